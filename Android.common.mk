@@ -3,7 +3,8 @@ LOCAL_CFLAGS += \
 	-DMAJOR_IN_SYSMACROS=1 \
 	-DHAVE_VISIBILITY=1 \
 	-fvisibility=hidden \
-	-DHAVE_LIBDRM_ATOMIC_PRIMITIVES=1
+	-DHAVE_LIBDRM_ATOMIC_PRIMITIVES=1 \
+	-DHAVE_LIBDRM_ATOMIC_BUILTINS=1
 
 LOCAL_CFLAGS += \
 	-Wno-error \
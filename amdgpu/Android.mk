@@ -10,6 +10,15 @@ LOCAL_SHARED_LIBRARIES := libdrm
 
 LOCAL_SRC_FILES := $(LIBDRM_AMDGPU_FILES)
 
+intermediates := $(call local-generated-sources-dir)
+LOCAL_GENERATED_SOURCES := $(intermediates)/amdgpu_asic_id_table.h
+LOCAL_C_INCLUDES += $(intermediates)
+
+$(intermediates)/amdgpu_asic_id_table.h: $(LOCAL_PATH)/gen_asic_id_table.py \
+		$(LOCAL_PATH)/../data/amdgpu.ids
+	@mkdir -p $(dir $@)
+	$(hide) $< $(word 2,$^) $@
+
 LOCAL_CFLAGS := \
 	-DAMDGPU_ASIC_ID_TABLE=\"/vendor/etc/hwdata/amdgpu.ids\"
 
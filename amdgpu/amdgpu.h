@@ -43,6 +43,8 @@ extern "C" {
 
 struct drm_amdgpu_info_hw_ip;
 struct drm_amdgpu_bo_list_entry;
+struct drm_amdgpu_cs_chunk_syncobj;
+struct _drmBOStats;
 
 /*--------------------------------------------------------------------------*/
 /* --------------------------- Defines ------------------------------------ */
@@ -67,6 +69,12 @@ struct drm_amdgpu_bo_list_entry;
  */
 #define AMDGPU_QUERY_FENCE_TIMEOUT_IS_ABSOLUTE     (1 << 0)
 
+/**
+ * Used in amdgpu_cs_query_fence_status(), meaning that the user fence of
+ * the ring may be polled for a short while before sleeping in the kernel.
+ */
+#define AMDGPU_QUERY_FENCE_SPIN                    (1 << 1)
+
 /*--------------------------------------------------------------------------*/
 /* ----------------------------- Enums ------------------------------------ */
 /*--------------------------------------------------------------------------*/
@@ -143,6 +151,41 @@ typedef struct amdgpu_va *amdgpu_va_handle;
  */
 typedef struct amdgpu_semaphore *amdgpu_semaphore_handle;
 
+/**
+ * Define handle for a slab suballocator of small buffers
+ */
+typedef struct amdgpu_bo_slab *amdgpu_bo_slab_handle;
+
+/**
+ * Define handle for a queue of GPU VA operations
+ */
+typedef struct amdgpu_bo_va_batch *amdgpu_bo_va_batch_handle;
+
+/**
+ * Define handle for a ring of staging memory for uploads
+ */
+typedef struct amdgpu_upload_ring *amdgpu_upload_ring_handle;
+
+/**
+ * Define handle for a pool of huge page backed host memory
+ */
+typedef struct amdgpu_host_pool *amdgpu_host_pool_handle;
+
+/**
+ * Define handle for an SDMA copy engine
+ */
+typedef struct amdgpu_sdma *amdgpu_sdma_handle;
+
+/**
+ * Define handle for a sensor sampler
+ */
+typedef struct amdgpu_sampler *amdgpu_sampler_handle;
+
+/**
+ * Define handle for a scheduler spreading submissions over rings
+ */
+typedef struct amdgpu_cs_scheduler *amdgpu_cs_scheduler_handle;
+
 /*--------------------------------------------------------------------------*/
 /* -------------------------- Structures ---------------------------------- */
 /*--------------------------------------------------------------------------*/
@@ -174,6 +217,72 @@ struct amdgpu_bo_alloc_request {
 	uint64_t flags;
 };
 
+/**
+ * Structure describing a suballocation of a slab buffer
+ *
+ * \sa amdgpu_bo_slab_alloc()
+ *
+*/
+struct amdgpu_bo_slab_entry {
+	/** Parent buffer the suballocation lives in */
+	amdgpu_bo_handle bo;
+
+	/** Offset of the suballocation in the parent buffer */
+	uint64_t offset;
+
+	/** Size of the suballocation, rounded up to its size class */
+	uint64_t size;
+
+	/** GPU virtual address of the suballocation */
+	uint64_t va;
+
+	/** CPU address, or NULL when the heap isn't CPU accessible */
+	void *cpu;
+};
+
+/**
+ * Structure describing a suballocation of a host memory pool
+ *
+ * \sa amdgpu_host_pool_alloc()
+ *
+*/
+struct amdgpu_host_pool_entry {
+	/** userptr buffer of the chunk the suballocation lives in */
+	amdgpu_bo_handle bo;
+
+	/** Offset of the suballocation in that buffer */
+	uint64_t offset;
+
+	/** Size of the suballocation, rounded up to 256 bytes */
+	uint64_t size;
+
+	/** GPU virtual address of the suballocation */
+	uint64_t va;
+
+	/** CPU address of the suballocation */
+	void *cpu;
+};
+
+/**
+ * Structure describing space handed out by an upload ring
+ *
+ * \sa amdgpu_upload_ring_alloc()
+ *
+*/
+struct amdgpu_upload_chunk {
+	/** Ring buffer the chunk lives in */
+	amdgpu_bo_handle bo;
+
+	/** Offset of the chunk in the ring buffer */
+	uint64_t offset;
+
+	/** GPU virtual address of the chunk */
+	uint64_t va;
+
+	/** CPU address of the chunk */
+	void *cpu;
+};
+
 /**
  * Special UMD specific information associated with buffer.
  *
@@ -285,6 +394,23 @@ struct amdgpu_cs_fence {
 	uint64_t fence;
 };
 
+/**
+ * Structure describing a sync object point to wait for
+ *
+ * \sa amdgpu_cs_wait_fences_multi()
+ *
+*/
+struct amdgpu_cs_syncobj_point {
+	/** Device the sync object belongs to */
+	amdgpu_device_handle dev;
+
+	/** Sync object handle */
+	uint32_t handle;
+
+	/** Timeline point, zero for binary sync objects */
+	uint64_t point;
+};
+
 /**
  * Structure describing IB
  *
@@ -586,6 +712,11 @@ int amdgpu_bo_set_metadata(amdgpu_bo_handle buf_handle,
  * Query buffer information including metadata previusly associated with
  * buffer.
  *
+ * The result is cached in the buffer handle, so only the first call asks
+ * the kernel.  amdgpu_bo_set_metadata() on the handle drops the cached
+ * copy; metadata set by other processes is only seen through
+ * amdgpu_bo_query_info2() with #AMDGPU_BO_QUERY_INFO_REFRESH.
+ *
  * \param   dev	       - \c [in] Device handle.
  *				 See #amdgpu_device_initialize()
  * \param   buf_handle - \c [in]   Buffer handle
@@ -599,6 +730,26 @@ int amdgpu_bo_set_metadata(amdgpu_bo_handle buf_handle,
 int amdgpu_bo_query_info(amdgpu_bo_handle buf_handle,
 			 struct amdgpu_bo_info *info);
 
+/* Ask the kernel even if the buffer information is cached. */
+#define AMDGPU_BO_QUERY_INFO_REFRESH	(1 << 0)
+
+/**
+ * Query buffer information like amdgpu_bo_query_info(), with flags.
+ *
+ * \param   buf_handle - \c [in]   Buffer handle
+ * \param   flags      - \c [in]   #AMDGPU_BO_QUERY_INFO_REFRESH for
+ *				   buffers whose metadata another process
+ *				   may have changed
+ * \param   info       - \c [out]  Structure describing buffer
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \sa amdgpu_bo_query_info()
+*/
+int amdgpu_bo_query_info2(amdgpu_bo_handle buf_handle, uint32_t flags,
+			  struct amdgpu_bo_info *info);
+
 /**
  * Allow others to get access to buffer
  *
@@ -721,6 +872,58 @@ int amdgpu_find_bo_by_cpu_mapping(amdgpu_device_handle dev,
 */
 int amdgpu_bo_free(amdgpu_bo_handle buf_handle);
 
+/**
+ * Keep freed buffers for reuse by later allocations
+ *
+ * Once enabled, amdgpu_bo_alloc() rounds sizes up to a cache bucket and
+ * first tries an idle cached buffer with the same heap and flags.
+ * amdgpu_bo_free() keeps the buffer for about a second instead of
+ * closing it.  Buffers that were exported as flink names or dma-bufs, or
+ * had metadata set, are never reused.
+ *
+ * \param   dev - \c [in] Device handle. See #amdgpu_device_initialize()
+ *
+ * \note Buffers must be unmapped from the GPU VA space before they are
+ *	 freed, and the contents of a reused buffer are undefined.
+ *
+ * \sa amdgpu_bo_alloc(), amdgpu_bo_free()
+ *
+*/
+void amdgpu_device_enable_bo_reuse(amdgpu_device_handle dev);
+
+/**
+ * Keep CPU mappings of buffers until the buffers are freed
+ *
+ * Once enabled, amdgpu_bo_cpu_unmap() of the last mapping leaves the
+ * buffer mapped, so that mapping it again is cheap.  The CPU address a
+ * buffer is mapped at then doesn't change for its lifetime.
+ *
+ * \param   dev - \c [in] Device handle. See #amdgpu_device_initialize()
+ *
+ * \note This uses more CPU address space, mostly for large VRAM buffers
+ *	 that are mapped once.
+ *
+ * \sa amdgpu_bo_cpu_map(), amdgpu_bo_cpu_unmap()
+ *
+*/
+void amdgpu_device_enable_persistent_cpu_maps(amdgpu_device_handle dev);
+
+/**
+ * Query the buffer memory held through the device
+ *
+ * Buffers waiting in the reuse cache count as allocated and as cached,
+ * buffers opened from flink names, dma-bufs or user memory as imported
+ * only.  Mapped counts the buffers with a CPU mapping.
+ *
+ * \param   dev   - \c [in] Device handle. See #amdgpu_device_initialize()
+ * \param   stats - \c [out] The counters, see drmBOStats in xf86drm.h
+ *
+ * \sa amdgpu_device_enable_bo_reuse()
+ *
+*/
+void amdgpu_device_get_bo_stats(amdgpu_device_handle dev,
+				struct _drmBOStats *stats);
+
 /**
  * Increase the reference count of a buffer object
  *
@@ -731,6 +934,248 @@ int amdgpu_bo_free(amdgpu_bo_handle buf_handle);
 */
 void amdgpu_bo_inc_ref(amdgpu_bo_handle bo);
 
+/**
+ * Create a suballocator for small buffers
+ *
+ * Suballocations of up to 64 KiB are carved out of larger parent buffers,
+ * which are mapped into the GPU VA space and, unless \c flags contains
+ * AMDGPU_GEM_CREATE_NO_CPU_ACCESS, the CPU address space for their whole
+ * lifetime.  Many suballocations then share a single entry in BO lists.
+ *
+ * \param   dev	    - \c [in] Device handle. See #amdgpu_device_initialize()
+ * \param   preferred_heap - \c [in] Heap of the parent buffers
+ * \param   flags	    - \c [in] Allocation flags of the parent buffers
+ * \param   slab	    - \c [out] Slab allocator handle
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \sa amdgpu_bo_slab_destroy(), amdgpu_bo_slab_alloc()
+ *
+*/
+int amdgpu_bo_slab_create(amdgpu_device_handle dev, uint32_t preferred_heap,
+			  uint64_t flags, amdgpu_bo_slab_handle *slab);
+
+/**
+ * Destroy a slab allocator and all of its parent buffers
+ *
+ * \param   slab - \c [in] Slab allocator handle
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \note All suballocations become invalid.
+ *
+*/
+int amdgpu_bo_slab_destroy(amdgpu_bo_slab_handle slab);
+
+/**
+ * Suballocate a small buffer
+ *
+ * The suballocation is aligned to its size class, a power of two between
+ * 256 bytes and 64 KiB.
+ *
+ * \param   slab  - \c [in] Slab allocator handle
+ * \param   size  - \c [in] Size in bytes, at most 64 KiB
+ * \param   entry - \c [out] Description of the suballocation
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \sa amdgpu_bo_slab_free()
+ *
+*/
+int amdgpu_bo_slab_alloc(amdgpu_bo_slab_handle slab, uint64_t size,
+			 struct amdgpu_bo_slab_entry **entry);
+
+/**
+ * Free a suballocation
+ *
+ * \param   entry - \c [in] Suballocation returned by amdgpu_bo_slab_alloc()
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \note As with amdgpu_bo_free(), the GPU must be done with it.
+ *
+*/
+int amdgpu_bo_slab_free(struct amdgpu_bo_slab_entry *entry);
+
+/**
+ * Create a ring of staging memory for CPU to GPU uploads
+ *
+ * The ring is a GTT buffer that stays mapped for the CPU and in the GPU VA
+ * space.  Space is handed out in order with amdgpu_upload_ring_alloc() and
+ * reused once the submissions passed to amdgpu_upload_ring_fence() have
+ * signaled.
+ *
+ * \param   dev	 - \c [in] Device handle. See #amdgpu_device_initialize()
+ * \param   size	 - \c [in] Size of the ring in bytes
+ * \param   flags - \c [in] Allocation flags of the ring buffer,
+ *			e.g. AMDGPU_GEM_CREATE_CPU_GTT_USWC
+ * \param   ring	 - \c [out] Upload ring handle
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \sa amdgpu_upload_ring_destroy(), amdgpu_upload_ring_create_from_user_mem()
+ *
+*/
+int amdgpu_upload_ring_create(amdgpu_device_handle dev, uint64_t size,
+			      uint64_t flags, amdgpu_upload_ring_handle *ring);
+
+/**
+ * Create an upload ring on user memory
+ *
+ * Like amdgpu_upload_ring_create(), but the GPU reads the user memory
+ * directly, see amdgpu_create_bo_from_user_mem().
+ *
+ * \param   dev	- \c [in] Device handle. See #amdgpu_device_initialize()
+ * \param   cpu	- \c [in] Page aligned user memory
+ * \param   size	- \c [in] Size in bytes, a multiple of the page size
+ * \param   ring	- \c [out] Upload ring handle
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+*/
+int amdgpu_upload_ring_create_from_user_mem(amdgpu_device_handle dev,
+					    void *cpu, uint64_t size,
+					    amdgpu_upload_ring_handle *ring);
+
+/**
+ * Destroy an upload ring
+ *
+ * \param   ring - \c [in] Upload ring handle
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \note As with amdgpu_bo_free(), the GPU must be done with it.
+ *
+*/
+int amdgpu_upload_ring_destroy(amdgpu_upload_ring_handle ring);
+
+/**
+ * Get space from an upload ring
+ *
+ * If the ring is full, the oldest submissions passed to
+ * amdgpu_upload_ring_fence() are waited for.  Their fences are checked with
+ * amdgpu_cs_query_fence_status(), which reads the user fence when the
+ * submission has one.
+ *
+ * \param   ring	    - \c [in] Upload ring handle
+ * \param   size	    - \c [in] Size in bytes
+ * \param   alignment  - \c [in] Power of two alignment, at most 4096
+ * \param   timeout_ns - \c [in] Timeout of each fence wait
+ * \param   chunk	    - \c [out] Description of the space
+ *
+ * \return   0 on success\n
+ *          -EBUSY - The ring is full and no fence signaled in time\n
+ *          -ENOSPC - The ring is full of space not fenced yet\n
+ *          <0 - Other negative POSIX Error code
+ *
+ * \sa amdgpu_upload_ring_fence()
+ *
+*/
+int amdgpu_upload_ring_alloc(amdgpu_upload_ring_handle ring, uint64_t size,
+			     uint64_t alignment, uint64_t timeout_ns,
+			     struct amdgpu_upload_chunk *chunk);
+
+/**
+ * Mark the space handed out so far as used by a submission
+ *
+ * \param   ring  - \c [in] Upload ring handle
+ * \param   fence - \c [in] Fence of the submission reading the space
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+*/
+int amdgpu_upload_ring_fence(amdgpu_upload_ring_handle ring,
+			     const struct amdgpu_cs_fence *fence);
+
+/**
+ * Back host pools with hugetlbfs pages rather than transparent huge pages
+ *
+ * \sa amdgpu_host_pool_create()
+ */
+#define AMDGPU_HOST_POOL_HUGETLB	(1 << 0)
+
+/**
+ * Create a pool of host memory the GPU accesses directly
+ *
+ * The pool maps anonymous memory in chunks aligned to 2 MiB, backed by
+ * transparent huge pages or, with AMDGPU_HOST_POOL_HUGETLB, by hugetlbfs
+ * pages if any are reserved.  Each chunk is registered once with
+ * amdgpu_create_bo_from_user_mem() and mapped into the GPU VA space at a
+ * 2 MiB aligned address, so pinning it and its page tables take far fewer
+ * entries than 4 KiB pages would.  Suballocations are carved out of the
+ * chunks and their space is reused after amdgpu_host_pool_free().
+ *
+ * \param   dev	- \c [in] Device handle. See #amdgpu_device_initialize()
+ * \param   chunk_size - \c [in] Size of the chunks, rounded up to 2 MiB,
+ *			0 for a default
+ * \param   flags	- \c [in] AMDGPU_HOST_POOL_* flags
+ * \param   pool	- \c [out] Host pool handle
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \sa amdgpu_host_pool_destroy(), amdgpu_host_pool_alloc()
+ *
+*/
+int amdgpu_host_pool_create(amdgpu_device_handle dev, uint64_t chunk_size,
+			    uint32_t flags, amdgpu_host_pool_handle *pool);
+
+/**
+ * Destroy a host pool and unmap all of its chunks
+ *
+ * \param   pool - \c [in] Host pool handle
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \note All suballocations become invalid, and the GPU must be done with
+ *       them.
+ *
+*/
+int amdgpu_host_pool_destroy(amdgpu_host_pool_handle pool);
+
+/**
+ * Suballocate host memory
+ *
+ * Requests larger than the chunk size get a chunk of their own.
+ *
+ * \param   pool	- \c [in] Host pool handle
+ * \param   size	- \c [in] Size in bytes
+ * \param   alignment - \c [in] Power of two alignment of the CPU and GPU
+ *			   addresses, at most 2 MiB, 0 for 256 bytes
+ * \param   entry	- \c [out] Description of the suballocation
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \sa amdgpu_host_pool_free()
+ *
+*/
+int amdgpu_host_pool_alloc(amdgpu_host_pool_handle pool, uint64_t size,
+			   uint64_t alignment,
+			   struct amdgpu_host_pool_entry **entry);
+
+/**
+ * Free a host pool suballocation
+ *
+ * \param   entry - \c [in] Suballocation returned by amdgpu_host_pool_alloc()
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \note As with amdgpu_bo_free(), the GPU must be done with it.
+ *
+*/
+int amdgpu_host_pool_free(struct amdgpu_host_pool_entry *entry);
+
 /**
  * Request CPU access to GPU accessible memory
  *
@@ -819,6 +1264,11 @@ int amdgpu_bo_list_destroy_raw(amdgpu_device_handle dev, uint32_t bo_list);
  * \return   0 on success\n
  *          <0 - Negative POSIX Error code
  *
+ * \note Buffers allocated with AMDGPU_GEM_CREATE_VM_ALWAYS_VALID are valid
+ *       in every submission of the VM and left out of the kernel list.  A
+ *       list of such buffers only doesn't create a kernel list, and
+ *       submissions with it pass no list.
+ *
  * \sa amdgpu_bo_list_destroy()
 */
 int amdgpu_bo_list_create(amdgpu_device_handle dev,
@@ -1003,6 +1453,39 @@ int amdgpu_cs_submit(amdgpu_context_handle context,
 		     struct amdgpu_cs_request *ibs_request,
 		     uint32_t number_of_requests);
 
+/**
+ * Submit a single request with its buffer list passed inline
+ *
+ * Like amdgpu_cs_submit() with one request, but the buffers the request
+ * accesses are handed to the kernel in the submission itself, so no BO
+ * list object has to be created and destroyed around it.
+ *
+ * \param   context             - \c [in]  GPU Context
+ * \param   flags               - \c [in]  Global submission flags
+ * \param   ibs_request         - \c [in/out] Submission request; its
+ *					   resources field is ignored
+ * \param   number_of_resources - \c [in]  Number of buffers in resources
+ * \param   resources           - \c [in]  Buffers accessed by the request
+ * \param   resource_prios      - \c [in]  Optional priorities for each
+ *					   buffer, may be NULL
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \note Needs a kernel with DRM interface 3.27 or later.
+ * \note Buffers allocated with AMDGPU_GEM_CREATE_VM_ALWAYS_VALID are left
+ *       out of the list; with no other buffers, no list is sent at all.
+ *
+ * \sa amdgpu_cs_submit(), amdgpu_bo_list_create()
+ *
+*/
+int amdgpu_cs_submit_bos(amdgpu_context_handle context,
+			 uint64_t flags,
+			 struct amdgpu_cs_request *ibs_request,
+			 uint32_t number_of_resources,
+			 amdgpu_bo_handle *resources,
+			 uint8_t *resource_prios);
+
 /**
  *  Query status of Command Buffer Submission
  *
@@ -1021,6 +1504,11 @@ int amdgpu_cs_submit(amdgpu_context_handle context,
  *	 returned in the case if submission was completed or timeout error
  *	 code.
  *
+ * \note When the last submission to the fence's ring used fence_info and
+ *	 the fence buffer is CPU mapped, the user fence is read first and an
+ *	 expired fence is reported without a system call.  The fence slot
+ *	 must then only be written by that ring.
+ *
  * \sa amdgpu_cs_submit()
 */
 int amdgpu_cs_query_fence_status(struct amdgpu_cs_fence *fence,
@@ -1051,6 +1539,37 @@ int amdgpu_cs_wait_fences(struct amdgpu_cs_fence *fences,
 			  uint64_t timeout_ns,
 			  uint32_t *status, uint32_t *first);
 
+/**
+ *  Wait for fences and sync objects from any number of devices
+ *
+ * \param   fences        - \c [in] The fence array to wait, may be NULL
+ * \param   fence_count   - \c [in] The fence count
+ * \param   syncobjs      - \c [in] The sync object points to wait, may be NULL
+ * \param   syncobj_count - \c [in] The sync object point count
+ * \param   wait_all      - \c [in] If true, wait all to be signaled,
+ *                                  otherwise, wait at least one
+ * \param   timeout_ns    - \c [in] The timeout to wait, in nanoseconds
+ * \param   status        - \c [out] '1' for signaled, '0' for timeout
+ * \param   first         - \c [out] the index of the first signaled entry,
+ *                                   counting @fences first, then @syncobjs
+ *
+ * \return  0 on success
+ *          <0 - Negative POSIX Error code
+ *
+ * \note    Fences are turned into sync_files and sync objects into eventfds,
+ *          which are then polled together.  Sync objects need DRM_IOCTL_SYNCOBJ_EVENTFD
+ *          or, failing that, a fence already attached to the point.  When
+ *          there are no sync objects and all fences come from one device,
+ *          this is the same as amdgpu_cs_wait_fences().
+*/
+int amdgpu_cs_wait_fences_multi(struct amdgpu_cs_fence *fences,
+				uint32_t fence_count,
+				const struct amdgpu_cs_syncobj_point *syncobjs,
+				uint32_t syncobj_count,
+				bool wait_all,
+				uint64_t timeout_ns,
+				uint32_t *status, uint32_t *first);
+
 /*
  * Query / Info API
  *
@@ -1088,6 +1607,7 @@ int amdgpu_query_buffer_size_alignment(amdgpu_device_handle dev,
  * \return   0 on success\n
  *          <0 - Negative POSIX Error code
  *
+ * \note Successful results are cached in the device.
 */
 int amdgpu_query_firmware_version(amdgpu_device_handle dev, unsigned fw_type,
 				  unsigned ip_instance, unsigned index,
@@ -1102,6 +1622,8 @@ int amdgpu_query_firmware_version(amdgpu_device_handle dev, unsigned fw_type,
  *
  * \return   0 on success\n
  *          <0 - Negative POSIX Error code
+ *
+ * \note Successful results are cached in the device.
 */
 int amdgpu_query_hw_ip_count(amdgpu_device_handle dev, unsigned type,
 			     uint32_t *count);
@@ -1119,6 +1641,8 @@ int amdgpu_query_hw_ip_count(amdgpu_device_handle dev, unsigned type,
  *
  * \return   0 on success\n
  *          <0 - Negative POSIX Error code
+ *
+ * \note Successful results are cached in the device.
 */
 int amdgpu_query_hw_ip_info(amdgpu_device_handle dev, unsigned type,
 			    unsigned ip_instance,
@@ -1215,6 +1739,7 @@ int amdgpu_query_sw_info(amdgpu_device_handle dev, enum amdgpu_sw_info info,
  * \return   0 on success\n
  *          <0 - Negative POSIX Error code
  *
+ * \note Successful results are cached in the device.
 */
 int amdgpu_query_gds_info(amdgpu_device_handle dev,
 			struct amdgpu_gds_resource_info *gds_info);
@@ -1237,6 +1762,101 @@ int amdgpu_query_gds_info(amdgpu_device_handle dev,
 int amdgpu_query_sensor_info(amdgpu_device_handle dev, unsigned sensor_type,
 			     unsigned size, void *value);
 
+/**
+ * Values for the mask of amdgpu_sampler_create() and the valid field of
+ * struct amdgpu_sensor_sample
+ */
+#define AMDGPU_SAMPLE_GFX_SCLK		(1 << 0)
+#define AMDGPU_SAMPLE_GFX_MCLK		(1 << 1)
+#define AMDGPU_SAMPLE_TEMPERATURE	(1 << 2)
+#define AMDGPU_SAMPLE_LOAD		(1 << 3)
+#define AMDGPU_SAMPLE_POWER		(1 << 4)
+#define AMDGPU_SAMPLE_VRAM_USAGE	(1 << 5)
+#define AMDGPU_SAMPLE_VIS_VRAM_USAGE	(1 << 6)
+#define AMDGPU_SAMPLE_GTT_USAGE		(1 << 7)
+
+/**
+ * One sample of the sensors of a sampler
+ *
+ * \sa amdgpu_sampler_read()
+*/
+struct amdgpu_sensor_sample {
+	/** CLOCK_MONOTONIC time the sample was complete */
+	uint64_t timestamp_ns;
+
+	/** Number of the sample, counting from 1 */
+	uint64_t sequence;
+
+	/** AMDGPU_SAMPLE_* bits of the values read successfully */
+	uint32_t valid;
+
+	/** Shader and memory clocks in MHz */
+	uint32_t gfx_sclk;
+	uint32_t gfx_mclk;
+
+	/** Temperature in millidegrees Celsius */
+	uint32_t temperature;
+
+	/** GPU load in percent */
+	uint32_t load;
+
+	/** Average power in watts */
+	uint32_t power;
+
+	/** Memory usage in bytes */
+	uint64_t vram_usage;
+	uint64_t vis_vram_usage;
+	uint64_t gtt_usage;
+};
+
+/**
+ * Create a sampler of the sensors and memory usage of a device
+ *
+ * A thread of the sampler queries the sensors selected by the mask every
+ * interval; readers get the latest sample without a syscall.  Sensors
+ * the kernel doesn't support are dropped from the mask after the first
+ * query.  The first sample is taken before this returns.
+ *
+ * \param   dev         - \c [in] Device handle. See #amdgpu_device_initialize()
+ * \param   mask        - \c [in] AMDGPU_SAMPLE_* bits to sample
+ * \param   interval_ns - \c [in] Interval between samples
+ * \param   sampler     - \c [out] Sampler handle
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \sa amdgpu_sampler_read(), amdgpu_sampler_destroy()
+*/
+int amdgpu_sampler_create(amdgpu_device_handle dev, uint32_t mask,
+			  uint64_t interval_ns,
+			  amdgpu_sampler_handle *sampler);
+
+/**
+ * Stop and free a sampler
+ *
+ * \param   sampler - \c [in] Sampler handle
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+*/
+int amdgpu_sampler_destroy(amdgpu_sampler_handle sampler);
+
+/**
+ * Copy the latest sample of a sampler
+ *
+ * Takes no lock and makes no syscall; any number of threads may read.
+ *
+ * \param   sampler - \c [in] Sampler handle
+ * \param   sample  - \c [out] The latest complete sample
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+*/
+int amdgpu_sampler_read(amdgpu_sampler_handle sampler,
+			struct amdgpu_sensor_sample *sample);
+
 /**
  * Read a set of consecutive memory-mapped registers.
  * Not all registers are allowed to be read by userspace.
@@ -1263,6 +1883,12 @@ int amdgpu_read_mm_registers(amdgpu_device_handle dev, unsigned dword_offset,
 */
 #define AMDGPU_VA_RANGE_32_BIT		0x1
 #define AMDGPU_VA_RANGE_HIGH		0x2
+/**
+ * Flag to serve small ranges from a per-thread cache that is refilled from
+ * the shared VA manager in batches.  Useful when many threads allocate VA
+ * concurrently; ranges are only handed out with the default alignment.
+ */
+#define AMDGPU_VA_RANGE_THREAD_CACHE	0x4
 
 /**
  * Allocate virtual address range
@@ -1393,6 +2019,88 @@ int amdgpu_bo_va_op_raw(amdgpu_device_handle dev,
 			uint64_t flags,
 			uint32_t ops);
 
+/**
+ * Used in amdgpu_bo_va_batch_create(), meaning that adjacent maps or
+ * replaces of consecutive ranges of the same buffer may become a single
+ * mapping.  Such mappings can then only be removed with AMDGPU_VA_OP_CLEAR
+ * or AMDGPU_VA_OP_REPLACE, not piece by piece with AMDGPU_VA_OP_UNMAP.
+ */
+#define AMDGPU_VA_BATCH_MERGE_MAPS	(1 << 0)
+
+/**
+ * Create a queue of GPU VA operations
+ *
+ * Operations added with amdgpu_bo_va_batch_add() are only sent to the
+ * kernel by amdgpu_bo_va_batch_flush().  Until then, an unmap followed by
+ * an identical map (or the reverse) cancels out, a replace or clear that
+ * covers the range of the previous map, replace or clear supersedes it,
+ * and touching clears are combined.  The queue must not be used by several
+ * threads at once.
+ *
+ * \param   dev   - \c [in] Device handle. See #amdgpu_device_initialize()
+ * \param   flags - \c [in] 0 or AMDGPU_VA_BATCH_MERGE_MAPS
+ * \param   batch - \c [out] Queue handle
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \sa amdgpu_bo_va_batch_destroy()
+ *
+*/
+int amdgpu_bo_va_batch_create(amdgpu_device_handle dev, uint32_t flags,
+			      amdgpu_bo_va_batch_handle *batch);
+
+/**
+ * Destroy a queue of GPU VA operations
+ *
+ * \param   batch - \c [in] Queue handle
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \note Operations that weren't flushed are dropped.
+ *
+*/
+int amdgpu_bo_va_batch_destroy(amdgpu_bo_va_batch_handle batch);
+
+/**
+ * Queue a GPU VA operation
+ *
+ * Takes the same parameters as amdgpu_bo_va_op_raw().  The queue holds a
+ * reference on \c bo until the operation is flushed.
+ *
+ * \param   batch  - \c [in] Queue handle
+ * \param   bo     - \c [in] BO handle (may be NULL)
+ * \param   offset - \c [in] Start offset to map
+ * \param   size   - \c [in] Size to map
+ * \param   addr   - \c [in] Start virtual address.
+ * \param   flags  - \c [in] Supported flags for mapping/unmapping
+ * \param   ops    - \c [in] AMDGPU_VA_OP_*
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+*/
+int amdgpu_bo_va_batch_add(amdgpu_bo_va_batch_handle batch,
+			   amdgpu_bo_handle bo,
+			   uint64_t offset,
+			   uint64_t size,
+			   uint64_t addr,
+			   uint64_t flags,
+			   uint32_t ops);
+
+/**
+ * Send the queued GPU VA operations to the kernel, in order
+ *
+ * \param   batch - \c [in] Queue handle
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code of the first operation that
+ *               failed.  The operations after it are dropped.
+ *
+*/
+int amdgpu_bo_va_batch_flush(amdgpu_bo_va_batch_handle batch);
+
 /**
  *  create semaphore
  *
@@ -1806,6 +2514,215 @@ void amdgpu_cs_chunk_fence_to_dep(struct amdgpu_cs_fence *fence,
 void amdgpu_cs_chunk_fence_info_to_data(struct amdgpu_cs_fence_info *fence_info,
 					struct drm_amdgpu_cs_chunk_data *data);
 
+/**
+ * Structure describing a submission for amdgpu_cs_submit_desc()
+ *
+ * Every array may be NULL when its count is 0.
+ *
+ * \sa amdgpu_cs_submit_desc()
+*/
+struct amdgpu_cs_submit_info {
+	/** Specify HW IP block type to which to send the IBs. */
+	unsigned ip_type;
+
+	/** IP instance index if there are several IPs of the same type. */
+	unsigned ip_instance;
+
+	/** Specify ring index of the IP. */
+	uint32_t ring;
+
+	/** IBs to submit together as single entity. */
+	uint32_t number_of_ibs;
+	const struct amdgpu_cs_ib_info *ibs;
+
+	/**
+	 * Raw BO list handle, see amdgpu_bo_list_create_raw(), or 0.
+	 * Mutually exclusive with bo_handles.
+	 */
+	uint32_t bo_list_handle;
+
+	/** Buffers used by the submission, passed without creating a list. */
+	uint32_t number_of_bo_handles;
+	const struct drm_amdgpu_bo_list_entry *bo_handles;
+
+	/** Fences of earlier submissions to wait for. */
+	uint32_t number_of_dependencies;
+	const struct amdgpu_cs_fence *dependencies;
+
+	/**
+	 * Syncobj points to wait for before execution starts, and to signal
+	 * when it finishes.  A point of 0 is a binary syncobj.
+	 */
+	uint32_t number_of_waits;
+	const struct drm_amdgpu_cs_chunk_syncobj *waits;
+	uint32_t number_of_signals;
+	const struct drm_amdgpu_cs_chunk_syncobj *signals;
+
+	/** User fence to write, if fence_info.handle isn't NULL. */
+	struct amdgpu_cs_fence_info fence_info;
+};
+
+/**
+ * Submit IBs together with their syncobj waits and signals.
+ *
+ * The CS chunks are assembled in a buffer kept per thread, so repeated
+ * submissions don't allocate.  The BO handle and syncobj arrays are
+ * passed to the kernel without a copy.
+ *
+ * \param   dev	       - \c [in] device handle
+ * \param   context    - \c [in] context handle for context id
+ * \param   info       - \c [in] description of the submission
+ * \param   seq_no     - \c [out] output sequence number for submission.
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \sa amdgpu_cs_submit_raw2()
+ */
+int amdgpu_cs_submit_desc(amdgpu_device_handle dev,
+			  amdgpu_context_handle context,
+			  const struct amdgpu_cs_submit_info *info,
+			  uint64_t *seq_no);
+
+/**
+ * Create a scheduler spreading the submissions of a context over the
+ * rings of an IP type
+ *
+ * Each submission goes to the ring with the least work of the context
+ * outstanding.  The priority is the one of the context, see
+ * amdgpu_cs_ctx_create2(); the kernel orders the work of each ring by it.
+ *
+ * \param   context            - \c [in] Context to submit on
+ * \param   ip_type            - \c [in] AMDGPU_HW_IP_*
+ * \param   max_ibs_per_submit - \c [in] How many IBs of consecutive
+ *				     requests may go in one submission, at most
+ *				     AMDGPU_CS_MAX_IBS_PER_SUBMIT; 0 or 1 to
+ *				     submit each request on its own
+ * \param   sched              - \c [out] Scheduler handle
+ *
+ * \return   0 on success\n
+ *          -ENODEV - The IP type has no rings\n
+ *          <0 - Other negative POSIX Error code
+ *
+ * \sa amdgpu_cs_scheduler_submit(), amdgpu_cs_scheduler_destroy()
+*/
+int amdgpu_cs_scheduler_create(amdgpu_context_handle context,
+			       unsigned ip_type,
+			       uint32_t max_ibs_per_submit,
+			       amdgpu_cs_scheduler_handle *sched);
+
+/**
+ * Destroy a scheduler
+ *
+ * \param   sched - \c [in] Scheduler handle
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+*/
+int amdgpu_cs_scheduler_destroy(amdgpu_cs_scheduler_handle sched);
+
+/**
+ * Submit requests on the least loaded rings
+ *
+ * ip_type, ip_instance and ring of the requests are set by the scheduler.
+ * Consecutive requests with the same flags and resources, and without
+ * dependencies or user fences after the first, share a submission while
+ * their IBs fit into max_ibs_per_submit.
+ *
+ * \param   sched    - \c [in] Scheduler handle
+ * \param   requests - \c [in/out] Requests; seq_no and ring are returned
+ * \param   count    - \c [in] Number of requests
+ * \param   fences   - \c [out] Fence of each request, or NULL
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code; earlier requests may have been
+ *               submitted
+ *
+*/
+int amdgpu_cs_scheduler_submit(amdgpu_cs_scheduler_handle sched,
+			       struct amdgpu_cs_request *requests,
+			       uint32_t count,
+			       struct amdgpu_cs_fence *fences);
+
+/**
+ * Create an engine for copies and fills on an SDMA ring
+ *
+ * The engine builds the SDMA packets in a pool of IBs of its own and
+ * reuses each IB once its last submission signaled.
+ *
+ * \param   dev     - \c [in] Device handle. See #amdgpu_device_initialize()
+ * \param   context - \c [in] Context to submit on
+ * \param   ring    - \c [in] Index of the SDMA ring
+ * \param   num_ibs - \c [in] Number of IBs in the pool, 0 for a default
+ * \param   sdma    - \c [out] SDMA engine handle
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \sa amdgpu_sdma_destroy(), amdgpu_sdma_copy(), amdgpu_sdma_fill()
+*/
+int amdgpu_sdma_create(amdgpu_device_handle dev,
+		       amdgpu_context_handle context,
+		       uint32_t ring, uint32_t num_ibs,
+		       amdgpu_sdma_handle *sdma);
+
+/**
+ * Destroy an SDMA engine
+ *
+ * \param   sdma - \c [in] SDMA engine handle
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+ * \note As with amdgpu_bo_free(), the GPU must be done with it.
+ *
+*/
+int amdgpu_sdma_destroy(amdgpu_sdma_handle sdma);
+
+/**
+ * Copy memory with SDMA
+ *
+ * Large copies are split into as many packets and submissions as needed.
+ * On SI, addresses and size must be multiples of 4.
+ *
+ * \param   sdma   - \c [in] SDMA engine handle
+ * \param   dst    - \c [in] Buffer of the destination, or NULL if it
+ *			    doesn't need to be in the BO list of the submission
+ * \param   dst_va - \c [in] GPU virtual address of the destination
+ * \param   src    - \c [in] Buffer of the source, or NULL
+ * \param   src_va - \c [in] GPU virtual address of the source
+ * \param   size   - \c [in] Size in bytes
+ * \param   fence  - \c [out] Fence of the last submission, or NULL
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+*/
+int amdgpu_sdma_copy(amdgpu_sdma_handle sdma,
+		     amdgpu_bo_handle dst, uint64_t dst_va,
+		     amdgpu_bo_handle src, uint64_t src_va,
+		     uint64_t size, struct amdgpu_cs_fence *fence);
+
+/**
+ * Fill memory with a 32-bit value with SDMA
+ *
+ * \param   sdma   - \c [in] SDMA engine handle
+ * \param   dst    - \c [in] Buffer of the destination, or NULL
+ * \param   dst_va - \c [in] GPU virtual address, a multiple of 4
+ * \param   value  - \c [in] Value to write
+ * \param   size   - \c [in] Size in bytes, a multiple of 4
+ * \param   fence  - \c [out] Fence of the last submission, or NULL
+ *
+ * \return   0 on success\n
+ *          <0 - Negative POSIX Error code
+ *
+*/
+int amdgpu_sdma_fill(amdgpu_sdma_handle sdma,
+		     amdgpu_bo_handle dst, uint64_t dst_va,
+		     uint32_t value, uint64_t size,
+		     struct amdgpu_cs_fence *fence);
+
 /**
  * Reserve VMID
  * \param   context - \c [in]  GPU Context
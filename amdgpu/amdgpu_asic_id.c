@@ -34,6 +34,40 @@
 #include "amdgpu_drm.h"
 #include "amdgpu_internal.h"
 
+struct amdgpu_asic_id {
+	uint16_t did;
+	uint8_t rid;
+	const char *name;
+};
+
+/* Generated at build time from amdgpu.ids, sorted by did then rid */
+#include "amdgpu_asic_id_table.h"
+
+static int compare_asic_id(const void *a, const void *b)
+{
+	const struct amdgpu_asic_id *ka = a, *kb = b;
+
+	if (ka->did != kb->did)
+		return ka->did < kb->did ? -1 : 1;
+	return (int)ka->rid - (int)kb->rid;
+}
+
+static const char *find_builtin_asic_id(struct amdgpu_device *dev)
+{
+	struct amdgpu_asic_id key = {};
+	const struct amdgpu_asic_id *id;
+
+	if (dev->info.asic_id > UINT16_MAX || dev->info.pci_rev_id > UINT8_MAX)
+		return NULL;
+
+	key.did = dev->info.asic_id;
+	key.rid = dev->info.pci_rev_id;
+	id = bsearch(&key, amdgpu_asic_ids,
+		     sizeof(amdgpu_asic_ids) / sizeof(amdgpu_asic_ids[0]),
+		     sizeof(amdgpu_asic_ids[0]), compare_asic_id);
+	return id ? id->name : NULL;
+}
+
 static int parse_one_line(struct amdgpu_device *dev, const char *line)
 {
 	char *buf, *saveptr;
@@ -106,6 +140,7 @@ out:
 
 void amdgpu_parse_asic_ids(struct amdgpu_device *dev)
 {
+	const char *name;
 	FILE *fp;
 	char *line = NULL;
 	size_t len = 0;
@@ -113,6 +148,16 @@ void amdgpu_parse_asic_ids(struct amdgpu_device *dev)
 	int line_num = 1;
 	int r = 0;
 
+	/*
+	 * The table built from amdgpu.ids covers everything this libdrm was
+	 * released with; the installed file is only read for newer devices.
+	 */
+	name = find_builtin_asic_id(dev);
+	if (name) {
+		dev->marketing_name = strdup(name);
+		return;
+	}
+
 	fp = fopen(AMDGPU_ASIC_ID_TABLE, "r");
 	if (!fp) {
 		fprintf(stderr, "%s: %s\n", AMDGPU_ASIC_ID_TABLE,
@@ -47,9 +47,12 @@ static int amdgpu_close_kms_handle(int fd, uint32_t handle)
 	return drmIoctl(fd, DRM_IOCTL_GEM_CLOSE, &args);
 }
 
+static void amdgpu_cpu_map_remove(struct amdgpu_bo *bo);
+
 static int amdgpu_bo_create(amdgpu_device_handle dev,
 			    uint64_t size,
 			    uint32_t handle,
+			    bool imported,
 			    amdgpu_bo_handle *buf_handle)
 {
 	struct amdgpu_bo *bo;
@@ -59,17 +62,31 @@ static int amdgpu_bo_create(amdgpu_device_handle dev,
 	if (!bo)
 		return -ENOMEM;
 
+	/* Lockless lookups may find the buffer as soon as it is inserted. */
+	atomic_set(&bo->refcount, 1);
+	bo->dev = dev;
+	bo->alloc_size = size;
+	bo->handle = handle;
+	bo->serial = ++dev->bo_serial;
+	bo->imported = imported;
+	pthread_mutex_init(&bo->cpu_access_mutex, NULL);
+	pthread_mutex_init(&bo->info_mutex, NULL);
+
 	r = handle_table_insert(&dev->bo_handles, handle, bo);
 	if (r) {
+		pthread_mutex_destroy(&bo->info_mutex);
+		pthread_mutex_destroy(&bo->cpu_access_mutex);
 		free(bo);
 		return r;
 	}
 
-	atomic_set(&bo->refcount, 1);
-	bo->dev = dev;
-	bo->alloc_size = size;
-	bo->handle = handle;
-	pthread_mutex_init(&bo->cpu_access_mutex, NULL);
+	if (imported) {
+		dev->import_size += size;
+		dev->import_count++;
+	} else {
+		dev->alloc_size += size;
+		dev->alloc_count++;
+	}
 
 	*buf_handle = bo;
 	return 0;
@@ -80,10 +97,20 @@ drm_public int amdgpu_bo_alloc(amdgpu_device_handle dev,
 			       amdgpu_bo_handle *buf_handle)
 {
 	union drm_amdgpu_gem_create args;
+	struct amdgpu_bo *bo;
+	uint64_t size;
 	int r;
 
+	pthread_mutex_lock(&dev->bo_table_mutex);
+	bo = amdgpu_bo_cache_alloc(&dev->bo_cache, alloc_buffer, &size);
+	pthread_mutex_unlock(&dev->bo_table_mutex);
+	if (bo) {
+		*buf_handle = bo;
+		return 0;
+	}
+
 	memset(&args, 0, sizeof(args));
-	args.in.bo_size = alloc_buffer->alloc_size;
+	args.in.bo_size = size;
 	args.in.alignment = alloc_buffer->phys_alignment;
 
 	/* Set the placement. */
@@ -97,8 +124,16 @@ drm_public int amdgpu_bo_alloc(amdgpu_device_handle dev,
 		goto out;
 
 	pthread_mutex_lock(&dev->bo_table_mutex);
-	r = amdgpu_bo_create(dev, alloc_buffer->alloc_size, args.out.handle,
-			     buf_handle);
+	r = amdgpu_bo_create(dev, size, args.out.handle, false, buf_handle);
+	if (!r) {
+		bo = *buf_handle;
+		bo->phys_alignment = alloc_buffer->phys_alignment;
+		bo->flags = alloc_buffer->flags;
+		bo->preferred_heap = alloc_buffer->preferred_heap;
+		bo->reusable = true;
+		bo->always_valid = !!(alloc_buffer->flags &
+				      AMDGPU_GEM_CREATE_VM_ALWAYS_VALID);
+	}
 	pthread_mutex_unlock(&dev->bo_table_mutex);
 	if (r) {
 		amdgpu_close_kms_handle(dev->fd, args.out.handle);
@@ -112,6 +147,7 @@ drm_public int amdgpu_bo_set_metadata(amdgpu_bo_handle bo,
 				      struct amdgpu_bo_metadata *info)
 {
 	struct drm_amdgpu_gem_metadata args = {};
+	int r;
 
 	args.handle = bo->handle;
 	args.op = AMDGPU_GEM_METADATA_OP_SET_METADATA;
@@ -121,28 +157,35 @@ drm_public int amdgpu_bo_set_metadata(amdgpu_bo_handle bo,
 	if (info->size_metadata > sizeof(args.data.data))
 		return -EINVAL;
 
+	/* Don't hand out stale metadata from the reuse cache. */
+	bo->reusable = false;
+
 	if (info->size_metadata) {
 		args.data.data_size_bytes = info->size_metadata;
 		memcpy(args.data.data, info->umd_metadata, info->size_metadata);
 	}
 
-	return drmCommandWriteRead(bo->dev->fd,
-				   DRM_AMDGPU_GEM_METADATA,
-				   &args, sizeof(args));
+	r = drmCommandWriteRead(bo->dev->fd,
+				DRM_AMDGPU_GEM_METADATA,
+				&args, sizeof(args));
+
+	/* Also on failure, what the kernel holds is unknown then. */
+	pthread_mutex_lock(&bo->info_mutex);
+	bo->info_valid = false;
+	bo->info_seq++;
+	pthread_mutex_unlock(&bo->info_mutex);
+
+	return r;
 }
 
-drm_public int amdgpu_bo_query_info(amdgpu_bo_handle bo,
-				    struct amdgpu_bo_info *info)
+static int amdgpu_bo_query_info_kernel(amdgpu_bo_handle bo,
+				       struct amdgpu_bo_info *info)
 {
 	struct drm_amdgpu_gem_metadata metadata = {};
 	struct drm_amdgpu_gem_create_in bo_info = {};
 	struct drm_amdgpu_gem_op gem_op = {};
 	int r;
 
-	/* Validate the BO passed in */
-	if (!bo->handle)
-		return -EINVAL;
-
 	/* Query metadata. */
 	metadata.handle = bo->handle;
 	metadata.op = AMDGPU_GEM_METADATA_OP_GET_METADATA;
@@ -182,6 +225,51 @@ drm_public int amdgpu_bo_query_info(amdgpu_bo_handle bo,
 	return 0;
 }
 
+drm_public int amdgpu_bo_query_info2(amdgpu_bo_handle bo, uint32_t flags,
+				     struct amdgpu_bo_info *info)
+{
+	uint32_t seq;
+	int r;
+
+	/* Validate the BO passed in */
+	if (!bo->handle || (flags & ~AMDGPU_BO_QUERY_INFO_REFRESH))
+		return -EINVAL;
+
+	pthread_mutex_lock(&bo->info_mutex);
+	if (bo->info_valid && !(flags & AMDGPU_BO_QUERY_INFO_REFRESH)) {
+		*info = *bo->info;
+		pthread_mutex_unlock(&bo->info_mutex);
+		return 0;
+	}
+	seq = bo->info_seq;
+	pthread_mutex_unlock(&bo->info_mutex);
+
+	r = amdgpu_bo_query_info_kernel(bo, info);
+	if (r)
+		return r;
+
+	/* Unless the metadata was set meanwhile, this is the current
+	 * state.  Without memory for the copy the next query asks again. */
+	pthread_mutex_lock(&bo->info_mutex);
+	if (bo->info_seq == seq) {
+		if (!bo->info)
+			bo->info = malloc(sizeof(*bo->info));
+		if (bo->info) {
+			*bo->info = *info;
+			bo->info_valid = true;
+		}
+	}
+	pthread_mutex_unlock(&bo->info_mutex);
+
+	return 0;
+}
+
+drm_public int amdgpu_bo_query_info(amdgpu_bo_handle bo,
+				    struct amdgpu_bo_info *info)
+{
+	return amdgpu_bo_query_info2(bo, 0, info);
+}
+
 static int amdgpu_bo_export_flink(amdgpu_bo_handle bo)
 {
 	struct drm_gem_flink flink;
@@ -233,6 +321,7 @@ drm_public int amdgpu_bo_export(amdgpu_bo_handle bo,
 
 	switch (type) {
 	case amdgpu_bo_handle_type_gem_flink_name:
+		bo->reusable = false;
 		r = amdgpu_bo_export_flink(bo);
 		if (r)
 			return r;
@@ -246,6 +335,7 @@ drm_public int amdgpu_bo_export(amdgpu_bo_handle bo,
 		return 0;
 
 	case amdgpu_bo_handle_type_dma_buf_fd:
+		bo->reusable = false;
 		return drmPrimeHandleToFD(bo->dev->fd, bo->handle,
 					  DRM_CLOEXEC | DRM_RDWR,
 					  (int*)shared_handle);
@@ -253,6 +343,64 @@ drm_public int amdgpu_bo_export(amdgpu_bo_handle bo,
 	return -EINVAL;
 }
 
+#if HAVE_LIBDRM_ATOMIC_PRIMITIVES
+/*
+ * Find a buffer and take a reference on it without bo_table_mutex.  Returns
+ * NULL if it isn't in the table or is already being freed.
+ */
+static struct amdgpu_bo *amdgpu_bo_lookup_lockless(struct handle_table *table,
+						   uint32_t key)
+{
+	struct amdgpu_bo *bo;
+	int idx;
+
+	idx = handle_table_read_begin(table);
+	bo = handle_table_lookup_lockless(table, key);
+	if (bo && atomic_add_unless(&bo->refcount, 1, 0))
+		bo = NULL;
+	handle_table_read_end(table, idx);
+
+	return bo;
+}
+
+/* Import of a buffer that is already imported, without bo_table_mutex. */
+static struct amdgpu_bo *amdgpu_bo_import_lockless(amdgpu_device_handle dev,
+						   enum amdgpu_bo_handle_type type,
+						   uint32_t shared_handle)
+{
+	struct amdgpu_bo *bo;
+	uint32_t handle;
+
+	switch (type) {
+	case amdgpu_bo_handle_type_gem_flink_name:
+		return amdgpu_bo_lookup_lockless(&dev->bo_flink_names,
+						 shared_handle);
+
+	case amdgpu_bo_handle_type_dma_buf_fd:
+		if (drmPrimeFDToHandle(dev->fd, shared_handle, &handle))
+			return NULL;
+		bo = amdgpu_bo_lookup_lockless(&dev->bo_handles, handle);
+		if (!bo)
+			return NULL;
+
+		/* The handle may have been closed and reused for another
+		 * buffer before the reference was taken.  Now that the
+		 * reference pins it, ask again. */
+		if (drmPrimeFDToHandle(dev->fd, shared_handle, &handle) ||
+		    handle != bo->handle) {
+			amdgpu_bo_free(bo);
+			return NULL;
+		}
+		return bo;
+
+	case amdgpu_bo_handle_type_kms:
+	case amdgpu_bo_handle_type_kms_noimport:
+	default:
+		return NULL;
+	}
+}
+#endif
+
 drm_public int amdgpu_bo_import(amdgpu_device_handle dev,
 				enum amdgpu_bo_handle_type type,
 				uint32_t shared_handle,
@@ -263,34 +411,35 @@ drm_public int amdgpu_bo_import(amdgpu_device_handle dev,
 	uint32_t handle = 0, flink_name = 0;
 	uint64_t alloc_size = 0;
 	int r = 0;
-	int dma_fd;
-	uint64_t dma_buf_size = 0;
+	int dma_fd, dma_fd_in = shared_handle;
+	off_t size;
+
+#if HAVE_LIBDRM_ATOMIC_PRIMITIVES
+	bo = amdgpu_bo_import_lockless(dev, type, shared_handle);
+	if (bo) {
+		output->buf_handle = bo;
+		output->alloc_size = bo->alloc_size;
+		return 0;
+	}
+#endif
 
 	/* We must maintain a list of pairs <handle, bo>, so that we always
-	 * return the same amdgpu_bo instance for the same handle. */
-	pthread_mutex_lock(&dev->bo_table_mutex);
+	 * return the same amdgpu_bo instance for the same handle.  Queued
+	 * closes must not run between getting the handle and inserting it. */
+	pthread_mutex_lock(&dev->close_mutex);
 
-	/* Convert a DMA buf handle to a KMS handle now. */
+	/* Convert a DMA buf handle to a KMS handle now.  Other imports wait
+	 * for close_mutex, so nobody else can insert this handle until we
+	 * drop it and bo_table_mutex needn't be held across the ioctl. */
 	if (type == amdgpu_bo_handle_type_dma_buf_fd) {
-		off_t size;
-
-		/* Get a KMS handle. */
 		r = drmPrimeFDToHandle(dev->fd, shared_handle, &handle);
 		if (r)
-			goto unlock;
-
-		/* Query the buffer size. */
-		size = lseek(shared_handle, 0, SEEK_END);
-		if (size == (off_t)-1) {
-			r = -errno;
-			goto free_bo_handle;
-		}
-		lseek(shared_handle, 0, SEEK_SET);
-
-		dma_buf_size = size;
+			goto unlock_close;
 		shared_handle = handle;
 	}
 
+	pthread_mutex_lock(&dev->bo_table_mutex);
+
 	/* If we have already created a buffer with this handle, find it. */
 	switch (type) {
 	case amdgpu_bo_handle_type_gem_flink_name:
@@ -316,6 +465,7 @@ drm_public int amdgpu_bo_import(amdgpu_device_handle dev,
 		/* The buffer already exists, just bump the refcount. */
 		atomic_inc(&bo->refcount);
 		pthread_mutex_unlock(&dev->bo_table_mutex);
+		pthread_mutex_unlock(&dev->close_mutex);
 
 		output->buf_handle = bo;
 		output->alloc_size = bo->alloc_size;
@@ -351,8 +501,19 @@ drm_public int amdgpu_bo_import(amdgpu_device_handle dev,
 		break;
 
 	case amdgpu_bo_handle_type_dma_buf_fd:
+		/* Only a new buffer needs its size. */
+		pthread_mutex_unlock(&dev->bo_table_mutex);
+		size = lseek(dma_fd_in, 0, SEEK_END);
+		if (size == (off_t)-1)
+			r = -errno;
+		else
+			lseek(dma_fd_in, 0, SEEK_SET);
+		pthread_mutex_lock(&dev->bo_table_mutex);
+		if (r)
+			goto free_bo_handle;
+
 		handle = shared_handle;
-		alloc_size = dma_buf_size;
+		alloc_size = size;
 		break;
 
 	case amdgpu_bo_handle_type_kms:
@@ -361,7 +522,7 @@ drm_public int amdgpu_bo_import(amdgpu_device_handle dev,
 	}
 
 	/* Initialize it. */
-	r = amdgpu_bo_create(dev, alloc_size, handle, &bo);
+	r = amdgpu_bo_create(dev, alloc_size, handle, true, &bo);
 	if (r)
 		goto free_bo_handle;
 
@@ -377,51 +538,173 @@ drm_public int amdgpu_bo_import(amdgpu_device_handle dev,
 	output->buf_handle = bo;
 	output->alloc_size = bo->alloc_size;
 	pthread_mutex_unlock(&dev->bo_table_mutex);
+	pthread_mutex_unlock(&dev->close_mutex);
 	return 0;
 
 free_bo_handle:
 	if (flink_name && open_arg.handle)
 		amdgpu_close_kms_handle(dev->flink_fd, open_arg.handle);
 
-	if (bo)
-		amdgpu_bo_free(bo);
-	else
+	if (bo) {
+		if (update_references(&bo->refcount, NULL))
+			amdgpu_bo_destroy(bo);
+	} else
 		amdgpu_close_kms_handle(dev->fd, handle);
 unlock:
 	pthread_mutex_unlock(&dev->bo_table_mutex);
+unlock_close:
+	amdgpu_bo_close_flush(dev);
+	pthread_mutex_unlock(&dev->close_mutex);
 	return r;
 }
 
+static int amdgpu_bo_close_reserve(struct amdgpu_bo_close_list *list)
+{
+	struct amdgpu_bo_close *items;
+	uint32_t max;
+
+	if (list->count < list->max)
+		return 0;
+
+	max = MAX2(list->max * 2, 16);
+	items = realloc(list->items, max * sizeof(*items));
+	if (!items)
+		return -ENOMEM;
+
+	list->items = items;
+	list->max = max;
+	return 0;
+}
+
+/*
+ * Called with bo_table_mutex held once the last reference is gone.  The
+ * handle and CPU mapping are queued and released by amdgpu_bo_close_flush()
+ * after the lock is dropped.
+ */
+drm_private void amdgpu_bo_destroy(struct amdgpu_bo *bo)
+{
+	struct amdgpu_device *dev = bo->dev;
+	struct amdgpu_bo_close *item;
+
+	/* Remove the buffer from the hash tables. */
+	handle_table_remove(&dev->bo_handles, bo->handle);
+	if (bo->imported) {
+		dev->import_size -= bo->alloc_size;
+		dev->import_count--;
+	} else {
+		dev->alloc_size -= bo->alloc_size;
+		dev->alloc_count--;
+	}
+
+	if (bo->flink_name)
+		handle_table_remove(&dev->bo_flink_names, bo->flink_name);
+
+	/* Wait out lockless lookups that may have found it. */
+	handle_table_synchronize(&dev->bo_handles);
+	if (bo->flink_name)
+		handle_table_synchronize(&dev->bo_flink_names);
+
+	if (amdgpu_bo_close_reserve(&dev->closes)) {
+		/* No memory to queue it, release it right away. */
+		amdgpu_bo_cpu_unmap_all(bo);
+		amdgpu_close_kms_handle(dev->fd, bo->handle);
+	} else {
+		item = &dev->closes.items[dev->closes.count++];
+		item->handle = bo->handle;
+		item->cpu_ptr = bo->cpu_ptr;
+		item->size = bo->alloc_size;
+		if (bo->cpu_ptr)
+			amdgpu_cpu_map_remove(bo);
+	}
+
+	pthread_mutex_destroy(&bo->info_mutex);
+	pthread_mutex_destroy(&bo->cpu_access_mutex);
+	free(bo->info);
+	free(bo);
+}
+
+/*
+ * Releases what amdgpu_bo_destroy() queued.  Called with close_mutex held,
+ * without bo_table_mutex.  Buffers destroyed meanwhile are queued for the
+ * next caller, so contended frees batch their ioctls.
+ */
+drm_private void amdgpu_bo_close_flush(struct amdgpu_device *dev)
+{
+	struct amdgpu_bo_close_list list;
+	uint32_t i;
+
+	/* Swap in the empty spare list. */
+	pthread_mutex_lock(&dev->bo_table_mutex);
+	list = dev->closes;
+	dev->closes = dev->closing;
+	pthread_mutex_unlock(&dev->bo_table_mutex);
+
+	for (i = 0; i < list.count; i++) {
+		if (list.items[i].cpu_ptr)
+			drm_munmap(list.items[i].cpu_ptr, list.items[i].size);
+		amdgpu_close_kms_handle(dev->fd, list.items[i].handle);
+	}
+
+	list.count = 0;
+	dev->closing = list;
+}
+
+drm_public void amdgpu_device_enable_bo_reuse(amdgpu_device_handle dev)
+{
+	pthread_mutex_lock(&dev->bo_table_mutex);
+	amdgpu_bo_cache_init(&dev->bo_cache);
+	pthread_mutex_unlock(&dev->bo_table_mutex);
+}
+
+drm_public void
+amdgpu_device_enable_persistent_cpu_maps(amdgpu_device_handle dev)
+{
+	dev->persistent_cpu_maps = true;
+}
+
+drm_public void amdgpu_device_get_bo_stats(amdgpu_device_handle dev,
+					   struct _drmBOStats *stats)
+{
+	pthread_mutex_lock(&dev->bo_table_mutex);
+	stats->allocated_bytes = dev->alloc_size;
+	stats->allocated_count = dev->alloc_count;
+	stats->cached_bytes = dev->bo_cache.size;
+	stats->cached_count = dev->bo_cache.count;
+	stats->imported_bytes = dev->import_size;
+	stats->imported_count = dev->import_count;
+
+	/* cpu_map_mutex is taken last */
+	pthread_mutex_lock(&dev->cpu_map_mutex);
+	stats->mapped_bytes = dev->cpu_map_size;
+	stats->mapped_count = dev->num_cpu_maps;
+	pthread_mutex_unlock(&dev->cpu_map_mutex);
+	pthread_mutex_unlock(&dev->bo_table_mutex);
+}
+
 drm_public int amdgpu_bo_free(amdgpu_bo_handle buf_handle)
 {
 	struct amdgpu_device *dev;
 	struct amdgpu_bo *bo = buf_handle;
+	bool pending;
 
 	assert(bo != NULL);
 	dev = bo->dev;
 	pthread_mutex_lock(&dev->bo_table_mutex);
 
-	if (update_references(&bo->refcount, NULL)) {
-		/* Remove the buffer from the hash tables. */
-		handle_table_remove(&dev->bo_handles, bo->handle);
-
-		if (bo->flink_name)
-			handle_table_remove(&dev->bo_flink_names,
-					    bo->flink_name);
+	if (update_references(&bo->refcount, NULL) &&
+	    amdgpu_bo_cache_free(&dev->bo_cache, bo))
+		amdgpu_bo_destroy(bo);
 
-		/* Release CPU access. */
-		if (bo->cpu_map_count > 0) {
-			bo->cpu_map_count = 1;
-			amdgpu_bo_cpu_unmap(bo);
-		}
+	pending = dev->closes.count != 0;
+	pthread_mutex_unlock(&dev->bo_table_mutex);
 
-		amdgpu_close_kms_handle(dev->fd, bo->handle);
-		pthread_mutex_destroy(&bo->cpu_access_mutex);
-		free(bo);
+	/* Close the handles before returning, so their memory is released. */
+	if (pending) {
+		pthread_mutex_lock(&dev->close_mutex);
+		amdgpu_bo_close_flush(dev);
+		pthread_mutex_unlock(&dev->close_mutex);
 	}
 
-	pthread_mutex_unlock(&dev->bo_table_mutex);
-
 	return 0;
 }
 
@@ -430,24 +713,90 @@ drm_public void amdgpu_bo_inc_ref(amdgpu_bo_handle bo)
 	atomic_inc(&bo->refcount);
 }
 
+/* Index of the first mapping that starts after @cpu. Needs cpu_map_mutex. */
+static uint32_t amdgpu_cpu_map_upper_bound(struct amdgpu_device *dev,
+					   const void *cpu)
+{
+	uint32_t lo = 0, hi = dev->num_cpu_maps, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if ((uintptr_t)dev->cpu_maps[mid]->cpu_ptr <= (uintptr_t)cpu)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static int amdgpu_cpu_map_insert(struct amdgpu_bo *bo)
+{
+	struct amdgpu_device *dev = bo->dev;
+	struct amdgpu_bo **maps;
+	uint32_t i, max;
+
+	pthread_mutex_lock(&dev->cpu_map_mutex);
+	if (dev->num_cpu_maps == dev->max_cpu_maps) {
+		max = MAX2(dev->max_cpu_maps * 2, 64);
+		maps = realloc(dev->cpu_maps, max * sizeof(*maps));
+		if (!maps) {
+			pthread_mutex_unlock(&dev->cpu_map_mutex);
+			return -ENOMEM;
+		}
+		dev->cpu_maps = maps;
+		dev->max_cpu_maps = max;
+	}
+
+	i = amdgpu_cpu_map_upper_bound(dev, bo->cpu_ptr);
+	memmove(&dev->cpu_maps[i + 1], &dev->cpu_maps[i],
+		(dev->num_cpu_maps - i) * sizeof(*dev->cpu_maps));
+	dev->cpu_maps[i] = bo;
+	dev->num_cpu_maps++;
+	dev->cpu_map_size += bo->alloc_size;
+	pthread_mutex_unlock(&dev->cpu_map_mutex);
+
+	return 0;
+}
+
+static void amdgpu_cpu_map_remove(struct amdgpu_bo *bo)
+{
+	struct amdgpu_device *dev = bo->dev;
+	uint32_t i;
+
+	pthread_mutex_lock(&dev->cpu_map_mutex);
+	i = amdgpu_cpu_map_upper_bound(dev, bo->cpu_ptr);
+	if (i > 0 && dev->cpu_maps[i - 1] == bo) {
+		memmove(&dev->cpu_maps[i - 1], &dev->cpu_maps[i],
+			(dev->num_cpu_maps - i) * sizeof(*dev->cpu_maps));
+		dev->num_cpu_maps--;
+		dev->cpu_map_size -= bo->alloc_size;
+	}
+	pthread_mutex_unlock(&dev->cpu_map_mutex);
+}
+
 drm_public int amdgpu_bo_cpu_map(amdgpu_bo_handle bo, void **cpu)
 {
 	union drm_amdgpu_gem_mmap args;
 	void *ptr;
 	int r;
 
+	/* Already mapped: the count can't drop to zero under us. */
+	if (!atomic_add_unless(&bo->cpu_map_count, 1, 0)) {
+		*cpu = bo->cpu_ptr;
+		return 0;
+	}
+
 	pthread_mutex_lock(&bo->cpu_access_mutex);
 
 	if (bo->cpu_ptr) {
-		/* already mapped */
-		assert(bo->cpu_map_count > 0);
-		bo->cpu_map_count++;
+		/* mapped, or kept mapped by persistent_cpu_maps */
+		atomic_inc(&bo->cpu_map_count);
 		*cpu = bo->cpu_ptr;
 		pthread_mutex_unlock(&bo->cpu_access_mutex);
 		return 0;
 	}
 
-	assert(bo->cpu_map_count == 0);
+	assert(atomic_read(&bo->cpu_map_count) == 0);
 
 	memset(&args, 0, sizeof(args));
 
@@ -471,39 +820,79 @@ drm_public int amdgpu_bo_cpu_map(amdgpu_bo_handle bo, void **cpu)
 	}
 
 	bo->cpu_ptr = ptr;
-	bo->cpu_map_count = 1;
+	r = amdgpu_cpu_map_insert(bo);
+	if (r) {
+		drm_munmap(ptr, bo->alloc_size);
+		bo->cpu_ptr = NULL;
+		pthread_mutex_unlock(&bo->cpu_access_mutex);
+		return r;
+	}
+	/* A full barrier, so cpu_ptr is visible before the count is. */
+	atomic_inc(&bo->cpu_map_count);
 	pthread_mutex_unlock(&bo->cpu_access_mutex);
 
 	*cpu = ptr;
 	return 0;
 }
 
-drm_public int amdgpu_bo_cpu_unmap(amdgpu_bo_handle bo)
+/* Drops one of several mappings, never the last one. */
+static bool amdgpu_bo_cpu_unmap_shared(struct amdgpu_bo *bo)
+{
+	int c, old;
+
+	c = atomic_read(&bo->cpu_map_count);
+	while (c > 1) {
+		old = atomic_cmpxchg(&bo->cpu_map_count, c, c - 1);
+		if (old == c)
+			return true;
+		c = old;
+	}
+	return false;
+}
+
+/* Needs cpu_access_mutex. */
+static int amdgpu_bo_cpu_release(struct amdgpu_bo *bo)
 {
 	int r;
 
+	amdgpu_cpu_map_remove(bo);
+	r = drm_munmap(bo->cpu_ptr, bo->alloc_size) == 0 ? 0 : -errno;
+	bo->cpu_ptr = NULL;
+	return r;
+}
+
+drm_public int amdgpu_bo_cpu_unmap(amdgpu_bo_handle bo)
+{
+	int r = 0;
+
+	if (amdgpu_bo_cpu_unmap_shared(bo))
+		return 0;
+
 	pthread_mutex_lock(&bo->cpu_access_mutex);
-	assert(bo->cpu_map_count >= 0);
+	assert(atomic_read(&bo->cpu_map_count) >= 0);
 
-	if (bo->cpu_map_count == 0) {
+	if (atomic_read(&bo->cpu_map_count) == 0) {
 		/* not mapped */
 		pthread_mutex_unlock(&bo->cpu_access_mutex);
 		return -EINVAL;
 	}
 
-	bo->cpu_map_count--;
-	if (bo->cpu_map_count > 0) {
-		/* mapped multiple times */
-		pthread_mutex_unlock(&bo->cpu_access_mutex);
-		return 0;
-	}
-
-	r = drm_munmap(bo->cpu_ptr, bo->alloc_size) == 0 ? 0 : -errno;
-	bo->cpu_ptr = NULL;
+	if (atomic_dec_and_test(&bo->cpu_map_count) &&
+	    !bo->dev->persistent_cpu_maps)
+		r = amdgpu_bo_cpu_release(bo);
 	pthread_mutex_unlock(&bo->cpu_access_mutex);
 	return r;
 }
 
+drm_private void amdgpu_bo_cpu_unmap_all(struct amdgpu_bo *bo)
+{
+	pthread_mutex_lock(&bo->cpu_access_mutex);
+	if (bo->cpu_ptr)
+		amdgpu_bo_cpu_release(bo);
+	atomic_set(&bo->cpu_map_count, 0);
+	pthread_mutex_unlock(&bo->cpu_access_mutex);
+}
+
 drm_public int amdgpu_query_buffer_size_alignment(amdgpu_device_handle dev,
 				struct amdgpu_buffer_size_alignments *info)
 {
@@ -541,7 +930,8 @@ drm_public int amdgpu_find_bo_by_cpu_mapping(amdgpu_device_handle dev,
 					     amdgpu_bo_handle *buf_handle,
 					     uint64_t *offset_in_bo)
 {
-	struct amdgpu_bo *bo;
+	struct amdgpu_bo *bo = NULL;
+	uint64_t offset = 0;
 	uint32_t i;
 	int r = 0;
 
@@ -552,21 +942,26 @@ drm_public int amdgpu_find_bo_by_cpu_mapping(amdgpu_device_handle dev,
 	 * Workaround for a buggy application which tries to import previously
 	 * exposed CPU pointers. If we find a real world use case we should
 	 * improve that by asking the kernel for the right handle.
+	 *
+	 * Mappings don't overlap, so only the last one starting at or below
+	 * @cpu can contain it.  bo_table_mutex keeps the buffer from being
+	 * freed before the reference is taken.
 	 */
 	pthread_mutex_lock(&dev->bo_table_mutex);
-	for (i = 0; i < dev->bo_handles.max_key; i++) {
-		bo = handle_table_lookup(&dev->bo_handles, i);
-		if (!bo || !bo->cpu_ptr || size > bo->alloc_size)
-			continue;
-		if (cpu >= bo->cpu_ptr &&
-		    cpu < (void*)((uintptr_t)bo->cpu_ptr + bo->alloc_size))
-			break;
+	pthread_mutex_lock(&dev->cpu_map_mutex);
+	i = amdgpu_cpu_map_upper_bound(dev, cpu);
+	if (i > 0) {
+		bo = dev->cpu_maps[i - 1];
+		offset = (uintptr_t)cpu - (uintptr_t)bo->cpu_ptr;
+		if (size > bo->alloc_size || offset >= bo->alloc_size)
+			bo = NULL;
 	}
+	pthread_mutex_unlock(&dev->cpu_map_mutex);
 
-	if (i < dev->bo_handles.max_key) {
+	if (bo) {
 		atomic_inc(&bo->refcount);
 		*buf_handle = bo;
-		*offset_in_bo = (uintptr_t)cpu - (uintptr_t)bo->cpu_ptr;
+		*offset_in_bo = offset;
 	} else {
 		*buf_handle = NULL;
 		*offset_in_bo = 0;
@@ -595,7 +990,7 @@ drm_public int amdgpu_create_bo_from_user_mem(amdgpu_device_handle dev,
 		goto out;
 
 	pthread_mutex_lock(&dev->bo_table_mutex);
-	r = amdgpu_bo_create(dev, size, args.handle, buf_handle);
+	r = amdgpu_bo_create(dev, size, args.handle, true, buf_handle);
 	pthread_mutex_unlock(&dev->bo_table_mutex);
 	if (r) {
 		amdgpu_close_kms_handle(dev->fd, args.handle);
@@ -639,58 +1034,128 @@ drm_public int amdgpu_bo_list_destroy_raw(amdgpu_device_handle dev,
 				   &args, sizeof(args));
 }
 
+static int amdgpu_bo_list_item_compare(const void *pa, const void *pb)
+{
+	const struct amdgpu_bo_list_item *a = pa, *b = pb;
+
+	if (a->bo_handle != b->bo_handle)
+		return a->bo_handle < b->bo_handle ? -1 : 1;
+	if (a->serial != b->serial)
+		return a->serial < b->serial ? -1 : 1;
+	if (a->bo_priority != b->bo_priority)
+		return a->bo_priority < b->bo_priority ? -1 : 1;
+	return 0;
+}
+
+/*
+ * Fills items with the sorted contents of a list of resources and returns
+ * their number.  Always valid buffers are left out, the kernel doesn't need
+ * them in a list.
+ */
+static uint32_t amdgpu_bo_list_fill(struct amdgpu_bo_list_item *items,
+				    uint32_t number_of_resources,
+				    amdgpu_bo_handle *resources,
+				    uint8_t *resource_prios)
+{
+	uint32_t i, n = 0;
+
+	for (i = 0; i < number_of_resources; i++) {
+		if (resources[i]->always_valid)
+			continue;
+		items[n].serial = resources[i]->serial;
+		items[n].bo_handle = resources[i]->handle;
+		if (resource_prios)
+			items[n].bo_priority = resource_prios[i];
+		else
+			items[n].bo_priority = 0;
+		n++;
+	}
+	qsort(items, n, sizeof(*items), amdgpu_bo_list_item_compare);
+	return n;
+}
+
+static int amdgpu_bo_list_send(amdgpu_device_handle dev, uint32_t operation,
+			       uint32_t *list_handle,
+			       struct amdgpu_bo_list_item *items,
+			       uint32_t number_of_items)
+{
+	struct drm_amdgpu_bo_list_entry stack_list[256];
+	struct drm_amdgpu_bo_list_entry *list = stack_list;
+	union drm_amdgpu_bo_list args;
+	unsigned i;
+	int r;
+
+	if (number_of_items > sizeof(stack_list) / sizeof(stack_list[0])) {
+		list = malloc(number_of_items * sizeof(struct drm_amdgpu_bo_list_entry));
+		if (!list)
+			return -ENOMEM;
+	}
+
+	for (i = 0; i < number_of_items; i++) {
+		list[i].bo_handle = items[i].bo_handle;
+		list[i].bo_priority = items[i].bo_priority;
+	}
+
+	memset(&args, 0, sizeof(args));
+	args.in.operation = operation;
+	args.in.list_handle = *list_handle;
+	args.in.bo_number = number_of_items;
+	args.in.bo_info_size = sizeof(struct drm_amdgpu_bo_list_entry);
+	args.in.bo_info_ptr = (uint64_t)(uintptr_t)list;
+
+	r = drmCommandWriteRead(dev->fd, DRM_AMDGPU_BO_LIST,
+				&args, sizeof(args));
+	if (list != stack_list)
+		free(list);
+	if (!r && operation == AMDGPU_BO_LIST_OP_CREATE)
+		*list_handle = args.out.list_handle;
+	return r;
+}
+
 drm_public int amdgpu_bo_list_create(amdgpu_device_handle dev,
 				     uint32_t number_of_resources,
 				     amdgpu_bo_handle *resources,
 				     uint8_t *resource_prios,
 				     amdgpu_bo_list_handle *result)
 {
-	struct drm_amdgpu_bo_list_entry *list;
-	union drm_amdgpu_bo_list args;
-	unsigned i;
+	struct amdgpu_bo_list_item *items;
+	uint32_t handle = 0, n;
 	int r;
 
 	if (!number_of_resources)
 		return -EINVAL;
 
 	/* overflow check for multiplication */
-	if (number_of_resources > UINT32_MAX / sizeof(struct drm_amdgpu_bo_list_entry))
+	if (number_of_resources > UINT32_MAX / sizeof(struct amdgpu_bo_list_item))
 		return -EINVAL;
 
-	list = malloc(number_of_resources * sizeof(struct drm_amdgpu_bo_list_entry));
-	if (!list)
+	items = malloc(number_of_resources * sizeof(struct amdgpu_bo_list_item));
+	if (!items)
 		return -ENOMEM;
 
-	*result = malloc(sizeof(struct amdgpu_bo_list));
+	*result = calloc(1, sizeof(struct amdgpu_bo_list));
 	if (!*result) {
-		free(list);
+		free(items);
 		return -ENOMEM;
 	}
 
-	memset(&args, 0, sizeof(args));
-	args.in.operation = AMDGPU_BO_LIST_OP_CREATE;
-	args.in.bo_number = number_of_resources;
-	args.in.bo_info_size = sizeof(struct drm_amdgpu_bo_list_entry);
-	args.in.bo_info_ptr = (uint64_t)(uintptr_t)list;
-
-	for (i = 0; i < number_of_resources; i++) {
-		list[i].bo_handle = resources[i]->handle;
-		if (resource_prios)
-			list[i].bo_priority = resource_prios[i];
-		else
-			list[i].bo_priority = 0;
-	}
+	n = amdgpu_bo_list_fill(items, number_of_resources, resources,
+				resource_prios);
 
-	r = drmCommandWriteRead(dev->fd, DRM_AMDGPU_BO_LIST,
-				&args, sizeof(args));
-	free(list);
+	/* A list of always valid buffers only has no kernel list behind it. */
+	r = n ? amdgpu_bo_list_send(dev, AMDGPU_BO_LIST_OP_CREATE, &handle,
+				    items, n) : 0;
 	if (r) {
+		free(items);
 		free(*result);
 		return r;
 	}
 
 	(*result)->dev = dev;
-	(*result)->handle = args.out.list_handle;
+	(*result)->handle = handle;
+	(*result)->items = items;
+	(*result)->num_items = n;
+	(*result)->max_items = number_of_resources;
 	return 0;
 }
 
@@ -703,54 +1168,83 @@ drm_public int amdgpu_bo_list_destroy(amdgpu_bo_list_handle list)
 	args.in.operation = AMDGPU_BO_LIST_OP_DESTROY;
 	args.in.list_handle = list->handle;
 
-	r = drmCommandWriteRead(list->dev->fd, DRM_AMDGPU_BO_LIST,
-				&args, sizeof(args));
+	r = list->handle ? drmCommandWriteRead(list->dev->fd,
+					       DRM_AMDGPU_BO_LIST,
+					       &args, sizeof(args)) : 0;
 
-	if (!r)
+	if (!r) {
+		free(list->items);
+		free(list->scratch);
 		free(list);
+	}
 
 	return r;
 }
 
+/*
+ * The kernel can only replace a list as a whole, so the list remembers what
+ * it last sent, sorted.  An update that sorts to the same buffers and
+ * priorities doesn't need the ioctl at all.
+ */
 drm_public int amdgpu_bo_list_update(amdgpu_bo_list_handle handle,
 				     uint32_t number_of_resources,
 				     amdgpu_bo_handle *resources,
 				     uint8_t *resource_prios)
 {
-	struct drm_amdgpu_bo_list_entry *list;
-	union drm_amdgpu_bo_list args;
-	unsigned i;
+	struct amdgpu_bo_list_item *items;
+	uint32_t max, n;
 	int r;
 
 	if (!number_of_resources)
 		return -EINVAL;
 
 	/* overflow check for multiplication */
-	if (number_of_resources > UINT32_MAX / sizeof(struct drm_amdgpu_bo_list_entry))
+	if (number_of_resources > UINT32_MAX / sizeof(struct amdgpu_bo_list_item))
 		return -EINVAL;
 
-	list = malloc(number_of_resources * sizeof(struct drm_amdgpu_bo_list_entry));
-	if (!list)
-		return -ENOMEM;
+	if (!handle->scratch || number_of_resources > handle->max_items) {
+		max = MAX2(number_of_resources, handle->max_items);
+		items = realloc(handle->scratch, max * sizeof(*items));
+		if (!items)
+			return -ENOMEM;
+		handle->scratch = items;
+
+		items = realloc(handle->items, max * sizeof(*items));
+		if (!items)
+			return -ENOMEM;
+		handle->items = items;
+		handle->max_items = max;
+	}
 
-	args.in.operation = AMDGPU_BO_LIST_OP_UPDATE;
-	args.in.list_handle = handle->handle;
-	args.in.bo_number = number_of_resources;
-	args.in.bo_info_size = sizeof(struct drm_amdgpu_bo_list_entry);
-	args.in.bo_info_ptr = (uintptr_t)list;
+	items = handle->scratch;
+	n = amdgpu_bo_list_fill(items, number_of_resources, resources,
+				resource_prios);
 
-	for (i = 0; i < number_of_resources; i++) {
-		list[i].bo_handle = resources[i]->handle;
-		if (resource_prios)
-			list[i].bo_priority = resource_prios[i];
-		else
-			list[i].bo_priority = 0;
+	if (n == handle->num_items &&
+	    !memcmp(items, handle->items, n * sizeof(*items)))
+		return 0;
+
+	if (!n) {
+		r = amdgpu_bo_list_destroy_raw(handle->dev, handle->handle);
+		if (!r)
+			handle->handle = 0;
+	} else if (!handle->handle) {
+		r = amdgpu_bo_list_send(handle->dev, AMDGPU_BO_LIST_OP_CREATE,
+					&handle->handle, items, n);
+	} else {
+		r = amdgpu_bo_list_send(handle->dev, AMDGPU_BO_LIST_OP_UPDATE,
+					&handle->handle, items, n);
+	}
+	if (r) {
+		/* What the kernel list holds is unknown now. */
+		handle->num_items = 0;
+		return r;
 	}
 
-	r = drmCommandWriteRead(handle->dev->fd, DRM_AMDGPU_BO_LIST,
-				&args, sizeof(args));
-	free(list);
-	return r;
+	handle->scratch = handle->items;
+	handle->items = items;
+	handle->num_items = n;
+	return 0;
 }
 
 drm_public int amdgpu_bo_va_op(amdgpu_bo_handle bo,
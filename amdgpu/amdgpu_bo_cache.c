@@ -0,0 +1,210 @@
+/*
+ * Copyright 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Size bucketed cache of freed buffers, along the lines of the intel and
+ * freedreno ones.  All of it runs under dev->bo_table_mutex.
+ */
+
+#include <time.h>
+
+#include "amdgpu.h"
+#include "amdgpu_drm.h"
+#include "amdgpu_internal.h"
+#include "util_math.h"
+
+static void add_bucket(struct amdgpu_bo_cache *cache, uint64_t size)
+{
+	unsigned int i = cache->num_buckets;
+
+	assert(i < sizeof(cache->cache_bucket) / sizeof(cache->cache_bucket[0]));
+
+	list_inithead(&cache->cache_bucket[i].list);
+	cache->cache_bucket[i].size = size;
+	cache->num_buckets++;
+}
+
+drm_private void amdgpu_bo_cache_init(struct amdgpu_bo_cache *cache)
+{
+	uint64_t size, cache_max_size = 64 * 1024 * 1024;
+
+	if (cache->num_buckets)
+		return;
+
+	/* Three sizes between each power of two, as freedreno does. */
+	add_bucket(cache, 4096);
+	add_bucket(cache, 4096 * 2);
+	add_bucket(cache, 4096 * 3);
+
+	for (size = 4 * 4096; size <= cache_max_size; size *= 2) {
+		add_bucket(cache, size);
+		add_bucket(cache, size + size * 1 / 4);
+		add_bucket(cache, size + size * 2 / 4);
+		add_bucket(cache, size + size * 3 / 4);
+	}
+}
+
+/* Frees cached buffers that have been idle for more than a second. */
+static void amdgpu_bo_cache_cleanup(struct amdgpu_bo_cache *cache, time_t time)
+{
+	struct amdgpu_bo_bucket *bucket;
+	struct amdgpu_bo *bo;
+	int i;
+
+	if (cache->time == time)
+		return;
+
+	for (i = 0; i < cache->num_buckets; i++) {
+		bucket = &cache->cache_bucket[i];
+
+		while (!LIST_IS_EMPTY(&bucket->list)) {
+			bo = LIST_ENTRY(struct amdgpu_bo, bucket->list.next,
+					cache_list);
+			if (time - bo->free_time <= 1)
+				break;
+
+			list_del(&bo->cache_list);
+			cache->size -= bo->alloc_size;
+			cache->count--;
+			amdgpu_bo_destroy(bo);
+		}
+	}
+
+	cache->time = time;
+}
+
+drm_private void amdgpu_bo_cache_fini(struct amdgpu_bo_cache *cache)
+{
+	struct amdgpu_bo *bo, *tmp;
+	int i;
+
+	for (i = 0; i < cache->num_buckets; i++) {
+		LIST_FOR_EACH_ENTRY_SAFE(bo, tmp, &cache->cache_bucket[i].list,
+					 cache_list) {
+			list_del(&bo->cache_list);
+			amdgpu_bo_destroy(bo);
+		}
+	}
+	cache->num_buckets = 0;
+	cache->size = 0;
+	cache->count = 0;
+}
+
+static struct amdgpu_bo_bucket *get_bucket(struct amdgpu_bo_cache *cache,
+					   uint64_t size)
+{
+	struct amdgpu_bo_bucket *bucket;
+	unsigned order;
+	int i;
+
+	/* The index follows from the sizes set up by amdgpu_bo_cache_init(). */
+	if (size <= 4 * 4096) {
+		i = size ? (size - 1) / 4096 : 0;
+	} else {
+		/* size is in (2^order, 2^(order + 1)] */
+		order = 63 - __builtin_clzll(size - 1);
+		i = 4 * (order - 14) + 4 +
+		    ((size - 1 - (1ull << order)) >> (order - 2));
+	}
+
+	if (i >= cache->num_buckets)
+		return NULL;
+
+	bucket = &cache->cache_bucket[i];
+	assert(bucket->size >= size);
+	return bucket;
+}
+
+static bool amdgpu_bo_cache_match(struct amdgpu_bo *bo,
+				  struct amdgpu_bo_alloc_request *alloc_buffer)
+{
+	/* Alignments are powers of two, so a larger one satisfies a smaller. */
+	return bo->preferred_heap == alloc_buffer->preferred_heap &&
+	       bo->flags == alloc_buffer->flags &&
+	       bo->phys_alignment >= alloc_buffer->phys_alignment;
+}
+
+/*
+ * Returns a cached buffer for the request, or NULL.  In both cases *size is
+ * set to the size to allocate, which is rounded up to the bucket size.
+ */
+drm_private struct amdgpu_bo *
+amdgpu_bo_cache_alloc(struct amdgpu_bo_cache *cache,
+		      struct amdgpu_bo_alloc_request *alloc_buffer,
+		      uint64_t *size)
+{
+	struct amdgpu_bo_bucket *bucket;
+	struct amdgpu_bo *bo;
+	bool busy;
+
+	*size = alloc_buffer->alloc_size;
+	bucket = get_bucket(cache, ALIGN(*size, 4096));
+	if (!bucket)
+		return NULL;
+	*size = bucket->size;
+
+	/* Oldest first: if that one is still busy the rest likely are too. */
+	LIST_FOR_EACH_ENTRY(bo, &bucket->list, cache_list) {
+		if (!amdgpu_bo_cache_match(bo, alloc_buffer))
+			continue;
+
+		if (amdgpu_bo_wait_for_idle(bo, 0, &busy) || busy)
+			return NULL;
+
+		list_del(&bo->cache_list);
+		cache->size -= bo->alloc_size;
+		cache->count--;
+		atomic_set(&bo->refcount, 1);
+		return bo;
+	}
+
+	return NULL;
+}
+
+/* Takes a buffer whose last reference is gone.  Returns -1 if it can't be
+ * cached and has to be destroyed instead. */
+drm_private int amdgpu_bo_cache_free(struct amdgpu_bo_cache *cache,
+				     struct amdgpu_bo *bo)
+{
+	struct amdgpu_bo_bucket *bucket;
+	struct timespec time;
+
+	if (!bo->reusable)
+		return -1;
+
+	bucket = get_bucket(cache, bo->alloc_size);
+	if (!bucket || bucket->size != bo->alloc_size)
+		return -1;
+
+	/* Release CPU access, as amdgpu_bo_destroy() would. */
+	amdgpu_bo_cpu_unmap_all(bo);
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	bo->free_time = time.tv_sec;
+	list_addtail(&bo->cache_list, &bucket->list);
+	cache->size += bo->alloc_size;
+	cache->count++;
+	amdgpu_bo_cache_cleanup(cache, time.tv_sec);
+
+	return 0;
+}
@@ -25,8 +25,11 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
+#include <poll.h>
 #include <pthread.h>
 #include <sched.h>
+#include <unistd.h>
 #include <sys/ioctl.h>
 #ifdef HAVE_ALLOCA_H
 # include <alloca.h>
@@ -35,6 +38,7 @@
 #include "xf86drm.h"
 #include "amdgpu_drm.h"
 #include "amdgpu_internal.h"
+#include "util_math.h"
 
 static int amdgpu_cs_unreference_sem(amdgpu_semaphore_handle sem);
 static int amdgpu_cs_reset_sem(amdgpu_semaphore_handle sem);
@@ -54,7 +58,6 @@ drm_public int amdgpu_cs_ctx_create2(amdgpu_device_handle dev,
 {
 	struct amdgpu_context *gpu_context;
 	union drm_amdgpu_ctx args;
-	int i, j, k;
 	int r;
 
 	if (!dev || !context)
@@ -80,10 +83,6 @@ drm_public int amdgpu_cs_ctx_create2(amdgpu_device_handle dev,
 		goto error;
 
 	gpu_context->id = args.out.alloc.ctx_id;
-	for (i = 0; i < AMDGPU_HW_IP_NUM; i++)
-		for (j = 0; j < AMDGPU_HW_IP_INSTANCE_MAX_COUNT; j++)
-			for (k = 0; k < AMDGPU_CS_MAX_RINGS; k++)
-				list_inithead(&gpu_context->sem_list[i][j][k]);
 	*context = (amdgpu_context_handle)gpu_context;
 
 	return 0;
@@ -111,6 +110,7 @@ drm_public int amdgpu_cs_ctx_create(amdgpu_device_handle dev,
 drm_public int amdgpu_cs_ctx_free(amdgpu_context_handle context)
 {
 	union drm_amdgpu_ctx args;
+	amdgpu_semaphore_handle sem, next;
 	int i, j, k;
 	int r;
 
@@ -128,12 +128,14 @@ drm_public int amdgpu_cs_ctx_free(amdgpu_context_handle context)
 	for (i = 0; i < AMDGPU_HW_IP_NUM; i++) {
 		for (j = 0; j < AMDGPU_HW_IP_INSTANCE_MAX_COUNT; j++) {
 			for (k = 0; k < AMDGPU_CS_MAX_RINGS; k++) {
-				amdgpu_semaphore_handle sem;
-				LIST_FOR_EACH_ENTRY(sem, &context->sem_list[i][j][k], list) {
-					list_del(&sem->list);
+				for (sem = context->sem_list[i][j][k]; sem;
+				     sem = next) {
+					next = sem->next;
 					amdgpu_cs_reset_sem(sem);
 					amdgpu_cs_unreference_sem(sem);
 				}
+				if (context->user_fence[i][j][k].bo)
+					amdgpu_bo_free(context->user_fence[i][j][k].bo);
 			}
 		}
 	}
@@ -217,18 +219,57 @@ drm_public int amdgpu_cs_query_reset_state2(amdgpu_context_handle context,
  * \return  0 on success otherwise POSIX Error code
  * \sa amdgpu_cs_submit()
 */
+/* Dependencies and inline BO lists that fit here are built without
+ * allocating. */
+#define AMDGPU_CS_STACK_DEPS 64
+#define AMDGPU_CS_STACK_BOS 256
+
+static void amdgpu_cs_fence_to_dep(struct amdgpu_cs_fence *info,
+				   struct drm_amdgpu_cs_chunk_dep *dep)
+{
+	dep->ip_type = info->ip_type;
+	dep->ip_instance = info->ip_instance;
+	dep->ring = info->ring;
+	dep->ctx_id = info->context->id;
+	dep->handle = info->fence;
+}
+
+/* Pushes the chain first..last onto a sem_list. */
+static void amdgpu_cs_push_sems(amdgpu_semaphore_handle *head,
+				amdgpu_semaphore_handle first,
+				amdgpu_semaphore_handle last)
+{
+	last->next = __atomic_load_n(head, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(head, &last->next, first, true,
+					    __ATOMIC_RELEASE,
+					    __ATOMIC_RELAXED))
+		;
+}
+
+/*
+ * Only publishing last_seq needs sequence_mutex; the semaphores to wait
+ * for are taken from a lock-free list and the chunks are built and
+ * submitted without it, so threads submitting to different rings of one
+ * context don't serialize.
+ */
 static int amdgpu_cs_submit_one(amdgpu_context_handle context,
-				struct amdgpu_cs_request *ibs_request)
+				struct amdgpu_cs_request *ibs_request,
+				struct drm_amdgpu_bo_list_in *bo_list)
 {
 	union drm_amdgpu_cs cs;
 	uint64_t *chunk_array;
 	struct drm_amdgpu_cs_chunk *chunks;
 	struct drm_amdgpu_cs_chunk_data *chunk_data;
-	struct drm_amdgpu_cs_chunk_dep *dependencies = NULL;
-	struct drm_amdgpu_cs_chunk_dep *sem_dependencies = NULL;
-	struct list_head *sem_list;
-	amdgpu_semaphore_handle sem, tmp;
+	struct drm_amdgpu_cs_chunk_dep stack_deps[AMDGPU_CS_STACK_DEPS];
+	struct drm_amdgpu_cs_chunk_dep *dependencies = stack_deps;
+	struct drm_amdgpu_cs_chunk_sem stack_sems[AMDGPU_CS_STACK_DEPS];
+	struct drm_amdgpu_cs_chunk_sem *syncobjs = stack_sems;
+	amdgpu_semaphore_handle *sem_list, sems, sem, last_sem = NULL;
 	uint32_t i, size, sem_count = 0;
+	struct amdgpu_user_fence *uf;
+	amdgpu_bo_handle old_fence_bo = NULL;
+	uint64_t *last_seq;
+	drmSubmitTrace trace;
 	bool user_fence;
 	int r = 0;
 
@@ -242,7 +283,8 @@ static int amdgpu_cs_submit_one(amdgpu_context_handle context,
 	}
 	user_fence = (ibs_request->fence_info.handle != NULL);
 
-	size = ibs_request->number_of_ibs + (user_fence ? 2 : 1) + 1;
+	size = ibs_request->number_of_ibs + (user_fence ? 2 : 1) + 1 +
+	       (bo_list ? 1 : 0);
 
 	chunk_array = alloca(sizeof(uint64_t) * size);
 	chunks = alloca(sizeof(struct drm_amdgpu_cs_chunk) * size);
@@ -251,10 +293,35 @@ static int amdgpu_cs_submit_one(amdgpu_context_handle context,
 
 	chunk_data = alloca(sizeof(struct drm_amdgpu_cs_chunk_data) * size);
 
+	/* Take the semaphores this submission has to wait for. */
+	sem_list = &context->sem_list[ibs_request->ip_type][ibs_request->ip_instance][ibs_request->ring];
+	sems = __atomic_exchange_n(sem_list, NULL, __ATOMIC_ACQUIRE);
+	for (sem = sems; sem; sem = sem->next) {
+		if (sem->syncobj)
+			sem_count++;
+		last_sem = sem;
+	}
+
+	if (ibs_request->number_of_dependencies > AMDGPU_CS_STACK_DEPS) {
+		dependencies = malloc(sizeof(struct drm_amdgpu_cs_chunk_dep) *
+				      ibs_request->number_of_dependencies);
+		if (!dependencies) {
+			r = -ENOMEM;
+			goto error_sems;
+		}
+	}
+	if (sem_count > AMDGPU_CS_STACK_DEPS) {
+		syncobjs = malloc(sizeof(*syncobjs) * sem_count);
+		if (!syncobjs) {
+			r = -ENOMEM;
+			goto error_sems;
+		}
+	}
+
 	memset(&cs, 0, sizeof(cs));
 	cs.in.chunks = (uint64_t)(uintptr_t)chunk_array;
 	cs.in.ctx_id = context->id;
-	if (ibs_request->resources)
+	if (ibs_request->resources && !bo_list)
 		cs.in.bo_list_handle = ibs_request->resources->handle;
 	cs.in.num_chunks = ibs_request->number_of_ibs;
 	/* IB chunks */
@@ -276,8 +343,6 @@ static int amdgpu_cs_submit_one(amdgpu_context_handle context,
 		chunk_data[i].ib_data.flags = ib->flags;
 	}
 
-	pthread_mutex_lock(&context->sequence_mutex);
-
 	if (user_fence) {
 		i = cs.in.num_chunks++;
 
@@ -295,22 +360,9 @@ static int amdgpu_cs_submit_one(amdgpu_context_handle context,
 	}
 
 	if (ibs_request->number_of_dependencies) {
-		dependencies = malloc(sizeof(struct drm_amdgpu_cs_chunk_dep) *
-			ibs_request->number_of_dependencies);
-		if (!dependencies) {
-			r = -ENOMEM;
-			goto error_unlock;
-		}
-
-		for (i = 0; i < ibs_request->number_of_dependencies; ++i) {
-			struct amdgpu_cs_fence *info = &ibs_request->dependencies[i];
-			struct drm_amdgpu_cs_chunk_dep *dep = &dependencies[i];
-			dep->ip_type = info->ip_type;
-			dep->ip_instance = info->ip_instance;
-			dep->ring = info->ring;
-			dep->ctx_id = info->context->id;
-			dep->handle = info->fence;
-		}
+		for (i = 0; i < ibs_request->number_of_dependencies; ++i)
+			amdgpu_cs_fence_to_dep(&ibs_request->dependencies[i],
+					       &dependencies[i]);
 
 		i = cs.in.num_chunks++;
 
@@ -322,49 +374,90 @@ static int amdgpu_cs_submit_one(amdgpu_context_handle context,
 		chunks[i].chunk_data = (uint64_t)(uintptr_t)dependencies;
 	}
 
-	sem_list = &context->sem_list[ibs_request->ip_type][ibs_request->ip_instance][ibs_request->ring];
-	LIST_FOR_EACH_ENTRY(sem, sem_list, list)
-		sem_count++;
 	if (sem_count) {
-		sem_dependencies = malloc(sizeof(struct drm_amdgpu_cs_chunk_dep) * sem_count);
-		if (!sem_dependencies) {
-			r = -ENOMEM;
-			goto error_unlock;
-		}
 		sem_count = 0;
-		LIST_FOR_EACH_ENTRY_SAFE(sem, tmp, sem_list, list) {
-			struct amdgpu_cs_fence *info = &sem->signal_fence;
-			struct drm_amdgpu_cs_chunk_dep *dep = &sem_dependencies[sem_count++];
-			dep->ip_type = info->ip_type;
-			dep->ip_instance = info->ip_instance;
-			dep->ring = info->ring;
-			dep->ctx_id = info->context->id;
-			dep->handle = info->fence;
-
-			list_del(&sem->list);
-			amdgpu_cs_reset_sem(sem);
-			amdgpu_cs_unreference_sem(sem);
-		}
+		for (sem = sems; sem; sem = sem->next)
+			if (sem->syncobj)
+				syncobjs[sem_count++].handle = sem->syncobj;
 		i = cs.in.num_chunks++;
 
-		/* dependencies chunk */
+		/* syncobj chunk */
 		chunk_array[i] = (uint64_t)(uintptr_t)&chunks[i];
-		chunks[i].chunk_id = AMDGPU_CHUNK_ID_DEPENDENCIES;
-		chunks[i].length_dw = sizeof(struct drm_amdgpu_cs_chunk_dep) / 4 * sem_count;
-		chunks[i].chunk_data = (uint64_t)(uintptr_t)sem_dependencies;
+		chunks[i].chunk_id = AMDGPU_CHUNK_ID_SYNCOBJ_IN;
+		chunks[i].length_dw = sizeof(struct drm_amdgpu_cs_chunk_sem) / 4 * sem_count;
+		chunks[i].chunk_data = (uint64_t)(uintptr_t)syncobjs;
 	}
 
+	if (bo_list) {
+		i = cs.in.num_chunks++;
+
+		/* BO list chunk */
+		chunk_array[i] = (uint64_t)(uintptr_t)&chunks[i];
+		chunks[i].chunk_id = AMDGPU_CHUNK_ID_BO_HANDLES;
+		chunks[i].length_dw = sizeof(struct drm_amdgpu_bo_list_in) / 4;
+		chunks[i].chunk_data = (uint64_t)(uintptr_t)bo_list;
+	}
+
+	memset(&trace, 0, sizeof(trace));
+	trace.name = "amdgpu_cs_submit";
+	trace.fd = context->dev->fd;
+	if (bo_list)
+		trace.num_bos = bo_list->bo_number;
+	else if (ibs_request->resources)
+		trace.num_bos = ibs_request->resources->num_items;
+	for (i = 0; i < ibs_request->number_of_ibs; i++)
+		trace.cmd_bytes += ibs_request->ibs[i].size * 4;
+	drmSubmitTraceBegin(&trace);
+
 	r = drmCommandWriteRead(context->dev->fd, DRM_AMDGPU_CS,
 				&cs, sizeof(cs));
+	trace.ret = r;
+	trace.fence = r ? 0 : cs.out.handle;
+	drmSubmitTraceEnd(&trace);
 	if (r)
-		goto error_unlock;
+		goto out;
 
+	/* Another thread may have published a later submission already. */
 	ibs_request->seq_no = cs.out.handle;
-	context->last_seq[ibs_request->ip_type][ibs_request->ip_instance][ibs_request->ring] = ibs_request->seq_no;
-error_unlock:
+	last_seq = &context->last_seq[ibs_request->ip_type][ibs_request->ip_instance][ibs_request->ring];
+	uf = &context->user_fence[ibs_request->ip_type][ibs_request->ip_instance][ibs_request->ring];
+	pthread_mutex_lock(&context->sequence_mutex);
+	if (ibs_request->seq_no > *last_seq) {
+		*last_seq = ibs_request->seq_no;
+		if (user_fence) {
+			if (uf->bo != ibs_request->fence_info.handle) {
+				old_fence_bo = uf->bo;
+				uf->bo = ibs_request->fence_info.handle;
+				amdgpu_bo_inc_ref(uf->bo);
+			}
+			uf->offset = ibs_request->fence_info.offset;
+		}
+	}
 	pthread_mutex_unlock(&context->sequence_mutex);
-	free(dependencies);
-	free(sem_dependencies);
+
+	/* Freeing takes bo_table_mutex, so not under sequence_mutex. */
+	if (old_fence_bo)
+		amdgpu_bo_free(old_fence_bo);
+out:
+	/* The semaphores are used up, even by a failed submission. */
+	while (sems) {
+		sem = sems;
+		sems = sem->next;
+		amdgpu_cs_reset_sem(sem);
+		amdgpu_cs_unreference_sem(sem);
+	}
+	if (syncobjs != stack_sems)
+		free(syncobjs);
+	if (dependencies != stack_deps)
+		free(dependencies);
+	return r;
+
+error_sems:
+	/* Leave the semaphores for the next submission. */
+	if (sems)
+		amdgpu_cs_push_sems(sem_list, sems, last_sem);
+	if (dependencies != stack_deps)
+		free(dependencies);
 	return r;
 }
 
@@ -381,7 +474,7 @@ drm_public int amdgpu_cs_submit(amdgpu_context_handle context,
 
 	r = 0;
 	for (i = 0; i < number_of_requests; i++) {
-		r = amdgpu_cs_submit_one(context, ibs_request);
+		r = amdgpu_cs_submit_one(context, ibs_request, NULL);
 		if (r)
 			break;
 		ibs_request++;
@@ -390,6 +483,58 @@ drm_public int amdgpu_cs_submit(amdgpu_context_handle context,
 	return r;
 }
 
+drm_public int amdgpu_cs_submit_bos(amdgpu_context_handle context,
+				    uint64_t flags,
+				    struct amdgpu_cs_request *ibs_request,
+				    uint32_t number_of_resources,
+				    amdgpu_bo_handle *resources,
+				    uint8_t *resource_prios)
+{
+	struct drm_amdgpu_bo_list_entry stack_list[AMDGPU_CS_STACK_BOS];
+	struct drm_amdgpu_bo_list_entry *list = stack_list;
+	struct drm_amdgpu_bo_list_in bo_list;
+	uint32_t i, n;
+	int r;
+
+	if (!context || !ibs_request || (number_of_resources && !resources))
+		return -EINVAL;
+
+	/* overflow check for multiplication */
+	if (number_of_resources > UINT32_MAX / sizeof(struct drm_amdgpu_bo_list_entry))
+		return -EINVAL;
+
+	if (number_of_resources > AMDGPU_CS_STACK_BOS) {
+		list = malloc(number_of_resources * sizeof(struct drm_amdgpu_bo_list_entry));
+		if (!list)
+			return -ENOMEM;
+	}
+
+	for (i = n = 0; i < number_of_resources; i++) {
+		if (resources[i]->always_valid)
+			continue;
+		list[n].bo_handle = resources[i]->handle;
+		if (resource_prios)
+			list[n].bo_priority = resource_prios[i];
+		else
+			list[n].bo_priority = 0;
+		n++;
+	}
+
+	memset(&bo_list, 0, sizeof(bo_list));
+	bo_list.operation = ~0;
+	bo_list.list_handle = ~0;
+	bo_list.bo_number = n;
+	bo_list.bo_info_size = sizeof(struct drm_amdgpu_bo_list_entry);
+	bo_list.bo_info_ptr = (uint64_t)(uintptr_t)list;
+
+	/* with only always valid buffers, the BO_HANDLES chunk is left out */
+	r = amdgpu_cs_submit_one(context, ibs_request, n ? &bo_list : NULL);
+
+	if (list != stack_list)
+		free(list);
+	return r;
+}
+
 /**
  * Calculate absolute timeout.
  *
@@ -452,11 +597,41 @@ static int amdgpu_ioctl_wait_cs(amdgpu_context_handle context,
 	return 0;
 }
 
+/* How long AMDGPU_QUERY_FENCE_SPIN polls the user fence at most. */
+#define AMDGPU_FENCE_SPIN_NS 50000
+
+/*
+ * Reads the user fence the ring's last submission wrote to.  Returns false
+ * if there is none or it isn't CPU mapped.
+ */
+static bool amdgpu_cs_read_user_fence(struct amdgpu_cs_fence *fence,
+				      uint64_t *value)
+{
+	amdgpu_context_handle context = fence->context;
+	struct amdgpu_user_fence *uf;
+	bool found = false;
+
+	uf = &context->user_fence[fence->ip_type][fence->ip_instance][fence->ring];
+	pthread_mutex_lock(&context->sequence_mutex);
+	if (uf->bo) {
+		pthread_mutex_lock(&uf->bo->cpu_access_mutex);
+		if (uf->bo->cpu_ptr) {
+			*value = ((volatile uint64_t *)uf->bo->cpu_ptr)[uf->offset];
+			found = true;
+		}
+		pthread_mutex_unlock(&uf->bo->cpu_access_mutex);
+	}
+	pthread_mutex_unlock(&context->sequence_mutex);
+
+	return found;
+}
+
 drm_public int amdgpu_cs_query_fence_status(struct amdgpu_cs_fence *fence,
 					    uint64_t timeout_ns,
 					    uint64_t flags,
 					    uint32_t *expired)
 {
+	uint64_t value, now, spin_end;
 	bool busy = true;
 	int r;
 
@@ -473,6 +648,33 @@ drm_public int amdgpu_cs_query_fence_status(struct amdgpu_cs_fence *fence,
 
 	*expired = false;
 
+	if (fence->ip_instance < AMDGPU_HW_IP_INSTANCE_MAX_COUNT &&
+	    amdgpu_cs_read_user_fence(fence, &value)) {
+		if (fence->fence <= value) {
+			*expired = true;
+			return 0;
+		}
+
+		/* Poll for a bit before sleeping in the kernel. */
+		if (flags & AMDGPU_QUERY_FENCE_SPIN && timeout_ns) {
+			now = amdgpu_cs_calculate_timeout(0);
+			if (flags & AMDGPU_QUERY_FENCE_TIMEOUT_IS_ABSOLUTE)
+				spin_end = MIN2(timeout_ns, now + AMDGPU_FENCE_SPIN_NS);
+			else
+				spin_end = now + MIN2(timeout_ns, AMDGPU_FENCE_SPIN_NS);
+
+			while (now < spin_end) {
+				sched_yield();
+				if (amdgpu_cs_read_user_fence(fence, &value) &&
+				    fence->fence <= value) {
+					*expired = true;
+					return 0;
+				}
+				now = amdgpu_cs_calculate_timeout(0);
+			}
+		}
+	}
+
 	r = amdgpu_ioctl_wait_cs(fence->context, fence->ip_type,
 				fence->ip_instance, fence->ring,
 			       	fence->fence, timeout_ns, flags, &busy);
@@ -551,6 +753,160 @@ drm_public int amdgpu_cs_wait_fences(struct amdgpu_cs_fence *fences,
 					timeout_ns, status, first);
 }
 
+/* Entries amdgpu_cs_wait_fences_multi() can poll without allocating. */
+#define AMDGPU_CS_STACK_WAITS 32
+
+static int amdgpu_cs_syncobj_point_fd(const struct amdgpu_cs_syncobj_point *sp,
+				      int *fd)
+{
+	int r;
+
+	r = drmSyncobjWaitEventfd(sp->dev->fd, sp->handle, sp->point, 0, fd);
+	if (r != -ENOTTY && r != -EINVAL && r != -ENOSYS)
+		return r;
+
+	/* No syncobj eventfds, the point must already have a fence. */
+	r = amdgpu_cs_syncobj_export_sync_file2(sp->dev, sp->handle, sp->point,
+						0, fd);
+	return r ? -errno : 0;
+}
+
+drm_public int amdgpu_cs_wait_fences_multi(struct amdgpu_cs_fence *fences,
+					   uint32_t fence_count,
+					   const struct amdgpu_cs_syncobj_point *syncobjs,
+					   uint32_t syncobj_count,
+					   bool wait_all,
+					   uint64_t timeout_ns,
+					   uint32_t *status,
+					   uint32_t *first)
+{
+	struct pollfd stack_fds[AMDGPU_CS_STACK_WAITS], *fds = stack_fds;
+	uint32_t i, count, pending, signaled;
+	uint64_t deadline, now;
+	uint32_t handle;
+	int r = 0, timeout_ms;
+
+	count = fence_count + syncobj_count;
+	if (!status || !count || count < fence_count ||
+	    (fence_count && !fences) || (syncobj_count && !syncobjs))
+		return -EINVAL;
+
+	for (i = 0; i < fence_count; i++) {
+		if (NULL == fences[i].context)
+			return -EINVAL;
+		if (fences[i].ip_type >= AMDGPU_HW_IP_NUM)
+			return -EINVAL;
+		if (fences[i].ring >= AMDGPU_CS_MAX_RINGS)
+			return -EINVAL;
+	}
+	for (i = 0; i < syncobj_count; i++) {
+		if (NULL == syncobjs[i].dev)
+			return -EINVAL;
+	}
+
+	*status = 0;
+
+	/* A single device can wait for all of them in one ioctl. */
+	if (!syncobj_count) {
+		for (i = 1; i < fence_count; i++) {
+			if (fences[i].context->dev != fences[0].context->dev)
+				break;
+		}
+		if (i == fence_count)
+			return amdgpu_ioctl_wait_fences(fences, fence_count,
+							wait_all, timeout_ns,
+							status, first);
+	}
+
+	if (count > AMDGPU_CS_STACK_WAITS) {
+		fds = malloc(count * sizeof(*fds));
+		if (!fds)
+			return -ENOMEM;
+	}
+
+	deadline = amdgpu_cs_calculate_timeout(timeout_ns);
+
+	for (i = 0; i < count; i++) {
+		fds[i].fd = -1;
+		fds[i].events = POLLIN;
+		fds[i].revents = 0;
+	}
+
+	/* A negative fd marks a signaled entry, poll() skips those. */
+	pending = count;
+	signaled = count;
+	for (i = 0; i < count; i++) {
+		if (i >= fence_count) {
+			r = amdgpu_cs_syncobj_point_fd(&syncobjs[i - fence_count],
+						       &fds[i].fd);
+		} else if (fences[i].fence == AMDGPU_NULL_SUBMIT_SEQ) {
+			if (signaled == count)
+				signaled = i;
+			pending--;
+			continue;
+		} else {
+			r = amdgpu_cs_fence_to_handle(fences[i].context->dev,
+						      &fences[i],
+						      AMDGPU_FENCE_TO_HANDLE_GET_SYNC_FILE_FD,
+						      &handle);
+			fds[i].fd = r ? -1 : (int)handle;
+		}
+		if (r)
+			goto out;
+	}
+
+	while (pending && (wait_all || signaled == count)) {
+		if (deadline == AMDGPU_TIMEOUT_INFINITE) {
+			timeout_ms = -1;
+		} else {
+			now = amdgpu_cs_calculate_timeout(0);
+			timeout_ms = now < deadline ?
+				MIN2((deadline - now + 999999) / 1000000, INT_MAX) : 0;
+		}
+
+		r = poll(fds, count, timeout_ms);
+		if (r < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			r = -errno;
+			goto out;
+		}
+
+		for (i = 0; i < count; i++) {
+			if (fds[i].fd < 0 || !fds[i].revents)
+				continue;
+			if (fds[i].revents & (POLLERR | POLLNVAL)) {
+				r = -EIO;
+				goto out;
+			}
+			close(fds[i].fd);
+			fds[i].fd = -1;
+			if (signaled == count)
+				signaled = i;
+			pending--;
+		}
+
+		if (!timeout_ms)
+			break;
+	}
+
+	r = 0;
+	if (signaled != count && (!wait_all || !pending)) {
+		*status = 1;
+		if (first)
+			*first = signaled;
+	}
+
+out:
+	for (i = 0; i < count; i++) {
+		if (fds[i].fd >= 0)
+			close(fds[i].fd);
+	}
+	if (fds != stack_fds)
+		free(fds);
+	return r;
+}
+
 drm_public int amdgpu_cs_create_semaphore(amdgpu_semaphore_handle *sem)
 {
 	struct amdgpu_semaphore *gpu_semaphore;
@@ -574,6 +930,10 @@ drm_public int amdgpu_cs_signal_semaphore(amdgpu_context_handle ctx,
 			       uint32_t ring,
 			       amdgpu_semaphore_handle sem)
 {
+	struct amdgpu_cs_fence fence;
+	uint32_t syncobj = 0;
+	int r;
+
 	if (!ctx || !sem)
 		return -EINVAL;
 	if (ip_type >= AMDGPU_HW_IP_NUM)
@@ -583,14 +943,28 @@ drm_public int amdgpu_cs_signal_semaphore(amdgpu_context_handle ctx,
 	/* sem has been signaled */
 	if (sem->signal_fence.context)
 		return -EINVAL;
+
+	fence.context = ctx;
+	fence.ip_type = ip_type;
+	fence.ip_instance = ip_instance;
+	fence.ring = ring;
 	pthread_mutex_lock(&ctx->sequence_mutex);
-	sem->signal_fence.context = ctx;
-	sem->signal_fence.ip_type = ip_type;
-	sem->signal_fence.ip_instance = ip_instance;
-	sem->signal_fence.ring = ring;
-	sem->signal_fence.fence = ctx->last_seq[ip_type][ip_instance][ring];
-	update_references(NULL, &sem->refcount);
+	fence.fence = ctx->last_seq[ip_type][ip_instance][ring];
 	pthread_mutex_unlock(&ctx->sequence_mutex);
+
+	/* The syncobj lets a waiter on any ring skip the context state. */
+	if (fence.fence) {
+		r = amdgpu_cs_fence_to_handle(ctx->dev, &fence,
+					      AMDGPU_FENCE_TO_HANDLE_GET_SYNCOBJ,
+					      &syncobj);
+		if (r)
+			return r;
+	}
+
+	sem->signal_fence = fence;
+	sem->dev = ctx->dev;
+	sem->syncobj = syncobj;
+	update_references(NULL, &sem->refcount);
 	return 0;
 }
 
@@ -610,9 +984,8 @@ drm_public int amdgpu_cs_wait_semaphore(amdgpu_context_handle ctx,
 	if (!sem->signal_fence.context)
 		return -EINVAL;
 
-	pthread_mutex_lock(&ctx->sequence_mutex);
-	list_add(&sem->list, &ctx->sem_list[ip_type][ip_instance][ring]);
-	pthread_mutex_unlock(&ctx->sequence_mutex);
+	amdgpu_cs_push_sems(&ctx->sem_list[ip_type][ip_instance][ring],
+			    sem, sem);
 	return 0;
 }
 
@@ -621,6 +994,9 @@ static int amdgpu_cs_reset_sem(amdgpu_semaphore_handle sem)
 	if (!sem || !sem->signal_fence.context)
 		return -EINVAL;
 
+	if (sem->syncobj)
+		drmSyncobjDestroy(sem->dev->fd, sem->syncobj);
+	sem->syncobj = 0;
 	sem->signal_fence.context = NULL;
 	sem->signal_fence.ip_type = 0;
 	sem->signal_fence.ip_instance = 0;
@@ -958,3 +1334,181 @@ drm_public int amdgpu_cs_fence_to_handle(amdgpu_device_handle dev,
 		*out_handle = fth.out.handle;
 	return r;
 }
+
+/*
+ * Chunks for amdgpu_cs_submit_desc() are assembled in a buffer that every
+ * thread keeps around between submissions, so the common case doesn't
+ * allocate at all.
+ */
+struct amdgpu_cs_arena {
+	void *ptr;
+	size_t size;
+};
+
+static pthread_key_t cs_arena_key;
+static pthread_once_t cs_arena_once = PTHREAD_ONCE_INIT;
+static int cs_arena_key_ret;
+
+static void amdgpu_cs_arena_free(void *data)
+{
+	struct amdgpu_cs_arena *arena = data;
+
+	free(arena->ptr);
+	free(arena);
+}
+
+static void amdgpu_cs_arena_init(void)
+{
+	cs_arena_key_ret = pthread_key_create(&cs_arena_key,
+					      amdgpu_cs_arena_free);
+}
+
+static void *amdgpu_cs_arena_get(size_t size)
+{
+	struct amdgpu_cs_arena *arena;
+	void *ptr;
+
+	pthread_once(&cs_arena_once, amdgpu_cs_arena_init);
+	if (cs_arena_key_ret)
+		return NULL;
+
+	arena = pthread_getspecific(cs_arena_key);
+	if (!arena) {
+		arena = calloc(1, sizeof(*arena));
+		if (!arena)
+			return NULL;
+		if (pthread_setspecific(cs_arena_key, arena)) {
+			free(arena);
+			return NULL;
+		}
+	}
+
+	if (arena->size < size) {
+		size = ALIGN(size, 1024);
+		ptr = realloc(arena->ptr, size);
+		if (!ptr)
+			return NULL;
+		arena->ptr = ptr;
+		arena->size = size;
+	}
+	return arena->ptr;
+}
+
+drm_public int amdgpu_cs_submit_desc(amdgpu_device_handle dev,
+				     amdgpu_context_handle context,
+				     const struct amdgpu_cs_submit_info *info,
+				     uint64_t *seq_no)
+{
+	struct drm_amdgpu_cs_chunk *chunks, *chunk;
+	struct drm_amdgpu_cs_chunk_ib *ib;
+	struct drm_amdgpu_cs_chunk_dep *dep;
+	struct drm_amdgpu_cs_chunk_data *fence;
+	struct drm_amdgpu_bo_list_in *bo_list;
+	unsigned num_chunks;
+	uint32_t i;
+	char *data;
+
+	if (!dev || !context || !info)
+		return -EINVAL;
+	if (info->number_of_ibs > AMDGPU_CS_MAX_IBS_PER_SUBMIT)
+		return -EINVAL;
+	if (info->number_of_bo_handles && info->bo_list_handle)
+		return -EINVAL;
+
+	num_chunks = info->number_of_ibs +
+		     !!info->number_of_dependencies +
+		     !!info->fence_info.handle +
+		     !!info->number_of_bo_handles +
+		     !!info->number_of_waits +
+		     !!info->number_of_signals;
+
+	data = amdgpu_cs_arena_get(num_chunks * sizeof(*chunks) +
+				   info->number_of_ibs * sizeof(*ib) +
+				   info->number_of_dependencies * sizeof(*dep) +
+				   sizeof(*fence) + sizeof(*bo_list));
+	if (!data)
+		return -ENOMEM;
+
+	/* every piece is a multiple of 8 bytes, so all stay aligned */
+	chunks = (struct drm_amdgpu_cs_chunk *)data;
+	ib = (struct drm_amdgpu_cs_chunk_ib *)(chunks + num_chunks);
+	dep = (struct drm_amdgpu_cs_chunk_dep *)(ib + info->number_of_ibs);
+	fence = (struct drm_amdgpu_cs_chunk_data *)
+		(dep + info->number_of_dependencies);
+	bo_list = (struct drm_amdgpu_bo_list_in *)(fence + 1);
+	chunk = chunks;
+
+	for (i = 0; i < info->number_of_ibs; i++, ib++, chunk++) {
+		ib->_pad = 0;
+		ib->flags = info->ibs[i].flags;
+		ib->va_start = info->ibs[i].ib_mc_address;
+		ib->ib_bytes = info->ibs[i].size * 4;
+		ib->ip_type = info->ip_type;
+		ib->ip_instance = info->ip_instance;
+		ib->ring = info->ring;
+
+		chunk->chunk_id = AMDGPU_CHUNK_ID_IB;
+		chunk->length_dw = sizeof(*ib) / 4;
+		chunk->chunk_data = (uint64_t)(uintptr_t)ib;
+	}
+
+	if (info->number_of_dependencies) {
+		chunk->chunk_id = AMDGPU_CHUNK_ID_DEPENDENCIES;
+		chunk->length_dw = sizeof(*dep) / 4 *
+				   info->number_of_dependencies;
+		chunk->chunk_data = (uint64_t)(uintptr_t)dep;
+		for (i = 0; i < info->number_of_dependencies; i++) {
+			const struct amdgpu_cs_fence *f = &info->dependencies[i];
+
+			dep[i].ip_type = f->ip_type;
+			dep[i].ip_instance = f->ip_instance;
+			dep[i].ring = f->ring;
+			dep[i].ctx_id = f->context->id;
+			dep[i].handle = f->fence;
+		}
+		chunk++;
+	}
+
+	if (info->fence_info.handle) {
+		memset(fence, 0, sizeof(*fence));
+		fence->fence_data.handle = info->fence_info.handle->handle;
+		fence->fence_data.offset = info->fence_info.offset *
+					   sizeof(uint64_t);
+		chunk->chunk_id = AMDGPU_CHUNK_ID_FENCE;
+		chunk->length_dw = sizeof(struct drm_amdgpu_cs_chunk_fence) / 4;
+		chunk->chunk_data = (uint64_t)(uintptr_t)fence;
+		chunk++;
+	}
+
+	/* the arrays below are handed to the kernel as they are */
+	if (info->number_of_bo_handles) {
+		bo_list->operation = ~0;
+		bo_list->list_handle = ~0;
+		bo_list->bo_number = info->number_of_bo_handles;
+		bo_list->bo_info_size = sizeof(struct drm_amdgpu_bo_list_entry);
+		bo_list->bo_info_ptr = (uint64_t)(uintptr_t)info->bo_handles;
+		chunk->chunk_id = AMDGPU_CHUNK_ID_BO_HANDLES;
+		chunk->length_dw = sizeof(*bo_list) / 4;
+		chunk->chunk_data = (uint64_t)(uintptr_t)bo_list;
+		chunk++;
+	}
+
+	if (info->number_of_waits) {
+		chunk->chunk_id = AMDGPU_CHUNK_ID_SYNCOBJ_TIMELINE_WAIT;
+		chunk->length_dw = sizeof(struct drm_amdgpu_cs_chunk_syncobj) /
+				   4 * info->number_of_waits;
+		chunk->chunk_data = (uint64_t)(uintptr_t)info->waits;
+		chunk++;
+	}
+
+	if (info->number_of_signals) {
+		chunk->chunk_id = AMDGPU_CHUNK_ID_SYNCOBJ_TIMELINE_SIGNAL;
+		chunk->length_dw = sizeof(struct drm_amdgpu_cs_chunk_syncobj) /
+				   4 * info->number_of_signals;
+		chunk->chunk_data = (uint64_t)(uintptr_t)info->signals;
+		chunk++;
+	}
+
+	return amdgpu_cs_submit_raw2(dev, context, info->bo_list_handle,
+				     num_chunks, chunks, seq_no);
+}
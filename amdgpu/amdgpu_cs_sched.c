@@ -0,0 +1,206 @@
+/*
+ * Copyright 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Spreads submissions of one context over the rings of an IP type.
+ *
+ * Sequence numbers of a context count submissions to each ring one by
+ * one, so the work outstanding on a ring is the distance between the last
+ * sequence the context submitted there and the last one seen signaled.
+ * The latter is only a lower bound; before a ring counts as busy its last
+ * fence is checked, which normally reads the user fence without a syscall.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "amdgpu.h"
+#include "amdgpu_drm.h"
+#include "amdgpu_internal.h"
+#include "util_math.h"
+
+drm_public int amdgpu_cs_scheduler_create(amdgpu_context_handle context,
+					  unsigned ip_type,
+					  uint32_t max_ibs_per_submit,
+					  amdgpu_cs_scheduler_handle *sched_handle)
+{
+	struct drm_amdgpu_info_hw_ip info;
+	struct amdgpu_cs_scheduler *sched;
+	uint32_t ring;
+	int r;
+
+	if (!context || ip_type >= AMDGPU_HW_IP_NUM || !sched_handle)
+		return -EINVAL;
+
+	r = amdgpu_query_hw_ip_info(context->dev, ip_type, 0, &info);
+	if (r)
+		return r;
+	if (!info.available_rings)
+		return -ENODEV;
+
+	sched = calloc(1, sizeof(*sched));
+	if (!sched)
+		return -ENOMEM;
+
+	sched->context = context;
+	sched->ip_type = ip_type;
+	sched->max_ibs = max_ibs_per_submit ? max_ibs_per_submit : 1;
+	sched->max_ibs = MIN2(sched->max_ibs, AMDGPU_CS_MAX_IBS_PER_SUBMIT);
+	for (ring = 0; ring < AMDGPU_CS_MAX_RINGS; ring++)
+		if (info.available_rings & (1u << ring))
+			sched->rings[sched->num_rings++] = ring;
+	pthread_mutex_init(&sched->mutex, NULL);
+
+	*sched_handle = sched;
+	return 0;
+}
+
+drm_public int amdgpu_cs_scheduler_destroy(amdgpu_cs_scheduler_handle sched)
+{
+	if (!sched)
+		return -EINVAL;
+
+	pthread_mutex_destroy(&sched->mutex);
+	free(sched);
+	return 0;
+}
+
+/* Returns the ring with the least work known to be outstanding. */
+static uint32_t amdgpu_cs_scheduler_pick(struct amdgpu_cs_scheduler *sched)
+{
+	struct amdgpu_context *context = sched->context;
+	struct amdgpu_cs_fence fence = {};
+	uint64_t last, pending, best_pending = UINT64_MAX;
+	uint32_t i, ring, best = sched->rings[0], expired;
+
+	fence.context = context;
+	fence.ip_type = sched->ip_type;
+
+	for (i = 0; i < sched->num_rings; i++) {
+		ring = sched->rings[i];
+
+		pthread_mutex_lock(&context->sequence_mutex);
+		last = context->last_seq[sched->ip_type][0][ring];
+		pthread_mutex_unlock(&context->sequence_mutex);
+
+		pthread_mutex_lock(&sched->mutex);
+		pending = last - MIN2(sched->completed[ring], last);
+		pthread_mutex_unlock(&sched->mutex);
+
+		if (pending) {
+			fence.ring = ring;
+			fence.fence = last;
+			if (!amdgpu_cs_query_fence_status(&fence, 0, 0,
+							  &expired) &&
+			    expired) {
+				pthread_mutex_lock(&sched->mutex);
+				if (sched->completed[ring] < last)
+					sched->completed[ring] = last;
+				pthread_mutex_unlock(&sched->mutex);
+				pending = 0;
+			}
+		}
+
+		if (!pending)
+			return ring;
+		if (pending < best_pending) {
+			best_pending = pending;
+			best = ring;
+		}
+	}
+	return best;
+}
+
+/* Later requests can only ride along if they need nothing of their own. */
+static bool amdgpu_cs_scheduler_can_batch(const struct amdgpu_cs_request *first,
+					  const struct amdgpu_cs_request *req)
+{
+	return req->flags == first->flags &&
+	       req->resources == first->resources &&
+	       !req->number_of_dependencies &&
+	       !req->fence_info.handle && !first->fence_info.handle;
+}
+
+drm_public int amdgpu_cs_scheduler_submit(amdgpu_cs_scheduler_handle sched,
+					  struct amdgpu_cs_request *requests,
+					  uint32_t count,
+					  struct amdgpu_cs_fence *fences)
+{
+	struct amdgpu_cs_ib_info ibs[AMDGPU_CS_MAX_IBS_PER_SUBMIT];
+	struct amdgpu_cs_request batch;
+	uint32_t i, j, k, num_ibs;
+	int r;
+
+	if (!sched || (count && !requests))
+		return -EINVAL;
+
+	for (i = 0; i < count; i = j) {
+		if (requests[i].number_of_ibs > sched->max_ibs)
+			return -EINVAL;
+
+		num_ibs = requests[i].number_of_ibs;
+		for (j = i + 1; j < count; j++) {
+			if (num_ibs + requests[j].number_of_ibs > sched->max_ibs ||
+			    !amdgpu_cs_scheduler_can_batch(&requests[i],
+							   &requests[j]))
+				break;
+			num_ibs += requests[j].number_of_ibs;
+		}
+
+		batch = requests[i];
+		batch.ip_type = sched->ip_type;
+		batch.ip_instance = 0;
+		batch.ring = amdgpu_cs_scheduler_pick(sched);
+		if (j > i + 1) {
+			num_ibs = 0;
+			for (k = i; k < j; k++) {
+				memcpy(&ibs[num_ibs], requests[k].ibs,
+				       requests[k].number_of_ibs * sizeof(ibs[0]));
+				num_ibs += requests[k].number_of_ibs;
+			}
+			batch.number_of_ibs = num_ibs;
+			batch.ibs = ibs;
+		}
+
+		r = amdgpu_cs_submit(sched->context, 0, &batch, 1);
+		if (r)
+			return r;
+
+		for (k = i; k < j; k++) {
+			requests[k].ip_type = batch.ip_type;
+			requests[k].ip_instance = 0;
+			requests[k].ring = batch.ring;
+			requests[k].seq_no = batch.seq_no;
+			if (fences) {
+				fences[k].context = sched->context;
+				fences[k].ip_type = batch.ip_type;
+				fences[k].ip_instance = 0;
+				fences[k].ring = batch.ring;
+				fences[k].fence = batch.seq_no;
+			}
+		}
+	}
+
+	return 0;
+}
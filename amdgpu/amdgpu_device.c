@@ -29,6 +29,12 @@
  */
 
 #include <sys/stat.h>
+#ifdef MAJOR_IN_MKDEV
+#include <sys/mkdev.h>
+#endif
+#ifdef MAJOR_IN_SYSMACROS
+#include <sys/sysmacros.h>
+#endif
 #include <errno.h>
 #include <string.h>
 #include <stdio.h>
@@ -46,30 +52,40 @@
 static pthread_mutex_t dev_mutex = PTHREAD_MUTEX_INITIALIZER;
 static amdgpu_device_handle dev_list;
 
-static int fd_compare(int fd1, int fd2)
+/**
+* Identify the device behind a DRM fd
+*
+* The primary, control and render nodes of a device share the low six bits
+* of their minor number, the bits above are the node type.  One fstat()
+* thus names the device without looking at sysfs or /dev.
+*
+* \param   fd        - \c [in]  File descriptor for AMD GPU device
+* \param   key       - \c [out] Device number of the primary node
+* \param   node_type - \c [out] DRM_NODE_* type of \c fd
+*
+* \return   0 on success\n
+*          <0 - Negative POSIX Error code
+*/
+static int amdgpu_device_key(int fd, dev_t *key, int *node_type)
 {
-	char *name1 = drmGetPrimaryDeviceNameFromFd(fd1);
-	char *name2 = drmGetPrimaryDeviceNameFromFd(fd2);
-	int result;
+	struct stat sbuf;
 
-	if (name1 == NULL || name2 == NULL) {
-		free(name1);
-		free(name2);
-		return 0;
-	}
-
-	result = strcmp(name1, name2);
-	free(name1);
-	free(name2);
+	if (fstat(fd, &sbuf))
+		return -errno;
+	if (!S_ISCHR(sbuf.st_mode))
+		return -EINVAL;
 
-	return result;
+	*node_type = minor(sbuf.st_rdev) >> 6;
+	*key = makedev(major(sbuf.st_rdev), minor(sbuf.st_rdev) & 0x3f);
+	return 0;
 }
 
 /**
 * Get the authenticated form fd,
 *
-* \param   fd   - \c [in]  File descriptor for AMD GPU device
-* \param   auth - \c [out] Pointer to output the fd is authenticated or not
+* \param   fd        - \c [in]  File descriptor for AMD GPU device
+* \param   node_type - \c [in]  DRM_NODE_* type of \c fd
+* \param   auth      - \c [out] Pointer to output the fd is authenticated or not
 *                          A render node fd, output auth = 0
 *                          A legacy fd, get the authenticated for compatibility root
 *
@@ -77,12 +93,12 @@ static int fd_compare(int fd1, int fd2)
 *          >0 - AMD specific error code\n
 *          <0 - Negative POSIX Error code
 */
-static int amdgpu_get_auth(int fd, int *auth)
+static int amdgpu_get_auth(int fd, int node_type, int *auth)
 {
 	int r = 0;
 	drm_client_t client = {};
 
-	if (drmGetNodeTypeFromFd(fd) == DRM_NODE_RENDER)
+	if (node_type == DRM_NODE_RENDER)
 		*auth = 0;
 	else {
 		client.idx = 0;
@@ -103,6 +119,10 @@ static void amdgpu_device_free_internal(amdgpu_device_handle dev)
 	*node = (*node)->next;
 	pthread_mutex_unlock(&dev_mutex);
 
+	amdgpu_bo_cache_fini(&dev->bo_cache);
+	pthread_mutex_lock(&dev->close_mutex);
+	amdgpu_bo_close_flush(dev);
+	pthread_mutex_unlock(&dev->close_mutex);
 	close(dev->fd);
 	if ((dev->flink_fd >= 0) && (dev->fd != dev->flink_fd))
 		close(dev->flink_fd);
@@ -114,6 +134,13 @@ static void amdgpu_device_free_internal(amdgpu_device_handle dev)
 	handle_table_fini(&dev->bo_handles);
 	handle_table_fini(&dev->bo_flink_names);
 	pthread_mutex_destroy(&dev->bo_table_mutex);
+	free(dev->closes.items);
+	free(dev->closing.items);
+	pthread_mutex_destroy(&dev->close_mutex);
+	free(dev->cpu_maps);
+	pthread_mutex_destroy(&dev->cpu_map_mutex);
+	free(dev->info_cache.fw);
+	pthread_mutex_destroy(&dev->info_cache.mutex);
 	free(dev->marketing_name);
 	free(dev);
 }
@@ -152,11 +179,17 @@ drm_public int amdgpu_device_initialize(int fd,
 	int flag_authexist=0;
 	uint32_t accel_working = 0;
 	uint64_t start, max;
+	dev_t key = 0;
+	int node_type = -1;
 
 	*device_handle = NULL;
 
+	r = amdgpu_device_key(fd, &key, &node_type);
+	if (r)
+		return r;
+
 	pthread_mutex_lock(&dev_mutex);
-	r = amdgpu_get_auth(fd, &flag_auth);
+	r = amdgpu_get_auth(fd, node_type, &flag_auth);
 	if (r) {
 		fprintf(stderr, "%s: amdgpu_get_auth (1) failed (%i)\n",
 			__func__, r);
@@ -165,11 +198,11 @@ drm_public int amdgpu_device_initialize(int fd,
 	}
 
 	for (dev = dev_list; dev; dev = dev->next)
-		if (fd_compare(dev->fd, fd) == 0)
+		if (dev->key == key)
 			break;
 
 	if (dev) {
-		r = amdgpu_get_auth(dev->fd, &flag_authexist);
+		r = amdgpu_get_auth(dev->fd, dev->node_type, &flag_authexist);
 		if (r) {
 			fprintf(stderr, "%s: amdgpu_get_auth (2) failed (%i)\n",
 				__func__, r);
@@ -195,6 +228,8 @@ drm_public int amdgpu_device_initialize(int fd,
 
 	dev->fd = -1;
 	dev->flink_fd = -1;
+	dev->key = key;
+	dev->node_type = node_type;
 
 	atomic_set(&dev->refcount, 1);
 
@@ -218,6 +253,9 @@ drm_public int amdgpu_device_initialize(int fd,
 	drmFreeVersion(version);
 
 	pthread_mutex_init(&dev->bo_table_mutex, NULL);
+	pthread_mutex_init(&dev->close_mutex, NULL);
+	pthread_mutex_init(&dev->cpu_map_mutex, NULL);
+	pthread_mutex_init(&dev->info_cache.mutex, NULL);
 
 	/* Check if acceleration is working. */
 	r = amdgpu_query_info(dev, AMDGPU_INFO_ACCEL_WORKING, 4, &accel_working);
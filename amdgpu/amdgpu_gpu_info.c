@@ -23,11 +23,13 @@
  */
 
 #include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "amdgpu.h"
 #include "amdgpu_drm.h"
 #include "amdgpu_internal.h"
+#include "util_math.h"
 #include "xf86drm.h"
 
 drm_public int amdgpu_query_info(amdgpu_device_handle dev, unsigned info_id,
@@ -82,7 +84,19 @@ drm_public int amdgpu_query_hw_ip_count(amdgpu_device_handle dev,
 					unsigned type,
 					uint32_t *count)
 {
+	struct amdgpu_info_cache *cache = &dev->info_cache;
 	struct drm_amdgpu_info request;
+	int r;
+
+	if (type < AMDGPU_HW_IP_NUM) {
+		pthread_mutex_lock(&cache->mutex);
+		if (cache->hw_ip_count_valid & (1u << type)) {
+			*count = cache->hw_ip_count[type];
+			pthread_mutex_unlock(&cache->mutex);
+			return 0;
+		}
+		pthread_mutex_unlock(&cache->mutex);
+	}
 
 	memset(&request, 0, sizeof(request));
 	request.return_pointer = (uintptr_t)count;
@@ -90,15 +104,38 @@ drm_public int amdgpu_query_hw_ip_count(amdgpu_device_handle dev,
 	request.query = AMDGPU_INFO_HW_IP_COUNT;
 	request.query_hw_ip.type = type;
 
-	return drmCommandWrite(dev->fd, DRM_AMDGPU_INFO, &request,
-			       sizeof(struct drm_amdgpu_info));
+	r = drmCommandWrite(dev->fd, DRM_AMDGPU_INFO, &request,
+			    sizeof(struct drm_amdgpu_info));
+	if (r || type >= AMDGPU_HW_IP_NUM)
+		return r;
+
+	pthread_mutex_lock(&cache->mutex);
+	cache->hw_ip_count[type] = *count;
+	cache->hw_ip_count_valid |= 1u << type;
+	pthread_mutex_unlock(&cache->mutex);
+	return 0;
 }
 
 drm_public int amdgpu_query_hw_ip_info(amdgpu_device_handle dev, unsigned type,
 				       unsigned ip_instance,
 				       struct drm_amdgpu_info_hw_ip *info)
 {
+	struct amdgpu_info_cache *cache = &dev->info_cache;
 	struct drm_amdgpu_info request;
+	bool cacheable;
+	int r;
+
+	cacheable = type < AMDGPU_HW_IP_NUM &&
+		    ip_instance < AMDGPU_HW_IP_INSTANCE_MAX_COUNT;
+	if (cacheable) {
+		pthread_mutex_lock(&cache->mutex);
+		if (cache->hw_ip_info_valid[type] & (1u << ip_instance)) {
+			*info = cache->hw_ip_info[type][ip_instance];
+			pthread_mutex_unlock(&cache->mutex);
+			return 0;
+		}
+		pthread_mutex_unlock(&cache->mutex);
+	}
 
 	memset(&request, 0, sizeof(request));
 	request.return_pointer = (uintptr_t)info;
@@ -107,18 +144,55 @@ drm_public int amdgpu_query_hw_ip_info(amdgpu_device_handle dev, unsigned type,
 	request.query_hw_ip.type = type;
 	request.query_hw_ip.ip_instance = ip_instance;
 
-	return drmCommandWrite(dev->fd, DRM_AMDGPU_INFO, &request,
-			       sizeof(struct drm_amdgpu_info));
+	r = drmCommandWrite(dev->fd, DRM_AMDGPU_INFO, &request,
+			    sizeof(struct drm_amdgpu_info));
+	if (r || !cacheable)
+		return r;
+
+	pthread_mutex_lock(&cache->mutex);
+	cache->hw_ip_info[type][ip_instance] = *info;
+	cache->hw_ip_info_valid[type] |= 1u << ip_instance;
+	pthread_mutex_unlock(&cache->mutex);
+	return 0;
+}
+
+/* Needs the info cache mutex. */
+static struct amdgpu_fw_version *
+amdgpu_find_fw_version(struct amdgpu_info_cache *cache, unsigned fw_type,
+		       unsigned ip_instance, unsigned index)
+{
+	uint32_t i;
+
+	for (i = 0; i < cache->num_fw; i++) {
+		struct amdgpu_fw_version *fw = &cache->fw[i];
+
+		if (fw->fw_type == fw_type && fw->ip_instance == ip_instance &&
+		    fw->index == index)
+			return fw;
+	}
+	return NULL;
 }
 
 drm_public int amdgpu_query_firmware_version(amdgpu_device_handle dev,
 		unsigned fw_type, unsigned ip_instance, unsigned index,
 		uint32_t *version, uint32_t *feature)
 {
+	struct amdgpu_info_cache *cache = &dev->info_cache;
 	struct drm_amdgpu_info request;
 	struct drm_amdgpu_info_firmware firmware = {};
+	struct amdgpu_fw_version *fw;
 	int r;
 
+	pthread_mutex_lock(&cache->mutex);
+	fw = amdgpu_find_fw_version(cache, fw_type, ip_instance, index);
+	if (fw) {
+		*version = fw->version;
+		*feature = fw->feature;
+		pthread_mutex_unlock(&cache->mutex);
+		return 0;
+	}
+	pthread_mutex_unlock(&cache->mutex);
+
 	memset(&request, 0, sizeof(request));
 	request.return_pointer = (uintptr_t)&firmware;
 	request.return_size = sizeof(firmware);
@@ -134,6 +208,29 @@ drm_public int amdgpu_query_firmware_version(amdgpu_device_handle dev,
 
 	*version = firmware.ver;
 	*feature = firmware.feature;
+
+	/* Failing to remember the version only costs another ioctl. */
+	pthread_mutex_lock(&cache->mutex);
+	if (!amdgpu_find_fw_version(cache, fw_type, ip_instance, index)) {
+		if (cache->num_fw == cache->max_fw) {
+			uint32_t max_fw = MAX2(cache->max_fw * 2, 16);
+
+			fw = realloc(cache->fw, max_fw * sizeof(*fw));
+			if (fw) {
+				cache->fw = fw;
+				cache->max_fw = max_fw;
+			}
+		}
+		if (cache->num_fw < cache->max_fw) {
+			fw = &cache->fw[cache->num_fw++];
+			fw->fw_type = fw_type;
+			fw->ip_instance = ip_instance;
+			fw->index = index;
+			fw->version = firmware.ver;
+			fw->feature = firmware.feature;
+		}
+	}
+	pthread_mutex_unlock(&cache->mutex);
 	return 0;
 }
 
@@ -295,16 +392,30 @@ drm_public int amdgpu_query_heap_info(amdgpu_device_handle dev,
 drm_public int amdgpu_query_gds_info(amdgpu_device_handle dev,
 				     struct amdgpu_gds_resource_info *gds_info)
 {
+	struct amdgpu_info_cache *cache = &dev->info_cache;
 	struct drm_amdgpu_info_gds gds_config = {};
-        int r;
+	int r;
 
 	if (!gds_info)
 		return -EINVAL;
 
-        r = amdgpu_query_info(dev, AMDGPU_INFO_GDS_CONFIG,
-                              sizeof(gds_config), &gds_config);
-        if (r)
-                return r;
+	pthread_mutex_lock(&cache->mutex);
+	if (cache->gds_valid) {
+		gds_config = cache->gds;
+		pthread_mutex_unlock(&cache->mutex);
+	} else {
+		pthread_mutex_unlock(&cache->mutex);
+
+		r = amdgpu_query_info(dev, AMDGPU_INFO_GDS_CONFIG,
+				      sizeof(gds_config), &gds_config);
+		if (r)
+			return r;
+
+		pthread_mutex_lock(&cache->mutex);
+		cache->gds = gds_config;
+		cache->gds_valid = true;
+		pthread_mutex_unlock(&cache->mutex);
+	}
 
 	gds_info->gds_gfx_partition_size = gds_config.gds_gfx_partition_size;
 	gds_info->compute_partition_size = gds_config.compute_partition_size;
@@ -0,0 +1,356 @@
+/*
+ * Copyright 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Pool of huge page backed host memory for zero-copy uploads.  Chunks are
+ * mapped 2 MiB aligned, registered as userptr buffers once and mapped at
+ * 2 MiB aligned GPU addresses.  Each chunk keeps its suballocations and the
+ * holes between them on one list sorted by offset; allocation is first fit
+ * and freeing merges a hole with its free neighbours.  An empty chunk is
+ * released as long as the pool has another one.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#include "amdgpu.h"
+#include "amdgpu_drm.h"
+#include "amdgpu_internal.h"
+#include "util_math.h"
+
+#define AMDGPU_HOST_POOL_PAGE_SIZE	(2 * 1024 * 1024)
+#define AMDGPU_HOST_POOL_CHUNK_SIZE	(16 * 1024 * 1024)
+#define AMDGPU_HOST_POOL_MIN_ALIGN	256
+
+static void *amdgpu_host_pool_map(uint64_t size, uint32_t flags,
+				  bool *hugetlb)
+{
+	uintptr_t addr, start;
+	void *cpu;
+
+#ifdef MAP_HUGETLB
+	if (flags & AMDGPU_HOST_POOL_HUGETLB) {
+		cpu = mmap(NULL, size, PROT_READ | PROT_WRITE,
+			   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (cpu != MAP_FAILED) {
+			*hugetlb = true;
+			return cpu;
+		}
+	}
+#endif
+
+	/* Transparent huge pages need 2 MiB aligned ranges, so map an extra
+	 * huge page and trim the ends.
+	 */
+	cpu = mmap(NULL, size + AMDGPU_HOST_POOL_PAGE_SIZE,
+		   PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (cpu == MAP_FAILED)
+		return NULL;
+
+	addr = (uintptr_t)cpu;
+	start = ALIGN(addr, AMDGPU_HOST_POOL_PAGE_SIZE);
+	if (start > addr)
+		munmap(cpu, start - addr);
+	if (addr + AMDGPU_HOST_POOL_PAGE_SIZE > start)
+		munmap((void *)(start + size),
+		       addr + AMDGPU_HOST_POOL_PAGE_SIZE - start);
+#ifdef MADV_HUGEPAGE
+	madvise((void *)start, size, MADV_HUGEPAGE);
+#endif
+
+	*hugetlb = false;
+	return (void *)start;
+}
+
+static void amdgpu_host_chunk_destroy(struct amdgpu_host_chunk *chunk)
+{
+	struct amdgpu_host_range *range, *tmp;
+
+	amdgpu_bo_va_op(chunk->bo, 0, chunk->size, chunk->va, 0,
+			AMDGPU_VA_OP_UNMAP);
+	amdgpu_va_range_free(chunk->va_handle);
+	amdgpu_bo_free(chunk->bo);
+	munmap(chunk->cpu, chunk->size);
+
+	LIST_FOR_EACH_ENTRY_SAFE(range, tmp, &chunk->ranges, head)
+		free(range);
+	free(chunk);
+}
+
+static int amdgpu_host_chunk_create(struct amdgpu_host_pool *pool,
+				    uint64_t size,
+				    struct amdgpu_host_chunk **out)
+{
+	struct amdgpu_host_chunk *chunk;
+	struct amdgpu_host_range *hole;
+	int r = -ENOMEM;
+
+	chunk = calloc(1, sizeof(*chunk));
+	hole = calloc(1, sizeof(*hole));
+	if (!chunk || !hole)
+		goto error_alloc;
+
+	chunk->pool = pool;
+	chunk->size = size;
+	list_inithead(&chunk->ranges);
+
+	chunk->cpu = amdgpu_host_pool_map(size, pool->flags, &chunk->hugetlb);
+	if (!chunk->cpu)
+		goto error_alloc;
+
+	r = amdgpu_create_bo_from_user_mem(pool->dev, chunk->cpu, size,
+					   &chunk->bo);
+	if (r)
+		goto error_userptr;
+
+	r = amdgpu_va_range_alloc(pool->dev, amdgpu_gpu_va_range_general,
+				  size, AMDGPU_HOST_POOL_PAGE_SIZE, 0,
+				  &chunk->va, &chunk->va_handle, 0);
+	if (r)
+		goto error_va_alloc;
+
+	r = amdgpu_bo_va_op(chunk->bo, 0, size, chunk->va, 0,
+			    AMDGPU_VA_OP_MAP);
+	if (r)
+		goto error_va_map;
+
+	hole->chunk = chunk;
+	hole->base.size = size;
+	hole->free = true;
+	list_addtail(&hole->head, &chunk->ranges);
+
+	*out = chunk;
+	return 0;
+
+error_va_map:
+	amdgpu_va_range_free(chunk->va_handle);
+error_va_alloc:
+	amdgpu_bo_free(chunk->bo);
+error_userptr:
+	munmap(chunk->cpu, size);
+error_alloc:
+	free(hole);
+	free(chunk);
+	return r;
+}
+
+/* Carves [start, start + size) out of free range @hole. */
+static struct amdgpu_host_range *
+amdgpu_host_range_split(struct amdgpu_host_range *hole, uint64_t start,
+			uint64_t size)
+{
+	struct amdgpu_host_chunk *chunk = hole->chunk;
+	struct amdgpu_host_range *front = NULL, *back = NULL;
+	uint64_t end = start + size;
+	uint64_t hole_end = hole->base.offset + hole->base.size;
+
+	if (start > hole->base.offset) {
+		front = calloc(1, sizeof(*front));
+		if (!front)
+			return NULL;
+	}
+	if (end < hole_end) {
+		back = calloc(1, sizeof(*back));
+		if (!back) {
+			free(front);
+			return NULL;
+		}
+	}
+
+	if (front) {
+		front->chunk = chunk;
+		front->free = true;
+		front->base.offset = hole->base.offset;
+		front->base.size = start - hole->base.offset;
+		list_addtail(&front->head, &hole->head);
+	}
+	if (back) {
+		back->chunk = chunk;
+		back->free = true;
+		back->base.offset = end;
+		back->base.size = hole_end - end;
+		list_add(&back->head, &hole->head);
+	}
+
+	hole->free = false;
+	hole->base.bo = chunk->bo;
+	hole->base.offset = start;
+	hole->base.size = size;
+	hole->base.va = chunk->va + start;
+	hole->base.cpu = (char *)chunk->cpu + start;
+	chunk->used += size;
+	return hole;
+}
+
+static struct amdgpu_host_range *
+amdgpu_host_chunk_alloc(struct amdgpu_host_chunk *chunk, uint64_t size,
+			uint64_t alignment)
+{
+	struct amdgpu_host_range *hole;
+	uint64_t start;
+
+	if (chunk->size - chunk->used < size)
+		return NULL;
+
+	LIST_FOR_EACH_ENTRY(hole, &chunk->ranges, head) {
+		if (!hole->free)
+			continue;
+		start = ALIGN(hole->base.offset, alignment);
+		if (start + size <= hole->base.offset + hole->base.size)
+			return amdgpu_host_range_split(hole, start, size);
+	}
+	return NULL;
+}
+
+drm_public int amdgpu_host_pool_create(amdgpu_device_handle dev,
+				       uint64_t chunk_size, uint32_t flags,
+				       amdgpu_host_pool_handle *pool_handle)
+{
+	struct amdgpu_host_pool *pool;
+
+	if (!dev || !pool_handle || (flags & ~AMDGPU_HOST_POOL_HUGETLB))
+		return -EINVAL;
+
+	pool = calloc(1, sizeof(*pool));
+	if (!pool)
+		return -ENOMEM;
+
+	pool->dev = dev;
+	pool->chunk_size = ALIGN(chunk_size ? chunk_size :
+				 AMDGPU_HOST_POOL_CHUNK_SIZE,
+				 AMDGPU_HOST_POOL_PAGE_SIZE);
+	pool->flags = flags;
+	pthread_mutex_init(&pool->mutex, NULL);
+	list_inithead(&pool->chunks);
+
+	*pool_handle = pool;
+	return 0;
+}
+
+drm_public int amdgpu_host_pool_destroy(amdgpu_host_pool_handle pool)
+{
+	struct amdgpu_host_chunk *chunk, *tmp;
+
+	if (!pool)
+		return -EINVAL;
+
+	LIST_FOR_EACH_ENTRY_SAFE(chunk, tmp, &pool->chunks, head)
+		amdgpu_host_chunk_destroy(chunk);
+
+	pthread_mutex_destroy(&pool->mutex);
+	free(pool);
+	return 0;
+}
+
+drm_public int amdgpu_host_pool_alloc(amdgpu_host_pool_handle pool,
+				      uint64_t size, uint64_t alignment,
+				      struct amdgpu_host_pool_entry **entry)
+{
+	struct amdgpu_host_chunk *chunk;
+	struct amdgpu_host_range *range = NULL;
+	int r;
+
+	if (!pool || !size || !entry || (alignment & (alignment - 1)) ||
+	    alignment > AMDGPU_HOST_POOL_PAGE_SIZE)
+		return -EINVAL;
+
+	alignment = MAX2(alignment, AMDGPU_HOST_POOL_MIN_ALIGN);
+	size = ALIGN(size, AMDGPU_HOST_POOL_MIN_ALIGN);
+
+	pthread_mutex_lock(&pool->mutex);
+	LIST_FOR_EACH_ENTRY(chunk, &pool->chunks, head) {
+		range = amdgpu_host_chunk_alloc(chunk, size, alignment);
+		if (range)
+			break;
+	}
+
+	if (!range) {
+		r = amdgpu_host_chunk_create(pool,
+				MAX2(pool->chunk_size,
+				     ALIGN(size, AMDGPU_HOST_POOL_PAGE_SIZE)),
+				&chunk);
+		if (r) {
+			pthread_mutex_unlock(&pool->mutex);
+			return r;
+		}
+		list_addtail(&chunk->head, &pool->chunks);
+
+		range = amdgpu_host_chunk_alloc(chunk, size, alignment);
+		if (!range) {
+			pthread_mutex_unlock(&pool->mutex);
+			return -ENOMEM;
+		}
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	*entry = &range->base;
+	return 0;
+}
+
+drm_public int amdgpu_host_pool_free(struct amdgpu_host_pool_entry *entry)
+{
+	struct amdgpu_host_range *range = (struct amdgpu_host_range *)entry;
+	struct amdgpu_host_range *prev, *next;
+	struct amdgpu_host_chunk *chunk;
+	struct amdgpu_host_pool *pool;
+
+	if (!entry)
+		return -EINVAL;
+
+	chunk = range->chunk;
+	pool = chunk->pool;
+
+	pthread_mutex_lock(&pool->mutex);
+	range->free = true;
+	chunk->used -= range->base.size;
+
+	if (range->head.prev != &chunk->ranges) {
+		prev = LIST_ENTRY(struct amdgpu_host_range, range->head.prev,
+				  head);
+		if (prev->free) {
+			prev->base.size += range->base.size;
+			list_del(&range->head);
+			free(range);
+			range = prev;
+		}
+	}
+	if (range->head.next != &chunk->ranges) {
+		next = LIST_ENTRY(struct amdgpu_host_range, range->head.next,
+				  head);
+		if (next->free) {
+			range->base.size += next->base.size;
+			list_del(&next->head);
+			free(next);
+		}
+	}
+
+	/* Keep one chunk around so churn doesn't re-register memory. */
+	if (!chunk->used && pool->chunks.next != pool->chunks.prev) {
+		list_del(&chunk->head);
+		amdgpu_host_chunk_destroy(chunk);
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	return 0;
+}
@@ -27,6 +27,8 @@
 
 #include <assert.h>
 #include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
 
 #include "libdrm_macros.h"
 #include "xf86atomic.h"
@@ -43,17 +45,34 @@
 #define AMDGPU_INVALID_VA_ADDRESS	0xffffffffffffffff
 #define AMDGPU_NULL_SUBMIT_SEQ		0
 
+/* Node of an AVL tree of holes ordered by offset. */
 struct amdgpu_bo_va_hole {
-	struct list_head list;
+	struct amdgpu_bo_va_hole *left, *right;
 	uint64_t offset;
 	uint64_t size;
+	uint64_t max_size;	/* largest hole in this subtree */
+	int height;
+};
+
+/* Per-thread caches of small VA ranges, see AMDGPU_VA_RANGE_THREAD_CACHE. */
+#define AMDGPU_VA_CACHE_SHARDS		8
+#define AMDGPU_VA_CACHE_CLASSES		8	/* 1 to 8 times va_alignment */
+#define AMDGPU_VA_CACHE_DEPTH		16
+#define AMDGPU_VA_CACHE_BATCH		8
+
+struct amdgpu_va_magazine {
+	pthread_mutex_t mutex;
+	uint32_t count[AMDGPU_VA_CACHE_CLASSES];
+	uint64_t va[AMDGPU_VA_CACHE_CLASSES][AMDGPU_VA_CACHE_DEPTH];
 };
 
 struct amdgpu_bo_va_mgr {
 	uint64_t va_max;
-	struct list_head va_holes;
+	struct amdgpu_bo_va_hole *va_holes;
 	pthread_mutex_t bo_va_mutex;
 	uint32_t va_alignment;
+	/* AMDGPU_VA_CACHE_SHARDS magazines, taken before bo_va_mutex */
+	struct amdgpu_va_magazine *va_cache;
 };
 
 struct amdgpu_va {
@@ -62,6 +81,57 @@ struct amdgpu_va {
 	uint64_t size;
 	enum amdgpu_gpu_va_range range;
 	struct amdgpu_bo_va_mgr *vamgr;
+	bool cached;
+};
+
+struct amdgpu_bo_bucket {
+	uint64_t size;
+	struct list_head list;
+};
+
+/* Freed buffers kept for reuse, see amdgpu_device_enable_bo_reuse(). */
+struct amdgpu_bo_cache {
+	struct amdgpu_bo_bucket cache_bucket[14 * 4];
+	int num_buckets;
+	time_t time;
+	/** Total size and number of the buffers in the buckets */
+	uint64_t size;
+	uint32_t count;
+};
+
+/* Kernel side of a destroyed buffer, released outside bo_table_mutex. */
+struct amdgpu_bo_close {
+	uint32_t handle;
+	void *cpu_ptr;
+	uint64_t size;
+};
+
+struct amdgpu_bo_close_list {
+	struct amdgpu_bo_close *items;
+	uint32_t count;
+	uint32_t max;
+};
+
+struct amdgpu_fw_version {
+	uint32_t fw_type;
+	uint32_t ip_instance;
+	uint32_t index;
+	uint32_t version;
+	uint32_t feature;
+};
+
+/* AMDGPU_INFO results that can't change, filled in on first query. */
+struct amdgpu_info_cache {
+	pthread_mutex_t mutex;
+	uint32_t hw_ip_count_valid;	/* bit per HW IP type */
+	uint32_t hw_ip_count[AMDGPU_HW_IP_NUM];
+	uint32_t hw_ip_info_valid[AMDGPU_HW_IP_NUM];	/* bit per instance */
+	struct drm_amdgpu_info_hw_ip hw_ip_info[AMDGPU_HW_IP_NUM][AMDGPU_HW_IP_INSTANCE_MAX_COUNT];
+	bool gds_valid;
+	struct drm_amdgpu_info_gds gds;
+	struct amdgpu_fw_version *fw;
+	uint32_t num_fw;
+	uint32_t max_fw;
 };
 
 struct amdgpu_device {
@@ -69,18 +139,38 @@ struct amdgpu_device {
 	struct amdgpu_device *next;
 	int fd;
 	int flink_fd;
+	/** Device number of the primary node, identifies the device */
+	dev_t key;
+	/** DRM_NODE_* type of fd */
+	int node_type;
 	unsigned major_version;
 	unsigned minor_version;
 
 	char *marketing_name;
-	/** List of buffer handles. Protected by bo_table_mutex. */
+	/** List of buffer handles. Modified under bo_table_mutex, see
+	 * handle_table.h for lockless lookups. */
 	struct handle_table bo_handles;
-	/** List of buffer GEM flink names. Protected by bo_table_mutex. */
+	/** List of buffer GEM flink names. Same rules as bo_handles. */
 	struct handle_table bo_flink_names;
 	/** This protects all hash tables. */
 	pthread_mutex_t bo_table_mutex;
+	/** Serial of the last buffer created. Protected by bo_table_mutex */
+	uint64_t bo_serial;
+	/** Buffers in bo_handles, allocated or imported, for
+	 * amdgpu_device_get_bo_stats(). Protected by bo_table_mutex */
+	uint64_t alloc_size, import_size;
+	uint32_t alloc_count, import_count;
+	/** CPU mapped buffers sorted by cpu_ptr. Protected by cpu_map_mutex,
+	 * which is taken last and never held while taking another lock. */
+	struct amdgpu_bo **cpu_maps;
+	uint32_t num_cpu_maps;
+	uint32_t max_cpu_maps;
+	/** Total size of the buffers in cpu_maps */
+	uint64_t cpu_map_size;
+	pthread_mutex_t cpu_map_mutex;
 	struct drm_amdgpu_info_device dev_info;
 	struct amdgpu_gpu_info info;
+	struct amdgpu_info_cache info_cache;
 	/** The VA manager for the lower virtual address space */
 	struct amdgpu_bo_va_mgr vamgr;
 	/** The VA manager for the 32bit address space */
@@ -89,6 +179,17 @@ struct amdgpu_device {
 	struct amdgpu_bo_va_mgr vamgr_high;
 	/** The VA manager for the 32bit high address space */
 	struct amdgpu_bo_va_mgr vamgr_high_32;
+	/** Buffers waiting for reuse. Protected by bo_table_mutex */
+	struct amdgpu_bo_cache bo_cache;
+	/** Destroyed buffers to close. Protected by bo_table_mutex */
+	struct amdgpu_bo_close_list closes;
+	/** Empty spare for closes. Protected by close_mutex */
+	struct amdgpu_bo_close_list closing;
+	/** Keeps imports from getting a handle that is about to be closed.
+	 * Taken before bo_table_mutex. */
+	pthread_mutex_t close_mutex;
+	/** Keep CPU mappings until buffers are freed */
+	bool persistent_cpu_maps;
 };
 
 struct amdgpu_bo {
@@ -99,16 +200,211 @@ struct amdgpu_bo {
 
 	uint32_t handle;
 	uint32_t flink_name;
+	uint64_t serial;
 
+	/* cpu_map_count may be raised from a non-zero value without the
+	 * mutex; dropping it to zero, and cpu_ptr, need the mutex. */
 	pthread_mutex_t cpu_access_mutex;
 	void *cpu_ptr;
-	int cpu_map_count;
+	atomic_t cpu_map_count;
+
+	/* Creation parameters, for matching in the reuse cache */
+	uint64_t phys_alignment;
+	uint64_t flags;
+	uint32_t preferred_heap;
+	bool reusable;
+	/* Opened from a flink name, dma-buf or user memory */
+	bool imported;
+	/* Created with AMDGPU_GEM_CREATE_VM_ALWAYS_VALID */
+	bool always_valid;
+	time_t free_time;
+	struct list_head cache_list;
+
+	/* amdgpu_bo_query_info() result, valid until the metadata is set
+	 * through this handle */
+	pthread_mutex_t info_mutex;
+	struct amdgpu_bo_info *info;
+	uint32_t info_seq;
+	bool info_valid;
+};
+
+#define AMDGPU_SLAB_MIN_ORDER	8	/* 256 bytes */
+#define AMDGPU_SLAB_MAX_ORDER	16	/* 64 KiB */
+#define AMDGPU_SLAB_NUM_CLASSES	(AMDGPU_SLAB_MAX_ORDER - AMDGPU_SLAB_MIN_ORDER + 1)
+
+struct amdgpu_slab_parent;
+
+struct amdgpu_slab_entry {
+	struct amdgpu_bo_slab_entry base;
+	struct amdgpu_slab_parent *parent;
+	struct list_head head;
+};
+
+/* A parent buffer split into entries of one size class. */
+struct amdgpu_slab_parent {
+	struct amdgpu_bo_slab *slab;
+	struct list_head head;		/* in slab->partial when not full */
+	unsigned class;
+	amdgpu_bo_handle bo;
+	amdgpu_va_handle va_handle;
+	uint64_t va;
+	uint64_t size;
+	struct list_head free;
+	unsigned num_free;
+	unsigned num_entries;
+	struct amdgpu_slab_entry entries[];
+};
+
+struct amdgpu_bo_slab {
+	struct amdgpu_device *dev;
+	uint32_t preferred_heap;
+	uint64_t flags;
+	pthread_mutex_t mutex;
+	struct list_head partial[AMDGPU_SLAB_NUM_CLASSES];
+	struct list_head full;
+};
+
+struct amdgpu_host_chunk;
+
+/* A suballocation of a host pool chunk, or a hole between them. */
+struct amdgpu_host_range {
+	struct amdgpu_host_pool_entry base;
+	struct amdgpu_host_chunk *chunk;
+	struct list_head head;		/* in chunk->ranges, by offset */
+	bool free;
+};
+
+/* Huge page backed host memory registered as one userptr buffer. */
+struct amdgpu_host_chunk {
+	struct amdgpu_host_pool *pool;
+	struct list_head head;		/* in pool->chunks */
+	void *cpu;
+	uint64_t size;
+	bool hugetlb;
+	amdgpu_bo_handle bo;
+	amdgpu_va_handle va_handle;
+	uint64_t va;
+	uint64_t used;			/* bytes handed out */
+	struct list_head ranges;
+};
+
+struct amdgpu_host_pool {
+	struct amdgpu_device *dev;
+	uint64_t chunk_size;
+	uint32_t flags;
+	pthread_mutex_t mutex;
+	struct list_head chunks;
+};
+
+struct amdgpu_va_batch_op {
+	amdgpu_bo_handle bo;	/* holds a reference */
+	uint64_t offset;
+	uint64_t size;
+	uint64_t addr;
+	uint64_t flags;
+	uint32_t ops;
+};
+
+struct amdgpu_bo_va_batch {
+	struct amdgpu_device *dev;
+	uint32_t flags;
+	struct amdgpu_va_batch_op *ops;
+	uint32_t num_ops;
+	uint32_t max_ops;
+};
+
+struct amdgpu_upload_ring_fence {
+	struct amdgpu_cs_fence fence;
+	uint64_t end;		/* head when the fence was added */
+};
+
+struct amdgpu_upload_ring {
+	struct amdgpu_device *dev;
+	amdgpu_bo_handle bo;
+	amdgpu_va_handle va_handle;
+	uint64_t va;
+	void *cpu;
+	bool user_mem;
+	uint64_t size;
+	pthread_mutex_t mutex;
+	uint64_t head;		/* end of the space handed out */
+	uint64_t tail;		/* start of the space still in use */
+	uint64_t fenced;	/* head as of the last fence */
+	struct amdgpu_upload_ring_fence *fences;
+	uint32_t first_fence;
+	uint32_t num_fences;
+	uint32_t max_fences;
+};
+
+struct amdgpu_sdma_ib {
+	amdgpu_bo_handle bo;
+	amdgpu_va_handle va_handle;
+	uint64_t va;
+	uint32_t *cpu;
+	bool busy;		/* fence is of the last submission */
+	struct amdgpu_cs_fence fence;
+};
+
+struct amdgpu_sdma {
+	struct amdgpu_device *dev;
+	amdgpu_context_handle context;
+	uint32_t ring;
+	bool si;		/* SI packet formats */
+	bool count_minus_one;	/* AI and later */
+	pthread_mutex_t mutex;
+	uint32_t next_ib;
+	uint32_t num_ibs;
+	struct amdgpu_sdma_ib ibs[];
+};
+
+struct amdgpu_cs_scheduler {
+	struct amdgpu_context *context;
+	unsigned ip_type;
+	uint32_t max_ibs;
+	uint32_t num_rings;
+	uint32_t rings[AMDGPU_CS_MAX_RINGS];
+	pthread_mutex_t mutex;
+	/* last sequence known to be signaled, by ring */
+	uint64_t completed[AMDGPU_CS_MAX_RINGS];
+};
+
+struct amdgpu_sampler {
+	struct amdgpu_device *dev;
+	uint32_t mask;		/* sampler thread only after creation */
+	uint64_t interval_ns;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	bool quit;
+
+	/* odd while sample is written */
+	uint64_t seq;
+	struct amdgpu_sensor_sample sample;
+};
+
+/* A handle number alone can be reused for a new buffer; the serial can't. */
+struct amdgpu_bo_list_item {
+	uint64_t serial;
+	uint32_t bo_handle;
+	uint32_t bo_priority;
 };
 
 struct amdgpu_bo_list {
 	struct amdgpu_device *dev;
 
 	uint32_t handle;
+
+	/* What the kernel list holds, sorted, and room to build the next. */
+	struct amdgpu_bo_list_item *items;
+	struct amdgpu_bo_list_item *scratch;
+	uint32_t num_items;
+	uint32_t max_items;
+};
+
+/* Where the last submission to a ring had the GPU write its sequence. */
+struct amdgpu_user_fence {
+	amdgpu_bo_handle bo;	/* holds a reference */
+	uint64_t offset;	/* in uint64_t units */
 };
 
 struct amdgpu_context {
@@ -119,17 +415,24 @@ struct amdgpu_context {
 	/* context id*/
 	uint32_t id;
 	uint64_t last_seq[AMDGPU_HW_IP_NUM][AMDGPU_HW_IP_INSTANCE_MAX_COUNT][AMDGPU_CS_MAX_RINGS];
-	struct list_head sem_list[AMDGPU_HW_IP_NUM][AMDGPU_HW_IP_INSTANCE_MAX_COUNT][AMDGPU_CS_MAX_RINGS];
+	struct amdgpu_user_fence user_fence[AMDGPU_HW_IP_NUM][AMDGPU_HW_IP_INSTANCE_MAX_COUNT][AMDGPU_CS_MAX_RINGS];
+	/* Semaphores the next submission waits for, pushed and taken
+	 * without sequence_mutex */
+	struct amdgpu_semaphore *sem_list[AMDGPU_HW_IP_NUM][AMDGPU_HW_IP_INSTANCE_MAX_COUNT][AMDGPU_CS_MAX_RINGS];
 };
 
 /**
- * Structure describing sw semaphore based on scheduler
+ * Structure describing a semaphore, backed by a syncobj holding the fence
+ * of the submission that signals it
  *
  */
 struct amdgpu_semaphore {
 	atomic_t refcount;
-	struct list_head list;
+	struct amdgpu_semaphore *next;	/* in a sem_list of the context */
 	struct amdgpu_cs_fence signal_fence;
+	/* the context of signal_fence may be gone before a wait */
+	struct amdgpu_device *dev;
+	uint32_t syncobj;	/* 0 if nothing was submitted before */
 };
 
 /**
@@ -141,6 +444,21 @@ drm_private void amdgpu_vamgr_init(struct amdgpu_bo_va_mgr *mgr, uint64_t start,
 
 drm_private void amdgpu_vamgr_deinit(struct amdgpu_bo_va_mgr *mgr);
 
+drm_private void amdgpu_vamgr_flush_cache(struct amdgpu_bo_va_mgr *mgr);
+
+drm_private void amdgpu_bo_destroy(struct amdgpu_bo *bo);
+drm_private void amdgpu_bo_close_flush(struct amdgpu_device *dev);
+drm_private void amdgpu_bo_cpu_unmap_all(struct amdgpu_bo *bo);
+
+drm_private void amdgpu_bo_cache_init(struct amdgpu_bo_cache *cache);
+drm_private void amdgpu_bo_cache_fini(struct amdgpu_bo_cache *cache);
+drm_private struct amdgpu_bo *
+amdgpu_bo_cache_alloc(struct amdgpu_bo_cache *cache,
+		      struct amdgpu_bo_alloc_request *alloc_buffer,
+		      uint64_t *size);
+drm_private int amdgpu_bo_cache_free(struct amdgpu_bo_cache *cache,
+				     struct amdgpu_bo *bo);
+
 drm_private void amdgpu_parse_asic_ids(struct amdgpu_device *dev);
 
 drm_private int amdgpu_query_gpu_info_init(amdgpu_device_handle dev);
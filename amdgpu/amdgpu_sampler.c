@@ -0,0 +1,231 @@
+/*
+ * Copyright 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Sensor sampler.  A thread queries the sensors every interval and
+ * publishes the results under a sequence count: odd while the sample is
+ * written, even once it is complete.  Readers copy the sample and retry if
+ * the count was odd or changed meanwhile, so they never take a lock or
+ * make a syscall.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "amdgpu.h"
+#include "amdgpu_drm.h"
+#include "amdgpu_internal.h"
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+static const struct {
+	uint32_t bit;
+	bool sensor;
+	unsigned id;
+	unsigned size;
+	size_t offset;
+} amdgpu_sampler_queries[] = {
+#define SENSOR(bit, id, field) \
+	{ bit, true, id, sizeof(uint32_t), \
+	  offsetof(struct amdgpu_sensor_sample, field) }
+#define INFO(bit, id, field) \
+	{ bit, false, id, sizeof(uint64_t), \
+	  offsetof(struct amdgpu_sensor_sample, field) }
+	SENSOR(AMDGPU_SAMPLE_GFX_SCLK, AMDGPU_INFO_SENSOR_GFX_SCLK, gfx_sclk),
+	SENSOR(AMDGPU_SAMPLE_GFX_MCLK, AMDGPU_INFO_SENSOR_GFX_MCLK, gfx_mclk),
+	SENSOR(AMDGPU_SAMPLE_TEMPERATURE, AMDGPU_INFO_SENSOR_GPU_TEMP,
+	       temperature),
+	SENSOR(AMDGPU_SAMPLE_LOAD, AMDGPU_INFO_SENSOR_GPU_LOAD, load),
+	SENSOR(AMDGPU_SAMPLE_POWER, AMDGPU_INFO_SENSOR_GPU_AVG_POWER, power),
+	INFO(AMDGPU_SAMPLE_VRAM_USAGE, AMDGPU_INFO_VRAM_USAGE, vram_usage),
+	INFO(AMDGPU_SAMPLE_VIS_VRAM_USAGE, AMDGPU_INFO_VIS_VRAM_USAGE,
+	     vis_vram_usage),
+	INFO(AMDGPU_SAMPLE_GTT_USAGE, AMDGPU_INFO_GTT_USAGE, gtt_usage),
+#undef SENSOR
+#undef INFO
+};
+
+static uint64_t amdgpu_sampler_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* Queries everything in the mask, dropping what the kernel doesn't have. */
+static void amdgpu_sampler_query(struct amdgpu_sampler *sampler,
+				 struct amdgpu_sensor_sample *sample)
+{
+	unsigned i;
+	int r;
+
+	memset(sample, 0, sizeof(*sample));
+	for (i = 0; i < ARRAY_SIZE(amdgpu_sampler_queries); i++) {
+		char *value = (char *)sample + amdgpu_sampler_queries[i].offset;
+
+		if (!(sampler->mask & amdgpu_sampler_queries[i].bit))
+			continue;
+
+		if (amdgpu_sampler_queries[i].sensor)
+			r = amdgpu_query_sensor_info(sampler->dev,
+					amdgpu_sampler_queries[i].id,
+					amdgpu_sampler_queries[i].size, value);
+		else
+			r = amdgpu_query_info(sampler->dev,
+					amdgpu_sampler_queries[i].id,
+					amdgpu_sampler_queries[i].size, value);
+		if (r == -EINVAL || r == -EOPNOTSUPP || r == -ENOENT)
+			sampler->mask &= ~amdgpu_sampler_queries[i].bit;
+		else if (!r)
+			sample->valid |= amdgpu_sampler_queries[i].bit;
+	}
+	sample->timestamp_ns = amdgpu_sampler_now();
+}
+
+static void amdgpu_sampler_publish(struct amdgpu_sampler *sampler,
+				   const struct amdgpu_sensor_sample *sample)
+{
+	uint64_t seq = __atomic_load_n(&sampler->seq, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&sampler->seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	sampler->sample = *sample;
+	sampler->sample.sequence = seq / 2 + 1;
+	__atomic_store_n(&sampler->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+static void *amdgpu_sampler_thread(void *data)
+{
+	struct amdgpu_sampler *sampler = data;
+	struct amdgpu_sensor_sample sample;
+	struct timespec deadline;
+	uint64_t next;
+
+	next = amdgpu_sampler_now();
+
+	pthread_mutex_lock(&sampler->mutex);
+	while (!sampler->quit) {
+		next += sampler->interval_ns;
+		deadline.tv_sec = next / 1000000000ull;
+		deadline.tv_nsec = next % 1000000000ull;
+		if (pthread_cond_timedwait(&sampler->cond, &sampler->mutex,
+					   &deadline) != ETIMEDOUT)
+			continue;
+
+		pthread_mutex_unlock(&sampler->mutex);
+		amdgpu_sampler_query(sampler, &sample);
+		amdgpu_sampler_publish(sampler, &sample);
+
+		/* don't try to catch up after falling behind */
+		if (sample.timestamp_ns > next)
+			next = sample.timestamp_ns;
+		pthread_mutex_lock(&sampler->mutex);
+	}
+	pthread_mutex_unlock(&sampler->mutex);
+
+	return NULL;
+}
+
+drm_public int amdgpu_sampler_create(amdgpu_device_handle dev, uint32_t mask,
+				     uint64_t interval_ns,
+				     amdgpu_sampler_handle *sampler_handle)
+{
+	struct amdgpu_sensor_sample sample;
+	struct amdgpu_sampler *sampler;
+	pthread_condattr_t attr;
+	int r;
+
+	if (!dev || !mask || !interval_ns || !sampler_handle)
+		return -EINVAL;
+
+	sampler = calloc(1, sizeof(*sampler));
+	if (!sampler)
+		return -ENOMEM;
+
+	sampler->dev = dev;
+	sampler->mask = mask;
+	sampler->interval_ns = interval_ns;
+
+	/* readers get a sample right away */
+	amdgpu_sampler_query(sampler, &sample);
+	amdgpu_sampler_publish(sampler, &sample);
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&sampler->cond, &attr);
+	pthread_condattr_destroy(&attr);
+	pthread_mutex_init(&sampler->mutex, NULL);
+
+	r = -pthread_create(&sampler->thread, NULL, amdgpu_sampler_thread,
+			    sampler);
+	if (r) {
+		pthread_mutex_destroy(&sampler->mutex);
+		pthread_cond_destroy(&sampler->cond);
+		free(sampler);
+		return r;
+	}
+
+	*sampler_handle = sampler;
+	return 0;
+}
+
+drm_public int amdgpu_sampler_destroy(amdgpu_sampler_handle sampler)
+{
+	if (!sampler)
+		return -EINVAL;
+
+	pthread_mutex_lock(&sampler->mutex);
+	sampler->quit = true;
+	pthread_cond_signal(&sampler->cond);
+	pthread_mutex_unlock(&sampler->mutex);
+	pthread_join(sampler->thread, NULL);
+
+	pthread_mutex_destroy(&sampler->mutex);
+	pthread_cond_destroy(&sampler->cond);
+	free(sampler);
+	return 0;
+}
+
+drm_public int amdgpu_sampler_read(amdgpu_sampler_handle sampler,
+				   struct amdgpu_sensor_sample *sample)
+{
+	uint64_t seq;
+
+	if (!sampler || !sample)
+		return -EINVAL;
+
+	do {
+		seq = __atomic_load_n(&sampler->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+		*sample = sampler->sample;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((seq & 1) ||
+		 __atomic_load_n(&sampler->seq, __ATOMIC_RELAXED) != seq);
+
+	return 0;
+}
@@ -0,0 +1,383 @@
+/*
+ * Copyright 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Copies and fills on an SDMA ring.  The IBs come from a small pool of
+ * buffers that stay mapped for the CPU and the GPU and are used round
+ * robin; a buffer is written again once its last submission signaled.
+ * Requests too large for one packet are split, and those too large for
+ * one IB are split into several submissions, which the ring runs in order.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "amdgpu.h"
+#include "amdgpu_drm.h"
+#include "amdgpu_internal.h"
+#include "util_math.h"
+
+#define AMDGPU_SDMA_IB_SIZE		16384
+
+/* Packets of SI */
+#define SDMA_PACKET_SI(op, b, t, s, cnt)	((((op) & 0xF) << 28) |	\
+						(((b) & 0x1) << 26) |		\
+						(((t) & 0x1) << 23) |		\
+						(((s) & 0x1) << 22) |		\
+						(((cnt) & 0xFFFFF) << 0))
+#define SDMA_OPCODE_COPY_SI		3
+#define SDMA_OPCODE_CONSTANT_FILL_SI	13
+#define SDMA_NOP_SI			0xf
+
+/* Packets of CIK and later */
+#define SDMA_PACKET(op, sub_op, e)	((((e) & 0xFFFF) << 16) |	\
+					(((sub_op) & 0xFF) << 8) |	\
+					(((op) & 0xFF) << 0))
+#define SDMA_OPCODE_COPY		1
+#define SDMA_COPY_SUB_OPCODE_LINEAR	0
+#define SDMA_OPCODE_CONSTANT_FILL	11
+#define SDMA_CONSTANT_FILL_EXTRA_SIZE(x)	((x) << 14)
+#define SDMA_NOP			0
+
+/* Largest byte counts of one packet, kept aligned */
+#define SDMA_MAX_BYTES_SI		0xfffe0
+#define SDMA_MAX_BYTES			0x3fffe0
+
+#define SDMA_COPY_DWORDS_SI		5
+#define SDMA_FILL_DWORDS_SI		4
+#define SDMA_COPY_DWORDS		7
+#define SDMA_FILL_DWORDS		5
+
+static void amdgpu_sdma_ib_fini(struct amdgpu_sdma_ib *ib)
+{
+	amdgpu_bo_va_op(ib->bo, 0, AMDGPU_SDMA_IB_SIZE, ib->va, 0,
+			AMDGPU_VA_OP_UNMAP);
+	amdgpu_va_range_free(ib->va_handle);
+	amdgpu_bo_cpu_unmap(ib->bo);
+	amdgpu_bo_free(ib->bo);
+}
+
+static int amdgpu_sdma_ib_init(struct amdgpu_sdma *sdma,
+			       struct amdgpu_sdma_ib *ib)
+{
+	struct amdgpu_bo_alloc_request req = {};
+	void *cpu;
+	int r;
+
+	req.alloc_size = AMDGPU_SDMA_IB_SIZE;
+	req.phys_alignment = 4096;
+	req.preferred_heap = AMDGPU_GEM_DOMAIN_GTT;
+	req.flags = AMDGPU_GEM_CREATE_CPU_GTT_USWC;
+	r = amdgpu_bo_alloc(sdma->dev, &req, &ib->bo);
+	if (r)
+		return r;
+
+	r = amdgpu_bo_cpu_map(ib->bo, &cpu);
+	if (r)
+		goto error_cpu_map;
+	ib->cpu = cpu;
+
+	r = amdgpu_va_range_alloc(sdma->dev, amdgpu_gpu_va_range_general,
+				  AMDGPU_SDMA_IB_SIZE, 4096, 0,
+				  &ib->va, &ib->va_handle, 0);
+	if (r)
+		goto error_va_alloc;
+
+	r = amdgpu_bo_va_op(ib->bo, 0, AMDGPU_SDMA_IB_SIZE, ib->va, 0,
+			    AMDGPU_VA_OP_MAP);
+	if (r)
+		goto error_va_map;
+
+	return 0;
+
+error_va_map:
+	amdgpu_va_range_free(ib->va_handle);
+error_va_alloc:
+	amdgpu_bo_cpu_unmap(ib->bo);
+error_cpu_map:
+	amdgpu_bo_free(ib->bo);
+	return r;
+}
+
+drm_public int amdgpu_sdma_create(amdgpu_device_handle dev,
+				  amdgpu_context_handle context,
+				  uint32_t ring, uint32_t num_ibs,
+				  amdgpu_sdma_handle *sdma_handle)
+{
+	struct amdgpu_sdma *sdma;
+	uint32_t i;
+	int r;
+
+	if (!dev || !context || !sdma_handle)
+		return -EINVAL;
+
+	if (!num_ibs)
+		num_ibs = 4;
+
+	sdma = calloc(1, sizeof(*sdma) + num_ibs * sizeof(sdma->ibs[0]));
+	if (!sdma)
+		return -ENOMEM;
+
+	sdma->dev = dev;
+	sdma->context = context;
+	sdma->ring = ring;
+	sdma->si = dev->info.family_id == AMDGPU_FAMILY_SI;
+	sdma->count_minus_one = dev->info.family_id >= AMDGPU_FAMILY_AI;
+
+	for (i = 0; i < num_ibs; i++) {
+		r = amdgpu_sdma_ib_init(sdma, &sdma->ibs[i]);
+		if (r)
+			goto error;
+		sdma->num_ibs++;
+	}
+
+	pthread_mutex_init(&sdma->mutex, NULL);
+	*sdma_handle = sdma;
+	return 0;
+
+error:
+	while (sdma->num_ibs)
+		amdgpu_sdma_ib_fini(&sdma->ibs[--sdma->num_ibs]);
+	free(sdma);
+	return r;
+}
+
+drm_public int amdgpu_sdma_destroy(amdgpu_sdma_handle sdma)
+{
+	uint32_t i;
+
+	if (!sdma)
+		return -EINVAL;
+
+	for (i = 0; i < sdma->num_ibs; i++)
+		amdgpu_sdma_ib_fini(&sdma->ibs[i]);
+	pthread_mutex_destroy(&sdma->mutex);
+	free(sdma);
+	return 0;
+}
+
+/* Called with the mutex held. */
+static int amdgpu_sdma_ib_get(struct amdgpu_sdma *sdma,
+			      struct amdgpu_sdma_ib **ib_out)
+{
+	struct amdgpu_sdma_ib *ib = &sdma->ibs[sdma->next_ib];
+	uint32_t expired;
+	int r;
+
+	if (ib->busy) {
+		r = amdgpu_cs_query_fence_status(&ib->fence,
+						 AMDGPU_TIMEOUT_INFINITE, 0,
+						 &expired);
+		if (r)
+			return r;
+		ib->busy = false;
+	}
+
+	sdma->next_ib = (sdma->next_ib + 1) % sdma->num_ibs;
+	*ib_out = ib;
+	return 0;
+}
+
+/* Called with the mutex held. */
+static int amdgpu_sdma_submit(struct amdgpu_sdma *sdma,
+			      struct amdgpu_sdma_ib *ib, uint32_t ndw,
+			      amdgpu_bo_handle dst, amdgpu_bo_handle src)
+{
+	struct drm_amdgpu_bo_list_entry bos[3];
+	struct amdgpu_cs_submit_info info = {};
+	struct amdgpu_cs_ib_info ib_info = {};
+	uint32_t nop = sdma->si ? SDMA_PACKET_SI(SDMA_NOP_SI, 0, 0, 0, 0) :
+				  SDMA_NOP;
+	uint64_t seq_no;
+	int r;
+
+	/* the ring fetches IBs in units of 8 dwords */
+	while (ndw & 7)
+		ib->cpu[ndw++] = nop;
+
+	ib_info.ib_mc_address = ib->va;
+	ib_info.size = ndw;
+
+	bos[0].bo_handle = ib->bo->handle;
+	bos[0].bo_priority = 0;
+	info.number_of_bo_handles = 1;
+	if (dst) {
+		bos[info.number_of_bo_handles].bo_handle = dst->handle;
+		bos[info.number_of_bo_handles++].bo_priority = 0;
+	}
+	if (src && src != dst) {
+		bos[info.number_of_bo_handles].bo_handle = src->handle;
+		bos[info.number_of_bo_handles++].bo_priority = 0;
+	}
+
+	info.ip_type = AMDGPU_HW_IP_DMA;
+	info.ring = sdma->ring;
+	info.number_of_ibs = 1;
+	info.ibs = &ib_info;
+	info.bo_handles = bos;
+
+	r = amdgpu_cs_submit_desc(sdma->dev, sdma->context, &info, &seq_no);
+	if (r)
+		return r;
+
+	ib->fence.context = sdma->context;
+	ib->fence.ip_type = AMDGPU_HW_IP_DMA;
+	ib->fence.ip_instance = 0;
+	ib->fence.ring = sdma->ring;
+	ib->fence.fence = seq_no;
+	ib->busy = true;
+	return 0;
+}
+
+static uint32_t amdgpu_sdma_emit_copy(struct amdgpu_sdma *sdma, uint32_t *pm4,
+				      uint64_t dst_va, uint64_t src_va,
+				      uint32_t bytes)
+{
+	uint32_t i = 0;
+
+	if (sdma->si) {
+		pm4[i++] = SDMA_PACKET_SI(SDMA_OPCODE_COPY_SI, 0, 0, 0, bytes);
+		pm4[i++] = dst_va;
+		pm4[i++] = src_va;
+		pm4[i++] = (dst_va >> 32) & 0xff;
+		pm4[i++] = (src_va >> 32) & 0xff;
+	} else {
+		pm4[i++] = SDMA_PACKET(SDMA_OPCODE_COPY,
+				       SDMA_COPY_SUB_OPCODE_LINEAR, 0);
+		pm4[i++] = bytes - sdma->count_minus_one;
+		pm4[i++] = 0;
+		pm4[i++] = src_va;
+		pm4[i++] = src_va >> 32;
+		pm4[i++] = dst_va;
+		pm4[i++] = dst_va >> 32;
+	}
+	return i;
+}
+
+static uint32_t amdgpu_sdma_emit_fill(struct amdgpu_sdma *sdma, uint32_t *pm4,
+				      uint64_t dst_va, uint32_t value,
+				      uint32_t bytes)
+{
+	uint32_t i = 0;
+
+	if (sdma->si) {
+		pm4[i++] = SDMA_PACKET_SI(SDMA_OPCODE_CONSTANT_FILL_SI,
+					  0, 0, 0, bytes / 4);
+		pm4[i++] = dst_va & 0xfffffffc;
+		pm4[i++] = value;
+		pm4[i++] = (dst_va >> 32) << 16;
+	} else {
+		pm4[i++] = SDMA_PACKET(SDMA_OPCODE_CONSTANT_FILL, 0,
+				       SDMA_CONSTANT_FILL_EXTRA_SIZE(2));
+		pm4[i++] = dst_va;
+		pm4[i++] = dst_va >> 32;
+		pm4[i++] = value;
+		pm4[i++] = bytes - sdma->count_minus_one;
+	}
+	return i;
+}
+
+/*
+ * Emits packets for dst..dst + size, filling IBs and submitting each.
+ * src_va is only used for copies.
+ */
+static int amdgpu_sdma_run(struct amdgpu_sdma *sdma, bool fill,
+			   amdgpu_bo_handle dst, uint64_t dst_va,
+			   amdgpu_bo_handle src, uint64_t src_va,
+			   uint32_t value, uint64_t size,
+			   struct amdgpu_cs_fence *fence)
+{
+	const uint32_t max_ndw = AMDGPU_SDMA_IB_SIZE / 4 - 8;
+	uint32_t max_bytes, packet_ndw, ndw, bytes;
+	struct amdgpu_sdma_ib *ib = NULL;
+	int r = 0;
+
+	max_bytes = sdma->si ? SDMA_MAX_BYTES_SI : SDMA_MAX_BYTES;
+	if (fill)
+		packet_ndw = sdma->si ? SDMA_FILL_DWORDS_SI : SDMA_FILL_DWORDS;
+	else
+		packet_ndw = sdma->si ? SDMA_COPY_DWORDS_SI : SDMA_COPY_DWORDS;
+
+	pthread_mutex_lock(&sdma->mutex);
+
+	while (size) {
+		r = amdgpu_sdma_ib_get(sdma, &ib);
+		if (r)
+			break;
+
+		ndw = 0;
+		while (size && ndw + packet_ndw <= max_ndw) {
+			bytes = MIN2(size, max_bytes);
+			if (fill)
+				ndw += amdgpu_sdma_emit_fill(sdma, ib->cpu + ndw,
+							     dst_va, value,
+							     bytes);
+			else
+				ndw += amdgpu_sdma_emit_copy(sdma, ib->cpu + ndw,
+							     dst_va, src_va,
+							     bytes);
+			dst_va += bytes;
+			src_va += bytes;
+			size -= bytes;
+		}
+
+		r = amdgpu_sdma_submit(sdma, ib, ndw, dst, src);
+		if (r)
+			break;
+	}
+
+	if (!r && ib && fence)
+		*fence = ib->fence;
+
+	pthread_mutex_unlock(&sdma->mutex);
+	return r;
+}
+
+drm_public int amdgpu_sdma_copy(amdgpu_sdma_handle sdma,
+				amdgpu_bo_handle dst, uint64_t dst_va,
+				amdgpu_bo_handle src, uint64_t src_va,
+				uint64_t size, struct amdgpu_cs_fence *fence)
+{
+	if (!sdma || !size)
+		return -EINVAL;
+
+	/* SI copies dwords */
+	if (sdma->si && ((dst_va | src_va | size) & 3))
+		return -EINVAL;
+
+	return amdgpu_sdma_run(sdma, false, dst, dst_va, src, src_va, 0,
+			       size, fence);
+}
+
+drm_public int amdgpu_sdma_fill(amdgpu_sdma_handle sdma,
+				amdgpu_bo_handle dst, uint64_t dst_va,
+				uint32_t value, uint64_t size,
+				struct amdgpu_cs_fence *fence)
+{
+	if (!sdma || !size || ((dst_va | size) & 3))
+		return -EINVAL;
+
+	return amdgpu_sdma_run(sdma, true, dst, dst_va, NULL, 0, value,
+			       size, fence);
+}
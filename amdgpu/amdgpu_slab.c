@@ -0,0 +1,246 @@
+/*
+ * Copyright 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Slab suballocator for small buffers.  Each parent buffer is split into
+ * equally sized entries of one power of two size class.  Parents with free
+ * entries sit on a per-class partial list, the others on the full list; an
+ * empty parent is released as long as its class has another one to use.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include "amdgpu.h"
+#include "amdgpu_drm.h"
+#include "amdgpu_internal.h"
+#include "util_math.h"
+
+#define AMDGPU_SLAB_PARENT_SIZE		(2 * 1024 * 1024)
+#define AMDGPU_SLAB_MIN_ENTRIES		32
+#define AMDGPU_SLAB_MAX_ENTRIES		1024
+
+static void amdgpu_slab_parent_destroy(struct amdgpu_slab_parent *parent)
+{
+	struct amdgpu_bo_slab *slab = parent->slab;
+
+	if (!(slab->flags & AMDGPU_GEM_CREATE_NO_CPU_ACCESS))
+		amdgpu_bo_cpu_unmap(parent->bo);
+	amdgpu_bo_va_op(parent->bo, 0, parent->size, parent->va, 0,
+			AMDGPU_VA_OP_UNMAP);
+	amdgpu_va_range_free(parent->va_handle);
+	amdgpu_bo_free(parent->bo);
+	free(parent);
+}
+
+static int amdgpu_slab_parent_create(struct amdgpu_bo_slab *slab,
+				     unsigned class,
+				     struct amdgpu_slab_parent **out)
+{
+	struct amdgpu_bo_alloc_request req = {};
+	struct amdgpu_slab_parent *parent;
+	struct amdgpu_slab_entry *e;
+	uint64_t entry_size = 1ull << (class + AMDGPU_SLAB_MIN_ORDER);
+	unsigned i, num;
+	void *cpu = NULL;
+	int r;
+
+	num = AMDGPU_SLAB_PARENT_SIZE / entry_size;
+	num = MIN2(MAX2(num, AMDGPU_SLAB_MIN_ENTRIES), AMDGPU_SLAB_MAX_ENTRIES);
+
+	parent = calloc(1, sizeof(*parent) + num * sizeof(parent->entries[0]));
+	if (!parent)
+		return -ENOMEM;
+
+	parent->slab = slab;
+	parent->class = class;
+	parent->size = num * entry_size;
+	parent->num_entries = num;
+	parent->num_free = num;
+	list_inithead(&parent->free);
+
+	req.alloc_size = parent->size;
+	req.phys_alignment = MAX2(entry_size, 4096);
+	req.preferred_heap = slab->preferred_heap;
+	req.flags = slab->flags;
+	r = amdgpu_bo_alloc(slab->dev, &req, &parent->bo);
+	if (r)
+		goto error_bo;
+
+	/* Entries are naturally aligned in the GPU VA space too. */
+	r = amdgpu_va_range_alloc(slab->dev, amdgpu_gpu_va_range_general,
+				  parent->size, entry_size >= 4096 ? entry_size : 0,
+				  0, &parent->va, &parent->va_handle, 0);
+	if (r)
+		goto error_va_alloc;
+
+	r = amdgpu_bo_va_op(parent->bo, 0, parent->size, parent->va, 0,
+			    AMDGPU_VA_OP_MAP);
+	if (r)
+		goto error_va_map;
+
+	if (!(slab->flags & AMDGPU_GEM_CREATE_NO_CPU_ACCESS)) {
+		r = amdgpu_bo_cpu_map(parent->bo, &cpu);
+		if (r)
+			goto error_cpu_map;
+	}
+
+	for (i = 0; i < num; i++) {
+		e = &parent->entries[i];
+		e->base.bo = parent->bo;
+		e->base.offset = i * entry_size;
+		e->base.size = entry_size;
+		e->base.va = parent->va + e->base.offset;
+		e->base.cpu = cpu ? (char *)cpu + e->base.offset : NULL;
+		e->parent = parent;
+		list_addtail(&e->head, &parent->free);
+	}
+
+	*out = parent;
+	return 0;
+
+error_cpu_map:
+	amdgpu_bo_va_op(parent->bo, 0, parent->size, parent->va, 0,
+			AMDGPU_VA_OP_UNMAP);
+error_va_map:
+	amdgpu_va_range_free(parent->va_handle);
+error_va_alloc:
+	amdgpu_bo_free(parent->bo);
+error_bo:
+	free(parent);
+	return r;
+}
+
+drm_public int amdgpu_bo_slab_create(amdgpu_device_handle dev,
+				     uint32_t preferred_heap, uint64_t flags,
+				     amdgpu_bo_slab_handle *slab_handle)
+{
+	struct amdgpu_bo_slab *slab;
+	unsigned i;
+
+	slab = calloc(1, sizeof(*slab));
+	if (!slab)
+		return -ENOMEM;
+
+	slab->dev = dev;
+	slab->preferred_heap = preferred_heap;
+	slab->flags = flags;
+	pthread_mutex_init(&slab->mutex, NULL);
+	for (i = 0; i < AMDGPU_SLAB_NUM_CLASSES; i++)
+		list_inithead(&slab->partial[i]);
+	list_inithead(&slab->full);
+
+	*slab_handle = slab;
+	return 0;
+}
+
+drm_public int amdgpu_bo_slab_destroy(amdgpu_bo_slab_handle slab)
+{
+	struct amdgpu_slab_parent *parent, *tmp;
+	unsigned i;
+
+	if (!slab)
+		return -EINVAL;
+
+	for (i = 0; i < AMDGPU_SLAB_NUM_CLASSES; i++) {
+		LIST_FOR_EACH_ENTRY_SAFE(parent, tmp, &slab->partial[i], head)
+			amdgpu_slab_parent_destroy(parent);
+	}
+	LIST_FOR_EACH_ENTRY_SAFE(parent, tmp, &slab->full, head)
+		amdgpu_slab_parent_destroy(parent);
+
+	pthread_mutex_destroy(&slab->mutex);
+	free(slab);
+	return 0;
+}
+
+drm_public int amdgpu_bo_slab_alloc(amdgpu_bo_slab_handle slab, uint64_t size,
+				    struct amdgpu_bo_slab_entry **entry)
+{
+	struct amdgpu_slab_parent *parent;
+	struct amdgpu_slab_entry *e;
+	unsigned order = AMDGPU_SLAB_MIN_ORDER, class;
+	int r;
+
+	if (!size || size > 1ull << AMDGPU_SLAB_MAX_ORDER)
+		return -EINVAL;
+
+	while ((1ull << order) < size)
+		order++;
+	class = order - AMDGPU_SLAB_MIN_ORDER;
+
+	pthread_mutex_lock(&slab->mutex);
+	if (LIST_IS_EMPTY(&slab->partial[class])) {
+		r = amdgpu_slab_parent_create(slab, class, &parent);
+		if (r) {
+			pthread_mutex_unlock(&slab->mutex);
+			return r;
+		}
+		list_add(&parent->head, &slab->partial[class]);
+	}
+
+	parent = LIST_ENTRY(struct amdgpu_slab_parent,
+			    slab->partial[class].next, head);
+	e = LIST_ENTRY(struct amdgpu_slab_entry, parent->free.next, head);
+	list_del(&e->head);
+	if (!--parent->num_free) {
+		list_del(&parent->head);
+		list_add(&parent->head, &slab->full);
+	}
+	pthread_mutex_unlock(&slab->mutex);
+
+	*entry = &e->base;
+	return 0;
+}
+
+drm_public int amdgpu_bo_slab_free(struct amdgpu_bo_slab_entry *entry)
+{
+	struct amdgpu_slab_entry *e = (struct amdgpu_slab_entry *)entry;
+	struct amdgpu_slab_parent *parent;
+	struct amdgpu_bo_slab *slab;
+	struct list_head *partial;
+
+	if (!entry)
+		return -EINVAL;
+
+	parent = e->parent;
+	slab = parent->slab;
+	partial = &slab->partial[parent->class];
+
+	pthread_mutex_lock(&slab->mutex);
+	if (!parent->num_free++) {
+		list_del(&parent->head);
+		list_add(&parent->head, partial);
+	}
+	list_add(&e->head, &parent->free);
+
+	/* Keep one parent around per class so churn doesn't hit the kernel. */
+	if (parent->num_free == parent->num_entries &&
+	    partial->next != partial->prev) {
+		list_del(&parent->head);
+		amdgpu_slab_parent_destroy(parent);
+	}
+	pthread_mutex_unlock(&slab->mutex);
+
+	return 0;
+}
@@ -0,0 +1,273 @@
+/*
+ * Copyright 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Streaming upload ring.  One buffer stays mapped for the CPU and the GPU
+ * and is handed out linearly.  head and tail are running byte counts, the
+ * ring offset is their remainder by the size.  Each fence added marks the
+ * bytes up to the current head, and once it signals the tail moves there.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "amdgpu.h"
+#include "amdgpu_drm.h"
+#include "amdgpu_internal.h"
+#include "util_math.h"
+
+#define AMDGPU_UPLOAD_RING_ALIGN	4096
+
+static int amdgpu_upload_ring_init(struct amdgpu_upload_ring *ring)
+{
+	int r;
+
+	r = amdgpu_va_range_alloc(ring->dev, amdgpu_gpu_va_range_general,
+				  ring->size, AMDGPU_UPLOAD_RING_ALIGN, 0,
+				  &ring->va, &ring->va_handle, 0);
+	if (r)
+		return r;
+
+	r = amdgpu_bo_va_op(ring->bo, 0, ring->size, ring->va, 0,
+			    AMDGPU_VA_OP_MAP);
+	if (r) {
+		amdgpu_va_range_free(ring->va_handle);
+		return r;
+	}
+
+	pthread_mutex_init(&ring->mutex, NULL);
+	return 0;
+}
+
+drm_public int amdgpu_upload_ring_create(amdgpu_device_handle dev,
+					 uint64_t size, uint64_t flags,
+					 amdgpu_upload_ring_handle *ring_handle)
+{
+	struct amdgpu_bo_alloc_request req = {};
+	struct amdgpu_upload_ring *ring;
+	int r;
+
+	if (!size)
+		return -EINVAL;
+
+	ring = calloc(1, sizeof(*ring));
+	if (!ring)
+		return -ENOMEM;
+
+	ring->dev = dev;
+	ring->size = ALIGN(size, AMDGPU_UPLOAD_RING_ALIGN);
+
+	req.alloc_size = ring->size;
+	req.phys_alignment = AMDGPU_UPLOAD_RING_ALIGN;
+	req.preferred_heap = AMDGPU_GEM_DOMAIN_GTT;
+	req.flags = flags | AMDGPU_GEM_CREATE_CPU_ACCESS_REQUIRED;
+	r = amdgpu_bo_alloc(dev, &req, &ring->bo);
+	if (r)
+		goto error_bo;
+
+	r = amdgpu_bo_cpu_map(ring->bo, &ring->cpu);
+	if (r)
+		goto error_cpu_map;
+
+	r = amdgpu_upload_ring_init(ring);
+	if (r)
+		goto error_init;
+
+	*ring_handle = ring;
+	return 0;
+
+error_init:
+	amdgpu_bo_cpu_unmap(ring->bo);
+error_cpu_map:
+	amdgpu_bo_free(ring->bo);
+error_bo:
+	free(ring);
+	return r;
+}
+
+drm_public int
+amdgpu_upload_ring_create_from_user_mem(amdgpu_device_handle dev, void *cpu,
+					uint64_t size,
+					amdgpu_upload_ring_handle *ring_handle)
+{
+	struct amdgpu_upload_ring *ring;
+	int r;
+
+	if (!cpu || !size || size % AMDGPU_UPLOAD_RING_ALIGN)
+		return -EINVAL;
+
+	ring = calloc(1, sizeof(*ring));
+	if (!ring)
+		return -ENOMEM;
+
+	ring->dev = dev;
+	ring->size = size;
+	ring->cpu = cpu;
+	ring->user_mem = true;
+
+	r = amdgpu_create_bo_from_user_mem(dev, cpu, size, &ring->bo);
+	if (r)
+		goto error_bo;
+
+	r = amdgpu_upload_ring_init(ring);
+	if (r)
+		goto error_init;
+
+	*ring_handle = ring;
+	return 0;
+
+error_init:
+	amdgpu_bo_free(ring->bo);
+error_bo:
+	free(ring);
+	return r;
+}
+
+drm_public int amdgpu_upload_ring_destroy(amdgpu_upload_ring_handle ring)
+{
+	if (!ring)
+		return -EINVAL;
+
+	amdgpu_bo_va_op(ring->bo, 0, ring->size, ring->va, 0,
+			AMDGPU_VA_OP_UNMAP);
+	amdgpu_va_range_free(ring->va_handle);
+	if (!ring->user_mem)
+		amdgpu_bo_cpu_unmap(ring->bo);
+	amdgpu_bo_free(ring->bo);
+
+	pthread_mutex_destroy(&ring->mutex);
+	free(ring->fences);
+	free(ring);
+	return 0;
+}
+
+/* Moves the tail forward until the ring has room up to end. */
+static int amdgpu_upload_ring_reclaim(struct amdgpu_upload_ring *ring,
+				      uint64_t end, uint64_t timeout_ns)
+{
+	struct amdgpu_upload_ring_fence *f;
+	uint32_t expired;
+	int r;
+
+	while (end - ring->tail > ring->size) {
+		/* The rest of the ring isn't fenced yet. */
+		if (ring->first_fence == ring->num_fences)
+			return -ENOSPC;
+
+		f = &ring->fences[ring->first_fence];
+		r = amdgpu_cs_query_fence_status(&f->fence, timeout_ns, 0,
+						 &expired);
+		if (r)
+			return r;
+		if (!expired)
+			return -EBUSY;
+
+		ring->tail = f->end;
+		ring->first_fence++;
+	}
+
+	if (ring->first_fence == ring->num_fences)
+		ring->first_fence = ring->num_fences = 0;
+	return 0;
+}
+
+drm_public int amdgpu_upload_ring_alloc(amdgpu_upload_ring_handle ring,
+					uint64_t size, uint64_t alignment,
+					uint64_t timeout_ns,
+					struct amdgpu_upload_chunk *chunk)
+{
+	uint64_t start;
+	int r;
+
+	if (!alignment)
+		alignment = 1;
+	if (!size || size > ring->size ||
+	    alignment > AMDGPU_UPLOAD_RING_ALIGN ||
+	    (alignment & (alignment - 1)))
+		return -EINVAL;
+
+	pthread_mutex_lock(&ring->mutex);
+
+	/* Chunks don't wrap around; skip to the start of the ring instead. */
+	start = ALIGN(ring->head, alignment);
+	if (start % ring->size + size > ring->size)
+		start = (ring->head / ring->size + 1) * ring->size;
+
+	r = amdgpu_upload_ring_reclaim(ring, start + size, timeout_ns);
+	if (r) {
+		pthread_mutex_unlock(&ring->mutex);
+		return r;
+	}
+	ring->head = start + size;
+
+	pthread_mutex_unlock(&ring->mutex);
+
+	chunk->bo = ring->bo;
+	chunk->offset = start % ring->size;
+	chunk->va = ring->va + chunk->offset;
+	chunk->cpu = (char *)ring->cpu + chunk->offset;
+	return 0;
+}
+
+drm_public int amdgpu_upload_ring_fence(amdgpu_upload_ring_handle ring,
+					const struct amdgpu_cs_fence *fence)
+{
+	struct amdgpu_upload_ring_fence *fences;
+	uint32_t max;
+
+	pthread_mutex_lock(&ring->mutex);
+
+	/* Nothing allocated since the last fence. */
+	if (ring->head == ring->fenced) {
+		pthread_mutex_unlock(&ring->mutex);
+		return 0;
+	}
+
+	if (ring->num_fences == ring->max_fences) {
+		if (ring->first_fence) {
+			/* Reuse the slots of signaled fences. */
+			ring->num_fences -= ring->first_fence;
+			memmove(ring->fences, &ring->fences[ring->first_fence],
+				ring->num_fences * sizeof(*ring->fences));
+			ring->first_fence = 0;
+		} else {
+			max = MAX2(ring->max_fences * 2, 16);
+			fences = realloc(ring->fences, max * sizeof(*fences));
+			if (!fences) {
+				pthread_mutex_unlock(&ring->mutex);
+				return -ENOMEM;
+			}
+			ring->fences = fences;
+			ring->max_fences = max;
+		}
+	}
+
+	ring->fences[ring->num_fences].fence = *fence;
+	ring->fences[ring->num_fences].end = ring->head;
+	ring->num_fences++;
+	ring->fenced = ring->head;
+
+	pthread_mutex_unlock(&ring->mutex);
+	return 0;
+}
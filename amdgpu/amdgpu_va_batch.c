@@ -0,0 +1,219 @@
+/*
+ * Copyright 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Queue of GPU VA operations.  The kernel takes one operation per
+ * DRM_AMDGPU_GEM_VA ioctl, so the queue saves ioctls by looking at each new
+ * operation together with the one queued before it, and dropping or
+ * combining the pair where the result in the page tables is the same.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include "amdgpu.h"
+#include "amdgpu_drm.h"
+#include "amdgpu_internal.h"
+#include "util_math.h"
+
+drm_public int amdgpu_bo_va_batch_create(amdgpu_device_handle dev,
+					 uint32_t flags,
+					 amdgpu_bo_va_batch_handle *batch)
+{
+	struct amdgpu_bo_va_batch *b;
+
+	if (!dev || !batch || (flags & ~AMDGPU_VA_BATCH_MERGE_MAPS))
+		return -EINVAL;
+
+	b = calloc(1, sizeof(*b));
+	if (!b)
+		return -ENOMEM;
+
+	b->dev = dev;
+	b->flags = flags;
+	*batch = b;
+	return 0;
+}
+
+static void amdgpu_va_batch_pop(struct amdgpu_bo_va_batch *batch)
+{
+	struct amdgpu_va_batch_op *op = &batch->ops[--batch->num_ops];
+
+	if (op->bo)
+		amdgpu_bo_free(op->bo);
+}
+
+static void amdgpu_va_batch_reset(struct amdgpu_bo_va_batch *batch)
+{
+	while (batch->num_ops)
+		amdgpu_va_batch_pop(batch);
+}
+
+drm_public int amdgpu_bo_va_batch_destroy(amdgpu_bo_va_batch_handle batch)
+{
+	if (!batch)
+		return -EINVAL;
+
+	amdgpu_va_batch_reset(batch);
+	free(batch->ops);
+	free(batch);
+	return 0;
+}
+
+static bool amdgpu_va_op_same(const struct amdgpu_va_batch_op *a,
+			      const struct amdgpu_va_batch_op *b)
+{
+	return a->bo == b->bo && a->offset == b->offset &&
+	       a->size == b->size && a->addr == b->addr &&
+	       a->flags == b->flags;
+}
+
+/* Replace and clear remove whatever was mapped in their range first. */
+static bool amdgpu_va_op_is_range(uint32_t ops)
+{
+	return ops == AMDGPU_VA_OP_REPLACE || ops == AMDGPU_VA_OP_CLEAR;
+}
+
+/*
+ * Folds the last queued operation into @op where possible.  Returns true if
+ * it did, so that the new last operation can be tried next.
+ */
+static bool amdgpu_va_batch_fold(struct amdgpu_bo_va_batch *batch,
+				 struct amdgpu_va_batch_op *op)
+{
+	struct amdgpu_va_batch_op *last = &batch->ops[batch->num_ops - 1];
+	uint64_t start, end;
+
+	/* @op undoes everything @last would do to the ranges it covers. */
+	if (amdgpu_va_op_is_range(op->ops) &&
+	    (amdgpu_va_op_is_range(last->ops) || last->ops == AMDGPU_VA_OP_MAP) &&
+	    op->addr <= last->addr &&
+	    op->addr + op->size >= last->addr + last->size) {
+		amdgpu_va_batch_pop(batch);
+		return true;
+	}
+
+	if (op->ops == AMDGPU_VA_OP_CLEAR && last->ops == AMDGPU_VA_OP_CLEAR &&
+	    op->flags == last->flags &&
+	    op->addr <= last->addr + last->size &&
+	    last->addr <= op->addr + op->size) {
+		start = MIN2(op->addr, last->addr);
+		end = MAX2(op->addr + op->size, last->addr + last->size);
+		op->addr = start;
+		op->size = end - start;
+		amdgpu_va_batch_pop(batch);
+		return true;
+	}
+
+	if ((batch->flags & AMDGPU_VA_BATCH_MERGE_MAPS) &&
+	    (op->ops == AMDGPU_VA_OP_MAP || op->ops == AMDGPU_VA_OP_REPLACE) &&
+	    op->ops == last->ops && op->bo == last->bo &&
+	    op->flags == last->flags &&
+	    last->addr + last->size == op->addr &&
+	    last->offset + last->size == op->offset) {
+		op->addr = last->addr;
+		op->offset = last->offset;
+		op->size += last->size;
+		amdgpu_va_batch_pop(batch);
+		return true;
+	}
+
+	return false;
+}
+
+drm_public int amdgpu_bo_va_batch_add(amdgpu_bo_va_batch_handle batch,
+				      amdgpu_bo_handle bo,
+				      uint64_t offset,
+				      uint64_t size,
+				      uint64_t addr,
+				      uint64_t flags,
+				      uint32_t ops)
+{
+	struct amdgpu_va_batch_op op, *last;
+
+	if (!batch)
+		return -EINVAL;
+	if (ops != AMDGPU_VA_OP_MAP && ops != AMDGPU_VA_OP_UNMAP &&
+	    ops != AMDGPU_VA_OP_REPLACE && ops != AMDGPU_VA_OP_CLEAR)
+		return -EINVAL;
+
+	/* The kernel doesn't look at the buffer for clears. */
+	op.bo = ops == AMDGPU_VA_OP_CLEAR ? NULL : bo;
+	op.offset = offset;
+	op.size = size;
+	op.addr = addr;
+	op.flags = flags;
+	op.ops = ops;
+
+	if (batch->num_ops) {
+		last = &batch->ops[batch->num_ops - 1];
+		if (amdgpu_va_op_same(&op, last) &&
+		    ((ops == AMDGPU_VA_OP_MAP && last->ops == AMDGPU_VA_OP_UNMAP) ||
+		     (ops == AMDGPU_VA_OP_UNMAP && last->ops == AMDGPU_VA_OP_MAP))) {
+			amdgpu_va_batch_pop(batch);
+			return 0;
+		}
+	}
+
+	if (batch->num_ops == batch->max_ops) {
+		uint32_t max_ops = MAX2(batch->max_ops * 2, 16);
+		struct amdgpu_va_batch_op *tmp;
+
+		tmp = realloc(batch->ops, max_ops * sizeof(*tmp));
+		if (!tmp)
+			return -ENOMEM;
+		batch->ops = tmp;
+		batch->max_ops = max_ops;
+	}
+
+	/* Take the reference before folding can drop the last one on @bo. */
+	if (op.bo)
+		amdgpu_bo_inc_ref(op.bo);
+
+	while (batch->num_ops && amdgpu_va_batch_fold(batch, &op))
+		;
+
+	batch->ops[batch->num_ops++] = op;
+	return 0;
+}
+
+drm_public int amdgpu_bo_va_batch_flush(amdgpu_bo_va_batch_handle batch)
+{
+	struct amdgpu_va_batch_op *op;
+	uint32_t i;
+	int r = 0;
+
+	if (!batch)
+		return -EINVAL;
+
+	for (i = 0; i < batch->num_ops; i++) {
+		op = &batch->ops[i];
+		r = amdgpu_bo_va_op_raw(batch->dev, op->bo, op->offset, op->size,
+					op->addr, op->flags, op->ops);
+		if (r)
+			break;
+	}
+
+	amdgpu_va_batch_reset(batch);
+	return r;
+}
@@ -41,148 +41,505 @@ drm_public int amdgpu_va_range_query(amdgpu_device_handle dev,
 	return 0;
 }
 
+/*
+ * Holes are kept in an AVL tree ordered by offset, with every node also
+ * recording the largest hole below it.  That keeps the lowest-address
+ * first-fit policy of the old sorted list, but subtrees with no hole large
+ * enough are skipped, so allocation and freeing are O(log n) in the number
+ * of holes however fragmented the address space gets.
+ */
+
+static int amdgpu_va_hole_height(struct amdgpu_bo_va_hole *n)
+{
+	return n ? n->height : 0;
+}
+
+static uint64_t amdgpu_va_hole_max(struct amdgpu_bo_va_hole *n)
+{
+	return n ? n->max_size : 0;
+}
+
+static void amdgpu_va_hole_update(struct amdgpu_bo_va_hole *n)
+{
+	n->height = 1 + MAX2(amdgpu_va_hole_height(n->left),
+			     amdgpu_va_hole_height(n->right));
+	n->max_size = MAX2(n->size, MAX2(amdgpu_va_hole_max(n->left),
+					 amdgpu_va_hole_max(n->right)));
+}
+
+static struct amdgpu_bo_va_hole *
+amdgpu_va_hole_rotate_right(struct amdgpu_bo_va_hole *n)
+{
+	struct amdgpu_bo_va_hole *l = n->left;
+
+	n->left = l->right;
+	l->right = n;
+	amdgpu_va_hole_update(n);
+	amdgpu_va_hole_update(l);
+	return l;
+}
+
+static struct amdgpu_bo_va_hole *
+amdgpu_va_hole_rotate_left(struct amdgpu_bo_va_hole *n)
+{
+	struct amdgpu_bo_va_hole *r = n->right;
+
+	n->right = r->left;
+	r->left = n;
+	amdgpu_va_hole_update(n);
+	amdgpu_va_hole_update(r);
+	return r;
+}
+
+static struct amdgpu_bo_va_hole *
+amdgpu_va_hole_balance(struct amdgpu_bo_va_hole *n)
+{
+	int diff;
+
+	amdgpu_va_hole_update(n);
+	diff = amdgpu_va_hole_height(n->left) - amdgpu_va_hole_height(n->right);
+	if (diff > 1) {
+		if (amdgpu_va_hole_height(n->left->left) <
+		    amdgpu_va_hole_height(n->left->right))
+			n->left = amdgpu_va_hole_rotate_left(n->left);
+		return amdgpu_va_hole_rotate_right(n);
+	}
+	if (diff < -1) {
+		if (amdgpu_va_hole_height(n->right->right) <
+		    amdgpu_va_hole_height(n->right->left))
+			n->right = amdgpu_va_hole_rotate_right(n->right);
+		return amdgpu_va_hole_rotate_left(n);
+	}
+	return n;
+}
+
+static struct amdgpu_bo_va_hole *
+amdgpu_va_hole_insert(struct amdgpu_bo_va_hole *root,
+		      struct amdgpu_bo_va_hole *hole)
+{
+	if (!root) {
+		hole->left = hole->right = NULL;
+		amdgpu_va_hole_update(hole);
+		return hole;
+	}
+	if (hole->offset < root->offset)
+		root->left = amdgpu_va_hole_insert(root->left, hole);
+	else
+		root->right = amdgpu_va_hole_insert(root->right, hole);
+	return amdgpu_va_hole_balance(root);
+}
+
+static struct amdgpu_bo_va_hole *
+amdgpu_va_hole_remove_min(struct amdgpu_bo_va_hole *root,
+			  struct amdgpu_bo_va_hole **min)
+{
+	if (!root->left) {
+		*min = root;
+		return root->right;
+	}
+	root->left = amdgpu_va_hole_remove_min(root->left, min);
+	return amdgpu_va_hole_balance(root);
+}
+
+/* Unlink @hole from the tree; the caller frees it. */
+static struct amdgpu_bo_va_hole *
+amdgpu_va_hole_remove(struct amdgpu_bo_va_hole *root,
+		      struct amdgpu_bo_va_hole *hole)
+{
+	struct amdgpu_bo_va_hole *min;
+
+	if (root == hole) {
+		if (!hole->right)
+			return hole->left;
+		min = NULL;
+		hole->right = amdgpu_va_hole_remove_min(hole->right, &min);
+		min->left = hole->left;
+		min->right = hole->right;
+		return amdgpu_va_hole_balance(min);
+	}
+	if (hole->offset < root->offset)
+		root->left = amdgpu_va_hole_remove(root->left, hole);
+	else
+		root->right = amdgpu_va_hole_remove(root->right, hole);
+	return amdgpu_va_hole_balance(root);
+}
+
+/*
+ * Recompute max_size on the path to @hole after its size changed in place.
+ * Offsets may change too as long as the order of holes is kept.
+ */
+static void amdgpu_va_hole_resized(struct amdgpu_bo_va_hole *root,
+				   struct amdgpu_bo_va_hole *hole)
+{
+	if (root != hole) {
+		if (hole->offset < root->offset)
+			amdgpu_va_hole_resized(root->left, hole);
+		else
+			amdgpu_va_hole_resized(root->right, hole);
+	}
+	amdgpu_va_hole_update(root);
+}
+
+/* Lowest hole that can hold @size bytes at @alignment. */
+static struct amdgpu_bo_va_hole *
+amdgpu_va_hole_first_fit(struct amdgpu_bo_va_hole *n, uint64_t size,
+			 uint64_t alignment, uint64_t *offset)
+{
+	struct amdgpu_bo_va_hole *fit;
+	uint64_t waste;
+
+	if (!n || n->max_size < size)
+		return NULL;
+
+	fit = amdgpu_va_hole_first_fit(n->left, size, alignment, offset);
+	if (fit)
+		return fit;
+
+	waste = n->offset % alignment;
+	waste = waste ? alignment - waste : 0;
+	if (n->size >= size && n->size - size >= waste) {
+		*offset = n->offset + waste;
+		return n;
+	}
+
+	return amdgpu_va_hole_first_fit(n->right, size, alignment, offset);
+}
+
+/* Last hole starting at or below @va, or NULL. */
+static struct amdgpu_bo_va_hole *
+amdgpu_va_hole_floor(struct amdgpu_bo_va_hole *n, uint64_t va)
+{
+	struct amdgpu_bo_va_hole *floor = NULL;
+
+	while (n) {
+		if (n->offset <= va) {
+			floor = n;
+			n = n->right;
+		} else {
+			n = n->left;
+		}
+	}
+	return floor;
+}
+
+/* First hole starting above @va, or NULL. */
+static struct amdgpu_bo_va_hole *
+amdgpu_va_hole_ceil(struct amdgpu_bo_va_hole *n, uint64_t va)
+{
+	struct amdgpu_bo_va_hole *ceil = NULL;
+
+	while (n) {
+		if (n->offset > va) {
+			ceil = n;
+			n = n->left;
+		} else {
+			n = n->right;
+		}
+	}
+	return ceil;
+}
+
+static void amdgpu_va_hole_free_all(struct amdgpu_bo_va_hole *n)
+{
+	if (!n)
+		return;
+	amdgpu_va_hole_free_all(n->left);
+	amdgpu_va_hole_free_all(n->right);
+	free(n);
+}
+
 drm_private void amdgpu_vamgr_init(struct amdgpu_bo_va_mgr *mgr, uint64_t start,
 				   uint64_t max, uint64_t alignment)
 {
 	struct amdgpu_bo_va_hole *n;
+	int i;
 
 	mgr->va_max = max;
 	mgr->va_alignment = alignment;
 
-	list_inithead(&mgr->va_holes);
+	mgr->va_holes = NULL;
 	pthread_mutex_init(&mgr->bo_va_mutex, NULL);
 	pthread_mutex_lock(&mgr->bo_va_mutex);
 	n = calloc(1, sizeof(struct amdgpu_bo_va_hole));
 	n->size = mgr->va_max - start;
 	n->offset = start;
-	list_add(&n->list, &mgr->va_holes);
+	mgr->va_holes = amdgpu_va_hole_insert(mgr->va_holes, n);
 	pthread_mutex_unlock(&mgr->bo_va_mutex);
+
+	/* Without the cache AMDGPU_VA_RANGE_THREAD_CACHE is just ignored */
+	mgr->va_cache = calloc(AMDGPU_VA_CACHE_SHARDS,
+			       sizeof(struct amdgpu_va_magazine));
+	if (mgr->va_cache) {
+		for (i = 0; i < AMDGPU_VA_CACHE_SHARDS; i++)
+			pthread_mutex_init(&mgr->va_cache[i].mutex, NULL);
+	}
 }
 
 drm_private void amdgpu_vamgr_deinit(struct amdgpu_bo_va_mgr *mgr)
 {
-	struct amdgpu_bo_va_hole *hole, *tmp;
-	LIST_FOR_EACH_ENTRY_SAFE(hole, tmp, &mgr->va_holes, list) {
-		list_del(&hole->list);
-		free(hole);
+	int i;
+
+	if (mgr->va_cache) {
+		amdgpu_vamgr_flush_cache(mgr);
+		for (i = 0; i < AMDGPU_VA_CACHE_SHARDS; i++)
+			pthread_mutex_destroy(&mgr->va_cache[i].mutex);
+		free(mgr->va_cache);
+		mgr->va_cache = NULL;
 	}
+	amdgpu_va_hole_free_all(mgr->va_holes);
+	mgr->va_holes = NULL;
 	pthread_mutex_destroy(&mgr->bo_va_mutex);
 }
 
-static drm_private uint64_t
-amdgpu_vamgr_find_va(struct amdgpu_bo_va_mgr *mgr, uint64_t size,
-		     uint64_t alignment, uint64_t base_required)
+static uint64_t
+amdgpu_vamgr_find_va_locked(struct amdgpu_bo_va_mgr *mgr, uint64_t size,
+			    uint64_t alignment, uint64_t base_required)
 {
 	struct amdgpu_bo_va_hole *hole, *n;
-	uint64_t offset = 0, waste = 0;
-
-
-	alignment = MAX2(alignment, mgr->va_alignment);
-	size = ALIGN(size, mgr->va_alignment);
+	uint64_t offset = 0, waste;
 
-	if (base_required % alignment)
+	if (base_required) {
+		hole = amdgpu_va_hole_floor(mgr->va_holes, base_required);
+		if (hole && (hole->offset + hole->size) < (base_required + size))
+			hole = NULL;
+		offset = base_required;
+	} else {
+		hole = amdgpu_va_hole_first_fit(mgr->va_holes, size, alignment,
+						&offset);
+	}
+	if (!hole)
 		return AMDGPU_INVALID_VA_ADDRESS;
 
-	pthread_mutex_lock(&mgr->bo_va_mutex);
-	LIST_FOR_EACH_ENTRY_SAFE_REV(hole, n, &mgr->va_holes, list) {
-		if (base_required) {
-			if (hole->offset > base_required ||
-			    (hole->offset + hole->size) < (base_required + size))
-				continue;
-			waste = base_required - hole->offset;
-			offset = base_required;
-		} else {
-			offset = hole->offset;
-			waste = offset % alignment;
-			waste = waste ? alignment - waste : 0;
-			offset += waste;
-			if (offset >= (hole->offset + hole->size)) {
-				continue;
-			}
+	waste = offset - hole->offset;
+	if (!waste && hole->size == size) {
+		mgr->va_holes = amdgpu_va_hole_remove(mgr->va_holes, hole);
+		free(hole);
+	} else if (!waste) {
+		hole->offset += size;
+		hole->size -= size;
+		amdgpu_va_hole_resized(mgr->va_holes, hole);
+	} else {
+		/* The part above the allocation becomes a new hole. */
+		if (hole->size - waste > size) {
+			n = calloc(1, sizeof(struct amdgpu_bo_va_hole));
+			if (!n)
+				return AMDGPU_INVALID_VA_ADDRESS;
+			n->offset = offset + size;
+			n->size = hole->size - waste - size;
+			mgr->va_holes = amdgpu_va_hole_insert(mgr->va_holes, n);
 		}
-		if (!waste && hole->size == size) {
-			offset = hole->offset;
-			list_del(&hole->list);
-			free(hole);
-			pthread_mutex_unlock(&mgr->bo_va_mutex);
-			return offset;
+		hole->size = waste;
+		amdgpu_va_hole_resized(mgr->va_holes, hole);
+	}
+
+	return offset;
+}
+
+static void
+amdgpu_vamgr_free_va_locked(struct amdgpu_bo_va_mgr *mgr, uint64_t va,
+			    uint64_t size)
+{
+	struct amdgpu_bo_va_hole *lower, *upper, *n;
+
+	lower = amdgpu_va_hole_floor(mgr->va_holes, va);
+	upper = amdgpu_va_hole_ceil(mgr->va_holes, va);
+	if (lower && lower->offset + lower->size != va)
+		lower = NULL;
+	if (upper && upper->offset != va + size)
+		upper = NULL;
+
+	if (lower && upper) {
+		/* Merge both neighbours into the lower hole */
+		lower->size += size + upper->size;
+		mgr->va_holes = amdgpu_va_hole_remove(mgr->va_holes, upper);
+		free(upper);
+		amdgpu_va_hole_resized(mgr->va_holes, lower);
+	} else if (lower) {
+		lower->size += size;
+		amdgpu_va_hole_resized(mgr->va_holes, lower);
+	} else if (upper) {
+		upper->offset = va;
+		upper->size += size;
+		amdgpu_va_hole_resized(mgr->va_holes, upper);
+	} else {
+		/* FIXME on allocation failure we just lose virtual address space
+		 * maybe print a warning
+		 */
+		n = calloc(1, sizeof(struct amdgpu_bo_va_hole));
+		if (n) {
+			n->size = size;
+			n->offset = va;
+			mgr->va_holes = amdgpu_va_hole_insert(mgr->va_holes, n);
 		}
-		if ((hole->size - waste) > size) {
-			if (waste) {
-				n = calloc(1, sizeof(struct amdgpu_bo_va_hole));
-				n->size = waste;
-				n->offset = hole->offset;
-				list_add(&n->list, &hole->list);
-			}
-			hole->size -= (size + waste);
-			hole->offset += size + waste;
-			pthread_mutex_unlock(&mgr->bo_va_mutex);
-			return offset;
+	}
+}
+
+/*
+ * Ranges cached for AMDGPU_VA_RANGE_THREAD_CACHE live in a small number of
+ * magazines.  Each thread is given its own slot on first use, so threads
+ * only share a magazine when there are more of them than shards.  Empty
+ * magazines are refilled with AMDGPU_VA_CACHE_BATCH ranges carved from one
+ * allocation and full ones return half their ranges, each under a single
+ * bo_va_mutex acquisition.
+ */
+static pthread_once_t amdgpu_va_cache_once = PTHREAD_ONCE_INIT;
+static pthread_key_t amdgpu_va_cache_key;
+static bool amdgpu_va_cache_key_valid;
+static atomic_t amdgpu_va_cache_slots;
+
+static void amdgpu_va_cache_key_create(void)
+{
+	amdgpu_va_cache_key_valid =
+		!pthread_key_create(&amdgpu_va_cache_key, NULL);
+}
+
+static struct amdgpu_va_magazine *
+amdgpu_vamgr_magazine(struct amdgpu_bo_va_mgr *mgr)
+{
+	uintptr_t slot = 0;
+
+	pthread_once(&amdgpu_va_cache_once, amdgpu_va_cache_key_create);
+	if (amdgpu_va_cache_key_valid) {
+		slot = (uintptr_t)pthread_getspecific(amdgpu_va_cache_key);
+		if (!slot) {
+			slot = (unsigned)atomic_inc_return(&amdgpu_va_cache_slots);
+			pthread_setspecific(amdgpu_va_cache_key, (void *)slot);
 		}
-		if ((hole->size - waste) == size) {
-			hole->size = waste;
-			pthread_mutex_unlock(&mgr->bo_va_mutex);
-			return offset;
+	}
+	return &mgr->va_cache[slot % AMDGPU_VA_CACHE_SHARDS];
+}
+
+static int amdgpu_vamgr_cache_class(struct amdgpu_bo_va_mgr *mgr,
+				    uint64_t size)
+{
+	if (!mgr->va_cache || !size || size % mgr->va_alignment ||
+	    size / mgr->va_alignment > AMDGPU_VA_CACHE_CLASSES)
+		return -1;
+	return size / mgr->va_alignment - 1;
+}
+
+static uint64_t
+amdgpu_vamgr_cache_get(struct amdgpu_bo_va_mgr *mgr, uint64_t size)
+{
+	struct amdgpu_va_magazine *mag;
+	int c = amdgpu_vamgr_cache_class(mgr, size);
+	uint64_t va;
+	int i;
+
+	if (c < 0)
+		return AMDGPU_INVALID_VA_ADDRESS;
+
+	mag = amdgpu_vamgr_magazine(mgr);
+	pthread_mutex_lock(&mag->mutex);
+	if (mag->count[c]) {
+		va = mag->va[c][--mag->count[c]];
+	} else {
+		pthread_mutex_lock(&mgr->bo_va_mutex);
+		va = amdgpu_vamgr_find_va_locked(mgr,
+						 size * AMDGPU_VA_CACHE_BATCH,
+						 mgr->va_alignment, 0);
+		pthread_mutex_unlock(&mgr->bo_va_mutex);
+
+		/* Hand out the lowest range, keep the others */
+		if (va != AMDGPU_INVALID_VA_ADDRESS) {
+			for (i = AMDGPU_VA_CACHE_BATCH - 1; i > 0; i--)
+				mag->va[c][mag->count[c]++] = va + i * size;
 		}
 	}
+	pthread_mutex_unlock(&mag->mutex);
+	return va;
+}
 
-	pthread_mutex_unlock(&mgr->bo_va_mutex);
-	return AMDGPU_INVALID_VA_ADDRESS;
+static int
+amdgpu_vamgr_cache_put(struct amdgpu_bo_va_mgr *mgr, uint64_t va,
+		       uint64_t size)
+{
+	struct amdgpu_va_magazine *mag;
+	int c = amdgpu_vamgr_cache_class(mgr, size);
+	int i, half = AMDGPU_VA_CACHE_DEPTH / 2;
+
+	if (c < 0)
+		return -EINVAL;
+
+	mag = amdgpu_vamgr_magazine(mgr);
+	pthread_mutex_lock(&mag->mutex);
+	if (mag->count[c] == AMDGPU_VA_CACHE_DEPTH) {
+		/* Return the coldest half */
+		pthread_mutex_lock(&mgr->bo_va_mutex);
+		for (i = 0; i < half; i++)
+			amdgpu_vamgr_free_va_locked(mgr, mag->va[c][i], size);
+		pthread_mutex_unlock(&mgr->bo_va_mutex);
+
+		memmove(mag->va[c], mag->va[c] + half,
+			(mag->count[c] - half) * sizeof(uint64_t));
+		mag->count[c] -= half;
+	}
+	mag->va[c][mag->count[c]++] = va;
+	pthread_mutex_unlock(&mag->mutex);
+	return 0;
 }
 
-static drm_private void
-amdgpu_vamgr_free_va(struct amdgpu_bo_va_mgr *mgr, uint64_t va, uint64_t size)
+drm_private void amdgpu_vamgr_flush_cache(struct amdgpu_bo_va_mgr *mgr)
 {
-	struct amdgpu_bo_va_hole *hole, *next;
+	struct amdgpu_va_magazine *mag;
+	uint64_t size;
+	int i, c;
 
-	if (va == AMDGPU_INVALID_VA_ADDRESS)
+	if (!mgr->va_cache)
 		return;
 
+	for (i = 0; i < AMDGPU_VA_CACHE_SHARDS; i++) {
+		mag = &mgr->va_cache[i];
+		pthread_mutex_lock(&mag->mutex);
+		pthread_mutex_lock(&mgr->bo_va_mutex);
+		for (c = 0; c < AMDGPU_VA_CACHE_CLASSES; c++) {
+			size = (uint64_t)(c + 1) * mgr->va_alignment;
+			while (mag->count[c])
+				amdgpu_vamgr_free_va_locked(mgr,
+					mag->va[c][--mag->count[c]], size);
+		}
+		pthread_mutex_unlock(&mgr->bo_va_mutex);
+		pthread_mutex_unlock(&mag->mutex);
+	}
+}
+
+static drm_private uint64_t
+amdgpu_vamgr_find_va(struct amdgpu_bo_va_mgr *mgr, uint64_t size,
+		     uint64_t alignment, uint64_t base_required)
+{
+	uint64_t va;
+
+	alignment = MAX2(alignment, mgr->va_alignment);
 	size = ALIGN(size, mgr->va_alignment);
 
+	if (base_required % alignment)
+		return AMDGPU_INVALID_VA_ADDRESS;
+
 	pthread_mutex_lock(&mgr->bo_va_mutex);
-	hole = container_of(&mgr->va_holes, hole, list);
-	LIST_FOR_EACH_ENTRY(next, &mgr->va_holes, list) {
-		if (next->offset < va)
-			break;
-		hole = next;
-	}
+	va = amdgpu_vamgr_find_va_locked(mgr, size, alignment, base_required);
+	pthread_mutex_unlock(&mgr->bo_va_mutex);
 
-	if (&hole->list != &mgr->va_holes) {
-		/* Grow upper hole if it's adjacent */
-		if (hole->offset == (va + size)) {
-			hole->offset = va;
-			hole->size += size;
-			/* Merge lower hole if it's adjacent */
-			if (next != hole &&
-			    &next->list != &mgr->va_holes &&
-			    (next->offset + next->size) == va) {
-				next->size += hole->size;
-				list_del(&hole->list);
-				free(hole);
-			}
-			goto out;
-		}
+	/* Ranges sitting in the thread caches may be what is missing */
+	if (va == AMDGPU_INVALID_VA_ADDRESS && mgr->va_cache) {
+		amdgpu_vamgr_flush_cache(mgr);
+		pthread_mutex_lock(&mgr->bo_va_mutex);
+		va = amdgpu_vamgr_find_va_locked(mgr, size, alignment,
+						 base_required);
+		pthread_mutex_unlock(&mgr->bo_va_mutex);
 	}
+	return va;
+}
 
-	/* Grow lower hole if it's adjacent */
-	if (next != hole && &next->list != &mgr->va_holes &&
-	    (next->offset + next->size) == va) {
-		next->size += size;
-		goto out;
-	}
+static drm_private void
+amdgpu_vamgr_free_va(struct amdgpu_bo_va_mgr *mgr, uint64_t va, uint64_t size)
+{
+	if (va == AMDGPU_INVALID_VA_ADDRESS)
+		return;
 
-	/* FIXME on allocation failure we just lose virtual address space
-	 * maybe print a warning
-	 */
-	next = calloc(1, sizeof(struct amdgpu_bo_va_hole));
-	if (next) {
-		next->size = size;
-		next->offset = va;
-		list_add(&next->list, &hole->list);
-	}
+	size = ALIGN(size, mgr->va_alignment);
 
-out:
+	pthread_mutex_lock(&mgr->bo_va_mutex);
+	amdgpu_vamgr_free_va_locked(mgr, va, size);
 	pthread_mutex_unlock(&mgr->bo_va_mutex);
 }
 
@@ -216,8 +573,18 @@ drm_public int amdgpu_va_range_alloc(amdgpu_device_handle dev,
 	va_base_alignment = MAX2(va_base_alignment, vamgr->va_alignment);
 	size = ALIGN(size, vamgr->va_alignment);
 
-	*va_base_allocated = amdgpu_vamgr_find_va(vamgr, size,
+	/* Only plain requests can be served from the thread cache */
+	if (va_base_alignment != vamgr->va_alignment || va_base_required)
+		flags &= ~AMDGPU_VA_RANGE_THREAD_CACHE;
+
+	*va_base_allocated = AMDGPU_INVALID_VA_ADDRESS;
+	if (flags & AMDGPU_VA_RANGE_THREAD_CACHE)
+		*va_base_allocated = amdgpu_vamgr_cache_get(vamgr, size);
+	if (*va_base_allocated == AMDGPU_INVALID_VA_ADDRESS) {
+		flags &= ~AMDGPU_VA_RANGE_THREAD_CACHE;
+		*va_base_allocated = amdgpu_vamgr_find_va(vamgr, size,
 					va_base_alignment, va_base_required);
+	}
 
 	if (!(flags & AMDGPU_VA_RANGE_32_BIT) &&
 	    (*va_base_allocated == AMDGPU_INVALID_VA_ADDRESS)) {
@@ -242,6 +609,7 @@ drm_public int amdgpu_va_range_alloc(amdgpu_device_handle dev,
 		va->size = size;
 		va->range = va_range_type;
 		va->vamgr = vamgr;
+		va->cached = !!(flags & AMDGPU_VA_RANGE_THREAD_CACHE);
 		*va_range_handle = va;
 	} else {
 		return -EINVAL;
@@ -255,9 +623,13 @@ drm_public int amdgpu_va_range_free(amdgpu_va_handle va_range_handle)
 	if(!va_range_handle || !va_range_handle->address)
 		return 0;
 
-	amdgpu_vamgr_free_va(va_range_handle->vamgr,
-			va_range_handle->address,
-			va_range_handle->size);
+	if (!va_range_handle->cached ||
+	    amdgpu_vamgr_cache_put(va_range_handle->vamgr,
+				   va_range_handle->address,
+				   va_range_handle->size))
+		amdgpu_vamgr_free_va(va_range_handle->vamgr,
+				va_range_handle->address,
+				va_range_handle->size);
 	free(va_range_handle);
 	return 0;
 }
@@ -0,0 +1,58 @@
+#!/usr/bin/env python3
+
+import argparse
+
+
+def parse_ids(path):
+    '''
+    Parse amdgpu.ids into its version and (device_id, revision_id, name)
+    tuples, in file order
+    '''
+    version = None
+    ids = []
+    with open(path, encoding='utf-8') as f:
+        for line_num, line in enumerate(f, 1):
+            line = line.rstrip('\n')
+            if not line or line.startswith('#'):
+                continue
+            if version is None:
+                version = line
+                continue
+            fields = line.split(',')
+            if len(fields) < 3 or not fields[2].lstrip(' \t'):
+                raise SystemExit('{}:{}: invalid format: {}'.format(
+                    path, line_num, line))
+            ids.append((int(fields[0], 16), int(fields[1], 16),
+                        fields[2].lstrip(' \t')))
+    return version, ids
+
+
+def c_string(s):
+    return '"' + s.replace('\\', '\\\\').replace('"', '\\"') + '"'
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('ids', help='path to amdgpu.ids')
+    parser.add_argument('output', help='header to generate')
+    args = parser.parse_args()
+
+    version, ids = parse_ids(args.ids)
+
+    # The text parser stops at the first match, so keep the first duplicate
+    table = {}
+    for did, rid, name in ids:
+        table.setdefault((did, rid), name)
+
+    with open(args.output, 'w', encoding='utf-8') as out:
+        out.write('/* Generated by gen_asic_id_table.py from amdgpu.ids {}, '
+                  'do not edit. */\n\n'.format(version))
+        out.write('static const struct amdgpu_asic_id amdgpu_asic_ids[] = {\n')
+        for (did, rid), name in sorted(table.items()):
+            out.write('\t{{ 0x{:04x}, 0x{:02x}, {} }},\n'.format(
+                did, rid, c_string(name)))
+        out.write('};\n')
+
+
+if __name__ == '__main__':
+    main()
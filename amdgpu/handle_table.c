@@ -24,32 +24,57 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <sched.h>
 #include <unistd.h>
 #include "handle_table.h"
 #include "util_math.h"
 
+/*
+ * Lockless lookups use a two-slot reader count, as in SRCU: readers bump the
+ * slot selected by the current epoch, and a writer that is about to free
+ * something it unpublished flips the epoch and waits for the old slot to
+ * drain.  Readers that arrive after the flip can no longer find the freed
+ * object.  The values array is published before max_key grows, so a reader
+ * that sees the new size also sees the new array, and replaced arrays are
+ * only freed after a grace period.
+ */
+
 drm_private int handle_table_insert(struct handle_table *table, uint32_t key,
 				    void *value)
 {
 	if (key >= table->max_key) {
 		uint32_t alignment = sysconf(_SC_PAGESIZE) / sizeof(void*);
 		uint32_t max_key = ALIGN(key + 1, alignment);
-		void **values;
+		void **values, **old = table->values;
 
-		values = realloc(table->values, max_key * sizeof(void *));
+		values = calloc(max_key, sizeof(void *));
 		if (!values)
 			return -ENOMEM;
 
-		memset(values + table->max_key, 0, (max_key - table->max_key) *
-		       sizeof(void *));
+		if (old)
+			memcpy(values, old, table->max_key * sizeof(void *));
 
-		table->max_key = max_key;
 		table->values = values;
+#if HAVE_LIBDRM_ATOMIC_PRIMITIVES
+		__sync_synchronize();
+#endif
+		table->max_key = max_key;
+
+		handle_table_synchronize(table);
+		free(old);
 	}
+#if HAVE_LIBDRM_ATOMIC_PRIMITIVES
+	/* Make the object's contents visible before the object itself. */
+	__sync_synchronize();
+#endif
 	table->values[key] = value;
 	return 0;
 }
 
+/*
+ * Lockless readers may still be looking at the value afterwards; call
+ * handle_table_synchronize() before freeing it.
+ */
 drm_private void handle_table_remove(struct handle_table *table, uint32_t key)
 {
 	if (key < table->max_key)
@@ -64,6 +89,63 @@ drm_private void *handle_table_lookup(struct handle_table *table, uint32_t key)
 		return NULL;
 }
 
+#if HAVE_LIBDRM_ATOMIC_PRIMITIVES
+/* Enter a lockless read section; the index goes to handle_table_read_end(). */
+drm_private int handle_table_read_begin(struct handle_table *table)
+{
+	int idx;
+
+	for (;;) {
+		idx = *(volatile unsigned *)&table->epoch & 1;
+		__sync_fetch_and_add(&table->readers[idx], 1);
+
+		/* If the epoch moved on before the increment became visible,
+		 * a writer may already have stopped waiting on this slot. */
+		if ((*(volatile unsigned *)&table->epoch & 1) == (unsigned)idx)
+			return idx;
+		__sync_fetch_and_sub(&table->readers[idx], 1);
+	}
+}
+
+drm_private void handle_table_read_end(struct handle_table *table, int idx)
+{
+	__sync_fetch_and_sub(&table->readers[idx], 1);
+}
+
+/*
+ * Lookup inside a read section.  The value stays valid until
+ * handle_table_read_end(), but may already be on its way out: callers must
+ * take a reference that fails on a zero refcount.
+ */
+drm_private void *handle_table_lookup_lockless(struct handle_table *table,
+					       uint32_t key)
+{
+	uint32_t max_key = *(volatile uint32_t *)&table->max_key;
+	void **values;
+
+	__sync_synchronize();
+	values = *(void ** volatile *)&table->values;
+	if (key < max_key)
+		return *(void * volatile *)&values[key];
+	return NULL;
+}
+#endif
+
+/*
+ * Wait until no lockless reader can still see anything that was removed or
+ * replaced before the call.  Writers only.
+ */
+drm_private void handle_table_synchronize(struct handle_table *table)
+{
+#if HAVE_LIBDRM_ATOMIC_PRIMITIVES
+	int idx = table->epoch & 1;
+
+	__sync_fetch_and_add(&table->epoch, 1);
+	while (*(volatile int *)&table->readers[idx])
+		sched_yield();
+#endif
+}
+
 drm_private void handle_table_fini(struct handle_table *table)
 {
 	free(table->values);
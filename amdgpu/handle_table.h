@@ -27,9 +27,16 @@
 #include <stdint.h>
 #include "libdrm_macros.h"
 
+/*
+ * Insertions and removals must be serialized by the caller.  Where atomic
+ * primitives are available, lookups can also run concurrently with them
+ * inside a handle_table_read_begin()/end() section, see handle_table.c.
+ */
 struct handle_table {
 	uint32_t	max_key;
 	void		**values;
+	unsigned	epoch;
+	int		readers[2];
 };
 
 drm_private int handle_table_insert(struct handle_table *table, uint32_t key,
@@ -38,4 +45,12 @@ drm_private void handle_table_remove(struct handle_table *table, uint32_t key);
 drm_private void *handle_table_lookup(struct handle_table *table, uint32_t key);
 drm_private void handle_table_fini(struct handle_table *table);
 
+#if HAVE_LIBDRM_ATOMIC_PRIMITIVES
+drm_private int handle_table_read_begin(struct handle_table *table);
+drm_private void handle_table_read_end(struct handle_table *table, int idx);
+drm_private void *handle_table_lookup_lockless(struct handle_table *table,
+					       uint32_t key);
+#endif
+drm_private void handle_table_synchronize(struct handle_table *table);
+
 #endif /* _HANDLE_TABLE_H_ */
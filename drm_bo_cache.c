@@ -0,0 +1,327 @@
+/*
+ * Copyright © 2007 Intel Corporation
+ * Copyright (C) 2016 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <assert.h>
+
+#include "drm_bo_cache.h"
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+/* number of busy bo's to skip before giving up on a bucket, by default: */
+#define DEFAULT_BUSY_SKIP 4
+
+static void
+add_bucket(struct drm_bo_cache *cache, uint64_t size)
+{
+	unsigned int i = cache->num_buckets;
+
+	assert(i < ARRAY_SIZE(cache->cache_bucket));
+
+	list_inithead(&cache->cache_bucket[i].list);
+	cache->cache_bucket[i].size = size;
+	cache->num_buckets++;
+}
+
+/**
+ * @coarse: if true, only power-of-two bucket sizes, otherwise
+ *    fill in for a bit smoother size curve..
+ */
+drm_private void
+drm_bo_cache_init(struct drm_bo_cache *cache, int coarse,
+		const struct drm_bo_cache_funcs *funcs)
+{
+	uint64_t size, cache_max_size = 64 * 1024 * 1024;
+
+	/* OK, so power of two buckets was too wasteful of memory.
+	 * Give 3 other sizes between each power of two, to hopefully
+	 * cover things accurately enough.  (The alternative is
+	 * probably to just go for exact matching of sizes, and assume
+	 * that for things like composited window resize the tiled
+	 * width/height alignment and rounding of sizes to pages will
+	 * get us useful cache hit rates anyway)
+	 */
+	cache->coarse = coarse;
+	cache->busy_skip = DEFAULT_BUSY_SKIP;
+	cache->funcs = funcs;
+	add_bucket(cache, 4096);
+	add_bucket(cache, 4096 * 2);
+	if (!coarse)
+		add_bucket(cache, 4096 * 3);
+
+	/* Initialize the linked lists for BO reuse cache. */
+	for (size = 4 * 4096; size <= cache_max_size; size *= 2) {
+		add_bucket(cache, size);
+		if (!coarse) {
+			add_bucket(cache, size + size * 1 / 4);
+			add_bucket(cache, size + size * 2 / 4);
+			add_bucket(cache, size + size * 3 / 4);
+		}
+	}
+}
+
+/* Returns the bucket for size, or NULL if too big to be cached. */
+drm_private struct drm_bo_cache_bucket *
+drm_bo_cache_bucket(struct drm_bo_cache *cache, uint64_t size)
+{
+	struct drm_bo_cache_bucket *bucket;
+	unsigned order, i;
+
+	/* Calculate the index from the bucket sizes set up by
+	 * drm_bo_cache_init(), rather than looping.
+	 */
+	if (size <= 4096) {
+		i = 0;
+	} else if (size > cache->cache_bucket[cache->num_buckets - 1].size) {
+		return NULL;
+	} else {
+		/* size is in (2^order, 2^(order + 1)] */
+		order = 63 - __builtin_clzll(size - 1);
+		if (cache->coarse)
+			i = order - 11;
+		else if (size <= 4 * 4096)
+			i = (size - 1) / 4096;
+		else
+			i = 4 * (order - 14) + 4 +
+			    ((size - 1 - (1ull << order)) >> (order - 2));
+	}
+
+	bucket = &cache->cache_bucket[i];
+	assert(bucket->size >= size);
+	return bucket;
+}
+
+/* Takes a bo out of its bucket. */
+drm_private void
+drm_bo_cache_remove(struct drm_bo_cache *cache,
+		struct drm_bo_cache_entry *entry)
+{
+	list_delinit(&entry->list);
+	cache->size -= entry->size;
+	cache->count--;
+}
+
+/* Frees older cached buffers, and marks the ones that have been in the
+ * cache since before the current second DONTNEED, if the library can
+ * madvise.  Buffers reused sooner than that never see a madvise.  A time
+ * of 0 frees everything.
+ */
+drm_private void
+drm_bo_cache_cleanup(struct drm_bo_cache *cache, time_t time)
+{
+	unsigned i;
+
+	if (time && cache->time == time)
+		return;
+
+	for (i = 0; i < cache->num_buckets; i++) {
+		struct drm_bo_cache_bucket *bucket = &cache->cache_bucket[i];
+		struct drm_bo_cache_entry *entry, *tmp;
+
+		while (!LIST_IS_EMPTY(&bucket->list)) {
+			entry = LIST_ENTRY(struct drm_bo_cache_entry,
+					bucket->list.next, list);
+
+			/* keep things in cache for at least 1 second: */
+			if (time && ((time - entry->free_time) <= 1))
+				break;
+
+			drm_bo_cache_remove(cache, entry);
+			cache->funcs->destroy(entry);
+		}
+
+		if (!time || !cache->funcs->madvise)
+			continue;
+
+		/* the list is in free order, so everything older than a bo
+		 * which is already marked is marked too:
+		 */
+		LIST_FOR_EACH_ENTRY_SAFE_REV(entry, tmp, &bucket->list, list) {
+			if (entry->free_time == time)
+				continue;
+			if (entry->dontneed)
+				break;
+			cache->funcs->madvise(entry, 0);
+			entry->dontneed = 1;
+		}
+	}
+
+	cache->time = time;
+}
+
+/* Frees the oldest cached buffers, whatever their bucket, until no more
+ * than bytes are left in the cache.
+ */
+drm_private void
+drm_bo_cache_trim(struct drm_bo_cache *cache, uint64_t bytes)
+{
+	while (cache->size > bytes) {
+		struct drm_bo_cache_entry *entry, *oldest = NULL;
+		unsigned i;
+
+		/* the head of each bucket is its oldest bo: */
+		for (i = 0; i < cache->num_buckets; i++) {
+			struct drm_bo_cache_bucket *bucket = &cache->cache_bucket[i];
+
+			if (LIST_IS_EMPTY(&bucket->list))
+				continue;
+
+			entry = LIST_ENTRY(struct drm_bo_cache_entry,
+					bucket->list.next, list);
+			if (!oldest || entry->free_time < oldest->free_time)
+				oldest = entry;
+		}
+
+		if (!oldest)
+			break;
+
+		drm_bo_cache_remove(cache, oldest);
+		cache->funcs->destroy(oldest);
+	}
+}
+
+/* Drops the oldest DONTNEED bo's of the bucket whose pages the kernel
+ * already took back: when one of them was purged, older ones likely were
+ * too.
+ */
+static void
+purge_bucket(struct drm_bo_cache *cache, struct drm_bo_cache_bucket *bucket)
+{
+	while (!LIST_IS_EMPTY(&bucket->list)) {
+		struct drm_bo_cache_entry *entry;
+
+		entry = LIST_ENTRY(struct drm_bo_cache_entry,
+				bucket->list.next, list);
+		if (!entry->dontneed || cache->funcs->madvise(entry, 0) > 0)
+			break;
+
+		drm_bo_cache_remove(cache, entry);
+		cache->funcs->destroy(entry);
+	}
+}
+
+/* without a tolerance all bo's in a bucket have the bucket size: */
+static int
+fits(struct drm_bo_cache_entry *entry, uint64_t size, uint64_t slack,
+		uint32_t flags)
+{
+	return entry->flags == flags && entry->size >= size &&
+	       entry->size - size <= slack;
+}
+
+static struct drm_bo_cache_entry *
+find_in_bucket(struct drm_bo_cache *cache, struct drm_bo_cache_bucket *bucket,
+		uint64_t size, uint64_t slack, uint32_t flags, int mru)
+{
+	struct drm_bo_cache_entry *entry, *tmp;
+	unsigned busy = 0;
+
+	/* Render targets come from the tail (MRU, likely in GPU cache) and
+	 * skip the busy check: rendering to one waits for the GPU anyway,
+	 * the CPU doesn't have to stall.
+	 */
+	if (mru) {
+		LIST_FOR_EACH_ENTRY_SAFE_REV(entry, tmp, &bucket->list, list) {
+			if (fits(entry, size, slack, flags))
+				return entry;
+		}
+		return NULL;
+	}
+
+	/* Otherwise the oldest idle one, younger ones are busy as likely: */
+	LIST_FOR_EACH_ENTRY_SAFE(entry, tmp, &bucket->list, list) {
+		if (!fits(entry, size, slack, flags))
+			continue;
+		if (!cache->funcs->busy(entry))
+			return entry;
+		if (++busy == cache->busy_skip)
+			break;
+	}
+
+	return NULL;
+}
+
+/* Takes a cached bo for a request of *size bytes with the given flags out
+ * of the cache, or returns NULL.
+ *
+ * NOTE: *size is rounded up to the bucket size, unless the cache has a
+ * tolerance for reusing bigger bo's.  It is left alone when there is no
+ * bucket for it.
+ */
+drm_private struct drm_bo_cache_entry *
+drm_bo_cache_get(struct drm_bo_cache *cache, uint64_t *size, uint32_t flags,
+		int mru)
+{
+	struct drm_bo_cache_bucket *bucket;
+	struct drm_bo_cache_entry *entry;
+
+	bucket = drm_bo_cache_bucket(cache, *size);
+	if (!bucket)
+		return NULL;
+
+	if (!cache->tolerance)
+		*size = bucket->size;
+
+	/* see if we can be green and recycle: */
+	while ((entry = find_in_bucket(cache, bucket, *size,
+				*size / 100 * cache->tolerance, flags, mru))) {
+		drm_bo_cache_remove(cache, entry);
+
+		if (!entry->dontneed || cache->funcs->madvise(entry, 1) > 0) {
+			entry->dontneed = 0;
+			return entry;
+		}
+
+		/* we've lost the backing pages, delete and try again: */
+		cache->funcs->destroy(entry);
+		purge_bucket(cache, bucket);
+	}
+
+	return NULL;
+}
+
+/* Puts a bo of size bytes into the cache, at the given time in seconds.
+ * Returns -1 if there is no bucket for it, and the caller has to free it.
+ */
+drm_private int
+drm_bo_cache_put(struct drm_bo_cache *cache, struct drm_bo_cache_entry *entry,
+		uint64_t size, time_t time)
+{
+	struct drm_bo_cache_bucket *bucket = drm_bo_cache_bucket(cache, size);
+
+	if (!bucket)
+		return -1;
+
+	entry->size = size;
+	entry->free_time = time;
+	list_addtail(&entry->list, &bucket->list);
+	cache->size += size;
+	cache->count++;
+	drm_bo_cache_cleanup(cache, time);
+
+	/* this may free the bo itself if it alone is over budget: */
+	if (cache->budget && cache->size > cache->budget)
+		drm_bo_cache_trim(cache, cache->budget);
+
+	return 0;
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright © 2007 Intel Corporation
+ * Copyright (C) 2016 Rob Clark <robclark@freedesktop.org>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Bucketed cache of freed buffer objects, shared by the driver libraries.
+ *
+ * Each library embeds a struct drm_bo_cache_entry in its bo struct and
+ * hands the cache a few hooks to check whether a bo is busy, to madvise
+ * it and to destroy it.  The cache has no lock of its own: every call,
+ * and so every hook, runs under the lock the library protects its bo
+ * tables with.  drm_bo_cache.c is built into each library using it, the
+ * functions are not exported.
+ */
+
+#ifndef DRM_BO_CACHE_H_
+#define DRM_BO_CACHE_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include "libdrm_macros.h"
+#include "util_double_list.h"
+
+struct drm_bo_cache_entry {
+	struct list_head list;   /* bucket-list entry */
+	uint64_t size;           /* size of the bo, set when cached */
+	uint32_t flags;          /* set by the library, reused for equal flags */
+	time_t free_time;        /* time when added to bucket-list */
+	int dontneed;            /* madvise'd DONTNEED while cached */
+};
+
+struct drm_bo_cache_funcs {
+	/* whether the GPU may still be using the bo: */
+	int (*busy)(struct drm_bo_cache_entry *entry);
+	/* optional, tells the kernel whether the backing pages are needed,
+	 * returns > 0 if they are still there:
+	 */
+	int (*madvise)(struct drm_bo_cache_entry *entry, int willneed);
+	/* frees a bo the cache no longer holds: */
+	void (*destroy)(struct drm_bo_cache_entry *entry);
+};
+
+struct drm_bo_cache_bucket {
+	uint64_t size;
+	struct list_head list;
+};
+
+struct drm_bo_cache {
+	struct drm_bo_cache_bucket cache_bucket[14 * 4];
+	unsigned num_buckets;
+	int coarse;           /* power of two bucket sizes only */
+	unsigned tolerance;   /* % a reused bo may exceed the request, or 0 */
+	unsigned busy_skip;   /* busy bo's to skip before giving up on a bucket */
+	uint64_t size;        /* total size of the bo's in the buckets */
+	unsigned count;       /* number of bo's in the buckets */
+	uint64_t budget;      /* trim to this size on put, or 0 */
+	time_t time;
+	const struct drm_bo_cache_funcs *funcs;
+};
+
+static inline void
+drm_bo_cache_entry_init(struct drm_bo_cache_entry *entry)
+{
+	list_inithead(&entry->list);
+}
+
+static inline int
+drm_bo_cache_entry_is_cached(struct drm_bo_cache_entry *entry)
+{
+	return !LIST_IS_EMPTY(&entry->list);
+}
+
+drm_private void drm_bo_cache_init(struct drm_bo_cache *cache, int coarse,
+		const struct drm_bo_cache_funcs *funcs);
+drm_private struct drm_bo_cache_bucket *
+drm_bo_cache_bucket(struct drm_bo_cache *cache, uint64_t size);
+drm_private struct drm_bo_cache_entry *
+drm_bo_cache_get(struct drm_bo_cache *cache, uint64_t *size, uint32_t flags,
+		int mru);
+drm_private int drm_bo_cache_put(struct drm_bo_cache *cache,
+		struct drm_bo_cache_entry *entry, uint64_t size, time_t time);
+drm_private void drm_bo_cache_remove(struct drm_bo_cache *cache,
+		struct drm_bo_cache_entry *entry);
+drm_private void drm_bo_cache_cleanup(struct drm_bo_cache *cache, time_t time);
+drm_private void drm_bo_cache_trim(struct drm_bo_cache *cache, uint64_t bytes);
+
+#endif /* DRM_BO_CACHE_H_ */
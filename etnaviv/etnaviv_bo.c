@@ -27,7 +27,6 @@
 #include "etnaviv_priv.h"
 #include "etnaviv_drmif.h"
 
-drm_private pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
 drm_private void bo_del(struct etna_bo *bo);
 
 /* set buffer name, and add to table, call w/ table_lock held: */
@@ -35,25 +34,39 @@ static void set_name(struct etna_bo *bo, uint32_t name)
 {
 	bo->name = name;
 	/* add ourself into the name table: */
-	drmHashInsert(bo->dev->name_table, name, bo);
+	drmIntMapInsert(bo->dev->name_table, name, bo);
 }
 
 /* Called under table_lock */
 drm_private void bo_del(struct etna_bo *bo)
 {
-	if (bo->map)
+	if (bo->map) {
 		drm_munmap(bo->map, bo->size);
+		bo->dev->map_size -= bo->size;
+		bo->dev->map_count--;
+	}
 
 	if (bo->name)
-		drmHashDelete(bo->dev->name_table, bo->name);
+		drmIntMapDelete(bo->dev->name_table, bo->name);
 
 	if (bo->handle) {
 		struct drm_gem_close req = {
 			.handle = bo->handle,
 		};
 
-		drmHashDelete(bo->dev->handle_table, bo->handle);
+		drmIntMapDelete(bo->dev->handle_table, bo->handle);
+		drmPrimeCacheForget(bo->dev->fd, bo->handle);
 		drmIoctl(bo->dev->fd, DRM_IOCTL_GEM_CLOSE, &req);
+		__atomic_store_n(&bo->dev->close_seq, bo->dev->close_seq + 1,
+				__ATOMIC_RELEASE);
+
+		if (bo->imported) {
+			bo->dev->import_size -= bo->size;
+			bo->dev->import_count--;
+		} else {
+			bo->dev->alloc_size -= bo->size;
+			bo->dev->alloc_count--;
+		}
 	}
 
 	free(bo);
@@ -64,12 +77,18 @@ static struct etna_bo *lookup_bo(void *tbl, uint32_t handle)
 {
 	struct etna_bo *bo = NULL;
 
-	if (!drmHashLookup(tbl, handle, (void **)&bo)) {
+	if (!drmIntMapLookup(tbl, handle, (void **)&bo)) {
 		/* found, incr refcnt and return: */
 		bo = etna_bo_ref(bo);
 
-		/* don't break the bucket if this bo was found in one */
-		list_delinit(&bo->list);
+		/* don't break the bucket if this bo was found in one, and
+		 * take back the device reference cached bo's don't hold:
+		 */
+		if (drm_bo_cache_entry_is_cached(&bo->cache_entry)) {
+			drm_bo_cache_remove(&bo->dev->bo_cache,
+					&bo->cache_entry);
+			etna_device_ref(bo->dev);
+		}
 	}
 
 	return bo;
@@ -77,7 +96,7 @@ static struct etna_bo *lookup_bo(void *tbl, uint32_t handle)
 
 /* allocate a new buffer object, call w/ table_lock held */
 static struct etna_bo *bo_from_handle(struct etna_device *dev,
-		uint32_t size, uint32_t handle, uint32_t flags)
+		uint32_t size, uint32_t handle, uint32_t flags, int imported)
 {
 	struct etna_bo *bo = calloc(sizeof(*bo), 1);
 
@@ -86,7 +105,10 @@ static struct etna_bo *bo_from_handle(struct etna_device *dev,
 			.handle = handle,
 		};
 
+		drmPrimeCacheForget(dev->fd, handle);
 		drmIoctl(dev->fd, DRM_IOCTL_GEM_CLOSE, &req);
+		__atomic_store_n(&dev->close_seq, dev->close_seq + 1,
+				__ATOMIC_RELEASE);
 
 		return NULL;
 	}
@@ -95,10 +117,19 @@ static struct etna_bo *bo_from_handle(struct etna_device *dev,
 	bo->size = size;
 	bo->handle = handle;
 	bo->flags = flags;
+	bo->imported = imported;
 	atomic_set(&bo->refcnt, 1);
-	list_inithead(&bo->list);
+	drm_bo_cache_entry_init(&bo->cache_entry);
 	/* add ourselves to the handle table: */
-	drmHashInsert(dev->handle_table, handle, bo);
+	drmIntMapInsert(dev->handle_table, handle, bo);
+
+	if (imported) {
+		dev->import_size += size;
+		dev->import_count++;
+	} else {
+		dev->alloc_size += size;
+		dev->alloc_count++;
+	}
 
 	return bo;
 }
@@ -110,23 +141,26 @@ drm_public struct etna_bo *etna_bo_new(struct etna_device *dev, uint32_t size,
 	struct etna_bo *bo;
 	int ret;
 	struct drm_etnaviv_gem_new req = {
-			.flags = flags,
+			.flags = flags & ~DRM_ETNA_GEM_ALLOC_FOR_RENDER,
 	};
 
-	bo = etna_bo_cache_alloc(&dev->bo_cache, &size, flags);
+	bo = etna_bo_cache_alloc(dev, &size, flags);
 	if (bo)
 		return bo;
 
+	flags &= ~DRM_ETNA_GEM_ALLOC_FOR_RENDER;
+
 	req.size = size;
 	ret = drmCommandWriteRead(dev->fd, DRM_ETNAVIV_GEM_NEW,
 			&req, sizeof(req));
 	if (ret)
 		return NULL;
 
-	pthread_mutex_lock(&table_lock);
-	bo = bo_from_handle(dev, size, req.handle, flags);
-	bo->reuse = 1;
-	pthread_mutex_unlock(&table_lock);
+	pthread_mutex_lock(&dev->table_lock);
+	bo = bo_from_handle(dev, size, req.handle, flags, 0);
+	if (bo)
+		bo->reuse = 1;
+	pthread_mutex_unlock(&dev->table_lock);
 
 	return bo;
 }
@@ -167,7 +201,7 @@ drm_public struct etna_bo *etna_bo_from_name(struct etna_device *dev,
 		.name = name,
 	};
 
-	pthread_mutex_lock(&table_lock);
+	pthread_mutex_lock(&dev->table_lock);
 
 	/* check name table first, to see if bo is already open: */
 	bo = lookup_bo(dev->name_table, name);
@@ -183,12 +217,12 @@ drm_public struct etna_bo *etna_bo_from_name(struct etna_device *dev,
 	if (bo)
 		goto out_unlock;
 
-	bo = bo_from_handle(dev, req.size, req.handle, 0);
+	bo = bo_from_handle(dev, req.size, req.handle, 0, 1);
 	if (bo)
 		set_name(bo, name);
 
 out_unlock:
-	pthread_mutex_unlock(&table_lock);
+	pthread_mutex_unlock(&dev->table_lock);
 
 	return bo;
 }
@@ -200,18 +234,24 @@ out_unlock:
 drm_public struct etna_bo *etna_bo_from_dmabuf(struct etna_device *dev, int fd)
 {
 	struct etna_bo *bo;
-	int ret, size;
-	uint32_t handle;
+	uint32_t handle, seq;
+	uint64_t size;
+	int ret;
 
-	/* take the lock before calling drmPrimeFDToHandle to avoid
-	 * racing against etna_bo_del, which might invalidate the
-	 * returned handle.
+	/* import without the lock, usually from the prime cache which also
+	 * knows the size.  etna_bo_del might close the returned handle
+	 * before we get the lock though, in that case redo the import with
+	 * the lock held:
 	 */
-	pthread_mutex_lock(&table_lock);
+	seq = __atomic_load_n(&dev->close_seq, __ATOMIC_ACQUIRE);
+	ret = drmPrimeFDToHandleCached(dev->fd, fd, &handle, &size);
 
-	ret = drmPrimeFDToHandle(dev->fd, fd, &handle);
+	pthread_mutex_lock(&dev->table_lock);
+
+	if (!ret && seq != dev->close_seq)
+		ret = drmPrimeFDToHandleCached(dev->fd, fd, &handle, &size);
 	if (ret) {
-		pthread_mutex_unlock(&table_lock);
+		pthread_mutex_unlock(&dev->table_lock);
 		return NULL;
 	}
 
@@ -219,14 +259,10 @@ drm_public struct etna_bo *etna_bo_from_dmabuf(struct etna_device *dev, int fd)
 	if (bo)
 		goto out_unlock;
 
-	/* lseek() to get bo size */
-	size = lseek(fd, 0, SEEK_END);
-	lseek(fd, 0, SEEK_CUR);
-
-	bo = bo_from_handle(dev, size, handle, 0);
+	bo = bo_from_handle(dev, size, handle, 0, 1);
 
 out_unlock:
-	pthread_mutex_unlock(&table_lock);
+	pthread_mutex_unlock(&dev->table_lock);
 
 	return bo;
 }
@@ -242,15 +278,17 @@ drm_public void etna_bo_del(struct etna_bo *bo)
 	if (!atomic_dec_and_test(&bo->refcnt))
 		return;
 
-	pthread_mutex_lock(&table_lock);
+	pthread_mutex_lock(&dev->table_lock);
 
-	if (bo->reuse && (etna_bo_cache_free(&dev->bo_cache, bo) == 0))
+	if (bo->reuse && (etna_bo_cache_free(dev, bo) == 0))
 		goto out;
 
 	bo_del(bo);
-	etna_device_del_locked(dev);
 out:
-	pthread_mutex_unlock(&table_lock);
+	pthread_mutex_unlock(&dev->table_lock);
+
+	/* neither deleted nor cached bo's hold a ref to the dev: */
+	etna_device_del(dev);
 }
 
 /* get the global flink/DRI2 buffer name */
@@ -267,9 +305,9 @@ drm_public int etna_bo_get_name(struct etna_bo *bo, uint32_t *name)
 			return ret;
 		}
 
-		pthread_mutex_lock(&table_lock);
+		pthread_mutex_lock(&bo->dev->table_lock);
 		set_name(bo, req.name);
-		pthread_mutex_unlock(&table_lock);
+		pthread_mutex_unlock(&bo->dev->table_lock);
 		bo->reuse = 0;
 	}
 
@@ -310,16 +348,30 @@ drm_public uint32_t etna_bo_size(struct etna_bo *bo)
 drm_public void *etna_bo_map(struct etna_bo *bo)
 {
 	if (!bo->map) {
+		struct etna_device *dev = bo->dev;
+		void *map;
+
 		if (!bo->offset) {
 			get_buffer_info(bo);
 		}
 
-		bo->map = drm_mmap(0, bo->size, PROT_READ | PROT_WRITE,
-				MAP_SHARED, bo->dev->fd, bo->offset);
-		if (bo->map == MAP_FAILED) {
+		map = drm_mmap(0, bo->size, PROT_READ | PROT_WRITE,
+				MAP_SHARED, dev->fd, bo->offset);
+		if (map == MAP_FAILED) {
 			ERROR_MSG("mmap failed: %s", strerror(errno));
-			bo->map = NULL;
+			return NULL;
+		}
+
+		pthread_mutex_lock(&dev->table_lock);
+		if (bo->map) {
+			/* another thread mapped it meanwhile: */
+			drm_munmap(map, bo->size);
+		} else {
+			bo->map = map;
+			dev->map_size += bo->size;
+			dev->map_count++;
 		}
+		pthread_mutex_unlock(&dev->table_lock);
 	}
 
 	return bo->map;
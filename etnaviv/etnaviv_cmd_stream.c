@@ -29,8 +29,6 @@
 #include "etnaviv_drmif.h"
 #include "etnaviv_priv.h"
 
-static pthread_mutex_t idx_lock = PTHREAD_MUTEX_INITIALIZER;
-
 static void *grow(void *ptr, uint32_t nr, uint32_t *max, uint32_t sz)
 {
 	if ((nr + 1) > *max) {
@@ -96,20 +94,88 @@ fail:
 	return NULL;
 }
 
+static void release_prev_bos(struct etna_cmd_stream_priv *priv)
+{
+	for (uint32_t i = 0; i < priv->nr_prev_bos; i++)
+		if (priv->prev_bos[i])
+			etna_bo_del(priv->prev_bos[i]);
+	priv->nr_prev_bos = 0;
+}
+
 drm_public void etna_cmd_stream_del(struct etna_cmd_stream *stream)
 {
 	struct etna_cmd_stream_priv *priv = etna_cmd_stream_priv(stream);
 
 	free(stream->buffer);
+	free(priv->submit.bos);
 	free(priv->submit.relocs);
 	free(priv->submit.pmrs);
+	release_prev_bos(priv);
+	free(priv->bos);
+	free(priv->prev_bos);
+	free(priv->bo_hash);
 	free(priv);
 }
 
+static uint32_t bo_hash_size_for(uint32_t nr_bos)
+{
+	uint32_t size = 64;
+
+	while (size < 2 * nr_bos)
+		size *= 2;
+	return size;
+}
+
+static uint32_t *bo_hash_slot(struct etna_cmd_stream_priv *priv,
+		uint32_t handle)
+{
+	uint32_t mask = priv->bo_hash_size - 1;
+	uint32_t i = (handle * 0x9e3779b1u) >> 8;
+
+	for (;; i++) {
+		uint32_t *slot = &priv->bo_hash[i & mask];
+		if (!*slot || priv->submit.bos[*slot - 1].handle == handle)
+			return slot;
+	}
+}
+
+/* (re)build the table for at least nr_bos entries from submit.bos: */
+static int bo_hash_resize(struct etna_cmd_stream_priv *priv, uint32_t nr_bos)
+{
+	uint32_t size = bo_hash_size_for(nr_bos);
+	uint32_t *hash = calloc(size, sizeof(*hash));
+	uint32_t i;
+
+	if (!hash)
+		return -ENOMEM;
+
+	free(priv->bo_hash);
+	priv->bo_hash = hash;
+	priv->bo_hash_size = size;
+
+	for (i = 0; i < priv->nr_bos; i++)
+		*bo_hash_slot(priv, priv->submit.bos[i].handle) = i + 1;
+
+	return 0;
+}
+
 static void reset_buffer(struct etna_cmd_stream *stream)
 {
 	struct etna_cmd_stream_priv *priv = etna_cmd_stream_priv(stream);
 
+	/* keep the bo table if it is the right size for the next submit: */
+	if (priv->bo_hash) {
+		if (bo_hash_size_for(priv->submit.nr_bos) == priv->bo_hash_size) {
+			memset(priv->bo_hash, 0,
+					priv->bo_hash_size * sizeof(*priv->bo_hash));
+		} else {
+			free(priv->bo_hash);
+			priv->bo_hash = NULL;
+			priv->bo_hash_size = 0;
+		}
+	}
+	priv->bo_hash_hint = priv->submit.nr_bos;
+
 	stream->offset = 0;
 	priv->submit.nr_bos = 0;
 	priv->submit.nr_relocs = 0;
@@ -136,6 +202,18 @@ static uint32_t append_bo(struct etna_cmd_stream *stream, struct etna_bo *bo)
 	priv->submit.bos[idx].flags = 0;
 	priv->submit.bos[idx].handle = bo->handle;
 
+	/* if the bo was part of the previous submit, its cached idx still
+	 * points into prev_bos, and we can take over that reference:
+	 */
+	if (__atomic_load_n(&bo->current_stream, __ATOMIC_RELAXED) == stream) {
+		uint32_t prev = __atomic_load_n(&bo->idx, __ATOMIC_RELAXED);
+		if (prev < priv->nr_prev_bos && priv->prev_bos[prev] == bo) {
+			priv->prev_bos[prev] = NULL;
+			priv->bos[idx] = bo;
+			return idx;
+		}
+	}
+
 	priv->bos[idx] = etna_bo_ref(bo);
 
 	return idx;
@@ -146,26 +224,44 @@ static uint32_t bo2idx(struct etna_cmd_stream *stream, struct etna_bo *bo,
 		uint32_t flags)
 {
 	struct etna_cmd_stream_priv *priv = etna_cmd_stream_priv(stream);
-	uint32_t idx;
+	uint32_t *slot, idx;
+
+	/* The cached idx is only a hint, which other streams (possibly on
+	 * other threads) may overwrite at any time.  It is trusted only
+	 * once it is seen to point back at this bo in this stream's table:
+	 */
+	if (__atomic_load_n(&bo->current_stream, __ATOMIC_RELAXED) == stream) {
+		idx = __atomic_load_n(&bo->idx, __ATOMIC_RELAXED);
+		if (idx < priv->nr_bos && priv->bos[idx] == bo)
+			goto found;
+	}
 
-	pthread_mutex_lock(&idx_lock);
+	if (!priv->bo_hash || 2 * (priv->nr_bos + 1) > priv->bo_hash_size) {
+		uint32_t nr_bos = priv->nr_bos + 1;
+		bo_hash_resize(priv, nr_bos > priv->bo_hash_hint ?
+				nr_bos : priv->bo_hash_hint);
+	}
 
-	if (bo->current_stream == stream) {
-		idx = bo->idx;
+	if (priv->bo_hash) {
+		slot = bo_hash_slot(priv, bo->handle);
+		if (*slot) {
+			idx = *slot - 1;
+		} else {
+			idx = append_bo(stream, bo);
+			*slot = idx + 1;
+		}
 	} else {
-		/* slow-path: */
+		/* out of memory for the table, scan instead: */
 		for (idx = 0; idx < priv->nr_bos; idx++)
 			if (priv->bos[idx] == bo)
 				break;
-		if (idx == priv->nr_bos) {
-			/* not found */
+		if (idx == priv->nr_bos)
 			idx = append_bo(stream, bo);
-		}
-		bo->current_stream = stream;
-		bo->idx = idx;
 	}
-	pthread_mutex_unlock(&idx_lock);
 
+	__atomic_store_n(&bo->current_stream, stream, __ATOMIC_RELAXED);
+	__atomic_store_n(&bo->idx, idx, __ATOMIC_RELAXED);
+found:
 	if (flags & ETNA_RELOC_READ)
 		priv->submit.bos[idx].flags |= ETNA_SUBMIT_BO_READ;
 	if (flags & ETNA_RELOC_WRITE)
@@ -180,20 +276,29 @@ static void flush(struct etna_cmd_stream *stream, int in_fence_fd,
 	struct etna_cmd_stream_priv *priv = etna_cmd_stream_priv(stream);
 	int ret, id = priv->pipe->id;
 	struct etna_gpu *gpu = priv->pipe->gpu;
+	drmSubmitTrace trace = {
+		.name = "etna_cmd_stream_flush",
+		.fd = gpu->dev->fd,
+	};
 
 	struct drm_etnaviv_gem_submit req = {
 		.pipe = gpu->core,
 		.exec_state = id,
-		.bos = VOID2U64(priv->submit.bos),
-		.nr_bos = priv->submit.nr_bos,
-		.relocs = VOID2U64(priv->submit.relocs),
-		.nr_relocs = priv->submit.nr_relocs,
-		.pmrs = VOID2U64(priv->submit.pmrs),
-		.nr_pmrs = priv->submit.nr_pmrs,
 		.stream = VOID2U64(stream->buffer),
 		.stream_size = stream->offset * 4, /* in bytes */
 	};
 
+	/* before filling in the tables, as this can add pmrs and bos: */
+	if (priv->sampler)
+		etna_perf_sampler_emit(priv->sampler);
+
+	req.bos = VOID2U64(priv->submit.bos);
+	req.nr_bos = priv->submit.nr_bos;
+	req.relocs = VOID2U64(priv->submit.relocs);
+	req.nr_relocs = priv->submit.nr_relocs;
+	req.pmrs = VOID2U64(priv->submit.pmrs);
+	req.nr_pmrs = priv->submit.nr_pmrs;
+
 	if (in_fence_fd != -1) {
 		req.flags |= ETNA_SUBMIT_FENCE_FD_IN | ETNA_SUBMIT_NO_IMPLICIT;
 		req.fence_fd = in_fence_fd;
@@ -202,19 +307,37 @@ static void flush(struct etna_cmd_stream *stream, int in_fence_fd,
 	if (out_fence_fd)
 		req.flags |= ETNA_SUBMIT_FENCE_FD_OUT;
 
+	trace.num_bos = req.nr_bos;
+	trace.cmd_bytes = req.stream_size;
+	drmSubmitTraceBegin(&trace);
+
 	ret = drmCommandWriteRead(gpu->dev->fd, DRM_ETNAVIV_GEM_SUBMIT,
 			&req, sizeof(req));
 
+	trace.ret = ret;
+	trace.fence = ret ? 0 : req.fence;
+	drmSubmitTraceEnd(&trace);
+
 	if (ret)
 		ERROR_MSG("submit failed: %d (%s)", ret, strerror(errno));
 	else
 		priv->last_timestamp = req.fence;
 
-	for (uint32_t i = 0; i < priv->nr_bos; i++) {
-		struct etna_bo *bo = priv->bos[i];
-
-		bo->current_stream = NULL;
-		etna_bo_del(bo);
+	/* Rather than unref'ing all the bo's, hold on to them until the
+	 * next submit, which likely references most of them again.  The
+	 * bo's cached idx then points into prev_bos:
+	 */
+	release_prev_bos(priv);
+	{
+		struct etna_bo **bos = priv->prev_bos;
+		uint32_t max_bos = priv->max_prev_bos;
+
+		priv->prev_bos = priv->bos;
+		priv->nr_prev_bos = priv->nr_bos;
+		priv->max_prev_bos = priv->max_bos;
+		priv->bos = bos;
+		priv->nr_bos = 0;
+		priv->max_bos = max_bos;
 	}
 
 	if (out_fence_fd)
@@ -244,6 +367,30 @@ drm_public void etna_cmd_stream_finish(struct etna_cmd_stream *stream)
 	reset_buffer(stream);
 }
 
+drm_public int etna_cmd_stream_throttle(struct etna_cmd_stream *stream,
+		uint32_t depth)
+{
+	struct etna_cmd_stream_priv *priv = etna_cmd_stream_priv(stream);
+	uint32_t n = priv->nr_frames++;
+
+	if (depth < 1)
+		depth = 1;
+	else if (depth > ETNA_CMD_STREAM_MAX_DEPTH)
+		depth = ETNA_CMD_STREAM_MAX_DEPTH;
+
+	/* the stream buffer itself is copied by the kernel on submit, only
+	 * the client's buffers need fencing:
+	 */
+	priv->frame_fences[n % ETNA_CMD_STREAM_MAX_DEPTH] = priv->last_timestamp;
+
+	if (n + 1 < depth)
+		return 0;
+
+	return etna_pipe_wait(priv->pipe,
+			priv->frame_fences[(n + 1 - depth) % ETNA_CMD_STREAM_MAX_DEPTH],
+			5000);
+}
+
 drm_public void etna_cmd_stream_reloc(struct etna_cmd_stream *stream,
 									  const struct etna_reloc *r)
 {
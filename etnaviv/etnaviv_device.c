@@ -39,8 +39,6 @@
 #include "etnaviv_priv.h"
 #include "etnaviv_drmif.h"
 
-static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
-
 drm_public struct etna_device *etna_device_new(int fd)
 {
 	struct etna_device *dev = calloc(sizeof(*dev), 1);
@@ -50,8 +48,9 @@ drm_public struct etna_device *etna_device_new(int fd)
 
 	atomic_set(&dev->refcnt, 1);
 	dev->fd = fd;
-	dev->handle_table = drmHashCreate();
-	dev->name_table = drmHashCreate();
+	dev->handle_table = drmIntMapCreate();
+	dev->name_table = drmIntMapCreate();
+	pthread_mutex_init(&dev->table_lock, NULL);
 	etna_bo_cache_init(&dev->bo_cache);
 
 	return dev;
@@ -79,11 +78,21 @@ drm_public struct etna_device *etna_device_ref(struct etna_device *dev)
 	return dev;
 }
 
-static void etna_device_del_impl(struct etna_device *dev)
+/* The lock lives in the device, so references to it are never dropped
+ * with table_lock held.
+ */
+drm_public void etna_device_del(struct etna_device *dev)
 {
-	etna_bo_cache_cleanup(&dev->bo_cache, 0);
-	drmHashDestroy(dev->handle_table);
-	drmHashDestroy(dev->name_table);
+	if (!atomic_dec_and_test(&dev->refcnt))
+		return;
+
+	pthread_mutex_lock(&dev->table_lock);
+	drm_bo_cache_cleanup(&dev->bo_cache, 0);
+	pthread_mutex_unlock(&dev->table_lock);
+
+	pthread_mutex_destroy(&dev->table_lock);
+	drmIntMapDestroy(dev->handle_table);
+	drmIntMapDestroy(dev->name_table);
 
 	if (dev->closefd)
 		close(dev->fd);
@@ -91,22 +100,58 @@ static void etna_device_del_impl(struct etna_device *dev)
 	free(dev);
 }
 
-drm_private void etna_device_del_locked(struct etna_device *dev)
+/* Let the bo cache reuse BOs up to percent larger than requested, rather
+ * than rounding allocations up to the bucket size.  0 restores rounding.
+ */
+drm_public void etna_device_set_bo_cache_tolerance(struct etna_device *dev,
+		int percent)
 {
-	if (!atomic_dec_and_test(&dev->refcnt))
-		return;
+	pthread_mutex_lock(&dev->table_lock);
+	dev->bo_cache.tolerance = percent > 0 ? percent : 0;
+	pthread_mutex_unlock(&dev->table_lock);
+}
 
-	etna_device_del_impl(dev);
+/* Cap the bytes held in the bo cache, freeing the oldest cached BOs
+ * beyond it.  0 (the default) leaves the cache unbounded.
+ */
+drm_public void etna_device_set_bo_cache_budget(struct etna_device *dev,
+		uint64_t bytes)
+{
+	pthread_mutex_lock(&dev->table_lock);
+	dev->bo_cache.budget = bytes;
+	if (bytes)
+		drm_bo_cache_trim(&dev->bo_cache, bytes);
+	pthread_mutex_unlock(&dev->table_lock);
 }
 
-drm_public void etna_device_del(struct etna_device *dev)
+/* Free the oldest cached BOs until no more than bytes are left, eg. when
+ * the system is under memory pressure.
+ */
+drm_public void etna_device_bo_cache_trim(struct etna_device *dev,
+		uint64_t bytes)
 {
-	if (!atomic_dec_and_test(&dev->refcnt))
-		return;
+	pthread_mutex_lock(&dev->table_lock);
+	drm_bo_cache_trim(&dev->bo_cache, bytes);
+	pthread_mutex_unlock(&dev->table_lock);
+}
 
-	pthread_mutex_lock(&table_lock);
-	etna_device_del_impl(dev);
-	pthread_mutex_unlock(&table_lock);
+/* Fill in the memory held through the device.  BOs in the bo cache count
+ * as allocated too, BOs opened from a flink name or dmabuf only as
+ * imported.
+ */
+drm_public void etna_device_get_bo_stats(struct etna_device *dev,
+		drmBOStatsPtr stats)
+{
+	pthread_mutex_lock(&dev->table_lock);
+	stats->allocated_bytes = dev->alloc_size;
+	stats->allocated_count = dev->alloc_count;
+	stats->cached_bytes = dev->bo_cache.size;
+	stats->cached_count = dev->bo_cache.count;
+	stats->mapped_bytes = dev->map_size;
+	stats->mapped_count = dev->map_count;
+	stats->imported_bytes = dev->import_size;
+	stats->imported_count = dev->import_count;
+	pthread_mutex_unlock(&dev->table_lock);
 }
 
 drm_public int etna_device_fd(struct etna_device *dev)
@@ -38,6 +38,7 @@ struct etna_cmd_stream;
 struct etna_perfmon;
 struct etna_perfmon_domain;
 struct etna_perfmon_signal;
+struct etna_perf_sampler;
 
 enum etna_pipe_id {
 	ETNA_PIPE_3D = 0,
@@ -77,6 +78,8 @@ enum etna_param_id {
 #define DRM_ETNA_GEM_CACHE_MASK         0x000f0000
 /* map flags */
 #define DRM_ETNA_GEM_FORCE_MMU          0x00100000
+/* only used by the bo cache, not passed to the kernel: */
+#define DRM_ETNA_GEM_ALLOC_FOR_RENDER   0x80000000
 
 /* bo access flags: (keep aligned to ETNA_PREP_x) */
 #define DRM_ETNA_PREP_READ              0x01
@@ -91,6 +94,10 @@ struct etna_device *etna_device_new_dup(int fd);
 struct etna_device *etna_device_ref(struct etna_device *dev);
 void etna_device_del(struct etna_device *dev);
 int etna_device_fd(struct etna_device *dev);
+void etna_device_set_bo_cache_tolerance(struct etna_device *dev, int percent);
+void etna_device_set_bo_cache_budget(struct etna_device *dev, uint64_t bytes);
+void etna_device_bo_cache_trim(struct etna_device *dev, uint64_t bytes);
+void etna_device_get_bo_stats(struct etna_device *dev, drmBOStatsPtr stats);
 
 /* gpu functions:
  */
@@ -146,6 +153,12 @@ void etna_cmd_stream_flush(struct etna_cmd_stream *stream);
 void etna_cmd_stream_flush2(struct etna_cmd_stream *stream, int in_fence_fd,
 			    int *out_fence_fd);
 void etna_cmd_stream_finish(struct etna_cmd_stream *stream);
+/* Call once per frame, after flushing it: waits until at most depth - 1
+ * of the stream's frames are still executing, so a client cycling through
+ * depth sets of per-frame buffers can reuse the oldest set while the GPU
+ * works on the others.  depth of 1 waits for the frame just flushed.
+ */
+int etna_cmd_stream_throttle(struct etna_cmd_stream *stream, uint32_t depth);
 
 static inline uint32_t etna_cmd_stream_avail(struct etna_cmd_stream *stream)
 {
@@ -211,4 +224,17 @@ struct etna_perf {
 
 void etna_cmd_stream_perf(struct etna_cmd_stream *stream, const struct etna_perf *p);
 
+/* Continuous sampling: every interval'th submit of the stream samples the
+ * signals before and after it, into a ring of nr_samples samples.  The
+ * signals must outlive the sampler, and the sampler the stream.
+ * etna_perf_sampler_read() returns 1 and the per-signal deltas of the
+ * oldest finished sample not read yet, or 0 if there is none.  Samples
+ * not read before the ring wraps are dropped.
+ */
+struct etna_perf_sampler *etna_perf_sampler_new(struct etna_cmd_stream *stream,
+		struct etna_perfmon_signal **signals, uint32_t nr_signals,
+		uint32_t interval, uint32_t nr_samples);
+void etna_perf_sampler_del(struct etna_perf_sampler *sampler);
+int etna_perf_sampler_read(struct etna_perf_sampler *sampler, uint32_t *values);
+
 #endif /* ETNAVIV_DRMIF_H_ */
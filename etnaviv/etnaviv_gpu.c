@@ -47,6 +47,7 @@ static uint64_t get_param(struct etna_device *dev, uint32_t core, uint32_t param
 drm_public struct etna_gpu *etna_gpu_new(struct etna_device *dev, unsigned int core)
 {
 	struct etna_gpu *gpu;
+	unsigned int i;
 
 	gpu = calloc(1, sizeof(*gpu));
 	if (!gpu) {
@@ -57,13 +58,21 @@ drm_public struct etna_gpu *etna_gpu_new(struct etna_device *dev, unsigned int c
 	gpu->dev = dev;
 	gpu->core = core;
 
-	gpu->model    	= get_param(dev, core, ETNAVIV_PARAM_GPU_MODEL);
-	gpu->revision 	= get_param(dev, core, ETNAVIV_PARAM_GPU_REVISION);
-
-	if (!gpu->model)
+	gpu->params[ETNA_GPU_MODEL] = get_param(dev, core, ETNAVIV_PARAM_GPU_MODEL);
+	if (!gpu->params[ETNA_GPU_MODEL])
 		goto fail;
 
-	INFO_MSG(" GPU model:          0x%x (rev %x)", gpu->model, gpu->revision);
+	/* etna_param_id matches the kernel's param ids, with a gap between
+	 * the feature words and the limits:
+	 */
+	for (i = ETNA_GPU_REVISION; i <= ETNA_GPU_FEATURES_6; i++)
+		gpu->params[i] = get_param(dev, core, i);
+	for (i = ETNA_GPU_STREAM_COUNT; i <= ETNA_GPU_NUM_VARYINGS; i++)
+		gpu->params[i] = get_param(dev, core, i);
+
+	INFO_MSG(" GPU model:          0x%x (rev %x)",
+			(uint32_t)gpu->params[ETNA_GPU_MODEL],
+			(uint32_t)gpu->params[ETNA_GPU_REVISION]);
 
 	return gpu;
 fail:
@@ -81,69 +90,28 @@ drm_public void etna_gpu_del(struct etna_gpu *gpu)
 drm_public int etna_gpu_get_param(struct etna_gpu *gpu, enum etna_param_id param,
 		uint64_t *value)
 {
-	struct etna_device *dev = gpu->dev;
-	unsigned int core = gpu->core;
-
 	switch(param) {
 	case ETNA_GPU_MODEL:
-		*value = gpu->model;
-		return 0;
 	case ETNA_GPU_REVISION:
-		*value = gpu->revision;
-		return 0;
 	case ETNA_GPU_FEATURES_0:
-		*value = get_param(dev, core, ETNAVIV_PARAM_GPU_FEATURES_0);
-		return 0;
 	case ETNA_GPU_FEATURES_1:
-		*value = get_param(dev, core, ETNAVIV_PARAM_GPU_FEATURES_1);
-		return 0;
 	case ETNA_GPU_FEATURES_2:
-		*value = get_param(dev, core, ETNAVIV_PARAM_GPU_FEATURES_2);
-		return 0;
 	case ETNA_GPU_FEATURES_3:
-		*value = get_param(dev, core, ETNAVIV_PARAM_GPU_FEATURES_3);
-		return 0;
 	case ETNA_GPU_FEATURES_4:
-		*value = get_param(dev, core, ETNAVIV_PARAM_GPU_FEATURES_4);
-		return 0;
 	case ETNA_GPU_FEATURES_5:
-		*value = get_param(dev, core, ETNAVIV_PARAM_GPU_FEATURES_5);
-		return 0;
 	case ETNA_GPU_FEATURES_6:
-		*value = get_param(dev, core, ETNAVIV_PARAM_GPU_FEATURES_6);
-		return 0;
 	case ETNA_GPU_STREAM_COUNT:
-		*value = get_param(dev, core, ETNA_GPU_STREAM_COUNT);
-		return 0;
 	case ETNA_GPU_REGISTER_MAX:
-		*value = get_param(dev, core, ETNA_GPU_REGISTER_MAX);
-		return 0;
 	case ETNA_GPU_THREAD_COUNT:
-		*value = get_param(dev, core, ETNA_GPU_THREAD_COUNT);
-		return 0;
 	case ETNA_GPU_VERTEX_CACHE_SIZE:
-		*value = get_param(dev, core, ETNA_GPU_VERTEX_CACHE_SIZE);
-		return 0;
 	case ETNA_GPU_SHADER_CORE_COUNT:
-		*value = get_param(dev, core, ETNA_GPU_SHADER_CORE_COUNT);
-		return 0;
 	case ETNA_GPU_PIXEL_PIPES:
-		*value = get_param(dev, core, ETNA_GPU_PIXEL_PIPES);
-		return 0;
 	case ETNA_GPU_VERTEX_OUTPUT_BUFFER_SIZE:
-		*value = get_param(dev, core, ETNA_GPU_VERTEX_OUTPUT_BUFFER_SIZE);
-		return 0;
 	case ETNA_GPU_BUFFER_SIZE:
-		*value = get_param(dev, core, ETNA_GPU_BUFFER_SIZE);
-		return 0;
 	case ETNA_GPU_INSTRUCTION_COUNT:
-		*value = get_param(dev, core, ETNA_GPU_INSTRUCTION_COUNT);
-		return 0;
 	case ETNA_GPU_NUM_CONSTANTS:
-		*value = get_param(dev, core, ETNA_GPU_NUM_CONSTANTS);
-		return 0;
 	case ETNA_GPU_NUM_VARYINGS:
-		*value = get_param(dev, core, ETNA_GPU_NUM_VARYINGS);
+		*value = gpu->params[param];
 		return 0;
 
 	default:
@@ -183,3 +183,128 @@ drm_public struct etna_perfmon_signal *etna_perfmon_get_sig_by_name(struct etna_
 
 	return NULL;
 }
+
+drm_public struct etna_perf_sampler *
+etna_perf_sampler_new(struct etna_cmd_stream *stream,
+		struct etna_perfmon_signal **signals, uint32_t nr_signals,
+		uint32_t interval, uint32_t nr_samples)
+{
+	struct etna_cmd_stream_priv *priv = (struct etna_cmd_stream_priv *)stream;
+	struct etna_perf_sampler *sampler;
+	uint32_t size, *map;
+
+	if (!nr_signals || !interval || !nr_samples || priv->sampler)
+		return NULL;
+
+	sampler = calloc(1, sizeof(*sampler) + nr_signals * sizeof(*signals));
+	if (!sampler) {
+		ERROR_MSG("allocation failed");
+		return NULL;
+	}
+
+	size = (2 + 2 * nr_signals * nr_samples) * sizeof(uint32_t);
+	sampler->bo = etna_bo_new(priv->pipe->gpu->dev, ALIGN(size, 4096),
+			DRM_ETNA_GEM_CACHE_UNCACHED);
+	if (!sampler->bo)
+		goto fail;
+
+	map = etna_bo_map(sampler->bo);
+	if (!map)
+		goto fail;
+	memset(map, 0, size);
+
+	sampler->stream = stream;
+	sampler->interval = interval;
+	sampler->nr_samples = nr_samples;
+	sampler->nr_signals = nr_signals;
+	memcpy(sampler->signals, signals, nr_signals * sizeof(*signals));
+
+	priv->sampler = sampler;
+
+	return sampler;
+
+fail:
+	if (sampler->bo)
+		etna_bo_del(sampler->bo);
+	free(sampler);
+	return NULL;
+}
+
+drm_public void etna_perf_sampler_del(struct etna_perf_sampler *sampler)
+{
+	struct etna_cmd_stream_priv *priv;
+
+	if (!sampler)
+		return;
+
+	priv = (struct etna_cmd_stream_priv *)sampler->stream;
+	priv->sampler = NULL;
+
+	etna_bo_del(sampler->bo);
+	free(sampler);
+}
+
+static uint32_t sample_base(struct etna_perf_sampler *sampler, uint32_t seq)
+{
+	return 2 + ((seq - 1) % sampler->nr_samples) * 2 * sampler->nr_signals;
+}
+
+/* Called from flush, before the submit tables are handed to the kernel: */
+drm_private void etna_perf_sampler_emit(struct etna_perf_sampler *sampler)
+{
+	uint32_t i, seq, base;
+
+	if (sampler->nr_flushes++ % sampler->interval)
+		return;
+
+	seq = ++sampler->nr_written;
+
+	/* ring is full, drop the oldest unread sample: */
+	if (seq - sampler->nr_read > sampler->nr_samples)
+		sampler->nr_read = seq - sampler->nr_samples;
+
+	base = sample_base(sampler, seq);
+
+	for (i = 0; i < sampler->nr_signals; i++) {
+		struct etna_perf p = {
+			.flags = ETNA_PM_PROCESS_PRE,
+			.sequence = seq,
+			.signal = sampler->signals[i],
+			.bo = sampler->bo,
+			.offset = base + 2 * i,
+		};
+
+		etna_cmd_stream_perf(sampler->stream, &p);
+
+		p.flags = ETNA_PM_PROCESS_POST;
+		p.offset = base + 2 * i + 1;
+		etna_cmd_stream_perf(sampler->stream, &p);
+	}
+}
+
+drm_public int etna_perf_sampler_read(struct etna_perf_sampler *sampler,
+		uint32_t *values)
+{
+	uint32_t *map = etna_bo_map(sampler->bo);
+	uint32_t i, base, seq = sampler->nr_read + 1;
+
+	if (!map)
+		return -ENOMEM;
+
+	if ((int32_t)(sampler->nr_written - seq) < 0)
+		return 0;
+
+	/* submits finish in order, so anything up to the sequence the
+	 * kernel stored last is done:
+	 */
+	if ((int32_t)(__atomic_load_n(&map[0], __ATOMIC_ACQUIRE) - seq) < 0)
+		return 0;
+
+	base = sample_base(sampler, seq);
+	for (i = 0; i < sampler->nr_signals; i++)
+		values[i] = map[base + 2 * i + 1] - map[base + 2 * i];
+
+	sampler->nr_read = seq;
+
+	return 1;
+}
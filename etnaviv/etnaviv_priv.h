@@ -43,21 +43,11 @@
 #include "xf86atomic.h"
 
 #include "util_double_list.h"
+#include "drm_bo_cache.h"
 
 #include "etnaviv_drmif.h"
 #include "etnaviv_drm.h"
 
-struct etna_bo_bucket {
-	uint32_t size;
-	struct list_head list;
-};
-
-struct etna_bo_cache {
-	struct etna_bo_bucket cache_bucket[14 * 4];
-	unsigned num_buckets;
-	time_t time;
-};
-
 struct etna_device {
 	int fd;
 	atomic_t refcnt;
@@ -73,19 +63,33 @@ struct etna_device {
 	 */
 	void *handle_table, *name_table;
 
-	struct etna_bo_cache bo_cache;
+	/* protects the tables above and the bo cache.  Per device, so that
+	 * unrelated devices don't contend (neither table is shared across
+	 * devices, flink names are looked up per device too):
+	 */
+	pthread_mutex_t table_lock;
+
+	struct drm_bo_cache bo_cache;
+
+	/* BOs in the handle table, and their CPU mappings, for
+	 * etna_device_get_bo_stats().  Protected by table_lock:
+	 */
+	uint64_t alloc_size, import_size, map_size;
+	uint32_t alloc_count, import_count, map_count;
+
+	/* bumped under table_lock for every GEM handle closed, so that a
+	 * dma-buf import done without the lock can tell whether its handle
+	 * may have been closed in the meantime:
+	 */
+	uint32_t close_seq;
 
 	int closefd;        /* call close(fd) upon destruction */
 };
 
-drm_private void etna_bo_cache_init(struct etna_bo_cache *cache);
-drm_private void etna_bo_cache_cleanup(struct etna_bo_cache *cache, time_t time);
-drm_private struct etna_bo *etna_bo_cache_alloc(struct etna_bo_cache *cache,
+drm_private void etna_bo_cache_init(struct drm_bo_cache *cache);
+drm_private struct etna_bo *etna_bo_cache_alloc(struct etna_device *dev,
 		uint32_t *size, uint32_t flags);
-drm_private int etna_bo_cache_free(struct etna_bo_cache *cache, struct etna_bo *bo);
-
-/* for where @table_lock is already held: */
-drm_private void etna_device_del_locked(struct etna_device *dev);
+drm_private int etna_bo_cache_free(struct etna_device *dev, struct etna_bo *bo);
 
 /* a GEM buffer object allocated from the DRM device */
 struct etna_bo {
@@ -99,25 +103,28 @@ struct etna_bo {
 	atomic_t        refcnt;
 
 	/* in the common case, a bo won't be referenced by more than a single
-	 * command stream.  So to avoid looping over all the bo's in the
-	 * reloc table to find the idx of a bo that might already be in the
-	 * table, we cache the idx in the bo.  But in order to detect the
-	 * slow-path where bo is ref'd in multiple streams, we also must track
-	 * the current_stream for which the idx is valid.  See bo2idx().
+	 * command stream.  So to avoid a hashtable lookup to find the idx of
+	 * a bo that might already be in the table, we cache the idx in the
+	 * bo, along with the current_stream for which the idx is valid.
+	 * Accessed without a lock, so bo2idx() checks the idx against the
+	 * stream before using it.
 	 */
 	struct etna_cmd_stream *current_stream;
 	uint32_t idx;
 
 	int reuse;
-	struct list_head list;   /* bucket-list entry */
-	time_t free_time;        /* time when added to bucket-list */
+	int imported;   /* opened from a flink name or dmabuf */
+	struct drm_bo_cache_entry cache_entry;
 };
 
 struct etna_gpu {
 	struct etna_device *dev;
 	uint32_t core;
-	uint32_t model;
-	uint32_t revision;
+
+	/* all of the GET_PARAM values are fixed for a core, so they are read
+	 * once in etna_gpu_new(), indexed by enum etna_param_id:
+	 */
+	uint64_t params[ETNA_GPU_NUM_VARYINGS + 1];
 };
 
 struct etna_pipe {
@@ -131,6 +138,11 @@ struct etna_cmd_stream_priv {
 
 	uint32_t last_timestamp;
 
+	/* fences of the last frames, see etna_cmd_stream_throttle(): */
+#define ETNA_CMD_STREAM_MAX_DEPTH 8
+	uint32_t frame_fences[ETNA_CMD_STREAM_MAX_DEPTH];
+	uint32_t nr_frames;
+
 	/* submit ioctl related tables: */
 	struct {
 		/* bo's table: */
@@ -150,6 +162,24 @@ struct etna_cmd_stream_priv {
 	struct etna_bo **bos;
 	uint32_t nr_bos, max_bos;
 
+	/* bo's of the previous submit, still holding their reference.  A bo
+	 * which shows up again takes over its reference (and the entry is
+	 * cleared), the remaining ones are unref'd after the next submit:
+	 */
+	struct etna_bo **prev_bos;
+	uint32_t nr_prev_bos, max_prev_bos;
+
+	/* maps bo handle to idx + 1, for bo's whose cached idx is for another
+	 * stream.  Open addressing, sized (power of two) from the number of
+	 * bo's in the previous submit and allocated on the first miss:
+	 */
+	uint32_t *bo_hash;
+	uint32_t bo_hash_size;
+	uint32_t bo_hash_hint;
+
+	/* optional, see etna_perf_sampler_new(): */
+	struct etna_perf_sampler *sampler;
+
 	/* notify callback if buffer reset happened */
 	void (*reset_notify)(struct etna_cmd_stream *stream, void *priv);
 	void *reset_notify_priv;
@@ -176,6 +206,23 @@ struct etna_perfmon_signal
 	char name[64];
 };
 
+/* The kernel stores the sequence of the last processed request at the
+ * start of the bo (and takes the pmr offsets in 32-bit words), so the
+ * samples follow that, PRE and POST value per signal:
+ */
+struct etna_perf_sampler
+{
+	struct etna_cmd_stream *stream;
+	struct etna_bo *bo;
+	uint32_t interval, nr_samples;
+	uint32_t nr_flushes;
+	uint32_t nr_written, nr_read;    /* sample sequence numbers */
+	uint32_t nr_signals;
+	struct etna_perfmon_signal *signals[];
+};
+
+drm_private void etna_perf_sampler_emit(struct etna_perf_sampler *sampler);
+
 #define ALIGN(v,a) (((v) + (a) - 1) & ~((a) - 1))
 #define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
 
@@ -29,6 +29,8 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <time.h>
 
 #include <sys/mman.h>
 #include <linux/stddef.h>
@@ -36,11 +38,174 @@
 #include <xf86drm.h>
 
 #include "libdrm_macros.h"
+#include "util_double_list.h"
 #include "exynos_drm.h"
 #include "exynos_drmif.h"
 
 #define U642VOID(x) ((void *)(unsigned long)(x))
 
+/*
+ * bo reuse cache: bo's destroyed by the user are kept around, mapping
+ * included, for about a second in a bucket matching their size and are
+ * handed out again by exynos_bo_create() for the same flags.  There is
+ * no busy ioctl for exynos gem objects, so the cache is only enabled on
+ * request with exynos_device_set_bo_cache() by users that guarantee a
+ * bo is idle (not queued to g2d, not being scanned out) when destroyed.
+ */
+#define EXYNOS_BO_CACHE_BUCKETS	56
+
+struct exynos_bo_bucket {
+	size_t size;
+	struct list_head list;
+};
+
+struct exynos_device_priv {
+	struct exynos_device base;
+	pthread_mutex_t lock;
+	int cache_enabled;
+	time_t time;
+	unsigned int nr_buckets;
+	struct exynos_bo_bucket buckets[EXYNOS_BO_CACHE_BUCKETS];
+};
+
+struct exynos_bo_priv {
+	struct exynos_bo base;
+	struct list_head list;
+	time_t free_time;
+	int reusable;
+};
+
+static inline struct exynos_device_priv *to_device_priv(struct exynos_device *dev)
+{
+	return (struct exynos_device_priv *)dev;
+}
+
+static inline struct exynos_bo_priv *to_bo_priv(struct exynos_bo *bo)
+{
+	return (struct exynos_bo_priv *)bo;
+}
+
+static void add_bucket(struct exynos_device_priv *priv, size_t size)
+{
+	struct exynos_bo_bucket *bucket = &priv->buckets[priv->nr_buckets++];
+
+	bucket->size = size;
+	list_inithead(&bucket->list);
+}
+
+static void bo_cache_init(struct exynos_device_priv *priv)
+{
+	size_t size;
+
+	/* same bucket layout as the other drivers' bo caches */
+	add_bucket(priv, 4096);
+	add_bucket(priv, 4096 * 2);
+	add_bucket(priv, 4096 * 3);
+
+	for (size = 4 * 4096; size <= 64 * 1024 * 1024; size *= 2) {
+		add_bucket(priv, size);
+		add_bucket(priv, size + size * 1 / 4);
+		add_bucket(priv, size + size * 2 / 4);
+		add_bucket(priv, size + size * 3 / 4);
+	}
+}
+
+static struct exynos_bo_bucket *
+get_bucket(struct exynos_device_priv *priv, size_t size)
+{
+	unsigned int i;
+
+	for (i = 0; i < priv->nr_buckets; i++) {
+		struct exynos_bo_bucket *bucket = &priv->buckets[i];
+
+		if (bucket->size >= size)
+			return bucket;
+	}
+
+	return NULL;
+}
+
+static time_t get_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+static void bo_free(struct exynos_bo *bo)
+{
+	if (bo->vaddr)
+		munmap(bo->vaddr, bo->size);
+
+	if (bo->handle) {
+		struct drm_gem_close req = {
+			.handle = bo->handle,
+		};
+
+		drmIoctl(bo->dev->fd, DRM_IOCTL_GEM_CLOSE, &req);
+	}
+
+	free(to_bo_priv(bo));
+}
+
+/*
+ * Free the cached bo's that have been idle for more than a second, or
+ * all of them if time is 0.  Called with the device lock held.
+ */
+static void bo_cache_cleanup(struct exynos_device_priv *priv, time_t time)
+{
+	unsigned int i;
+
+	if (time && priv->time == time)
+		return;
+
+	for (i = 0; i < priv->nr_buckets; i++) {
+		struct exynos_bo_bucket *bucket = &priv->buckets[i];
+
+		while (!LIST_IS_EMPTY(&bucket->list)) {
+			struct exynos_bo_priv *bo_priv;
+
+			bo_priv = LIST_FIRST_ENTRY(&bucket->list,
+						   struct exynos_bo_priv, list);
+			if (time && time - bo_priv->free_time <= 1)
+				break;
+
+			list_del(&bo_priv->list);
+			bo_free(&bo_priv->base);
+		}
+	}
+
+	priv->time = time;
+}
+
+static struct exynos_bo *
+bo_cache_alloc(struct exynos_device_priv *priv, size_t *size, uint32_t flags)
+{
+	struct exynos_bo_bucket *bucket;
+	struct exynos_bo_priv *bo_priv, *tmp;
+	struct exynos_bo *bo = NULL;
+
+	bucket = get_bucket(priv, *size);
+	if (!bucket)
+		return NULL;
+
+	*size = bucket->size;
+
+	pthread_mutex_lock(&priv->lock);
+	/* most recently freed first, its pages are the likeliest to be warm */
+	LIST_FOR_EACH_ENTRY_SAFE_REV(bo_priv, tmp, &bucket->list, list) {
+		if (bo_priv->base.flags == flags) {
+			list_del(&bo_priv->list);
+			bo = &bo_priv->base;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&priv->lock);
+
+	return bo;
+}
+
 /*
  * Create exynos drm device object.
  *
@@ -50,18 +215,20 @@
  */
 drm_public struct exynos_device * exynos_device_create(int fd)
 {
-	struct exynos_device *dev;
+	struct exynos_device_priv *priv;
 
-	dev = calloc(sizeof(*dev), 1);
-	if (!dev) {
+	priv = calloc(sizeof(*priv), 1);
+	if (!priv) {
 		fprintf(stderr, "failed to create device[%s].\n",
 				strerror(errno));
 		return NULL;
 	}
 
-	dev->fd = fd;
+	priv->base.fd = fd;
+	pthread_mutex_init(&priv->lock, NULL);
+	bo_cache_init(priv);
 
-	return dev;
+	return &priv->base;
 }
 
 /*
@@ -71,7 +238,36 @@ drm_public struct exynos_device * exynos_device_create(int fd)
  */
 drm_public void exynos_device_destroy(struct exynos_device *dev)
 {
-	free(dev);
+	struct exynos_device_priv *priv = to_device_priv(dev);
+
+	bo_cache_cleanup(priv, 0);
+	pthread_mutex_destroy(&priv->lock);
+	free(priv);
+}
+
+/*
+ * Enable or disable reuse of destroyed buffer objects.
+ *
+ * @dev: exynos drm device object.
+ * @enable: non-zero to keep destroyed bo's for reuse, zero to disable
+ *	reuse and release the bo's cached so far.
+ *
+ * the kernel can't tell whether a gem object is still in use by the
+ * hardware, so a user enabling the cache must only destroy bo's that
+ * are idle.  bo's shared through a global name are never reused, bo's
+ * exported through prime must be kept alive by the user as long as the
+ * importer uses them.
+ */
+drm_public void exynos_device_set_bo_cache(struct exynos_device *dev,
+					   int enable)
+{
+	struct exynos_device_priv *priv = to_device_priv(dev);
+
+	pthread_mutex_lock(&priv->lock);
+	priv->cache_enabled = !!enable;
+	if (!enable)
+		bo_cache_cleanup(priv, 0);
+	pthread_mutex_unlock(&priv->lock);
 }
 
 /*
@@ -90,9 +286,10 @@ drm_public void exynos_device_destroy(struct exynos_device *dev)
 drm_public struct exynos_bo * exynos_bo_create(struct exynos_device *dev,
                                                size_t size, uint32_t flags)
 {
+	struct exynos_device_priv *priv = to_device_priv(dev);
+	struct exynos_bo_priv *bo_priv;
 	struct exynos_bo *bo;
 	struct drm_exynos_gem_create req = {
-		.size = size,
 		.flags = flags,
 	};
 
@@ -101,14 +298,22 @@ drm_public struct exynos_bo * exynos_bo_create(struct exynos_device *dev,
 		goto fail;
 	}
 
-	bo = calloc(sizeof(*bo), 1);
-	if (!bo) {
+	if (priv->cache_enabled) {
+		bo = bo_cache_alloc(priv, &size, flags);
+		if (bo)
+			return bo;
+	}
+
+	bo_priv = calloc(sizeof(*bo_priv), 1);
+	if (!bo_priv) {
 		fprintf(stderr, "failed to create bo[%s].\n",
 				strerror(errno));
-		goto err_free_bo;
+		goto fail;
 	}
 
+	bo = &bo_priv->base;
 	bo->dev = dev;
+	req.size = size;
 
 	if (drmIoctl(dev->fd, DRM_IOCTL_EXYNOS_GEM_CREATE, &req)){
 		fprintf(stderr, "failed to create gem object[%s].\n",
@@ -119,11 +324,12 @@ drm_public struct exynos_bo * exynos_bo_create(struct exynos_device *dev,
 	bo->handle = req.handle;
 	bo->size = size;
 	bo->flags = flags;
+	bo_priv->reusable = 1;
 
 	return bo;
 
 err_free_bo:
-	free(bo);
+	free(bo_priv);
 fail:
 	return NULL;
 }
@@ -169,21 +375,33 @@ drm_public int exynos_bo_get_info(struct exynos_device *dev, uint32_t handle,
  */
 drm_public void exynos_bo_destroy(struct exynos_bo *bo)
 {
+	struct exynos_device_priv *priv;
+	struct exynos_bo_priv *bo_priv;
+
 	if (!bo)
 		return;
 
-	if (bo->vaddr)
-		munmap(bo->vaddr, bo->size);
+	priv = to_device_priv(bo->dev);
+	bo_priv = to_bo_priv(bo);
 
-	if (bo->handle) {
-		struct drm_gem_close req = {
-			.handle = bo->handle,
-		};
+	if (bo_priv->reusable) {
+		struct exynos_bo_bucket *bucket;
 
-		drmIoctl(bo->dev->fd, DRM_IOCTL_GEM_CLOSE, &req);
+		pthread_mutex_lock(&priv->lock);
+		bucket = priv->cache_enabled ? get_bucket(priv, bo->size) : NULL;
+		if (bucket && bucket->size == bo->size) {
+			time_t time = get_time();
+
+			bo_priv->free_time = time;
+			list_addtail(&bo_priv->list, &bucket->list);
+			bo_cache_cleanup(priv, time);
+			pthread_mutex_unlock(&priv->lock);
+			return;
+		}
+		pthread_mutex_unlock(&priv->lock);
 	}
 
-	free(bo);
+	bo_free(bo);
 }
 
 
@@ -202,18 +420,21 @@ drm_public void exynos_bo_destroy(struct exynos_bo *bo)
 drm_public struct exynos_bo *
 exynos_bo_from_name(struct exynos_device *dev, uint32_t name)
 {
+	struct exynos_bo_priv *bo_priv;
 	struct exynos_bo *bo;
 	struct drm_gem_open req = {
 		.name = name,
 	};
 
-	bo = calloc(sizeof(*bo), 1);
-	if (!bo) {
+	bo_priv = calloc(sizeof(*bo_priv), 1);
+	if (!bo_priv) {
 		fprintf(stderr, "failed to allocate bo[%s].\n",
 				strerror(errno));
 		return NULL;
 	}
 
+	bo = &bo_priv->base;
+
 	if (drmIoctl(dev->fd, DRM_IOCTL_GEM_OPEN, &req)) {
 		fprintf(stderr, "failed to open gem object[%s].\n",
 				strerror(errno));
@@ -227,7 +448,7 @@ exynos_bo_from_name(struct exynos_device *dev, uint32_t name)
 	return bo;
 
 err_free_bo:
-	free(bo);
+	free(bo_priv);
 	return NULL;
 }
 
@@ -258,6 +479,8 @@ drm_public int exynos_bo_get_name(struct exynos_bo *bo, uint32_t *name)
 		}
 
 		bo->name = req.name;
+		/* other processes may hold on to it, never reuse */
+		to_bo_priv(bo)->reusable = 0;
 	}
 
 	*name = bo->name;
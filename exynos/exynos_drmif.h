@@ -82,6 +82,7 @@ struct exynos_event_context {
  */
 struct exynos_device * exynos_device_create(int fd);
 void exynos_device_destroy(struct exynos_device *dev);
+void exynos_device_set_bo_cache(struct exynos_device *dev, int enable);
 
 /*
  * buffer-object related functions:
@@ -57,6 +57,9 @@
 #define G2D_MAX_GEM_CMD_NR	64
 #define G2D_MAX_CMD_LIST_NR	64
 
+/* number of 32-bit registers covered by g2d_context::cmd_pos */
+#define G2D_REG_NR		(0x0800 / 4)
+
 struct g2d_context {
 	int				fd;
 	unsigned int			major;
@@ -67,6 +70,8 @@ struct g2d_context {
 	unsigned int			cmd_buf_nr;
 	unsigned int			cmdlist_nr;
 	void				*event_userdata;
+	/* position + 1 in cmd[] of each register written in the list */
+	unsigned char			cmd_pos[G2D_REG_NR];
 };
 
 enum g2d_base_addr_reg {
@@ -241,10 +246,16 @@ static int g2d_validate_blending_op(
  *
  * The caller has to make sure that the commands buffers have enough space
  * left to hold the command. Use g2d_check_space() to ensure this.
+ *
+ * Only the last value of a register before the blit starts matters, so a
+ * register written again within the same command list is updated in place
+ * rather than taking another slot.
  */
 static void g2d_add_cmd(struct g2d_context *ctx, unsigned long cmd,
 			unsigned long value)
 {
+	unsigned long reg = cmd / 4;
+
 	switch (cmd & ~(G2D_BUF_USERPTR)) {
 	case SRC_BASE_ADDR_REG:
 	case SRC_PLANE2_BASE_ADDR_REG:
@@ -259,11 +270,19 @@ static void g2d_add_cmd(struct g2d_context *ctx, unsigned long cmd,
 		ctx->cmd_buf_nr++;
 		break;
 	default:
+		if (reg < G2D_REG_NR && ctx->cmd_pos[reg]) {
+			ctx->cmd[ctx->cmd_pos[reg] - 1].data = value;
+			break;
+		}
+
 		assert(ctx->cmd_nr < G2D_MAX_CMD_NR);
 
 		ctx->cmd[ctx->cmd_nr].offset = cmd;
 		ctx->cmd[ctx->cmd_nr].data = value;
 		ctx->cmd_nr++;
+
+		if (reg < G2D_REG_NR)
+			ctx->cmd_pos[reg] = ctx->cmd_nr;
 		break;
 	}
 }
@@ -274,6 +293,11 @@ static void g2d_add_cmd(struct g2d_context *ctx, unsigned long cmd,
  * @ctx: a pointer to g2d_context structure.
  * @img: a pointer to the dst/src g2d_image structure.
  * @reg: the register that should be set.
+ *
+ * Userptr images are passed by address and size.  The kernel keeps the
+ * pages of previously used regions pinned and mapped, keyed on exactly
+ * that pair, so clients should keep reusing the same user_ptr[] values
+ * for long-lived buffers instead of varying the size or offset.
  */
 static void g2d_add_base_addr(struct g2d_context *ctx, struct g2d_image *img,
 			enum g2d_base_addr_reg reg)
@@ -312,15 +336,24 @@ static void g2d_set_direction(struct g2d_context *ctx,
  */
 static int g2d_flush(struct g2d_context *ctx)
 {
+	unsigned int i;
 	int ret;
 	struct drm_exynos_g2d_set_cmdlist cmdlist = {0};
 
 	if (ctx->cmd_nr == 0 && ctx->cmd_buf_nr == 0)
 		return 0;
 
+	/*
+	 * Each operation needs a command list of its own, as the kernel
+	 * appends the bitblt start command.  If the caller queued as many
+	 * as the kernel can take, execute those first rather than failing.
+	 */
 	if (ctx->cmdlist_nr >= G2D_MAX_CMD_LIST_NR) {
-		fprintf(stderr, MSG_PREFIX "command list overflow.\n");
-		return -EINVAL;
+		ret = g2d_exec2(ctx, 0);
+		if (ret < 0) {
+			fprintf(stderr, MSG_PREFIX "command list overflow.\n");
+			return ret;
+		}
 	}
 
 	cmdlist.cmd = (uint64_t)(uintptr_t)&ctx->cmd[0];
@@ -337,6 +370,17 @@ static int g2d_flush(struct g2d_context *ctx)
 		cmdlist.user_data = 0;
 	}
 
+	/*
+	 * The kernel clears all registers at the start of each command list,
+	 * so nothing can be carried over to the next one.
+	 */
+	for (i = 0; i < ctx->cmd_nr; i++) {
+		unsigned long reg = ctx->cmd[i].offset / 4;
+
+		if (reg < G2D_REG_NR)
+			ctx->cmd_pos[reg] = 0;
+	}
+
 	ctx->cmd_nr = 0;
 	ctx->cmd_buf_nr = 0;
 
@@ -411,6 +455,22 @@ drm_public void g2d_config_event(struct g2d_context *ctx, void *userdata)
  * @ctx: a pointer to g2d_context structure.
  */
 drm_public int g2d_exec(struct g2d_context *ctx)
+{
+	return g2d_exec2(ctx, 0);
+}
+
+/**
+ * g2d_exec2 - start the dma to process all commands summited by g2d_flush(),
+ *		optionally without waiting for them to complete.
+ *		With G2D_EXEC_ASYNC, completion is signalled by the events
+ *		requested through g2d_config_event().  Until then the
+ *		command lists stay allocated in the kernel, which has room
+ *		for G2D_MAX_CMD_LIST_NR of them.
+ *
+ * @ctx: a pointer to g2d_context structure.
+ * @flags: G2D_EXEC_ASYNC or zero.
+ */
+drm_public int g2d_exec2(struct g2d_context *ctx, unsigned int flags)
 {
 	struct drm_exynos_g2d_exec exec;
 	int ret;
@@ -418,7 +478,7 @@ drm_public int g2d_exec(struct g2d_context *ctx)
 	if (ctx->cmdlist_nr == 0)
 		return -EINVAL;
 
-	exec.async = 0;
+	exec.async = !!(flags & G2D_EXEC_ASYNC);
 
 	ret = drmIoctl(ctx->fd, DRM_IOCTL_EXYNOS_G2D_EXEC, &exec);
 	if (ret < 0) {
@@ -29,7 +29,6 @@
 #include "freedreno_drmif.h"
 #include "freedreno_priv.h"
 
-drm_private pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
 drm_private void bo_del(struct fd_bo *bo);
 
 /* set buffer name, and add to table, call w/ table_lock held: */
@@ -37,26 +36,35 @@ static void set_name(struct fd_bo *bo, uint32_t name)
 {
 	bo->name = name;
 	/* add ourself into the handle table: */
-	drmHashInsert(bo->dev->name_table, name, bo);
+	drmIntMapInsert(bo->dev->name_table, name, bo);
 }
 
 /* lookup a buffer, call w/ table_lock held: */
 static struct fd_bo * lookup_bo(void *tbl, uint32_t key)
 {
 	struct fd_bo *bo = NULL;
-	if (!drmHashLookup(tbl, key, (void **)&bo)) {
+	if (!drmIntMapLookup(tbl, key, (void **)&bo)) {
 		/* found, incr refcnt and return: */
 		bo = fd_bo_ref(bo);
 
-		/* don't break the bucket if this bo was found in one */
-		list_delinit(&bo->list);
+		/* don't break the bucket if this bo was found in one, and
+		 * take back the device reference cached bo's don't hold:
+		 */
+		if (drm_bo_cache_entry_is_cached(&bo->cache_entry)) {
+			struct fd_device *dev = bo->dev;
+
+			drm_bo_cache_remove(bo->bo_reuse == RING_CACHE ?
+					&dev->ring_cache : &dev->bo_cache,
+					&bo->cache_entry);
+			fd_device_ref(dev);
+		}
 	}
 	return bo;
 }
 
 /* allocate a new buffer object, call w/ table_lock held */
 static struct fd_bo * bo_from_handle(struct fd_device *dev,
-		uint32_t size, uint32_t handle)
+		uint32_t size, uint32_t handle, int imported)
 {
 	struct fd_bo *bo;
 
@@ -65,38 +73,52 @@ static struct fd_bo * bo_from_handle(struct fd_device *dev,
 		struct drm_gem_close req = {
 				.handle = handle,
 		};
+		drmPrimeCacheForget(dev->fd, handle);
 		drmIoctl(dev->fd, DRM_IOCTL_GEM_CLOSE, &req);
+		__atomic_store_n(&dev->close_seq, dev->close_seq + 1,
+				__ATOMIC_RELEASE);
 		return NULL;
 	}
 	bo->dev = fd_device_ref(dev);
 	bo->size = size;
 	bo->handle = handle;
+	bo->imported = imported;
+	bo->fence_state = (!imported && dev->track_fences) ?
+			FENCE_IDLE : FENCE_UNTRACKED;
 	atomic_set(&bo->refcnt, 1);
-	list_inithead(&bo->list);
+	drm_bo_cache_entry_init(&bo->cache_entry);
 	/* add ourself into the handle table: */
-	drmHashInsert(dev->handle_table, handle, bo);
+	drmIntMapInsert(dev->handle_table, handle, bo);
+	if (imported) {
+		dev->import_size += size;
+		dev->import_count++;
+	} else {
+		dev->alloc_size += size;
+		dev->alloc_count++;
+	}
 	return bo;
 }
 
 static struct fd_bo *
 bo_new(struct fd_device *dev, uint32_t size, uint32_t flags,
-		struct fd_bo_cache *cache)
+		struct drm_bo_cache *cache)
 {
 	struct fd_bo *bo = NULL;
 	uint32_t handle;
 	int ret;
 
-	bo = fd_bo_cache_alloc(cache, &size, flags);
+	bo = fd_bo_cache_alloc(dev, cache, &size, flags);
 	if (bo)
 		return bo;
 
+	flags &= ~DRM_FREEDRENO_GEM_ALLOC_FOR_RENDER;
 	ret = dev->funcs->bo_new_handle(dev, size, flags, &handle);
 	if (ret)
 		return NULL;
 
-	pthread_mutex_lock(&table_lock);
-	bo = bo_from_handle(dev, size, handle);
-	pthread_mutex_unlock(&table_lock);
+	pthread_mutex_lock(&dev->table_lock);
+	bo = bo_from_handle(dev, size, handle, FALSE);
+	pthread_mutex_unlock(&dev->table_lock);
 
 	VG_BO_ALLOC(bo);
 
@@ -131,18 +153,22 @@ fd_bo_from_handle(struct fd_device *dev, uint32_t handle, uint32_t size)
 {
 	struct fd_bo *bo = NULL;
 
-	pthread_mutex_lock(&table_lock);
+	pthread_mutex_lock(&dev->table_lock);
 
 	bo = lookup_bo(dev->handle_table, handle);
 	if (bo)
 		goto out_unlock;
 
-	bo = bo_from_handle(dev, size, handle);
+	bo = bo_from_handle(dev, size, handle, TRUE);
+	pthread_mutex_unlock(&dev->table_lock);
 
+	/* outside of the lock, this maps the bo under valgrind: */
 	VG_BO_ALLOC(bo);
 
+	return bo;
+
 out_unlock:
-	pthread_mutex_unlock(&table_lock);
+	pthread_mutex_unlock(&dev->table_lock);
 
 	return bo;
 }
@@ -150,14 +176,24 @@ out_unlock:
 drm_public struct fd_bo *
 fd_bo_from_dmabuf(struct fd_device *dev, int fd)
 {
-	int ret, size;
-	uint32_t handle;
+	uint32_t handle, seq;
+	uint64_t size;
 	struct fd_bo *bo;
+	int ret;
 
-	pthread_mutex_lock(&table_lock);
-	ret = drmPrimeFDToHandle(dev->fd, fd, &handle);
+	/* import without the lock, usually from the prime cache which also
+	 * knows the size.  fd_bo_del might close the returned handle before
+	 * we get the lock though, in that case redo the import with the
+	 * lock held:
+	 */
+	seq = __atomic_load_n(&dev->close_seq, __ATOMIC_ACQUIRE);
+	ret = drmPrimeFDToHandleCached(dev->fd, fd, &handle, &size);
+
+	pthread_mutex_lock(&dev->table_lock);
+	if (!ret && seq != dev->close_seq)
+		ret = drmPrimeFDToHandleCached(dev->fd, fd, &handle, &size);
 	if (ret) {
-		pthread_mutex_unlock(&table_lock);
+		pthread_mutex_unlock(&dev->table_lock);
 		return NULL;
 	}
 
@@ -165,16 +201,15 @@ fd_bo_from_dmabuf(struct fd_device *dev, int fd)
 	if (bo)
 		goto out_unlock;
 
-	/* lseek() to get bo size */
-	size = lseek(fd, 0, SEEK_END);
-	lseek(fd, 0, SEEK_CUR);
-
-	bo = bo_from_handle(dev, size, handle);
+	bo = bo_from_handle(dev, size, handle, TRUE);
+	pthread_mutex_unlock(&dev->table_lock);
 
 	VG_BO_ALLOC(bo);
 
+	return bo;
+
 out_unlock:
-	pthread_mutex_unlock(&table_lock);
+	pthread_mutex_unlock(&dev->table_lock);
 
 	return bo;
 }
@@ -186,7 +221,7 @@ drm_public struct fd_bo * fd_bo_from_name(struct fd_device *dev, uint32_t name)
 	};
 	struct fd_bo *bo;
 
-	pthread_mutex_lock(&table_lock);
+	pthread_mutex_lock(&dev->table_lock);
 
 	/* check name table first, to see if bo is already open: */
 	bo = lookup_bo(dev->name_table, name);
@@ -202,14 +237,17 @@ drm_public struct fd_bo * fd_bo_from_name(struct fd_device *dev, uint32_t name)
 	if (bo)
 		goto out_unlock;
 
-	bo = bo_from_handle(dev, req.size, req.handle);
-	if (bo) {
+	bo = bo_from_handle(dev, req.size, req.handle, TRUE);
+	if (bo)
 		set_name(bo, name);
-		VG_BO_ALLOC(bo);
-	}
+	pthread_mutex_unlock(&dev->table_lock);
+
+	VG_BO_ALLOC(bo);
+
+	return bo;
 
 out_unlock:
-	pthread_mutex_unlock(&table_lock);
+	pthread_mutex_unlock(&dev->table_lock);
 
 	return bo;
 }
@@ -237,7 +275,7 @@ drm_public void fd_bo_del(struct fd_bo *bo)
 	if (!atomic_dec_and_test(&bo->refcnt))
 		return;
 
-	pthread_mutex_lock(&table_lock);
+	pthread_mutex_lock(&dev->table_lock);
 
 	if ((bo->bo_reuse == BO_CACHE) && (fd_bo_cache_free(&dev->bo_cache, bo) == 0))
 		goto out;
@@ -245,9 +283,126 @@ drm_public void fd_bo_del(struct fd_bo *bo)
 		goto out;
 
 	bo_del(bo);
-	fd_device_del_locked(dev);
 out:
-	pthread_mutex_unlock(&table_lock);
+	pthread_mutex_unlock(&dev->table_lock);
+
+	/* neither deleted nor cached bo's hold a ref to the dev: */
+	fd_device_del(dev);
+}
+
+/* Called with fence_lock held */
+static void bo_fence_clear(struct fd_bo *bo, int state)
+{
+	if (bo->timeline)
+		fd_fence_timeline_put(bo->timeline);
+	bo->timeline = NULL;
+	bo->fence_state = state;
+}
+
+static int fence_passed(const struct fd_fence_timeline *timeline,
+		uint32_t fence)
+{
+	return timeline->signaled &&
+			(int32_t)(timeline->completed - fence) >= 0;
+}
+
+/* Backends which set track_fences report every successful submit here,
+ * with all of its bo's (NULL entries are skipped).  One fence can't cover
+ * submits on two pipes, so a bo submitted on another pipe while its last
+ * submit may still be running is left to the kernel until it is seen idle.
+ */
+drm_private void fd_bo_fence_submit(struct fd_pipe *pipe, struct fd_bo **bos,
+		uint32_t nr_bos, uint32_t fence)
+{
+	struct fd_fence_timeline *timeline = pipe->timeline;
+	uint32_t i;
+
+	pthread_mutex_lock(&pipe->dev->fence_lock);
+	for (i = 0; i < nr_bos; i++) {
+		struct fd_bo *bo = bos[i];
+
+		if (!bo)
+			continue;
+
+		switch (bo->fence_state) {
+		case FENCE_UNTRACKED:
+		case FENCE_UNKNOWN:
+			continue;
+		case FENCE_PENDING:
+			if (bo->timeline == timeline)
+				break;
+			if (!fence_passed(bo->timeline, bo->fence)) {
+				bo_fence_clear(bo, FENCE_UNKNOWN);
+				continue;
+			}
+			bo_fence_clear(bo, FENCE_IDLE);
+			/* fallthrough */
+		case FENCE_IDLE:
+			if (!timeline) {
+				bo->fence_state = FENCE_UNKNOWN;
+				continue;
+			}
+			timeline->refcnt++;
+			bo->timeline = timeline;
+			bo->fence_state = FENCE_PENDING;
+			break;
+		}
+		bo->fence = fence;
+	}
+	pthread_mutex_unlock(&pipe->dev->fence_lock);
+}
+
+/* Whether bo is known to be idle without asking the kernel: */
+drm_private int fd_bo_fence_idle(struct fd_bo *bo)
+{
+	int idle;
+
+	if (!bo->dev->track_fences)
+		return FALSE;
+
+	pthread_mutex_lock(&bo->dev->fence_lock);
+	if (bo->fence_state == FENCE_PENDING &&
+			fence_passed(bo->timeline, bo->fence))
+		bo_fence_clear(bo, FENCE_IDLE);
+	idle = bo->fence_state == FENCE_IDLE;
+	pthread_mutex_unlock(&bo->dev->fence_lock);
+
+	return idle;
+}
+
+/* The kernel found bo idle, so its last submit is done, and with it every
+ * earlier one on the same pipe:
+ */
+drm_private void fd_bo_fence_retire(struct fd_bo *bo)
+{
+	struct fd_fence_timeline *timeline;
+
+	if (!bo->dev->track_fences)
+		return;
+
+	pthread_mutex_lock(&bo->dev->fence_lock);
+	if (bo->fence_state == FENCE_PENDING) {
+		timeline = bo->timeline;
+		if (!fence_passed(timeline, bo->fence)) {
+			timeline->completed = bo->fence;
+			timeline->signaled = 1;
+		}
+		bo_fence_clear(bo, FENCE_IDLE);
+	} else if (bo->fence_state == FENCE_UNKNOWN) {
+		bo->fence_state = FENCE_IDLE;
+	}
+	pthread_mutex_unlock(&bo->dev->fence_lock);
+}
+
+/* Shared bo's can be busy with rendering we never see: */
+static void bo_fence_untrack(struct fd_bo *bo)
+{
+	if (!bo->dev->track_fences)
+		return;
+
+	pthread_mutex_lock(&bo->dev->fence_lock);
+	bo_fence_clear(bo, FENCE_UNTRACKED);
+	pthread_mutex_unlock(&bo->dev->fence_lock);
 }
 
 /* Called under table_lock */
@@ -255,8 +410,13 @@ drm_private void bo_del(struct fd_bo *bo)
 {
 	VG_BO_FREE(bo);
 
-	if (bo->map)
+	bo_fence_untrack(bo);
+
+	if (bo->map) {
 		drm_munmap(bo->map, bo->size);
+		bo->dev->map_size -= bo->size;
+		bo->dev->map_count--;
+	}
 
 	/* TODO probably bo's in bucket list get removed from
 	 * handle table??
@@ -266,10 +426,21 @@ drm_private void bo_del(struct fd_bo *bo)
 		struct drm_gem_close req = {
 				.handle = bo->handle,
 		};
-		drmHashDelete(bo->dev->handle_table, bo->handle);
+		drmIntMapDelete(bo->dev->handle_table, bo->handle);
 		if (bo->name)
-			drmHashDelete(bo->dev->name_table, bo->name);
+			drmIntMapDelete(bo->dev->name_table, bo->name);
+		drmPrimeCacheForget(bo->dev->fd, bo->handle);
 		drmIoctl(bo->dev->fd, DRM_IOCTL_GEM_CLOSE, &req);
+		__atomic_store_n(&bo->dev->close_seq, bo->dev->close_seq + 1,
+				__ATOMIC_RELEASE);
+
+		if (bo->imported) {
+			bo->dev->import_size -= bo->size;
+			bo->dev->import_count--;
+		} else {
+			bo->dev->alloc_size -= bo->size;
+			bo->dev->alloc_count--;
+		}
 	}
 
 	bo->funcs->destroy(bo);
@@ -288,10 +459,11 @@ drm_public int fd_bo_get_name(struct fd_bo *bo, uint32_t *name)
 			return ret;
 		}
 
-		pthread_mutex_lock(&table_lock);
+		pthread_mutex_lock(&bo->dev->table_lock);
 		set_name(bo, req.name);
-		pthread_mutex_unlock(&table_lock);
+		pthread_mutex_unlock(&bo->dev->table_lock);
 		bo->bo_reuse = NO_CACHE;
+		bo_fence_untrack(bo);
 	}
 
 	*name = bo->name;
@@ -316,6 +488,7 @@ drm_public int fd_bo_dmabuf(struct fd_bo *bo)
 	}
 
 	bo->bo_reuse = NO_CACHE;
+	bo_fence_untrack(bo);
 
 	return prime_fd;
 }
@@ -328,7 +501,9 @@ drm_public uint32_t fd_bo_size(struct fd_bo *bo)
 drm_public void * fd_bo_map(struct fd_bo *bo)
 {
 	if (!bo->map) {
+		struct fd_device *dev = bo->dev;
 		uint64_t offset;
+		void *map;
 		int ret;
 
 		ret = bo->funcs->offset(bo, &offset);
@@ -336,12 +511,23 @@ drm_public void * fd_bo_map(struct fd_bo *bo)
 			return NULL;
 		}
 
-		bo->map = drm_mmap(0, bo->size, PROT_READ | PROT_WRITE, MAP_SHARED,
-				bo->dev->fd, offset);
-		if (bo->map == MAP_FAILED) {
+		map = drm_mmap(0, bo->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+				dev->fd, offset);
+		if (map == MAP_FAILED) {
 			ERROR_MSG("mmap failed: %s", strerror(errno));
-			bo->map = NULL;
+			return NULL;
+		}
+
+		pthread_mutex_lock(&dev->table_lock);
+		if (bo->map) {
+			/* another thread mapped it meanwhile: */
+			drm_munmap(map, bo->size);
+		} else {
+			bo->map = map;
+			dev->map_size += bo->size;
+			dev->map_count++;
 		}
+		pthread_mutex_unlock(&dev->table_lock);
 	}
 	return bo->map;
 }
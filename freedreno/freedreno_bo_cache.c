@@ -30,191 +30,92 @@
 #include "freedreno_priv.h"
 
 drm_private void bo_del(struct fd_bo *bo);
-drm_private extern pthread_mutex_t table_lock;
 
-static void
-add_bucket(struct fd_bo_cache *cache, int size)
+/* Known idle from the fences its submits got, or else ask the kernel: */
+static int fd_bo_cache_busy(struct drm_bo_cache_entry *entry)
 {
-	unsigned int i = cache->num_buckets;
+	struct fd_bo *bo = LIST_ENTRY(struct fd_bo, entry, cache_entry);
+	int busy;
 
-	assert(i < ARRAY_SIZE(cache->cache_bucket));
+	if (fd_bo_fence_idle(bo))
+		return 0;
 
-	list_inithead(&cache->cache_bucket[i].list);
-	cache->cache_bucket[i].size = size;
-	cache->num_buckets++;
-}
+	busy = fd_bo_cpu_prep(bo, NULL,
+			DRM_FREEDRENO_PREP_READ |
+			DRM_FREEDRENO_PREP_WRITE |
+			DRM_FREEDRENO_PREP_NOSYNC) != 0;
+	if (!busy)
+		fd_bo_fence_retire(bo);
 
-/**
- * @coarse: if true, only power-of-two bucket sizes, otherwise
- *    fill in for a bit smoother size curve..
- */
-drm_private void
-fd_bo_cache_init(struct fd_bo_cache *cache, int coarse)
-{
-	unsigned long size, cache_max_size = 64 * 1024 * 1024;
-
-	/* OK, so power of two buckets was too wasteful of memory.
-	 * Give 3 other sizes between each power of two, to hopefully
-	 * cover things accurately enough.  (The alternative is
-	 * probably to just go for exact matching of sizes, and assume
-	 * that for things like composited window resize the tiled
-	 * width/height alignment and rounding of sizes to pages will
-	 * get us useful cache hit rates anyway)
-	 */
-	add_bucket(cache, 4096);
-	add_bucket(cache, 4096 * 2);
-	if (!coarse)
-		add_bucket(cache, 4096 * 3);
-
-	/* Initialize the linked lists for BO reuse cache. */
-	for (size = 4 * 4096; size <= cache_max_size; size *= 2) {
-		add_bucket(cache, size);
-		if (!coarse) {
-			add_bucket(cache, size + size * 1 / 4);
-			add_bucket(cache, size + size * 2 / 4);
-			add_bucket(cache, size + size * 3 / 4);
-		}
-	}
+	return busy;
 }
 
-/* Frees older cached buffers.  Called under table_lock */
-drm_private void
-fd_bo_cache_cleanup(struct fd_bo_cache *cache, time_t time)
+static int fd_bo_cache_madvise(struct drm_bo_cache_entry *entry, int willneed)
 {
-	int i;
-
-	if (cache->time == time)
-		return;
+	struct fd_bo *bo = LIST_ENTRY(struct fd_bo, entry, cache_entry);
 
-	for (i = 0; i < cache->num_buckets; i++) {
-		struct fd_bo_bucket *bucket = &cache->cache_bucket[i];
-		struct fd_bo *bo;
-
-		while (!LIST_IS_EMPTY(&bucket->list)) {
-			bo = LIST_ENTRY(struct fd_bo, bucket->list.next, list);
-
-			/* keep things in cache for at least 1 second: */
-			if (time && ((time - bo->free_time) <= 1))
-				break;
-
-			VG_BO_OBTAIN(bo);
-			list_del(&bo->list);
-			bo_del(bo);
-		}
-	}
-
-	cache->time = time;
+	return bo->funcs->madvise(bo, willneed);
 }
 
-static struct fd_bo_bucket * get_bucket(struct fd_bo_cache *cache, uint32_t size)
+static void fd_bo_cache_destroy(struct drm_bo_cache_entry *entry)
 {
-	int i;
-
-	/* hmm, this is what intel does, but I suppose we could calculate our
-	 * way to the correct bucket size rather than looping..
-	 */
-	for (i = 0; i < cache->num_buckets; i++) {
-		struct fd_bo_bucket *bucket = &cache->cache_bucket[i];
-		if (bucket->size >= size) {
-			return bucket;
-		}
-	}
+	struct fd_bo *bo = LIST_ENTRY(struct fd_bo, entry, cache_entry);
 
-	return NULL;
+	VG_BO_OBTAIN(bo);
+	bo_del(bo);
 }
 
-static int is_idle(struct fd_bo *bo)
-{
-	return fd_bo_cpu_prep(bo, NULL,
-			DRM_FREEDRENO_PREP_READ |
-			DRM_FREEDRENO_PREP_WRITE |
-			DRM_FREEDRENO_PREP_NOSYNC) == 0;
-}
+static const struct drm_bo_cache_funcs fd_bo_cache_funcs = {
+	.busy = fd_bo_cache_busy,
+	.madvise = fd_bo_cache_madvise,
+	.destroy = fd_bo_cache_destroy,
+};
 
-static struct fd_bo *find_in_bucket(struct fd_bo_bucket *bucket, uint32_t flags)
+drm_private void
+fd_bo_cache_init(struct drm_bo_cache *cache, int coarse)
 {
-	struct fd_bo *bo = NULL;
-
-	/* TODO .. if we had an ALLOC_FOR_RENDER flag like intel, we could
-	 * skip the busy check.. if it is only going to be a render target
-	 * then we probably don't need to stall..
-	 *
-	 * NOTE that intel takes ALLOC_FOR_RENDER bo's from the list tail
-	 * (MRU, since likely to be in GPU cache), rather than head (LRU)..
-	 */
-	pthread_mutex_lock(&table_lock);
-	if (!LIST_IS_EMPTY(&bucket->list)) {
-		bo = LIST_ENTRY(struct fd_bo, bucket->list.next, list);
-		/* TODO check for compatible flags? */
-		if (is_idle(bo)) {
-			list_del(&bo->list);
-		} else {
-			bo = NULL;
-		}
-	}
-	pthread_mutex_unlock(&table_lock);
-
-	return bo;
+	drm_bo_cache_init(cache, coarse, &fd_bo_cache_funcs);
 }
 
-/* NOTE: size is potentially rounded up to bucket size: */
+/* NOTE: size is potentially rounded up to bucket size, unless the cache
+ * has a tolerance for reusing bigger bo's:
+ */
 drm_private struct fd_bo *
-fd_bo_cache_alloc(struct fd_bo_cache *cache, uint32_t *size, uint32_t flags)
+fd_bo_cache_alloc(struct fd_device *dev, struct drm_bo_cache *cache,
+		uint32_t *size, uint32_t flags)
 {
+	struct drm_bo_cache_entry *entry;
 	struct fd_bo *bo = NULL;
-	struct fd_bo_bucket *bucket;
-
-	*size = ALIGN(*size, 4096);
-	bucket = get_bucket(cache, *size);
-
-	/* see if we can be green and recycle: */
-retry:
-	if (bucket) {
-		*size = bucket->size;
-		bo = find_in_bucket(bucket, flags);
-		if (bo) {
-			VG_BO_OBTAIN(bo);
-			if (bo->funcs->madvise(bo, TRUE) <= 0) {
-				/* we've lost the backing pages, delete and try again: */
-				pthread_mutex_lock(&table_lock);
-				bo_del(bo);
-				pthread_mutex_unlock(&table_lock);
-				goto retry;
-			}
-			atomic_set(&bo->refcnt, 1);
-			fd_device_ref(bo->dev);
-			return bo;
-		}
+	uint64_t bo_size = ALIGN(*size, 4096);
+
+	pthread_mutex_lock(&dev->table_lock);
+	entry = drm_bo_cache_get(cache, &bo_size, 0,
+			flags & DRM_FREEDRENO_GEM_ALLOC_FOR_RENDER);
+	if (entry) {
+		bo = LIST_ENTRY(struct fd_bo, entry, cache_entry);
+		VG_BO_OBTAIN(bo);
+		atomic_set(&bo->refcnt, 1);
+		fd_device_ref(bo->dev);
 	}
+	pthread_mutex_unlock(&dev->table_lock);
+
+	*size = bo_size;
 
-	return NULL;
+	return bo;
 }
 
+/* Called under table_lock */
 drm_private int
-fd_bo_cache_free(struct fd_bo_cache *cache, struct fd_bo *bo)
+fd_bo_cache_free(struct drm_bo_cache *cache, struct fd_bo *bo)
 {
-	struct fd_bo_bucket *bucket = get_bucket(cache, bo->size);
+	struct timespec time;
 
 	/* see if we can be green and recycle: */
-	if (bucket) {
-		struct timespec time;
-
-		bo->funcs->madvise(bo, FALSE);
-
-		clock_gettime(CLOCK_MONOTONIC, &time);
+	if (!drm_bo_cache_bucket(cache, bo->size))
+		return -1;
 
-		bo->free_time = time.tv_sec;
-		VG_BO_RELEASE(bo);
-		list_addtail(&bo->list, &bucket->list);
-		fd_bo_cache_cleanup(cache, time.tv_sec);
-
-		/* bo's in the bucket cache don't have a ref and
-		 * don't hold a ref to the dev:
-		 */
-		fd_device_del_locked(bo->dev);
-
-		return 0;
-	}
+	clock_gettime(CLOCK_MONOTONIC, &time);
 
-	return -1;
+	VG_BO_RELEASE(bo);
+	return drm_bo_cache_put(cache, &bo->cache_entry, bo->size, time.tv_sec);
 }
@@ -33,8 +33,6 @@
 #include "freedreno_drmif.h"
 #include "freedreno_priv.h"
 
-static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
-
 struct fd_device * kgsl_device_new(int fd);
 struct fd_device * msm_device_new(int fd);
 
@@ -79,8 +77,10 @@ out:
 
 	atomic_set(&dev->refcnt, 1);
 	dev->fd = fd;
-	dev->handle_table = drmHashCreate();
-	dev->name_table = drmHashCreate();
+	dev->handle_table = drmIntMapCreate();
+	dev->name_table = drmIntMapCreate();
+	pthread_mutex_init(&dev->table_lock, NULL);
+	pthread_mutex_init(&dev->fence_lock, NULL);
 	fd_bo_cache_init(&dev->bo_cache, FALSE);
 	fd_bo_cache_init(&dev->ring_cache, TRUE);
 
@@ -107,31 +107,83 @@ drm_public struct fd_device * fd_device_ref(struct fd_device *dev)
 	return dev;
 }
 
-static void fd_device_del_impl(struct fd_device *dev)
+/* The lock lives in the device, so references to it are never dropped
+ * with table_lock held.
+ */
+drm_public void fd_device_del(struct fd_device *dev)
 {
-	int close_fd = dev->closefd ? dev->fd : -1;
-	fd_bo_cache_cleanup(&dev->bo_cache, 0);
-	drmHashDestroy(dev->handle_table);
-	drmHashDestroy(dev->name_table);
+	int close_fd;
+
+	if (!atomic_dec_and_test(&dev->refcnt))
+		return;
+
+	close_fd = dev->closefd ? dev->fd : -1;
+
+	pthread_mutex_lock(&dev->table_lock);
+	drm_bo_cache_cleanup(&dev->bo_cache, 0);
+	pthread_mutex_unlock(&dev->table_lock);
+
+	pthread_mutex_destroy(&dev->table_lock);
+	pthread_mutex_destroy(&dev->fence_lock);
+	drmIntMapDestroy(dev->handle_table);
+	drmIntMapDestroy(dev->name_table);
 	dev->funcs->destroy(dev);
 	if (close_fd >= 0)
 		close(close_fd);
 }
 
-drm_private void fd_device_del_locked(struct fd_device *dev)
+/* Let the bo cache reuse bo's up to percent larger than requested, rather
+ * than rounding allocations up to the bucket size.  0 restores rounding.
+ */
+drm_public void fd_device_set_bo_cache_tolerance(struct fd_device *dev,
+		int percent)
 {
-	if (!atomic_dec_and_test(&dev->refcnt))
-		return;
-	fd_device_del_impl(dev);
+	pthread_mutex_lock(&dev->table_lock);
+	dev->bo_cache.tolerance = percent > 0 ? percent : 0;
+	pthread_mutex_unlock(&dev->table_lock);
 }
 
-drm_public void fd_device_del(struct fd_device *dev)
+/* Cap the bytes held in the bo cache, freeing the oldest cached bo's
+ * beyond it.  0 (the default) leaves the cache unbounded.
+ */
+drm_public void fd_device_set_bo_cache_budget(struct fd_device *dev,
+		uint64_t bytes)
 {
-	if (!atomic_dec_and_test(&dev->refcnt))
-		return;
-	pthread_mutex_lock(&table_lock);
-	fd_device_del_impl(dev);
-	pthread_mutex_unlock(&table_lock);
+	pthread_mutex_lock(&dev->table_lock);
+	dev->bo_cache.budget = bytes;
+	if (bytes)
+		drm_bo_cache_trim(&dev->bo_cache, bytes);
+	pthread_mutex_unlock(&dev->table_lock);
+}
+
+/* Free the oldest cached bo's until no more than bytes are left, eg.
+ * when the system is under memory pressure.
+ */
+drm_public void fd_device_bo_cache_trim(struct fd_device *dev,
+		uint64_t bytes)
+{
+	pthread_mutex_lock(&dev->table_lock);
+	drm_bo_cache_trim(&dev->bo_cache, bytes);
+	pthread_mutex_unlock(&dev->table_lock);
+}
+
+/* Fill in the memory held through the device.  Bo's in the bo cache count
+ * as allocated too, bo's opened from a handle, flink name or dmabuf only
+ * as imported.
+ */
+drm_public void fd_device_get_bo_stats(struct fd_device *dev,
+		drmBOStatsPtr stats)
+{
+	pthread_mutex_lock(&dev->table_lock);
+	stats->allocated_bytes = dev->alloc_size;
+	stats->allocated_count = dev->alloc_count;
+	stats->cached_bytes = dev->bo_cache.size + dev->ring_cache.size;
+	stats->cached_count = dev->bo_cache.count + dev->ring_cache.count;
+	stats->mapped_bytes = dev->map_size;
+	stats->mapped_count = dev->map_count;
+	stats->imported_bytes = dev->import_size;
+	stats->imported_count = dev->import_count;
+	pthread_mutex_unlock(&dev->table_lock);
 }
 
 drm_public int fd_device_fd(struct fd_device *dev)
@@ -75,6 +75,8 @@ enum fd_param_id {
 #define DRM_FREEDRENO_GEM_CACHE_WBACKWA   0x00800000
 #define DRM_FREEDRENO_GEM_CACHE_MASK      0x00f00000
 #define DRM_FREEDRENO_GEM_GPUREADONLY     0x01000000
+/* only used by the bo cache, not passed to the kernel: */
+#define DRM_FREEDRENO_GEM_ALLOC_FOR_RENDER 0x80000000
 
 /* bo access flags: (keep aligned to MSM_PREP_x) */
 #define DRM_FREEDRENO_PREP_READ           0x01
@@ -89,6 +91,10 @@ struct fd_device * fd_device_new_dup(int fd);
 struct fd_device * fd_device_ref(struct fd_device *dev);
 void fd_device_del(struct fd_device *dev);
 int fd_device_fd(struct fd_device *dev);
+void fd_device_set_bo_cache_tolerance(struct fd_device *dev, int percent);
+void fd_device_set_bo_cache_budget(struct fd_device *dev, uint64_t bytes);
+void fd_device_bo_cache_trim(struct fd_device *dev, uint64_t bytes);
+void fd_device_get_bo_stats(struct fd_device *dev, drmBOStatsPtr stats);
 
 enum fd_version {
 	FD_VERSION_MADVISE = 1,            /* kernel supports madvise */
@@ -112,6 +118,18 @@ int fd_pipe_wait(struct fd_pipe *pipe, uint32_t timestamp);
 /* timeout in nanosec */
 int fd_pipe_wait_timeout(struct fd_pipe *pipe, uint32_t timestamp,
 		uint64_t timeout);
+/* wait for several timestamps of the same pipe, either all of them
+ * or (wait_all == 0) any one of them.  timeout in nanosec
+ */
+int fd_pipe_wait_timestamps(struct fd_pipe *pipe, const uint32_t *timestamps,
+		uint32_t count, int wait_all, uint64_t timeout);
+
+/* wait for sync_file fence fd's, as returned by fd_ringbuffer_flush2(),
+ * which may belong to different pipes or devices.  Returns the index of
+ * a signalled fence (0 if wait_all), or -ETIMEDOUT.  timeout in nanosec
+ */
+int fd_fence_wait(const int *fence_fds, uint32_t count, int wait_all,
+		uint64_t timeout);
 
 
 /* buffer-object functions:
@@ -26,6 +26,9 @@
  *    Rob Clark <robclark@freedesktop.org>
  */
 
+#include <poll.h>
+#include <time.h>
+
 #include "freedreno_drmif.h"
 #include "freedreno_priv.h"
 
@@ -59,6 +62,11 @@ fd_pipe_new2(struct fd_device *dev, enum fd_pipe_id id, uint32_t prio)
 	pipe->id = id;
 	atomic_set(&pipe->refcnt, 1);
 
+	/* without one the pipe's bo's are simply left to the kernel: */
+	pipe->timeline = calloc(1, sizeof(*pipe->timeline));
+	if (pipe->timeline)
+		pipe->timeline->refcnt = 1;
+
 	fd_pipe_get_param(pipe, FD_GPU_ID, &val);
 	pipe->gpu_id = val;
 
@@ -81,9 +89,38 @@ drm_public void fd_pipe_del(struct fd_pipe *pipe)
 {
 	if (!atomic_dec_and_test(&pipe->refcnt))
 		return;
+	if (pipe->timeline) {
+		pthread_mutex_lock(&pipe->dev->fence_lock);
+		fd_fence_timeline_put(pipe->timeline);
+		pthread_mutex_unlock(&pipe->dev->fence_lock);
+	}
 	pipe->funcs->destroy(pipe);
 }
 
+/* Called with fence_lock held */
+drm_private void fd_fence_timeline_put(struct fd_fence_timeline *timeline)
+{
+	if (--timeline->refcnt == 0)
+		free(timeline);
+}
+
+/* A wait on the pipe found fence done, and with it all before it: */
+drm_private void fd_pipe_fence_signal(struct fd_pipe *pipe, uint32_t fence)
+{
+	struct fd_fence_timeline *timeline = pipe->timeline;
+
+	if (!timeline || !pipe->dev->track_fences)
+		return;
+
+	pthread_mutex_lock(&pipe->dev->fence_lock);
+	if (!timeline->signaled ||
+			(int32_t)(fence - timeline->completed) > 0) {
+		timeline->completed = fence;
+		timeline->signaled = 1;
+	}
+	pthread_mutex_unlock(&pipe->dev->fence_lock);
+}
+
 drm_public int fd_pipe_get_param(struct fd_pipe *pipe,
 				 enum fd_param_id param, uint64_t *value)
 {
@@ -98,5 +135,126 @@ drm_public int fd_pipe_wait(struct fd_pipe *pipe, uint32_t timestamp)
 drm_public int fd_pipe_wait_timeout(struct fd_pipe *pipe, uint32_t timestamp,
 		uint64_t timeout)
 {
-	return pipe->funcs->wait(pipe, timestamp, timeout);
+	int ret = pipe->funcs->wait(pipe, timestamp, timeout);
+	if (!ret)
+		fd_pipe_fence_signal(pipe, timestamp);
+	return ret;
+}
+
+/* timestamps of a pipe signal in order, so waiting for all of them is
+ * waiting for the newest one, and for any of them the oldest one:
+ */
+drm_public int fd_pipe_wait_timestamps(struct fd_pipe *pipe,
+		const uint32_t *timestamps, uint32_t count, int wait_all,
+		uint64_t timeout)
+{
+	uint32_t i, target;
+	int ret;
+
+	if (!count)
+		return 0;
+
+	target = timestamps[0];
+	for (i = 1; i < count; i++) {
+		int32_t d = (int32_t)(timestamps[i] - target);
+		if (wait_all ? d > 0 : d < 0)
+			target = timestamps[i];
+	}
+
+	ret = pipe->funcs->wait(pipe, target, timeout);
+	if (!ret)
+		fd_pipe_fence_signal(pipe, target);
+	return ret;
+}
+
+static int64_t fence_wait_remaining(const struct timespec *end)
+{
+	struct timespec t;
+	int64_t ms;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	ms = (end->tv_sec - t.tv_sec) * 1000 +
+			(end->tv_nsec - t.tv_nsec) / 1000000;
+
+	return ms < 0 ? 0 : ms;
+}
+
+drm_public int fd_fence_wait(const int *fence_fds, uint32_t count,
+		int wait_all, uint64_t timeout)
+{
+	struct pollfd stack_fds[16], *fds = stack_fds;
+	struct timespec end;
+	uint32_t i, pending = count;
+	int ret = 0;
+
+	if (!count)
+		return 0;
+
+	if (count > ARRAY_SIZE(stack_fds)) {
+		fds = malloc(count * sizeof(*fds));
+		if (!fds)
+			return -ENOMEM;
+	}
+
+	for (i = 0; i < count; i++) {
+		fds[i].fd = fence_fds[i];
+		fds[i].events = POLLIN;
+		fds[i].revents = 0;
+	}
+
+	/* same "~0 is forever" convention as fd_pipe_wait(): */
+	if (timeout != ~0ULL) {
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		end.tv_sec += timeout / 1000000000;
+		end.tv_nsec += timeout % 1000000000;
+		if (end.tv_nsec >= 1000000000) {
+			end.tv_sec++;
+			end.tv_nsec -= 1000000000;
+		}
+	}
+
+	while (pending) {
+		int ms = -1;
+
+		if (timeout != ~0ULL)
+			ms = MIN2(fence_wait_remaining(&end), INT32_MAX);
+
+		ret = poll(fds, count, ms);
+		if (ret < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			ret = -errno;
+			break;
+		}
+		if (ret == 0) {
+			ret = -ETIMEDOUT;
+			break;
+		}
+
+		for (i = 0; i < count; i++) {
+			if (!fds[i].revents)
+				continue;
+
+			if (fds[i].revents & (POLLERR | POLLNVAL)) {
+				ret = -EINVAL;
+				goto out;
+			}
+
+			if (!wait_all) {
+				ret = i;
+				goto out;
+			}
+
+			/* negative fd's are ignored by poll(): */
+			fds[i].fd = -1;
+			fds[i].revents = 0;
+			pending--;
+		}
+		ret = 0;
+	}
+
+out:
+	if (fds != stack_fds)
+		free(fds);
+	return ret;
 }
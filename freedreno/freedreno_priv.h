@@ -46,6 +46,7 @@
 
 #include "util_double_list.h"
 #include "util_math.h"
+#include "drm_bo_cache.h"
 
 #include "freedreno_drmif.h"
 #include "freedreno_ringbuffer.h"
@@ -68,17 +69,6 @@ struct fd_device_funcs {
 	void (*destroy)(struct fd_device *dev);
 };
 
-struct fd_bo_bucket {
-	uint32_t size;
-	struct list_head list;
-};
-
-struct fd_bo_cache {
-	struct fd_bo_bucket cache_bucket[14 * 4];
-	int num_buckets;
-	time_t time;
-};
-
 struct fd_device {
 	int fd;
 	enum fd_version version;
@@ -95,10 +85,34 @@ struct fd_device {
 	 */
 	void *handle_table, *name_table;
 
+	/* protects the tables above and both bo caches.  Per device, so that
+	 * unrelated devices don't contend (neither table is shared across
+	 * devices, flink names are looked up per device too):
+	 */
+	pthread_mutex_t table_lock;
+
+	/* protects the submit fences of bo's and the pipe timelines they
+	 * point at, nests inside table_lock:
+	 */
+	pthread_mutex_t fence_lock;
+	int track_fences;   /* backend reports submits to fd_bo_fence_submit() */
+
 	const struct fd_device_funcs *funcs;
 
-	struct fd_bo_cache bo_cache;
-	struct fd_bo_cache ring_cache;
+	struct drm_bo_cache bo_cache;
+	struct drm_bo_cache ring_cache;
+
+	/* bo's in the handle table, and their CPU mappings, for
+	 * fd_device_get_bo_stats().  Protected by table_lock:
+	 */
+	uint64_t alloc_size, import_size, map_size;
+	uint32_t alloc_count, import_count, map_count;
+
+	/* bumped under table_lock for every GEM handle closed, so that a
+	 * dma-buf import done without the lock can tell whether its handle
+	 * may have been closed in the meantime:
+	 */
+	uint32_t close_seq;
 
 	int closefd;        /* call close(fd) upon destruction */
 
@@ -106,31 +120,45 @@ struct fd_device {
 	int bo_size;
 };
 
-drm_private void fd_bo_cache_init(struct fd_bo_cache *cache, int coarse);
-drm_private void fd_bo_cache_cleanup(struct fd_bo_cache *cache, time_t time);
-drm_private struct fd_bo * fd_bo_cache_alloc(struct fd_bo_cache *cache,
-		uint32_t *size, uint32_t flags);
-drm_private int fd_bo_cache_free(struct fd_bo_cache *cache, struct fd_bo *bo);
-
-/* for where @table_lock is already held: */
-drm_private void fd_device_del_locked(struct fd_device *dev);
+drm_private void fd_bo_cache_init(struct drm_bo_cache *cache, int coarse);
+drm_private struct fd_bo * fd_bo_cache_alloc(struct fd_device *dev,
+		struct drm_bo_cache *cache, uint32_t *size, uint32_t flags);
+drm_private int fd_bo_cache_free(struct drm_bo_cache *cache, struct fd_bo *bo);
 
 struct fd_pipe_funcs {
 	struct fd_ringbuffer * (*ringbuffer_new)(struct fd_pipe *pipe, uint32_t size,
 			enum fd_ringbuffer_flags flags);
 	int (*get_param)(struct fd_pipe *pipe, enum fd_param_id param, uint64_t *value);
 	int (*wait)(struct fd_pipe *pipe, uint32_t timestamp, uint64_t timeout);
+	/* optional, wait for queued submits to reach the kernel: */
+	void (*drain)(struct fd_pipe *pipe);
 	void (*destroy)(struct fd_pipe *pipe);
 };
 
+/* Fences of a pipe known to be done.  They signal in order, so a bo whose
+ * last submit was on the pipe is idle once its fence is at or before
+ * completed.  Refcounted under fence_lock by the pipe and the bo's pointing
+ * at it, so it outlives the pipe:
+ */
+struct fd_fence_timeline {
+	int refcnt;
+	int signaled;       /* completed is only valid once set */
+	uint32_t completed;
+};
+
+drm_private void fd_fence_timeline_put(struct fd_fence_timeline *timeline);
+
 struct fd_pipe {
 	struct fd_device *dev;
 	enum fd_pipe_id id;
 	uint32_t gpu_id;
 	atomic_t refcnt;
 	const struct fd_pipe_funcs *funcs;
+	struct fd_fence_timeline *timeline;
 };
 
+drm_private void fd_pipe_fence_signal(struct fd_pipe *pipe, uint32_t fence);
+
 struct fd_ringbuffer_funcs {
 	void * (*hostptr)(struct fd_ringbuffer *ring);
 	int (*flush)(struct fd_ringbuffer *ring, uint32_t *last_start,
@@ -169,10 +197,28 @@ struct fd_bo {
 		RING_CACHE = 2,
 	} bo_reuse;
 
-	struct list_head list;   /* bucket-list entry */
-	time_t free_time;        /* time when added to bucket-list */
+	int imported;       /* opened from a handle, flink name or dmabuf */
+
+	/* the last submit the bo was part of, so that the bo cache can tell
+	 * it idle without asking the kernel.  Protected by dev->fence_lock:
+	 */
+	enum {
+		FENCE_UNTRACKED = 0, /* always ask the kernel */
+		FENCE_IDLE,          /* in no submit since it was last idle */
+		FENCE_PENDING,       /* last submitted at fence on timeline */
+		FENCE_UNKNOWN,       /* submitted on more than one pipe */
+	} fence_state;
+	struct fd_fence_timeline *timeline;
+	uint32_t fence;
+
+	struct drm_bo_cache_entry cache_entry;
 };
 
+drm_private void fd_bo_fence_submit(struct fd_pipe *pipe, struct fd_bo **bos,
+		uint32_t nr_bos, uint32_t fence);
+drm_private int fd_bo_fence_idle(struct fd_bo *bo);
+drm_private void fd_bo_fence_retire(struct fd_bo *bo);
+
 drm_private struct fd_bo *fd_bo_new_ring(struct fd_device *dev,
 		uint32_t size, uint32_t flags);
 
@@ -226,7 +272,7 @@ static inline void VG_BO_FREE(struct fd_bo *bo)
  * doesn't attribute ownership to the first one to allocate the recycled
  * bo.
  *
- * Note that the list_head in fd_bo is used to track the buffers in cache
+ * Note that the cache_entry in fd_bo is used to track the buffers in cache
  * so disable error reporting on the range while they are in cache so
  * valgrind doesn't squawk about list traversal.
  *
@@ -129,6 +129,7 @@ drm_public void fd_ringbuffer_grow(struct fd_ringbuffer *ring, uint32_t ndwords)
 	if (ring->size < 0x100000)
 		ring->size *= 2;
 
+	/* which is a hint, the backend can settle on another size: */
 	ring->funcs->grow(ring, ring->size);
 
 	ring->start = ring->funcs->hostptr(ring);
@@ -139,6 +140,11 @@ drm_public void fd_ringbuffer_grow(struct fd_ringbuffer *ring, uint32_t ndwords)
 
 drm_public uint32_t fd_ringbuffer_timestamp(struct fd_ringbuffer *ring)
 {
+	/* with async submit, the timestamp is only known once the
+	 * submit has been through the kernel:
+	 */
+	if (ring->pipe->funcs->drain)
+		ring->pipe->funcs->drain(ring->pipe);
 	return ring->last_timestamp;
 }
 
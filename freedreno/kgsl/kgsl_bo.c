@@ -77,26 +77,43 @@ static int kgsl_bo_offset(struct fd_bo *bo, uint64_t *offset)
 	return 0;
 }
 
+/* is the bo still referenced by cmdstream that hasn't retired? */
+static int kgsl_bo_is_pending(struct kgsl_bo *kgsl_bo)
+{
+	unsigned i;
+
+	for (i = 0; i < ARRAY_SIZE(kgsl_bo->list); i++)
+		if (!LIST_IS_EMPTY(&kgsl_bo->list[i]))
+			return 1;
+
+	return 0;
+}
+
 static int kgsl_bo_cpu_prep(struct fd_bo *bo, struct fd_pipe *pipe, uint32_t op)
 {
-	uint32_t timestamp = kgsl_bo_get_timestamp(to_kgsl_bo(bo));
+	struct kgsl_bo *kgsl_bo = to_kgsl_bo(bo);
+	uint32_t timestamp;
+
+	if ((op & DRM_FREEDRENO_PREP_NOSYNC) && !pipe) {
+		/* is_idle() from the bo-cache: every submit holds a reference
+		 * on its bo's until its timestamp has been seen to pass, and
+		 * shared bo's are never cached, so only bo's still on one of
+		 * the pipes' lists can be busy:
+		 */
+		return kgsl_bo_is_pending(kgsl_bo) ? -EBUSY : 0;
+	}
+
+	timestamp = kgsl_bo_get_timestamp(kgsl_bo);
 
 	if (op & DRM_FREEDRENO_PREP_NOSYNC) {
 		uint32_t current;
 		int ret;
 
-		/* special case for is_idle().. we can't really handle that
-		 * properly in kgsl (perhaps we need a way to just disable
-		 * the bo-cache for kgsl?)
-		 */
-		if (!pipe)
-			return -EBUSY;
-
 		ret = kgsl_pipe_timestamp(to_kgsl_pipe(pipe), &current);
 		if (ret)
 			return ret;
 
-		if (timestamp > current)
+		if (kgsl_timestamp_after(timestamp, current))
 			return -EBUSY;
 
 		return 0;
@@ -210,7 +227,12 @@ fd_bo_from_fbdev(struct fd_pipe *pipe, int fbfd, uint32_t size)
 			goto fail;
 		}
 		kgsl_bo->gpuaddr = req.gpuaddr;
+
+		pthread_mutex_lock(&bo->dev->table_lock);
 		bo->map = fbmem;
+		bo->dev->map_size += bo->size;
+		bo->dev->map_count++;
+		pthread_mutex_unlock(&bo->dev->table_lock);
 	}
 
 	return bo;
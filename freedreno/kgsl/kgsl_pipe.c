@@ -89,6 +89,7 @@ drm_private int kgsl_pipe_timestamp(struct kgsl_pipe *kgsl_pipe,
 				ret, strerror(errno));
 		return ret;
 	}
+	kgsl_pipe->last_timestamp = req.timestamp;
 	*timestamp = req.timestamp;
 	return 0;
 }
@@ -168,6 +169,13 @@ drm_private void kgsl_pipe_post_submit(struct kgsl_pipe *kgsl_pipe,
 		kgsl_bo_set_timestamp(kgsl_bo, timestamp);
 	}
 
+	/* retire what we can without a readtimestamp first, only ask the
+	 * kernel if the oldest pending bo might have passed since:
+	 */
+	kgsl_pipe_process_pending(kgsl_pipe, kgsl_pipe->last_timestamp);
+	if (LIST_IS_EMPTY(&kgsl_pipe->pending_list))
+		return;
+
 	if (!kgsl_pipe_timestamp(kgsl_pipe, &timestamp))
 		kgsl_pipe_process_pending(kgsl_pipe, timestamp);
 }
@@ -178,9 +186,13 @@ drm_private void kgsl_pipe_process_pending(struct kgsl_pipe *kgsl_pipe,
 	struct fd_pipe *pipe = &kgsl_pipe->base;
 	struct kgsl_bo *kgsl_bo = NULL, *tmp;
 
+	if (kgsl_timestamp_after(timestamp, kgsl_pipe->last_timestamp))
+		kgsl_pipe->last_timestamp = timestamp;
+
+	/* the list is in timestamp order, stop at the first unretired bo: */
 	LIST_FOR_EACH_ENTRY_SAFE(kgsl_bo, tmp, &kgsl_pipe->pending_list, list[pipe->id]) {
 		struct list_head *list = &kgsl_bo->list[pipe->id];
-		if (kgsl_bo->timestamp[pipe->id] > timestamp)
+		if (kgsl_timestamp_after(kgsl_bo->timestamp[pipe->id], timestamp))
 			return;
 		list_delinit(list);
 		kgsl_bo->timestamp[pipe->id] = 0;
@@ -58,10 +58,14 @@ struct kgsl_pipe {
 	struct list_head submit_list;
 
 	/* list of bo's that have been submitted but timestamp has
-	 * not passed yet (so still ref'd in active cmdstream)
+	 * not passed yet (so still ref'd in active cmdstream), in
+	 * timestamp order:
 	 */
 	struct list_head pending_list;
 
+	/* last retired timestamp seen: */
+	uint32_t last_timestamp;
+
 	/* if we are the 2d pipe, and want to wait on a timestamp
 	 * from 3d, we need to also internally open the 3d pipe:
 	 */
@@ -75,6 +79,12 @@ static inline struct kgsl_pipe * to_kgsl_pipe(struct fd_pipe *x)
 
 drm_private int is_kgsl_pipe(struct fd_pipe *pipe);
 
+/* timestamps wrap around: */
+static inline int kgsl_timestamp_after(uint32_t a, uint32_t b)
+{
+	return (int32_t)(a - b) > 0;
+}
+
 struct kgsl_bo {
 	struct fd_bo base;
 	uint64_t offset;
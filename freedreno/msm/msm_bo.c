@@ -71,6 +71,13 @@ static int msm_bo_cpu_prep(struct fd_bo *bo, struct fd_pipe *pipe, uint32_t op)
 			.op = op,
 	};
 
+	/* a bo that is still referenced could be part of a submit that
+	 * is queued but not yet seen by the kernel.  Idle cached bo's
+	 * (refcnt of zero) can't be, so the bo cache doesn't stall here:
+	 */
+	if (atomic_read(&bo->refcnt))
+		msm_device_drain(bo->dev);
+
 	get_abs_timeout(&req.timeout, 5000000000);
 
 	return drmCommandWrite(bo->dev->fd, DRM_MSM_GEM_CPU_PREP, &req, sizeof(req));
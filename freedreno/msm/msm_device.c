@@ -35,6 +35,9 @@
 static void msm_device_destroy(struct fd_device *dev)
 {
 	struct msm_device *msm_dev = to_msm_device(dev);
+	msm_rd_close(msm_dev->rd);
+	pthread_cond_destroy(&msm_dev->submit_cond);
+	pthread_mutex_destroy(&msm_dev->submit_lock);
 	free(msm_dev);
 }
 
@@ -58,6 +61,12 @@ drm_private struct fd_device * msm_device_new(int fd)
 	dev->funcs = &funcs;
 
 	dev->bo_size = sizeof(struct msm_bo);
+	dev->track_fences = 1;
+
+	pthread_mutex_init(&msm_dev->submit_lock, NULL);
+	pthread_cond_init(&msm_dev->submit_cond, NULL);
+
+	msm_dev->rd = msm_rd_open();
 
 	return dev;
 }
@@ -64,11 +64,15 @@ static int msm_pipe_get_param(struct fd_pipe *pipe,
 		*value = msm_pipe->chip_id;
 		return 0;
 	case FD_MAX_FREQ:
-		return query_param(pipe, MSM_PARAM_MAX_FREQ, value);
+		if (!msm_pipe->max_freq_ret)
+			*value = msm_pipe->max_freq;
+		return msm_pipe->max_freq_ret;
 	case FD_TIMESTAMP:
 		return query_param(pipe, MSM_PARAM_TIMESTAMP, value);
 	case FD_NR_RINGS:
-		return query_param(pipe, MSM_PARAM_NR_RINGS, value);
+		if (!msm_pipe->nr_rings_ret)
+			*value = msm_pipe->nr_rings;
+		return msm_pipe->nr_rings_ret;
 	default:
 		ERROR_MSG("invalid param id: %d", param);
 		return -1;
@@ -137,6 +141,10 @@ static void close_submitqueue(struct fd_pipe *pipe, uint32_t queue_id)
 static void msm_pipe_destroy(struct fd_pipe *pipe)
 {
 	struct msm_pipe *msm_pipe = to_msm_pipe(pipe);
+
+	/* flushes whatever is still queued before the submitqueue goes: */
+	msm_submit_queue_fini(pipe);
+
 	close_submitqueue(pipe, msm_pipe->queue_id);
 
 	if (msm_pipe->suballoc_ring) {
@@ -144,6 +152,14 @@ static void msm_pipe_destroy(struct fd_pipe *pipe)
 		msm_pipe->suballoc_ring = NULL;
 	}
 
+	if (msm_pipe->obj_slab_bo) {
+		fd_bo_del(msm_pipe->obj_slab_bo);
+		msm_pipe->obj_slab_bo = NULL;
+	}
+
+	msm_grow_pool_fini(pipe);
+	pthread_mutex_destroy(&msm_pipe->grow_lock);
+
 	free(msm_pipe);
 }
 
@@ -151,6 +167,7 @@ static const struct fd_pipe_funcs funcs = {
 		.ringbuffer_new = msm_ringbuffer_new,
 		.get_param = msm_pipe_get_param,
 		.wait = msm_pipe_wait,
+		.drain = msm_submit_queue_drain,
 		.destroy = msm_pipe_destroy,
 };
 
@@ -183,6 +200,7 @@ drm_private struct fd_pipe * msm_pipe_new(struct fd_device *dev,
 
 	pipe = &msm_pipe->base;
 	pipe->funcs = &funcs;
+	pthread_mutex_init(&msm_pipe->grow_lock, NULL);
 
 	/* initialize before get_param(): */
 	pipe->dev = dev;
@@ -193,6 +211,12 @@ drm_private struct fd_pipe * msm_pipe_new(struct fd_device *dev,
 	msm_pipe->gmem   = get_param(pipe, MSM_PARAM_GMEM_SIZE);
 	msm_pipe->chip_id = get_param(pipe, MSM_PARAM_CHIP_ID);
 
+	/* only the timestamp is queried live: */
+	msm_pipe->max_freq_ret = query_param(pipe, MSM_PARAM_MAX_FREQ,
+			&msm_pipe->max_freq);
+	msm_pipe->nr_rings_ret = query_param(pipe, MSM_PARAM_NR_RINGS,
+			&msm_pipe->nr_rings);
+
 	if (! msm_pipe->gpu_id)
 		goto fail;
 
@@ -204,6 +228,9 @@ drm_private struct fd_pipe * msm_pipe_new(struct fd_device *dev,
 	if (open_submitqueue(pipe, prio))
 		goto fail;
 
+	msm_submit_queue_init(pipe);
+	msm_pipe->no_relocs = msm_no_relocs(dev);
+
 	return pipe;
 fail:
 	if (pipe)
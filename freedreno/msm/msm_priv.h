@@ -39,8 +39,18 @@
 
 struct msm_device {
 	struct fd_device base;
-	struct fd_bo_cache ring_cache;
+	struct drm_bo_cache ring_cache;
 	unsigned ring_cnt;
+
+	/* protects the async submit queues of all the device's pipes, and
+	 * is signalled whenever a queued submit has reached the kernel:
+	 */
+	pthread_mutex_t submit_lock;
+	pthread_cond_t submit_cond;
+	unsigned nr_queued;
+
+	/* optional (FD_LIBDRM_RD=<file>) capture of all submits: */
+	struct msm_rd *rd;
 };
 
 static inline struct msm_device * to_msm_device(struct fd_device *x)
@@ -50,6 +60,10 @@ static inline struct msm_device * to_msm_device(struct fd_device *x)
 
 drm_private struct fd_device * msm_device_new(int fd);
 
+/* size of, and max # of idle, bo's in msm_pipe::grow_pool: */
+#define MSM_GROW_SIZE      0x10000
+#define MSM_GROW_POOL_MAX  8
+
 struct msm_pipe {
 	struct fd_pipe base;
 	uint32_t pipe;
@@ -58,6 +72,12 @@ struct msm_pipe {
 	uint32_t chip_id;
 	uint32_t queue_id;
 
+	/* fixed for the gpu, read once at pipe creation along with the
+	 * ones above, with the error if the kernel doesn't know them:
+	 */
+	uint64_t max_freq, nr_rings;
+	int max_freq_ret, nr_rings_ret;
+
 	/* Allow for sub-allocation of stateobj ring buffers (ie. sharing
 	 * the same underlying bo)..
 	 *
@@ -68,6 +88,43 @@ struct msm_pipe {
 	 * so we can reclaim extra space at it's end.
 	 */
 	struct fd_ringbuffer *suballoc_ring;
+
+	/* Page sized slab that small non-streaming stateobj's are carved out
+	 * of.  Each stateobj holds a reference on the slab bo, so it is
+	 * released once the pipe moved on to a new slab and the last
+	 * stateobj in it is gone.
+	 */
+	struct fd_bo *obj_slab_bo;
+	uint32_t obj_slab_offset;
+
+	/* Optional (FD_LIBDRM_NO_RELOCS=1): write the bo's iova straight
+	 * into the cmdstream and submit without reloc's, the bos table
+	 * alone tells the kernel what the submit uses.
+	 */
+	int no_relocs;
+
+	/* Fixed size cmdstream bo's which growable rb's grow into, oldest
+	 * first.  A bo comes back once the rb it was part of is reset, and
+	 * is reused once nothing but the pool references it and the gpu is
+	 * done with it.  Rb's can be deleted by the async submit worker, so
+	 * this has a lock of its own.
+	 */
+	pthread_mutex_t grow_lock;
+	struct fd_bo *grow_pool[MSM_GROW_POOL_MAX];
+	unsigned grow_pool_first, grow_pool_count;
+
+	/* Optional (FD_LIBDRM_ASYNC_SUBMIT=1) queue of finalized submits,
+	 * handed to the kernel by a worker thread so the flushing thread
+	 * can keep recording.  Protected by msm_device::submit_lock.
+	 */
+	struct {
+		int active, stop;
+		pthread_t thread;
+		pthread_cond_t cond;
+		struct list_head jobs;
+		unsigned nr_queued;
+		int error;      /* first failed queued submit, if any */
+	} async;
 };
 
 static inline struct msm_pipe * to_msm_pipe(struct fd_pipe *x)
@@ -81,13 +138,28 @@ drm_private struct fd_pipe * msm_pipe_new(struct fd_device *dev,
 drm_private struct fd_ringbuffer * msm_ringbuffer_new(struct fd_pipe *pipe,
 		uint32_t size, enum fd_ringbuffer_flags flags);
 
+drm_private void msm_submit_queue_init(struct fd_pipe *pipe);
+drm_private void msm_submit_queue_fini(struct fd_pipe *pipe);
+drm_private void msm_submit_queue_drain(struct fd_pipe *pipe);
+drm_private void msm_device_drain(struct fd_device *dev);
+drm_private int msm_no_relocs(struct fd_device *dev);
+drm_private void msm_grow_pool_fini(struct fd_pipe *pipe);
+
+struct msm_rd;
+drm_private struct msm_rd * msm_rd_open(void);
+drm_private void msm_rd_close(struct msm_rd *rd);
+drm_private void msm_rd_submit(struct msm_rd *rd, struct fd_pipe *pipe,
+		const struct drm_msm_gem_submit *req, struct fd_bo **bos);
+
 struct msm_bo {
 	struct fd_bo base;
 	uint64_t offset;
+	/* iova, once queried for a no_relocs pipe, else 0: */
 	uint64_t presumed;
 	/* to avoid excess hashtable lookups, cache the ring this bo was
 	 * last emitted on (since that will probably also be the next ring
-	 * it is emitted on)
+	 * it is emitted on).  Accessed without a lock, so bo2idx() checks
+	 * the idx against the ring before using it.
 	 */
 	unsigned current_ring_seqno;
 	uint32_t idx;
@@ -98,6 +170,21 @@ static inline struct msm_bo * to_msm_bo(struct fd_bo *x)
 	return (struct msm_bo *)x;
 }
 
+/* the bo's iova, looked up once: */
+static inline uint64_t msm_bo_presumed(struct fd_bo *bo)
+{
+	struct msm_bo *msm_bo = to_msm_bo(bo);
+	uint64_t iova = __atomic_load_n(&msm_bo->presumed, __ATOMIC_RELAXED);
+
+	/* racing lookups store the same value: */
+	if (!iova) {
+		iova = fd_bo_get_iova(bo);
+		__atomic_store_n(&msm_bo->presumed, iova, __ATOMIC_RELAXED);
+	}
+
+	return iova;
+}
+
 drm_private int msm_bo_new_handle(struct fd_device *dev,
 		uint32_t size, uint32_t flags, uint32_t *handle);
 drm_private struct fd_bo * msm_bo_from_handle(struct fd_device *dev,
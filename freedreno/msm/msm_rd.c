@@ -0,0 +1,490 @@
+/* -*- mode: C; c-file-style: "k&r"; tab-width 4; indent-tabs-mode: t; -*- */
+
+/*
+ * Copyright © 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Capture of submits in the rd format of the cffdump and replay tools.
+ *
+ * With FD_LIBDRM_RD=<file> every submit of the device is written to the
+ * file, gzip'd if the name ends in ".gz" (and libdrm was built with zlib):
+ * the contents of each of the submit's bo's at the time of the flush, with
+ * the reloc's applied, followed by the address of each of its cmds.  A
+ * bo's contents are only written again once they changed, which is told
+ * apart by a hash.  The flushing thread only copies bo's into a record,
+ * compressing and writing the records is up to a writer thread.
+ */
+
+#include <fcntl.h>
+#include <inttypes.h>
+#if HAVE_ZLIB
+#  include <zlib.h>
+#endif
+
+#include "msm_priv.h"
+
+enum rd_sect_type {
+	RD_NONE,
+	RD_TEST,
+	RD_CMD,
+	RD_GPUADDR,
+	RD_CONTEXT,
+	RD_CMDSTREAM,
+	RD_CMDSTREAM_ADDR,
+	RD_PARAM,
+	RD_FLUSH,
+	RD_PROGRAM,
+	RD_VERT_SHADER,
+	RD_FRAG_SHADER,
+	RD_BUFFER_CONTENTS,
+	RD_GPU_ID,
+	RD_CHIP_ID,
+};
+
+/* the flushing threads wait for the writer beyond this many queued bytes: */
+#define RD_MAX_QUEUED  (256 * 1024 * 1024)
+
+/* all the sections of one submit: */
+struct rd_record {
+	struct list_head node;
+	uint32_t size, max;
+	uint8_t *data;
+	int failed;
+};
+
+/* what was last written for a bo handle: */
+struct rd_bo_state {
+	uint64_t iova;
+	uint64_t hash;
+	uint32_t size;
+};
+
+struct msm_rd {
+	int fd;
+#if HAVE_ZLIB
+	gzFile gz;
+#endif
+
+	/* one submit is captured at a time: */
+	pthread_mutex_t lock;
+	void *bo_states;
+	int has_ids;
+
+	pthread_mutex_t queue_lock;
+	pthread_cond_t queue_cond;
+	struct list_head queue;
+	uint64_t queued_bytes;
+	int stop;
+	pthread_t thread;
+};
+
+static void *rd_sect(struct rd_record *rec, uint32_t type, uint32_t size)
+{
+	uint32_t *hdr, need = rec->size + 8 + size;
+
+	if (rec->failed)
+		return NULL;
+
+	if (need > rec->max) {
+		uint32_t max = MAX2(MAX2(need, 2 * rec->max), 0x10000);
+		uint8_t *data = realloc(rec->data, max);
+
+		if (!data) {
+			rec->failed = TRUE;
+			return NULL;
+		}
+		rec->data = data;
+		rec->max = max;
+	}
+
+	hdr = (uint32_t *)(rec->data + rec->size);
+	hdr[0] = type;
+	hdr[1] = size;
+	rec->size = need;
+
+	return hdr + 2;
+}
+
+static void rd_sect_u32s(struct rd_record *rec, uint32_t type,
+		uint32_t a, uint32_t b, uint32_t c)
+{
+	uint32_t *p = rd_sect(rec, type, 3 * sizeof(uint32_t));
+
+	if (p) {
+		p[0] = a;
+		p[1] = b;
+		p[2] = c;
+	}
+}
+
+/* FNV-1a over 64 bit words, bo sizes are a multiple of the page size: */
+static uint64_t rd_hash(uint64_t hash, const void *data, uint32_t size)
+{
+	const uint64_t *p = data;
+	uint32_t i;
+
+	for (i = 0; i < size / 8; i++)
+		hash = (hash ^ p[i]) * 0x100000001b3ull;
+
+	return hash;
+}
+
+static int rd_write(struct msm_rd *rd, const void *data, uint32_t size)
+{
+	const uint8_t *p = data;
+	ssize_t ret;
+
+#if HAVE_ZLIB
+	if (rd->gz)
+		return gzwrite(rd->gz, data, size) == (int)size ? 0 : -EIO;
+#endif
+
+	while (size) {
+		ret = write(rd->fd, p, size);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		p += ret;
+		size -= ret;
+	}
+
+	return 0;
+}
+
+static void * rd_writer(void *arg)
+{
+	struct msm_rd *rd = arg;
+	int error = 0;
+
+	pthread_mutex_lock(&rd->queue_lock);
+	for (;;) {
+		struct rd_record *rec;
+
+		while (LIST_IS_EMPTY(&rd->queue) && !rd->stop)
+			pthread_cond_wait(&rd->queue_cond, &rd->queue_lock);
+
+		/* only exit once everything queued has been written: */
+		if (LIST_IS_EMPTY(&rd->queue))
+			break;
+
+		rec = LIST_FIRST_ENTRY(&rd->queue, struct rd_record, node);
+		list_del(&rec->node);
+		pthread_mutex_unlock(&rd->queue_lock);
+
+		if (!error) {
+			error = rd_write(rd, rec->data, rec->size);
+			if (error)
+				ERROR_MSG("rd write failed: %d, capture stopped", error);
+		}
+
+		pthread_mutex_lock(&rd->queue_lock);
+		rd->queued_bytes -= rec->size;
+		pthread_cond_broadcast(&rd->queue_cond);
+
+		free(rec->data);
+		free(rec);
+	}
+	pthread_mutex_unlock(&rd->queue_lock);
+
+	return NULL;
+}
+
+drm_private struct msm_rd * msm_rd_open(void)
+{
+	const char *path = getenv("FD_LIBDRM_RD");
+	struct msm_rd *rd;
+	size_t len;
+
+	if (!path || !*path)
+		return NULL;
+
+	rd = calloc(1, sizeof(*rd));
+	if (!rd)
+		return NULL;
+
+	rd->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (rd->fd < 0) {
+		ERROR_MSG("could not open %s: %s", path, strerror(errno));
+		goto fail;
+	}
+
+	len = strlen(path);
+	if (len > 3 && !strcmp(path + len - 3, ".gz")) {
+#if HAVE_ZLIB
+		/* speed over size, this runs next to the app: */
+		rd->gz = gzdopen(rd->fd, "wb1");
+		if (!rd->gz)
+			goto fail_close;
+#else
+		ERROR_MSG("built without zlib, writing %s uncompressed", path);
+#endif
+	}
+
+	rd->bo_states = drmHashCreate();
+	if (!rd->bo_states)
+		goto fail_gz;
+
+	pthread_mutex_init(&rd->lock, NULL);
+	pthread_mutex_init(&rd->queue_lock, NULL);
+	pthread_cond_init(&rd->queue_cond, NULL);
+	list_inithead(&rd->queue);
+
+	if (pthread_create(&rd->thread, NULL, rd_writer, rd)) {
+		pthread_cond_destroy(&rd->queue_cond);
+		pthread_mutex_destroy(&rd->queue_lock);
+		pthread_mutex_destroy(&rd->lock);
+		drmHashDestroy(rd->bo_states);
+		goto fail_gz;
+	}
+
+	return rd;
+
+fail_gz:
+#if HAVE_ZLIB
+	if (rd->gz) {
+		/* closes the fd too: */
+		gzclose(rd->gz);
+		goto fail;
+	}
+fail_close:
+#endif
+	close(rd->fd);
+fail:
+	free(rd);
+	return NULL;
+}
+
+static void rd_forget_bos(struct msm_rd *rd)
+{
+	unsigned long key;
+	void *value;
+
+	while (drmHashFirst(rd->bo_states, &key, &value) == 1) {
+		drmHashDelete(rd->bo_states, key);
+		free(value);
+	}
+}
+
+/* Writes out everything captured so far. */
+drm_private void msm_rd_close(struct msm_rd *rd)
+{
+	if (!rd)
+		return;
+
+	pthread_mutex_lock(&rd->queue_lock);
+	rd->stop = TRUE;
+	pthread_cond_broadcast(&rd->queue_cond);
+	pthread_mutex_unlock(&rd->queue_lock);
+	pthread_join(rd->thread, NULL);
+
+#if HAVE_ZLIB
+	if (rd->gz)
+		gzclose(rd->gz);
+	else
+#endif
+		close(rd->fd);
+
+	rd_forget_bos(rd);
+	drmHashDestroy(rd->bo_states);
+	pthread_cond_destroy(&rd->queue_cond);
+	pthread_mutex_destroy(&rd->queue_lock);
+	pthread_mutex_destroy(&rd->lock);
+	free(rd);
+}
+
+/* applies the reloc's of cmd to the copy of its bo, as the kernel would: */
+static void rd_apply_relocs(uint32_t *data, uint32_t size,
+		const struct drm_msm_gem_submit_cmd *cmd, struct fd_bo **bos,
+		uint32_t nr_bos)
+{
+	const struct drm_msm_gem_submit_reloc *relocs = U642VOID(cmd->relocs);
+	uint32_t i;
+
+	for (i = 0; i < cmd->nr_relocs; i++) {
+		const struct drm_msm_gem_submit_reloc *r = &relocs[i];
+		uint64_t iova;
+
+		if (r->reloc_idx >= nr_bos || r->submit_offset % 4 ||
+				r->submit_offset + 4 > size)
+			continue;
+
+		iova = msm_bo_presumed(bos[r->reloc_idx]) + r->reloc_offset;
+		if (r->shift < 0)
+			iova >>= -r->shift;
+		else
+			iova <<= r->shift;
+		data[r->submit_offset / 4] = (uint32_t)iova | r->or;
+	}
+}
+
+/* the reloc's of the cmds in bo idx, and where they point to: */
+static uint64_t rd_hash_relocs(uint64_t hash,
+		const struct drm_msm_gem_submit *req, struct fd_bo **bos,
+		uint32_t idx)
+{
+	const struct drm_msm_gem_submit_cmd *cmds = U642VOID(req->cmds);
+	uint32_t i, j;
+
+	for (i = 0; i < req->nr_cmds; i++) {
+		const struct drm_msm_gem_submit_reloc *relocs =
+				U642VOID(cmds[i].relocs);
+
+		if (cmds[i].submit_idx != idx)
+			continue;
+
+		for (j = 0; j < cmds[i].nr_relocs; j++) {
+			uint64_t iova = 0;
+
+			if (relocs[j].reloc_idx < req->nr_bos)
+				iova = msm_bo_presumed(bos[relocs[j].reloc_idx]);
+			hash = rd_hash(hash, &relocs[j], sizeof(relocs[j]));
+			hash = rd_hash(hash, &iova, sizeof(iova));
+		}
+	}
+
+	return hash;
+}
+
+/* Checks whether the bo has changed since it was last written, and
+ * records the change if so.  Returns TRUE if the contents need writing.
+ */
+static int rd_bo_changed(struct msm_rd *rd, struct fd_bo *bo,
+		uint64_t iova, uint64_t hash)
+{
+	struct rd_bo_state *state;
+	void *value;
+
+	if (!drmHashLookup(rd->bo_states, bo->handle, &value)) {
+		state = value;
+		if (state->iova == iova && state->size == bo->size &&
+				state->hash == hash)
+			return FALSE;
+	} else {
+		state = malloc(sizeof(*state));
+		if (!state)
+			return TRUE;
+		drmHashInsert(rd->bo_states, bo->handle, state);
+	}
+
+	state->iova = iova;
+	state->size = bo->size;
+	state->hash = hash;
+
+	return TRUE;
+}
+
+/*
+ * Captures a submit, called by the flushing thread before the submit is
+ * handed to the kernel (or the async queue).  bos shadows req->bos.
+ */
+drm_private void msm_rd_submit(struct msm_rd *rd, struct fd_pipe *pipe,
+		const struct drm_msm_gem_submit *req, struct fd_bo **bos)
+{
+	const struct drm_msm_gem_submit_cmd *cmds = U642VOID(req->cmds);
+	struct msm_pipe *msm_pipe = to_msm_pipe(pipe);
+	struct rd_record *rec;
+	uint32_t i, j;
+
+	rec = calloc(1, sizeof(*rec));
+	if (!rec)
+		return;
+
+	pthread_mutex_lock(&rd->lock);
+
+	if (!rd->has_ids) {
+		uint32_t *gpu_id = rd_sect(rec, RD_GPU_ID, sizeof(*gpu_id));
+		uint64_t *chip_id = rd_sect(rec, RD_CHIP_ID, sizeof(*chip_id));
+
+		if (gpu_id && chip_id) {
+			*gpu_id = msm_pipe->gpu_id;
+			*chip_id = msm_pipe->chip_id;
+			rd->has_ids = TRUE;
+		}
+	}
+
+	for (i = 0; i < req->nr_bos; i++) {
+		struct fd_bo *bo = bos[i];
+		uint64_t iova, hash;
+		uint32_t *data;
+		void *map;
+
+		map = fd_bo_map(bo);
+		if (!map)
+			continue;
+
+		iova = msm_bo_presumed(bo);
+		hash = rd_hash(0xcbf29ce484222325ull, map, bo->size);
+		hash = rd_hash_relocs(hash, req, bos, i);
+		if (!rd_bo_changed(rd, bo, iova, hash))
+			continue;
+
+		rd_sect_u32s(rec, RD_GPUADDR, iova, bo->size, iova >> 32);
+		data = rd_sect(rec, RD_BUFFER_CONTENTS, bo->size);
+		if (!data)
+			break;
+		memcpy(data, map, bo->size);
+
+		for (j = 0; j < req->nr_cmds; j++)
+			if (cmds[j].submit_idx == i)
+				rd_apply_relocs(data, bo->size, &cmds[j], bos,
+						req->nr_bos);
+	}
+
+	/* the IB's the kernel runs directly, the others are reached from
+	 * those:
+	 */
+	for (i = 0; i < req->nr_cmds; i++) {
+		uint64_t iova;
+
+		if (cmds[i].type != MSM_SUBMIT_CMD_BUF ||
+				cmds[i].submit_idx >= req->nr_bos)
+			continue;
+
+		iova = msm_bo_presumed(bos[cmds[i].submit_idx]) +
+				cmds[i].submit_offset;
+		rd_sect_u32s(rec, RD_CMDSTREAM_ADDR, iova, cmds[i].size / 4,
+				iova >> 32);
+	}
+
+	if (rec->failed) {
+		/* the file lacks contents the table claims were written: */
+		rd_forget_bos(rd);
+		rd->has_ids = FALSE;
+		pthread_mutex_unlock(&rd->lock);
+		free(rec->data);
+		free(rec);
+		return;
+	}
+
+	pthread_mutex_lock(&rd->queue_lock);
+	while (rd->queued_bytes && rd->queued_bytes + rec->size > RD_MAX_QUEUED)
+		pthread_cond_wait(&rd->queue_cond, &rd->queue_lock);
+	list_addtail(&rec->node, &rd->queue);
+	rd->queued_bytes += rec->size;
+	pthread_cond_broadcast(&rd->queue_cond);
+	pthread_mutex_unlock(&rd->queue_lock);
+
+	pthread_mutex_unlock(&rd->lock);
+}
@@ -49,6 +49,17 @@ struct msm_cmd {
 
 	/* has cmd already been added to parent rb's submit.cmds table? */
 	int is_appended_to_submit;
+
+	/* is ring_bo from the pipe's grow_pool? */
+	int is_pooled;
+
+	/* for stateobj's, the reloc's table translated to the bos table of
+	 * the last submit it was part of, and the idx in that table of each
+	 * of the stateobj's bos.  Reused as-is while the idx's still match:
+	 */
+	struct drm_msm_gem_submit_reloc *xlat_relocs;
+	uint32_t *xlat_idx;
+	unsigned nr_xlat_relocs, nr_xlat_bos;
 };
 
 struct msm_ringbuffer {
@@ -92,8 +103,13 @@ struct msm_ringbuffer {
 
 	unsigned seqno;
 
-	/* maps fd_bo to idx: */
-	void *bo_table;
+	/* maps bo handle to idx + 1, for bo's whose cached idx is for another
+	 * ring.  Open addressing, sized (power of two) from the number of
+	 * bo's in the previous submit and allocated on the first miss:
+	 */
+	uint32_t *bo_hash;
+	uint32_t bo_hash_size;
+	uint32_t bo_hash_hint;
 
 	/* maps msm_cmd to drm_msm_gem_submit_cmd in parent rb.  Each rb has a
 	 * list of msm_cmd's which correspond to each chunk of cmdstream in
@@ -115,7 +131,9 @@ static inline struct msm_ringbuffer * to_msm_ringbuffer(struct fd_ringbuffer *x)
 
 #define INIT_SIZE 0x1000
 
-static pthread_mutex_t idx_lock = PTHREAD_MUTEX_INITIALIZER;
+/* non-streaming stateobj's up to OBJ_SUBALLOC_MAX bytes share slabs: */
+#define OBJ_SLAB_SIZE     0x1000
+#define OBJ_SUBALLOC_MAX  0x400
 
 static struct msm_cmd *current_cmd(struct fd_ringbuffer *ring)
 {
@@ -124,12 +142,100 @@ static struct msm_cmd *current_cmd(struct fd_ringbuffer *ring)
 	return LIST_LAST_ENTRY(&msm_ring->cmd_list, struct msm_cmd, list);
 }
 
+/*
+ * Growth:
+ *
+ * A growable rb grows by finalizing its current cmd buffer and starting
+ * another one, which the submit ioctl gets as one more cmd, ie. the
+ * kernel runs them as a chain of IB's.  Rather than a new bo of twice
+ * the size each time, the new cmd buffers are MSM_GROW_SIZE bo's from
+ * the pipe's pool.  Submits on a pipe retire in order, so if the oldest
+ * pooled bo is still busy the others are too and only that one needs
+ * checking.
+ */
+static int grow_bo_idle(struct fd_bo *bo)
+{
+	struct drm_msm_gem_cpu_prep req = {
+			.handle = bo->handle,
+			.op = MSM_PREP_READ | MSM_PREP_WRITE | MSM_PREP_NOSYNC,
+	};
+
+	/* only the pool's reference left means no queued submit has it, so
+	 * unlike fd_bo_cpu_prep() there is no need to drain the queue:
+	 */
+	if (atomic_read(&bo->refcnt) != 1)
+		return FALSE;
+
+	return !drmCommandWrite(bo->dev->fd, DRM_MSM_GEM_CPU_PREP,
+			&req, sizeof(req));
+}
+
+static struct fd_bo *grow_bo_get(struct fd_pipe *pipe)
+{
+	struct msm_pipe *msm_pipe = to_msm_pipe(pipe);
+	struct fd_bo *bo = NULL;
+
+	pthread_mutex_lock(&msm_pipe->grow_lock);
+	if (msm_pipe->grow_pool_count) {
+		struct fd_bo *oldest = msm_pipe->grow_pool[msm_pipe->grow_pool_first];
+
+		if (grow_bo_idle(oldest)) {
+			bo = oldest;
+			msm_pipe->grow_pool_first =
+					(msm_pipe->grow_pool_first + 1) % MSM_GROW_POOL_MAX;
+			msm_pipe->grow_pool_count--;
+		}
+	}
+	pthread_mutex_unlock(&msm_pipe->grow_lock);
+
+	if (!bo)
+		bo = fd_bo_new_ring(pipe->dev, MSM_GROW_SIZE, 0);
+
+	return bo;
+}
+
+/* takes over the reference to bo: */
+static void grow_bo_put(struct fd_pipe *pipe, struct fd_bo *bo)
+{
+	struct msm_pipe *msm_pipe = to_msm_pipe(pipe);
+	unsigned i;
+
+	pthread_mutex_lock(&msm_pipe->grow_lock);
+	if (msm_pipe->grow_pool_count < MSM_GROW_POOL_MAX) {
+		i = (msm_pipe->grow_pool_first + msm_pipe->grow_pool_count++) %
+				MSM_GROW_POOL_MAX;
+		msm_pipe->grow_pool[i] = bo;
+		bo = NULL;
+	}
+	pthread_mutex_unlock(&msm_pipe->grow_lock);
+
+	if (bo)
+		fd_bo_del(bo);
+}
+
+drm_private void msm_grow_pool_fini(struct fd_pipe *pipe)
+{
+	struct msm_pipe *msm_pipe = to_msm_pipe(pipe);
+
+	while (msm_pipe->grow_pool_count) {
+		fd_bo_del(msm_pipe->grow_pool[msm_pipe->grow_pool_first]);
+		msm_pipe->grow_pool_first =
+				(msm_pipe->grow_pool_first + 1) % MSM_GROW_POOL_MAX;
+		msm_pipe->grow_pool_count--;
+	}
+}
+
 static void ring_cmd_del(struct msm_cmd *cmd)
 {
-	fd_bo_del(cmd->ring_bo);
+	if (cmd->is_pooled)
+		grow_bo_put(cmd->ring->pipe, cmd->ring_bo);
+	else
+		fd_bo_del(cmd->ring_bo);
 	list_del(&cmd->list);
 	to_msm_ringbuffer(cmd->ring)->cmd_count--;
 	free(cmd->relocs);
+	free(cmd->xlat_relocs);
+	free(cmd->xlat_idx);
 	free(cmd);
 }
 
@@ -144,9 +250,6 @@ static struct msm_cmd * ring_cmd_new(struct fd_ringbuffer *ring, uint32_t size,
 
 	cmd->ring = ring;
 
-	/* TODO separate suballoc buffer for small non-streaming state, using
-	 * smaller page-sized backing bo's.
-	 */
 	if (flags & FD_RINGBUFFER_STREAMING) {
 		struct msm_pipe *msm_pipe = to_msm_pipe(ring->pipe);
 		unsigned suballoc_offset = 0;
@@ -182,6 +285,23 @@ static struct msm_cmd * ring_cmd_new(struct fd_ringbuffer *ring, uint32_t size,
 			fd_ringbuffer_del(msm_pipe->suballoc_ring);
 
 		msm_pipe->suballoc_ring = fd_ringbuffer_ref(ring);
+	} else if ((flags & FD_RINGBUFFER_OBJECT) && size <= OBJ_SUBALLOC_MAX) {
+		struct msm_pipe *msm_pipe = to_msm_pipe(ring->pipe);
+		uint32_t offset = ALIGN(msm_pipe->obj_slab_offset, 0x10);
+
+		if (!msm_pipe->obj_slab_bo || (offset + size) > OBJ_SLAB_SIZE) {
+			if (msm_pipe->obj_slab_bo)
+				fd_bo_del(msm_pipe->obj_slab_bo);
+			msm_pipe->obj_slab_bo = fd_bo_new_ring(ring->pipe->dev,
+					OBJ_SLAB_SIZE, 0);
+			offset = 0;
+		}
+
+		if (msm_pipe->obj_slab_bo) {
+			cmd->ring_bo = fd_bo_ref(msm_pipe->obj_slab_bo);
+			msm_ring->offset = offset;
+			msm_pipe->obj_slab_offset = offset + size;
+		}
 	} else {
 		cmd->ring_bo = fd_bo_new_ring(ring->pipe->dev, size, 0);
 	}
@@ -215,33 +335,91 @@ static uint32_t append_bo(struct fd_ringbuffer *ring, struct fd_bo *bo)
 	return idx;
 }
 
+static uint32_t bo_hash_size_for(uint32_t nr_bos)
+{
+	uint32_t size = 64;
+
+	while (size < 2 * nr_bos)
+		size *= 2;
+	return size;
+}
+
+static uint32_t *bo_hash_slot(struct msm_ringbuffer *msm_ring, uint32_t handle)
+{
+	uint32_t mask = msm_ring->bo_hash_size - 1;
+	uint32_t i = (handle * 0x9e3779b1u) >> 8;
+
+	for (;; i++) {
+		uint32_t *slot = &msm_ring->bo_hash[i & mask];
+		if (!*slot || msm_ring->submit.bos[*slot - 1].handle == handle)
+			return slot;
+	}
+}
+
+/* (re)build the table for at least nr_bos entries from submit.bos: */
+static int bo_hash_resize(struct msm_ringbuffer *msm_ring, uint32_t nr_bos)
+{
+	uint32_t size = bo_hash_size_for(nr_bos);
+	uint32_t *hash = calloc(size, sizeof(*hash));
+	uint32_t i;
+
+	if (!hash)
+		return -ENOMEM;
+
+	free(msm_ring->bo_hash);
+	msm_ring->bo_hash = hash;
+	msm_ring->bo_hash_size = size;
+
+	for (i = 0; i < msm_ring->nr_bos; i++)
+		*bo_hash_slot(msm_ring, msm_ring->submit.bos[i].handle) = i + 1;
+
+	return 0;
+}
+
 /* add (if needed) bo, return idx: */
 static uint32_t bo2idx(struct fd_ringbuffer *ring, struct fd_bo *bo, uint32_t flags)
 {
 	struct msm_ringbuffer *msm_ring = to_msm_ringbuffer(ring);
 	struct msm_bo *msm_bo = to_msm_bo(bo);
-	uint32_t idx;
-	pthread_mutex_lock(&idx_lock);
-	if (msm_bo->current_ring_seqno == msm_ring->seqno) {
-		idx = msm_bo->idx;
-	} else {
-		void *val;
+	uint32_t *slot, idx;
+
+	/* The cached idx is only a hint, which other rings (possibly on
+	 * other threads) may overwrite at any time.  It is trusted only
+	 * once it is seen to point back at this bo in this ring's table:
+	 */
+	if (__atomic_load_n(&msm_bo->current_ring_seqno, __ATOMIC_RELAXED) ==
+			msm_ring->seqno) {
+		idx = __atomic_load_n(&msm_bo->idx, __ATOMIC_RELAXED);
+		if (idx < msm_ring->nr_bos && msm_ring->bos[idx] == bo)
+			goto found;
+	}
 
-		if (!msm_ring->bo_table)
-			msm_ring->bo_table = drmHashCreate();
+	if (!msm_ring->bo_hash || 2 * (msm_ring->nr_bos + 1) > msm_ring->bo_hash_size) {
+		uint32_t nr_bos = msm_ring->nr_bos + 1;
+		bo_hash_resize(msm_ring, nr_bos > msm_ring->bo_hash_hint ?
+				nr_bos : msm_ring->bo_hash_hint);
+	}
 
-		if (!drmHashLookup(msm_ring->bo_table, bo->handle, &val)) {
-			/* found */
-			idx = (uint32_t)(uintptr_t)val;
+	if (msm_ring->bo_hash) {
+		slot = bo_hash_slot(msm_ring, bo->handle);
+		if (*slot) {
+			idx = *slot - 1;
 		} else {
 			idx = append_bo(ring, bo);
-			val = (void *)(uintptr_t)idx;
-			drmHashInsert(msm_ring->bo_table, bo->handle, val);
+			*slot = idx + 1;
 		}
-		msm_bo->current_ring_seqno = msm_ring->seqno;
-		msm_bo->idx = idx;
+	} else {
+		/* out of memory for the table, scan instead: */
+		for (idx = 0; idx < msm_ring->nr_bos; idx++)
+			if (msm_ring->bos[idx] == bo)
+				break;
+		if (idx == msm_ring->nr_bos)
+			idx = append_bo(ring, bo);
 	}
-	pthread_mutex_unlock(&idx_lock);
+
+	__atomic_store_n(&msm_bo->current_ring_seqno, msm_ring->seqno, __ATOMIC_RELAXED);
+	__atomic_store_n(&msm_bo->idx, idx, __ATOMIC_RELAXED);
+found:
 	if (flags & FD_RELOC_READ)
 		msm_ring->submit.bos[idx].flags |= MSM_SUBMIT_BO_READ;
 	if (flags & FD_RELOC_WRITE)
@@ -336,7 +514,6 @@ static void flush_reset(struct fd_ringbuffer *ring)
 		struct msm_bo *msm_bo = to_msm_bo(msm_ring->bos[i]);
 		if (!msm_bo)
 			continue;
-		msm_bo->current_ring_seqno = 0;
 		fd_bo_del(&msm_bo->base);
 	}
 
@@ -350,16 +527,24 @@ static void flush_reset(struct fd_ringbuffer *ring)
 			fd_ringbuffer_del(msm_cmd->ring);
 	}
 
+	/* keep the bo table if it is the right size for the next submit: */
+	if (msm_ring->bo_hash) {
+		if (bo_hash_size_for(msm_ring->nr_bos) == msm_ring->bo_hash_size) {
+			memset(msm_ring->bo_hash, 0,
+					msm_ring->bo_hash_size * sizeof(*msm_ring->bo_hash));
+		} else {
+			free(msm_ring->bo_hash);
+			msm_ring->bo_hash = NULL;
+			msm_ring->bo_hash_size = 0;
+		}
+	}
+	msm_ring->bo_hash_hint = msm_ring->nr_bos;
+
 	msm_ring->submit.nr_cmds = 0;
 	msm_ring->submit.nr_bos = 0;
 	msm_ring->nr_cmds = 0;
 	msm_ring->nr_bos = 0;
 
-	if (msm_ring->bo_table) {
-		drmHashDestroy(msm_ring->bo_table);
-		msm_ring->bo_table = NULL;
-	}
-
 	if (msm_ring->cmd_table) {
 		drmHashDestroy(msm_ring->cmd_table);
 		msm_ring->cmd_table = NULL;
@@ -392,16 +577,18 @@ static void finalize_current_cmd(struct fd_ringbuffer *ring, uint32_t *last_star
 	get_cmd(parent, current_cmd(ring), submit_offset, size, type);
 }
 
-static void dump_submit(struct msm_ringbuffer *msm_ring)
+static void dump_submit(struct drm_msm_gem_submit *req)
 {
+	struct drm_msm_gem_submit_bo *bos = U642VOID(req->bos);
+	struct drm_msm_gem_submit_cmd *cmds = U642VOID(req->cmds);
 	uint32_t i, j;
 
-	for (i = 0; i < msm_ring->submit.nr_bos; i++) {
-		struct drm_msm_gem_submit_bo *bo = &msm_ring->submit.bos[i];
+	for (i = 0; i < req->nr_bos; i++) {
+		struct drm_msm_gem_submit_bo *bo = &bos[i];
 		ERROR_MSG("  bos[%d]: handle=%u, flags=%x", i, bo->handle, bo->flags);
 	}
-	for (i = 0; i < msm_ring->submit.nr_cmds; i++) {
-		struct drm_msm_gem_submit_cmd *cmd = &msm_ring->submit.cmds[i];
+	for (i = 0; i < req->nr_cmds; i++) {
+		struct drm_msm_gem_submit_cmd *cmd = &cmds[i];
 		struct drm_msm_gem_submit_reloc *relocs = U642VOID(cmd->relocs);
 		ERROR_MSG("  cmd[%d]: type=%u, submit_idx=%u, submit_offset=%u, size=%u",
 				i, cmd->type, cmd->submit_idx, cmd->submit_offset, cmd->size);
@@ -414,26 +601,81 @@ static void dump_submit(struct msm_ringbuffer *msm_ring)
 	}
 }
 
+/* does the submit ioctl, reporting it to drmSubmitTraceBegin()/End(): */
+static int submit_ioctl(struct fd_pipe *pipe, struct drm_msm_gem_submit *req)
+{
+	struct drm_msm_gem_submit_cmd *cmds = U642VOID(req->cmds);
+	drmSubmitTrace trace = {
+			.name = "msm_ringbuffer_flush",
+			.fd = pipe->dev->fd,
+			.num_bos = req->nr_bos,
+	};
+	uint32_t i;
+	int ret;
+
+	for (i = 0; i < req->nr_cmds; i++)
+		trace.cmd_bytes += cmds[i].size;
+	drmSubmitTraceBegin(&trace);
+
+	ret = drmCommandWriteRead(pipe->dev->fd, DRM_MSM_GEM_SUBMIT,
+			req, sizeof(*req));
+
+	trace.ret = ret;
+	trace.fence = ret ? 0 : req->fence;
+	drmSubmitTraceEnd(&trace);
+
+	return ret;
+}
+
+/* Returns the stateobj cmd's reloc's translated to the parent's bos table,
+ * which stays owned by the cmd.  The stateobj's bos are added to the parent
+ * either way, but the table is only rewritten when any of them ended up at
+ * a different idx than in the previous submit the stateobj was part of.
+ */
 static struct drm_msm_gem_submit_reloc *
 handle_stateobj_relocs(struct fd_ringbuffer *parent, struct fd_ringbuffer *stateobj,
-		struct drm_msm_gem_submit_reloc *orig_relocs, unsigned nr_relocs)
+		struct msm_cmd *stateobj_cmd)
 {
 	struct msm_ringbuffer *msm_ring = to_msm_ringbuffer(stateobj);
-	struct drm_msm_gem_submit_reloc *relocs = malloc(nr_relocs * sizeof(*relocs));
+	struct drm_msm_gem_submit_reloc *orig_relocs = stateobj_cmd->relocs;
+	unsigned nr_relocs = stateobj_cmd->nr_relocs;
+	unsigned nr_bos = msm_ring->nr_bos;
+	int stale = 0;
 	unsigned i;
 
-	for (i = 0; i < nr_relocs; i++) {
-		unsigned idx = orig_relocs[i].reloc_idx;
-		struct fd_bo *bo = msm_ring->bos[idx];
+	if (stateobj_cmd->nr_xlat_relocs != nr_relocs ||
+			stateobj_cmd->nr_xlat_bos != nr_bos) {
+		free(stateobj_cmd->xlat_relocs);
+		free(stateobj_cmd->xlat_idx);
+		stateobj_cmd->xlat_relocs = malloc(nr_relocs * sizeof(*orig_relocs));
+		stateobj_cmd->xlat_idx = malloc(nr_bos * sizeof(uint32_t));
+		stateobj_cmd->nr_xlat_relocs = nr_relocs;
+		stateobj_cmd->nr_xlat_bos = nr_bos;
+		stale = 1;
+	}
+
+	for (i = 0; i < nr_bos; i++) {
 		unsigned flags = 0;
+		uint32_t idx;
 
-		if (msm_ring->submit.bos[idx].flags & MSM_SUBMIT_BO_READ)
+		if (msm_ring->submit.bos[i].flags & MSM_SUBMIT_BO_READ)
 			flags |= FD_RELOC_READ;
-		if (msm_ring->submit.bos[idx].flags & MSM_SUBMIT_BO_WRITE)
+		if (msm_ring->submit.bos[i].flags & MSM_SUBMIT_BO_WRITE)
 			flags |= FD_RELOC_WRITE;
 
-		relocs[i] = orig_relocs[i];
-		relocs[i].reloc_idx = bo2idx(parent, bo, flags);
+		idx = bo2idx(parent, msm_ring->bos[i], flags);
+		if (stale || stateobj_cmd->xlat_idx[i] != idx) {
+			stateobj_cmd->xlat_idx[i] = idx;
+			stale = 1;
+		}
+	}
+
+	if (stale) {
+		for (i = 0; i < nr_relocs; i++) {
+			stateobj_cmd->xlat_relocs[i] = orig_relocs[i];
+			stateobj_cmd->xlat_relocs[i].reloc_idx =
+					stateobj_cmd->xlat_idx[orig_relocs[i].reloc_idx];
+		}
 	}
 
 	/* stateobj rb's could have reloc's to other stateobj rb's which didn't
@@ -454,7 +696,270 @@ handle_stateobj_relocs(struct fd_ringbuffer *parent, struct fd_ringbuffer *state
 		}
 	}
 
-	return relocs;
+	return stateobj_cmd->xlat_relocs;
+}
+
+/*
+ * Async submit:
+ *
+ * With FD_LIBDRM_ASYNC_SUBMIT=1 each pipe gets a worker thread.  Flushes
+ * which don't ask for an out-fence copy the finalized submit into a
+ * msm_submit_job and return without waiting for the ioctl.  The job
+ * holds references to the submit's bo's and rb's until the kernel has
+ * seen it, anything which depends on that (timestamps, cpu_prep) waits
+ * for the queue to drain first.
+ */
+
+struct msm_submit_job {
+	struct list_head node;
+	struct drm_msm_gem_submit req;
+	int in_fence_fd;
+	uint32_t nr_bos, nr_rings;
+	struct fd_bo **bos;
+	struct fd_ringbuffer **rings;
+};
+
+/* Returns NULL if the submit has to go synchronously.  That is the case
+ * if any of the rb's is a non-growable one (other than stateobj's), as
+ * those keep reusing the same cmdstream bo after being flushed, while
+ * the kernel still has to read it to apply the relocs.
+ */
+static struct msm_submit_job *
+submit_job_new(struct fd_ringbuffer *ring, struct drm_msm_gem_submit *req,
+		int in_fence_fd)
+{
+	struct msm_ringbuffer *msm_ring = to_msm_ringbuffer(ring);
+	struct drm_msm_gem_submit_bo *bos;
+	struct drm_msm_gem_submit_cmd *cmds;
+	struct drm_msm_gem_submit_reloc *relocs;
+	struct msm_submit_job *job;
+	uint32_t i, nr_relocs = 0;
+
+	for (i = 0; i < req->nr_cmds; i++) {
+		struct fd_ringbuffer *target = msm_ring->cmds[i]->ring;
+
+		if (!to_msm_ringbuffer(target)->is_growable &&
+				!(target->flags & FD_RINGBUFFER_OBJECT))
+			return NULL;
+
+		nr_relocs += msm_ring->submit.cmds[i].nr_relocs;
+	}
+
+	job = malloc(sizeof(*job) +
+			req->nr_bos * (sizeof(*bos) + sizeof(*job->bos)) +
+			req->nr_cmds * (sizeof(*cmds) + sizeof(*job->rings)) +
+			nr_relocs * sizeof(*relocs));
+	if (!job)
+		return NULL;
+
+	/* the caller is free to close the in-fence once we return: */
+	job->in_fence_fd = -1;
+	if (in_fence_fd != -1) {
+		job->in_fence_fd = fcntl(in_fence_fd, F_DUPFD_CLOEXEC, 0);
+		if (job->in_fence_fd < 0) {
+			free(job);
+			return NULL;
+		}
+	}
+
+	bos = (void *)(job + 1);
+	memcpy(bos, msm_ring->submit.bos, req->nr_bos * sizeof(*bos));
+
+	cmds = (void *)(bos + req->nr_bos);
+	memcpy(cmds, msm_ring->submit.cmds, req->nr_cmds * sizeof(*cmds));
+
+	/* the reloc tables belong to the cmds, which are gone (or reused,
+	 * for stateobj's) by the time the worker gets to the submit:
+	 */
+	relocs = (void *)(cmds + req->nr_cmds);
+	for (i = 0; i < req->nr_cmds; i++) {
+		memcpy(relocs, U642VOID(cmds[i].relocs),
+				cmds[i].nr_relocs * sizeof(*relocs));
+		cmds[i].relocs = VOID2U64(relocs);
+		relocs += cmds[i].nr_relocs;
+	}
+
+	job->bos = (void *)relocs;
+	job->rings = (void *)(job->bos + req->nr_bos);
+
+	/* take over the submit's bo references, flush_reset() skips the
+	 * entries we clear:
+	 */
+	for (i = 0; i < req->nr_bos; i++) {
+		job->bos[i] = msm_ring->bos[i];
+		msm_ring->bos[i] = NULL;
+	}
+	job->nr_bos = req->nr_bos;
+
+	/* and keep the rb's around to update their timestamp: */
+	for (i = 0; i < req->nr_cmds; i++)
+		job->rings[i] = fd_ringbuffer_ref(msm_ring->cmds[i]->ring);
+	job->nr_rings = req->nr_cmds;
+
+	job->req = *req;
+	job->req.bos = VOID2U64(bos);
+	job->req.cmds = VOID2U64(cmds);
+	job->req.fence_fd = job->in_fence_fd;
+
+	return job;
+}
+
+/* called from the worker thread, without submit_lock held: */
+static int submit_job_run(struct fd_pipe *pipe, struct msm_submit_job *job)
+{
+	uint32_t i;
+	int ret;
+
+	DEBUG_MSG("nr_cmds=%u, nr_bos=%u", job->req.nr_cmds, job->req.nr_bos);
+
+	ret = submit_ioctl(pipe, &job->req);
+	if (ret) {
+		ERROR_MSG("queued submit failed: %d (%s)", ret, strerror(errno));
+		dump_submit(&job->req);
+	} else {
+		for (i = 0; i < job->nr_rings; i++)
+			job->rings[i]->last_timestamp = job->req.fence;
+		fd_bo_fence_submit(pipe, job->bos, job->nr_bos, job->req.fence);
+	}
+
+	for (i = 0; i < job->nr_rings; i++)
+		fd_ringbuffer_del(job->rings[i]);
+
+	for (i = 0; i < job->nr_bos; i++)
+		if (job->bos[i])
+			fd_bo_del(job->bos[i]);
+
+	if (job->in_fence_fd != -1)
+		close(job->in_fence_fd);
+
+	free(job);
+
+	return ret;
+}
+
+static void * submit_worker(void *arg)
+{
+	struct fd_pipe *pipe = arg;
+	struct msm_device *msm_dev = to_msm_device(pipe->dev);
+	struct msm_pipe *msm_pipe = to_msm_pipe(pipe);
+
+	pthread_mutex_lock(&msm_dev->submit_lock);
+	for (;;) {
+		struct msm_submit_job *job;
+		int ret;
+
+		while (LIST_IS_EMPTY(&msm_pipe->async.jobs) && !msm_pipe->async.stop)
+			pthread_cond_wait(&msm_pipe->async.cond, &msm_dev->submit_lock);
+
+		/* only exit once everything queued has been submitted: */
+		if (LIST_IS_EMPTY(&msm_pipe->async.jobs))
+			break;
+
+		job = LIST_FIRST_ENTRY(&msm_pipe->async.jobs,
+				struct msm_submit_job, node);
+		list_del(&job->node);
+		pthread_mutex_unlock(&msm_dev->submit_lock);
+
+		ret = submit_job_run(pipe, job);
+
+		pthread_mutex_lock(&msm_dev->submit_lock);
+		if (ret && !msm_pipe->async.error)
+			msm_pipe->async.error = ret;
+		msm_pipe->async.nr_queued--;
+		__atomic_sub_fetch(&msm_dev->nr_queued, 1, __ATOMIC_RELEASE);
+		pthread_cond_broadcast(&msm_dev->submit_cond);
+	}
+	pthread_mutex_unlock(&msm_dev->submit_lock);
+
+	return NULL;
+}
+
+/* Returns the error of an earlier queued submit that failed, if any, as
+ * that couldn't be reported by the flush that queued it.
+ */
+static int submit_job_queue(struct fd_pipe *pipe, struct msm_submit_job *job)
+{
+	struct msm_device *msm_dev = to_msm_device(pipe->dev);
+	struct msm_pipe *msm_pipe = to_msm_pipe(pipe);
+	int ret;
+
+	pthread_mutex_lock(&msm_dev->submit_lock);
+	ret = msm_pipe->async.error;
+	msm_pipe->async.error = 0;
+	if (job) {
+		list_addtail(&job->node, &msm_pipe->async.jobs);
+		msm_pipe->async.nr_queued++;
+		__atomic_add_fetch(&msm_dev->nr_queued, 1, __ATOMIC_RELEASE);
+		pthread_cond_signal(&msm_pipe->async.cond);
+	}
+	pthread_mutex_unlock(&msm_dev->submit_lock);
+
+	return ret;
+}
+
+drm_private void msm_submit_queue_init(struct fd_pipe *pipe)
+{
+	struct msm_pipe *msm_pipe = to_msm_pipe(pipe);
+	const char *str = getenv("FD_LIBDRM_ASYNC_SUBMIT");
+
+	if (!str || !atoi(str))
+		return;
+
+	list_inithead(&msm_pipe->async.jobs);
+	pthread_cond_init(&msm_pipe->async.cond, NULL);
+
+	if (pthread_create(&msm_pipe->async.thread, NULL, submit_worker, pipe)) {
+		ERROR_MSG("could not create submit thread, submitting synchronously");
+		pthread_cond_destroy(&msm_pipe->async.cond);
+		return;
+	}
+
+	msm_pipe->async.active = TRUE;
+}
+
+drm_private void msm_submit_queue_fini(struct fd_pipe *pipe)
+{
+	struct msm_device *msm_dev = to_msm_device(pipe->dev);
+	struct msm_pipe *msm_pipe = to_msm_pipe(pipe);
+
+	if (!msm_pipe->async.active)
+		return;
+
+	pthread_mutex_lock(&msm_dev->submit_lock);
+	msm_pipe->async.stop = TRUE;
+	pthread_cond_signal(&msm_pipe->async.cond);
+	pthread_mutex_unlock(&msm_dev->submit_lock);
+
+	pthread_join(msm_pipe->async.thread, NULL);
+	pthread_cond_destroy(&msm_pipe->async.cond);
+	msm_pipe->async.active = FALSE;
+}
+
+drm_private void msm_submit_queue_drain(struct fd_pipe *pipe)
+{
+	struct msm_device *msm_dev = to_msm_device(pipe->dev);
+	struct msm_pipe *msm_pipe = to_msm_pipe(pipe);
+
+	if (!msm_pipe->async.active)
+		return;
+
+	pthread_mutex_lock(&msm_dev->submit_lock);
+	while (msm_pipe->async.nr_queued)
+		pthread_cond_wait(&msm_dev->submit_cond, &msm_dev->submit_lock);
+	pthread_mutex_unlock(&msm_dev->submit_lock);
+}
+
+drm_private void msm_device_drain(struct fd_device *dev)
+{
+	struct msm_device *msm_dev = to_msm_device(dev);
+
+	if (!__atomic_load_n(&msm_dev->nr_queued, __ATOMIC_ACQUIRE))
+		return;
+
+	pthread_mutex_lock(&msm_dev->submit_lock);
+	while (msm_dev->nr_queued)
+		pthread_cond_wait(&msm_dev->submit_cond, &msm_dev->submit_lock);
+	pthread_mutex_unlock(&msm_dev->submit_lock);
 }
 
 static int msm_ringbuffer_flush(struct fd_ringbuffer *ring, uint32_t *last_start,
@@ -497,7 +1002,7 @@ static int msm_ringbuffer_flush(struct fd_ringbuffer *ring, uint32_t *last_start
 		 */
 		if (msm_cmd->ring->flags & FD_RINGBUFFER_OBJECT) {
 			relocs = handle_stateobj_relocs(ring, msm_cmd->ring,
-					relocs, nr_relocs);
+					msm_cmd);
 		}
 
 		cmd = &msm_ring->submit.cmds[i];
@@ -511,32 +1016,53 @@ static int msm_ringbuffer_flush(struct fd_ringbuffer *ring, uint32_t *last_start
 	req.cmds = VOID2U64(msm_ring->submit.cmds),
 	req.nr_cmds = msm_ring->submit.nr_cmds;
 
+	if (to_msm_device(ring->pipe->dev)->rd)
+		msm_rd_submit(to_msm_device(ring->pipe->dev)->rd, ring->pipe,
+				&req, msm_ring->bos);
+
+	if (msm_pipe->async.active) {
+		struct msm_submit_job *job = NULL;
+
+		/* the out-fence only exists once the kernel has seen the
+		 * submit, so that one has to go synchronously:
+		 */
+		if (!out_fence_fd)
+			job = submit_job_new(ring, &req, in_fence_fd);
+
+		if (job) {
+			ret = submit_job_queue(ring->pipe, job);
+			flush_reset(ring);
+			return ret;
+		}
+
+		/* keep the submits in order: */
+		msm_submit_queue_drain(ring->pipe);
+	}
+
 	DEBUG_MSG("nr_cmds=%u, nr_bos=%u", req.nr_cmds, req.nr_bos);
 
-	ret = drmCommandWriteRead(ring->pipe->dev->fd, DRM_MSM_GEM_SUBMIT,
-			&req, sizeof(req));
+	ret = submit_ioctl(ring->pipe, &req);
 	if (ret) {
 		ERROR_MSG("submit failed: %d (%s)", ret, strerror(errno));
-		dump_submit(msm_ring);
+		dump_submit(&req);
 	} else if (!ret) {
 		/* update timestamp on all rings associated with submit: */
 		for (i = 0; i < msm_ring->submit.nr_cmds; i++) {
 			struct msm_cmd *msm_cmd = msm_ring->cmds[i];
 			msm_cmd->ring->last_timestamp = req.fence;
 		}
+		fd_bo_fence_submit(ring->pipe, msm_ring->bos, req.nr_bos,
+				req.fence);
 
 		if (out_fence_fd) {
 			*out_fence_fd = req.fence_fd;
 		}
 	}
 
-	/* free dynamically constructed stateobj relocs tables: */
-	for (i = 0; i < msm_ring->submit.nr_cmds; i++) {
-		struct drm_msm_gem_submit_cmd *cmd = &msm_ring->submit.cmds[i];
-		struct msm_cmd *msm_cmd = msm_ring->cmds[i];
-		if (msm_cmd->ring->flags & FD_RINGBUFFER_OBJECT) {
-			free(U642VOID(cmd->relocs));
-		}
+	if (msm_pipe->async.active) {
+		int err = submit_job_queue(ring->pipe, NULL);
+		if (!ret)
+			ret = err;
 	}
 
 	flush_reset(ring);
@@ -546,9 +1072,29 @@ static int msm_ringbuffer_flush(struct fd_ringbuffer *ring, uint32_t *last_start
 
 static void msm_ringbuffer_grow(struct fd_ringbuffer *ring, uint32_t size)
 {
-	assert(to_msm_ringbuffer(ring)->is_growable);
+	struct msm_ringbuffer *msm_ring = to_msm_ringbuffer(ring);
+	struct msm_cmd *cmd;
+
+	assert(msm_ring->is_growable);
 	finalize_current_cmd(ring, ring->last_start);
-	ring_cmd_new(ring, size, 0);
+
+	cmd = calloc(1, sizeof(*cmd));
+	if (!cmd)
+		return;
+
+	cmd->ring = ring;
+	cmd->ring_bo = grow_bo_get(ring->pipe);
+	if (!cmd->ring_bo) {
+		free(cmd);
+		return;
+	}
+	cmd->is_pooled = TRUE;
+
+	list_addtail(&cmd->list, &msm_ring->cmd_list);
+	msm_ring->cmd_count++;
+
+	/* the pool's size rather than the requested one: */
+	ring->size = MSM_GROW_SIZE;
 }
 
 static void msm_ringbuffer_reset(struct fd_ringbuffer *ring)
@@ -556,6 +1102,43 @@ static void msm_ringbuffer_reset(struct fd_ringbuffer *ring)
 	flush_reset(ring);
 }
 
+/*
+ * No reloc's:
+ *
+ * A bo keeps the iova it got in the gpu's address space for its whole
+ * life, so with FD_LIBDRM_NO_RELOCS=1 (and a kernel which tells the
+ * iova) it is looked up once and written into the cmdstream as is.  It
+ * is also passed as presumed address, which the kernel checks against
+ * the real one when pinning the submit's bos.
+ */
+drm_private int msm_no_relocs(struct fd_device *dev)
+{
+	const char *str = getenv("FD_LIBDRM_NO_RELOCS");
+
+	if (!str || !atoi(str))
+		return FALSE;
+
+	return dev->version >= FD_VERSION_BO_IOVA;
+}
+
+static void emit_iova(struct fd_ringbuffer *ring, const struct fd_reloc *r)
+{
+	struct fd_ringbuffer *parent = ring->parent ? ring->parent : ring;
+	uint64_t iova = msm_bo_presumed(r->bo) + r->offset;
+
+	/* only for the bos table flags: */
+	bo2idx(parent, r->bo, r->flags);
+
+	if (r->shift < 0)
+		iova >>= -r->shift;
+	else
+		iova <<= r->shift;
+	(*ring->cur++) = (uint32_t)iova | r->or;
+
+	if (ring->pipe->gpu_id >= 500)
+		(*ring->cur++) = (uint32_t)(iova >> 32) | r->orhi;
+}
+
 static void msm_ringbuffer_emit_reloc(struct fd_ringbuffer *ring,
 		const struct fd_reloc *r)
 {
@@ -563,9 +1146,15 @@ static void msm_ringbuffer_emit_reloc(struct fd_ringbuffer *ring,
 	struct msm_bo *msm_bo = to_msm_bo(r->bo);
 	struct drm_msm_gem_submit_reloc *reloc;
 	struct msm_cmd *cmd = current_cmd(ring);
-	uint32_t idx = APPEND(cmd, relocs);
+	uint32_t idx;
 	uint32_t addr;
 
+	if (to_msm_pipe(ring->pipe)->no_relocs) {
+		emit_iova(ring, r);
+		return;
+	}
+
+	idx = APPEND(cmd, relocs);
 	reloc = &cmd->relocs[idx];
 
 	reloc->reloc_idx = bo2idx(parent, r->bo, r->flags);
@@ -675,6 +1264,7 @@ static void msm_ringbuffer_destroy(struct fd_ringbuffer *ring)
 	free(msm_ring->submit.bos);
 	free(msm_ring->bos);
 	free(msm_ring->cmds);
+	free(msm_ring->bo_hash);
 	free(msm_ring);
 }
 
@@ -291,6 +291,26 @@ drm_intel_bo_busy(drm_intel_bo *bo)
 	return 0;
 }
 
+/**
+ * Checks \c count buffers in order and stops at the first busy one.
+ * Buffers the GEM bufmgr already knows to be idle cost no ioctl.
+ *
+ * \return the index of the first busy buffer, or -1 if all of them are
+ * idle.  NULL entries are skipped.
+ */
+drm_public int
+drm_intel_bo_busy_array(drm_intel_bo **bo_array, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++) {
+		if (bo_array[i] && drm_intel_bo_busy(bo_array[i]))
+			return i;
+	}
+
+	return -1;
+}
+
 drm_public int
 drm_intel_bo_madvise(drm_intel_bo *bo, int madv)
 {
@@ -43,6 +43,7 @@ extern "C" {
 #endif
 
 struct drm_clip_rect;
+struct _drmBOStats;
 
 typedef struct _drm_intel_bufmgr drm_intel_bufmgr;
 typedef struct _drm_intel_context drm_intel_context;
@@ -109,6 +110,14 @@ typedef struct _drm_intel_aub_annotation {
 	uint32_t ending_offset;
 } drm_intel_aub_annotation;
 
+/** One region of a drm_intel_gem_bo_subdata_multi() upload */
+typedef struct _drm_intel_upload {
+	drm_intel_bo *bo;
+	unsigned long offset;
+	unsigned long size;
+	const void *data;
+} drm_intel_upload;
+
 #define BO_ALLOC_FOR_RENDER (1<<0)
 
 drm_intel_bo *drm_intel_bo_alloc(drm_intel_bufmgr *bufmgr, const char *name,
@@ -163,6 +172,7 @@ int drm_intel_bo_get_tiling(drm_intel_bo *bo, uint32_t * tiling_mode,
 			    uint32_t * swizzle_mode);
 int drm_intel_bo_flink(drm_intel_bo *bo, uint32_t * name);
 int drm_intel_bo_busy(drm_intel_bo *bo);
+int drm_intel_bo_busy_array(drm_intel_bo **bo_array, int count);
 int drm_intel_bo_madvise(drm_intel_bo *bo, int madv);
 int drm_intel_bo_use_48b_address_range(drm_intel_bo *bo, uint32_t enable);
 int drm_intel_bo_set_softpin_offset(drm_intel_bo *bo, uint64_t offset);
@@ -178,11 +188,31 @@ drm_intel_bo *drm_intel_bo_gem_create_from_name(drm_intel_bufmgr *bufmgr,
 						unsigned int handle);
 void drm_intel_bufmgr_gem_enable_reuse(drm_intel_bufmgr *bufmgr);
 void drm_intel_bufmgr_gem_enable_fenced_relocs(drm_intel_bufmgr *bufmgr);
+int drm_intel_bufmgr_gem_enable_no_reloc(drm_intel_bufmgr *bufmgr);
+int drm_intel_bufmgr_gem_enable_softpin(drm_intel_bufmgr *bufmgr);
 void drm_intel_bufmgr_gem_set_vma_cache_size(drm_intel_bufmgr *bufmgr,
 					     int limit);
+void drm_intel_bufmgr_gem_set_vma_cache_budget(drm_intel_bufmgr *bufmgr,
+					       unsigned long bytes);
+void drm_intel_bufmgr_gem_set_reuse_tolerance(drm_intel_bufmgr *bufmgr,
+					      int percent);
+void drm_intel_bufmgr_gem_set_bo_cache_budget(drm_intel_bufmgr *bufmgr,
+					      unsigned long bytes);
+void drm_intel_bufmgr_gem_bo_cache_trim(drm_intel_bufmgr *bufmgr,
+					unsigned long bytes);
+void drm_intel_bufmgr_gem_get_bo_stats(drm_intel_bufmgr *bufmgr,
+				       struct _drmBOStats *stats);
+void drm_intel_bufmgr_gem_enable_userptr_cache(drm_intel_bufmgr *bufmgr,
+					       int max);
+void drm_intel_bufmgr_gem_release_userptr(drm_intel_bufmgr *bufmgr,
+					  void *addr, unsigned long size);
 int drm_intel_gem_bo_map_unsynchronized(drm_intel_bo *bo);
 int drm_intel_gem_bo_map_gtt(drm_intel_bo *bo);
 int drm_intel_gem_bo_unmap_gtt(drm_intel_bo *bo);
+int drm_intel_gem_bo_map_wc(drm_intel_bo *bo);
+int drm_intel_gem_bo_map_wc_unsynchronized(drm_intel_bo *bo);
+int drm_intel_gem_bo_unmap_wc(drm_intel_bo *bo);
+int drm_intel_gem_bo_subdata_multi(drm_intel_upload *uploads, int count);
 
 #define HAVE_DRM_INTEL_GEM_BO_DISABLE_IMPLICIT_SYNC 1
 int drm_intel_bufmgr_gem_can_disable_implicit_sync(drm_intel_bufmgr *bufmgr);
@@ -282,6 +312,19 @@ int drm_intel_reg_read(drm_intel_bufmgr *bufmgr,
 		       uint32_t offset,
 		       uint64_t *result);
 
+typedef struct _drm_intel_batch_timestamp {
+	uint32_t batch;		/* count of timed batches before this one */
+	uint32_t ring;		/* I915_EXEC_* the batch ran on */
+	uint32_t start;		/* raw TIMESTAMP register ticks */
+	uint32_t end;
+	uint64_t ns;		/* end - start, 0 if the frequency is unknown */
+} drm_intel_batch_timestamp;
+
+int drm_intel_bufmgr_gem_enable_timestamps(drm_intel_bufmgr *bufmgr);
+int drm_intel_bufmgr_gem_poll_timestamps(drm_intel_bufmgr *bufmgr,
+					 drm_intel_batch_timestamp *results,
+					 int max);
+
 int drm_intel_get_reset_stats(drm_intel_context *ctx,
 			      uint32_t *reset_count,
 			      uint32_t *active,
@@ -0,0 +1,137 @@
+/*
+ * Copyright 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Allocation throughput of the GEM buffer manager with its reuse cache on.
+ * After a warm-up every allocation is served from the cache, so the loop
+ * measures the bucket lookups and the cache list handling.  Results are
+ * printed as JSON, one object per test.
+ *
+ * Usage: intel_bufmgr_bench [device node] [milliseconds per test]
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "xf86drm.h"
+#include "intel_bufmgr.h"
+
+#define NUM_MIXED_SIZES	64
+
+static drm_intel_bufmgr *bufmgr;
+static double duration;
+static int num_results;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, unsigned long size, unsigned long ops,
+		   double elapsed, int error)
+{
+	printf("%s\n    { \"name\": \"%s\"", num_results++ ? "," : "", name);
+	if (size)
+		printf(", \"size\": %lu", size);
+	if (error)
+		printf(", \"error\": %d }", error);
+	else
+		printf(", \"ops\": %lu, \"ops_per_sec\": %.1f, \"ns_per_op\": %.1f }",
+		       ops, ops / elapsed, ops ? elapsed * 1e9 / ops : 0.0);
+}
+
+/* Allocates and frees buffers of the given sizes in turn. */
+static void bench_alloc(const char *name, const unsigned long *sizes,
+			unsigned num_sizes)
+{
+	drm_intel_bo *bo;
+	unsigned long ops = 0;
+	double start = now(), elapsed;
+
+	do {
+		bo = drm_intel_bo_alloc(bufmgr, "bench", sizes[ops % num_sizes],
+					0);
+		if (!bo) {
+			report(name, num_sizes == 1 ? sizes[0] : 0, 0, 0, 1);
+			return;
+		}
+		drm_intel_bo_unreference(bo);
+		ops++;
+		elapsed = now() - start;
+	} while (elapsed < duration);
+
+	report(name, num_sizes == 1 ? sizes[0] : 0, ops, elapsed, 0);
+}
+
+int main(int argc, char **argv)
+{
+	static const unsigned long sizes[] = { 4096, 64 * 1024, 1024 * 1024,
+					       48 * 1024 * 1024 };
+	unsigned long mixed[NUM_MIXED_SIZES];
+	const char *node = argc > 1 ? argv[1] : "/dev/dri/renderD128";
+	int ms = argc > 2 ? atoi(argv[2]) : 0;
+	unsigned i;
+	int fd;
+
+	if (ms <= 0)
+		ms = 250;
+	duration = ms / 1000.0;
+
+	fd = open(node, O_RDWR | O_CLOEXEC);
+	if (fd < 0) {
+		perror(node);
+		return 1;
+	}
+
+	bufmgr = drm_intel_bufmgr_gem_init(fd, 4096);
+	if (!bufmgr) {
+		fprintf(stderr, "drm_intel_bufmgr_gem_init failed\n");
+		return 1;
+	}
+	drm_intel_bufmgr_gem_enable_reuse(bufmgr);
+
+	/* Sizes spread over the cached range, one of them per step. */
+	srand(1);
+	for (i = 0; i < NUM_MIXED_SIZES; i++) {
+		mixed[i] = 4096ul << (rand() % 13);
+		mixed[i] += mixed[i] / 4 * (rand() % 4);
+	}
+
+	printf("{\n  \"ms_per_test\": %d,\n  \"results\": [", ms);
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+		bench_alloc("bo_alloc_free", &sizes[i], 1);
+	bench_alloc("bo_alloc_free_mixed", mixed, NUM_MIXED_SIZES);
+
+	printf("\n  ]\n}\n");
+
+	drm_intel_bufmgr_destroy(bufmgr);
+	close(fd);
+	return 0;
+}
@@ -457,7 +457,7 @@ free_block(drm_intel_bufmgr_fake *bufmgr_fake, struct block *block,
 	   int skip_dirty_copy)
 {
 	drm_intel_bo_fake *bo_fake;
-	DBG("free block %p %08x %d %d\n", block, block->mem->ofs,
+	DBG("free block %p %08x %d %d\n", block, (unsigned)block->mem->ofs,
 	    block->on_hardware, block->fenced);
 
 	if (!block)
@@ -601,13 +601,15 @@ clear_fenced(drm_intel_bufmgr_fake *bufmgr_fake, unsigned int fence_cookie)
 
 			if (!block->bo) {
 				DBG("delayed free: offset %x sz %x\n",
-				    block->mem->ofs, block->mem->size);
+				    (unsigned)block->mem->ofs,
+				    (unsigned)block->mem->size);
 				DRMLISTDEL(block);
 				mmFreeMem(block->mem);
 				free(block);
 			} else {
 				DBG("return to lru: offset %x sz %x\n",
-				    block->mem->ofs, block->mem->size);
+				    (unsigned)block->mem->ofs,
+				    (unsigned)block->mem->size);
 				DRMLISTDEL(block);
 				DRMLISTADDTAIL(block, &bufmgr_fake->lru);
 			}
@@ -618,7 +620,8 @@ clear_fenced(drm_intel_bufmgr_fake *bufmgr_fake, unsigned int fence_cookie)
 			 * from here will fail also:
 			 */
 			DBG("fence not passed: offset %x sz %x %d %d \n",
-			    block->mem->ofs, block->mem->size, block->fence,
+			    (unsigned)block->mem->ofs,
+			    (unsigned)block->mem->size, block->fence,
 			    bufmgr_fake->last_fence);
 			break;
 		}
@@ -635,7 +638,8 @@ fence_blocks(drm_intel_bufmgr_fake *bufmgr_fake, unsigned fence)
 
 	DRMLISTFOREACHSAFE(block, tmp, &bufmgr_fake->on_hardware) {
 		DBG("Fence block %p (sz 0x%x ofs %x buf %p) with fence %d\n",
-		    block, block->mem->size, block->mem->ofs, block->bo, fence);
+		    block, (unsigned)block->mem->size,
+		    (unsigned)block->mem->ofs, block->bo, fence);
 		block->fence = fence;
 
 		block->on_hardware = 0;
@@ -1191,7 +1195,7 @@ static int
 	/* Upload the buffer contents if necessary */
 	if (bo_fake->dirty) {
 		DBG("Upload dirty buf %d:%s, sz %lu offset 0x%x\n", bo_fake->id,
-		    bo_fake->name, bo->size, bo_fake->block->mem->ofs);
+		    bo_fake->name, bo->size, (unsigned)bo_fake->block->mem->ofs);
 
 		assert(!(bo_fake->flags & (BM_NO_BACKING_STORE | BM_PINNED)));
 
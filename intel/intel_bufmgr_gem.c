@@ -54,9 +54,11 @@
 #endif
 #include "libdrm_macros.h"
 #include "libdrm_lists.h"
+#include "drm_bo_cache.h"
 #include "intel_bufmgr.h"
 #include "intel_bufmgr_priv.h"
 #include "intel_chipset.h"
+#include "mm.h"
 #include "string.h"
 
 #include "i915_drm.h"
@@ -98,9 +100,58 @@
 
 typedef struct _drm_intel_bo_gem drm_intel_bo_gem;
 
-struct drm_intel_gem_bo_bucket {
-	drmMMListHead head;
-	unsigned long size;
+/* Batches whose timestamps can be outstanding before the oldest is lost */
+#define TIMESTAMP_SLOTS 64
+/* Rings with a TIMESTAMP register: render, bsd, blt, vebox */
+#define TIMESTAMP_RINGS 4
+/* Bytes taken by one of the small batches writing a timestamp */
+#define TIMESTAMP_CMD_SIZE 64
+
+#define MI_BATCH_BUFFER_END		(0x0a << 23)
+#define MI_STORE_DATA_IMM		(0x20 << 23)
+#define MI_STORE_REGISTER_MEM		(0x24 << 23)
+
+/* Per slot: start and end ticks, and a dword set once both are written */
+struct drm_intel_gem_timestamp_slot {
+	uint32_t start;
+	uint32_t end;
+	uint32_t done;
+	uint32_t pad;
+};
+
+struct drm_intel_gem_timestamps {
+	drm_intel_bo *query_bo;
+	drm_intel_bo *cmd_bo;
+	volatile struct drm_intel_gem_timestamp_slot *slots;
+	uint64_t frequency;	/* Hz, 0 if unknown */
+
+	uint32_t submitted;	/* batches bracketed so far */
+	uint32_t polled;	/* of which handed out */
+	int ring[TIMESTAMP_SLOTS];	/* I915_EXEC_*, -1 if it failed */
+
+	/* [ring][slot][start, end], the end batch has two relocs */
+	struct drm_i915_gem_relocation_entry
+		relocs[TIMESTAMP_RINGS][TIMESTAMP_SLOTS][2][2];
+};
+
+/*
+ * Small buffers a thread frees are kept in a magazine for its next
+ * allocations, which then skip bufmgr_gem->lock.  Threads are spread over
+ * INTEL_BO_MAGAZINE_SHARDS magazines with a mutex each, always taken
+ * before bufmgr_gem->lock.  A full magazine returns its older half to
+ * bo_cache, and an empty one takes up to INTEL_BO_MAGAZINE_BATCH idle
+ * buffers from it, each under a single bufmgr_gem->lock acquisition.
+ * Buffers in a magazine stay unpurgeable, so only small ones qualify.
+ */
+#define INTEL_BO_MAGAZINE_SHARDS	8
+#define INTEL_BO_MAGAZINE_DEPTH		16
+#define INTEL_BO_MAGAZINE_BATCH		4
+#define INTEL_BO_MAGAZINE_MAX_SIZE	(64 * 1024)
+
+struct drm_intel_gem_magazine {
+	pthread_mutex_t lock;
+	int count;
+	drm_intel_bo_gem *bos[INTEL_BO_MAGAZINE_DEPTH];	/* oldest first */
 };
 
 typedef struct _drm_intel_bufmgr_gem {
@@ -108,6 +159,9 @@ typedef struct _drm_intel_bufmgr_gem {
 
 	atomic_t refcount;
 
+	/** Source of drm_intel_bo_gem::reloc_tree_id */
+	atomic_t reloc_tree_serial;
+
 	int fd;
 
 	int max_relocs;
@@ -120,10 +174,11 @@ typedef struct _drm_intel_bufmgr_gem {
 	int exec_size;
 	int exec_count;
 
-	/** Array of lists of cached gem objects of power-of-two sizes */
-	struct drm_intel_gem_bo_bucket cache_bucket[14 * 4];
-	int num_buckets;
-	time_t time;
+	/** Cached gem objects, in buckets by size */
+	struct drm_bo_cache bo_cache;
+
+	/** Per-thread fronts of bo_cache for small buffers */
+	struct drm_intel_gem_magazine magazines[INTEL_BO_MAGAZINE_SHARDS];
 
 	drmMMListHead managers;
 
@@ -132,6 +187,12 @@ typedef struct _drm_intel_bufmgr_gem {
 
 	drmMMListHead vma_cache;
 	int vma_count, vma_open, vma_max;
+	/**
+	 * Bytes of address space held by the CPU, WC and GTT mappings in
+	 * vma_cache, and the most to keep there (0: no limit)
+	 */
+	unsigned long vma_cpu_size, vma_wc_size, vma_gtt_size;
+	unsigned long vma_budget;
 
 	uint64_t gtt_size;
 	int available_fences;
@@ -146,13 +207,36 @@ typedef struct _drm_intel_bufmgr_gem {
 	unsigned int no_exec : 1;
 	unsigned int has_vebox : 1;
 	unsigned int has_exec_async : 1;
+	unsigned int has_exec_lut : 1;
 	bool fenced_relocs;
+	bool no_reloc;
+	bool softpin;
+
+	/** Softpin address space, NULL until softpin is enabled */
+	struct mem_block *va_heap;
+
+	/** GPU timestamps around batches, NULL until enabled */
+	struct drm_intel_gem_timestamps *timestamps;
 
 	struct {
 		void *ptr;
 		uint32_t handle;
 	} userptr_active;
 
+	/**
+	 * Released userptr buffers kept for reuse, least recently used first,
+	 * and the most to keep there (0: userptr reuse disabled)
+	 */
+	drmMMListHead userptr_cache;
+	int userptr_cache_count, userptr_cache_max;
+
+	/**
+	 * Buffers in the handle table, created or imported, and CPU, WC and
+	 * GTT mappings, for drm_intel_bufmgr_gem_get_bo_stats()
+	 */
+	uint64_t alloc_size, import_size, mmap_size;
+	unsigned int alloc_count, import_count, mmap_count;
+
 } drm_intel_bufmgr_gem;
 
 #define DRM_INTEL_RELOC_FENCE (1<<0)
@@ -194,7 +278,11 @@ struct _drm_intel_bo_gem {
 
 	unsigned long kflags;
 
-	time_t free_time;
+	/** Address range handed out by the softpin heap, or NULL */
+	struct mem_block *va_block;
+
+	/** BO cache entry */
+	struct drm_bo_cache_entry cache_entry;
 
 	/** Array passed to the DRM containing relocation information. */
 	struct drm_i915_gem_relocation_entry *relocs;
@@ -225,7 +313,7 @@ struct _drm_intel_bo_gem {
 	int map_count;
 	drmMMListHead vma_list;
 
-	/** BO cache list */
+	/** Userptr cache list */
 	drmMMListHead head;
 
 	/**
@@ -265,6 +353,14 @@ struct _drm_intel_bo_gem {
 	 */
 	bool is_userptr;
 
+	/**
+	 * Boolean of whether this buffer was opened from a flink name or a
+	 * prime fd.
+	 */
+	bool imported;
+	/** Flags the userptr object was created with */
+	uint32_t userptr_flags;
+
 	/**
 	 * Size in bytes of this buffer and its relocation descendents.
 	 *
@@ -279,6 +375,16 @@ struct _drm_intel_bo_gem {
 	 */
 	int reloc_tree_fences;
 
+	/**
+	 * Serial of the relocation tree whose reloc_tree_size this buffer
+	 * was last added to, and of this buffer's own tree (0: none).
+	 *
+	 * Lets relocations to an already counted target leave the running
+	 * total alone, so that it stays exact for the usual batch buffer.
+	 */
+	unsigned int counted_in_tree;
+	unsigned int reloc_tree_id;
+
 	/** Flags that we may need to do the SW_FINISH ioctl on unmap. */
 	bool mapped_cpu_write;
 };
@@ -392,23 +498,6 @@ drm_intel_gem_bo_tile_pitch(drm_intel_bufmgr_gem *bufmgr_gem,
 	return i;
 }
 
-static struct drm_intel_gem_bo_bucket *
-drm_intel_gem_bo_bucket_for_size(drm_intel_bufmgr_gem *bufmgr_gem,
-				 unsigned long size)
-{
-	int i;
-
-	for (i = 0; i < bufmgr_gem->num_buckets; i++) {
-		struct drm_intel_gem_bo_bucket *bucket =
-		    &bufmgr_gem->cache_bucket[i];
-		if (bucket->size >= size) {
-			return bucket;
-		}
-	}
-
-	return NULL;
-}
-
 static void
 drm_intel_gem_dump_validation_list(drm_intel_bufmgr_gem *bufmgr_gem)
 {
@@ -603,6 +692,7 @@ drm_intel_bo_gem_set_in_aperture_size(drm_intel_bufmgr_gem *bufmgr_gem,
 	}
 
 	bo_gem->reloc_tree_size = size + alignment;
+	bo_gem->counted_in_tree = 0;
 }
 
 static int
@@ -681,25 +771,306 @@ drm_intel_gem_bo_madvise(drm_intel_bo *bo, int madv)
 		 madv);
 }
 
-/* drop the oldest entries that have been purged by the kernel */
+/* Pins the bo at an address of its own if softpinning was enabled,
+ * keeping the one it had if it comes from the cache.  A bo the heap has
+ * no room for is left to relocations.
+ */
 static void
-drm_intel_gem_bo_cache_purge_bucket(drm_intel_bufmgr_gem *bufmgr_gem,
-				    struct drm_intel_gem_bo_bucket *bucket)
+drm_intel_gem_bo_assign_va(drm_intel_bufmgr_gem *bufmgr_gem,
+			   drm_intel_bo_gem *bo_gem, unsigned int alignment)
 {
-	while (!DRMLISTEMPTY(&bucket->head)) {
-		drm_intel_bo_gem *bo_gem;
+	uint64_t offset;
 
-		bo_gem = DRMLISTENTRY(drm_intel_bo_gem,
-				      bucket->head.next, head);
-		if (drm_intel_gem_bo_madvise_internal
-		    (bufmgr_gem, bo_gem, I915_MADV_DONTNEED))
-			break;
+	if (!bufmgr_gem->softpin)
+		return;
+
+	if (alignment < 4096)
+		alignment = 4096;
+
+	if (bo_gem->va_block && (bo_gem->bo.offset64 & (alignment - 1))) {
+		mmFreeMem(bo_gem->va_block);
+		bo_gem->va_block = NULL;
+	}
 
-		DRMLISTDEL(&bo_gem->head);
+	if (!bo_gem->va_block) {
+		uint64_t size = ALIGN(bo_gem->bo.size, 4096);
+
+		bo_gem->va_block = mmAllocMem(bufmgr_gem->va_heap, size,
+					      ffs(alignment) - 1, 0);
+		if (!bo_gem->va_block)
+			return;
+
+		offset = bo_gem->va_block->ofs;
+		bo_gem->bo.offset64 = offset;
+		bo_gem->bo.offset = offset;
+	}
+
+	bo_gem->kflags |= EXEC_OBJECT_PINNED;
+	if (bo_gem->bo.offset64 + bo_gem->va_block->size > 1ull << 32)
+		bo_gem->kflags |= EXEC_OBJECT_SUPPORTS_48B_ADDRESS;
+}
+
+/** Counts a buffer entering (or leaving) the handle table in the stats. */
+static void
+drm_intel_gem_bo_stats_account(drm_intel_bufmgr_gem *bufmgr_gem,
+			       drm_intel_bo_gem *bo_gem, bool add)
+{
+	uint64_t size = bo_gem->bo.size;
+
+	if (bo_gem->imported || bo_gem->is_userptr) {
+		bufmgr_gem->import_size += add ? size : -size;
+		bufmgr_gem->import_count += add ? 1 : -1;
+	} else {
+		bufmgr_gem->alloc_size += add ? size : -size;
+		bufmgr_gem->alloc_count += add ? 1 : -1;
+	}
+}
+
+/** Counts a new mapping of the buffer (or one going away) in the stats. */
+static void
+drm_intel_gem_bo_mmap_account(drm_intel_bufmgr_gem *bufmgr_gem,
+			      drm_intel_bo_gem *bo_gem, bool add)
+{
+	uint64_t size = bo_gem->bo.size;
+
+	bufmgr_gem->mmap_size += add ? size : -size;
+	bufmgr_gem->mmap_count += add ? 1 : -1;
+}
+
+/** Resets the state of a new or reused buffer for its new owner. */
+static void
+drm_intel_gem_bo_init_state(drm_intel_bo_gem *bo_gem, const char *name)
+{
+	bo_gem->name = name;
+	atomic_set(&bo_gem->refcount, 1);
+	bo_gem->validate_index = -1;
+	bo_gem->reloc_tree_fences = 0;
+	bo_gem->used_as_reloc_target = false;
+	bo_gem->has_error = false;
+	bo_gem->reusable = true;
+}
+
+/**
+ * Puts an unreferenced buffer into bo_cache, or frees it if its pages were
+ * already purged.  Called with bufmgr_gem->lock held.
+ */
+static void
+drm_intel_gem_bo_cache_put_locked(drm_intel_bufmgr_gem *bufmgr_gem,
+				  drm_intel_bo_gem *bo_gem, time_t time)
+{
+	free(bo_gem->reloc_target_info);
+	bo_gem->reloc_target_info = NULL;
+	free(bo_gem->relocs);
+	bo_gem->relocs = NULL;
+
+	if (drm_intel_gem_bo_madvise_internal(bufmgr_gem, bo_gem,
+					      I915_MADV_DONTNEED)) {
+		bo_gem->name = NULL;
+		bo_gem->validate_index = -1;
+
+		bo_gem->cache_entry.dontneed = 1;
+		drm_bo_cache_put(&bufmgr_gem->bo_cache, &bo_gem->cache_entry,
+				 bo_gem->bo.size, time);
+	} else {
 		drm_intel_gem_bo_free(&bo_gem->bo);
 	}
 }
 
+static pthread_once_t drm_intel_gem_magazine_once = PTHREAD_ONCE_INIT;
+static pthread_key_t drm_intel_gem_magazine_key;
+static bool drm_intel_gem_magazine_key_valid;
+static atomic_t drm_intel_gem_magazine_slots;
+
+static void drm_intel_gem_magazine_key_create(void)
+{
+	drm_intel_gem_magazine_key_valid =
+		!pthread_key_create(&drm_intel_gem_magazine_key, NULL);
+}
+
+static struct drm_intel_gem_magazine *
+drm_intel_gem_magazine(drm_intel_bufmgr_gem *bufmgr_gem)
+{
+	uintptr_t slot = 0;
+
+	pthread_once(&drm_intel_gem_magazine_once,
+		     drm_intel_gem_magazine_key_create);
+	if (drm_intel_gem_magazine_key_valid) {
+		slot = (uintptr_t)pthread_getspecific(drm_intel_gem_magazine_key);
+		if (!slot) {
+			slot = (unsigned)atomic_inc_return(&drm_intel_gem_magazine_slots);
+			pthread_setspecific(drm_intel_gem_magazine_key,
+					    (void *)slot);
+		}
+	}
+	return &bufmgr_gem->magazines[slot % INTEL_BO_MAGAZINE_SHARDS];
+}
+
+/**
+ * Returns the size buffers of the bucket for \p size get when they come
+ * through a magazine, or 0 if they don't.
+ */
+static uint64_t
+drm_intel_gem_magazine_size(drm_intel_bufmgr_gem *bufmgr_gem,
+			    struct drm_bo_cache_bucket *bucket)
+{
+	/* With a reuse tolerance cached sizes are not rounded to buckets. */
+	if (!bucket || !bufmgr_gem->bo_reuse || bufmgr_gem->bo_cache.tolerance ||
+	    bucket->size > INTEL_BO_MAGAZINE_MAX_SIZE)
+		return 0;
+	return bucket->size;
+}
+
+/**
+ * Takes a buffer of \p bucket's size out of the calling thread's
+ * magazine, refilling it from bo_cache if it has none.  Like bo_cache, a
+ * render target gets the most recently freed buffer, anything else the
+ * least recently freed one if it is idle.  Returns NULL if there is none.
+ */
+static drm_intel_bo_gem *
+drm_intel_gem_magazine_get(drm_intel_bufmgr_gem *bufmgr_gem,
+			   struct drm_bo_cache_bucket *bucket, bool for_render)
+{
+	uint64_t size = drm_intel_gem_magazine_size(bufmgr_gem, bucket);
+	struct drm_intel_gem_magazine *mag;
+	struct drm_bo_cache_entry *entry;
+	drm_intel_bo_gem *bo_gem = NULL;
+	int i, n;
+
+	if (!size)
+		return NULL;
+
+	mag = drm_intel_gem_magazine(bufmgr_gem);
+	pthread_mutex_lock(&mag->lock);
+
+	for (n = 0; n < mag->count; n++) {
+		i = for_render ? mag->count - 1 - n : n;
+		if (mag->bos[i]->bo.size != size)
+			continue;
+		if (!for_render && drm_intel_gem_bo_busy(&mag->bos[i]->bo))
+			break;
+		bo_gem = mag->bos[i];
+		memmove(&mag->bos[i], &mag->bos[i + 1],
+			(mag->count - i - 1) * sizeof(mag->bos[0]));
+		mag->count--;
+		goto out;
+	}
+
+	/* Peeking at the bucket without the lock only decides whether to
+	 * take it, bo_cache is only changed under it.
+	 */
+	if (LIST_IS_EMPTY(&bucket->list))
+		goto out;
+
+	pthread_mutex_lock(&bufmgr_gem->lock);
+	for (n = 0; n < INTEL_BO_MAGAZINE_BATCH &&
+		    mag->count < INTEL_BO_MAGAZINE_DEPTH; n++) {
+		uint64_t bo_size = size;
+
+		entry = drm_bo_cache_get(&bufmgr_gem->bo_cache, &bo_size, 0,
+					 false);
+		if (!entry)
+			break;
+		mag->bos[mag->count++] = DRMLISTENTRY(drm_intel_bo_gem, entry,
+						      cache_entry);
+	}
+	pthread_mutex_unlock(&bufmgr_gem->lock);
+
+	if (n)
+		bo_gem = mag->bos[--mag->count];
+out:
+	pthread_mutex_unlock(&mag->lock);
+	return bo_gem;
+}
+
+/**
+ * Drops the last reference to \p bo_gem into the calling thread's
+ * magazine.  Returns false, with the reference left alone, if the buffer
+ * has to go through drm_intel_gem_bo_unreference_final() instead.
+ *
+ * Only reusable buffers qualify.  They were never exported, so nothing can
+ * look up their handle and take a new reference while the last one is
+ * dropped without bufmgr_gem->lock.
+ */
+static bool
+drm_intel_gem_magazine_put(drm_intel_bufmgr_gem *bufmgr_gem,
+			   drm_intel_bo_gem *bo_gem)
+{
+	drm_intel_bo_gem *spill[INTEL_BO_MAGAZINE_DEPTH / 2];
+	struct drm_intel_gem_magazine *mag;
+	struct timespec time;
+	uint64_t size;
+	int i, n = 0;
+
+	if (!bo_gem->reusable || bo_gem->is_userptr || bo_gem->reloc_count ||
+	    bo_gem->softpin_target_count || bo_gem->map_count)
+		return false;
+
+	size = drm_intel_gem_magazine_size(bufmgr_gem,
+			drm_bo_cache_bucket(&bufmgr_gem->bo_cache,
+					    bo_gem->bo.size));
+	if (size != bo_gem->bo.size)
+		return false;
+
+	if (!atomic_dec_and_test(&bo_gem->refcount))
+		return true;
+
+	DBG("bo_unreference final: %d (%s), to magazine\n",
+	    bo_gem->gem_handle, bo_gem->name);
+
+	bo_gem->name = NULL;
+	bo_gem->validate_index = -1;
+	bo_gem->kflags = 0;
+	bo_gem->used_as_reloc_target = false;
+
+	mag = drm_intel_gem_magazine(bufmgr_gem);
+	pthread_mutex_lock(&mag->lock);
+	if (mag->count == INTEL_BO_MAGAZINE_DEPTH) {
+		n = INTEL_BO_MAGAZINE_DEPTH / 2;
+		memcpy(spill, mag->bos, n * sizeof(mag->bos[0]));
+		memmove(mag->bos, &mag->bos[n],
+			(mag->count - n) * sizeof(mag->bos[0]));
+		mag->count -= n;
+	}
+	mag->bos[mag->count++] = bo_gem;
+
+	if (n) {
+		clock_gettime(CLOCK_MONOTONIC, &time);
+		pthread_mutex_lock(&bufmgr_gem->lock);
+		for (i = 0; i < n; i++)
+			drm_intel_gem_bo_cache_put_locked(bufmgr_gem, spill[i],
+							  time.tv_sec);
+		drm_bo_cache_cleanup(&bufmgr_gem->bo_cache, time.tv_sec);
+		pthread_mutex_unlock(&bufmgr_gem->lock);
+	}
+	pthread_mutex_unlock(&mag->lock);
+	return true;
+}
+
+/** Returns the buffers of all magazines to bo_cache. */
+static void
+drm_intel_gem_magazines_drain(drm_intel_bufmgr_gem *bufmgr_gem)
+{
+	struct drm_intel_gem_magazine *mag;
+	struct timespec time;
+	int i, j;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	for (i = 0; i < INTEL_BO_MAGAZINE_SHARDS; i++) {
+		mag = &bufmgr_gem->magazines[i];
+		pthread_mutex_lock(&mag->lock);
+		if (mag->count) {
+			pthread_mutex_lock(&bufmgr_gem->lock);
+			for (j = 0; j < mag->count; j++)
+				drm_intel_gem_bo_cache_put_locked(bufmgr_gem,
+								  mag->bos[j],
+								  time.tv_sec);
+			mag->count = 0;
+			pthread_mutex_unlock(&bufmgr_gem->lock);
+		}
+		pthread_mutex_unlock(&mag->lock);
+	}
+}
+
 static drm_intel_bo *
 drm_intel_gem_bo_alloc_internal(drm_intel_bufmgr *bufmgr,
 				const char *name,
@@ -713,75 +1084,86 @@ drm_intel_gem_bo_alloc_internal(drm_intel_bufmgr *bufmgr,
 	drm_intel_bo_gem *bo_gem;
 	unsigned int page_size = getpagesize();
 	int ret;
-	struct drm_intel_gem_bo_bucket *bucket;
+	struct drm_bo_cache_bucket *bucket;
+	struct drm_bo_cache_entry *entry;
 	bool alloc_from_cache;
-	unsigned long bo_size;
+	uint64_t bo_size;
 	bool for_render = false;
 
 	if (flags & BO_ALLOC_FOR_RENDER)
 		for_render = true;
 
-	/* Round the allocated size up to a power of two number of pages. */
-	bucket = drm_intel_gem_bo_bucket_for_size(bufmgr_gem, size);
-
 	/* If we don't have caching at this size, don't actually round the
-	 * allocation up.
+	 * allocation up.  Otherwise drm_bo_cache_get() rounds it up to the
+	 * bucket size, unless cached buffers of other sizes in the bucket
+	 * may be reused, see drm_intel_bufmgr_gem_set_reuse_tolerance().
 	 */
+	bucket = drm_bo_cache_bucket(&bufmgr_gem->bo_cache, size);
 	if (bucket == NULL) {
 		bo_size = size;
 		if (bo_size < page_size)
 			bo_size = page_size;
 	} else {
-		bo_size = bucket->size;
+		bo_size = ALIGN(size, page_size);
+	}
+
+	bo_gem = drm_intel_gem_magazine_get(bufmgr_gem, bucket, for_render);
+	if (bo_gem) {
+		if (for_render)
+			bo_gem->bo.align = alignment;
+		else
+			assert(alignment == 0);
+
+		if (drm_intel_gem_bo_set_tiling_internal(&bo_gem->bo,
+							 tiling_mode,
+							 stride) == 0) {
+			drm_intel_gem_bo_init_state(bo_gem, name);
+			/* Only softpin may need the shared address space */
+			if (bufmgr_gem->softpin)
+				pthread_mutex_lock(&bufmgr_gem->lock);
+			drm_intel_gem_bo_assign_va(bufmgr_gem, bo_gem, alignment);
+			if (bufmgr_gem->softpin)
+				pthread_mutex_unlock(&bufmgr_gem->lock);
+			drm_intel_bo_gem_set_in_aperture_size(bufmgr_gem, bo_gem,
+							      alignment);
+
+			DBG("bo_create: buf %d (%s) %ldb, from magazine\n",
+			    bo_gem->gem_handle, bo_gem->name, size);
+			return &bo_gem->bo;
+		}
+
+		pthread_mutex_lock(&bufmgr_gem->lock);
+		drm_intel_gem_bo_free(&bo_gem->bo);
+		pthread_mutex_unlock(&bufmgr_gem->lock);
 	}
 
 	pthread_mutex_lock(&bufmgr_gem->lock);
 	/* Get a buffer out of the cache if available */
 retry:
 	alloc_from_cache = false;
-	if (bucket != NULL && !DRMLISTEMPTY(&bucket->head)) {
-		if (for_render) {
-			/* Allocate new render-target BOs from the tail (MRU)
-			 * of the list, as it will likely be hot in the GPU
-			 * cache and in the aperture for us.
-			 */
-			bo_gem = DRMLISTENTRY(drm_intel_bo_gem,
-					      bucket->head.prev, head);
-			DRMLISTDEL(&bo_gem->head);
-			alloc_from_cache = true;
+	/* Allocate new render-target BOs from the tail (MRU) of the bucket,
+	 * as it will likely be hot in the GPU cache and in the aperture for
+	 * us.  For non-render-target BOs (where we're probably going to map
+	 * it first thing in order to fill it with data), only the least
+	 * recently freed one is checked for being unbusy.  Otherwise,
+	 * allocating a new buffer is probably faster than waiting for the
+	 * GPU to finish.
+	 */
+	entry = drm_bo_cache_get(&bufmgr_gem->bo_cache, &bo_size, 0,
+				 for_render);
+	if (entry) {
+		bo_gem = DRMLISTENTRY(drm_intel_bo_gem, entry, cache_entry);
+		alloc_from_cache = true;
+		if (for_render)
 			bo_gem->bo.align = alignment;
-		} else {
+		else
 			assert(alignment == 0);
-			/* For non-render-target BOs (where we're probably
-			 * going to map it first thing in order to fill it
-			 * with data), check if the last BO in the cache is
-			 * unbusy, and only reuse in that case. Otherwise,
-			 * allocating a new buffer is probably faster than
-			 * waiting for the GPU to finish.
-			 */
-			bo_gem = DRMLISTENTRY(drm_intel_bo_gem,
-					      bucket->head.next, head);
-			if (!drm_intel_gem_bo_busy(&bo_gem->bo)) {
-				alloc_from_cache = true;
-				DRMLISTDEL(&bo_gem->head);
-			}
-		}
 
-		if (alloc_from_cache) {
-			if (!drm_intel_gem_bo_madvise_internal
-			    (bufmgr_gem, bo_gem, I915_MADV_WILLNEED)) {
-				drm_intel_gem_bo_free(&bo_gem->bo);
-				drm_intel_gem_bo_cache_purge_bucket(bufmgr_gem,
-								    bucket);
-				goto retry;
-			}
-
-			if (drm_intel_gem_bo_set_tiling_internal(&bo_gem->bo,
-								 tiling_mode,
-								 stride)) {
-				drm_intel_gem_bo_free(&bo_gem->bo);
-				goto retry;
-			}
+		if (drm_intel_gem_bo_set_tiling_internal(&bo_gem->bo,
+							 tiling_mode,
+							 stride)) {
+			drm_intel_gem_bo_free(&bo_gem->bo);
+			goto retry;
 		}
 	}
 
@@ -813,6 +1195,7 @@ retry:
 		HASH_ADD(handle_hh, bufmgr_gem->handle_table,
 			 gem_handle, sizeof(bo_gem->gem_handle),
 			 bo_gem);
+		drm_intel_gem_bo_stats_account(bufmgr_gem, bo_gem, true);
 
 		bo_gem->bo.handle = bo_gem->gem_handle;
 		bo_gem->bo.bufmgr = bufmgr;
@@ -828,14 +1211,8 @@ retry:
 			goto err_free;
 	}
 
-	bo_gem->name = name;
-	atomic_set(&bo_gem->refcount, 1);
-	bo_gem->validate_index = -1;
-	bo_gem->reloc_tree_fences = 0;
-	bo_gem->used_as_reloc_target = false;
-	bo_gem->has_error = false;
-	bo_gem->reusable = true;
-
+	drm_intel_gem_bo_init_state(bo_gem, name);
+	drm_intel_gem_bo_assign_va(bufmgr_gem, bo_gem, alignment);
 	drm_intel_bo_gem_set_in_aperture_size(bufmgr_gem, bo_gem, alignment);
 	pthread_mutex_unlock(&bufmgr_gem->lock);
 
@@ -925,6 +1302,55 @@ drm_intel_gem_bo_alloc_tiled(drm_intel_bufmgr *bufmgr, const char *name,
 					       tiling, stride, 0);
 }
 
+/**
+ * Take a released userptr buffer wrapping exactly [addr, addr + size) with
+ * the same flags out of the userptr cache.  Called with the lock held.
+ */
+static drm_intel_bo_gem *
+drm_intel_gem_userptr_cache_lookup(drm_intel_bufmgr_gem *bufmgr_gem,
+				   void *addr, unsigned long size,
+				   unsigned long flags)
+{
+	drm_intel_bo_gem *bo_gem;
+
+	DRMLISTFOREACHENTRY(bo_gem, &bufmgr_gem->userptr_cache, head) {
+		if (bo_gem->user_virtual != addr ||
+		    bo_gem->bo.size != size ||
+		    bo_gem->userptr_flags != flags)
+			continue;
+
+		DRMLISTDELINIT(&bo_gem->head);
+		bufmgr_gem->userptr_cache_count--;
+		atomic_set(&bo_gem->refcount, 1);
+		bo_gem->bo.virtual = addr;
+		bo_gem->validate_index = -1;
+		bo_gem->reloc_tree_fences = 0;
+		bo_gem->used_as_reloc_target = false;
+		bo_gem->has_error = false;
+		return bo_gem;
+	}
+
+	return NULL;
+}
+
+/**
+ * Free cached userptr buffers, oldest first, until at most max remain.
+ * Called with the lock held.
+ */
+static void
+drm_intel_gem_userptr_cache_trim(drm_intel_bufmgr_gem *bufmgr_gem, int max)
+{
+	while (bufmgr_gem->userptr_cache_count > max) {
+		drm_intel_bo_gem *bo_gem =
+			DRMLISTENTRY(drm_intel_bo_gem,
+				     bufmgr_gem->userptr_cache.next, head);
+
+		DRMLISTDELINIT(&bo_gem->head);
+		bufmgr_gem->userptr_cache_count--;
+		drm_intel_gem_bo_free(&bo_gem->bo);
+	}
+}
+
 static drm_intel_bo *
 drm_intel_gem_bo_alloc_userptr(drm_intel_bufmgr *bufmgr,
 				const char *name,
@@ -945,12 +1371,31 @@ drm_intel_gem_bo_alloc_userptr(drm_intel_bufmgr *bufmgr,
 	if (tiling_mode != I915_TILING_NONE)
 		return NULL;
 
+	if (bufmgr_gem->userptr_cache_max) {
+		pthread_mutex_lock(&bufmgr_gem->lock);
+		bo_gem = drm_intel_gem_userptr_cache_lookup(bufmgr_gem, addr,
+							    size, flags);
+		if (bo_gem) {
+			bo_gem->name = name;
+			drm_intel_bo_gem_set_in_aperture_size(bufmgr_gem,
+							      bo_gem, 0);
+		}
+		pthread_mutex_unlock(&bufmgr_gem->lock);
+		if (bo_gem) {
+			DBG("bo_create_userptr: reused buf %d (%s) for "
+			    "ptr %p size %ldb\n", bo_gem->gem_handle,
+			    bo_gem->name, addr, size);
+			return &bo_gem->bo;
+		}
+	}
+
 	bo_gem = calloc(1, sizeof(*bo_gem));
 	if (!bo_gem)
 		return NULL;
 
 	atomic_set(&bo_gem->refcount, 1);
 	DRMINITLISTHEAD(&bo_gem->vma_list);
+	DRMINITLISTHEAD(&bo_gem->head);
 
 	bo_gem->bo.size = size;
 
@@ -976,6 +1421,7 @@ drm_intel_gem_bo_alloc_userptr(drm_intel_bufmgr *bufmgr,
 	bo_gem->bo.handle = bo_gem->gem_handle;
 	bo_gem->bo.bufmgr    = bufmgr;
 	bo_gem->is_userptr   = true;
+	bo_gem->userptr_flags = flags;
 	bo_gem->bo.virtual   = addr;
 	/* Save the address provided by user */
 	bo_gem->user_virtual = addr;
@@ -986,14 +1432,16 @@ drm_intel_gem_bo_alloc_userptr(drm_intel_bufmgr *bufmgr,
 	HASH_ADD(handle_hh, bufmgr_gem->handle_table,
 		 gem_handle, sizeof(bo_gem->gem_handle),
 		 bo_gem);
+	drm_intel_gem_bo_stats_account(bufmgr_gem, bo_gem, true);
 
 	bo_gem->name = name;
 	bo_gem->validate_index = -1;
 	bo_gem->reloc_tree_fences = 0;
 	bo_gem->used_as_reloc_target = false;
 	bo_gem->has_error = false;
-	bo_gem->reusable = false;
+	bo_gem->reusable = bufmgr_gem->userptr_cache_max != 0;
 
+	drm_intel_gem_bo_assign_va(bufmgr_gem, bo_gem, 0);
 	drm_intel_bo_gem_set_in_aperture_size(bufmgr_gem, bo_gem, 0);
 	pthread_mutex_unlock(&bufmgr_gem->lock);
 
@@ -1140,9 +1588,11 @@ drm_intel_bo_gem_create_from_name(drm_intel_bufmgr *bufmgr,
 	bo_gem->bo.handle = open_arg.handle;
 	bo_gem->global_name = handle;
 	bo_gem->reusable = false;
+	bo_gem->imported = true;
 
 	HASH_ADD(handle_hh, bufmgr_gem->handle_table,
 		 gem_handle, sizeof(bo_gem->gem_handle), bo_gem);
+	drm_intel_gem_bo_stats_account(bufmgr_gem, bo_gem, true);
 	HASH_ADD(name_hh, bufmgr_gem->name_table,
 		 global_name, sizeof(bo_gem->global_name), bo_gem);
 
@@ -1157,6 +1607,7 @@ drm_intel_bo_gem_create_from_name(drm_intel_bufmgr *bufmgr,
 	bo_gem->tiling_mode = get_tiling.tiling_mode;
 	bo_gem->swizzle_mode = get_tiling.swizzle_mode;
 	/* XXX stride is unknown */
+	drm_intel_gem_bo_assign_va(bufmgr_gem, bo_gem, 0);
 	drm_intel_bo_gem_set_in_aperture_size(bufmgr_gem, bo_gem, 0);
 	DBG("bo_create_from_handle: %d (%s)\n", handle, bo_gem->name);
 
@@ -1170,6 +1621,43 @@ err_unref:
 	return NULL;
 }
 
+/* Adds the mappings of a bo entering the vma cache to the byte counts,
+ * or takes those of one leaving it away.
+ */
+static void
+drm_intel_gem_bo_vma_account(drm_intel_bufmgr_gem *bufmgr_gem,
+			     drm_intel_bo_gem *bo_gem, bool cached)
+{
+	unsigned long size = bo_gem->bo.size;
+
+	if (bo_gem->mem_virtual) {
+		if (cached)
+			bufmgr_gem->vma_cpu_size += size;
+		else
+			bufmgr_gem->vma_cpu_size -= size;
+	}
+	if (bo_gem->wc_virtual) {
+		if (cached)
+			bufmgr_gem->vma_wc_size += size;
+		else
+			bufmgr_gem->vma_wc_size -= size;
+	}
+	if (bo_gem->gtt_virtual) {
+		if (cached)
+			bufmgr_gem->vma_gtt_size += size;
+		else
+			bufmgr_gem->vma_gtt_size -= size;
+	}
+}
+
+static bool
+drm_intel_gem_vma_over_budget(drm_intel_bufmgr_gem *bufmgr_gem)
+{
+	return bufmgr_gem->vma_budget &&
+	       bufmgr_gem->vma_cpu_size + bufmgr_gem->vma_wc_size +
+	       bufmgr_gem->vma_gtt_size > bufmgr_gem->vma_budget;
+}
+
 static void
 drm_intel_gem_bo_free(drm_intel_bo *bo)
 {
@@ -1179,24 +1667,33 @@ drm_intel_gem_bo_free(drm_intel_bo *bo)
 	int ret;
 
 	DRMLISTDEL(&bo_gem->vma_list);
+	if (bo_gem->map_count == 0)
+		drm_intel_gem_bo_vma_account(bufmgr_gem, bo_gem, false);
 	if (bo_gem->mem_virtual) {
 		VG(VALGRIND_FREELIKE_BLOCK(bo_gem->mem_virtual, 0));
 		drm_munmap(bo_gem->mem_virtual, bo_gem->bo.size);
+		drm_intel_gem_bo_mmap_account(bufmgr_gem, bo_gem, false);
 		bufmgr_gem->vma_count--;
 	}
 	if (bo_gem->wc_virtual) {
 		VG(VALGRIND_FREELIKE_BLOCK(bo_gem->wc_virtual, 0));
 		drm_munmap(bo_gem->wc_virtual, bo_gem->bo.size);
+		drm_intel_gem_bo_mmap_account(bufmgr_gem, bo_gem, false);
 		bufmgr_gem->vma_count--;
 	}
 	if (bo_gem->gtt_virtual) {
 		drm_munmap(bo_gem->gtt_virtual, bo_gem->bo.size);
+		drm_intel_gem_bo_mmap_account(bufmgr_gem, bo_gem, false);
 		bufmgr_gem->vma_count--;
 	}
 
+	if (bo_gem->va_block)
+		mmFreeMem(bo_gem->va_block);
+
 	if (bo_gem->global_name)
 		HASH_DELETE(name_hh, bufmgr_gem->name_table, bo_gem);
 	HASH_DELETE(handle_hh, bufmgr_gem->handle_table, bo_gem);
+	drm_intel_gem_bo_stats_account(bufmgr_gem, bo_gem, false);
 
 	/* Close this object */
 	memclear(close);
@@ -1230,40 +1727,28 @@ drm_intel_gem_bo_mark_mmaps_incoherent(drm_intel_bo *bo)
 static void
 drm_intel_gem_cleanup_bo_cache(drm_intel_bufmgr_gem *bufmgr_gem, time_t time)
 {
-	int i;
-
-	if (bufmgr_gem->time == time)
-		return;
-
-	for (i = 0; i < bufmgr_gem->num_buckets; i++) {
-		struct drm_intel_gem_bo_bucket *bucket =
-		    &bufmgr_gem->cache_bucket[i];
-
-		while (!DRMLISTEMPTY(&bucket->head)) {
-			drm_intel_bo_gem *bo_gem;
-
-			bo_gem = DRMLISTENTRY(drm_intel_bo_gem,
-					      bucket->head.next, head);
-			if (time - bo_gem->free_time <= 1)
-				break;
-
-			DRMLISTDEL(&bo_gem->head);
-
-			drm_intel_gem_bo_free(&bo_gem->bo);
-		}
-	}
+	drm_bo_cache_cleanup(&bufmgr_gem->bo_cache, time);
+}
 
-	bufmgr_gem->time = time;
+/** Frees the least recently cached buffers until at most @bytes are left. */
+static void
+drm_intel_gem_bo_cache_trim_locked(drm_intel_bufmgr_gem *bufmgr_gem,
+				   unsigned long bytes)
+{
+	drm_bo_cache_trim(&bufmgr_gem->bo_cache, bytes);
 }
 
 static void drm_intel_gem_bo_purge_vma_cache(drm_intel_bufmgr_gem *bufmgr_gem)
 {
 	int limit;
 
-	DBG("%s: cached=%d, open=%d, limit=%d\n", __FUNCTION__,
-	    bufmgr_gem->vma_count, bufmgr_gem->vma_open, bufmgr_gem->vma_max);
+	DBG("%s: cached=%d, open=%d, limit=%d, "
+	    "cpu=%lu, wc=%lu, gtt=%lu, budget=%lu\n", __FUNCTION__,
+	    bufmgr_gem->vma_count, bufmgr_gem->vma_open, bufmgr_gem->vma_max,
+	    bufmgr_gem->vma_cpu_size, bufmgr_gem->vma_wc_size,
+	    bufmgr_gem->vma_gtt_size, bufmgr_gem->vma_budget);
 
-	if (bufmgr_gem->vma_max < 0)
+	if (bufmgr_gem->vma_max < 0 && !bufmgr_gem->vma_budget)
 		return;
 
 	/* We may need to evict a few entries in order to create new mmaps */
@@ -1271,7 +1756,10 @@ static void drm_intel_gem_bo_purge_vma_cache(drm_intel_bufmgr_gem *bufmgr_gem)
 	if (limit < 0)
 		limit = 0;
 
-	while (bufmgr_gem->vma_count > limit) {
+	/* Oldest first, until both the count and the byte budget fit */
+	while (!DRMLISTEMPTY(&bufmgr_gem->vma_cache) &&
+	       ((bufmgr_gem->vma_max >= 0 && bufmgr_gem->vma_count > limit) ||
+		drm_intel_gem_vma_over_budget(bufmgr_gem))) {
 		drm_intel_bo_gem *bo_gem;
 
 		bo_gem = DRMLISTENTRY(drm_intel_bo_gem,
@@ -1279,19 +1767,23 @@ static void drm_intel_gem_bo_purge_vma_cache(drm_intel_bufmgr_gem *bufmgr_gem)
 				      vma_list);
 		assert(bo_gem->map_count == 0);
 		DRMLISTDELINIT(&bo_gem->vma_list);
+		drm_intel_gem_bo_vma_account(bufmgr_gem, bo_gem, false);
 
 		if (bo_gem->mem_virtual) {
 			drm_munmap(bo_gem->mem_virtual, bo_gem->bo.size);
+			drm_intel_gem_bo_mmap_account(bufmgr_gem, bo_gem, false);
 			bo_gem->mem_virtual = NULL;
 			bufmgr_gem->vma_count--;
 		}
 		if (bo_gem->wc_virtual) {
 			drm_munmap(bo_gem->wc_virtual, bo_gem->bo.size);
+			drm_intel_gem_bo_mmap_account(bufmgr_gem, bo_gem, false);
 			bo_gem->wc_virtual = NULL;
 			bufmgr_gem->vma_count--;
 		}
 		if (bo_gem->gtt_virtual) {
 			drm_munmap(bo_gem->gtt_virtual, bo_gem->bo.size);
+			drm_intel_gem_bo_mmap_account(bufmgr_gem, bo_gem, false);
 			bo_gem->gtt_virtual = NULL;
 			bufmgr_gem->vma_count--;
 		}
@@ -1303,6 +1795,7 @@ static void drm_intel_gem_bo_close_vma(drm_intel_bufmgr_gem *bufmgr_gem,
 {
 	bufmgr_gem->vma_open--;
 	DRMLISTADDTAIL(&bo_gem->vma_list, &bufmgr_gem->vma_cache);
+	drm_intel_gem_bo_vma_account(bufmgr_gem, bo_gem, true);
 	if (bo_gem->mem_virtual)
 		bufmgr_gem->vma_count++;
 	if (bo_gem->wc_virtual)
@@ -1317,6 +1810,7 @@ static void drm_intel_gem_bo_open_vma(drm_intel_bufmgr_gem *bufmgr_gem,
 {
 	bufmgr_gem->vma_open++;
 	DRMLISTDEL(&bo_gem->vma_list);
+	drm_intel_gem_bo_vma_account(bufmgr_gem, bo_gem, false);
 	if (bo_gem->mem_virtual)
 		bufmgr_gem->vma_count--;
 	if (bo_gem->wc_virtual)
@@ -1331,7 +1825,6 @@ drm_intel_gem_bo_unreference_final(drm_intel_bo *bo, time_t time)
 {
 	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *) bo->bufmgr;
 	drm_intel_bo_gem *bo_gem = (drm_intel_bo_gem *) bo;
-	struct drm_intel_gem_bo_bucket *bucket;
 	int i;
 
 	/* Unreference all the target buffers */
@@ -1376,20 +1869,30 @@ drm_intel_gem_bo_unreference_final(drm_intel_bo *bo, time_t time)
 		drm_intel_gem_bo_mark_mmaps_incoherent(bo);
 	}
 
-	bucket = drm_intel_gem_bo_bucket_for_size(bufmgr_gem, bo->size);
-	/* Put the buffer into our internal cache for reuse if we can. */
-	if (bufmgr_gem->bo_reuse && bo_gem->reusable && bucket != NULL &&
-	    drm_intel_gem_bo_madvise_internal(bufmgr_gem, bo_gem,
-					      I915_MADV_DONTNEED)) {
-		bo_gem->free_time = time;
-
-		bo_gem->name = NULL;
-		bo_gem->validate_index = -1;
+	if (bo_gem->is_userptr) {
+		/* Keep the object, and so the kernel's tracking of the client
+		 * pages, around in case the same memory is wrapped again.
+		 */
+		if (bufmgr_gem->userptr_cache_max && bo_gem->reusable) {
+			bo_gem->name = NULL;
+			bo_gem->validate_index = -1;
+			DRMLISTADDTAIL(&bo_gem->head,
+				       &bufmgr_gem->userptr_cache);
+			bufmgr_gem->userptr_cache_count++;
+			drm_intel_gem_userptr_cache_trim(bufmgr_gem,
+							 bufmgr_gem->userptr_cache_max);
+		} else {
+			drm_intel_gem_bo_free(bo);
+		}
+		return;
+	}
 
-		DRMLISTADDTAIL(&bo_gem->head, &bucket->head);
-	} else {
+	/* Put the buffer into our internal cache for reuse if we can. */
+	if (bufmgr_gem->bo_reuse && bo_gem->reusable &&
+	    drm_bo_cache_bucket(&bufmgr_gem->bo_cache, bo->size) != NULL)
+		drm_intel_gem_bo_cache_put_locked(bufmgr_gem, bo_gem, time);
+	else
 		drm_intel_gem_bo_free(bo);
-	}
 }
 
 static void drm_intel_gem_bo_unreference_locked_timed(drm_intel_bo *bo,
@@ -1413,6 +1916,9 @@ static void drm_intel_gem_bo_unreference(drm_intel_bo *bo)
 		    (drm_intel_bufmgr_gem *) bo->bufmgr;
 		struct timespec time;
 
+		if (drm_intel_gem_magazine_put(bufmgr_gem, bo_gem))
+			return;
+
 		clock_gettime(CLOCK_MONOTONIC, &time);
 
 		pthread_mutex_lock(&bufmgr_gem->lock);
@@ -1468,6 +1974,7 @@ static int drm_intel_gem_bo_map(drm_intel_bo *bo, int write_enable)
 		}
 		VG(VALGRIND_MALLOCLIKE_BLOCK(mmap_arg.addr_ptr, mmap_arg.size, 0, 1));
 		bo_gem->mem_virtual = (void *)(uintptr_t) mmap_arg.addr_ptr;
+		drm_intel_gem_bo_mmap_account(bufmgr_gem, bo_gem, true);
 	}
 	DBG("bo_map: %d (%s) -> %p\n", bo_gem->gem_handle, bo_gem->name,
 	    bo_gem->mem_virtual);
@@ -1552,6 +2059,7 @@ map_gtt(drm_intel_bo *bo)
 				drm_intel_gem_bo_close_vma(bufmgr_gem, bo_gem);
 			return ret;
 		}
+		drm_intel_gem_bo_mmap_account(bufmgr_gem, bo_gem, true);
 	}
 
 	bo->virtual = bo_gem->gtt_virtual;
@@ -1562,6 +2070,56 @@ map_gtt(drm_intel_bo *bo)
 	return 0;
 }
 
+static int
+map_wc(drm_intel_bo *bo)
+{
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *) bo->bufmgr;
+	drm_intel_bo_gem *bo_gem = (drm_intel_bo_gem *) bo;
+	int ret;
+
+	if (bo_gem->is_userptr)
+		return -EINVAL;
+
+	if (bo_gem->map_count++ == 0)
+		drm_intel_gem_bo_open_vma(bufmgr_gem, bo_gem);
+
+	/* Get a mapping of the buffer if we haven't before. */
+	if (bo_gem->wc_virtual == NULL) {
+		struct drm_i915_gem_mmap mmap_arg;
+
+		DBG("bo_map_wc: mmap %d (%s), map_count=%d\n",
+		    bo_gem->gem_handle, bo_gem->name, bo_gem->map_count);
+
+		memclear(mmap_arg);
+		mmap_arg.handle = bo_gem->gem_handle;
+		mmap_arg.size = bo->size;
+		mmap_arg.flags = I915_MMAP_WC;
+		ret = drmIoctl(bufmgr_gem->fd,
+			       DRM_IOCTL_I915_GEM_MMAP,
+			       &mmap_arg);
+		if (ret != 0) {
+			ret = -errno;
+			DBG("%s:%d: Error mapping buffer %d (%s): %s .\n",
+			    __FILE__, __LINE__,
+			    bo_gem->gem_handle, bo_gem->name,
+			    strerror(errno));
+			if (--bo_gem->map_count == 0)
+				drm_intel_gem_bo_close_vma(bufmgr_gem, bo_gem);
+			return ret;
+		}
+		VG(VALGRIND_MALLOCLIKE_BLOCK(mmap_arg.addr_ptr, mmap_arg.size, 0, 1));
+		bo_gem->wc_virtual = (void *)(uintptr_t) mmap_arg.addr_ptr;
+		drm_intel_gem_bo_mmap_account(bufmgr_gem, bo_gem, true);
+	}
+
+	bo->virtual = bo_gem->wc_virtual;
+
+	DBG("bo_map_wc: %d (%s) -> %p\n", bo_gem->gem_handle, bo_gem->name,
+	    bo_gem->wc_virtual);
+
+	return 0;
+}
+
 drm_public int
 drm_intel_gem_bo_map_gtt(drm_intel_bo *bo)
 {
@@ -1653,6 +2211,83 @@ drm_intel_gem_bo_map_unsynchronized(drm_intel_bo *bo)
 	return ret;
 }
 
+/**
+ * Maps the buffer write-combined through the CPU page tables.
+ *
+ * Unlike drm_intel_gem_bo_map_gtt() this doesn't go through the
+ * mappable aperture, so it neither competes for aperture space nor
+ * takes the slow GTT faults, but it doesn't detile either: it is meant
+ * for streaming writes to linear buffers.  Like the other mappings it
+ * is kept in the vma cache after drm_intel_gem_bo_unmap_wc().
+ *
+ * Requires I915_PARAM_MMAP_VERSION >= 1, -errno is returned otherwise.
+ */
+drm_public int
+drm_intel_gem_bo_map_wc(drm_intel_bo *bo)
+{
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *) bo->bufmgr;
+	drm_intel_bo_gem *bo_gem = (drm_intel_bo_gem *) bo;
+	struct drm_i915_gem_set_domain set_domain;
+	int ret;
+
+	pthread_mutex_lock(&bufmgr_gem->lock);
+
+	ret = map_wc(bo);
+	if (ret) {
+		pthread_mutex_unlock(&bufmgr_gem->lock);
+		return ret;
+	}
+
+	/* Wait for the GPU and flush the CPU caches, as for GTT maps:
+	 * the GTT domain covers all uncached CPU access.
+	 */
+	memclear(set_domain);
+	set_domain.handle = bo_gem->gem_handle;
+	set_domain.read_domains = I915_GEM_DOMAIN_GTT;
+	set_domain.write_domain = I915_GEM_DOMAIN_GTT;
+	ret = drmIoctl(bufmgr_gem->fd,
+		       DRM_IOCTL_I915_GEM_SET_DOMAIN,
+		       &set_domain);
+	if (ret != 0) {
+		DBG("%s:%d: Error setting domain %d: %s\n",
+		    __FILE__, __LINE__, bo_gem->gem_handle,
+		    strerror(errno));
+	}
+
+	drm_intel_gem_bo_mark_mmaps_incoherent(bo);
+	VG(VALGRIND_MAKE_MEM_DEFINED(bo_gem->wc_virtual, bo->size));
+	pthread_mutex_unlock(&bufmgr_gem->lock);
+
+	return 0;
+}
+
+/**
+ * Like drm_intel_gem_bo_map_wc(), but without waiting for the GPU, see
+ * drm_intel_gem_bo_map_unsynchronized().  Write-combined access doesn't
+ * go through the CPU caches, so this is safe without LLC as well.
+ */
+drm_public int
+drm_intel_gem_bo_map_wc_unsynchronized(drm_intel_bo *bo)
+{
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *) bo->bufmgr;
+#if HAVE_VALGRIND
+	drm_intel_bo_gem *bo_gem = (drm_intel_bo_gem *) bo;
+#endif
+	int ret;
+
+	pthread_mutex_lock(&bufmgr_gem->lock);
+
+	ret = map_wc(bo);
+	if (ret == 0) {
+		drm_intel_gem_bo_mark_mmaps_incoherent(bo);
+		VG(VALGRIND_MAKE_MEM_DEFINED(bo_gem->wc_virtual, bo->size));
+	}
+
+	pthread_mutex_unlock(&bufmgr_gem->lock);
+
+	return ret;
+}
+
 static int drm_intel_gem_bo_unmap(drm_intel_bo *bo)
 {
 	drm_intel_bufmgr_gem *bufmgr_gem;
@@ -1716,6 +2351,12 @@ drm_intel_gem_bo_unmap_gtt(drm_intel_bo *bo)
 	return drm_intel_gem_bo_unmap(bo);
 }
 
+drm_public int
+drm_intel_gem_bo_unmap_wc(drm_intel_bo *bo)
+{
+	return drm_intel_gem_bo_unmap(bo);
+}
+
 static int
 drm_intel_gem_bo_subdata(drm_intel_bo *bo, unsigned long offset,
 			 unsigned long size, const void *data)
@@ -1746,6 +2387,113 @@ drm_intel_gem_bo_subdata(drm_intel_bo *bo, unsigned long offset,
 	return ret;
 }
 
+static int
+drm_intel_upload_compare(const void *a, const void *b)
+{
+	const drm_intel_upload *ua = a, *ub = b;
+
+	if (ua->bo != ub->bo)
+		return (uintptr_t)ua->bo < (uintptr_t)ub->bo ? -1 : 1;
+	if (ua->offset != ub->offset)
+		return ua->offset < ub->offset ? -1 : 1;
+	return 0;
+}
+
+/* pwrites one run of adjacent uploads, gathered into a single write */
+static int
+drm_intel_gem_bo_subdata_run(const drm_intel_upload *run, int count,
+			     void **staging, unsigned long *staging_size)
+{
+	unsigned long size = 0, done = 0;
+	int i;
+
+	if (count == 1)
+		return drm_intel_gem_bo_subdata(run->bo, run->offset,
+						run->size, run->data);
+
+	for (i = 0; i < count; i++)
+		size += run[i].size;
+
+	if (size > *staging_size) {
+		void *tmp = realloc(*staging, size);
+
+		if (!tmp)
+			return -ENOMEM;
+		*staging = tmp;
+		*staging_size = size;
+	}
+
+	for (i = 0; i < count; i++) {
+		memcpy((char *)*staging + done, run[i].data, run[i].size);
+		done += run[i].size;
+	}
+
+	return drm_intel_gem_bo_subdata(run->bo, run->offset, size, *staging);
+}
+
+/**
+ * Uploads many regions, to one or more buffers, with as few syscalls as
+ * possible.
+ *
+ * The regions are sorted by buffer and offset in place, and must not
+ * overlap.  Per buffer, adjacent regions are merged into runs: a buffer
+ * receiving a single run gets one pwrite, one receiving several is
+ * mapped write-combined once and the runs are copied in, which costs a
+ * single domain change however many runs there are.  Without WC mmap
+ * support every run is pwritten.
+ *
+ * Returns 0 on success or the first negative errno.
+ */
+drm_public int
+drm_intel_gem_bo_subdata_multi(drm_intel_upload *uploads, int count)
+{
+	void *staging = NULL;
+	unsigned long staging_size = 0;
+	int first, last, i, runs, ret = 0;
+
+	qsort(uploads, count, sizeof(*uploads), drm_intel_upload_compare);
+
+	for (first = 0; first < count && ret == 0; first = last) {
+		drm_intel_bo *bo = uploads[first].bo;
+		drm_intel_bo_gem *bo_gem = (drm_intel_bo_gem *) bo;
+
+		runs = 1;
+		for (last = first + 1; last < count; last++) {
+			if (uploads[last].bo != bo)
+				break;
+			if (uploads[last].offset !=
+			    uploads[last - 1].offset + uploads[last - 1].size)
+				runs++;
+		}
+
+		if (runs > 1 && !bo_gem->is_userptr &&
+		    drm_intel_gem_bo_map_wc(bo) == 0) {
+			for (i = first; i < last; i++)
+				memcpy((char *)bo_gem->wc_virtual +
+				       uploads[i].offset,
+				       uploads[i].data, uploads[i].size);
+			drm_intel_gem_bo_unmap_wc(bo);
+			continue;
+		}
+
+		for (i = first; i < last && ret == 0; i += runs) {
+			runs = 1;
+			while (i + runs < last &&
+			       uploads[i + runs].offset ==
+			       uploads[i + runs - 1].offset +
+			       uploads[i + runs - 1].size)
+				runs++;
+
+			ret = drm_intel_gem_bo_subdata_run(&uploads[i], runs,
+							   &staging,
+							   &staging_size);
+		}
+	}
+
+	free(staging);
+	return ret;
+}
+
 static int
 drm_intel_gem_get_pipe_from_crtc_id(drm_intel_bufmgr *bufmgr, int crtc_id)
 {
@@ -1854,6 +2602,9 @@ drm_intel_gem_bo_wait(drm_intel_bo *bo, int64_t timeout_ns)
 		}
 	}
 
+	if (bo_gem->reusable && bo_gem->idle)
+		return 0;
+
 	memclear(wait);
 	wait.bo_handle = bo_gem->gem_handle;
 	wait.timeout_ns = timeout_ns;
@@ -1861,6 +2612,8 @@ drm_intel_gem_bo_wait(drm_intel_bo *bo, int64_t timeout_ns)
 	if (ret == -1)
 		return -errno;
 
+	/* the next busy check needs no ioctl */
+	bo_gem->idle = true;
 	return ret;
 }
 
@@ -1899,7 +2652,13 @@ drm_intel_bufmgr_gem_destroy(drm_intel_bufmgr *bufmgr)
 {
 	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *) bufmgr;
 	struct drm_gem_close close_bo;
-	int i, ret;
+	int ret, i, j;
+
+	if (bufmgr_gem->timestamps) {
+		drm_intel_bo_unreference(bufmgr_gem->timestamps->cmd_bo);
+		drm_intel_bo_unreference(bufmgr_gem->timestamps->query_bo);
+		free(bufmgr_gem->timestamps);
+	}
 
 	free(bufmgr_gem->exec2_objects);
 	free(bufmgr_gem->exec_objects);
@@ -1908,19 +2667,16 @@ drm_intel_bufmgr_gem_destroy(drm_intel_bufmgr *bufmgr)
 	pthread_mutex_destroy(&bufmgr_gem->lock);
 
 	/* Free any cached buffer objects we were going to reuse */
-	for (i = 0; i < bufmgr_gem->num_buckets; i++) {
-		struct drm_intel_gem_bo_bucket *bucket =
-		    &bufmgr_gem->cache_bucket[i];
-		drm_intel_bo_gem *bo_gem;
+	for (i = 0; i < INTEL_BO_MAGAZINE_SHARDS; i++) {
+		struct drm_intel_gem_magazine *mag = &bufmgr_gem->magazines[i];
 
-		while (!DRMLISTEMPTY(&bucket->head)) {
-			bo_gem = DRMLISTENTRY(drm_intel_bo_gem,
-					      bucket->head.next, head);
-			DRMLISTDEL(&bo_gem->head);
-
-			drm_intel_gem_bo_free(&bo_gem->bo);
-		}
+		for (j = 0; j < mag->count; j++)
+			drm_intel_gem_bo_free(&mag->bos[j]->bo);
+		pthread_mutex_destroy(&mag->lock);
 	}
+	drm_bo_cache_cleanup(&bufmgr_gem->bo_cache, 0);
+
+	drm_intel_gem_userptr_cache_trim(bufmgr_gem, 0);
 
 	/* Release userptr bo kept hanging around for optimisation. */
 	if (bufmgr_gem->userptr_active.ptr) {
@@ -1934,6 +2690,8 @@ drm_intel_bufmgr_gem_destroy(drm_intel_bufmgr *bufmgr)
 				"i915 kernel driver may not be sane!\n", errno);
 	}
 
+	mmDestroy(bufmgr_gem->va_heap);
+
 	free(bufmgr);
 }
 
@@ -1996,9 +2754,16 @@ do_bo_emit_reloc(drm_intel_bo *bo, uint32_t offset,
 	 * already been accounted for.
 	 */
 	assert(!bo_gem->used_as_reloc_target);
+	if (bo_gem->reloc_count == 0)
+		bo_gem->reloc_tree_id =
+			atomic_inc_return(&bufmgr_gem->reloc_tree_serial);
 	if (target_bo_gem != bo_gem) {
 		target_bo_gem->used_as_reloc_target = true;
-		bo_gem->reloc_tree_size += target_bo_gem->reloc_tree_size;
+		if (target_bo_gem->counted_in_tree != bo_gem->reloc_tree_id) {
+			target_bo_gem->counted_in_tree = bo_gem->reloc_tree_id;
+			bo_gem->reloc_tree_size +=
+				target_bo_gem->reloc_tree_size;
+		}
 		bo_gem->reloc_tree_fences += target_bo_gem->reloc_tree_fences;
 	}
 
@@ -2178,8 +2943,13 @@ drm_intel_gem_bo_process_reloc(drm_intel_bo *bo)
 
 		drm_intel_gem_bo_mark_mmaps_incoherent(bo);
 
-		/* Continue walking the tree depth-first. */
-		drm_intel_gem_bo_process_reloc(target_bo);
+		/* Continue walking the tree depth-first.  Targets are added
+		 * after their own targets, so one that's on the validate list
+		 * already had its whole tree walked: don't do it again for
+		 * every further reloc pointing at it.
+		 */
+		if (to_bo_gem(target_bo)->validate_index == -1)
+			drm_intel_gem_bo_process_reloc(target_bo);
 
 		/* Add the target to the validate list */
 		drm_intel_add_validate_buffer(target_bo);
@@ -2204,8 +2974,11 @@ drm_intel_gem_bo_process_reloc2(drm_intel_bo *bo)
 
 		drm_intel_gem_bo_mark_mmaps_incoherent(bo);
 
-		/* Continue walking the tree depth-first. */
-		drm_intel_gem_bo_process_reloc2(target_bo);
+		/* Continue walking the tree depth-first, unless the target
+		 * and so its tree is on the validate list already.
+		 */
+		if (to_bo_gem(target_bo)->validate_index == -1)
+			drm_intel_gem_bo_process_reloc2(target_bo);
 
 		need_fence = (bo_gem->reloc_target_info[i].flags &
 			      DRM_INTEL_RELOC_FENCE);
@@ -2221,7 +2994,8 @@ drm_intel_gem_bo_process_reloc2(drm_intel_bo *bo)
 			continue;
 
 		drm_intel_gem_bo_mark_mmaps_incoherent(bo);
-		drm_intel_gem_bo_process_reloc2(target_bo);
+		if (to_bo_gem(target_bo)->validate_index == -1)
+			drm_intel_gem_bo_process_reloc2(target_bo);
 		drm_intel_add_validate_buffer2(target_bo, false);
 	}
 }
@@ -2277,6 +3051,42 @@ drm_intel_update_buffer_offsets2 (drm_intel_bufmgr_gem *bufmgr_gem)
 	}
 }
 
+/* With I915_EXEC_HANDLE_LUT reloc targets are indices into the validation
+ * list, so point them there once the list is complete.  Returns whether
+ * every reloc still presumes the current offset of its target, which is
+ * what I915_EXEC_NO_RELOC promises the kernel.
+ */
+static bool
+drm_intel_gem_bo_lut_relocs(drm_intel_bufmgr_gem *bufmgr_gem)
+{
+	bool presumed = true;
+	int i, j;
+
+	for (i = 0; i < bufmgr_gem->exec_count; i++) {
+		drm_intel_bo_gem *bo_gem = to_bo_gem(bufmgr_gem->exec_bos[i]);
+
+		for (j = 0; j < bo_gem->reloc_count; j++) {
+			struct drm_i915_gem_relocation_entry *reloc =
+				&bo_gem->relocs[j];
+			drm_intel_bo *target_bo = bo_gem->reloc_target_info[j].bo;
+			int index = to_bo_gem(target_bo)->validate_index;
+
+			reloc->target_handle = index;
+			if (reloc->presumed_offset != target_bo->offset64)
+				presumed = false;
+
+			/* Without relocation processing the kernel only
+			 * learns about writes from the object flags.
+			 */
+			if (reloc->write_domain)
+				bufmgr_gem->exec2_objects[index].flags |=
+					EXEC_OBJECT_WRITE;
+		}
+	}
+
+	return presumed;
+}
+
 drm_public void
 drm_intel_gem_bo_aub_dump_bmp(drm_intel_bo *bo,
 			      int x1, int y1, int width, int height,
@@ -2332,24 +3142,151 @@ drm_intel_gem_bo_exec(drm_intel_bo *bo, int used,
 			    (unsigned int)bufmgr_gem->gtt_size);
 		}
 	}
-	drm_intel_update_buffer_offsets(bufmgr_gem);
+	drm_intel_update_buffer_offsets(bufmgr_gem);
+
+	if (bufmgr_gem->bufmgr.debug)
+		drm_intel_gem_dump_validation_list(bufmgr_gem);
+
+	for (i = 0; i < bufmgr_gem->exec_count; i++) {
+		drm_intel_bo_gem *bo_gem = to_bo_gem(bufmgr_gem->exec_bos[i]);
+
+		bo_gem->idle = false;
+
+		/* Disconnect the buffer from the validate list */
+		bo_gem->validate_index = -1;
+		bufmgr_gem->exec_bos[i] = NULL;
+	}
+	bufmgr_gem->exec_count = 0;
+	pthread_mutex_unlock(&bufmgr_gem->lock);
+
+	return ret;
+}
+
+static int
+drm_intel_gem_timestamp_ring(unsigned int flags)
+{
+	switch (flags & I915_EXEC_RING_MASK) {
+	case I915_EXEC_DEFAULT:
+	case I915_EXEC_RENDER:
+		return 0;
+	case I915_EXEC_BSD:
+		/* the second video ring has a register of its own */
+		if ((flags & I915_EXEC_BSD_MASK) == I915_EXEC_BSD_RING2)
+			return -1;
+		return 1;
+	case I915_EXEC_BLT:
+		return 2;
+	case I915_EXEC_VEBOX:
+		return 3;
+	default:
+		return -1;
+	}
+}
+
+static uint32_t
+drm_intel_gem_timestamp_cmd_offset(int ring, int slot, int end)
+{
+	return ((ring * TIMESTAMP_SLOTS + slot) * 2 + end) * TIMESTAMP_CMD_SIZE;
+}
+
+/* Runs one of the small batches writing the start or the end of @slot,
+ * in the same context and ring as the batch it brackets.
+ */
+static int
+drm_intel_gem_timestamp_exec(drm_intel_bufmgr_gem *bufmgr_gem, int ring,
+			     int slot, int end, unsigned int flags,
+			     uint32_t ctx_id, int in_fence)
+{
+	struct drm_intel_gem_timestamps *ts = bufmgr_gem->timestamps;
+	struct drm_i915_gem_relocation_entry *relocs =
+		ts->relocs[ring][slot][end];
+	struct drm_i915_gem_exec_object2 objects[2];
+	struct drm_i915_gem_execbuffer2 execbuf;
+	int i;
+
+	for (i = 0; i < 1 + end; i++)
+		relocs[i].presumed_offset = ts->query_bo->offset64;
+
+	memclear(objects);
+	objects[0].handle = to_bo_gem(ts->query_bo)->gem_handle;
+	objects[0].offset = ts->query_bo->offset64;
+	objects[1].handle = to_bo_gem(ts->cmd_bo)->gem_handle;
+	objects[1].offset = ts->cmd_bo->offset64;
+	objects[1].relocation_count = 1 + end;
+	objects[1].relocs_ptr = (uintptr_t)relocs;
+
+	memclear(execbuf);
+	execbuf.buffers_ptr = (uintptr_t)objects;
+	execbuf.buffer_count = 2;
+	execbuf.batch_start_offset =
+		drm_intel_gem_timestamp_cmd_offset(ring, slot, end);
+	execbuf.batch_len = TIMESTAMP_CMD_SIZE;
+	execbuf.flags = flags & (I915_EXEC_RING_MASK | I915_EXEC_BSD_MASK);
+	i915_execbuffer2_set_context_id(execbuf, ctx_id);
+	if (in_fence != -1) {
+		execbuf.rsvd2 = in_fence;
+		execbuf.flags |= I915_EXEC_FENCE_IN;
+	}
 
-	if (bufmgr_gem->bufmgr.debug)
-		drm_intel_gem_dump_validation_list(bufmgr_gem);
+	if (drmIoctl(bufmgr_gem->fd, DRM_IOCTL_I915_GEM_EXECBUFFER2, &execbuf))
+		return -errno;
 
-	for (i = 0; i < bufmgr_gem->exec_count; i++) {
-		drm_intel_bo_gem *bo_gem = to_bo_gem(bufmgr_gem->exec_bos[i]);
+	ts->query_bo->offset64 = objects[0].offset;
+	ts->query_bo->offset = objects[0].offset;
+	ts->cmd_bo->offset64 = objects[1].offset;
+	ts->cmd_bo->offset = objects[1].offset;
+	return 0;
+}
 
-		bo_gem->idle = false;
+/* Starts bracketing a batch for @flags and @ctx_id, called with the lock
+ * held.  Returns the slot, or -1 if the batch isn't timed.
+ */
+static int
+drm_intel_gem_timestamp_begin(drm_intel_bufmgr_gem *bufmgr_gem,
+			      unsigned int flags, uint32_t ctx_id,
+			      int in_fence)
+{
+	struct drm_intel_gem_timestamps *ts = bufmgr_gem->timestamps;
+	int ring, slot;
 
-		/* Disconnect the buffer from the validate list */
-		bo_gem->validate_index = -1;
-		bufmgr_gem->exec_bos[i] = NULL;
+	if (!ts)
+		return -1;
+
+	ring = drm_intel_gem_timestamp_ring(flags);
+	if (ring < 0)
+		return -1;
+
+	/* drop the oldest result if nobody polled for it */
+	if (ts->submitted - ts->polled == TIMESTAMP_SLOTS)
+		ts->polled++;
+
+	slot = ts->submitted++ % TIMESTAMP_SLOTS;
+	ts->slots[slot].done = 0;
+	ts->ring[slot] = flags & I915_EXEC_RING_MASK;
+
+	/* wait for the in-fence here, so it isn't part of the time */
+	if (drm_intel_gem_timestamp_exec(bufmgr_gem, ring, slot, 0, flags,
+					 ctx_id, in_fence)) {
+		ts->ring[slot] = -1;
+		return -1;
 	}
-	bufmgr_gem->exec_count = 0;
-	pthread_mutex_unlock(&bufmgr_gem->lock);
+	return slot;
+}
 
-	return ret;
+static void
+drm_intel_gem_timestamp_end(drm_intel_bufmgr_gem *bufmgr_gem, int slot,
+			    unsigned int flags, uint32_t ctx_id, int ret)
+{
+	struct drm_intel_gem_timestamps *ts = bufmgr_gem->timestamps;
+
+	if (slot < 0)
+		return;
+
+	if (ret != 0 ||
+	    drm_intel_gem_timestamp_exec(bufmgr_gem,
+					 drm_intel_gem_timestamp_ring(flags),
+					 slot, 1, flags, ctx_id, -1))
+		ts->ring[slot] = -1;
 }
 
 static int
@@ -2360,8 +3297,10 @@ do_exec2(drm_intel_bo *bo, int used, drm_intel_context *ctx,
 {
 	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *)bo->bufmgr;
 	struct drm_i915_gem_execbuffer2 execbuf;
+	drmSubmitTrace trace;
+	uint32_t ctx_id = ctx ? ctx->ctx_id : 0;
 	int ret = 0;
-	int i;
+	int i, slot;
 
 	if (to_bo_gem(bo)->has_error)
 		return -ENOMEM;
@@ -2395,6 +3334,12 @@ do_exec2(drm_intel_bo *bo, int used, drm_intel_context *ctx,
 	 */
 	drm_intel_add_validate_buffer2(bo, 0);
 
+	if (bufmgr_gem->no_reloc) {
+		flags |= I915_EXEC_HANDLE_LUT;
+		if (drm_intel_gem_bo_lut_relocs(bufmgr_gem))
+			flags |= I915_EXEC_NO_RELOC;
+	}
+
 	memclear(execbuf);
 	execbuf.buffers_ptr = (uintptr_t)bufmgr_gem->exec2_objects;
 	execbuf.buffer_count = bufmgr_gem->exec_count;
@@ -2422,11 +3367,23 @@ do_exec2(drm_intel_bo *bo, int used, drm_intel_context *ctx,
 	if (bufmgr_gem->no_exec)
 		goto skip_execution;
 
+	slot = drm_intel_gem_timestamp_begin(bufmgr_gem, flags, ctx_id,
+					     in_fence);
+
+	memclear(trace);
+	trace.name = "drm_intel_gem_bo_exec2";
+	trace.fd = bufmgr_gem->fd;
+	trace.num_bos = bufmgr_gem->exec_count;
+	trace.cmd_bytes = used;
+	drmSubmitTraceBegin(&trace);
+
 	ret = drmIoctl(bufmgr_gem->fd,
 		       DRM_IOCTL_I915_GEM_EXECBUFFER2_WR,
 		       &execbuf);
-	if (ret != 0) {
+	if (ret != 0)
 		ret = -errno;
+	drm_intel_gem_timestamp_end(bufmgr_gem, slot, flags, ctx_id, ret);
+	if (ret != 0) {
 		if (ret == -ENOSPC) {
 			DBG("Execbuffer fails to pin. "
 			    "Estimate: %u. Actual: %u. Available: %u\n",
@@ -2442,6 +3399,12 @@ do_exec2(drm_intel_bo *bo, int used, drm_intel_context *ctx,
 	if (ret == 0 && out_fence != NULL)
 		*out_fence = execbuf.rsvd2 >> 32;
 
+	/* the out fence fd is the only fence id there is */
+	trace.ret = ret;
+	if (ret == 0 && out_fence != NULL)
+		trace.fence = *out_fence;
+	drmSubmitTraceEnd(&trace);
+
 skip_execution:
 	if (bufmgr_gem->bufmgr.debug)
 		drm_intel_gem_dump_validation_list(bufmgr_gem);
@@ -2618,8 +3581,17 @@ drm_intel_gem_bo_get_tiling(drm_intel_bo *bo, uint32_t * tiling_mode,
 static int
 drm_intel_gem_bo_set_softpin_offset(drm_intel_bo *bo, uint64_t offset)
 {
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *) bo->bufmgr;
 	drm_intel_bo_gem *bo_gem = (drm_intel_bo_gem *) bo;
 
+	/* The caller places the bo, give back the heap's address */
+	if (bo_gem->va_block) {
+		pthread_mutex_lock(&bufmgr_gem->lock);
+		mmFreeMem(bo_gem->va_block);
+		bo_gem->va_block = NULL;
+		pthread_mutex_unlock(&bufmgr_gem->lock);
+	}
+
 	bo->offset64 = offset;
 	bo->offset = offset;
 	bo_gem->kflags |= EXEC_OBJECT_PINNED;
@@ -2678,8 +3650,10 @@ drm_intel_bo_gem_create_from_prime(drm_intel_bufmgr *bufmgr, int prime_fd, int s
 	bo_gem->bo.bufmgr = bufmgr;
 
 	bo_gem->gem_handle = handle;
+	bo_gem->imported = true;
 	HASH_ADD(handle_hh, bufmgr_gem->handle_table,
 		 gem_handle, sizeof(bo_gem->gem_handle), bo_gem);
+	drm_intel_gem_bo_stats_account(bufmgr_gem, bo_gem, true);
 
 	bo_gem->name = "prime";
 	bo_gem->validate_index = -1;
@@ -2698,6 +3672,7 @@ drm_intel_bo_gem_create_from_prime(drm_intel_bufmgr *bufmgr, int prime_fd, int s
 	bo_gem->tiling_mode = get_tiling.tiling_mode;
 	bo_gem->swizzle_mode = get_tiling.swizzle_mode;
 	/* XXX stride is unknown */
+	drm_intel_gem_bo_assign_va(bufmgr_gem, bo_gem, 0);
 	drm_intel_bo_gem_set_in_aperture_size(bufmgr_gem, bo_gem, 0);
 
 out:
@@ -2839,6 +3814,86 @@ drm_intel_bufmgr_gem_enable_fenced_relocs(drm_intel_bufmgr *bufmgr)
 		bufmgr_gem->fenced_relocs = true;
 }
 
+/**
+ * Enable submission with I915_EXEC_HANDLE_LUT and I915_EXEC_NO_RELOC.
+ *
+ * Relocations then name their targets by validation list index, and the
+ * kernel skips relocation processing for batches whose buffers are all
+ * still at the offsets the relocations presumed.  This requires the
+ * caller to write target_bo->offset64 + delta into the buffer for every
+ * relocation it emits; batches where a target moved since are still
+ * relocated by the kernel.
+ *
+ * Returns 0 on success, or -ENODEV if the kernel lacks support.
+ */
+drm_public int
+drm_intel_bufmgr_gem_enable_no_reloc(drm_intel_bufmgr *bufmgr)
+{
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *)bufmgr;
+
+	if (bufmgr_gem->bufmgr.bo_exec != drm_intel_gem_bo_exec2 ||
+	    !bufmgr_gem->has_exec_lut)
+		return -ENODEV;
+
+	bufmgr_gem->no_reloc = true;
+	return 0;
+}
+
+/**
+ * Enable pinning every new buffer at an address of its own.
+ *
+ * Addresses come from a heap covering the per-process GTT, so with full
+ * PPGTT the kernel never has to move a buffer and relocation targets
+ * all become softpin targets: drm_intel_bo_emit_reloc() no longer adds
+ * relocations, and the caller writes target_bo->offset64 + delta into
+ * the batch as usual.  Buffers get addresses from the bottom of the
+ * heap; ones ending above 4GiB are flagged as supporting 48-bit
+ * addresses.  Call this before allocating buffers, existing ones keep
+ * using relocations.
+ *
+ * Returns 0 on success, or -ENODEV if the kernel doesn't support
+ * softpinning.
+ */
+drm_public int
+drm_intel_bufmgr_gem_enable_softpin(drm_intel_bufmgr *bufmgr)
+{
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *)bufmgr;
+	struct drm_i915_gem_context_param p;
+	drm_i915_getparam_t gp;
+	int ret, value = 0;
+
+	if (bufmgr_gem->bufmgr.bo_exec != drm_intel_gem_bo_exec2)
+		return -ENODEV;
+
+	memclear(gp);
+	gp.param = I915_PARAM_HAS_EXEC_SOFTPIN;
+	gp.value = &value;
+	ret = drmIoctl(bufmgr_gem->fd, DRM_IOCTL_I915_GETPARAM, &gp);
+	if (ret || !value)
+		return -ENODEV;
+
+	memclear(p);
+	p.param = I915_CONTEXT_PARAM_GTT_SIZE;
+	ret = drmIoctl(bufmgr_gem->fd,
+		       DRM_IOCTL_I915_GEM_CONTEXT_GETPARAM, &p);
+	if (ret || p.value <= 4096)
+		return -ENODEV;
+
+	pthread_mutex_lock(&bufmgr_gem->lock);
+	if (!bufmgr_gem->softpin) {
+		/* keep the first page unused, offset 0 reads as unplaced */
+		bufmgr_gem->va_heap = mmInit(4096, p.value - 4096);
+		if (!bufmgr_gem->va_heap) {
+			pthread_mutex_unlock(&bufmgr_gem->lock);
+			return -ENOMEM;
+		}
+		bufmgr_gem->softpin = true;
+	}
+	pthread_mutex_unlock(&bufmgr_gem->lock);
+
+	return 0;
+}
+
 /**
  * Return the additional aperture space required by the tree of buffer objects
  * rooted at bo.
@@ -2912,17 +3967,25 @@ drm_intel_gem_bo_clear_aperture_space_flag(drm_intel_bo *bo)
 /**
  * Return a conservative estimate for the amount of aperture required
  * for a collection of buffers. This may double-count some buffers.
+ *
+ * Buffers already counted in the first buffer's tree are skipped, so for
+ * the usual batch buffer plus a few new targets this is exact.
  */
 static unsigned int
 drm_intel_gem_estimate_batch_space(drm_intel_bo **bo_array, int count)
 {
+	drm_intel_bo_gem *root = (drm_intel_bo_gem *) bo_array[0];
 	int i;
 	unsigned int total = 0;
 
 	for (i = 0; i < count; i++) {
 		drm_intel_bo_gem *bo_gem = (drm_intel_bo_gem *) bo_array[i];
-		if (bo_gem != NULL)
-			total += bo_gem->reloc_tree_size;
+		if (bo_gem == NULL)
+			continue;
+		if (i > 0 && root != NULL && root->reloc_count &&
+		    bo_gem->counted_in_tree == root->reloc_tree_id)
+			continue;
+		total += bo_gem->reloc_tree_size;
 	}
 	return total;
 }
@@ -3070,43 +4133,138 @@ drm_intel_gem_bo_references(drm_intel_bo *bo, drm_intel_bo *target_bo)
 	return 0;
 }
 
-static void
-add_bucket(drm_intel_bufmgr_gem *bufmgr_gem, int size)
+static int
+drm_intel_gem_bo_cache_busy(struct drm_bo_cache_entry *entry)
+{
+	drm_intel_bo_gem *bo_gem = DRMLISTENTRY(drm_intel_bo_gem, entry,
+						cache_entry);
+
+	return drm_intel_gem_bo_busy(&bo_gem->bo);
+}
+
+static int
+drm_intel_gem_bo_cache_madvise(struct drm_bo_cache_entry *entry,
+			       int willneed)
 {
-	unsigned int i = bufmgr_gem->num_buckets;
+	drm_intel_bo_gem *bo_gem = DRMLISTENTRY(drm_intel_bo_gem, entry,
+						cache_entry);
+
+	return drm_intel_gem_bo_madvise_internal(
+			(drm_intel_bufmgr_gem *) bo_gem->bo.bufmgr, bo_gem,
+			willneed ? I915_MADV_WILLNEED : I915_MADV_DONTNEED);
+}
 
-	assert(i < ARRAY_SIZE(bufmgr_gem->cache_bucket));
+static void
+drm_intel_gem_bo_cache_destroy(struct drm_bo_cache_entry *entry)
+{
+	drm_intel_bo_gem *bo_gem = DRMLISTENTRY(drm_intel_bo_gem, entry,
+						cache_entry);
 
-	DRMINITLISTHEAD(&bufmgr_gem->cache_bucket[i].head);
-	bufmgr_gem->cache_bucket[i].size = size;
-	bufmgr_gem->num_buckets++;
+	drm_intel_gem_bo_free(&bo_gem->bo);
 }
 
+static const struct drm_bo_cache_funcs drm_intel_gem_bo_cache_funcs = {
+	.busy = drm_intel_gem_bo_cache_busy,
+	.madvise = drm_intel_gem_bo_cache_madvise,
+	.destroy = drm_intel_gem_bo_cache_destroy,
+};
+
 static void
 init_cache_buckets(drm_intel_bufmgr_gem *bufmgr_gem)
 {
-	unsigned long size, cache_max_size = 64 * 1024 * 1024;
+	drm_bo_cache_init(&bufmgr_gem->bo_cache, 0,
+			  &drm_intel_gem_bo_cache_funcs);
 
-	/* OK, so power of two buckets was too wasteful of memory.
-	 * Give 3 other sizes between each power of two, to hopefully
-	 * cover things accurately enough.  (The alternative is
-	 * probably to just go for exact matching of sizes, and assume
-	 * that for things like composited window resize the tiled
-	 * width/height alignment and rounding of sizes to pages will
-	 * get us useful cache hit rates anyway)
+	/* Only the least recently freed buffer that fits is checked for
+	 * being idle, see drm_intel_gem_bo_alloc_internal().
 	 */
-	add_bucket(bufmgr_gem, 4096);
-	add_bucket(bufmgr_gem, 4096 * 2);
-	add_bucket(bufmgr_gem, 4096 * 3);
+	bufmgr_gem->bo_cache.busy_skip = 1;
+}
+
+/**
+ * Lets cached buffer objects be reused for smaller requests.
+ *
+ * By default allocations are rounded up to the bucket size, so that every
+ * cached buffer in a bucket fits every request falling into it.  With a
+ * tolerance, allocations keep their page aligned size, and a cached buffer
+ * is reused if it is at most \p percent larger than the request.  This
+ * trades some reuse for less memory lost to rounding.  0 restores the
+ * default.
+ */
+drm_public void
+drm_intel_bufmgr_gem_set_reuse_tolerance(drm_intel_bufmgr *bufmgr,
+					 int percent)
+{
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *)bufmgr;
 
-	/* Initialize the linked lists for BO reuse cache. */
-	for (size = 4 * 4096; size <= cache_max_size; size *= 2) {
-		add_bucket(bufmgr_gem, size);
+	pthread_mutex_lock(&bufmgr_gem->lock);
+	bufmgr_gem->bo_cache.tolerance = percent > 0 ? percent : 0;
+	pthread_mutex_unlock(&bufmgr_gem->lock);
+}
 
-		add_bucket(bufmgr_gem, size + size * 1 / 4);
-		add_bucket(bufmgr_gem, size + size * 2 / 4);
-		add_bucket(bufmgr_gem, size + size * 3 / 4);
-	}
+/**
+ * Limits the memory held by the buffer object reuse cache.
+ *
+ * Whenever the cached buffers add up to more than \p bytes, the least
+ * recently freed ones are released, in addition to the ones unused for a
+ * second or more.  0 removes the limit, which is the default.
+ */
+drm_public void
+drm_intel_bufmgr_gem_set_bo_cache_budget(drm_intel_bufmgr *bufmgr,
+					 unsigned long bytes)
+{
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *)bufmgr;
+
+	if (bytes)
+		drm_intel_gem_magazines_drain(bufmgr_gem);
+
+	pthread_mutex_lock(&bufmgr_gem->lock);
+	bufmgr_gem->bo_cache.budget = bytes;
+	if (bytes)
+		drm_intel_gem_bo_cache_trim_locked(bufmgr_gem, bytes);
+	pthread_mutex_unlock(&bufmgr_gem->lock);
+}
+
+/**
+ * Releases the least recently freed cached buffers until at most \p bytes
+ * are left in the reuse cache, e.g. when the system runs low on memory.
+ */
+drm_public void
+drm_intel_bufmgr_gem_bo_cache_trim(drm_intel_bufmgr *bufmgr,
+				   unsigned long bytes)
+{
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *)bufmgr;
+
+	drm_intel_gem_magazines_drain(bufmgr_gem);
+
+	pthread_mutex_lock(&bufmgr_gem->lock);
+	drm_intel_gem_bo_cache_trim_locked(bufmgr_gem, bytes);
+	pthread_mutex_unlock(&bufmgr_gem->lock);
+}
+
+/**
+ * Fills in \p stats with the memory held through this bufmgr.
+ *
+ * Buffers waiting in the reuse cache count as allocated and as cached,
+ * userptr buffers as imported.  Each CPU, WC and GTT mapping of a buffer
+ * counts as mapped, including the unused ones kept in the vma cache.
+ */
+drm_public void
+drm_intel_bufmgr_gem_get_bo_stats(drm_intel_bufmgr *bufmgr,
+				  struct _drmBOStats *stats)
+{
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *)bufmgr;
+
+	pthread_mutex_lock(&bufmgr_gem->lock);
+	stats->allocated_bytes = bufmgr_gem->alloc_size;
+	stats->allocated_count = bufmgr_gem->alloc_count;
+	stats->cached_bytes = bufmgr_gem->bo_cache.size;
+	stats->cached_count = bufmgr_gem->bo_cache.count;
+	stats->mapped_bytes = bufmgr_gem->mmap_size;
+	stats->mapped_count = bufmgr_gem->mmap_count;
+	stats->imported_bytes = bufmgr_gem->import_size;
+	stats->imported_count = bufmgr_gem->import_count;
+	pthread_mutex_unlock(&bufmgr_gem->lock);
 }
 
 drm_public void
@@ -3119,6 +4277,84 @@ drm_intel_bufmgr_gem_set_vma_cache_size(drm_intel_bufmgr *bufmgr, int limit)
 	drm_intel_gem_bo_purge_vma_cache(bufmgr_gem);
 }
 
+/**
+ * Limits the address space held by unmapped buffers' cached mappings.
+ *
+ * drm_intel_bufmgr_gem_set_vma_cache_size() counts mappings whatever
+ * their size; this caps the bytes of CPU, WC and GTT mappings kept in the
+ * vma cache together, unmapping the least recently used ones beyond it.
+ * 0 means no limit, the default except for 32-bit processes, which start
+ * with 512MiB.
+ */
+drm_public void
+drm_intel_bufmgr_gem_set_vma_cache_budget(drm_intel_bufmgr *bufmgr,
+					  unsigned long bytes)
+{
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *)bufmgr;
+
+	pthread_mutex_lock(&bufmgr_gem->lock);
+	bufmgr_gem->vma_budget = bytes;
+	drm_intel_gem_bo_purge_vma_cache(bufmgr_gem);
+	pthread_mutex_unlock(&bufmgr_gem->lock);
+}
+
+/**
+ * Keeps up to max released userptr buffer objects for reuse.
+ *
+ * Creating a userptr object makes the kernel set up tracking of the client
+ * pages, which is costly for clients that keep wrapping the same memory,
+ * such as a pool of video frames.  With this enabled, unreferencing a
+ * userptr bo keeps it around, and drm_intel_bo_alloc_userptr() for the same
+ * address, size and flags hands it back instead of creating a new one.
+ *
+ * Before the wrapped memory is freed or reused for something else, the
+ * cached objects covering it must be dropped with
+ * drm_intel_bufmgr_gem_release_userptr().  A max of 0, the default,
+ * disables the cache and frees what it holds.
+ */
+drm_public void
+drm_intel_bufmgr_gem_enable_userptr_cache(drm_intel_bufmgr *bufmgr, int max)
+{
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *)bufmgr;
+
+	if (max < 0)
+		max = 0;
+
+	pthread_mutex_lock(&bufmgr_gem->lock);
+	bufmgr_gem->userptr_cache_max = max;
+	drm_intel_gem_userptr_cache_trim(bufmgr_gem, max);
+	pthread_mutex_unlock(&bufmgr_gem->lock);
+}
+
+/**
+ * Frees the cached userptr buffer objects wrapping any part of
+ * [addr, addr + size).
+ *
+ * Buffers still referenced by the caller are not affected.
+ */
+drm_public void
+drm_intel_bufmgr_gem_release_userptr(drm_intel_bufmgr *bufmgr,
+				     void *addr, unsigned long size)
+{
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *)bufmgr;
+	drm_intel_bo_gem *bo_gem, *next;
+	uintptr_t start = (uintptr_t)addr;
+
+	pthread_mutex_lock(&bufmgr_gem->lock);
+	DRMLISTFOREACHENTRYSAFE(bo_gem, next, &bufmgr_gem->userptr_cache, head) {
+		uintptr_t bo_start = (uintptr_t)bo_gem->user_virtual;
+
+		if (bo_start >= start + size ||
+		    bo_start + bo_gem->bo.size <= start)
+			continue;
+
+		DRMLISTDELINIT(&bo_gem->head);
+		bufmgr_gem->userptr_cache_count--;
+		drm_intel_gem_bo_free(&bo_gem->bo);
+	}
+	pthread_mutex_unlock(&bufmgr_gem->lock);
+}
+
 static int
 parse_devid_override(const char *devid_override)
 {
@@ -3329,6 +4565,197 @@ drm_intel_reg_read(drm_intel_bufmgr *bufmgr,
 	return ret;
 }
 
+static void
+drm_intel_gem_timestamp_build(drm_intel_bufmgr_gem *bufmgr_gem,
+			      uint32_t *cmd)
+{
+	static const uint32_t regs[TIMESTAMP_RINGS] = {
+		0x2358, 0x12358, 0x22358, 0x1a358
+	};
+	struct drm_intel_gem_timestamps *ts = bufmgr_gem->timestamps;
+	struct drm_i915_gem_relocation_entry *reloc;
+	uint32_t handle = to_bo_gem(ts->query_bo)->gem_handle;
+	int gen8 = bufmgr_gem->gen >= 8;
+	int ring, slot, end, n;
+	uint32_t base, *p;
+
+	for (ring = 0; ring < TIMESTAMP_RINGS; ring++) {
+		for (slot = 0; slot < TIMESTAMP_SLOTS; slot++) {
+			for (end = 0; end < 2; end++) {
+				base = drm_intel_gem_timestamp_cmd_offset(ring,
+									  slot,
+									  end);
+				reloc = ts->relocs[ring][slot][end];
+				p = cmd + base / 4;
+				n = 0;
+
+				p[n++] = MI_STORE_REGISTER_MEM | (gen8 ? 2 : 1);
+				p[n++] = regs[ring];
+				reloc[0].offset = base + n * 4;
+				reloc[0].delta = slot * sizeof(*ts->slots) +
+					(end ? 4 : 0);
+				p[n++] = 0;
+				if (gen8)
+					p[n++] = 0;
+
+				if (end) {
+					p[n++] = MI_STORE_DATA_IMM | 2;
+					if (!gen8)
+						p[n++] = 0;
+					reloc[1].offset = base + n * 4;
+					reloc[1].delta = slot * sizeof(*ts->slots) + 8;
+					p[n++] = 0;
+					if (gen8)
+						p[n++] = 0;
+					p[n++] = 1;
+				}
+
+				p[n++] = MI_BATCH_BUFFER_END;
+
+				for (n = 0; n < 1 + end; n++) {
+					reloc[n].target_handle = handle;
+					reloc[n].read_domains =
+						I915_GEM_DOMAIN_INSTRUCTION;
+					reloc[n].write_domain =
+						I915_GEM_DOMAIN_INSTRUCTION;
+				}
+			}
+		}
+	}
+}
+
+/**
+ * Brackets every batch submitted with drm_intel_bo_exec(),
+ * drm_intel_bo_mrb_exec(), drm_intel_gem_bo_context_exec() and
+ * drm_intel_gem_bo_fence_exec() with writes of the engine's TIMESTAMP
+ * register, read back with drm_intel_bufmgr_gem_poll_timestamps().
+ *
+ * Each timestamp is written by a small batch of its own, submitted right
+ * before and after the timed one on the same context and engine, so the
+ * batch itself is left untouched.  This costs two execbuffer calls per
+ * batch.  Batches on the second video engine aren't timed.
+ *
+ * Returns 0, -ENODEV before gen7 or without execbuffer2, or -ENOMEM.
+ */
+drm_public int
+drm_intel_bufmgr_gem_enable_timestamps(drm_intel_bufmgr *bufmgr)
+{
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *)bufmgr;
+	struct drm_intel_gem_timestamps *ts;
+	struct drm_i915_gem_caching caching;
+	drm_i915_getparam_t gp;
+	uint32_t size = TIMESTAMP_RINGS * TIMESTAMP_SLOTS * 2 *
+			TIMESTAMP_CMD_SIZE;
+	uint32_t *cmd;
+	int value = 0;
+
+	if (bufmgr_gem->timestamps)
+		return 0;
+	if (bufmgr_gem->gen < 7 ||
+	    bufmgr_gem->bufmgr.bo_exec != drm_intel_gem_bo_exec2)
+		return -ENODEV;
+
+	ts = calloc(1, sizeof(*ts));
+	cmd = calloc(1, size);
+	if (!ts || !cmd)
+		goto err;
+
+	ts->query_bo = drm_intel_bo_alloc(bufmgr, "timestamps",
+					  TIMESTAMP_SLOTS * sizeof(*ts->slots),
+					  4096);
+	ts->cmd_bo = drm_intel_bo_alloc(bufmgr, "timestamp batches",
+					size, 4096);
+	if (!ts->query_bo || !ts->cmd_bo)
+		goto err;
+
+	/* snooped, so results can be read without waiting */
+	memclear(caching);
+	caching.handle = to_bo_gem(ts->query_bo)->gem_handle;
+	caching.caching = I915_CACHING_CACHED;
+	if (drmIoctl(bufmgr_gem->fd, DRM_IOCTL_I915_GEM_SET_CACHING, &caching))
+		goto err;
+	ts->slots = drm_intel_gem_bo_map__cpu(ts->query_bo);
+	if (!ts->slots)
+		goto err;
+
+	memclear(gp);
+	gp.param = I915_PARAM_CS_TIMESTAMP_FREQUENCY;
+	gp.value = &value;
+	if (drmIoctl(bufmgr_gem->fd, DRM_IOCTL_I915_GETPARAM, &gp) == 0 &&
+	    value > 0)
+		ts->frequency = value;
+	else if (bufmgr_gem->gen < 9)
+		ts->frequency = 12500000;
+
+	pthread_mutex_lock(&bufmgr_gem->lock);
+	bufmgr_gem->timestamps = ts;
+	drm_intel_gem_timestamp_build(bufmgr_gem, cmd);
+	pthread_mutex_unlock(&bufmgr_gem->lock);
+
+	if (drm_intel_bo_subdata(ts->cmd_bo, 0, size, cmd)) {
+		pthread_mutex_lock(&bufmgr_gem->lock);
+		bufmgr_gem->timestamps = NULL;
+		pthread_mutex_unlock(&bufmgr_gem->lock);
+		goto err;
+	}
+	free(cmd);
+
+	return 0;
+
+err:
+	if (ts) {
+		drm_intel_bo_unreference(ts->cmd_bo);
+		drm_intel_bo_unreference(ts->query_bo);
+	}
+	free(ts);
+	free(cmd);
+	return -ENOMEM;
+}
+
+/**
+ * Hands out the timestamps of finished batches, oldest first, without
+ * waiting: stops at the first batch still running.  Results of batches no
+ * one polled for are lost after 64 more.  Returns the number of entries
+ * filled in, or -ENODEV if timestamps aren't enabled.
+ */
+drm_public int
+drm_intel_bufmgr_gem_poll_timestamps(drm_intel_bufmgr *bufmgr,
+				     drm_intel_batch_timestamp *results,
+				     int max)
+{
+	drm_intel_bufmgr_gem *bufmgr_gem = (drm_intel_bufmgr_gem *)bufmgr;
+	struct drm_intel_gem_timestamps *ts = bufmgr_gem->timestamps;
+	drm_intel_batch_timestamp *r;
+	int count = 0, slot;
+
+	if (!ts)
+		return -ENODEV;
+
+	pthread_mutex_lock(&bufmgr_gem->lock);
+	while (count < max && ts->polled != ts->submitted) {
+		slot = ts->polled % TIMESTAMP_SLOTS;
+		if (ts->ring[slot] < 0) {
+			ts->polled++;
+			continue;
+		}
+		if (!ts->slots[slot].done)
+			break;
+
+		r = &results[count++];
+		r->batch = ts->polled++;
+		r->ring = ts->ring[slot];
+		r->start = ts->slots[slot].start;
+		r->end = ts->slots[slot].end;
+		/* 32-bit ticks, a batch can't run long enough to wrap twice */
+		r->ns = ts->frequency ?
+			(uint64_t)(uint32_t)(r->end - r->start) * 1000000000 /
+			ts->frequency : 0;
+	}
+	pthread_mutex_unlock(&bufmgr_gem->lock);
+
+	return count;
+}
+
 drm_public int
 drm_intel_get_subslice_total(int fd, unsigned int *subslice_total)
 {
@@ -3492,6 +4919,8 @@ drm_public void *drm_intel_gem_bo_map__gtt(drm_intel_bo *bo)
 			if (--bo_gem->map_count == 0)
 				drm_intel_gem_bo_close_vma(bufmgr_gem, bo_gem);
 			ptr = NULL;
+		} else {
+			drm_intel_gem_bo_mmap_account(bufmgr_gem, bo_gem, true);
 		}
 
 		bo_gem->gtt_virtual = ptr;
@@ -3538,6 +4967,7 @@ drm_public void *drm_intel_gem_bo_map__cpu(drm_intel_bo *bo)
 		} else {
 			VG(VALGRIND_MALLOCLIKE_BLOCK(mmap_arg.addr_ptr, mmap_arg.size, 0, 1));
 			bo_gem->mem_virtual = (void *)(uintptr_t) mmap_arg.addr_ptr;
+			drm_intel_gem_bo_mmap_account(bufmgr_gem, bo_gem, true);
 		}
 	}
 	pthread_mutex_unlock(&bufmgr_gem->lock);
@@ -3581,6 +5011,7 @@ drm_public void *drm_intel_gem_bo_map__wc(drm_intel_bo *bo)
 		} else {
 			VG(VALGRIND_MALLOCLIKE_BLOCK(mmap_arg.addr_ptr, mmap_arg.size, 0, 1));
 			bo_gem->wc_virtual = (void *)(uintptr_t) mmap_arg.addr_ptr;
+			drm_intel_gem_bo_mmap_account(bufmgr_gem, bo_gem, true);
 		}
 	}
 	pthread_mutex_unlock(&bufmgr_gem->lock);
@@ -3600,7 +5031,7 @@ drm_intel_bufmgr_gem_init(int fd, int batch_size)
 	drm_intel_bufmgr_gem *bufmgr_gem;
 	struct drm_i915_gem_get_aperture aperture;
 	drm_i915_getparam_t gp;
-	int ret, tmp;
+	int ret, tmp, i;
 	bool exec2 = false;
 
 	pthread_mutex_lock(&bufmgr_list_mutex);
@@ -3621,6 +5052,8 @@ drm_intel_bufmgr_gem_init(int fd, int batch_size)
 		bufmgr_gem = NULL;
 		goto exit;
 	}
+	for (i = 0; i < INTEL_BO_MAGAZINE_SHARDS; i++)
+		pthread_mutex_init(&bufmgr_gem->magazines[i].lock, NULL);
 
 	memclear(aperture);
 	ret = drmIoctl(bufmgr_gem->fd,
@@ -3694,6 +5127,14 @@ drm_intel_bufmgr_gem_init(int fd, int batch_size)
 	ret = drmIoctl(bufmgr_gem->fd, DRM_IOCTL_I915_GETPARAM, &gp);
 	bufmgr_gem->has_exec_async = ret == 0;
 
+	gp.param = I915_PARAM_HAS_EXEC_NO_RELOC;
+	ret = drmIoctl(bufmgr_gem->fd, DRM_IOCTL_I915_GETPARAM, &gp);
+	if (ret == 0) {
+		gp.param = I915_PARAM_HAS_EXEC_HANDLE_LUT;
+		ret = drmIoctl(bufmgr_gem->fd, DRM_IOCTL_I915_GETPARAM, &gp);
+	}
+	bufmgr_gem->has_exec_lut = ret == 0;
+
 	bufmgr_gem->bufmgr.bo_alloc_userptr = check_bo_alloc_userptr;
 
 	gp.param = I915_PARAM_HAS_WAIT_TIMEOUT;
@@ -3800,7 +5241,11 @@ drm_intel_bufmgr_gem_init(int fd, int batch_size)
 	init_cache_buckets(bufmgr_gem);
 
 	DRMINITLISTHEAD(&bufmgr_gem->vma_cache);
+	DRMINITLISTHEAD(&bufmgr_gem->userptr_cache);
 	bufmgr_gem->vma_max = -1; /* unlimited by default */
+	/* but don't let cached mappings eat a 32-bit address space */
+	if (sizeof(void *) == 4)
+		bufmgr_gem->vma_budget = 512 * 1024 * 1024;
 
 	DRMLISTADD(&bufmgr_gem->managers, &bufmgr_list);
 
@@ -23,18 +23,20 @@
 #include "intel_chipset.h"
 
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdbool.h>
+#include <stdlib.h>
 
 #include "i915_pciids.h"
 
 #undef INTEL_VGA_DEVICE
 #define INTEL_VGA_DEVICE(id, gen) { id, gen }
 
-static const struct pci_device {
+static struct pci_device {
 	uint16_t device;
 	uint16_t gen;
 } pciids[] = {
-	/* Keep ids sorted by gen; latest gen first */
+	/* Sorted by device on first use */
 	INTEL_TGL_12_IDS(12),
 	INTEL_EHL_IDS(11),
 	INTEL_ICL_11_IDS(11),
@@ -46,42 +48,49 @@ static const struct pci_device {
 	INTEL_SKL_IDS(9),
 };
 
-drm_private bool intel_is_genx(unsigned int devid, int gen)
+static pthread_once_t pciids_once = PTHREAD_ONCE_INIT;
+
+static int pci_device_cmp(const void *a, const void *b)
+{
+	const struct pci_device *pa = a, *pb = b;
+
+	return (int)pa->device - (int)pb->device;
+}
+
+static void pciids_sort(void)
 {
-	const struct pci_device *p,
-		  *pend = pciids + sizeof(pciids) / sizeof(pciids[0]);
+	qsort(pciids, sizeof(pciids) / sizeof(pciids[0]), sizeof(pciids[0]),
+	      pci_device_cmp);
+}
 
-	for (p = pciids; p < pend; p++) {
-		/* PCI IDs are sorted */
-		if (p->gen < gen)
-			break;
+static const struct pci_device *pci_device_find(unsigned int devid)
+{
+	struct pci_device key = { .device = devid };
 
-		if (p->device != devid)
-			continue;
+	if (devid > UINT16_MAX)
+		return NULL;
 
-		if (gen == p->gen)
-			return true;
+	pthread_once(&pciids_once, pciids_sort);
+	return bsearch(&key, pciids, sizeof(pciids) / sizeof(pciids[0]),
+		       sizeof(pciids[0]), pci_device_cmp);
+}
 
-		break;
-	}
+drm_private bool intel_is_genx(unsigned int devid, int gen)
+{
+	const struct pci_device *p = pci_device_find(devid);
 
-	return false;
+	return p && p->gen == gen;
 }
 
 drm_private bool intel_get_genx(unsigned int devid, int *gen)
 {
-	const struct pci_device *p,
-		  *pend = pciids + sizeof(pciids) / sizeof(pciids[0]);
-
-	for (p = pciids; p < pend; p++) {
-		if (p->device != devid)
-			continue;
+	const struct pci_device *p = pci_device_find(devid);
 
-		if (gen)
-			*gen = p->gen;
+	if (!p)
+		return false;
 
-		return true;
-	}
+	if (gen)
+		*gen = p->gen;
 
-	return false;
+	return true;
 }
@@ -78,24 +78,78 @@ struct drm_intel_decode {
 	bool dump_past_end;
 
 	bool overflowed;
-};
 
-static FILE *out;
-static uint32_t saved_s2 = 0, saved_s4 = 0;
-static char saved_s2_set = 0, saved_s4_set = 0;
-static uint32_t head_offset = 0xffffffff;	/* undefined */
-static uint32_t tail_offset = 0xffffffff;	/* undefined */
+	/** @{
+	 * S2 and S4 of the last 3DSTATE_LOAD_STATE_IMMEDIATE_1, which
+	 * describe the vertex format of i915 primitives.
+	 */
+	uint32_t saved_s2, saved_s4;
+	bool saved_s2_set, saved_s4_set;
+	/** @} */
+
+	/**
+	 * Output not written to out yet.  Batches from hang dumps can be
+	 * megabytes, so rather than a stdio call per line, output is
+	 * formatted here and written in large chunks.
+	 */
+	char buf[16384];
+	unsigned int buf_len;
+};
 
 #ifndef ARRAY_SIZE
 #define ARRAY_SIZE(A) (sizeof(A)/sizeof(A[0]))
 #endif
 
 #define BUFFER_FAIL(_count, _len, _name) do {			\
-    fprintf(out, "Buffer size too small in %s (%d < %d)\n",	\
+    decode_printf(ctx, "Buffer size too small in %s (%d < %d)\n",	\
 	    (_name), (_count), (_len));				\
     return _count;						\
 } while (0)
 
+static void
+decode_flush(struct drm_intel_decode *ctx)
+{
+	if (ctx->buf_len)
+		fwrite(ctx->buf, 1, ctx->buf_len, ctx->out);
+	ctx->buf_len = 0;
+}
+
+static void DRM_PRINTFLIKE(2, 0)
+decode_vprintf(struct drm_intel_decode *ctx, const char *fmt, va_list va)
+{
+	unsigned int room = sizeof(ctx->buf) - ctx->buf_len;
+	va_list copy;
+	int len;
+
+	va_copy(copy, va);
+	len = vsnprintf(ctx->buf + ctx->buf_len, room, fmt, copy);
+	va_end(copy);
+	if (len < 0)
+		return;
+
+	if ((unsigned int)len < room) {
+		ctx->buf_len += len;
+		return;
+	}
+
+	/* Didn't fit, the truncated copy is dropped with the flush */
+	decode_flush(ctx);
+	if ((unsigned int)len < sizeof(ctx->buf))
+		ctx->buf_len = vsnprintf(ctx->buf, sizeof(ctx->buf), fmt, va);
+	else
+		vfprintf(ctx->out, fmt, va);
+}
+
+static void DRM_PRINTFLIKE(2, 3)
+decode_printf(struct drm_intel_decode *ctx, const char *fmt, ...)
+{
+	va_list va;
+
+	va_start(va, fmt);
+	decode_vprintf(ctx, fmt, va);
+	va_end(va);
+}
+
 static float int_as_float(uint32_t intval)
 {
 	union intfloat {
@@ -117,23 +171,23 @@ instr_out(struct drm_intel_decode *ctx, unsigned int index,
 
 	if (index > ctx->count) {
 		if (!ctx->overflowed) {
-			fprintf(out, "ERROR: Decode attempted to continue beyond end of batchbuffer\n");
+			decode_printf(ctx, "ERROR: Decode attempted to continue beyond end of batchbuffer\n");
 			ctx->overflowed = true;
 		}
 		return;
 	}
 
-	if (offset == head_offset)
+	if (offset == ctx->head)
 		parseinfo = "HEAD";
-	else if (offset == tail_offset)
+	else if (offset == ctx->tail)
 		parseinfo = "TAIL";
 	else
 		parseinfo = "    ";
 
-	fprintf(out, "0x%08x: %s 0x%08x: %s", offset, parseinfo,
-		ctx->data[index], index == 0 ? "" : "   ");
+	decode_printf(ctx, "0x%08x: %s 0x%08x: %s", offset, parseinfo,
+		      ctx->data[index], index == 0 ? "" : "   ");
 	va_start(va, fmt);
-	vfprintf(out, fmt, va);
+	decode_vprintf(ctx, fmt, va);
 	va_end(va);
 }
 
@@ -228,7 +282,7 @@ decode_mi(struct drm_intel_decode *ctx)
 	const char *post_sync_op = "";
 	uint32_t *data = ctx->data;
 
-	struct {
+	static const struct opcode_mi_info {
 		uint32_t opcode;
 		int len_mask;
 		unsigned int min_len;
@@ -259,7 +313,8 @@ decode_mi(struct drm_intel_decode *ctx)
 		{ 0x28, 0x3f, 3, 3, "MI_REPORT_PERF_COUNT" },
 		{ 0x29, 0xff, 3, 3, "MI_LOAD_REGISTER_MEM" },
 		{ 0x0b, 0, 1, 1, "MI_SUSPEND_FLUSH"},
-	}, *opcode_mi = NULL;
+	};
+	const struct opcode_mi_info *opcode_mi = NULL;
 
 	/* check instruction length */
 	for (opcode = 0; opcode < sizeof(opcodes_mi) / sizeof(opcodes_mi[0]);
@@ -271,7 +326,7 @@ decode_mi(struct drm_intel_decode *ctx)
 				    (data[0] & opcodes_mi[opcode].len_mask) + 2;
 				if (len < opcodes_mi[opcode].min_len
 				    || len > opcodes_mi[opcode].max_len) {
-					fprintf(out,
+					decode_printf(ctx,
 						"Bad length (%d) in %s, [%d, %d]\n",
 						len, opcodes_mi[opcode].name,
 						opcodes_mi[opcode].min_len,
@@ -421,7 +476,7 @@ decode_2d(struct drm_intel_decode *ctx)
 	unsigned int opcode, len;
 	uint32_t *data = ctx->data;
 
-	struct {
+	static const struct opcode_2d_info {
 		uint32_t opcode;
 		unsigned int min_len;
 		unsigned int max_len;
@@ -463,7 +518,7 @@ decode_2d(struct drm_intel_decode *ctx)
 
 		len = (data[0] & 0x000000ff) + 2;
 		if (len != 3)
-			fprintf(out, "Bad count in XY_SCANLINES_BLT\n");
+			decode_printf(ctx, "Bad count in XY_SCANLINES_BLT\n");
 
 		instr_out(ctx, 1, "dest (%d,%d)\n",
 			  data[1] & 0xffff, data[1] >> 16);
@@ -475,7 +530,7 @@ decode_2d(struct drm_intel_decode *ctx)
 
 		len = (data[0] & 0x000000ff) + 2;
 		if (len != 8)
-			fprintf(out, "Bad count in XY_SETUP_BLT\n");
+			decode_printf(ctx, "Bad count in XY_SETUP_BLT\n");
 
 		decode_2d_br01(ctx);
 		instr_out(ctx, 2, "cliprect (%d,%d)\n",
@@ -493,7 +548,7 @@ decode_2d(struct drm_intel_decode *ctx)
 
 		len = (data[0] & 0x000000ff) + 2;
 		if (len != 3)
-			fprintf(out, "Bad count in XY_SETUP_CLIP_BLT\n");
+			decode_printf(ctx, "Bad count in XY_SETUP_CLIP_BLT\n");
 
 		instr_out(ctx, 1, "cliprect (%d,%d)\n",
 			  data[1] & 0xffff, data[2] >> 16);
@@ -505,7 +560,7 @@ decode_2d(struct drm_intel_decode *ctx)
 
 		len = (data[0] & 0x000000ff) + 2;
 		if (len != 9)
-			fprintf(out,
+			decode_printf(ctx,
 				"Bad count in XY_SETUP_MONO_PATTERN_SL_BLT\n");
 
 		decode_2d_br01(ctx);
@@ -525,7 +580,7 @@ decode_2d(struct drm_intel_decode *ctx)
 
 		len = (data[0] & 0x000000ff) + 2;
 		if (len != 6)
-			fprintf(out, "Bad count in XY_COLOR_BLT\n");
+			decode_printf(ctx, "Bad count in XY_COLOR_BLT\n");
 
 		decode_2d_br01(ctx);
 		instr_out(ctx, 2, "(%d,%d)\n",
@@ -540,7 +595,7 @@ decode_2d(struct drm_intel_decode *ctx)
 
 		len = (data[0] & 0x000000ff) + 2;
 		if (len != 8)
-			fprintf(out, "Bad count in XY_SRC_COPY_BLT\n");
+			decode_printf(ctx, "Bad count in XY_SRC_COPY_BLT\n");
 
 		decode_2d_br01(ctx);
 		instr_out(ctx, 2, "dst (%d,%d)\n",
@@ -568,7 +623,7 @@ decode_2d(struct drm_intel_decode *ctx)
 				len = (data[0] & 0x000000ff) + 2;
 				if (len < opcodes_2d[opcode].min_len ||
 				    len > opcodes_2d[opcode].max_len) {
-					fprintf(out, "Bad count in %s\n",
+					decode_printf(ctx, "Bad count in %s\n",
 						opcodes_2d[opcode].name);
 				}
 			}
@@ -620,7 +675,7 @@ decode_3d_1c(struct drm_intel_decode *ctx)
 
 /** Sets the string dstname to describe the destination of the PS instruction */
 static void
-i915_get_instruction_dst(uint32_t *data, int i, char *dstname, int do_mask)
+i915_get_instruction_dst(struct drm_intel_decode *ctx, uint32_t *data, int i, char *dstname, int do_mask)
 {
 	uint32_t a0 = data[i];
 	int dst_nr = (a0 >> 14) & 0xf;
@@ -657,22 +712,22 @@ i915_get_instruction_dst(uint32_t *data, int i, char *dstname, int do_mask)
 	switch ((a0 >> 19) & 0x7) {
 	case 0:
 		if (dst_nr > 15)
-			fprintf(out, "bad destination reg R%d\n", dst_nr);
+			decode_printf(ctx, "bad destination reg R%d\n", dst_nr);
 		sprintf(dstname, "R%d%s%s", dst_nr, dstmask, sat);
 		break;
 	case 4:
 		if (dst_nr > 0)
-			fprintf(out, "bad destination reg oC%d\n", dst_nr);
+			decode_printf(ctx, "bad destination reg oC%d\n", dst_nr);
 		sprintf(dstname, "oC%s%s", dstmask, sat);
 		break;
 	case 5:
 		if (dst_nr > 0)
-			fprintf(out, "bad destination reg oD%d\n", dst_nr);
+			decode_printf(ctx, "bad destination reg oD%d\n", dst_nr);
 		sprintf(dstname, "oD%s%s", dstmask, sat);
 		break;
 	case 6:
 		if (dst_nr > 3)
-			fprintf(out, "bad destination reg U%d\n", dst_nr);
+			decode_printf(ctx, "bad destination reg U%d\n", dst_nr);
 		sprintf(dstname, "U%d%s%s", dst_nr, dstmask, sat);
 		break;
 	default:
@@ -703,13 +758,13 @@ i915_get_channel_swizzle(uint32_t select)
 }
 
 static void
-i915_get_instruction_src_name(uint32_t src_type, uint32_t src_nr, char *name)
+i915_get_instruction_src_name(struct drm_intel_decode *ctx, uint32_t src_type, uint32_t src_nr, char *name)
 {
 	switch (src_type) {
 	case 0:
 		sprintf(name, "R%d", src_nr);
 		if (src_nr > 15)
-			fprintf(out, "bad src reg %s\n", name);
+			decode_printf(ctx, "bad src reg %s\n", name);
 		break;
 	case 1:
 		if (src_nr < 8)
@@ -721,38 +776,38 @@ i915_get_instruction_src_name(uint32_t src_type, uint32_t src_nr, char *name)
 		else if (src_nr == 10)
 			sprintf(name, "FOG");
 		else {
-			fprintf(out, "bad src reg T%d\n", src_nr);
+			decode_printf(ctx, "bad src reg T%d\n", src_nr);
 			sprintf(name, "RESERVED");
 		}
 		break;
 	case 2:
 		sprintf(name, "C%d", src_nr);
 		if (src_nr > 31)
-			fprintf(out, "bad src reg %s\n", name);
+			decode_printf(ctx, "bad src reg %s\n", name);
 		break;
 	case 4:
 		sprintf(name, "oC");
 		if (src_nr > 0)
-			fprintf(out, "bad src reg oC%d\n", src_nr);
+			decode_printf(ctx, "bad src reg oC%d\n", src_nr);
 		break;
 	case 5:
 		sprintf(name, "oD");
 		if (src_nr > 0)
-			fprintf(out, "bad src reg oD%d\n", src_nr);
+			decode_printf(ctx, "bad src reg oD%d\n", src_nr);
 		break;
 	case 6:
 		sprintf(name, "U%d", src_nr);
 		if (src_nr > 3)
-			fprintf(out, "bad src reg %s\n", name);
+			decode_printf(ctx, "bad src reg %s\n", name);
 		break;
 	default:
-		fprintf(out, "bad src reg type %d\n", src_type);
+		decode_printf(ctx, "bad src reg type %d\n", src_type);
 		sprintf(name, "RESERVED");
 		break;
 	}
 }
 
-static void i915_get_instruction_src0(uint32_t *data, int i, char *srcname)
+static void i915_get_instruction_src0(struct drm_intel_decode *ctx, uint32_t *data, int i, char *srcname)
 {
 	uint32_t a0 = data[i];
 	uint32_t a1 = data[i + 1];
@@ -763,14 +818,14 @@ static void i915_get_instruction_src0(uint32_t *data, int i, char *srcname)
 	const char *swizzle_w = i915_get_channel_swizzle((a1 >> 16) & 0xf);
 	char swizzle[100];
 
-	i915_get_instruction_src_name((a0 >> 7) & 0x7, src_nr, srcname);
+	i915_get_instruction_src_name(ctx, (a0 >> 7) & 0x7, src_nr, srcname);
 	sprintf(swizzle, ".%s%s%s%s", swizzle_x, swizzle_y, swizzle_z,
 		swizzle_w);
 	if (strcmp(swizzle, ".xyzw") != 0)
 		strcat(srcname, swizzle);
 }
 
-static void i915_get_instruction_src1(uint32_t *data, int i, char *srcname)
+static void i915_get_instruction_src1(struct drm_intel_decode *ctx, uint32_t *data, int i, char *srcname)
 {
 	uint32_t a1 = data[i + 1];
 	uint32_t a2 = data[i + 2];
@@ -781,14 +836,14 @@ static void i915_get_instruction_src1(uint32_t *data, int i, char *srcname)
 	const char *swizzle_w = i915_get_channel_swizzle((a2 >> 24) & 0xf);
 	char swizzle[100];
 
-	i915_get_instruction_src_name((a1 >> 13) & 0x7, src_nr, srcname);
+	i915_get_instruction_src_name(ctx, (a1 >> 13) & 0x7, src_nr, srcname);
 	sprintf(swizzle, ".%s%s%s%s", swizzle_x, swizzle_y, swizzle_z,
 		swizzle_w);
 	if (strcmp(swizzle, ".xyzw") != 0)
 		strcat(srcname, swizzle);
 }
 
-static void i915_get_instruction_src2(uint32_t *data, int i, char *srcname)
+static void i915_get_instruction_src2(struct drm_intel_decode *ctx, uint32_t *data, int i, char *srcname)
 {
 	uint32_t a2 = data[i + 2];
 	int src_nr = (a2 >> 16) & 0x1f;
@@ -798,7 +853,7 @@ static void i915_get_instruction_src2(uint32_t *data, int i, char *srcname)
 	const char *swizzle_w = i915_get_channel_swizzle((a2 >> 0) & 0xf);
 	char swizzle[100];
 
-	i915_get_instruction_src_name((a2 >> 21) & 0x7, src_nr, srcname);
+	i915_get_instruction_src_name(ctx, (a2 >> 21) & 0x7, src_nr, srcname);
 	sprintf(swizzle, ".%s%s%s%s", swizzle_x, swizzle_y, swizzle_z,
 		swizzle_w);
 	if (strcmp(swizzle, ".xyzw") != 0)
@@ -806,13 +861,13 @@ static void i915_get_instruction_src2(uint32_t *data, int i, char *srcname)
 }
 
 static void
-i915_get_instruction_addr(uint32_t src_type, uint32_t src_nr, char *name)
+i915_get_instruction_addr(struct drm_intel_decode *ctx, uint32_t src_type, uint32_t src_nr, char *name)
 {
 	switch (src_type) {
 	case 0:
 		sprintf(name, "R%d", src_nr);
 		if (src_nr > 15)
-			fprintf(out, "bad src reg %s\n", name);
+			decode_printf(ctx, "bad src reg %s\n", name);
 		break;
 	case 1:
 		if (src_nr < 8)
@@ -824,22 +879,22 @@ i915_get_instruction_addr(uint32_t src_type, uint32_t src_nr, char *name)
 		else if (src_nr == 10)
 			sprintf(name, "FOG");
 		else {
-			fprintf(out, "bad src reg T%d\n", src_nr);
+			decode_printf(ctx, "bad src reg T%d\n", src_nr);
 			sprintf(name, "RESERVED");
 		}
 		break;
 	case 4:
 		sprintf(name, "oC");
 		if (src_nr > 0)
-			fprintf(out, "bad src reg oC%d\n", src_nr);
+			decode_printf(ctx, "bad src reg oC%d\n", src_nr);
 		break;
 	case 5:
 		sprintf(name, "oD");
 		if (src_nr > 0)
-			fprintf(out, "bad src reg oD%d\n", src_nr);
+			decode_printf(ctx, "bad src reg oD%d\n", src_nr);
 		break;
 	default:
-		fprintf(out, "bad src reg type %d\n", src_type);
+		decode_printf(ctx, "bad src reg type %d\n", src_type);
 		sprintf(name, "RESERVED");
 		break;
 	}
@@ -851,8 +906,8 @@ i915_decode_alu1(struct drm_intel_decode *ctx,
 {
 	char dst[100], src0[100];
 
-	i915_get_instruction_dst(ctx->data, i, dst, 1);
-	i915_get_instruction_src0(ctx->data, i, src0);
+	i915_get_instruction_dst(ctx, ctx->data, i, dst, 1);
+	i915_get_instruction_src0(ctx, ctx->data, i, src0);
 
 	instr_out(ctx, i++, "%s: %s %s, %s\n", instr_prefix,
 		  op_name, dst, src0);
@@ -866,9 +921,9 @@ i915_decode_alu2(struct drm_intel_decode *ctx,
 {
 	char dst[100], src0[100], src1[100];
 
-	i915_get_instruction_dst(ctx->data, i, dst, 1);
-	i915_get_instruction_src0(ctx->data, i, src0);
-	i915_get_instruction_src1(ctx->data, i, src1);
+	i915_get_instruction_dst(ctx, ctx->data, i, dst, 1);
+	i915_get_instruction_src0(ctx, ctx->data, i, src0);
+	i915_get_instruction_src1(ctx, ctx->data, i, src1);
 
 	instr_out(ctx, i++, "%s: %s %s, %s, %s\n", instr_prefix,
 		  op_name, dst, src0, src1);
@@ -882,10 +937,10 @@ i915_decode_alu3(struct drm_intel_decode *ctx,
 {
 	char dst[100], src0[100], src1[100], src2[100];
 
-	i915_get_instruction_dst(ctx->data, i, dst, 1);
-	i915_get_instruction_src0(ctx->data, i, src0);
-	i915_get_instruction_src1(ctx->data, i, src1);
-	i915_get_instruction_src2(ctx->data, i, src2);
+	i915_get_instruction_dst(ctx, ctx->data, i, dst, 1);
+	i915_get_instruction_src0(ctx, ctx->data, i, src0);
+	i915_get_instruction_src1(ctx, ctx->data, i, src1);
+	i915_get_instruction_src2(ctx, ctx->data, i, src2);
 
 	instr_out(ctx, i++, "%s: %s %s, %s, %s, %s\n", instr_prefix,
 		  op_name, dst, src0, src1, src2);
@@ -903,8 +958,8 @@ i915_decode_tex(struct drm_intel_decode *ctx, int i,
 	char addr_name[100];
 	int sampler_nr;
 
-	i915_get_instruction_dst(ctx->data, i, dst_name, 0);
-	i915_get_instruction_addr((t1 >> 24) & 0x7,
+	i915_get_instruction_dst(ctx, ctx->data, i, dst_name, 0);
+	i915_get_instruction_addr(ctx, (t1 >> 24) & 0x7,
 				  (t1 >> 17) & 0xf, addr_name);
 	sampler_nr = t0 & 0xf;
 
@@ -930,30 +985,30 @@ i915_decode_dcl(struct drm_intel_decode *ctx, int i, char *instr_prefix)
 	case 1:
 		sprintf(dcl_mask, ".%s%s%s%s", dcl_x, dcl_y, dcl_z, dcl_w);
 		if (strcmp(dcl_mask, ".") == 0)
-			fprintf(out, "bad (empty) dcl mask\n");
+			decode_printf(ctx, "bad (empty) dcl mask\n");
 
 		if (dcl_nr > 10)
-			fprintf(out, "bad T%d dcl register number\n", dcl_nr);
+			decode_printf(ctx, "bad T%d dcl register number\n", dcl_nr);
 		if (dcl_nr < 8) {
 			if (strcmp(dcl_mask, ".x") != 0 &&
 			    strcmp(dcl_mask, ".xy") != 0 &&
 			    strcmp(dcl_mask, ".xz") != 0 &&
 			    strcmp(dcl_mask, ".w") != 0 &&
 			    strcmp(dcl_mask, ".xyzw") != 0) {
-				fprintf(out, "bad T%d.%s dcl mask\n", dcl_nr,
+				decode_printf(ctx, "bad T%d.%s dcl mask\n", dcl_nr,
 					dcl_mask);
 			}
 			instr_out(ctx, i++, "%s: DCL T%d%s\n",
 				  instr_prefix, dcl_nr, dcl_mask);
 		} else {
 			if (strcmp(dcl_mask, ".xz") == 0)
-				fprintf(out, "errataed bad dcl mask %s\n",
+				decode_printf(ctx, "errataed bad dcl mask %s\n",
 					dcl_mask);
 			else if (strcmp(dcl_mask, ".xw") == 0)
-				fprintf(out, "errataed bad dcl mask %s\n",
+				decode_printf(ctx, "errataed bad dcl mask %s\n",
 					dcl_mask);
 			else if (strcmp(dcl_mask, ".xzw") == 0)
-				fprintf(out, "errataed bad dcl mask %s\n",
+				decode_printf(ctx, "errataed bad dcl mask %s\n",
 					dcl_mask);
 
 			if (dcl_nr == 8) {
@@ -989,7 +1044,7 @@ i915_decode_dcl(struct drm_intel_decode *ctx, int i, char *instr_prefix)
 			break;
 		}
 		if (dcl_nr > 15)
-			fprintf(out, "bad S%d dcl register number\n", dcl_nr);
+			decode_printf(ctx, "bad S%d dcl register number\n", dcl_nr);
 		instr_out(ctx, i++, "%s: DCL S%d %s\n",
 			  instr_prefix, dcl_nr, sampletype);
 		instr_out(ctx, i++, "%s\n", instr_prefix);
@@ -1272,7 +1327,7 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 	uint32_t *data = ctx->data;
 	uint32_t devid = ctx->devid;
 
-	struct {
+	static const struct opcode_3d_1d_info {
 		uint32_t opcode;
 		int i830_only;
 		unsigned int min_len;
@@ -1295,7 +1350,8 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 		{ 0x8d, 1, 3, 3, "3DSTATE_W_STATE_I830" },
 		{ 0x01, 1, 2, 2, "3DSTATE_COLOR_FACTOR_I830" },
 		{ 0x02, 1, 2, 2, "3DSTATE_MAP_COORD_SETBIND_I830"},
-	}, *opcode_3d_1d;
+	};
+	const struct opcode_3d_1d_info *opcode_3d_1d;
 
 	opcode = (data[0] & 0x00ff0000) >> 16;
 
@@ -1334,7 +1390,7 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 			instr_out(ctx, i++, "PSC.1\n");
 		}
 		if (len != i) {
-			fprintf(out, "Bad count in 3DSTATE_LOAD_INDIRECT\n");
+			decode_printf(ctx, "Bad count in 3DSTATE_LOAD_INDIRECT\n");
 			return len;
 		}
 		return len;
@@ -1350,12 +1406,12 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 					int tex_num;
 
 					if (word == 2) {
-						saved_s2_set = 1;
-						saved_s2 = data[i];
+						ctx->saved_s2_set = 1;
+						ctx->saved_s2 = data[i];
 					}
 					if (word == 4) {
-						saved_s4_set = 1;
-						saved_s4 = data[i];
+						ctx->saved_s4_set = 1;
+						ctx->saved_s4 = data[i];
 					}
 
 					switch (word) {
@@ -1384,43 +1440,43 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 								 tex_num *
 								 4) & 0xf) {
 							case 0:
-								fprintf(out,
+								decode_printf(ctx,
 									"%i=2D ",
 									tex_num);
 								break;
 							case 1:
-								fprintf(out,
+								decode_printf(ctx,
 									"%i=3D ",
 									tex_num);
 								break;
 							case 2:
-								fprintf(out,
+								decode_printf(ctx,
 									"%i=4D ",
 									tex_num);
 								break;
 							case 3:
-								fprintf(out,
+								decode_printf(ctx,
 									"%i=1D ",
 									tex_num);
 								break;
 							case 4:
-								fprintf(out,
+								decode_printf(ctx,
 									"%i=2D_16 ",
 									tex_num);
 								break;
 							case 5:
-								fprintf(out,
+								decode_printf(ctx,
 									"%i=4D_16 ",
 									tex_num);
 								break;
 							case 0xf:
-								fprintf(out,
+								decode_printf(ctx,
 									"%i=NP ",
 									tex_num);
 								break;
 							}
 						}
-						fprintf(out, "\n");
+						decode_printf(ctx, "\n");
 
 						break;
 					case 3:
@@ -1721,7 +1777,7 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 			}
 		}
 		if (len != i) {
-			fprintf(out,
+			decode_printf(ctx,
 				"Bad count in 3DSTATE_LOAD_STATE_IMMEDIATE_1\n");
 		}
 		return len;
@@ -1771,7 +1827,7 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 			}
 		}
 		if (len != i) {
-			fprintf(out,
+			decode_printf(ctx,
 				"Bad count in 3DSTATE_LOAD_STATE_IMMEDIATE_2\n");
 		}
 		return len;
@@ -1973,7 +2029,7 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 			}
 		}
 		if (len != i) {
-			fprintf(out, "Bad count in 3DSTATE_MAP_STATE\n");
+			decode_printf(ctx, "Bad count in 3DSTATE_MAP_STATE\n");
 			return len;
 		}
 		return len;
@@ -2000,7 +2056,7 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 			}
 		}
 		if (len != i) {
-			fprintf(out,
+			decode_printf(ctx,
 				"Bad count in 3DSTATE_PIXEL_SHADER_CONSTANTS\n");
 		}
 		return len;
@@ -2008,7 +2064,7 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 		instr_out(ctx, 0, "3DSTATE_PIXEL_SHADER_PROGRAM\n");
 		len = (data[0] & 0x000000ff) + 2;
 		if ((len - 1) % 3 != 0 || len > 370) {
-			fprintf(out,
+			decode_printf(ctx,
 				"Bad count in 3DSTATE_PIXEL_SHADER_PROGRAM\n");
 		}
 		i = 1;
@@ -2086,14 +2142,14 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 			}
 		}
 		if (len != i) {
-			fprintf(out, "Bad count in 3DSTATE_SAMPLER_STATE\n");
+			decode_printf(ctx, "Bad count in 3DSTATE_SAMPLER_STATE\n");
 		}
 		return len;
 	case 0x85:
 		len = (data[0] & 0x0000000f) + 2;
 
 		if (len != 2)
-			fprintf(out,
+			decode_printf(ctx,
 				"Bad count in 3DSTATE_DEST_BUFFER_VARIABLES\n");
 
 		instr_out(ctx, 0,
@@ -2163,7 +2219,7 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 
 			len = (data[0] & 0x0000000f) + 2;
 			if (len != 3)
-				fprintf(out,
+				decode_printf(ctx,
 					"Bad count in 3DSTATE_BUFFER_INFO\n");
 
 			switch ((data[1] >> 24) & 0x7) {
@@ -2196,7 +2252,7 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 		len = (data[0] & 0x0000000f) + 2;
 
 		if (len != 3)
-			fprintf(out,
+			decode_printf(ctx,
 				"Bad count in 3DSTATE_SCISSOR_RECTANGLE\n");
 
 		instr_out(ctx, 0, "3DSTATE_SCISSOR_RECTANGLE\n");
@@ -2210,7 +2266,7 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 		len = (data[0] & 0x0000000f) + 2;
 
 		if (len != 5)
-			fprintf(out,
+			decode_printf(ctx,
 				"Bad count in 3DSTATE_DRAWING_RECTANGLE\n");
 
 		instr_out(ctx, 0, "3DSTATE_DRAWING_RECTANGLE\n");
@@ -2228,7 +2284,7 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 		len = (data[0] & 0x0000000f) + 2;
 
 		if (len != 7)
-			fprintf(out, "Bad count in 3DSTATE_CLEAR_PARAMETERS\n");
+			decode_printf(ctx, "Bad count in 3DSTATE_CLEAR_PARAMETERS\n");
 
 		instr_out(ctx, 0, "3DSTATE_CLEAR_PARAMETERS\n");
 		instr_out(ctx, 1, "prim_type=%s, clear=%s%s%s\n",
@@ -2259,7 +2315,7 @@ decode_3d_1d(struct drm_intel_decode *ctx)
 				len = (data[0] & 0x0000ffff) + 2;
 				if (len < opcode_3d_1d->min_len ||
 				    len > opcode_3d_1d->max_len) {
-					fprintf(out, "Bad count in %s\n",
+					decode_printf(ctx, "Bad count in %s\n",
 						opcode_3d_1d->name);
 				}
 			}
@@ -2285,8 +2341,8 @@ decode_3d_primitive(struct drm_intel_decode *ctx)
 	char immediate = (data[0] & (1 << 23)) == 0;
 	unsigned int len, i, j, ret;
 	const char *primtype;
-	int original_s2 = saved_s2;
-	int original_s4 = saved_s4;
+	int original_s2 = ctx->saved_s2;
+	int original_s4 = ctx->saved_s4;
 
 	switch ((data[0] >> 18) & 0xf) {
 	case 0x0:
@@ -2321,8 +2377,8 @@ decode_3d_primitive(struct drm_intel_decode *ctx)
 		break;
 	case 0xa:
 		primtype = "CLEAR_RECT";
-		saved_s4 = 3 << 6;
-		saved_s2 = ~0;
+		ctx->saved_s4 = 3 << 6;
+		ctx->saved_s2 = ~0;
 		break;
 	default:
 		primtype = "unknown";
@@ -2336,8 +2392,8 @@ decode_3d_primitive(struct drm_intel_decode *ctx)
 			  primtype);
 		if (count < len)
 			BUFFER_FAIL(count, len, "3DPRIMITIVE inline");
-		if (!saved_s2_set || !saved_s4_set) {
-			fprintf(out, "unknown vertex format\n");
+		if (!ctx->saved_s2_set || !ctx->saved_s4_set) {
+			decode_printf(ctx, "unknown vertex format\n");
 			for (i = 1; i < len; i++) {
 				instr_out(ctx, i,
 					  "           vertex data (%f float)\n",
@@ -2352,13 +2408,13 @@ decode_3d_primitive(struct drm_intel_decode *ctx)
     if (i < len)							\
 	instr_out(ctx, i, " V%d."fmt"\n", vertex, __VA_ARGS__); \
     else								\
-	fprintf(out, " missing data in V%d\n", vertex);			\
+	decode_printf(ctx, " missing data in V%d\n", vertex);			\
     i++;								\
 } while (0)
 
 				VERTEX_OUT("X = %f", int_as_float(data[i]));
 				VERTEX_OUT("Y = %f", int_as_float(data[i]));
-				switch (saved_s4 >> 6 & 0x7) {
+				switch (ctx->saved_s4 >> 6 & 0x7) {
 				case 0x1:
 					VERTEX_OUT("Z = %f",
 						   int_as_float(data[i]));
@@ -2376,10 +2432,10 @@ decode_3d_primitive(struct drm_intel_decode *ctx)
 						   int_as_float(data[i]));
 					break;
 				default:
-					fprintf(out, "bad S4 position mask\n");
+					decode_printf(ctx, "bad S4 position mask\n");
 				}
 
-				if (saved_s4 & (1 << 10)) {
+				if (ctx->saved_s4 & (1 << 10)) {
 					VERTEX_OUT
 					    ("color = (A=0x%02x, R=0x%02x, G=0x%02x, "
 					     "B=0x%02x)", data[i] >> 24,
@@ -2387,7 +2443,7 @@ decode_3d_primitive(struct drm_intel_decode *ctx)
 					     (data[i] >> 8) & 0xff,
 					     data[i] & 0xff);
 				}
-				if (saved_s4 & (1 << 11)) {
+				if (ctx->saved_s4 & (1 << 11)) {
 					VERTEX_OUT
 					    ("spec = (A=0x%02x, R=0x%02x, G=0x%02x, "
 					     "B=0x%02x)", data[i] >> 24,
@@ -2395,11 +2451,11 @@ decode_3d_primitive(struct drm_intel_decode *ctx)
 					     (data[i] >> 8) & 0xff,
 					     data[i] & 0xff);
 				}
-				if (saved_s4 & (1 << 12))
+				if (ctx->saved_s4 & (1 << 12))
 					VERTEX_OUT("width = 0x%08x)", data[i]);
 
 				for (tc = 0; tc <= 7; tc++) {
-					switch ((saved_s2 >> (tc * 4)) & 0xf) {
+					switch ((ctx->saved_s2 >> (tc * 4)) & 0xf) {
 					case 0x0:
 						VERTEX_OUT("T%d.X = %f", tc,
 							   int_as_float(data
@@ -2454,7 +2510,7 @@ decode_3d_primitive(struct drm_intel_decode *ctx)
 					case 0xf:
 						break;
 					default:
-						fprintf(out,
+						decode_printf(ctx,
 							"bad S2.T%d format\n",
 							tc);
 					}
@@ -2499,7 +2555,7 @@ decode_3d_primitive(struct drm_intel_decode *ctx)
 							  data[i] >> 16);
 					}
 				}
-				fprintf(out,
+				decode_printf(ctx,
 					"3DPRIMITIVE: no terminator found in index buffer\n");
 				ret = count;
 				goto out;
@@ -2532,8 +2588,8 @@ decode_3d_primitive(struct drm_intel_decode *ctx)
 	}
 
 out:
-	saved_s2 = original_s2;
-	saved_s4 = original_s4;
+	ctx->saved_s2 = original_s2;
+	ctx->saved_s4 = original_s4;
 	return ret;
 }
 
@@ -2544,7 +2600,7 @@ decode_3d(struct drm_intel_decode *ctx)
 	unsigned int idx;
 	uint32_t *data = ctx->data;
 
-	struct {
+	static const struct opcode_3d_info {
 		uint32_t opcode;
 		unsigned int min_len;
 		unsigned int max_len;
@@ -2559,7 +2615,8 @@ decode_3d(struct drm_intel_decode *ctx)
 		{ 0x0d, 1, 1, "3DSTATE_MODES_4" },
 		{ 0x0c, 1, 1, "3DSTATE_MODES_5" },
 		{ 0x07, 1, 1, "3DSTATE_RASTERIZATION_RULES"},
-	}, *opcode_3d;
+	};
+	const struct opcode_3d_info *opcode_3d;
 
 	opcode = (data[0] & 0x1f000000) >> 24;
 
@@ -2582,7 +2639,7 @@ decode_3d(struct drm_intel_decode *ctx)
 				len = (data[0] & 0xff) + 2;
 				if (len < opcode_3d->min_len ||
 				    len > opcode_3d->max_len) {
-					fprintf(out, "Bad count in %s\n",
+					decode_printf(ctx, "Bad count in %s\n",
 						opcode_3d->name);
 				}
 			}
@@ -2724,7 +2781,7 @@ i965_decode_urb_fence(struct drm_intel_decode *ctx, int len)
 	uint32_t *data = ctx->data;
 
 	if (len != 3)
-		fprintf(out, "Bad count in URB_FENCE\n");
+		decode_printf(ctx, "Bad count in URB_FENCE\n");
 
 	vs_fence = data[1] & 0x3ff;
 	gs_fence = (data[1] >> 10) & 0x3ff;
@@ -2747,13 +2804,13 @@ i965_decode_urb_fence(struct drm_intel_decode *ctx, int len)
 		  "sf fence: %d, vfe_fence: %d, cs_fence: %d\n",
 		  sf_fence, vfe_fence, cs_fence);
 	if (gs_fence < vs_fence)
-		fprintf(out, "gs fence < vs fence!\n");
+		decode_printf(ctx, "gs fence < vs fence!\n");
 	if (clip_fence < gs_fence)
-		fprintf(out, "clip fence < gs fence!\n");
+		decode_printf(ctx, "clip fence < gs fence!\n");
 	if (sf_fence < clip_fence)
-		fprintf(out, "sf fence < clip fence!\n");
+		decode_printf(ctx, "sf fence < clip fence!\n");
 	if (cs_fence < sf_fence)
-		fprintf(out, "cs fence < sf fence!\n");
+		decode_printf(ctx, "cs fence < sf fence!\n");
 
 	return len;
 }
@@ -3139,7 +3196,7 @@ decode_3d_965(struct drm_intel_decode *ctx)
 	uint32_t *data = ctx->data;
 	uint32_t devid = ctx->devid;
 
-	struct {
+	static const struct opcode_3d_965_info {
 		uint32_t opcode;
 		uint32_t len_mask;
 		int unsigned min_len;
@@ -3236,7 +3293,8 @@ decode_3d_965(struct drm_intel_decode *ctx)
 		{ 0x7a00, 0x00ff, 4, 6, "PIPE_CONTROL" },
 		{ 0x7b00, 0x00ff, 7, 7, NULL, 7, gen7_3DPRIMITIVE },
 		{ 0x7b00, 0x00ff, 6, 6, NULL, 0, gen4_3DPRIMITIVE },
-	}, *opcode_3d = NULL;
+	};
+	const struct opcode_3d_965_info *opcode_3d = NULL;
 
 	opcode = (data[0] & 0xffff0000) >> 16;
 
@@ -3260,7 +3318,7 @@ decode_3d_965(struct drm_intel_decode *ctx)
 
 		if (len < opcode_3d->min_len ||
 		    len > opcode_3d->max_len) {
-			fprintf(out, "Bad length %d in %s, expected %d-%d\n",
+			decode_printf(ctx, "Bad length %d in %s, expected %d-%d\n",
 				len, opcode_3d->name,
 				opcode_3d->min_len, opcode_3d->max_len);
 		}
@@ -3297,7 +3355,7 @@ decode_3d_965(struct drm_intel_decode *ctx)
 		else
 			sba_len = 6;
 		if (len != sba_len)
-			fprintf(out, "Bad count in STATE_BASE_ADDRESS\n");
+			decode_printf(ctx, "Bad count in STATE_BASE_ADDRESS\n");
 
 		state_base_out(ctx, i++, "general");
 		state_base_out(ctx, i++, "surface");
@@ -3326,7 +3384,7 @@ decode_3d_965(struct drm_intel_decode *ctx)
 		return len;
 	case 0x7801:
 		if (len != 6 && len != 4)
-			fprintf(out,
+			decode_printf(ctx,
 				"Bad count in 3DSTATE_BINDING_TABLE_POINTERS\n");
 		if (len == 6) {
 			instr_out(ctx, 0,
@@ -3375,7 +3433,7 @@ decode_3d_965(struct drm_intel_decode *ctx)
 
 	case 0x7808:
 		if ((len - 1) % 4 != 0)
-			fprintf(out, "Bad count in 3DSTATE_VERTEX_BUFFERS\n");
+			decode_printf(ctx, "Bad count in 3DSTATE_VERTEX_BUFFERS\n");
 		instr_out(ctx, 0, "3DSTATE_VERTEX_BUFFERS\n");
 
 		for (i = 1; i < len;) {
@@ -3400,7 +3458,7 @@ decode_3d_965(struct drm_intel_decode *ctx)
 
 	case 0x7809:
 		if ((len + 1) % 2 != 0)
-			fprintf(out, "Bad count in 3DSTATE_VERTEX_ELEMENTS\n");
+			decode_printf(ctx, "Bad count in 3DSTATE_VERTEX_ELEMENTS\n");
 		instr_out(ctx, 0, "3DSTATE_VERTEX_ELEMENTS\n");
 
 		for (i = 1; i < len;) {
@@ -3628,7 +3686,7 @@ decode_3d_965(struct drm_intel_decode *ctx)
 	case 0x7a00:
 		if (IS_GEN6(devid) || IS_GEN7(devid)) {
 			if (len != 4 && len != 5)
-				fprintf(out, "Bad count in PIPE_CONTROL\n");
+				decode_printf(ctx, "Bad count in PIPE_CONTROL\n");
 
 			switch ((data[1] >> 14) & 0x3) {
 			case 0:
@@ -3694,7 +3752,7 @@ decode_3d_965(struct drm_intel_decode *ctx)
 			return len;
 		} else {
 			if (len != 4)
-				fprintf(out, "Bad count in PIPE_CONTROL\n");
+				decode_printf(ctx, "Bad count in PIPE_CONTROL\n");
 
 			switch ((data[0] >> 14) & 0x3) {
 			case 0:
@@ -3749,7 +3807,7 @@ decode_3d_i830(struct drm_intel_decode *ctx)
 	uint32_t opcode;
 	uint32_t *data = ctx->data;
 
-	struct {
+	static const struct opcode_3d_i830_info {
 		uint32_t opcode;
 		unsigned int min_len;
 		unsigned int max_len;
@@ -3771,7 +3829,8 @@ decode_3d_i830(struct drm_intel_decode *ctx)
 		{ 0x0f, 1, 1, "3DSTATE_MODES_2" },
 		{ 0x15, 1, 1, "3DSTATE_FOG_COLOR" },
 		{ 0x16, 1, 1, "3DSTATE_MODES_4"},
-	}, *opcode_3d;
+	};
+	const struct opcode_3d_i830_info *opcode_3d;
 
 	opcode = (data[0] & 0x1f000000) >> 24;
 
@@ -3794,7 +3853,7 @@ decode_3d_i830(struct drm_intel_decode *ctx)
 				len = (data[0] & 0xff) + 2;
 				if (len < opcode_3d->min_len ||
 				    len > opcode_3d->max_len) {
-					fprintf(out, "Bad count in %s\n",
+					decode_printf(ctx, "Bad count in %s\n",
 						opcode_3d->name);
 				}
 			}
@@ -3915,12 +3974,9 @@ drm_intel_decode(struct drm_intel_decode *ctx)
 	ctx->count = ctx->base_count;
 
 	devid = ctx->devid;
-	head_offset = ctx->head;
-	tail_offset = ctx->tail;
-	out = ctx->out;
 
-	saved_s2_set = 0;
-	saved_s4_set = 1;
+	ctx->saved_s2_set = false;
+	ctx->saved_s4_set = true;
 
 	while (ctx->count > 0) {
 		index = 0;
@@ -3966,7 +4022,6 @@ drm_intel_decode(struct drm_intel_decode *ctx)
 			index++;
 			break;
 		}
-		fflush(out);
 
 		if (ctx->count < index)
 			break;
@@ -3976,5 +4031,8 @@ drm_intel_decode(struct drm_intel_decode *ctx)
 		ctx->hw_offset += 4 * index;
 	}
 
+	decode_flush(ctx);
+	fflush(ctx->out);
+
 	free(temp);
 }
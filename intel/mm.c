@@ -22,6 +22,7 @@
  *
  */
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <assert.h>
 
@@ -29,40 +30,103 @@
 #include "libdrm_macros.h"
 #include "mm.h"
 
+/*
+ * Free blocks are kept on segregated lists, one per power-of-two size
+ * class, with a bitmask of the classes that aren't empty.  A block of a
+ * class above the one of size + alignment - 1 always fits, so most
+ * allocations take the first block of the first such class without a
+ * search.  The list of all blocks in offset order serves as the boundary
+ * tags: a freed block finds its neighbours in O(1) to coalesce with them.
+ */
+#define MM_NUM_CLASSES 64
+
+struct mem_heap {
+	struct mem_block head;		/* must be first */
+	struct mem_block bins[MM_NUM_CLASSES];
+	uint64_t nonempty;
+};
+
+static struct mem_heap *to_heap(const struct mem_block *heap)
+{
+	return (struct mem_heap *)heap;
+}
+
+static unsigned int size_class(uint64_t size)
+{
+	return 63 - __builtin_clzll(size);
+}
+
+static void free_list_add(struct mem_block *p)
+{
+	struct mem_heap *heap = to_heap(p->heap);
+	unsigned int c = size_class(p->size);
+	struct mem_block *bin = &heap->bins[c];
+
+	p->free = 1;
+	p->next_free = bin->next_free;
+	p->prev_free = bin;
+	bin->next_free->prev_free = p;
+	bin->next_free = p;
+	heap->nonempty |= 1ull << c;
+}
+
+static void free_list_del(struct mem_block *p)
+{
+	struct mem_heap *heap = to_heap(p->heap);
+	unsigned int c = size_class(p->size);
+
+	p->next_free->prev_free = p->prev_free;
+	p->prev_free->next_free = p->next_free;
+	p->next_free = NULL;
+	p->prev_free = NULL;
+	if (heap->bins[c].next_free == &heap->bins[c])
+		heap->nonempty &= ~(1ull << c);
+}
+
 drm_private void mmDumpMemInfo(const struct mem_block *heap)
 {
 	drmMsg("Memory heap %p:\n", (void *)heap);
 	if (heap == 0) {
 		drmMsg("  heap == 0\n");
 	} else {
+		const struct mem_heap *h = to_heap(heap);
 		const struct mem_block *p;
+		unsigned int c;
 
 		for (p = heap->next; p != heap; p = p->next) {
-			drmMsg("  Offset:%08x, Size:%08x, %c%c\n", p->ofs,
-			       p->size, p->free ? 'F' : '.',
-			       p->reserved ? 'R' : '.');
+			drmMsg("  Offset:%08llx, Size:%08llx, %c%c\n",
+			       (unsigned long long)p->ofs,
+			       (unsigned long long)p->size,
+			       p->free ? 'F' : '.', p->reserved ? 'R' : '.');
 		}
 
-		drmMsg("\nFree list:\n");
-
-		for (p = heap->next_free; p != heap; p = p->next_free) {
-			drmMsg(" FREE Offset:%08x, Size:%08x, %c%c\n", p->ofs,
-			       p->size, p->free ? 'F' : '.',
-			       p->reserved ? 'R' : '.');
+		drmMsg("\nFree lists:\n");
+
+		for (c = 0; c < MM_NUM_CLASSES; c++) {
+			for (p = h->bins[c].next_free; p != &h->bins[c];
+			     p = p->next_free) {
+				drmMsg(" FREE %2u Offset:%08llx, Size:%08llx, %c%c\n",
+				       c, (unsigned long long)p->ofs,
+				       (unsigned long long)p->size,
+				       p->free ? 'F' : '.',
+				       p->reserved ? 'R' : '.');
+			}
 		}
 
 	}
 	drmMsg("End of memory blocks\n");
 }
 
-drm_private struct mem_block *mmInit(int ofs, int size)
+drm_private struct mem_block *mmInit(uint64_t ofs, uint64_t size)
 {
-	struct mem_block *heap, *block;
+	struct mem_heap *heap;
+	struct mem_block *block;
+	unsigned int c;
 
-	if (size <= 0)
+	if (size == 0 || ofs + size < ofs)
 		return NULL;
 
-	heap = (struct mem_block *)calloc(1, sizeof(struct mem_block));
+	heap = (struct mem_heap *)calloc(1, sizeof(struct mem_heap));
 	if (!heap)
 		return NULL;
 
@@ -72,148 +136,152 @@ drm_private struct mem_block *mmInit(int ofs, int size)
 		return NULL;
 	}
 
-	heap->next = block;
-	heap->prev = block;
-	heap->next_free = block;
-	heap->prev_free = block;
-
-	block->heap = heap;
-	block->next = heap;
-	block->prev = heap;
-	block->next_free = heap;
-	block->prev_free = heap;
+	heap->head.next = block;
+	heap->head.prev = block;
+	heap->head.heap = &heap->head;
+	for (c = 0; c < MM_NUM_CLASSES; c++) {
+		heap->bins[c].next_free = &heap->bins[c];
+		heap->bins[c].prev_free = &heap->bins[c];
+	}
 
+	block->heap = &heap->head;
+	block->next = &heap->head;
+	block->prev = &heap->head;
 	block->ofs = ofs;
 	block->size = size;
-	block->free = 1;
+	free_list_add(block);
 
-	return heap;
+	return &heap->head;
 }
 
-static struct mem_block *SliceBlock(struct mem_block *p,
-				    int startofs, int size,
-				    int reserved, int alignment)
+/* Insert a free block of [ofs, ofs + size) after p in offset order. */
+static struct mem_block *InsertFree(struct mem_block *p, uint64_t ofs,
+				    uint64_t size)
 {
 	struct mem_block *newblock;
 
+	newblock = (struct mem_block *)calloc(1, sizeof(struct mem_block));
+	if (!newblock)
+		return NULL;
+	newblock->ofs = ofs;
+	newblock->size = size;
+	newblock->heap = p->heap;
+
+	newblock->next = p->next;
+	newblock->prev = p;
+	p->next->prev = newblock;
+	p->next = newblock;
+
+	free_list_add(newblock);
+	return newblock;
+}
+
+static struct mem_block *SliceBlock(struct mem_block *p,
+				    uint64_t startofs, uint64_t size,
+				    int reserved)
+{
+	uint64_t end = p->ofs + p->size;
+
+	free_list_del(p);
+
 	/* break left  [p, newblock, p->next], then p = newblock */
 	if (startofs > p->ofs) {
-		newblock =
-		    (struct mem_block *)calloc(1, sizeof(struct mem_block));
-		if (!newblock)
+		p->size = startofs - p->ofs;
+		if (!InsertFree(p, startofs, end - startofs)) {
+			p->size = end - p->ofs;
+			free_list_add(p);
 			return NULL;
-		newblock->ofs = startofs;
-		newblock->size = p->size - (startofs - p->ofs);
-		newblock->free = 1;
-		newblock->heap = p->heap;
-
-		newblock->next = p->next;
-		newblock->prev = p;
-		p->next->prev = newblock;
-		p->next = newblock;
-
-		newblock->next_free = p->next_free;
-		newblock->prev_free = p;
-		p->next_free->prev_free = newblock;
-		p->next_free = newblock;
-
-		p->size -= newblock->size;
-		p = newblock;
+		}
+		free_list_add(p);
+		p = p->next;
+		free_list_del(p);
 	}
 
 	/* break right, also [p, newblock, p->next] */
-	if (size < p->size) {
-		newblock =
-		    (struct mem_block *)calloc(1, sizeof(struct mem_block));
-		if (!newblock)
-			return NULL;
-		newblock->ofs = startofs + size;
-		newblock->size = p->size - size;
-		newblock->free = 1;
-		newblock->heap = p->heap;
-
-		newblock->next = p->next;
-		newblock->prev = p;
-		p->next->prev = newblock;
-		p->next = newblock;
-
-		newblock->next_free = p->next_free;
-		newblock->prev_free = p;
-		p->next_free->prev_free = newblock;
-		p->next_free = newblock;
-
+	if (startofs + size < end) {
 		p->size = size;
+		if (!InsertFree(p, startofs + size, end - startofs - size)) {
+			p->size = end - p->ofs;
+			free_list_add(p);
+			return NULL;
+		}
 	}
 
 	/* p = middle block */
 	p->free = 0;
+	p->reserved = reserved;
+	return p;
+}
 
-	/* Remove p from the free list: 
-	 */
-	p->next_free->prev_free = p->prev_free;
-	p->prev_free->next_free = p->next_free;
+static int BlockFits(const struct mem_block *p, uint64_t size, uint64_t mask,
+		     uint64_t startSearch, uint64_t *startofs)
+{
+	uint64_t ofs = (p->ofs + mask) & ~mask;
 
-	p->next_free = 0;
-	p->prev_free = 0;
+	if (ofs < p->ofs)
+		return 0;
+	if (ofs < startSearch)
+		ofs = startSearch;
+	if (ofs + size < ofs || ofs + size > p->ofs + p->size)
+		return 0;
 
-	p->reserved = reserved;
-	return p;
+	*startofs = ofs;
+	return 1;
 }
 
-drm_private struct mem_block *mmAllocMem(struct mem_block *heap, int size,
-					 int align2, int startSearch)
+drm_private struct mem_block *mmAllocMem(struct mem_block *heap,
+					 uint64_t size, int align2,
+					 uint64_t startSearch)
 {
+	struct mem_heap *h;
 	struct mem_block *p;
-	const int mask = (1 << align2) - 1;
-	int startofs = 0;
-	int endofs;
+	uint64_t mask, classes, startofs = 0;
+	unsigned int c, first;
 
-	if (!heap || align2 < 0 || size <= 0)
+	if (!heap || align2 < 0 || align2 > 63 || size == 0)
 		return NULL;
 
-	for (p = heap->next_free; p != heap; p = p->next_free) {
-		assert(p->free);
-
-		startofs = (p->ofs + mask) & ~mask;
-		if (startofs < startSearch) {
-			startofs = startSearch;
+	h = to_heap(heap);
+	mask = (1ull << align2) - 1;
+
+	/* classes whose blocks fit unless startSearch gets in the way */
+	first = size + mask < size ? MM_NUM_CLASSES :
+		size_class(size + mask) + 1;
+	classes = first < MM_NUM_CLASSES ? h->nonempty & (~0ull << first) : 0;
+
+	while (classes) {
+		c = __builtin_ctzll(classes);
+		classes &= classes - 1;
+		for (p = h->bins[c].next_free; p != &h->bins[c];
+		     p = p->next_free) {
+			assert(p->free);
+			if (BlockFits(p, size, mask, startSearch, &startofs))
+				return SliceBlock(p, startofs, size, 0);
 		}
-		endofs = startofs + size;
-		if (endofs <= (p->ofs + p->size))
-			break;
 	}
 
-	if (p == heap)
-		return NULL;
-
-	assert(p->free);
-	p = SliceBlock(p, startofs, size, 0, mask + 1);
+	/* then the classes where a block may or may not be large enough */
+	for (c = size_class(size); c < first && c < MM_NUM_CLASSES; c++) {
+		for (p = h->bins[c].next_free; p != &h->bins[c];
+		     p = p->next_free) {
+			assert(p->free);
+			if (BlockFits(p, size, mask, startSearch, &startofs))
+				return SliceBlock(p, startofs, size, 0);
+		}
+	}
 
-	return p;
+	return NULL;
 }
 
-static int Join2Blocks(struct mem_block *p)
+/* Merge q into p, its left neighbour, with both off the free lists. */
+static void Join2Blocks(struct mem_block *p, struct mem_block *q)
 {
-	/* XXX there should be some assertions here */
-
-	/* NOTE: heap->free == 0 */
+	assert(p->ofs + p->size == q->ofs);
 
-	if (p->free && p->next->free) {
-		struct mem_block *q = p->next;
-
-		assert(p->ofs + p->size == q->ofs);
-		p->size += q->size;
-
-		p->next = q->next;
-		q->next->prev = p;
-
-		q->next_free->prev_free = q->prev_free;
-		q->prev_free->next_free = q->next_free;
-
-		free(q);
-		return 1;
-	}
-	return 0;
+	p->size += q->size;
+	p->next = q->next;
+	q->next->prev = p;
+	free(q);
 }
 
 drm_private int mmFreeMem(struct mem_block *b)
@@ -230,16 +298,20 @@ drm_private int mmFreeMem(struct mem_block *b)
 		return -1;
 	}
 
-	b->free = 1;
-	b->next_free = b->heap->next_free;
-	b->prev_free = b->heap;
-	b->next_free->prev_free = b;
-	b->prev_free->next_free = b;
+	/* NOTE: heap->free == 0, so neither side joins the head */
+	if (b->next->free) {
+		free_list_del(b->next);
+		Join2Blocks(b, b->next);
+	}
+	if (b->prev->free) {
+		struct mem_block *p = b->prev;
 
-	Join2Blocks(b);
-	if (b->prev != b->heap)
-		Join2Blocks(b->prev);
+		free_list_del(p);
+		Join2Blocks(p, b);
+		b = p;
+	}
 
+	free_list_add(b);
 	return 0;
 }
 
@@ -256,5 +328,5 @@ drm_private void mmDestroy(struct mem_block *heap)
 		p = next;
 	}
 
-	free(heap);
+	free(to_heap(heap));
 }
@@ -29,13 +29,15 @@
 #ifndef MM_H
 #define MM_H
 
+#include <stdint.h>
+
 #include "libdrm_macros.h"
 
 struct mem_block {
-	struct mem_block *next, *prev;
-	struct mem_block *next_free, *prev_free;
+	struct mem_block *next, *prev;		/* all blocks, by offset */
+	struct mem_block *next_free, *prev_free; /* free list of the size class */
 	struct mem_block *heap;
-	int ofs, size;
+	uint64_t ofs, size;
 	unsigned int free:1;
 	unsigned int reserved:1;
 };
@@ -44,7 +46,7 @@ struct mem_block {
  * input: total size in bytes
  * return: a heap pointer if OK, NULL if error
  */
-drm_private extern struct mem_block *mmInit(int ofs, int size);
+drm_private extern struct mem_block *mmInit(uint64_t ofs, uint64_t size);
 
 /**
  * Allocate 'size' bytes with 2^align2 bytes alignment,
@@ -55,10 +57,13 @@ drm_private extern struct mem_block *mmInit(int ofs, int size);
  *       	align2 = 2^align2 bytes alignment
  *		startSearch = linear offset from start of heap to begin search
  * return: pointer to the allocated block, 0 if error
+ *
+ * Allocation and free are O(1) unless startSearch or a block of the exact
+ * size class is needed for the request to fit.
  */
 drm_private extern struct mem_block *mmAllocMem(struct mem_block *heap,
-						int size, int align2,
-						int startSearch);
+						uint64_t size, int align2,
+						uint64_t startSearch);
 
 /**
  * Free block starts at offset
@@ -49,11 +49,67 @@ drm_public int kms_get_prop(struct kms_driver *kms, unsigned key, unsigned *out)
 	return kms->get_prop(kms, key, out);
 }
 
+/*
+ * Trim the pool of destroyed bo's down to max entries, releasing the
+ * oldest ones first.
+ */
+static void kms_bo_pool_trim(struct kms_driver *kms, unsigned max)
+{
+	struct kms_bo **link = &kms->pool;
+	unsigned i;
+
+	for (i = 0; *link && i < max; i++)
+		link = &(*link)->pool_next;
+
+	while (*link) {
+		struct kms_bo *bo = *link;
+
+		*link = bo->pool_next;
+		kms->pool_count--;
+		kms->bo_destroy(bo);
+	}
+}
+
+static struct kms_bo *kms_bo_pool_get(struct kms_driver *kms, unsigned width,
+				      unsigned height, enum kms_bo_type type)
+{
+	struct kms_bo **link;
+
+	for (link = &kms->pool; *link; link = &(*link)->pool_next) {
+		struct kms_bo *bo = *link;
+
+		if (bo->width == width && bo->height == height &&
+		    bo->type == type) {
+			*link = bo->pool_next;
+			bo->pool_next = NULL;
+			kms->pool_count--;
+			return bo;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Keep up to max_bos destroyed buffers around, together with their
+ * mappings, and hand them back out from kms_bo_create() when a buffer
+ * with the same type and dimensions is asked for.  A reused buffer keeps
+ * its previous contents.  Passing 0 disables the pool and releases any
+ * buffers held by it.
+ */
+drm_public int kms_set_bo_pool(struct kms_driver *kms, unsigned max_bos)
+{
+	kms->pool_max = max_bos;
+	kms_bo_pool_trim(kms, max_bos);
+	return 0;
+}
+
 drm_public int kms_destroy(struct kms_driver **kms)
 {
 	if (!(*kms))
 		return 0;
 
+	kms_bo_pool_trim(*kms, 0);
 	free(*kms);
 	*kms = NULL;
 	return 0;
@@ -64,7 +120,7 @@ drm_public int kms_bo_create(struct kms_driver *kms, const unsigned *attr, struc
 	unsigned width = 0;
 	unsigned height = 0;
 	enum kms_bo_type type = KMS_BO_TYPE_SCANOUT_X8R8G8B8;
-	int i;
+	int i, ret;
 
 	for (i = 0; attr[i];) {
 		unsigned key = attr[i++];
@@ -94,7 +150,24 @@ drm_public int kms_bo_create(struct kms_driver *kms, const unsigned *attr, struc
 	    (width != 64 || height != 64))
 		return -EINVAL;
 
-	return kms->bo_create(kms, width, height, type, attr, out);
+	/* chroma is subsampled 2x2 */
+	if (type == KMS_BO_TYPE_SCANOUT_NV12 && ((width | height) & 1))
+		return -EINVAL;
+
+	*out = kms_bo_pool_get(kms, width, height, type);
+	if (*out)
+		return 0;
+
+	ret = kms->bo_create(kms, width, height, type, attr, out);
+	if (ret)
+		return ret;
+
+	(*out)->width = width;
+	(*out)->height = height;
+	(*out)->type = type;
+	if (type == KMS_BO_TYPE_SCANOUT_NV12)
+		(*out)->plane1_offset = (*out)->pitch * height;
+	return 0;
 }
 
 drm_public int kms_bo_get_prop(struct kms_bo *bo, unsigned key, unsigned *out)
@@ -106,6 +179,15 @@ drm_public int kms_bo_get_prop(struct kms_bo *bo, unsigned key, unsigned *out)
 	case KMS_HANDLE:
 		*out = bo->handle;
 		break;
+	case KMS_NUM_PLANES:
+		*out = bo->type == KMS_BO_TYPE_SCANOUT_NV12 ? 2 : 1;
+		break;
+	case KMS_PLANE1_OFFSET:
+	case KMS_PLANE1_PITCH:
+		if (bo->type != KMS_BO_TYPE_SCANOUT_NV12)
+			return -EINVAL;
+		*out = key == KMS_PLANE1_OFFSET ? bo->plane1_offset : bo->pitch;
+		break;
 	default:
 		return -EINVAL;
 	}
@@ -125,12 +207,23 @@ drm_public int kms_bo_unmap(struct kms_bo *bo)
 
 drm_public int kms_bo_destroy(struct kms_bo **bo)
 {
+	struct kms_driver *kms;
 	int ret;
 
 	if (!(*bo))
 		return 0;
 
-	ret = (*bo)->kms->bo_destroy(*bo);
+	kms = (*bo)->kms;
+	if (kms->pool_max) {
+		(*bo)->pool_next = kms->pool;
+		kms->pool = *bo;
+		kms->pool_count++;
+		kms_bo_pool_trim(kms, kms->pool_max);
+		*bo = NULL;
+		return 0;
+	}
+
+	ret = kms->bo_destroy(*bo);
 	if (ret)
 		return ret;
 
@@ -47,7 +47,7 @@ dumb_get_prop(struct kms_driver *kms, unsigned key, unsigned *out)
 {
 	switch (key) {
 	case KMS_BO_TYPE:
-		*out = KMS_BO_TYPE_SCANOUT_X8R8G8B8 | KMS_BO_TYPE_CURSOR_64X64_A8R8G8B8;
+		*out = KMS_BO_TYPE_SCANOUT_MASK | KMS_BO_TYPE_CURSOR_64X64_A8R8G8B8;
 		break;
 	default:
 		return -EINVAL;
@@ -90,10 +90,9 @@ dumb_bo_create(struct kms_driver *kms,
 
 	memset(&arg, 0, sizeof(arg));
 
-	/* All BO_TYPE currently are 32bpp formats */
-	arg.bpp = 32;
+	arg.bpp = kms_bo_type_cpp(type) * 8;
 	arg.width = width;
-	arg.height = height;
+	arg.height = kms_bo_type_rows(type, height);
 
 	ret = drmIoctl(kms->fd, DRM_IOCTL_MODE_CREATE_DUMB, &arg);
 	if (ret)
@@ -49,7 +49,7 @@ exynos_get_prop(struct kms_driver *kms, unsigned key, unsigned *out)
 {
 	switch (key) {
 	case KMS_BO_TYPE:
-		*out = KMS_BO_TYPE_SCANOUT_X8R8G8B8 | KMS_BO_TYPE_CURSOR_64X64_A8R8G8B8;
+		*out = KMS_BO_TYPE_SCANOUT_MASK | KMS_BO_TYPE_CURSOR_64X64_A8R8G8B8;
 		break;
 	default:
 		return -EINVAL;
@@ -93,10 +93,10 @@ exynos_bo_create(struct kms_driver *kms,
 	if (type == KMS_BO_TYPE_CURSOR_64X64_A8R8G8B8) {
 		pitch = 64 * 4;
 		size = 64 * 64 * 4;
-	} else if (type == KMS_BO_TYPE_SCANOUT_X8R8G8B8) {
-		pitch = width * 4;
+	} else if (type & KMS_BO_TYPE_SCANOUT_MASK) {
+		pitch = width * kms_bo_type_cpp(type);
 		pitch = (pitch + 512 - 1) & ~(512 - 1);
-		size = pitch * ((height + 4 - 1) & ~(4 - 1));
+		size = pitch * ((kms_bo_type_rows(type, height) + 4 - 1) & ~(4 - 1));
 	} else {
 		ret = -EINVAL;
 		goto err_free;
@@ -49,7 +49,7 @@ intel_get_prop(struct kms_driver *kms, unsigned key, unsigned *out)
 {
 	switch (key) {
 	case KMS_BO_TYPE:
-		*out = KMS_BO_TYPE_SCANOUT_X8R8G8B8 | KMS_BO_TYPE_CURSOR_64X64_A8R8G8B8;
+		*out = KMS_BO_TYPE_SCANOUT_MASK | KMS_BO_TYPE_CURSOR_64X64_A8R8G8B8;
 		break;
 	default:
 		return -EINVAL;
@@ -93,10 +93,10 @@ intel_bo_create(struct kms_driver *kms,
 	if (type == KMS_BO_TYPE_CURSOR_64X64_A8R8G8B8) {
 		pitch = 64 * 4;
 		size = 64 * 64 * 4;
-	} else if (type == KMS_BO_TYPE_SCANOUT_X8R8G8B8) {
-		pitch = width * 4;
+	} else if (type & KMS_BO_TYPE_SCANOUT_MASK) {
+		pitch = width * kms_bo_type_cpp(type);
 		pitch = (pitch + 512 - 1) & ~(512 - 1);
-		size = pitch * ((height + 4 - 1) & ~(4 - 1));
+		size = pitch * ((kms_bo_type_rows(type, height) + 4 - 1) & ~(4 - 1));
 	} else {
 		free(bo);
 		return -EINVAL;
@@ -115,7 +115,8 @@ intel_bo_create(struct kms_driver *kms,
 	bo->base.pitch = pitch;
 
 	*out = &bo->base;
-	if (type == KMS_BO_TYPE_SCANOUT_X8R8G8B8 && pitch > 512) {
+	if (type != KMS_BO_TYPE_SCANOUT_NV12 &&
+	    type != KMS_BO_TYPE_CURSOR_64X64_A8R8G8B8 && pitch > 512) {
 		struct drm_i915_gem_set_tiling tile;
 
 		memset(&tile, 0, sizeof(tile));
@@ -32,6 +32,31 @@
 #include "libdrm_macros.h"
 #include "libkms.h"
 
+#define KMS_BO_TYPE_SCANOUT_MASK (KMS_BO_TYPE_SCANOUT_X8R8G8B8 | \
+				  KMS_BO_TYPE_SCANOUT_R5G6B5 | \
+				  KMS_BO_TYPE_SCANOUT_NV12)
+
+/* bytes per pixel of the first plane */
+static inline unsigned kms_bo_type_cpp(enum kms_bo_type type)
+{
+	if (type == KMS_BO_TYPE_SCANOUT_R5G6B5)
+		return 2;
+	if (type == KMS_BO_TYPE_SCANOUT_NV12)
+		return 1;
+	return 4;
+}
+
+/*
+ * Number of rows, at the first plane's pitch, needed to hold all planes.
+ * The NV12 CbCr plane is half the height of the Y plane and shares its pitch.
+ */
+static inline unsigned kms_bo_type_rows(enum kms_bo_type type, unsigned height)
+{
+	if (type == KMS_BO_TYPE_SCANOUT_NV12)
+		return height + height / 2;
+	return height;
+}
+
 struct kms_driver
 {
 	int (*get_prop)(struct kms_driver *kms, const unsigned key,
@@ -51,6 +76,11 @@ struct kms_driver
 	int (*bo_destroy)(struct kms_bo *bo);
 
 	int fd;
+
+	/* destroyed bo's kept for reuse, most recently destroyed first */
+	struct kms_bo *pool;
+	unsigned pool_count;
+	unsigned pool_max;
 };
 
 struct kms_bo
@@ -61,6 +91,13 @@ struct kms_bo
 	size_t offset;
 	size_t pitch;
 	unsigned handle;
+	size_t plane1_offset;
+
+	/* creation attributes, used to match pooled bo's */
+	unsigned width;
+	unsigned height;
+	enum kms_bo_type type;
+	struct kms_bo *pool_next;
 };
 
 drm_private int linux_create(int fd, struct kms_driver **out);
@@ -55,6 +55,12 @@ enum kms_attrib
 #define KMS_PITCH KMS_PITCH
 	KMS_HANDLE,
 #define KMS_HANDLE KMS_HANDLE
+	KMS_NUM_PLANES,
+#define KMS_NUM_PLANES KMS_NUM_PLANES
+	KMS_PLANE1_OFFSET,
+#define KMS_PLANE1_OFFSET KMS_PLANE1_OFFSET
+	KMS_PLANE1_PITCH,
+#define KMS_PLANE1_PITCH KMS_PLANE1_PITCH
 };
 
 enum kms_bo_type
@@ -63,11 +69,17 @@ enum kms_bo_type
 #define KMS_BO_TYPE_SCANOUT_X8R8G8B8 KMS_BO_TYPE_SCANOUT_X8R8G8B8
 	KMS_BO_TYPE_CURSOR_64X64_A8R8G8B8 =  (1 << 1),
 #define KMS_BO_TYPE_CURSOR_64X64_A8R8G8B8 KMS_BO_TYPE_CURSOR_64X64_A8R8G8B8
+	KMS_BO_TYPE_SCANOUT_R5G6B5 = (1 << 2),
+#define KMS_BO_TYPE_SCANOUT_R5G6B5 KMS_BO_TYPE_SCANOUT_R5G6B5
+	/* Y plane followed by an interleaved CbCr plane of the same pitch */
+	KMS_BO_TYPE_SCANOUT_NV12 = (1 << 3),
+#define KMS_BO_TYPE_SCANOUT_NV12 KMS_BO_TYPE_SCANOUT_NV12
 };
 
 int kms_create(int fd, struct kms_driver **out);
 int kms_get_prop(struct kms_driver *kms, unsigned key, unsigned *out);
 int kms_destroy(struct kms_driver **kms);
+int kms_set_bo_pool(struct kms_driver *kms, unsigned max_bos);
 
 int kms_bo_create(struct kms_driver *kms, const unsigned *attr, struct kms_bo **out);
 int kms_bo_get_prop(struct kms_bo *bo, unsigned key, unsigned *out);
@@ -32,6 +32,7 @@
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <pthread.h>
 #include <xf86drm.h>
 #include <string.h>
 #include <unistd.h>
@@ -48,16 +49,84 @@
 #include "internal.h"
 
 #define PATH_SIZE 512
+#define NAME_CACHE_SIZE 8
 
+/*
+ * Driver names resolved so far, keyed by device number, so that tools
+ * opening the same device over and over only pay for the lookup once.
+ */
+static struct {
+	dev_t rdev;
+	char name[32];
+} name_cache[NAME_CACHE_SIZE];
+static unsigned name_cache_count;
+static pthread_mutex_t name_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static char *
+linux_name_cache_get(dev_t rdev)
+{
+	char *name = NULL;
+	unsigned i;
+
+	pthread_mutex_lock(&name_cache_lock);
+	for (i = 0; i < name_cache_count; i++) {
+		if (name_cache[i].rdev == rdev) {
+			name = strdup(name_cache[i].name);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&name_cache_lock);
+
+	return name;
+}
+
+static void
+linux_name_cache_put(dev_t rdev, const char *name)
+{
+	unsigned i;
+
+	if (strlen(name) >= sizeof(name_cache[0].name))
+		return;
+
+	pthread_mutex_lock(&name_cache_lock);
+	if (name_cache_count < NAME_CACHE_SIZE)
+		i = name_cache_count++;
+	else
+		i = rdev % NAME_CACHE_SIZE;
+	name_cache[i].rdev = rdev;
+	strcpy(name_cache[i].name, name);
+	pthread_mutex_unlock(&name_cache_lock);
+}
+
+/*
+ * Ask the kernel driver for its name. The i915 driver is the only one
+ * whose name differs from the backend's.
+ */
 static int
-linux_name_from_sysfs(int fd, char **out)
+linux_name_from_version(int fd, char **out)
+{
+	drmVersionPtr version;
+	const char *name;
+
+	version = drmGetVersion(fd);
+	if (!version)
+		return -EINVAL;
+
+	name = version->name;
+	if (!strcmp(name, "i915"))
+		name = "intel";
+
+	*out = strdup(name);
+	drmFreeVersion(version);
+	return *out ? 0 : -ENOMEM;
+}
+
+static int
+linux_name_from_sysfs(unsigned maj, unsigned min, char **out)
 {
 	char path[PATH_SIZE+1] = ""; /* initialize to please valgrind */
 	char link[PATH_SIZE+1] = "";
-	struct stat buffer;
-	unsigned maj, min;
 	char* slash_name;
-	int ret;
 
 	/* 
 	 * Inside the sysfs directory for the device there is a symlink
@@ -71,16 +140,6 @@ linux_name_from_sysfs(int fd, char **out)
 	 * Thanks to Ray Strode of Plymouth for the code.
 	 */
 
-	ret = fstat(fd, &buffer);
-	if (ret)
-		return -EINVAL;
-
-	if (!S_ISCHR(buffer.st_mode))
-		return -EINVAL;
-
-	maj = major(buffer.st_rdev);
-	min = minor(buffer.st_rdev);
-
 	snprintf(path, PATH_SIZE, "/sys/dev/char/%d:%d/device/driver", maj, min);
 
 	if (readlink(path, link, PATH_SIZE) < 0)
@@ -97,12 +156,40 @@ linux_name_from_sysfs(int fd, char **out)
 }
 
 static int
-linux_from_sysfs(int fd, struct kms_driver **out)
+linux_name(int fd, char **out)
+{
+	struct stat buffer;
+	int ret;
+
+	ret = fstat(fd, &buffer);
+	if (ret)
+		return -EINVAL;
+
+	if (!S_ISCHR(buffer.st_mode))
+		return -EINVAL;
+
+	*out = linux_name_cache_get(buffer.st_rdev);
+	if (*out)
+		return 0;
+
+	ret = linux_name_from_version(fd, out);
+	if (ret)
+		ret = linux_name_from_sysfs(major(buffer.st_rdev),
+					    minor(buffer.st_rdev), out);
+	if (ret)
+		return ret;
+
+	linux_name_cache_put(buffer.st_rdev, *out);
+	return 0;
+}
+
+static int
+linux_from_name(int fd, struct kms_driver **out)
 {
 	char *name;
 	int ret;
 
-	ret = linux_name_from_sysfs(fd, &name);
+	ret = linux_name(fd, &name);
 	if (ret)
 		return ret;
 
@@ -143,5 +230,5 @@ linux_create(int fd, struct kms_driver **out)
 	if (!dumb_create(fd, out))
 		return 0;
 
-	return linux_from_sysfs(fd, out);
+	return linux_from_name(fd, out);
 }
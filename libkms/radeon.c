@@ -52,7 +52,7 @@ radeon_get_prop(struct kms_driver *kms, unsigned key, unsigned *out)
 {
 	switch (key) {
 	case KMS_BO_TYPE:
-		*out = KMS_BO_TYPE_SCANOUT_X8R8G8B8 | KMS_BO_TYPE_CURSOR_64X64_A8R8G8B8;
+		*out = KMS_BO_TYPE_SCANOUT_MASK | KMS_BO_TYPE_CURSOR_64X64_A8R8G8B8;
 		break;
 	default:
 		return -EINVAL;
@@ -95,9 +95,11 @@ radeon_bo_create(struct kms_driver *kms,
 		size  = 4 * 64 * 64;
 		break;
 	case KMS_BO_TYPE_SCANOUT_X8R8G8B8:
-		pitch = width * 4;
+	case KMS_BO_TYPE_SCANOUT_R5G6B5:
+	case KMS_BO_TYPE_SCANOUT_NV12:
+		pitch = width * kms_bo_type_cpp(type);
 		pitch = (pitch + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
-		size  = pitch * height;
+		size  = pitch * kms_bo_type_rows(type, height);
 		break;
 	default:
 		return -EINVAL;
@@ -184,10 +186,8 @@ static int
 radeon_bo_unmap(struct kms_bo *_bo)
 {
 	struct radeon_bo *bo = (struct radeon_bo *)_bo;
-	if (--bo->map_count == 0) {
-		drm_munmap(bo->base.ptr, bo->base.size);
-		bo->base.ptr = NULL;
-	}
+	/* keep the mapping around until destroy, like the other backends */
+	bo->map_count--;
 	return 0;
 }
 
@@ -47,7 +47,7 @@ vmwgfx_get_prop(struct kms_driver *kms, unsigned key, unsigned *out)
 {
 	switch (key) {
 	case KMS_BO_TYPE:
-		*out = KMS_BO_TYPE_SCANOUT_X8R8G8B8 | KMS_BO_TYPE_CURSOR_64X64_A8R8G8B8;
+		*out = KMS_BO_TYPE_SCANOUT_MASK | KMS_BO_TYPE_CURSOR_64X64_A8R8G8B8;
 		break;
 	default:
 		return -EINVAL;
@@ -92,9 +92,10 @@ vmwgfx_bo_create(struct kms_driver *kms,
 		struct drm_vmw_dmabuf_rep *rep = &arg.rep;
 
 		memset(&arg, 0, sizeof(arg));
-		req->size = width * height * 4;
+		req->size = width * kms_bo_type_rows(type, height) *
+			    kms_bo_type_cpp(type);
 		bo->base.size = req->size;
-		bo->base.pitch = width * 4;
+		bo->base.pitch = width * kms_bo_type_cpp(type);
 		bo->base.kms = kms;
 
 		do {
@@ -31,7 +31,9 @@
 #include <assert.h>
 #include <errno.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <sys/ioctl.h>
 #include <sys/poll.h>
 #include <unistd.h>
@@ -141,6 +143,151 @@ static inline int sync_accumulate(const char *name, int *fd1, int fd2)
 	return 0;
 }
 
+/* wait on several fences with a single poll() per wakeup.  With all == 0
+ * this returns the index of a signaled fence as soon as there is one,
+ * otherwise it returns 0 once every fence has signaled.  A negative
+ * timeout waits forever, like poll().  On failure -1 is returned with
+ * errno set, ETIME meaning the timeout expired.
+ */
+static inline int sync_wait_many(const int *fds, unsigned int count,
+				 int timeout, int all)
+{
+	struct pollfd *pfds;
+	struct timespec start, now;
+	unsigned int i, n = count;
+	int ret = 0, remaining = timeout;
+
+	if (count == 0)
+		return 0;
+
+	pfds = (struct pollfd *)calloc(count, sizeof(*pfds));
+	if (!pfds) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		pfds[i].fd = fds[i];
+		pfds[i].events = POLLIN;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	while (n > 0) {
+		ret = poll(pfds, n, remaining);
+		if (ret == -1 && (errno == EINTR || errno == EAGAIN)) {
+			ret = 0;
+		} else if (ret == 0) {
+			errno = ETIME;
+			ret = -1;
+			break;
+		} else if (ret < 0) {
+			break;
+		}
+
+		for (i = 0; i < n; i++) {
+			if (!pfds[i].revents)
+				continue;
+
+			if (pfds[i].revents & (POLLERR | POLLNVAL)) {
+				errno = EINVAL;
+				ret = -1;
+				goto out;
+			}
+
+			if (!all) {
+				ret = i;
+				goto out;
+			}
+
+			/* drop the signaled fence and look at its replacement */
+			pfds[i--] = pfds[--n];
+		}
+		ret = 0;
+
+		if (n > 0 && timeout >= 0) {
+			int64_t elapsed;
+
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			elapsed = (now.tv_sec - start.tv_sec) * 1000 +
+				  (now.tv_nsec - start.tv_nsec) / 1000000;
+			remaining = elapsed < timeout ? timeout - elapsed : 0;
+		}
+	}
+
+out:
+	free(pfds);
+	return ret;
+}
+
+/* merge count fences into a single new fence, pairing them up level by
+ * level so that each fence only gets copied log2(count) times, instead of
+ * count times with repeated sync_accumulate().  Intermediate fences are
+ * closed as soon as they've been merged.  Does *NOT* take ownership of
+ * the fds passed in; the returned fd is owned by the caller.
+ */
+static inline int sync_merge_many(const char *name, const int *fds,
+				  unsigned int count)
+{
+	int *cur, *owned;
+	unsigned int i, j, n = count;
+	int ret;
+
+	if (count == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (count == 1)
+		return dup(fds[0]);
+
+	cur = (int *)malloc(2 * count * sizeof(*cur));
+	if (!cur) {
+		errno = ENOMEM;
+		return -1;
+	}
+	owned = cur + count;
+
+	memcpy(cur, fds, count * sizeof(*cur));
+	memset(owned, 0, count * sizeof(*owned));
+
+	while (n > 1) {
+		for (i = 0, j = 0; i < n; i += 2, j++) {
+			if (i + 1 == n) {
+				cur[j] = cur[i];
+				owned[j] = owned[i];
+				continue;
+			}
+
+			ret = sync_merge(name, cur[i], cur[i + 1]);
+			if (ret < 0) {
+				/* drop what this level merged so far and
+				 * what's left of the previous one */
+				while (j--)
+					close(cur[j]);
+				for (; i < n; i++) {
+					if (owned[i])
+						close(cur[i]);
+				}
+				free(cur);
+				return -1;
+			}
+
+			if (owned[i])
+				close(cur[i]);
+			if (owned[i + 1])
+				close(cur[i + 1]);
+			cur[j] = ret;
+			owned[j] = 1;
+		}
+		n = j;
+	}
+
+	ret = cur[0];
+	free(cur);
+	return ret;
+}
+
 #if defined(__cplusplus)
 }
 #endif
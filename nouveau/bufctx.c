@@ -28,6 +28,7 @@
 #include <stdbool.h>
 #include <assert.h>
 #include <errno.h>
+#include <inttypes.h>
 
 #include "libdrm_lists.h"
 
@@ -40,14 +41,23 @@ struct nouveau_bufref_priv {
 	struct nouveau_bufctx *bufctx;
 };
 
+/* A reset bin without relocs parks its refs on the stale list (in the
+ * order they were added) instead of dropping them, so that refilling it
+ * with the same buffers doesn't queue them up for validation again.
+ * Whatever isn't reclaimed is dropped on the next validate.
+ */
 struct nouveau_bufbin_priv {
 	struct nouveau_bufref_priv *list;
+	struct nouveau_bufref_priv *stale;
 	int relocs;
 };
 
 struct nouveau_bufctx_priv {
 	struct nouveau_bufctx base;
 	struct nouveau_bufref_priv *free;
+	int nr_stale;
+	uint64_t nr_refn;
+	uint64_t nr_reused;
 	int nr_bins;
 	struct nouveau_bufbin_priv bins[];
 };
@@ -78,14 +88,47 @@ nouveau_bufctx_new(struct nouveau_client *client, int bins,
 	return -ENOMEM;
 }
 
+static void
+nouveau_bufbin_release(struct nouveau_bufctx_priv *pctx,
+		       struct nouveau_bufbin_priv *pbin)
+{
+	struct nouveau_bufref_priv *pref;
+
+	if (!pbin->stale)
+		return;
+
+	while ((pref = pbin->stale)) {
+		DRMLISTDELINIT(&pref->base.thead);
+		pbin->stale = pref->next;
+		pref->next = pctx->free;
+		pctx->free = pref;
+	}
+	pctx->nr_stale--;
+}
+
+drm_private void
+nouveau_bufctx_sweep(struct nouveau_bufctx *bctx)
+{
+	struct nouveau_bufctx_priv *pctx = nouveau_bufctx(bctx);
+	int i;
+
+	for (i = 0; pctx->nr_stale && i < pctx->nr_bins; i++)
+		nouveau_bufbin_release(pctx, &pctx->bins[i]);
+}
+
 drm_public void
 nouveau_bufctx_del(struct nouveau_bufctx **pbctx)
 {
 	struct nouveau_bufctx_priv *pctx = nouveau_bufctx(*pbctx);
 	struct nouveau_bufref_priv *pref;
 	if (pctx) {
-		while (pctx->nr_bins--)
+		dbg(1, "bufctx %p: %"PRIu64" refs, %"PRIu64" reused\n",
+		    (void *)pctx, pctx->nr_refn, pctx->nr_reused);
+		while (pctx->nr_bins--) {
 			nouveau_bufctx_reset(&pctx->base, pctx->nr_bins);
+			nouveau_bufbin_release(pctx,
+					       &pctx->bins[pctx->nr_bins]);
+		}
 		while ((pref = pctx->free)) {
 			pctx->free = pref->next;
 			free(pref);
@@ -102,6 +145,21 @@ nouveau_bufctx_reset(struct nouveau_bufctx *bctx, int bin)
 	struct nouveau_bufbin_priv *pbin = &pctx->bins[bin];
 	struct nouveau_bufref_priv *pref;
 
+	nouveau_bufbin_release(pctx, pbin);
+
+	if (!pbin->relocs) {
+		while ((pref = pbin->list)) {
+			pbin->list = pref->next;
+			pref->base.priv = NULL;
+			pref->base.priv_data = 0;
+			pref->next = pbin->stale;
+			pbin->stale = pref;
+		}
+		if (pbin->stale)
+			pctx->nr_stale++;
+		return;
+	}
+
 	while ((pref = pbin->list)) {
 		DRMLISTDELINIT(&pref->base.thead);
 		pbin->list = pref->next;
@@ -113,14 +171,43 @@ nouveau_bufctx_reset(struct nouveau_bufctx *bctx, int bin)
 	pbin->relocs  = 0;
 }
 
+/* Takes back the next stale ref of the bin if it's for the same buffer,
+ * it then is still queued or validated from before the reset.
+ */
+static struct nouveau_bufref_priv *
+nouveau_bufbin_reclaim(struct nouveau_bufctx_priv *pctx,
+		       struct nouveau_bufbin_priv *pbin,
+		       struct nouveau_bo *bo, uint32_t flags)
+{
+	struct nouveau_bufref_priv *pref = pbin->stale;
+
+	if (pref->base.bo != bo || pref->base.flags != flags) {
+		nouveau_bufbin_release(pctx, pbin);
+		return NULL;
+	}
+
+	pbin->stale = pref->next;
+	if (!pbin->stale)
+		pctx->nr_stale--;
+	pref->next = pbin->list;
+	pbin->list = pref;
+	pctx->nr_reused++;
+	return pref;
+}
+
 drm_public struct nouveau_bufref *
 nouveau_bufctx_refn(struct nouveau_bufctx *bctx, int bin,
 		    struct nouveau_bo *bo, uint32_t flags)
 {
 	struct nouveau_bufctx_priv *pctx = nouveau_bufctx(bctx);
 	struct nouveau_bufbin_priv *pbin = &pctx->bins[bin];
-	struct nouveau_bufref_priv *pref = pctx->free;
+	struct nouveau_bufref_priv *pref;
+
+	pctx->nr_refn++;
+	if (pbin->stale && (pref = nouveau_bufbin_reclaim(pctx, pbin, bo, flags)))
+		return &pref->base;
 
+	pref = pctx->free;
 	if (!pref)
 		pref = malloc(sizeof(*pref));
 	else
@@ -147,7 +234,11 @@ nouveau_bufctx_mthd(struct nouveau_bufctx *bctx, int bin, uint32_t packet,
 {
 	struct nouveau_bufctx_priv *pctx = nouveau_bufctx(bctx);
 	struct nouveau_bufbin_priv *pbin = &pctx->bins[bin];
-	struct nouveau_bufref *bref = nouveau_bufctx_refn(bctx, bin, bo, flags);
+	struct nouveau_bufref *bref;
+
+	/* the method has to be emitted by validate, never reuse a ref */
+	nouveau_bufbin_release(pctx, pbin);
+	bref = nouveau_bufctx_refn(bctx, bin, bo, flags);
 	if (bref) {
 		bref->packet = packet;
 		bref->data = data;
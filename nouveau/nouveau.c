@@ -60,6 +60,9 @@ debug_init(char *args)
 }
 #endif
 
+static void nouveau_bo_cache_init(struct nouveau_bo_cache *, uint64_t);
+static void nouveau_bo_cache_cleanup(struct nouveau_bo_cache *, time_t);
+
 static int
 nouveau_object_ioctl(struct nouveau_object *obj, void *data, uint32_t size)
 {
@@ -130,21 +133,60 @@ nouveau_object_sclass_put(struct nouveau_sclass **psclass)
 	*psclass = NULL;
 }
 
-drm_public int
-nouveau_object_sclass_get(struct nouveau_object *obj,
-			  struct nouveau_sclass **psclass)
+/* called with the drm lock held */
+static struct nouveau_sclass_cache *
+nouveau_sclass_cache_find(struct nouveau_drm_priv *pdrm,
+			  struct nouveau_object *obj)
 {
-	struct nouveau_drm *drm = nouveau_drm(obj);
+	struct nouveau_sclass_cache *entry;
+
+	DRMLISTFOREACHENTRY(entry, &pdrm->sclass_cache, head) {
+		if (entry->object == obj)
+			return entry;
+	}
+	return NULL;
+}
+
+static void
+nouveau_sclass_cache_drop(struct nouveau_object *obj)
+{
+	struct nouveau_drm_priv *pdrm = nouveau_pdrm(nouveau_drm(obj));
+	struct nouveau_sclass_cache *entry;
+
+	if (!pdrm->base.nvif)
+		return;
+
+	pthread_mutex_lock(&pdrm->lock);
+	entry = nouveau_sclass_cache_find(pdrm, obj);
+	if (entry)
+		DRMLISTDEL(&entry->head);
+	pthread_mutex_unlock(&pdrm->lock);
+	free(entry);
+}
+
+/* Looks up the classes of an nvif object, asking the kernel only the
+ * first time.  The entry stays valid until the object is deleted.
+ */
+static int
+nouveau_sclass_cache_get(struct nouveau_object *obj,
+			 struct nouveau_sclass_cache **pentry)
+{
+	struct nouveau_drm_priv *pdrm = nouveau_pdrm(nouveau_drm(obj));
 	struct {
 		struct nvif_ioctl_v0 ioctl;
 		struct nvif_ioctl_sclass_v0 sclass;
 	} *args = NULL;
-	struct nouveau_sclass *sclass;
+	struct nouveau_sclass_cache *entry, *other;
 	int ret, cnt = 0, i;
 	uint32_t size;
 
-	if (!drm->nvif)
-		return abi16_sclass(obj, psclass);
+	pthread_mutex_lock(&pdrm->lock);
+	entry = nouveau_sclass_cache_find(pdrm, obj);
+	pthread_mutex_unlock(&pdrm->lock);
+	if (entry) {
+		*pentry = entry;
+		return 0;
+	}
 
 	while (1) {
 		size = sizeof(*args) + cnt * sizeof(args->sclass.oclass[0]);
@@ -164,33 +206,83 @@ nouveau_object_sclass_get(struct nouveau_object *obj,
 			return ret;
 	}
 
-	if ((sclass = calloc(args->sclass.count, sizeof(*sclass)))) {
-		for (i = 0; i < args->sclass.count; i++) {
-			sclass[i].oclass = args->sclass.oclass[i].oclass;
-			sclass[i].minver = args->sclass.oclass[i].minver;
-			sclass[i].maxver = args->sclass.oclass[i].maxver;
-		}
-		*psclass = sclass;
-		ret = args->sclass.count;
-	} else {
-		ret = -ENOMEM;
+	entry = malloc(sizeof(*entry) +
+		       args->sclass.count * sizeof(entry->sclass[0]));
+	if (!entry) {
+		free(args);
+		return -ENOMEM;
+	}
+	entry->object = obj;
+	entry->count = args->sclass.count;
+	for (i = 0; i < args->sclass.count; i++) {
+		entry->sclass[i].oclass = args->sclass.oclass[i].oclass;
+		entry->sclass[i].minver = args->sclass.oclass[i].minver;
+		entry->sclass[i].maxver = args->sclass.oclass[i].maxver;
 	}
-
 	free(args);
-	return ret;
+
+	/* another thread may have been asking at the same time */
+	pthread_mutex_lock(&pdrm->lock);
+	other = nouveau_sclass_cache_find(pdrm, obj);
+	if (!other)
+		DRMLISTADD(&entry->head, &pdrm->sclass_cache);
+	pthread_mutex_unlock(&pdrm->lock);
+	if (other) {
+		free(entry);
+		entry = other;
+	}
+
+	*pentry = entry;
+	return 0;
+}
+
+drm_public int
+nouveau_object_sclass_get(struct nouveau_object *obj,
+			  struct nouveau_sclass **psclass)
+{
+	struct nouveau_drm *drm = nouveau_drm(obj);
+	struct nouveau_sclass_cache *entry;
+	struct nouveau_sclass *sclass;
+	int ret;
+
+	if (!drm->nvif)
+		return abi16_sclass(obj, psclass);
+
+	ret = nouveau_sclass_cache_get(obj, &entry);
+	if (ret)
+		return ret;
+
+	/* the caller frees its copy with nouveau_object_sclass_put() */
+	if (!(sclass = malloc((entry->count ? entry->count : 1) *
+			      sizeof(*sclass))))
+		return -ENOMEM;
+	memcpy(sclass, entry->sclass, entry->count * sizeof(*sclass));
+	*psclass = sclass;
+	return entry->count;
 }
 
 drm_public int
 nouveau_object_mclass(struct nouveau_object *obj,
 		      const struct nouveau_mclass *mclass)
 {
+	struct nouveau_drm *drm = nouveau_drm(obj);
+	struct nouveau_sclass_cache *entry;
 	struct nouveau_sclass *sclass;
 	int ret = -ENODEV;
 	int cnt, i, j;
 
-	cnt = nouveau_object_sclass_get(obj, &sclass);
-	if (cnt < 0)
-		return cnt;
+	if (drm->nvif) {
+		ret = nouveau_sclass_cache_get(obj, &entry);
+		if (ret)
+			return ret;
+		sclass = entry->sclass;
+		cnt = entry->count;
+		ret = -ENODEV;
+	} else {
+		cnt = abi16_sclass(obj, &sclass);
+		if (cnt < 0)
+			return cnt;
+	}
 
 	for (i = 0; ret < 0 && mclass[i].oclass; i++) {
 		for (j = 0; j < cnt; j++) {
@@ -203,7 +295,8 @@ nouveau_object_mclass(struct nouveau_object *obj,
 		}
 	}
 
-	nouveau_object_sclass_put(&sclass);
+	if (!drm->nvif)
+		nouveau_object_sclass_put(&sclass);
 	return ret;
 }
 
@@ -224,6 +317,7 @@ nouveau_object_fini(struct nouveau_object *obj)
 		return;
 	}
 
+	nouveau_sclass_cache_drop(obj);
 	nouveau_object_ioctl(obj, &args, sizeof(args));
 }
 
@@ -317,13 +411,25 @@ nouveau_object_del(struct nouveau_object **pobj)
 drm_public void
 nouveau_drm_del(struct nouveau_drm **pdrm)
 {
-	free(*pdrm);
+	struct nouveau_drm_priv *pdrm_priv = nouveau_pdrm(*pdrm);
+	struct nouveau_sclass_cache *entry, *tmp;
+
+	if (!pdrm_priv)
+		return;
+
+	DRMLISTFOREACHENTRYSAFE(entry, tmp, &pdrm_priv->sclass_cache, head) {
+		DRMLISTDEL(&entry->head);
+		free(entry);
+	}
+	pthread_mutex_destroy(&pdrm_priv->lock);
+	free(pdrm_priv);
 	*pdrm = NULL;
 }
 
 drm_public int
 nouveau_drm_new(int fd, struct nouveau_drm **pdrm)
 {
+	struct nouveau_drm_priv *pdrm_priv;
 	struct nouveau_drm *drm;
 	drmVersionPtr ver;
 
@@ -331,8 +437,11 @@ nouveau_drm_new(int fd, struct nouveau_drm **pdrm)
 	debug_init(getenv("NOUVEAU_LIBDRM_DEBUG"));
 #endif
 
-	if (!(drm = calloc(1, sizeof(*drm))))
+	if (!(pdrm_priv = calloc(1, sizeof(*pdrm_priv))))
 		return -ENOMEM;
+	pthread_mutex_init(&pdrm_priv->lock, NULL);
+	DRMINITLISTHEAD(&pdrm_priv->sclass_cache);
+	drm = &pdrm_priv->base;
 	drm->fd = fd;
 
 	if (!(ver = drmGetVersion(fd))) {
@@ -447,7 +556,16 @@ nouveau_device_new(struct nouveau_object *parent, int32_t oclass,
 		(nvdev->base.gart_size * nvdev->gart_limit_percent) / 100;
 
 	ret = pthread_mutex_init(&nvdev->lock, NULL);
+	if (ret == 0)
+		ret = pthread_mutex_init(&nvdev->stats_lock, NULL);
 	DRMINITLISTHEAD(&nvdev->bo_list);
+
+	tmp = getenv("NOUVEAU_LIBDRM_MAP_CACHE_MB");
+	v = tmp ? strtoull(tmp, NULL, 0) : 256;
+
+	tmp = getenv("NOUVEAU_LIBDRM_BO_CACHE");
+	if (!tmp || atoi(tmp))
+		nouveau_bo_cache_init(&nvdev->bo_cache, v << 20);
 done:
 	if (ret)
 		nouveau_device_del(pdev);
@@ -494,13 +612,39 @@ nouveau_device_open(const char *busid, struct nouveau_device **pdev)
 	return ret;
 }
 
+drm_public void
+nouveau_device_get_bo_stats(struct nouveau_device *dev,
+			    struct _drmBOStats *stats)
+{
+	struct nouveau_device_priv *nvdev = nouveau_device(dev);
+
+	pthread_mutex_lock(&nvdev->lock);
+	stats->cached_bytes = nvdev->bo_cache.size;
+	stats->cached_count = nvdev->bo_cache.count;
+
+	pthread_mutex_lock(&nvdev->stats_lock);
+	stats->allocated_bytes = nvdev->alloc_size;
+	stats->allocated_count = nvdev->alloc_count;
+	stats->mapped_bytes = nvdev->map_size;
+	stats->mapped_count = nvdev->map_count;
+	stats->imported_bytes = nvdev->import_size;
+	stats->imported_count = nvdev->import_count;
+	pthread_mutex_unlock(&nvdev->stats_lock);
+	pthread_mutex_unlock(&nvdev->lock);
+}
+
 drm_public void
 nouveau_device_del(struct nouveau_device **pdev)
 {
 	struct nouveau_device_priv *nvdev = nouveau_device(*pdev);
 	if (nvdev) {
+		/* the device object isn't deleted through nouveau_object_del() */
+		if (nvdev->base.object.parent)
+			nouveau_sclass_cache_drop(&nvdev->base.object);
+		nouveau_bo_cache_cleanup(&nvdev->bo_cache, 0);
 		free(nvdev->client);
 		pthread_mutex_destroy(&nvdev->lock);
+		pthread_mutex_destroy(&nvdev->stats_lock);
 		if (nvdev->base.fd >= 0) {
 			struct nouveau_drm *drm =
 				nouveau_drm(&nvdev->base.object);
@@ -583,12 +727,43 @@ nouveau_client_del(struct nouveau_client **pclient)
 		nvdev->client[id / 32] &= ~(1 << (id % 32));
 		pthread_mutex_unlock(&nvdev->lock);
 		free(pcli->kref);
+		free(pcli->kref_hash);
 		free(pcli);
 	}
 }
 
+/* Counts a bo coming (add) or going in the device stats. */
 static void
-nouveau_bo_del(struct nouveau_bo *bo)
+nouveau_bo_stats_account(struct nouveau_bo *bo, bool add)
+{
+	struct nouveau_device_priv *nvdev = nouveau_device(bo->device);
+	struct nouveau_bo_priv *nvbo = nouveau_bo(bo);
+
+	pthread_mutex_lock(&nvdev->stats_lock);
+	if (nvbo->imported) {
+		nvdev->import_size += add ? bo->size : -bo->size;
+		nvdev->import_count += add ? 1 : -1;
+	} else {
+		nvdev->alloc_size += add ? bo->size : -bo->size;
+		nvdev->alloc_count += add ? 1 : -1;
+	}
+	pthread_mutex_unlock(&nvdev->stats_lock);
+}
+
+/* Counts a CPU mapping of the bo coming (add) or going. */
+static void
+nouveau_bo_map_account(struct nouveau_bo *bo, bool add)
+{
+	struct nouveau_device_priv *nvdev = nouveau_device(bo->device);
+
+	pthread_mutex_lock(&nvdev->stats_lock);
+	nvdev->map_size += add ? bo->size : -bo->size;
+	nvdev->map_count += add ? 1 : -1;
+	pthread_mutex_unlock(&nvdev->stats_lock);
+}
+
+static void
+nouveau_bo_free(struct nouveau_bo *bo)
 {
 	struct nouveau_drm *drm = nouveau_drm(&bo->device->object);
 	struct nouveau_device_priv *nvdev = nouveau_device(bo->device);
@@ -613,22 +788,232 @@ nouveau_bo_del(struct nouveau_bo *bo)
 	} else {
 		drmIoctl(drm->fd, DRM_IOCTL_GEM_CLOSE, &req);
 	}
-	if (bo->map)
+	if (bo->map) {
 		drm_munmap(bo->map, bo->size);
+		nouveau_bo_map_account(bo, false);
+	}
+	nouveau_bo_stats_account(bo, false);
 	free(nvbo);
 }
 
+/* creation flags a cached bo has to match to be handed out again */
+#define NOUVEAU_BO_CACHE_FLAGS (NOUVEAU_BO_APER | NOUVEAU_BO_MAP |        \
+				NOUVEAU_BO_CONTIG | NOUVEAU_BO_NOSNOOP |      \
+				NOUVEAU_BO_COHERENT)
+
+/* number of busy bos to skip before giving up on a bucket */
+#define NOUVEAU_BO_CACHE_BUSY_SKIP 4
+
+static void
+nouveau_bo_cache_add_bucket(struct nouveau_bo_cache *cache, uint64_t size)
+{
+	struct nouveau_bo_bucket *bucket = &cache->bucket[cache->nr_bucket++];
+
+	assert(cache->nr_bucket <= (int)(sizeof(cache->bucket) /
+					 sizeof(cache->bucket[0])));
+	DRMINITLISTHEAD(&bucket->list);
+	bucket->size = size;
+}
+
+/* Same size classes as the freedreno cache: pages up to 16KiB, then each
+ * power of two up to 64MiB with three steps in between.  Cached bos keep
+ * their CPU mappings until more than map_limit bytes of them pile up.
+ */
+static void
+nouveau_bo_cache_init(struct nouveau_bo_cache *cache, uint64_t map_limit)
+{
+	uint64_t size;
+
+	DRMINITLISTHEAD(&cache->map_lru);
+	cache->map_limit = map_limit;
+
+	nouveau_bo_cache_add_bucket(cache, 4096);
+	nouveau_bo_cache_add_bucket(cache, 4096 * 2);
+	nouveau_bo_cache_add_bucket(cache, 4096 * 3);
+	for (size = 4 * 4096; size <= 64 * 1024 * 1024; size *= 2) {
+		nouveau_bo_cache_add_bucket(cache, size);
+		nouveau_bo_cache_add_bucket(cache, size + size * 1 / 4);
+		nouveau_bo_cache_add_bucket(cache, size + size * 2 / 4);
+		nouveau_bo_cache_add_bucket(cache, size + size * 3 / 4);
+	}
+}
+
+static struct nouveau_bo_bucket *
+nouveau_bo_cache_bucket(struct nouveau_bo_cache *cache, uint64_t size)
+{
+	int i;
+
+	for (i = 0; i < cache->nr_bucket; i++) {
+		if (cache->bucket[i].size >= size)
+			return &cache->bucket[i];
+	}
+	return NULL;
+}
+
+/* Called with the device lock held, as are the two below. */
+static void
+nouveau_bo_cache_map_del(struct nouveau_bo_cache *cache,
+			 struct nouveau_bo_priv *nvbo)
+{
+	if (nvbo->base.map) {
+		DRMLISTDEL(&nvbo->map_head);
+		cache->mapped -= nvbo->base.size;
+	}
+}
+
+static void
+nouveau_bo_cache_map_add(struct nouveau_bo_cache *cache,
+			 struct nouveau_bo_priv *nvbo)
+{
+	struct nouveau_bo_priv *lru;
+
+	if (!nvbo->base.map)
+		return;
+
+	DRMLISTADDTAIL(&nvbo->map_head, &cache->map_lru);
+	cache->mapped += nvbo->base.size;
+
+	while (cache->mapped > cache->map_limit) {
+		lru = DRMLISTENTRY(struct nouveau_bo_priv,
+				   cache->map_lru.next, map_head);
+		nouveau_bo_cache_map_del(cache, lru);
+		drm_munmap(lru->base.map, lru->base.size);
+		nouveau_bo_map_account(&lru->base, false);
+		lru->base.map = NULL;
+	}
+}
+
+static time_t
+nouveau_bo_cache_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+/* Frees cached bos unused for more than a second, or all of them when
+ * time is 0.  Called with the device lock held.
+ */
+static void
+nouveau_bo_cache_cleanup(struct nouveau_bo_cache *cache, time_t time)
+{
+	struct nouveau_bo_priv *nvbo;
+	int i;
+
+	if (time && cache->time == time)
+		return;
+
+	for (i = 0; i < cache->nr_bucket; i++) {
+		struct nouveau_bo_bucket *bucket = &cache->bucket[i];
+
+		while (!DRMLISTEMPTY(&bucket->list)) {
+			nvbo = DRMLISTENTRY(struct nouveau_bo_priv,
+					    bucket->list.next, cache_head);
+			if (time && time - nvbo->free_time <= 1)
+				break;
+			DRMLISTDEL(&nvbo->cache_head);
+			cache->size -= nvbo->base.size;
+			cache->count--;
+			nouveau_bo_cache_map_del(cache, nvbo);
+			nouveau_bo_free(&nvbo->base);
+		}
+	}
+
+	cache->time = time;
+}
+
+/* Hands out the least recently freed idle bo of the bucket matching the
+ * creation flags and alignment, if any.
+ */
+static struct nouveau_bo *
+nouveau_bo_cache_alloc(struct nouveau_device_priv *nvdev,
+		       struct nouveau_bo_bucket *bucket,
+		       uint32_t flags, uint32_t align)
+{
+	struct nouveau_bo_priv *nvbo, *found = NULL;
+	int busy = 0;
+
+	flags &= NOUVEAU_BO_CACHE_FLAGS;
+
+	pthread_mutex_lock(&nvdev->lock);
+	DRMLISTFOREACHENTRY(nvbo, &bucket->list, cache_head) {
+		if (nvbo->cache_flags != flags || nvbo->align != align)
+			continue;
+		if (nouveau_bo_wait(&nvbo->base, NOUVEAU_BO_RDWR |
+				    NOUVEAU_BO_NOBLOCK, NULL)) {
+			if (++busy == NOUVEAU_BO_CACHE_BUSY_SKIP)
+				break;
+			continue;
+		}
+		found = nvbo;
+		break;
+	}
+	if (found) {
+		DRMLISTDEL(&found->cache_head);
+		nvdev->bo_cache.size -= found->base.size;
+		nvdev->bo_cache.count--;
+		nouveau_bo_cache_map_del(&nvdev->bo_cache, found);
+		atomic_set(&found->refcnt, 1);
+	}
+	pthread_mutex_unlock(&nvdev->lock);
+
+	return found ? &found->base : NULL;
+}
+
+static void
+nouveau_bo_del(struct nouveau_bo *bo)
+{
+	struct nouveau_device_priv *nvdev = nouveau_device(bo->device);
+	struct nouveau_bo_priv *nvbo = nouveau_bo(bo);
+	struct nouveau_bo_bucket *bucket;
+	time_t now;
+
+	/* a bo that was ever shared may still be in use elsewhere */
+	if (!nvbo->reusable || nvbo->head.next) {
+		nouveau_bo_free(bo);
+		return;
+	}
+
+	bucket = nouveau_bo_cache_bucket(&nvdev->bo_cache, bo->size);
+	now = nouveau_bo_cache_now();
+
+	pthread_mutex_lock(&nvdev->lock);
+	nvbo->free_time = now;
+	DRMLISTADDTAIL(&nvbo->cache_head, &bucket->list);
+	nvdev->bo_cache.size += bo->size;
+	nvdev->bo_cache.count++;
+	nouveau_bo_cache_map_add(&nvdev->bo_cache, nvbo);
+	nouveau_bo_cache_cleanup(&nvdev->bo_cache, now);
+	pthread_mutex_unlock(&nvdev->lock);
+}
+
 drm_public int
 nouveau_bo_new(struct nouveau_device *dev, uint32_t flags, uint32_t align,
 	       uint64_t size, union nouveau_bo_config *config,
 	       struct nouveau_bo **pbo)
 {
-	struct nouveau_bo_priv *nvbo = calloc(1, sizeof(*nvbo));
-	struct nouveau_bo *bo = &nvbo->base;
+	struct nouveau_device_priv *nvdev = nouveau_device(dev);
+	struct nouveau_bo_bucket *bucket = NULL;
+	struct nouveau_bo_priv *nvbo;
+	struct nouveau_bo *bo;
 	int ret;
 
+	if (!config)
+		bucket = nouveau_bo_cache_bucket(&nvdev->bo_cache, size);
+	if (bucket) {
+		bo = nouveau_bo_cache_alloc(nvdev, bucket, flags, align);
+		if (bo) {
+			*pbo = bo;
+			return 0;
+		}
+		size = bucket->size;
+	}
+
+	nvbo = calloc(1, sizeof(*nvbo));
 	if (!nvbo)
 		return -ENOMEM;
+	bo = &nvbo->base;
 	atomic_set(&nvbo->refcnt, 1);
 	bo->device = dev;
 	bo->flags = flags;
@@ -640,6 +1025,11 @@ nouveau_bo_new(struct nouveau_device *dev, uint32_t flags, uint32_t align,
 		return ret;
 	}
 
+	nvbo->reusable = bucket != NULL;
+	nvbo->cache_flags = flags & NOUVEAU_BO_CACHE_FLAGS;
+	nvbo->align = align;
+	nouveau_bo_stats_account(bo, true);
+
 	*pbo = bo;
 	return 0;
 }
@@ -689,6 +1079,8 @@ nouveau_bo_wrap_locked(struct nouveau_device *dev, uint32_t handle,
 		nvbo->base.device = dev;
 		abi16_bo_info(&nvbo->base, &req);
 		nvbo->name = name;
+		nvbo->imported = true;
+		nouveau_bo_stats_account(&nvbo->base, true);
 		DRMLISTADD(&nvbo->head, &nvdev->bo_list);
 		*pbo = &nvbo->base;
 		return 0;
@@ -834,7 +1226,8 @@ nouveau_bo_wait(struct nouveau_bo *bo, uint32_t access,
 	if (!(access & NOUVEAU_BO_RDWR))
 		return 0;
 
-	push = cli_push_get(client, bo);
+	/* no client for idle checks of unreferenced bos */
+	push = client ? cli_push_get(client, bo) : NULL;
 	if (push && push->channel)
 		nouveau_pushbuf_kick(push, push->channel);
 
@@ -869,6 +1262,7 @@ nouveau_bo_map(struct nouveau_bo *bo, uint32_t access,
 			bo->map = NULL;
 			return -errno;
 		}
+		nouveau_bo_map_account(bo, true);
 	}
 	return nouveau_bo_wait(bo, access, client);
 }
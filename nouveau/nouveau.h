@@ -75,6 +75,13 @@ int nouveau_device_new(struct nouveau_object *parent, int32_t oclass,
 		       void *data, uint32_t size, struct nouveau_device **);
 void nouveau_device_del(struct nouveau_device **);
 
+/* bos allocated, cached, mapped and imported through the device, see
+ * drmBOStats in xf86drm.h; cached bos count as allocated too
+ */
+struct _drmBOStats;
+void nouveau_device_get_bo_stats(struct nouveau_device *,
+				 struct _drmBOStats *);
+
 int nouveau_getparam(struct nouveau_device *, uint64_t param, uint64_t *value);
 int nouveau_setparam(struct nouveau_device *, uint64_t param, uint64_t value);
 
@@ -5,6 +5,7 @@
 #include <xf86drm.h>
 #include <xf86atomic.h>
 #include <pthread.h>
+#include <time.h>
 #include "nouveau_drm.h"
 
 #include "nouveau.h"
@@ -22,15 +23,47 @@ drm_private uint32_t nouveau_debug;
 #endif
 #define err(fmt, args...) fprintf(stderr, "nouveau: "fmt, ##args)
 
+/* the sclass list of an object, which can't change while it exists */
+struct nouveau_sclass_cache {
+	struct nouveau_list head;
+	struct nouveau_object *object;
+	int count;
+	struct nouveau_sclass sclass[];
+};
+
+struct nouveau_drm_priv {
+	struct nouveau_drm base;
+	pthread_mutex_t lock;
+	struct nouveau_list sclass_cache;
+};
+
+static inline struct nouveau_drm_priv *
+nouveau_pdrm(struct nouveau_drm *drm)
+{
+	return (struct nouveau_drm_priv *)drm;
+}
+
 struct nouveau_client_kref {
 	struct drm_nouveau_gem_pushbuf_bo *kref;
 	struct nouveau_pushbuf *push;
 };
 
+/* slot of the hashed kref table, a handle of 0 marks a free one */
+struct nouveau_client_kref_slot {
+	uint32_t handle;
+	struct nouveau_client_kref ref;
+};
+
 struct nouveau_client_priv {
 	struct nouveau_client base;
+	/* indexed by handle while the referenced handles are dense */
 	struct nouveau_client_kref *kref;
 	unsigned kref_nr;
+	/* open addressing table by handle, replacing kref once they aren't */
+	struct nouveau_client_kref_slot *kref_hash;
+	unsigned kref_hash_size;
+	/* number of bos with a kref */
+	unsigned kref_count;
 };
 
 static inline struct nouveau_client_priv *
@@ -39,44 +72,53 @@ nouveau_client(struct nouveau_client *client)
 	return (struct nouveau_client_priv *)client;
 }
 
+static inline unsigned
+cli_kref_hash(struct nouveau_client_priv *pcli, uint32_t handle)
+{
+	return (handle * 0x9e3779b1) & (pcli->kref_hash_size - 1);
+}
+
+static inline struct nouveau_client_kref *
+cli_kref_find(struct nouveau_client_priv *pcli, uint32_t handle)
+{
+	if (pcli->kref_hash) {
+		unsigned mask = pcli->kref_hash_size - 1;
+		unsigned i = cli_kref_hash(pcli, handle);
+
+		while (pcli->kref_hash[i].handle) {
+			if (pcli->kref_hash[i].handle == handle)
+				return &pcli->kref_hash[i].ref;
+			i = (i + 1) & mask;
+		}
+		return NULL;
+	}
+	if (pcli->kref_nr > handle)
+		return &pcli->kref[handle];
+	return NULL;
+}
+
 static inline struct drm_nouveau_gem_pushbuf_bo *
 cli_kref_get(struct nouveau_client *client, struct nouveau_bo *bo)
 {
-	struct nouveau_client_priv *pcli = nouveau_client(client);
-	struct drm_nouveau_gem_pushbuf_bo *kref = NULL;
-	if (pcli->kref_nr > bo->handle)
-		kref = pcli->kref[bo->handle].kref;
-	return kref;
+	struct nouveau_client_kref *ref;
+
+	ref = cli_kref_find(nouveau_client(client), bo->handle);
+	return ref ? ref->kref : NULL;
 }
 
 static inline struct nouveau_pushbuf *
 cli_push_get(struct nouveau_client *client, struct nouveau_bo *bo)
 {
-	struct nouveau_client_priv *pcli = nouveau_client(client);
-	struct nouveau_pushbuf *push = NULL;
-	if (pcli->kref_nr > bo->handle)
-		push = pcli->kref[bo->handle].push;
-	return push;
+	struct nouveau_client_kref *ref;
+
+	ref = cli_kref_find(nouveau_client(client), bo->handle);
+	return ref ? ref->push : NULL;
 }
 
-static inline void
+drm_private void
 cli_kref_set(struct nouveau_client *client, struct nouveau_bo *bo,
 	     struct drm_nouveau_gem_pushbuf_bo *kref,
-	     struct nouveau_pushbuf *push)
-{
-	struct nouveau_client_priv *pcli = nouveau_client(client);
-	if (pcli->kref_nr <= bo->handle) {
-		pcli->kref = realloc(pcli->kref,
-				     sizeof(*pcli->kref) * bo->handle * 2);
-		while (pcli->kref_nr < bo->handle * 2) {
-			pcli->kref[pcli->kref_nr].kref = NULL;
-			pcli->kref[pcli->kref_nr].push = NULL;
-			pcli->kref_nr++;
-		}
-	}
-	pcli->kref[bo->handle].kref = kref;
-	pcli->kref[bo->handle].push = push;
-}
+	     struct nouveau_pushbuf *push);
 
 struct nouveau_bo_priv {
 	struct nouveau_bo base;
@@ -85,6 +127,39 @@ struct nouveau_bo_priv {
 	uint64_t map_handle;
 	uint32_t name;
 	uint32_t access;
+
+	/* reuse cache state, only private bos created without a config
+	 * are ever reusable
+	 */
+	struct nouveau_list cache_head;
+	struct nouveau_list map_head;
+	bool reusable;
+	bool imported;
+	uint32_t cache_flags;
+	uint32_t align;
+	time_t free_time;
+};
+
+struct nouveau_bo_bucket {
+	struct nouveau_list list;
+	uint64_t size;
+};
+
+struct nouveau_bo_cache {
+	struct nouveau_bo_bucket bucket[56];
+	int nr_bucket;
+	time_t time;
+
+	/* bytes and number of bos in the buckets */
+	uint64_t size;
+	uint32_t count;
+
+	/* cached bos that kept their CPU mapping, least recently freed
+	 * first, and how many bytes of mappings they hold
+	 */
+	struct nouveau_list map_lru;
+	uint64_t mapped;
+	uint64_t map_limit;
 };
 
 static inline struct nouveau_bo_priv *
@@ -98,6 +173,15 @@ struct nouveau_device_priv {
 	int close;
 	pthread_mutex_t lock;
 	struct nouveau_list bo_list;
+	struct nouveau_bo_cache bo_cache;
+
+	/* bos created and wrapped through the device, and their CPU
+	 * mappings.  stats_lock is taken last, as bos are freed both with
+	 * and without the device lock held
+	 */
+	pthread_mutex_t stats_lock;
+	uint64_t alloc_size, import_size, map_size;
+	uint32_t alloc_count, import_count, map_count;
 	uint32_t *client;
 	int nr_client;
 	bool have_bo_usage;
@@ -117,6 +201,8 @@ nouveau_device_open_existing(struct nouveau_device **, int, int, drm_context_t);
 drm_private bool abi16_object(struct nouveau_object *, int (**)(struct nouveau_object *));
 drm_private void abi16_delete(struct nouveau_object *);
 drm_private int  abi16_sclass(struct nouveau_object *, struct nouveau_sclass **);
+drm_private void nouveau_bufctx_sweep(struct nouveau_bufctx *);
+
 drm_private void abi16_bo_info(struct nouveau_bo *, struct drm_nouveau_gem_info *);
 drm_private int  abi16_bo_init(struct nouveau_bo *, uint32_t alignment,
 			       union nouveau_bo_config *);
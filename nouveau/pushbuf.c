@@ -24,7 +24,9 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <string.h>
 #include <assert.h>
@@ -50,11 +52,24 @@ struct nouveau_pushbuf_krec {
 	uint64_t gart_used;
 };
 
+/* scratch space for folding consecutive krecs into a single submission,
+ * the hash maps buffer handles to their merged index + 1
+ */
+struct nouveau_pushbuf_merge {
+	struct nouveau_pushbuf_krec krec;
+	uint16_t hash[NOUVEAU_GEM_MAX_BUFFERS * 2];
+	uint16_t remap[NOUVEAU_GEM_MAX_BUFFERS];
+};
+
 struct nouveau_pushbuf_priv {
 	struct nouveau_pushbuf base;
 	struct nouveau_pushbuf_krec *list;
 	struct nouveau_pushbuf_krec *krec;
 	struct nouveau_list bctx_list;
+	struct nouveau_pushbuf_merge *merge;
+	uint64_t nr_kick;
+	uint64_t nr_ioctl;
+	uint64_t nr_validated;
 	struct nouveau_bo *bo;
 	uint32_t type;
 	uint32_t suffix0;
@@ -63,6 +78,9 @@ struct nouveau_pushbuf_priv {
 	uint32_t *bgn;
 	int bo_next;
 	int bo_nr;
+	int bo_min;
+	int bo_max;
+	bool bo_grown;
 	struct nouveau_bo *bos[];
 };
 
@@ -75,6 +93,156 @@ nouveau_pushbuf(struct nouveau_pushbuf *push)
 static int pushbuf_validate(struct nouveau_pushbuf *, bool);
 static int pushbuf_flush(struct nouveau_pushbuf *);
 
+/* An immediate pushbuf's ring may grow to this many times the number of
+ * buffers it was created with, rather than stall on a busy one.
+ */
+#define PUSHBUF_RING_MAX_SCALE 4
+
+/* The kref array is indexed by handle, so it is as large as the largest
+ * handle referenced.  Handles beyond this many times the live krefs (and
+ * the floor below) move the client to the hashed table.
+ */
+#define CLI_KREF_DENSE_FLOOR 4096
+#define CLI_KREF_DENSE_RATIO 16
+
+static void
+cli_kref_hash_insert(struct nouveau_client_priv *pcli, uint32_t handle,
+		     struct drm_nouveau_gem_pushbuf_bo *kref,
+		     struct nouveau_pushbuf *push)
+{
+	unsigned mask = pcli->kref_hash_size - 1;
+	unsigned i = cli_kref_hash(pcli, handle);
+
+	while (pcli->kref_hash[i].handle)
+		i = (i + 1) & mask;
+	pcli->kref_hash[i].handle = handle;
+	pcli->kref_hash[i].ref.kref = kref;
+	pcli->kref_hash[i].ref.push = push;
+}
+
+/* remove slot i, shifting back the entries that probed past it */
+static void
+cli_kref_hash_remove(struct nouveau_client_priv *pcli, unsigned i)
+{
+	struct nouveau_client_kref_slot *slot = pcli->kref_hash;
+	unsigned mask = pcli->kref_hash_size - 1;
+	unsigned j = i, home;
+
+	for (;;) {
+		j = (j + 1) & mask;
+		if (!slot[j].handle)
+			break;
+		home = cli_kref_hash(pcli, slot[j].handle);
+		if ((j > i && (home <= i || home > j)) ||
+		    (j < i && home <= i && home > j)) {
+			slot[i] = slot[j];
+			i = j;
+		}
+	}
+	memset(&slot[i], 0, sizeof(slot[i]));
+}
+
+/* move to a hashed table of size entries, from the array or a smaller one */
+static int
+cli_kref_hash_resize(struct nouveau_client_priv *pcli, unsigned size)
+{
+	struct nouveau_client_kref_slot *old = pcli->kref_hash;
+	unsigned old_size = pcli->kref_hash_size, i;
+
+	pcli->kref_hash = calloc(size, sizeof(*pcli->kref_hash));
+	if (!pcli->kref_hash) {
+		pcli->kref_hash = old;
+		return -ENOMEM;
+	}
+	pcli->kref_hash_size = size;
+
+	if (old) {
+		for (i = 0; i < old_size; i++) {
+			if (old[i].handle)
+				cli_kref_hash_insert(pcli, old[i].handle,
+						     old[i].ref.kref,
+						     old[i].ref.push);
+		}
+		free(old);
+	} else {
+		for (i = 0; i < pcli->kref_nr; i++) {
+			if (pcli->kref[i].kref)
+				cli_kref_hash_insert(pcli, i,
+						     pcli->kref[i].kref,
+						     pcli->kref[i].push);
+		}
+		free(pcli->kref);
+		pcli->kref = NULL;
+		pcli->kref_nr = 0;
+	}
+	return 0;
+}
+
+drm_private void
+cli_kref_set(struct nouveau_client *client, struct nouveau_bo *bo,
+	     struct drm_nouveau_gem_pushbuf_bo *kref,
+	     struct nouveau_pushbuf *push)
+{
+	struct nouveau_client_priv *pcli = nouveau_client(client);
+	struct nouveau_client_kref *ref = cli_kref_find(pcli, bo->handle);
+	unsigned size;
+
+	if (!kref) {
+		if (!ref || !ref->kref)
+			return;
+		pcli->kref_count--;
+		if (pcli->kref_hash) {
+			struct nouveau_client_kref_slot *slot = (void *)
+				((char *)ref - offsetof(struct nouveau_client_kref_slot, ref));
+			cli_kref_hash_remove(pcli, slot - pcli->kref_hash);
+		} else {
+			ref->kref = NULL;
+			ref->push = NULL;
+		}
+		return;
+	}
+
+	if (ref) {
+		if (!ref->kref)
+			pcli->kref_count++;
+		ref->kref = kref;
+		ref->push = push;
+		return;
+	}
+
+	if (!pcli->kref_hash &&
+	    (bo->handle < CLI_KREF_DENSE_FLOOR ||
+	     bo->handle / CLI_KREF_DENSE_RATIO <= pcli->kref_count)) {
+		struct nouveau_client_kref *krefs;
+
+		krefs = realloc(pcli->kref, sizeof(*krefs) * bo->handle * 2);
+		if (krefs) {
+			pcli->kref = krefs;
+			while (pcli->kref_nr < bo->handle * 2) {
+				pcli->kref[pcli->kref_nr].kref = NULL;
+				pcli->kref[pcli->kref_nr].push = NULL;
+				pcli->kref_nr++;
+			}
+			pcli->kref[bo->handle].kref = kref;
+			pcli->kref[bo->handle].push = push;
+			pcli->kref_count++;
+			return;
+		}
+	}
+
+	/* keep the table at most half full */
+	if (!pcli->kref_hash || (pcli->kref_count + 1) * 2 > pcli->kref_hash_size) {
+		size = pcli->kref_hash_size ? pcli->kref_hash_size * 2 : 64;
+		while (size < (pcli->kref_count + 1) * 2)
+			size *= 2;
+		if (cli_kref_hash_resize(pcli, size) &&
+		    (!pcli->kref_hash || pcli->kref_count + 1 >= pcli->kref_hash_size))
+			return;
+	}
+	cli_kref_hash_insert(pcli, bo->handle, kref, push);
+	pcli->kref_count++;
+}
+
 static bool
 pushbuf_kref_fits(struct nouveau_pushbuf *push, struct nouveau_bo *bo,
 		  uint32_t *domains)
@@ -302,6 +470,128 @@ pushbuf_dump(struct nouveau_pushbuf_krec *krec, int krec_id, int chid)
 	}
 }
 
+static uint16_t *
+pushbuf_merge_slot(struct nouveau_pushbuf_merge *merge, uint32_t handle)
+{
+	const uint32_t mask = NOUVEAU_GEM_MAX_BUFFERS * 2 - 1;
+	struct drm_nouveau_gem_pushbuf_bo *kref = merge->krec.buffer;
+	uint32_t i = (handle * 0x9e3779b1u) >> 16;
+	uint16_t *slot;
+
+	for (;; i++) {
+		slot = &merge->hash[i & mask];
+		if (!*slot || kref[*slot - 1].handle == handle)
+			return slot;
+	}
+}
+
+/* Append src to the merged krec, or leave it untouched and return false
+ * if the result would not fit in a single pushbuf ioctl.
+ */
+static bool
+pushbuf_merge_krec(struct nouveau_pushbuf *push,
+		   struct nouveau_pushbuf_merge *merge,
+		   struct nouveau_pushbuf_krec *src)
+{
+	struct nouveau_device *dev = push->client->device;
+	struct nouveau_pushbuf_krec *dst = &merge->krec;
+	struct drm_nouveau_gem_pushbuf_bo *kref, *kdst;
+	struct drm_nouveau_gem_pushbuf_reloc *krel;
+	struct drm_nouveau_gem_pushbuf_push *kpsh;
+	uint16_t *slot;
+	int nr_new = 0, i;
+
+	if (dst->nr_reloc + src->nr_reloc > NOUVEAU_GEM_MAX_RELOCS ||
+	    dst->nr_push + src->nr_push > NOUVEAU_GEM_MAX_PUSH ||
+	    dst->vram_used + src->vram_used > dev->vram_limit ||
+	    dst->gart_used + src->gart_used > dev->gart_limit)
+		return false;
+
+	kref = src->buffer;
+	for (i = 0; i < src->nr_buffer; i++, kref++) {
+		slot = pushbuf_merge_slot(merge, kref->handle);
+		if (!*slot)
+			nr_new++;
+		else
+		if (!(dst->buffer[*slot - 1].valid_domains &
+		      kref->valid_domains))
+			return false;
+	}
+
+	if (dst->nr_buffer + nr_new > NOUVEAU_GEM_MAX_BUFFERS)
+		return false;
+
+	kref = src->buffer;
+	for (i = 0; i < src->nr_buffer; i++, kref++) {
+		slot = pushbuf_merge_slot(merge, kref->handle);
+		if (!*slot) {
+			dst->buffer[dst->nr_buffer++] = *kref;
+			*slot = dst->nr_buffer;
+		} else {
+			kdst = &dst->buffer[*slot - 1];
+			kdst->valid_domains &= kref->valid_domains;
+			kdst->read_domains |= kref->read_domains;
+			kdst->write_domains |= kref->write_domains;
+		}
+		merge->remap[i] = *slot - 1;
+	}
+
+	krel = &dst->reloc[dst->nr_reloc];
+	for (i = 0; i < src->nr_reloc; i++, krel++) {
+		*krel = src->reloc[i];
+		krel->reloc_bo_index = merge->remap[krel->reloc_bo_index];
+		krel->bo_index = merge->remap[krel->bo_index];
+	}
+	dst->nr_reloc += src->nr_reloc;
+
+	kpsh = &dst->push[dst->nr_push];
+	for (i = 0; i < src->nr_push; i++, kpsh++) {
+		*kpsh = src->push[i];
+		kpsh->bo_index = merge->remap[kpsh->bo_index];
+	}
+	dst->nr_push += src->nr_push;
+
+	dst->vram_used += src->vram_used;
+	dst->gart_used += src->gart_used;
+	return true;
+}
+
+/* Fold as many krecs from the head of the chain as fit into one ioctl,
+ * returning the krec to submit and advancing *pkrec past those used.
+ */
+static struct nouveau_pushbuf_krec *
+pushbuf_merge(struct nouveau_pushbuf *push, struct nouveau_pushbuf_krec **pkrec)
+{
+	struct nouveau_pushbuf_priv *nvpb = nouveau_pushbuf(push);
+	struct nouveau_pushbuf_krec *krec = *pkrec;
+	struct nouveau_pushbuf_merge *merge = nvpb->merge;
+
+	*pkrec = krec->next;
+	if (!krec->next || !krec->next->nr_push)
+		return krec;
+
+	if (!merge) {
+		merge = nvpb->merge = malloc(sizeof(*merge));
+		if (!merge)
+			return krec;
+	}
+
+	memset(merge->hash, 0, sizeof(merge->hash));
+	merge->krec.nr_buffer = 0;
+	merge->krec.nr_reloc = 0;
+	merge->krec.nr_push = 0;
+	merge->krec.vram_used = 0;
+	merge->krec.gart_used = 0;
+	if (!pushbuf_merge_krec(push, merge, krec))
+		return krec;
+
+	while ((krec = *pkrec) && krec->nr_push &&
+	       pushbuf_merge_krec(push, merge, krec))
+		*pkrec = krec->next;
+
+	return &merge->krec;
+}
+
 static int
 pushbuf_submit(struct nouveau_pushbuf *push, struct nouveau_object *chan)
 {
@@ -313,6 +603,10 @@ pushbuf_submit(struct nouveau_pushbuf *push, struct nouveau_object *chan)
 	struct drm_nouveau_gem_pushbuf_bo *kref;
 	struct drm_nouveau_gem_pushbuf req;
 	struct nouveau_fifo *fifo = chan->data;
+	drmSubmitTrace trace = {
+		.name = "nouveau_pushbuf_submit",
+		.fd = drm->fd,
+	};
 	struct nouveau_bo *bo;
 	int krec_id = 0;
 	int ret = 0, i;
@@ -324,26 +618,38 @@ pushbuf_submit(struct nouveau_pushbuf *push, struct nouveau_object *chan)
 		push->kick_notify(push);
 
 	nouveau_pushbuf_data(push, NULL, 0, 0);
+	nvpb->nr_kick++;
 
 	while (krec && krec->nr_push) {
+		struct nouveau_pushbuf_krec *sub = pushbuf_merge(push, &krec);
+
 		req.channel = fifo->channel;
-		req.nr_buffers = krec->nr_buffer;
-		req.buffers = (uint64_t)(unsigned long)krec->buffer;
-		req.nr_relocs = krec->nr_reloc;
-		req.nr_push = krec->nr_push;
-		req.relocs = (uint64_t)(unsigned long)krec->reloc;
-		req.push = (uint64_t)(unsigned long)krec->push;
+		req.nr_buffers = sub->nr_buffer;
+		req.buffers = (uint64_t)(unsigned long)sub->buffer;
+		req.nr_relocs = sub->nr_reloc;
+		req.nr_push = sub->nr_push;
+		req.relocs = (uint64_t)(unsigned long)sub->reloc;
+		req.push = (uint64_t)(unsigned long)sub->push;
 		req.suffix0 = nvpb->suffix0;
 		req.suffix1 = nvpb->suffix1;
 		req.vram_available = 0; /* for valgrind */
 		req.gart_available = 0;
 
 		if (dbg_on(0))
-			pushbuf_dump(krec, krec_id++, fifo->channel);
+			pushbuf_dump(sub, krec_id++, fifo->channel);
 
+		nvpb->nr_ioctl++;
 #ifndef SIMULATE
+		/* the kernel hands out no fence, so none is traced */
+		trace.num_bos = sub->nr_buffer;
+		trace.cmd_bytes = 0;
+		for (i = 0; i < sub->nr_push; i++)
+			trace.cmd_bytes += sub->push[i].length;
+		drmSubmitTraceBegin(&trace);
 		ret = drmCommandWriteRead(drm->fd, DRM_NOUVEAU_GEM_PUSHBUF,
 					  &req, sizeof(req));
+		trace.ret = ret;
+		drmSubmitTraceEnd(&trace);
 		nvpb->suffix0 = req.suffix0;
 		nvpb->suffix1 = req.suffix1;
 		dev->vram_limit = (req.vram_available *
@@ -357,12 +663,12 @@ pushbuf_submit(struct nouveau_pushbuf *push, struct nouveau_object *chan)
 
 		if (ret) {
 			err("kernel rejected pushbuf: %s\n", strerror(-ret));
-			pushbuf_dump(krec, krec_id++, fifo->channel);
+			pushbuf_dump(sub, krec_id++, fifo->channel);
 			break;
 		}
 
-		kref = krec->buffer;
-		for (i = 0; i < krec->nr_buffer; i++, kref++) {
+		kref = sub->buffer;
+		for (i = 0; i < sub->nr_buffer; i++, kref++) {
 			bo = (void *)(unsigned long)kref->user_priv;
 
 			info = &kref->presumed;
@@ -380,8 +686,6 @@ pushbuf_submit(struct nouveau_pushbuf *push, struct nouveau_object *chan)
 			if (kref->read_domains)
 				nouveau_bo(bo)->access |= NOUVEAU_BO_RD;
 		}
-
-		krec = krec->next;
 	}
 
 	return ret;
@@ -497,8 +801,10 @@ pushbuf_validate(struct nouveau_pushbuf *push, bool retry)
 
 	DRMLISTDEL(&bctx->head);
 	DRMLISTADD(&bctx->head, &nvpb->bctx_list);
+	nouveau_bufctx_sweep(bctx);
 
 	DRMLISTFOREACHENTRY(bref, &bctx->pending, thead) {
+		nvpb->nr_validated++;
 		kref = pushbuf_kref(push, bref->bo, bref->flags);
 		if (!kref) {
 			ret = -ENOSPC;
@@ -553,9 +859,12 @@ nouveau_pushbuf_new(struct nouveau_client *client, struct nouveau_object *chan,
 	if (ret)
 		return ret;
 
-	nvpb = calloc(1, sizeof(*nvpb) + nr * sizeof(*nvpb->bos));
+	nvpb = calloc(1, sizeof(*nvpb) +
+			 nr * PUSHBUF_RING_MAX_SCALE * sizeof(*nvpb->bos));
 	if (!nvpb)
 		return -ENOMEM;
+	nvpb->bo_min = nr;
+	nvpb->bo_max = nr * PUSHBUF_RING_MAX_SCALE;
 
 #ifndef SIMULATE
 	nvpb->suffix0 = req.suffix0;
@@ -620,6 +929,10 @@ nouveau_pushbuf_del(struct nouveau_pushbuf **ppush)
 		while (nvpb->bo_nr--)
 			nouveau_bo_ref(NULL, &nvpb->bos[nvpb->bo_nr]);
 		nouveau_bo_ref(NULL, &nvpb->bo);
+		dbg(1, "pushbuf %p: %"PRIu64" kicks, %"PRIu64" ioctls, "
+		    "%"PRIu64" refs validated\n", (void *)nvpb,
+		    nvpb->nr_kick, nvpb->nr_ioctl, nvpb->nr_validated);
+		free(nvpb->merge);
 		free(nvpb);
 	}
 	*ppush = NULL;
@@ -633,6 +946,43 @@ nouveau_pushbuf_bufctx(struct nouveau_pushbuf *push, struct nouveau_bufctx *ctx)
 	return prev;
 }
 
+/* Pick the next buffer of an immediate pushbuf's ring.  If it's still
+ * busy on the GPU, a fresh buffer is slotted in ahead of it instead of
+ * stalling in the map; every lap that completes without growing gives
+ * one of the extra buffers back.
+ */
+static void
+pushbuf_ring_next(struct nouveau_pushbuf *push, struct nouveau_bo **pbo)
+{
+	struct nouveau_pushbuf_priv *nvpb = nouveau_pushbuf(push);
+	struct nouveau_bo *next = nvpb->bos[nvpb->bo_next];
+	struct nouveau_bo *bo = NULL;
+	int i;
+
+	if (nvpb->bo_nr < nvpb->bo_max &&
+	    nouveau_bo_wait(next, NOUVEAU_BO_WR | NOUVEAU_BO_NOBLOCK,
+			    push->client) &&
+	    !nouveau_bo_new(push->client->device, nvpb->type, 0,
+			    next->size, NULL, &bo)) {
+		for (i = nvpb->bo_nr; i > nvpb->bo_next; i--)
+			nvpb->bos[i] = nvpb->bos[i - 1];
+		nvpb->bos[nvpb->bo_next] = bo;
+		nvpb->bo_nr++;
+		nvpb->bo_grown = true;
+	}
+
+	nouveau_bo_ref(nvpb->bos[nvpb->bo_next++], pbo);
+	if (nvpb->bo_next == nvpb->bo_nr) {
+		nvpb->bo_next = 0;
+		/* the dropped buffer is the one just picked, which stays
+		 * alive through *pbo until the pushbuf moves past it
+		 */
+		if (!nvpb->bo_grown && nvpb->bo_nr > nvpb->bo_min)
+			nouveau_bo_ref(NULL, &nvpb->bos[--nvpb->bo_nr]);
+		nvpb->bo_grown = false;
+	}
+}
+
 drm_public int
 nouveau_pushbuf_space(struct nouveau_pushbuf *push,
 		      uint32_t dwords, uint32_t relocs, uint32_t pushes)
@@ -646,10 +996,11 @@ nouveau_pushbuf_space(struct nouveau_pushbuf *push,
 
 	/* switch to next buffer if insufficient space in the current one */
 	if (push->cur + dwords >= push->end) {
+		if (nvpb->bo_next < nvpb->bo_nr && push->channel) {
+			pushbuf_ring_next(push, &bo);
+		} else
 		if (nvpb->bo_next < nvpb->bo_nr) {
 			nouveau_bo_ref(nvpb->bos[nvpb->bo_next++], &bo);
-			if (nvpb->bo_next == nvpb->bo_nr && push->channel)
-				nvpb->bo_next = 0;
 		} else {
 			ret = nouveau_bo_new(client->device, nvpb->type, 0,
 					     nvpb->bos[0]->size, NULL, &bo);
@@ -34,10 +34,13 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <poll.h>
+#include <time.h>
 
 #include <libdrm_macros.h>
 #include <xf86drm.h>
 #include <xf86atomic.h>
+#include <util_double_list.h>
 
 #include "omap_drm.h"
 #include "omap_drmif.h"
@@ -63,6 +66,14 @@ struct omap_device {
 	 * free'd).
 	 */
 	void *handle_table;
+
+	/* Deleted bo's kept for reuse, if enabled, oldest first.  Tiled
+	 * bo's are matched on (width, height, flags), others on size and
+	 * flags.  Cached bo's don't hold a reference to the device.
+	 */
+	int cache_enabled;
+	struct list_head cache;
+	time_t cache_time;
 };
 
 /* a GEM buffer object allocated from the DRM device */
@@ -75,8 +86,18 @@ struct omap_bo {
 	uint64_t	offset;		/* offset to mmap() */
 	int		fd;		/* dmabuf handle */
 	atomic_t	refcnt;
+
+	/* bo cache: */
+	uint32_t	flags;
+	uint32_t	width, height;	/* tiled bo's only */
+	int		reusable;	/* never shared with anyone else */
+	time_t		free_time;
+	struct list_head list;
 };
 
+static void bo_free(struct omap_bo *bo);
+static void bo_cache_cleanup(struct omap_device *dev, time_t time);
+
 static struct omap_device * omap_device_new_impl(int fd)
 {
 	struct omap_device *dev = calloc(sizeof(*dev), 1);
@@ -84,7 +105,8 @@ static struct omap_device * omap_device_new_impl(int fd)
 		return NULL;
 	dev->fd = fd;
 	atomic_set(&dev->refcnt, 1);
-	dev->handle_table = drmHashCreate();
+	dev->handle_table = drmIntMapCreate();
+	list_inithead(&dev->cache);
 	return dev;
 }
 
@@ -122,7 +144,8 @@ drm_public void omap_device_del(struct omap_device *dev)
 	if (!atomic_dec_and_test(&dev->refcnt))
 		return;
 	pthread_mutex_lock(&table_lock);
-	drmHashDestroy(dev->handle_table);
+	bo_cache_cleanup(dev, 0);
+	drmIntMapDestroy(dev->handle_table);
 	drmHashDelete(dev_table, dev->fd);
 	pthread_mutex_unlock(&table_lock);
 	free(dev);
@@ -156,12 +179,108 @@ omap_set_param(struct omap_device *dev, uint64_t param, uint64_t value)
 	return drmCommandWrite(dev->fd, DRM_OMAP_SET_PARAM, &req, sizeof(req));
 }
 
+/* Enable or disable reuse of deleted buffer objects.  There is no way
+ * to ask the kernel whether a bo is still being accessed, so only enable
+ * this if bo's are idle (and no longer scanned out) by the time they are
+ * deleted.  The device is shared by all users of the fd in the process.
+ * Disabling frees the bo's cached so far.
+ */
+drm_public void omap_device_set_bo_cache(struct omap_device *dev, int enable)
+{
+	pthread_mutex_lock(&table_lock);
+	dev->cache_enabled = !!enable;
+	if (!enable)
+		bo_cache_cleanup(dev, 0);
+	pthread_mutex_unlock(&table_lock);
+}
+
+static time_t get_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+/* free bo's cached for more than a second, or all of them if time is 0,
+ * call w/ table_lock held:
+ */
+static void bo_cache_cleanup(struct omap_device *dev, time_t time)
+{
+	if (time && dev->cache_time == time)
+		return;
+
+	while (!LIST_IS_EMPTY(&dev->cache)) {
+		struct omap_bo *bo = LIST_FIRST_ENTRY(&dev->cache,
+				struct omap_bo, list);
+
+		if (time && (time - bo->free_time) <= 1)
+			break;
+
+		list_del(&bo->list);
+		bo_free(bo);
+	}
+
+	dev->cache_time = time;
+}
+
+/* take a matching bo out of the cache, call w/ table_lock held: */
+static struct omap_bo * bo_cache_alloc(struct omap_device *dev,
+		union omap_gem_size size, uint32_t flags)
+{
+	struct omap_bo *bo, *tmp;
+
+	/* most recently deleted first: */
+	LIST_FOR_EACH_ENTRY_SAFE_REV(bo, tmp, &dev->cache, list) {
+		if (bo->flags != flags)
+			continue;
+
+		if (flags & OMAP_BO_TILED) {
+			if (bo->width != size.tiled.width ||
+					bo->height != size.tiled.height)
+				continue;
+		} else if (round_up(bo->size, PAGE_SIZE) !=
+				round_up(size.bytes, PAGE_SIZE)) {
+			continue;
+		}
+
+		list_del(&bo->list);
+		bo->dev = omap_device_ref(dev);
+		atomic_set(&bo->refcnt, 1);
+		drmIntMapInsert(dev->handle_table, bo->handle, bo);
+		return bo;
+	}
+
+	return NULL;
+}
+
+/* put a deleted bo in the cache if possible, call w/ table_lock held: */
+static int bo_cache_free(struct omap_bo *bo)
+{
+	struct omap_device *dev = bo->dev;
+	time_t time;
+
+	if (!dev->cache_enabled || !bo->reusable)
+		return -1;
+
+	/* nobody can find it by handle while it is cached: */
+	drmIntMapDelete(dev->handle_table, bo->handle);
+
+	time = get_time();
+	bo->free_time = time;
+	list_addtail(&bo->list, &dev->cache);
+
+	bo_cache_cleanup(dev, time);
+
+	return 0;
+}
+
 /* lookup a buffer from it's handle, call w/ table_lock held: */
 static struct omap_bo * lookup_bo(struct omap_device *dev,
 		uint32_t handle)
 {
 	struct omap_bo *bo = NULL;
-	if (!drmHashLookup(dev->handle_table, handle, (void **)&bo)) {
+	if (!drmIntMapLookup(dev->handle_table, handle, (void **)&bo)) {
 		/* found, incr refcnt and return: */
 		bo = omap_bo_ref(bo);
 	}
@@ -185,7 +304,7 @@ static struct omap_bo * bo_from_handle(struct omap_device *dev,
 	bo->fd = -1;
 	atomic_set(&bo->refcnt, 1);
 	/* add ourselves to the handle table: */
-	drmHashInsert(dev->handle_table, handle, bo);
+	drmIntMapInsert(dev->handle_table, handle, bo);
 	return bo;
 }
 
@@ -203,6 +322,14 @@ static struct omap_bo * omap_bo_new_impl(struct omap_device *dev,
 		goto fail;
 	}
 
+	pthread_mutex_lock(&table_lock);
+	if (dev->cache_enabled)
+		bo = bo_cache_alloc(dev, size, flags);
+	pthread_mutex_unlock(&table_lock);
+
+	if (bo)
+		return bo;
+
 	if (drmCommandWriteRead(dev->fd, DRM_OMAP_GEM_NEW, &req, sizeof(req))) {
 		goto fail;
 	}
@@ -211,12 +338,20 @@ static struct omap_bo * omap_bo_new_impl(struct omap_device *dev,
 	bo = bo_from_handle(dev, req.handle);
 	pthread_mutex_unlock(&table_lock);
 
+	if (!bo)
+		goto fail;
+
 	if (flags & OMAP_BO_TILED) {
 		bo->size = round_up(size.tiled.width, PAGE_SIZE) * size.tiled.height;
+		bo->width = size.tiled.width;
+		bo->height = size.tiled.height;
 	} else {
 		bo->size = size.bytes;
 	}
 
+	bo->flags = flags;
+	bo->reusable = 1;
+
 	return bo;
 
 fail:
@@ -346,16 +481,9 @@ fail:
 	return NULL;
 }
 
-/* destroy a buffer object */
-drm_public void omap_bo_del(struct omap_bo *bo)
+/* free a buffer object, call w/ table_lock held */
+static void bo_free(struct omap_bo *bo)
 {
-	if (!bo) {
-		return;
-	}
-
-	if (!atomic_dec_and_test(&bo->refcnt))
-		return;
-
 	if (bo->map) {
 		munmap(bo->map, bo->size);
 	}
@@ -368,17 +496,35 @@ drm_public void omap_bo_del(struct omap_bo *bo)
 		struct drm_gem_close req = {
 				.handle = bo->handle,
 		};
-		pthread_mutex_lock(&table_lock);
-		drmHashDelete(bo->dev->handle_table, bo->handle);
+		drmIntMapDelete(bo->dev->handle_table, bo->handle);
 		drmIoctl(bo->dev->fd, DRM_IOCTL_GEM_CLOSE, &req);
-		pthread_mutex_unlock(&table_lock);
 	}
 
-	omap_device_del(bo->dev);
-
 	free(bo);
 }
 
+/* destroy a buffer object */
+drm_public void omap_bo_del(struct omap_bo *bo)
+{
+	struct omap_device *dev;
+
+	if (!bo) {
+		return;
+	}
+
+	if (!atomic_dec_and_test(&bo->refcnt))
+		return;
+
+	dev = bo->dev;
+
+	pthread_mutex_lock(&table_lock);
+	if (bo_cache_free(bo))
+		bo_free(bo);
+	pthread_mutex_unlock(&table_lock);
+
+	omap_device_del(dev);
+}
+
 /* get the global flink/DRI2 buffer name */
 drm_public int omap_bo_get_name(struct omap_bo *bo, uint32_t *name)
 {
@@ -394,6 +540,7 @@ drm_public int omap_bo_get_name(struct omap_bo *bo, uint32_t *name)
 		}
 
 		bo->name = req.name;
+		bo->reusable = 0;
 	}
 
 	*name = bo->name;
@@ -406,10 +553,8 @@ drm_public uint32_t omap_bo_handle(struct omap_bo *bo)
 	return bo->handle;
 }
 
-/* caller owns the dmabuf fd that is returned and is responsible
- * to close() it when done
- */
-drm_public int omap_bo_dmabuf(struct omap_bo *bo)
+/* export the bo as dmabuf, kept in bo->fd until the bo is freed */
+static int export_dmabuf(struct omap_bo *bo)
 {
 	if (bo->fd < 0) {
 		struct drm_prime_handle req = {
@@ -425,6 +570,22 @@ drm_public int omap_bo_dmabuf(struct omap_bo *bo)
 
 		bo->fd = req.fd;
 	}
+	return 0;
+}
+
+/* caller owns the dmabuf fd that is returned and is responsible
+ * to close() it when done
+ */
+drm_public int omap_bo_dmabuf(struct omap_bo *bo)
+{
+	int ret = export_dmabuf(bo);
+	if (ret) {
+		return ret;
+	}
+
+	/* it can be shared with anyone now: */
+	bo->reusable = 0;
+
 	return dup(bo->fd);
 }
 
@@ -462,6 +623,70 @@ drm_public int omap_bo_cpu_prep(struct omap_bo *bo, enum omap_gem_op op)
 			DRM_OMAP_GEM_CPU_PREP, &req, sizeof(req));
 }
 
+/* dmabuf poll() reports readable once writers are done, and writable
+ * once all accesses are done:
+ */
+static short op_events(enum omap_gem_op op)
+{
+	return (op & OMAP_GEM_WRITE) ? POLLOUT : POLLIN;
+}
+
+/* like omap_bo_cpu_prep(), but returns -EBUSY rather than blocking if
+ * the buffer is still being accessed by a device
+ */
+drm_public int omap_bo_cpu_prep_try(struct omap_bo *bo, enum omap_gem_op op)
+{
+	struct pollfd pfd;
+	int ret;
+
+	ret = export_dmabuf(bo);
+	if (ret) {
+		return -errno;
+	}
+
+	pfd.fd = bo->fd;
+	pfd.events = op_events(op);
+	pfd.revents = 0;
+
+	ret = poll(&pfd, 1, 0);
+	if (ret < 0) {
+		return -errno;
+	}
+	if (ret == 0) {
+		return -EBUSY;
+	}
+
+	return omap_bo_cpu_prep(bo, op);
+}
+
+/* returns an fd to poll() for the events stored in *events, which are
+ * reported once the CPU access given by op won't have to wait anymore,
+ * ie. once omap_bo_cpu_prep() no longer blocks.  The fd is a dmabuf of
+ * the bo, to be used for this purpose only.  The caller owns it and is
+ * responsible to close() it when done
+ */
+drm_public int omap_bo_cpu_prep_fd(struct omap_bo *bo, enum omap_gem_op op,
+		short *events)
+{
+	int fd, ret;
+
+	ret = export_dmabuf(bo);
+	if (ret) {
+		return -errno;
+	}
+
+	fd = dup(bo->fd);
+	if (fd < 0) {
+		return -errno;
+	}
+
+	if (events) {
+		*events = op_events(op);
+	}
+
+	return fd;
+}
+
 drm_public int omap_bo_cpu_fini(struct omap_bo *bo, enum omap_gem_op op)
 {
 	struct drm_omap_gem_cpu_fini req = {
@@ -42,6 +42,7 @@ struct omap_device * omap_device_ref(struct omap_device *dev);
 void omap_device_del(struct omap_device *dev);
 int omap_get_param(struct omap_device *dev, uint64_t param, uint64_t *value);
 int omap_set_param(struct omap_device *dev, uint64_t param, uint64_t value);
+void omap_device_set_bo_cache(struct omap_device *dev, int enable);
 
 /* buffer-object related functions:
  */
@@ -60,6 +61,9 @@ int omap_bo_dmabuf(struct omap_bo *bo);
 uint32_t omap_bo_size(struct omap_bo *bo);
 void * omap_bo_map(struct omap_bo *bo);
 int omap_bo_cpu_prep(struct omap_bo *bo, enum omap_gem_op op);
+int omap_bo_cpu_prep_try(struct omap_bo *bo, enum omap_gem_op op);
+int omap_bo_cpu_prep_fd(struct omap_bo *bo, enum omap_gem_op op,
+		short *events);
 int omap_bo_cpu_fini(struct omap_bo *bo, enum omap_gem_op op);
 
 #endif /* OMAP_DRMIF_H_ */
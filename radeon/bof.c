@@ -24,8 +24,11 @@
  *      Jerome Glisse
  */
 #include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "bof.h"
 
 /*
@@ -475,3 +478,266 @@ out_err:
 	bof->file = NULL;
 	return r;
 }
+
+/*
+ * stream
+ */
+#define BOF_STREAM_CHUNK	(64ULL << 20)
+
+bof_stream_t *bof_stream_open(const char *filename)
+{
+	bof_stream_t *stream;
+
+	stream = calloc(1, sizeof(bof_stream_t));
+	if (stream == NULL)
+		return NULL;
+	stream->hash_size = 256;
+	stream->hashes = calloc(stream->hash_size, sizeof(uint64_t));
+	stream->ids = calloc(stream->hash_size, sizeof(uint32_t));
+	if (stream->hashes == NULL || stream->ids == NULL)
+		goto out_err;
+	stream->fd = open(filename, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (stream->fd < 0) {
+		fprintf(stderr, "%s failed to open file %s\n", __func__, filename);
+		goto out_err;
+	}
+	return stream;
+out_err:
+	free(stream->hashes);
+	free(stream->ids);
+	free(stream);
+	return NULL;
+}
+
+int bof_stream_close(bof_stream_t *stream)
+{
+	int r = 0;
+
+	if (stream == NULL)
+		return 0;
+	if (stream->map)
+		munmap(stream->map, stream->map_size);
+	if (ftruncate(stream->fd, stream->offset))
+		r = -errno;
+	close(stream->fd);
+	free(stream->hashes);
+	free(stream->ids);
+	free(stream);
+	return r;
+}
+
+/* make room for size more bytes, growing the file and its mapping */
+static int bof_stream_reserve(bof_stream_t *stream, uint64_t size)
+{
+	uint64_t map_size = stream->map_size;
+	void *map;
+
+	if (stream->offset + size <= map_size)
+		return 0;
+	while (map_size < stream->offset + size)
+		map_size += BOF_STREAM_CHUNK;
+	if (ftruncate(stream->fd, map_size))
+		return -errno;
+	if (stream->map)
+		munmap(stream->map, stream->map_size);
+	map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		   stream->fd, 0);
+	if (map == MAP_FAILED) {
+		stream->map = NULL;
+		stream->map_size = 0;
+		return -errno;
+	}
+	stream->map = map;
+	stream->map_size = map_size;
+	return 0;
+}
+
+static int bof_stream_write(bof_stream_t *stream, uint32_t type,
+			    uint32_t size, const void *value)
+{
+	uint32_t header[3] = { type, size + 12, 0 };
+	int r;
+
+	r = bof_stream_reserve(stream, size + 12);
+	if (r)
+		return r;
+	memcpy(stream->map + stream->offset, header, 12);
+	if (size)
+		memcpy(stream->map + stream->offset + 12, value, size);
+	stream->offset += size + 12;
+	return 0;
+}
+
+/* Start an object or array record, returning its offset for
+ * bof_stream_end() or bof_stream_abort(). */
+int64_t bof_stream_begin(bof_stream_t *stream, uint32_t type)
+{
+	int r;
+
+	if (type != BOF_TYPE_OBJECT && type != BOF_TYPE_ARRAY)
+		return -EINVAL;
+	if (stream->depth++ == 0)
+		stream->record_first_id = stream->nids;
+	r = bof_stream_write(stream, type, 0, NULL);
+	if (r) {
+		stream->depth--;
+		return r;
+	}
+	return stream->offset - 12;
+}
+
+/* Close the record started at start, holding nentry (for objects: keys
+ * and values) entries. */
+int bof_stream_end(bof_stream_t *stream, int64_t start, uint32_t nentry)
+{
+	uint64_t size = stream->offset - start;
+	uint32_t header[2];
+
+	if (size > UINT32_MAX)
+		return -EFBIG;
+	header[0] = size;
+	header[1] = nentry;
+	memcpy(stream->map + start + 4, header, 8);
+	stream->depth--;
+	return 0;
+}
+
+/* Drop the top level record started at start and what was written in it,
+ * along with the blob ids it had handed out. */
+void bof_stream_abort(bof_stream_t *stream, int64_t start)
+{
+	uint32_t i;
+
+	stream->offset = start;
+	stream->depth = 0;
+	if (stream->nids == stream->record_first_id)
+		return;
+	for (i = 0; i < stream->hash_size; i++) {
+		if (stream->hashes[i] && stream->ids[i] >= stream->record_first_id) {
+			stream->hashes[i] = 0;
+			stream->ids[i] = 0;
+		}
+	}
+	stream->nids = stream->record_first_id;
+	/* stale entries may now sit before what they collided with, so
+	 * rebuild the probe chains */
+	for (i = 0; i < stream->hash_size; i++) {
+		uint64_t hash = stream->hashes[i];
+		uint32_t id = stream->ids[i];
+		uint32_t mask = stream->hash_size - 1, j;
+
+		if (!hash)
+			continue;
+		stream->hashes[i] = 0;
+		for (j = hash & mask; stream->hashes[j]; j = (j + 1) & mask)
+			;
+		stream->hashes[j] = hash;
+		stream->ids[j] = id;
+	}
+}
+
+int bof_stream_string(bof_stream_t *stream, const char *value)
+{
+	return bof_stream_write(stream, BOF_TYPE_STRING, strlen(value) + 1, value);
+}
+
+int bof_stream_int32(bof_stream_t *stream, int32_t value)
+{
+	return bof_stream_write(stream, BOF_TYPE_INT32, 4, &value);
+}
+
+int bof_stream_blob(bof_stream_t *stream, unsigned size, const void *value)
+{
+	return bof_stream_write(stream, BOF_TYPE_BLOB, size, value);
+}
+
+static uint64_t bof_hash(unsigned size, const void *value)
+{
+	const uint8_t *p = value;
+	uint64_t hash = 0xcbf29ce484222325ULL ^ size;
+	uint64_t word;
+	unsigned i;
+
+	for (i = 0; i + 8 <= size; i += 8) {
+		memcpy(&word, p + i, 8);
+		hash = (hash ^ word) * 0x100000001b3ULL;
+		hash ^= hash >> 29;
+	}
+	for (; i < size; i++)
+		hash = (hash ^ p[i]) * 0x100000001b3ULL;
+	/* 0 marks a free slot */
+	return hash ? hash : 1;
+}
+
+static int bof_stream_hash_grow(bof_stream_t *stream)
+{
+	uint32_t size = stream->hash_size * 2, mask = size - 1, i, j;
+	uint64_t *hashes;
+	uint32_t *ids;
+
+	hashes = calloc(size, sizeof(uint64_t));
+	ids = calloc(size, sizeof(uint32_t));
+	if (hashes == NULL || ids == NULL) {
+		free(hashes);
+		free(ids);
+		return -ENOMEM;
+	}
+	for (i = 0; i < stream->hash_size; i++) {
+		if (!stream->hashes[i])
+			continue;
+		for (j = stream->hashes[i] & mask; hashes[j]; j = (j + 1) & mask)
+			;
+		hashes[j] = stream->hashes[i];
+		ids[j] = stream->ids[i];
+	}
+	free(stream->hashes);
+	free(stream->ids);
+	stream->hashes = hashes;
+	stream->ids = ids;
+	stream->hash_size = size;
+	return 0;
+}
+
+/* Write the "id" of the given contents into the open object and, the first
+ * time the stream sees them, their "data" as well.  Returns the number of
+ * object entries written. */
+int bof_stream_shared_blob(bof_stream_t *stream, unsigned size,
+			   const void *value)
+{
+	uint64_t hash = bof_hash(size, value);
+	uint32_t mask = stream->hash_size - 1, i, id;
+	int r;
+
+	for (i = hash & mask; stream->hashes[i]; i = (i + 1) & mask) {
+		if (stream->hashes[i] == hash) {
+			r = bof_stream_string(stream, "id");
+			if (!r)
+				r = bof_stream_int32(stream, stream->ids[i]);
+			return r ? r : 2;
+		}
+	}
+
+	r = bof_stream_string(stream, "id");
+	if (!r)
+		r = bof_stream_int32(stream, stream->nids);
+	if (!r)
+		r = bof_stream_string(stream, "data");
+	if (!r)
+		r = bof_stream_blob(stream, size, value);
+	if (r)
+		return r;
+
+	id = stream->nids++;
+	/* failing to grow only costs deduplication, while the table is far
+	 * enough from full for probes to end */
+	if (stream->nids * 2 > stream->hash_size &&
+	    bof_stream_hash_grow(stream) &&
+	    stream->nids * 4 > stream->hash_size * 3)
+		return 4;
+	mask = stream->hash_size - 1;
+	for (i = hash & mask; stream->hashes[i]; i = (i + 1) & mask)
+		;
+	stream->hashes[i] = hash;
+	stream->ids[i] = id;
+	return 4;
+}
@@ -51,6 +51,39 @@ typedef struct bof {
 	long		offset;
 } bof_t;
 
+/*
+ * Streamed capture: records are appended to an mmap'ed file as they are
+ * produced instead of being built up in memory first.  Objects and arrays
+ * are opened with bof_stream_begin() and sized by bof_stream_end() once
+ * their entries are written.  The file is a sequence of top level
+ * records, each of them a complete bof object.
+ */
+typedef struct bof_stream {
+	int		fd;
+	uint8_t		*map;
+	uint64_t	map_size;
+	uint64_t	offset;
+	unsigned	depth;
+	/* open addressing table of bo content hashes and their blob ids */
+	uint64_t	*hashes;
+	uint32_t	*ids;
+	uint32_t	hash_size;
+	uint32_t	nids;
+	/* first blob id handed out for the current top level record */
+	uint32_t	record_first_id;
+} bof_stream_t;
+
+extern bof_stream_t *bof_stream_open(const char *filename);
+extern int bof_stream_close(bof_stream_t *stream);
+extern int64_t bof_stream_begin(bof_stream_t *stream, uint32_t type);
+extern int bof_stream_end(bof_stream_t *stream, int64_t start, uint32_t nentry);
+extern void bof_stream_abort(bof_stream_t *stream, int64_t start);
+extern int bof_stream_string(bof_stream_t *stream, const char *value);
+extern int bof_stream_int32(bof_stream_t *stream, int32_t value);
+extern int bof_stream_blob(bof_stream_t *stream, unsigned size, const void *value);
+extern int bof_stream_shared_blob(bof_stream_t *stream, unsigned size,
+				  const void *value);
+
 extern int bof_file_flush(bof_t *root);
 extern bof_t *bof_file_new(const char *filename);
 extern int bof_object_dump(bof_t *object, const char *filename);
@@ -34,7 +34,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 #include "libdrm_macros.h"
+#include "libdrm_lists.h"
 #include "xf86drm.h"
 #include "xf86atomic.h"
 #include "drm.h"
@@ -42,19 +44,47 @@
 #include "radeon_bo.h"
 #include "radeon_bo_int.h"
 #include "radeon_bo_gem.h"
+#include "radeon_bo_gem_priv.h"
 #include <fcntl.h>
 struct radeon_bo_gem {
     struct radeon_bo_int    base;
     uint32_t                name;
     int                     map_count;
     atomic_t                reloc_in_cs;
+    /* number of CS per id bit referencing the bo */
+    uint8_t                 cs_users[32];
     void                    *priv_ptr;
+    /* on the manager's map_lru while mapped by the cpu but not in use */
+    drmMMListHead           map_lru;
 };
 
+/* cpu mappings of unused bos are kept around up to this many bytes */
+#define RADEON_MAP_CACHE_SIZE   (64 * 1024 * 1024)
+
 struct bo_manager_gem {
     struct radeon_bo_manager    base;
+    /* open bos by GEM handle and by flink name, so that importing a
+     * buffer again hands back the same radeon_bo */
+    pthread_mutex_t             table_lock;
+    void                        *handle_table;
+    void                        *name_table;
+    /* idle mappings, least recently unmapped first, under table_lock */
+    drmMMListHead               map_lru;
+    uint64_t                    map_lru_size;
 };
 
+/* look up a bo and take a reference on it, call w/ table_lock held */
+static struct radeon_bo *bo_lookup(void *table, uint32_t key)
+{
+    void *bo;
+
+    if (drmIntMapLookup(table, key, &bo)) {
+        return NULL;
+    }
+    radeon_bo_ref((struct radeon_bo *)bo);
+    return (struct radeon_bo *)bo;
+}
+
 static int bo_wait(struct radeon_bo_int *boi);
     
 static struct radeon_bo *bo_open(struct radeon_bo_manager *bom,
@@ -64,9 +94,20 @@ static struct radeon_bo *bo_open(struct radeon_bo_manager *bom,
                                  uint32_t domains,
                                  uint32_t flags)
 {
+    struct bo_manager_gem *bomg = (struct bo_manager_gem*)bom;
     struct radeon_bo_gem *bo;
+    struct radeon_bo *old;
     int r;
 
+    if (handle) {
+        pthread_mutex_lock(&bomg->table_lock);
+        old = bo_lookup(bomg->name_table, handle);
+        pthread_mutex_unlock(&bomg->table_lock);
+        if (old) {
+            return old;
+        }
+    }
+
     bo = (struct radeon_bo_gem*)calloc(1, sizeof(struct radeon_bo_gem));
     if (bo == NULL) {
         return NULL;
@@ -81,6 +122,7 @@ static struct radeon_bo *bo_open(struct radeon_bo_manager *bom,
     bo->base.ptr = NULL;
     atomic_set(&bo->reloc_in_cs, 0);
     bo->map_count = 0;
+    DRMINITLISTHEAD(&bo->map_lru);
     if (handle) {
         struct drm_gem_open open_arg;
 
@@ -115,6 +157,13 @@ static struct radeon_bo *bo_open(struct radeon_bo_manager *bom,
         }
     }
     radeon_bo_ref((struct radeon_bo*)bo);
+
+    pthread_mutex_lock(&bomg->table_lock);
+    drmIntMapInsert(bomg->handle_table, bo->base.handle, bo);
+    if (bo->name) {
+        drmIntMapInsert(bomg->name_table, bo->name, bo);
+    }
+    pthread_mutex_unlock(&bomg->table_lock);
     return (struct radeon_bo*)bo;
 }
 
@@ -124,12 +173,34 @@ static void bo_ref(struct radeon_bo_int *boi)
 
 static struct radeon_bo *bo_unref(struct radeon_bo_int *boi)
 {
+    struct bo_manager_gem *bomg = (struct bo_manager_gem*)boi->bom;
     struct radeon_bo_gem *bo_gem = (struct radeon_bo_gem*)boi;
     struct drm_gem_close args;
+    void *named;
+
+    if (boi->cref) {
+        return (struct radeon_bo *)boi;
+    }
 
+    pthread_mutex_lock(&bomg->table_lock);
+    /* a lookup may have picked the bo up again in the meantime */
     if (boi->cref) {
+        pthread_mutex_unlock(&bomg->table_lock);
         return (struct radeon_bo *)boi;
     }
+    drmIntMapDelete(bomg->handle_table, boi->handle);
+    /* prime imports use their handle as name and are not in the table */
+    if (bo_gem->name &&
+        !drmIntMapLookup(bomg->name_table, bo_gem->name, &named) &&
+        named == bo_gem) {
+        drmIntMapDelete(bomg->name_table, bo_gem->name);
+    }
+    if (!DRMLISTEMPTY(&bo_gem->map_lru)) {
+        DRMLISTDELINIT(&bo_gem->map_lru);
+        bomg->map_lru_size -= boi->size;
+    }
+    pthread_mutex_unlock(&bomg->table_lock);
+
     if (bo_gem->priv_ptr) {
         drm_munmap(bo_gem->priv_ptr, boi->size);
     }
@@ -139,14 +210,30 @@ static struct radeon_bo *bo_unref(struct radeon_bo_int *boi)
 
     /* close object */
     args.handle = boi->handle;
+    drmPrimeCacheForget(boi->bom->fd, boi->handle);
     drmIoctl(boi->bom->fd, DRM_IOCTL_GEM_CLOSE, &args);
     memset(bo_gem, 0, sizeof(struct radeon_bo_gem));
     free(bo_gem);
     return NULL;
 }
 
-static int bo_map(struct radeon_bo_int *boi, int write)
+/* drop the oldest idle mappings until the cache fits, call w/ table_lock held */
+static void map_lru_trim(struct bo_manager_gem *bomg)
+{
+    struct radeon_bo_gem *bo_gem;
+
+    while (bomg->map_lru_size > RADEON_MAP_CACHE_SIZE) {
+        bo_gem = DRMLISTENTRY(struct radeon_bo_gem, bomg->map_lru.next, map_lru);
+        DRMLISTDELINIT(&bo_gem->map_lru);
+        bomg->map_lru_size -= bo_gem->base.size;
+        drm_munmap(bo_gem->priv_ptr, bo_gem->base.size);
+        bo_gem->priv_ptr = NULL;
+    }
+}
+
+static int bo_map_common(struct radeon_bo_int *boi, int write, int sync)
 {
+    struct bo_manager_gem *bomg = (struct bo_manager_gem*)boi->bom;
     struct radeon_bo_gem *bo_gem = (struct radeon_bo_gem*)boi;
     struct drm_radeon_gem_mmap args;
     int r;
@@ -155,6 +242,14 @@ static int bo_map(struct radeon_bo_int *boi, int write)
     if (bo_gem->map_count++ != 0) {
         return 0;
     }
+
+    /* take the mapping back from the cache before anyone can evict it */
+    pthread_mutex_lock(&bomg->table_lock);
+    if (!DRMLISTEMPTY(&bo_gem->map_lru)) {
+        DRMLISTDELINIT(&bo_gem->map_lru);
+        bomg->map_lru_size -= boi->size;
+    }
+    pthread_mutex_unlock(&bomg->table_lock);
     if (bo_gem->priv_ptr) {
         goto wait;
     }
@@ -173,29 +268,48 @@ static int bo_map(struct radeon_bo_int *boi, int write)
     if (r) {
         fprintf(stderr, "error mapping %p 0x%08X (error = %d)\n",
                 boi, boi->handle, r);
+        bo_gem->map_count--;
         return r;
     }
     ptr = drm_mmap(0, args.size, PROT_READ|PROT_WRITE, MAP_SHARED, boi->bom->fd, args.addr_ptr);
-    if (ptr == MAP_FAILED)
+    if (ptr == MAP_FAILED) {
+        bo_gem->map_count--;
         return -errno;
+    }
     bo_gem->priv_ptr = ptr;
 wait:
     boi->ptr = bo_gem->priv_ptr;
+    if (!sync)
+        return 0;
     r = bo_wait(boi);
     if (r)
         return r;
     return 0;
 }
 
+static int bo_map(struct radeon_bo_int *boi, int write)
+{
+    return bo_map_common(boi, write, 1);
+}
+
 static int bo_unmap(struct radeon_bo_int *boi)
 {
+    struct bo_manager_gem *bomg = (struct bo_manager_gem*)boi->bom;
     struct radeon_bo_gem *bo_gem = (struct radeon_bo_gem*)boi;
 
     if (--bo_gem->map_count > 0) {
         return 0;
     }
-    //drm_munmap(bo->ptr, bo->size);
     boi->ptr = NULL;
+
+    /* keep the mapping for the next bo_map, the unmapped longest go first */
+    pthread_mutex_lock(&bomg->table_lock);
+    if (bo_gem->priv_ptr) {
+        DRMLISTADDTAIL(&bo_gem->map_lru, &bomg->map_lru);
+        bomg->map_lru_size += boi->size;
+        map_lru_trim(bomg);
+    }
+    pthread_mutex_unlock(&bomg->table_lock);
     return 0;
 }
 
@@ -291,6 +405,20 @@ drm_public struct radeon_bo_manager *radeon_bo_manager_gem_ctor(int fd)
     }
     bomg->base.funcs = &bo_gem_funcs;
     bomg->base.fd = fd;
+    bomg->handle_table = drmIntMapCreate();
+    bomg->name_table = drmIntMapCreate();
+    if (bomg->handle_table == NULL || bomg->name_table == NULL) {
+        if (bomg->handle_table) {
+            drmIntMapDestroy(bomg->handle_table);
+        }
+        if (bomg->name_table) {
+            drmIntMapDestroy(bomg->name_table);
+        }
+        free(bomg);
+        return NULL;
+    }
+    pthread_mutex_init(&bomg->table_lock, NULL);
+    DRMINITLISTHEAD(&bomg->map_lru);
     return (struct radeon_bo_manager*)bomg;
 }
 
@@ -301,6 +429,9 @@ drm_public void radeon_bo_manager_gem_dtor(struct radeon_bo_manager *bom)
     if (bom == NULL) {
         return;
     }
+    drmIntMapDestroy(bomg->handle_table);
+    drmIntMapDestroy(bomg->name_table);
+    pthread_mutex_destroy(&bomg->table_lock);
     free(bomg);
 }
 
@@ -318,11 +449,47 @@ radeon_gem_get_reloc_in_cs(struct radeon_bo *bo)
     return &bo_gem->reloc_in_cs;
 }
 
+static void reloc_in_cs_update(struct radeon_bo_gem *bo_gem, uint32_t id, int set)
+{
+    int old, new;
+
+    do {
+        old = atomic_read(&bo_gem->reloc_in_cs);
+        new = set ? old | id : old & ~id;
+        if (new == old)
+            return;
+    } while (atomic_cmpxchg(&bo_gem->reloc_in_cs, old, new) != old);
+}
+
+drm_private void radeon_gem_bo_add_cs(struct radeon_bo *bo, uint32_t id)
+{
+    struct radeon_bo_gem *bo_gem = (struct radeon_bo_gem*)bo;
+    unsigned i = __builtin_ctz(id);
+
+    if (__atomic_add_fetch(&bo_gem->cs_users[i], 1, __ATOMIC_ACQ_REL) == 1)
+        reloc_in_cs_update(bo_gem, id, 1);
+}
+
+drm_private void radeon_gem_bo_del_cs(struct radeon_bo *bo, uint32_t id)
+{
+    struct radeon_bo_gem *bo_gem = (struct radeon_bo_gem*)bo;
+    unsigned i = __builtin_ctz(id);
+
+    if (__atomic_sub_fetch(&bo_gem->cs_users[i], 1, __ATOMIC_ACQ_REL))
+        return;
+    reloc_in_cs_update(bo_gem, id, 0);
+    /* another CS with this id may have picked the bo up before the bit
+     * was cleared; at worst this leaves the bit set a while too long */
+    if (__atomic_load_n(&bo_gem->cs_users[i], __ATOMIC_ACQUIRE))
+        reloc_in_cs_update(bo_gem, id, 1);
+}
+
 drm_public int
 radeon_gem_get_kernel_name(struct radeon_bo *bo, uint32_t *name)
 {
     struct radeon_bo_gem *bo_gem = (struct radeon_bo_gem*)bo;
     struct radeon_bo_int *boi = (struct radeon_bo_int *)bo;
+    struct bo_manager_gem *bomg;
     struct drm_gem_flink flink;
     int r;
 
@@ -335,11 +502,25 @@ radeon_gem_get_kernel_name(struct radeon_bo *bo, uint32_t *name)
     if (r) {
         return r;
     }
+    bomg = (struct bo_manager_gem*)boi->bom;
+    pthread_mutex_lock(&bomg->table_lock);
     bo_gem->name = flink.name;
+    drmIntMapInsert(bomg->name_table, flink.name, bo_gem);
+    pthread_mutex_unlock(&bomg->table_lock);
     *name = flink.name;
     return 0;
 }
 
+/* Map without waiting for the gpu to be done with the bo, for callers that
+ * only touch ranges they know to be idle (e.g. streaming uploads). Unmap
+ * with radeon_bo_unmap() as usual.
+ */
+drm_public int
+radeon_gem_bo_map_unsynchronized(struct radeon_bo *bo, int write)
+{
+    return bo_map_common((struct radeon_bo_int *)bo, write, 0);
+}
+
 drm_public int
 radeon_gem_set_domain(struct radeon_bo *bo, uint32_t read_domains, uint32_t write_domain)
 {
@@ -370,10 +551,25 @@ drm_public int radeon_gem_prime_share_bo(struct radeon_bo *bo, int *handle)
 drm_public struct radeon_bo *
 radeon_gem_bo_open_prime(struct radeon_bo_manager *bom, int fd_handle, uint32_t size)
 {
+    struct bo_manager_gem *bomg = (struct bo_manager_gem*)bom;
     struct radeon_bo_gem *bo;
+    struct radeon_bo *old;
     int r;
     uint32_t handle;
 
+    /* the kernel hands out the same handle for a buffer it has seen */
+    r = drmPrimeFDToHandleCached(bom->fd, fd_handle, &handle, NULL);
+    if (r != 0) {
+	return NULL;
+    }
+
+    pthread_mutex_lock(&bomg->table_lock);
+    old = bo_lookup(bomg->handle_table, handle);
+    pthread_mutex_unlock(&bomg->table_lock);
+    if (old) {
+        return old;
+    }
+
     bo = (struct radeon_bo_gem*)calloc(1, sizeof(struct radeon_bo_gem));
     if (bo == NULL) {
         return NULL;
@@ -388,17 +584,16 @@ radeon_gem_bo_open_prime(struct radeon_bo_manager *bom, int fd_handle, uint32_t
     bo->base.ptr = NULL;
     atomic_set(&bo->reloc_in_cs, 0);
     bo->map_count = 0;
-
-    r = drmPrimeFDToHandle(bom->fd, fd_handle, &handle);
-    if (r != 0) {
-	free(bo);
-	return NULL;
-    }
+    DRMINITLISTHEAD(&bo->map_lru);
 
     bo->base.handle = handle;
     bo->name = handle;
 
     radeon_bo_ref((struct radeon_bo *)bo);
+
+    pthread_mutex_lock(&bomg->table_lock);
+    drmIntMapInsert(bomg->handle_table, handle, bo);
+    pthread_mutex_unlock(&bomg->table_lock);
     return (struct radeon_bo *)bo;
 
 }
@@ -39,6 +39,7 @@ void radeon_bo_manager_gem_dtor(struct radeon_bo_manager *bom);
 
 uint32_t radeon_gem_name_bo(struct radeon_bo *bo);
 void *radeon_gem_get_reloc_in_cs(struct radeon_bo *bo);
+int radeon_gem_bo_map_unsynchronized(struct radeon_bo *bo, int write);
 int radeon_gem_set_domain(struct radeon_bo *bo, uint32_t read_domains, uint32_t write_domain);
 int radeon_gem_get_kernel_name(struct radeon_bo *bo, uint32_t *name);
 int radeon_gem_prime_share_bo(struct radeon_bo *bo, int *handle);
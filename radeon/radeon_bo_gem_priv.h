@@ -0,0 +1,37 @@
+/*
+ * Copyright © 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sub license, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NON-INFRINGEMENT. IN NO EVENT SHALL THE COPYRIGHT HOLDERS, AUTHORS
+ * AND/OR ITS SUPPLIERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE
+ * USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * The above copyright notice and this permission notice (including the
+ * next paragraph) shall be included in all copies or substantial portions
+ * of the Software.
+ */
+#ifndef RADEON_BO_GEM_PRIV_H
+#define RADEON_BO_GEM_PRIV_H
+
+#include "libdrm_macros.h"
+#include "radeon_bo.h"
+
+/* Track a CS with the given id bit referencing bo in its reloc_in_cs
+ * mask. Several CS may share an id, the bit stays set until the last of
+ * them is done with the bo. */
+drm_private void radeon_gem_bo_add_cs(struct radeon_bo *bo, uint32_t id);
+drm_private void radeon_gem_bo_del_cs(struct radeon_bo *bo, uint32_t id);
+
+#endif
@@ -46,6 +46,27 @@ drm_public int radeon_cs_emit(struct radeon_cs *cs)
     return csi->csm->funcs->cs_emit(csi);
 }
 
+drm_public int radeon_cs_emit_async(struct radeon_cs *cs)
+{
+    struct radeon_cs_int *csi = (struct radeon_cs_int *)cs;
+    int r;
+
+    if (csi->csm->funcs->cs_emit_async)
+        return csi->csm->funcs->cs_emit_async(csi);
+    r = csi->csm->funcs->cs_emit(csi);
+    csi->csm->funcs->cs_erase(csi);
+    return r;
+}
+
+drm_public int radeon_cs_emit_wait(struct radeon_cs *cs)
+{
+    struct radeon_cs_int *csi = (struct radeon_cs_int *)cs;
+
+    if (!csi->csm->funcs->cs_emit_wait)
+        return 0;
+    return csi->csm->funcs->cs_emit_wait(csi);
+}
+
 drm_public int radeon_cs_destroy(struct radeon_cs *cs)
 {
     struct radeon_cs_int *csi = (struct radeon_cs_int *)cs;
@@ -74,6 +74,14 @@ extern int radeon_cs_end(struct radeon_cs *cs,
                          const char *func,
                          int line);
 extern int radeon_cs_emit(struct radeon_cs *cs);
+/*
+ * Hand the CS over to a submission thread and return it empty, ready to
+ * record the next one while the kernel parses this one.  No erase is
+ * needed afterwards.  Returns the result of the previous asynchronous
+ * emission, radeon_cs_emit_wait() waits for the last one.
+ */
+extern int radeon_cs_emit_async(struct radeon_cs *cs);
+extern int radeon_cs_emit_wait(struct radeon_cs *cs);
 extern int radeon_cs_destroy(struct radeon_cs *cs);
 extern int radeon_cs_erase(struct radeon_cs *cs);
 extern int radeon_cs_need_flush(struct radeon_cs *cs);
@@ -40,22 +40,36 @@
 #include "radeon_bo_int.h"
 #include "radeon_cs_gem.h"
 #include "radeon_bo_gem.h"
+#include "radeon_bo_gem_priv.h"
 #include "drm.h"
 #include "libdrm_macros.h"
 #include "xf86drm.h"
 #include "xf86atomic.h"
 #include "radeon_drm.h"
 
-/* Add LIBDRM_RADEON_BOF_FILES to libdrm_radeon_la_SOURCES when building with BOF_DUMP */
+/* Add LIBDRM_RADEON_BOF_FILES to libdrm_radeon_la_SOURCES when building with BOF_DUMP.
+ * 1 writes one file per CS, 2 streams every CS into one capture file and
+ * stores each distinct bo content only once. */
 #define CS_BOF_DUMP 0
 #if CS_BOF_DUMP
 #include "bof.h"
 #endif
 
+#define CS_POOL_MAX 4
+
+struct cs_gem;
+
 struct radeon_cs_manager_gem {
     struct radeon_cs_manager    base;
     uint32_t                    device_id;
     unsigned                    nbof;
+#if CS_BOF_DUMP == 2
+    bof_stream_t                *bof_stream;
+#endif
+    /* destroyed CS kept with their buffers for the next cs_gem_create() */
+    pthread_mutex_t             pool_lock;
+    struct cs_gem               *pool[CS_POOL_MAX];
+    unsigned                    pool_count;
 };
 
 #pragma pack(1)
@@ -69,45 +83,57 @@ struct cs_reloc_gem {
 #pragma pack()
 #define RELOC_SIZE (sizeof(struct cs_reloc_gem) / sizeof(uint32_t))
 
+struct cs_gem_async;
+
 struct cs_gem {
     struct radeon_cs_int        base;
     struct drm_radeon_cs        cs;
     struct drm_radeon_cs_chunk  chunks[2];
+    uint64_t                    chunk_array[2];
     unsigned                    nrelocs;
     uint32_t                    *relocs;
     struct radeon_bo_int        **relocs_bo;
+    /* open addressing table of relocs by handle, holding the reloc
+     * index + 1 in each slot and 0 in free ones; kept below half full */
+    uint32_t                    *reloc_hash;
+    unsigned                    reloc_hash_size;
+    /* set up by the first cs_gem_emit_async() */
+    struct cs_gem_async         *async;
 };
 
-static pthread_mutex_t id_mutex = PTHREAD_MUTEX_INITIALIZER;
-static uint32_t cs_id_source = 0;
+/* A submission thread and the second set of CS buffers it submits from,
+ * swapped with the recording ones on each asynchronous emission. */
+struct cs_gem_async {
+    pthread_t                   thread;
+    pthread_mutex_t             lock;
+    pthread_cond_t              cond;
+    struct cs_gem               *shadow;
+    int                         busy;
+    int                         quit;
+    int                         result;
+};
 
-/**
- * result is undefined if called with ~0
- */
-static uint32_t get_first_zero(const uint32_t n)
-{
-    /* __builtin_ctz returns number of trailing zeros. */
-    return 1 << __builtin_ctz(~n);
-}
+static pthread_mutex_t id_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* number of CS holding each id bit */
+static unsigned cs_id_users[32];
 
 /**
- * Returns a free id for cs.
- * If there is no free id we return zero
+ * Returns an id bit for cs, the least used one.
+ * Past 32 CS ids are shared, which only makes reloc_in_cs report a bo
+ * as referenced by a CS that shares the id with the one really using it.
  **/
 static uint32_t generate_id(void)
 {
-    uint32_t r = 0;
-    pthread_mutex_lock( &id_mutex );
-    /* check for free ids */
-    if (cs_id_source != ~r) {
-        /* find first zero bit */
-        r = get_first_zero(cs_id_source);
+    unsigned i, best = 0;
 
-        /* set id as reserved */
-        cs_id_source |= r;
+    pthread_mutex_lock( &id_mutex );
+    for (i = 1; i < 32 && cs_id_users[best]; i++) {
+        if (cs_id_users[i] < cs_id_users[best])
+            best = i;
     }
+    cs_id_users[best]++;
     pthread_mutex_unlock( &id_mutex );
-    return r;
+    return 1u << best;
 }
 
 /**
@@ -115,22 +141,84 @@ static uint32_t generate_id(void)
  **/
 static void free_id(uint32_t id)
 {
+    if (id == 0)
+        return;
     pthread_mutex_lock( &id_mutex );
 
-    cs_id_source &= ~id;
+    cs_id_users[__builtin_ctz(id)]--;
 
     pthread_mutex_unlock( &id_mutex );
 }
 
+static unsigned cs_gem_reloc_hash_slot(struct cs_gem *csg, uint32_t handle)
+{
+    unsigned mask = csg->reloc_hash_size - 1;
+    unsigned slot = (handle * 0x9e3779b1) & mask;
+
+    for (;;) {
+        uint32_t i = csg->reloc_hash[slot];
+        if (i == 0 || csg->relocs[(i - 1) * RELOC_SIZE] == handle)
+            return slot;
+        slot = (slot + 1) & mask;
+    }
+}
+
+/**
+ * Returns the index of the reloc for handle, or -1 if there is none.
+ */
+static int cs_gem_reloc_hash_find(struct cs_gem *csg, uint32_t handle)
+{
+    return (int)csg->reloc_hash[cs_gem_reloc_hash_slot(csg, handle)] - 1;
+}
+
+/**
+ * Make room in the table for one more reloc, doubling it and rehashing
+ * the existing relocs when it would get more than half full.
+ */
+static int cs_gem_reloc_hash_reserve(struct cs_gem *csg)
+{
+    uint32_t *old = csg->reloc_hash;
+    unsigned i;
+
+    if ((csg->base.crelocs + 1) * 2 <= csg->reloc_hash_size)
+        return 0;
+
+    csg->reloc_hash = (uint32_t*)calloc(csg->reloc_hash_size * 2,
+                                        sizeof(uint32_t));
+    if (csg->reloc_hash == NULL) {
+        csg->reloc_hash = old;
+        return -ENOMEM;
+    }
+    csg->reloc_hash_size *= 2;
+    free(old);
+    for (i = 0; i < csg->base.crelocs; i++) {
+        uint32_t handle = csg->relocs[i * RELOC_SIZE];
+        csg->reloc_hash[cs_gem_reloc_hash_slot(csg, handle)] = i + 1;
+    }
+    return 0;
+}
+
 static struct radeon_cs_int *cs_gem_create(struct radeon_cs_manager *csm,
                                        uint32_t ndw)
 {
-    struct cs_gem *csg;
+    struct radeon_cs_manager_gem *csm_gem = (struct radeon_cs_manager_gem*)csm;
+    struct cs_gem *csg = NULL;
 
     /* max cmd buffer size is 64Kb */
     if (ndw > (64 * 1024 / 4)) {
         return NULL;
     }
+
+    /* pooled CS come back empty with their grown buffers */
+    pthread_mutex_lock(&csm_gem->pool_lock);
+    if (csm_gem->pool_count)
+        csg = csm_gem->pool[--csm_gem->pool_count];
+    pthread_mutex_unlock(&csm_gem->pool_lock);
+    if (csg) {
+        csg->base.id = generate_id();
+        return &csg->base;
+    }
+
     csg = (struct cs_gem*)calloc(1, sizeof(struct cs_gem));
     if (csg == NULL) {
         return NULL;
@@ -160,6 +248,16 @@ static struct radeon_cs_int *cs_gem_create(struct radeon_cs_manager *csm,
         free(csg);
         return NULL;
     }
+    csg->reloc_hash_size = csg->nrelocs * 2;
+    csg->reloc_hash = (uint32_t*)calloc(csg->reloc_hash_size,
+                                        sizeof(uint32_t));
+    if (csg->reloc_hash == NULL) {
+        free(csg->relocs);
+        free(csg->relocs_bo);
+        free(csg->base.packets);
+        free(csg);
+        return NULL;
+    }
     csg->chunks[0].chunk_id = RADEON_CHUNK_ID_IB;
     csg->chunks[0].length_dw = 0;
     csg->chunks[0].chunk_data = (uint64_t)(uintptr_t)csg->base.packets;
@@ -179,7 +277,7 @@ static int cs_gem_write_reloc(struct radeon_cs_int *cs,
     struct cs_gem *csg = (struct cs_gem*)cs;
     struct cs_reloc_gem *reloc;
     uint32_t idx;
-    unsigned i;
+    int i;
 
     assert(boi->space_accounted);
 
@@ -196,48 +294,43 @@ static int cs_gem_write_reloc(struct radeon_cs_int *cs,
     if (write_domain == RADEON_GEM_DOMAIN_CPU) {
         return -EINVAL;
     }
-    /* use bit field hash function to determine
-       if this bo is for sure not in this cs.*/
-    if ((atomic_read((atomic_t *)radeon_gem_get_reloc_in_cs(bo)) & cs->id)) {
-        /* check if bo is already referenced.
-         * Scanning from end to begin reduces cycles with mesa because
-         * it often relocates same shared dma bo again. */
-        for(i = cs->crelocs; i != 0;) {
-            --i;
-            idx = i * RELOC_SIZE;
-            reloc = (struct cs_reloc_gem*)&csg->relocs[idx];
-            if (reloc->handle == bo->handle) {
-                /* Check domains must be in read or write. As we check already
-                 * checked that in argument one of the read or write domain was
-                 * set we only need to check that if previous reloc as the read
-                 * domain set then the read_domain should also be set for this
-                 * new relocation.
-                 */
-                /* the DDX expects to read and write from same pixmap */
-                if (write_domain && (reloc->read_domain & write_domain)) {
-                    reloc->read_domain = 0;
-                    reloc->write_domain = write_domain;
-                } else if (read_domain & reloc->write_domain) {
-                    reloc->read_domain = 0;
-                } else {
-                    if (write_domain != reloc->write_domain)
-                        return -EINVAL;
-                    if (read_domain != reloc->read_domain)
-                        return -EINVAL;
-                }
-
-                reloc->read_domain |= read_domain;
-                reloc->write_domain |= write_domain;
-                /* update flags */
-                reloc->flags |= (flags & reloc->flags);
-                /* write relocation packet */
-                radeon_cs_write_dword((struct radeon_cs *)cs, 0xc0001000);
-                radeon_cs_write_dword((struct radeon_cs *)cs, idx);
-                return 0;
-            }
+    /* check if bo is already referenced */
+    i = cs_gem_reloc_hash_find(csg, bo->handle);
+    if (i >= 0) {
+        idx = i * RELOC_SIZE;
+        reloc = (struct cs_reloc_gem*)&csg->relocs[idx];
+        /* Check domains must be in read or write. As we check already
+         * checked that in argument one of the read or write domain was
+         * set we only need to check that if previous reloc as the read
+         * domain set then the read_domain should also be set for this
+         * new relocation.
+         */
+        /* the DDX expects to read and write from same pixmap */
+        if (write_domain && (reloc->read_domain & write_domain)) {
+            reloc->read_domain = 0;
+            reloc->write_domain = write_domain;
+        } else if (read_domain & reloc->write_domain) {
+            reloc->read_domain = 0;
+        } else {
+            if (write_domain != reloc->write_domain)
+                return -EINVAL;
+            if (read_domain != reloc->read_domain)
+                return -EINVAL;
         }
+
+        reloc->read_domain |= read_domain;
+        reloc->write_domain |= write_domain;
+        /* update flags */
+        reloc->flags |= (flags & reloc->flags);
+        /* write relocation packet */
+        radeon_cs_write_dword((struct radeon_cs *)cs, 0xc0001000);
+        radeon_cs_write_dword((struct radeon_cs *)cs, idx);
+        return 0;
     }
     /* new relocation */
+    if (cs_gem_reloc_hash_reserve(csg)) {
+        return -ENOMEM;
+    }
     if (csg->base.crelocs >= csg->nrelocs) {
         /* allocate more memory (TODO: should use a slab allocator maybe) */
         uint32_t *tmp, size;
@@ -259,14 +352,16 @@ static int cs_gem_write_reloc(struct radeon_cs_int *cs,
     csg->relocs_bo[csg->base.crelocs] = boi;
     idx = (csg->base.crelocs++) * RELOC_SIZE;
     reloc = (struct cs_reloc_gem*)&csg->relocs[idx];
+    csg->reloc_hash[cs_gem_reloc_hash_slot(csg, bo->handle)] =
+        csg->base.crelocs;
     reloc->handle = bo->handle;
     reloc->read_domain = read_domain;
     reloc->write_domain = write_domain;
     reloc->flags = flags;
     csg->chunks[1].length_dw += RELOC_SIZE;
     radeon_bo_ref(bo);
-    /* bo might be referenced from another context so have to use atomic operations */
-    atomic_add((atomic_t *)radeon_gem_get_reloc_in_cs(bo), cs->id);
+    /* bo might be referenced from another context */
+    radeon_gem_bo_add_cs(bo, cs->id);
     cs->relocs_total_size += boi->size;
     radeon_cs_write_dword((struct radeon_cs *)cs, 0xc0001000);
     radeon_cs_write_dword((struct radeon_cs *)cs, idx);
@@ -333,7 +428,79 @@ static int cs_gem_end(struct radeon_cs_int *cs,
     return 0;
 }
 
-#if CS_BOF_DUMP
+#if CS_BOF_DUMP == 2
+static int cs_gem_stream_bo(bof_stream_t *stream, struct radeon_bo_int *boi)
+{
+    int64_t start;
+    int n, r;
+
+    start = bof_stream_begin(stream, BOF_TYPE_OBJECT);
+    if (start < 0)
+        return start;
+    if ((r = bof_stream_string(stream, "size")) ||
+        (r = bof_stream_int32(stream, boi->size)) ||
+        (r = bof_stream_string(stream, "handle")) ||
+        (r = bof_stream_int32(stream, boi->handle)))
+        return r;
+    r = radeon_bo_map((struct radeon_bo*)boi, 0);
+    if (r)
+        return r;
+    n = bof_stream_shared_blob(stream, boi->size, boi->ptr);
+    radeon_bo_unmap((struct radeon_bo*)boi);
+    if (n < 0)
+        return n;
+    return bof_stream_end(stream, start, 4 + n);
+}
+
+/* Append the CS to the capture file as it is emitted, writing out only
+ * the bo contents the capture has not seen before. */
+static void cs_gem_dump_bof(struct radeon_cs_int *cs)
+{
+    struct cs_gem *csg = (struct cs_gem*)cs;
+    struct radeon_cs_manager_gem *csm;
+    bof_stream_t *stream;
+    int64_t start, array;
+    char tmp[256];
+    unsigned i;
+    int r;
+
+    csm = (struct radeon_cs_manager_gem *)cs->csm;
+    if (csm->bof_stream == NULL) {
+        sprintf(tmp, "d-0x%04X-stream.bof", csm->device_id);
+        csm->bof_stream = bof_stream_open(tmp);
+        if (csm->bof_stream == NULL)
+            return;
+    }
+    stream = csm->bof_stream;
+
+    start = bof_stream_begin(stream, BOF_TYPE_OBJECT);
+    if (start < 0)
+        return;
+    if ((r = bof_stream_string(stream, "device_id")) ||
+        (r = bof_stream_int32(stream, csm->device_id)) ||
+        (r = bof_stream_string(stream, "reloc")) ||
+        (r = bof_stream_blob(stream, cs->crelocs * RELOC_SIZE * 4, csg->relocs)) ||
+        (r = bof_stream_string(stream, "pm4")) ||
+        (r = bof_stream_blob(stream, cs->cdw * 4, cs->packets)) ||
+        (r = bof_stream_string(stream, "bo")))
+        goto out_err;
+    array = bof_stream_begin(stream, BOF_TYPE_ARRAY);
+    if (array < 0)
+        goto out_err;
+    for (i = 0; i < csg->base.crelocs; i++) {
+        r = cs_gem_stream_bo(stream, csg->relocs_bo[i]);
+        if (r)
+            goto out_err;
+    }
+    if (bof_stream_end(stream, array, csg->base.crelocs) ||
+        bof_stream_end(stream, start, 8))
+        goto out_err;
+    csm->nbof++;
+    return;
+out_err:
+    bof_stream_abort(stream, start);
+}
+#elif CS_BOF_DUMP
 static void cs_gem_dump_bof(struct radeon_cs_int *cs)
 {
     struct cs_gem *csg = (struct cs_gem*)cs;
@@ -421,6 +588,30 @@ out_err:
 }
 #endif
 
+static int cs_gem_async_wait(struct cs_gem *csg);
+static int cs_gem_destroy(struct radeon_cs_int *cs);
+static int cs_gem_erase(struct radeon_cs_int *cs);
+
+/* Does the CS ioctl of csg, reporting it to drmSubmitTraceBegin()/End(). */
+static int cs_gem_submit(struct cs_gem *csg)
+{
+    drmSubmitTrace trace = {
+        .name = "radeon_cs_emit",
+        .fd = csg->base.csm->fd,
+        .num_bos = csg->base.crelocs,
+        .cmd_bytes = csg->base.cdw * 4,
+    };
+    int r;
+
+    drmSubmitTraceBegin(&trace);
+    r = drmCommandWriteRead(csg->base.csm->fd, DRM_RADEON_CS,
+                            &csg->cs, sizeof(struct drm_radeon_cs));
+    /* radeon has no fence ids, the CS ioctl only reports errors */
+    trace.ret = r;
+    drmSubmitTraceEnd(&trace);
+    return r;
+}
+
 static int cs_gem_emit(struct radeon_cs_int *cs)
 {
     struct cs_gem *csg = (struct cs_gem*)cs;
@@ -428,6 +619,9 @@ static int cs_gem_emit(struct radeon_cs_int *cs)
     unsigned i;
     int r;
 
+    /* keep submissions in order */
+    cs_gem_async_wait(csg);
+
     while (cs->cdw & 7)
 	radeon_cs_write_dword((struct radeon_cs *)cs, 0x80000000);
 
@@ -442,12 +636,11 @@ static int cs_gem_emit(struct radeon_cs_int *cs)
     csg->cs.num_chunks = 2;
     csg->cs.chunks = (uint64_t)(uintptr_t)chunk_array;
 
-    r = drmCommandWriteRead(cs->csm->fd, DRM_RADEON_CS,
-                            &csg->cs, sizeof(struct drm_radeon_cs));
+    r = cs_gem_submit(csg);
     for (i = 0; i < csg->base.crelocs; i++) {
         csg->relocs_bo[i]->space_accounted = 0;
-        /* bo might be referenced from another context so have to use atomic operations */
-        atomic_dec((atomic_t *)radeon_gem_get_reloc_in_cs((struct radeon_bo*)csg->relocs_bo[i]), cs->id);
+        /* bo might be referenced from another context */
+        radeon_gem_bo_del_cs((struct radeon_bo*)csg->relocs_bo[i], cs->id);
         radeon_bo_unref((struct radeon_bo *)csg->relocs_bo[i]);
         csg->relocs_bo[i] = NULL;
     }
@@ -455,18 +648,247 @@ static int cs_gem_emit(struct radeon_cs_int *cs)
     cs->csm->read_used = 0;
     cs->csm->vram_write_used = 0;
     cs->csm->gart_write_used = 0;
+    cs->csm->space_epoch++;
+    return r;
+}
+
+static void *cs_gem_submit_thread(void *data)
+{
+    struct cs_gem_async *async = data;
+    struct cs_gem *shadow = async->shadow;
+    int r;
+
+    pthread_mutex_lock(&async->lock);
+    for (;;) {
+        if (async->busy) {
+            pthread_mutex_unlock(&async->lock);
+            r = cs_gem_submit(shadow);
+            pthread_mutex_lock(&async->lock);
+            async->result = r;
+            async->busy = 0;
+            pthread_cond_broadcast(&async->cond);
+        } else if (async->quit) {
+            break;
+        } else {
+            pthread_cond_wait(&async->cond, &async->lock);
+        }
+    }
+    pthread_mutex_unlock(&async->lock);
+    return NULL;
+}
+
+/**
+ * Wait for the asynchronous submission in flight, if any, and drop the
+ * references its relocations hold.  Returns its result.
+ */
+static int cs_gem_async_wait(struct cs_gem *csg)
+{
+    struct cs_gem_async *async = csg->async;
+    struct cs_gem *shadow;
+    unsigned i;
+    int r;
+
+    if (async == NULL) {
+        return 0;
+    }
+    pthread_mutex_lock(&async->lock);
+    while (async->busy) {
+        pthread_cond_wait(&async->cond, &async->lock);
+    }
+    r = async->result;
+    async->result = 0;
+    pthread_mutex_unlock(&async->lock);
+
+    /* unref here rather than in the thread, bo refcounts are not atomic */
+    shadow = async->shadow;
+    for (i = 0; i < shadow->base.crelocs; i++) {
+        radeon_bo_unref((struct radeon_bo *)shadow->relocs_bo[i]);
+        shadow->relocs_bo[i] = NULL;
+    }
+    if (shadow->base.crelocs) {
+        memset(shadow->reloc_hash, 0,
+               shadow->reloc_hash_size * sizeof(uint32_t));
+    }
+    shadow->base.relocs_total_size = 0;
+    shadow->base.cdw = 0;
+    shadow->base.crelocs = 0;
+    shadow->chunks[0].length_dw = 0;
+    shadow->chunks[1].length_dw = 0;
+    return r;
+}
+
+static int cs_gem_async_init(struct cs_gem *csg)
+{
+    struct cs_gem_async *async;
+
+    async = calloc(1, sizeof(struct cs_gem_async));
+    if (async == NULL) {
+        return -ENOMEM;
+    }
+    async->shadow = (struct cs_gem*)cs_gem_create(csg->base.csm, 0);
+    if (async->shadow == NULL) {
+        free(async);
+        return -ENOMEM;
+    }
+    /* only recording CS need an id */
+    free_id(async->shadow->base.id);
+    async->shadow->base.id = 0;
+    pthread_mutex_init(&async->lock, NULL);
+    pthread_cond_init(&async->cond, NULL);
+    if (pthread_create(&async->thread, NULL, cs_gem_submit_thread, async)) {
+        pthread_cond_destroy(&async->cond);
+        pthread_mutex_destroy(&async->lock);
+        cs_gem_destroy(&async->shadow->base);
+        free(async);
+        return -EAGAIN;
+    }
+    csg->async = async;
+    return 0;
+}
+
+/* exchange the recording buffers of a and b */
+static void cs_gem_swap_buffers(struct cs_gem *a, struct cs_gem *b)
+{
+    struct drm_radeon_cs_chunk chunks[2];
+    struct radeon_bo_int **relocs_bo;
+    uint32_t *ptr;
+    unsigned n;
+
+    ptr = a->base.packets; a->base.packets = b->base.packets; b->base.packets = ptr;
+    n = a->base.cdw; a->base.cdw = b->base.cdw; b->base.cdw = n;
+    n = a->base.ndw; a->base.ndw = b->base.ndw; b->base.ndw = n;
+    n = a->base.crelocs; a->base.crelocs = b->base.crelocs; b->base.crelocs = n;
+    n = a->base.relocs_total_size;
+    a->base.relocs_total_size = b->base.relocs_total_size;
+    b->base.relocs_total_size = n;
+    ptr = a->relocs; a->relocs = b->relocs; b->relocs = ptr;
+    a->base.relocs = a->relocs;
+    b->base.relocs = b->relocs;
+    relocs_bo = a->relocs_bo; a->relocs_bo = b->relocs_bo; b->relocs_bo = relocs_bo;
+    n = a->nrelocs; a->nrelocs = b->nrelocs; b->nrelocs = n;
+    ptr = a->reloc_hash; a->reloc_hash = b->reloc_hash; b->reloc_hash = ptr;
+    n = a->reloc_hash_size; a->reloc_hash_size = b->reloc_hash_size;
+    b->reloc_hash_size = n;
+    memcpy(chunks, a->chunks, sizeof(chunks));
+    memcpy(a->chunks, b->chunks, sizeof(chunks));
+    memcpy(b->chunks, chunks, sizeof(chunks));
+}
+
+static int cs_gem_emit_async(struct radeon_cs_int *cs)
+{
+    struct cs_gem *csg = (struct cs_gem*)cs;
+    struct cs_gem *shadow;
+    unsigned i;
+    int r;
+
+    if (csg->async == NULL && cs_gem_async_init(csg)) {
+        r = cs_gem_emit(cs);
+        cs_gem_erase(cs);
+        return r;
+    }
+
+    /* ping-pong: the other buffers must be back before they are reused */
+    r = cs_gem_async_wait(csg);
+
+    while (cs->cdw & 7)
+	radeon_cs_write_dword((struct radeon_cs *)cs, 0x80000000);
+
+#if CS_BOF_DUMP
+    cs_gem_dump_bof(cs);
+#endif
+    csg->chunks[0].length_dw = cs->cdw;
+
+    /* the next CS starts accounting afresh, as after cs_gem_emit() */
+    for (i = 0; i < csg->base.crelocs; i++) {
+        csg->relocs_bo[i]->space_accounted = 0;
+        /* bo might be referenced from another context */
+        radeon_gem_bo_del_cs((struct radeon_bo*)csg->relocs_bo[i], cs->id);
+    }
+    cs->csm->read_used = 0;
+    cs->csm->vram_write_used = 0;
+    cs->csm->gart_write_used = 0;
+    cs->csm->space_epoch++;
+
+    shadow = csg->async->shadow;
+    cs_gem_swap_buffers(csg, shadow);
+    cs->section_ndw = 0;
+
+    shadow->chunk_array[0] = (uint64_t)(uintptr_t)&shadow->chunks[0];
+    shadow->chunk_array[1] = (uint64_t)(uintptr_t)&shadow->chunks[1];
+    shadow->cs.num_chunks = 2;
+    shadow->cs.chunks = (uint64_t)(uintptr_t)shadow->chunk_array;
+
+    pthread_mutex_lock(&csg->async->lock);
+    csg->async->busy = 1;
+    pthread_cond_broadcast(&csg->async->cond);
+    pthread_mutex_unlock(&csg->async->lock);
+    return r;
+}
+
+static int cs_gem_emit_wait(struct radeon_cs_int *cs)
+{
+    return cs_gem_async_wait((struct cs_gem*)cs);
+}
+
+static void cs_gem_free(struct cs_gem *csg)
+{
+    free(csg->reloc_hash);
+    free(csg->relocs_bo);
+    free(csg->relocs);
+    free(csg->base.packets);
+    free(csg);
+}
+
+/* Keep an empty CS for reuse, returns 0 if the pool won't take it. */
+static int cs_gem_pool_put(struct cs_gem *csg)
+{
+    struct radeon_cs_manager_gem *csm = (struct radeon_cs_manager_gem*)csg->base.csm;
+    struct radeon_cs_int *cs = &csg->base;
+    int r = 0;
+
+    /* whatever still holds bo references goes the normal way */
+    if (cs->crelocs || cs->bo_count) {
+        return 0;
+    }
+    cs_gem_erase(cs);
+    cs->bo_count_checked = 0;
+    cs->space_epoch = 0;
+    cs->space_flush_fn = NULL;
+    cs->space_flush_data = NULL;
+
+    pthread_mutex_lock(&csm->pool_lock);
+    if (csm->pool_count < CS_POOL_MAX) {
+        csm->pool[csm->pool_count++] = csg;
+        r = 1;
+    }
+    pthread_mutex_unlock(&csm->pool_lock);
     return r;
 }
 
 static int cs_gem_destroy(struct radeon_cs_int *cs)
 {
     struct cs_gem *csg = (struct cs_gem*)cs;
+    struct cs_gem_async *async = csg->async;
+
+    if (async) {
+        cs_gem_async_wait(csg);
+        pthread_mutex_lock(&async->lock);
+        async->quit = 1;
+        pthread_cond_broadcast(&async->cond);
+        pthread_mutex_unlock(&async->lock);
+        pthread_join(async->thread, NULL);
+        pthread_cond_destroy(&async->cond);
+        pthread_mutex_destroy(&async->lock);
+        cs_gem_destroy(&async->shadow->base);
+        free(async);
+        csg->async = NULL;
+    }
 
     free_id(cs->id);
-    free(csg->relocs_bo);
-    free(cs->relocs);
-    free(cs->packets);
-    free(cs);
+    cs->id = 0;
+    if (!cs_gem_pool_put(csg)) {
+        cs_gem_free(csg);
+    }
     return 0;
 }
 
@@ -478,13 +900,14 @@ static int cs_gem_erase(struct radeon_cs_int *cs)
     if (csg->relocs_bo) {
         for (i = 0; i < csg->base.crelocs; i++) {
             if (csg->relocs_bo[i]) {
-                /* bo might be referenced from another context so have to use atomic operations */
-                atomic_dec((atomic_t *)radeon_gem_get_reloc_in_cs((struct radeon_bo*)csg->relocs_bo[i]), cs->id);
+                /* bo might be referenced from another context */
+                radeon_gem_bo_del_cs((struct radeon_bo*)csg->relocs_bo[i], cs->id);
                 radeon_bo_unref((struct radeon_bo *)csg->relocs_bo[i]);
                 csg->relocs_bo[i] = NULL;
             }
         }
     }
+    memset(csg->reloc_hash, 0, csg->reloc_hash_size * sizeof(uint32_t));
     cs->relocs_total_size = 0;
     cs->cdw = 0;
     cs->section_ndw = 0;
@@ -517,6 +940,8 @@ static const struct radeon_cs_funcs radeon_cs_gem_funcs = {
     .cs_begin = cs_gem_begin,
     .cs_end = cs_gem_end,
     .cs_emit = cs_gem_emit,
+    .cs_emit_async = cs_gem_emit_async,
+    .cs_emit_wait = cs_gem_emit_wait,
     .cs_destroy = cs_gem_destroy,
     .cs_erase = cs_gem_erase,
     .cs_need_flush = cs_gem_need_flush,
@@ -546,11 +971,24 @@ drm_public struct radeon_cs_manager *radeon_cs_manager_gem_ctor(int fd)
     }
     csm->base.funcs = &radeon_cs_gem_funcs;
     csm->base.fd = fd;
+    pthread_mutex_init(&csm->pool_lock, NULL);
     radeon_get_device_id(fd, &csm->device_id);
     return &csm->base;
 }
 
 drm_public void radeon_cs_manager_gem_dtor(struct radeon_cs_manager *csm)
 {
+    struct radeon_cs_manager_gem *csm_gem = (struct radeon_cs_manager_gem *)csm;
+
+    if (csm == NULL) {
+        return;
+    }
+#if CS_BOF_DUMP == 2
+    bof_stream_close(csm_gem->bof_stream);
+#endif
+    while (csm_gem->pool_count) {
+        cs_gem_free(csm_gem->pool[--csm_gem->pool_count]);
+    }
+    pthread_mutex_destroy(&csm_gem->pool_lock);
     free(csm);
 }
@@ -26,6 +26,9 @@ struct radeon_cs_int {
     int                         section_line;
     struct radeon_cs_space_check bos[MAX_SPACE_BOS];
     int                         bo_count;
+    /* bos[] before this index are accounted as of csm->space_epoch */
+    int                         bo_count_checked;
+    uint32_t                    space_epoch;
     void                        (*space_flush_fn)(void *);
     void                        *space_flush_data;
     uint32_t                    id;
@@ -51,6 +54,8 @@ struct radeon_cs_funcs {
 
 
     int (*cs_emit)(struct radeon_cs_int *cs);
+    int (*cs_emit_async)(struct radeon_cs_int *cs);
+    int (*cs_emit_wait)(struct radeon_cs_int *cs);
     int (*cs_destroy)(struct radeon_cs_int *cs);
     int (*cs_erase)(struct radeon_cs_int *cs);
     int (*cs_need_flush)(struct radeon_cs_int *cs);
@@ -63,5 +68,7 @@ struct radeon_cs_manager {
     int32_t vram_limit, gart_limit;
     int32_t vram_write_used, gart_write_used;
     int32_t read_used;
+    /* bumped whenever the used counters and bo accounting are reset */
+    uint32_t space_epoch;
 };
 #endif
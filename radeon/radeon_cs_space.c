@@ -121,8 +121,15 @@ static int radeon_cs_do_space_check(struct radeon_cs_int *cs, struct radeon_cs_s
 
     memset(&sizes, 0, sizeof(struct rad_sizes));
 
+    /* persistent bos accounted by an earlier check only need another look
+     * once a flush has reset the accounting */
+    if (cs->space_epoch != csm->space_epoch) {
+        cs->space_epoch = csm->space_epoch;
+        cs->bo_count_checked = 0;
+    }
+
     /* prepare */
-    for (i = 0; i < cs->bo_count; i++) {
+    for (i = cs->bo_count_checked; i < cs->bo_count; i++) {
         ret = radeon_cs_setup_bo(&cs->bos[i], &sizes);
         if (ret)
             return ret;
@@ -152,10 +159,11 @@ static int radeon_cs_do_space_check(struct radeon_cs_int *cs, struct radeon_cs_s
     csm->vram_write_used += sizes.op_vram_write;
     csm->read_used += sizes.op_read;
     /* commit */
-    for (i = 0; i < cs->bo_count; i++) {
+    for (i = cs->bo_count_checked; i < cs->bo_count; i++) {
         bo = cs->bos[i].bo;
         bo->space_accounted = cs->bos[i].new_accounted;
     }
+    cs->bo_count_checked = cs->bo_count;
     if (new_tmp)
         new_tmp->bo->space_accounted = new_tmp->new_accounted;
 
@@ -245,4 +253,5 @@ drm_public void radeon_cs_space_reset_bos(struct radeon_cs *cs)
         csi->bos[i].new_accounted = 0;
     }
     csi->bo_count = 0;
+    csi->bo_count_checked = 0;
 }
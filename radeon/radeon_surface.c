@@ -29,6 +29,7 @@
 #include <stdbool.h>
 #include <assert.h>
 #include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -111,6 +112,40 @@ struct radeon_hw_info {
     uint32_t                        macrotile_mode_array[16];
 };
 
+/* the radeon_surface fields a layout is computed from */
+struct radeon_surface_key {
+    uint32_t                    npix_x;
+    uint32_t                    npix_y;
+    uint32_t                    npix_z;
+    uint32_t                    blk_w;
+    uint32_t                    blk_h;
+    uint32_t                    blk_d;
+    uint32_t                    array_size;
+    uint32_t                    last_level;
+    uint32_t                    bpe;
+    uint32_t                    nsamples;
+    uint32_t                    flags;
+    uint32_t                    bankw;
+    uint32_t                    bankh;
+    uint32_t                    mtilea;
+    uint32_t                    tile_split;
+    uint32_t                    stencil_tile_split;
+    uint64_t                    bo_size;
+    uint64_t                    bo_alignment;
+    uint64_t                    stencil_offset;
+    /* 0 for radeon_surface_init, 1 for radeon_surface_best */
+    uint32_t                    best;
+};
+
+#define RADEON_SURFACE_CACHE_SIZE 16
+
+struct radeon_surface_cache_entry {
+    struct radeon_surface_key   key;
+    struct radeon_surface       surf;
+    /* last use, 0 for an unused entry */
+    unsigned                    stamp;
+};
+
 struct radeon_surface_manager {
     int                         fd;
     uint32_t                    device_id;
@@ -118,6 +153,10 @@ struct radeon_surface_manager {
     unsigned                    family;
     hw_init_surface_t           surface_init;
     hw_best_surface_t           surface_best;
+    /* recently computed layouts, replaced least recently used first */
+    pthread_mutex_t             cache_lock;
+    unsigned                    cache_stamp;
+    struct radeon_surface_cache_entry cache[RADEON_SURFACE_CACHE_SIZE];
 };
 
 /* helper */
@@ -2418,6 +2457,7 @@ radeon_surface_manager_new(int fd)
         return NULL;
     }
     surf_man->fd = fd;
+    pthread_mutex_init(&surf_man->cache_lock, NULL);
     if (radeon_get_value(fd, RADEON_INFO_DEVICE_ID, &surf_man->device_id)) {
         goto out_err;
     }
@@ -2453,6 +2493,7 @@ radeon_surface_manager_new(int fd)
 
     return surf_man;
 out_err:
+    pthread_mutex_destroy(&surf_man->cache_lock);
     free(surf_man);
     return NULL;
 }
@@ -2460,9 +2501,88 @@ out_err:
 drm_public void
 radeon_surface_manager_free(struct radeon_surface_manager *surf_man)
 {
+    if (surf_man == NULL) {
+        return;
+    }
+    pthread_mutex_destroy(&surf_man->cache_lock);
     free(surf_man);
 }
 
+static void radeon_surface_key_init(struct radeon_surface_key *key,
+                                    const struct radeon_surface *surf,
+                                    unsigned best)
+{
+    memset(key, 0, sizeof(*key));
+    key->npix_x = surf->npix_x;
+    key->npix_y = surf->npix_y;
+    key->npix_z = surf->npix_z;
+    key->blk_w = surf->blk_w;
+    key->blk_h = surf->blk_h;
+    key->blk_d = surf->blk_d;
+    key->array_size = surf->array_size;
+    key->last_level = surf->last_level;
+    key->bpe = surf->bpe;
+    key->nsamples = surf->nsamples;
+    key->flags = surf->flags;
+    key->bankw = surf->bankw;
+    key->bankh = surf->bankh;
+    key->mtilea = surf->mtilea;
+    key->tile_split = surf->tile_split;
+    key->stencil_tile_split = surf->stencil_tile_split;
+    key->bo_size = surf->bo_size;
+    key->bo_alignment = surf->bo_alignment;
+    key->stencil_offset = surf->stencil_offset;
+    key->best = best;
+}
+
+/* Compute the layout of surf with the hw function for init or best,
+ * reusing the result of an earlier call with the same input when the
+ * manager still has it.
+ */
+static int radeon_surface_compute(struct radeon_surface_manager *surf_man,
+                                  struct radeon_surface *surf,
+                                  unsigned best)
+{
+    struct radeon_surface_cache_entry *entry, *victim;
+    struct radeon_surface_key key;
+    unsigned i;
+    int r;
+
+    radeon_surface_key_init(&key, surf, best);
+
+    pthread_mutex_lock(&surf_man->cache_lock);
+    victim = &surf_man->cache[0];
+    for (i = 0; i < RADEON_SURFACE_CACHE_SIZE; i++) {
+        entry = &surf_man->cache[i];
+        if (entry->stamp && !memcmp(&entry->key, &key, sizeof(key))) {
+            entry->stamp = ++surf_man->cache_stamp;
+            *surf = entry->surf;
+            pthread_mutex_unlock(&surf_man->cache_lock);
+            return 0;
+        }
+        if (entry->stamp < victim->stamp) {
+            victim = entry;
+        }
+    }
+    pthread_mutex_unlock(&surf_man->cache_lock);
+
+    if (best) {
+        r = surf_man->surface_best(surf_man, surf);
+    } else {
+        r = surf_man->surface_init(surf_man, surf);
+    }
+    if (r) {
+        return r;
+    }
+
+    pthread_mutex_lock(&surf_man->cache_lock);
+    victim->key = key;
+    victim->surf = *surf;
+    victim->stamp = ++surf_man->cache_stamp;
+    pthread_mutex_unlock(&surf_man->cache_lock);
+    return 0;
+}
+
 static int radeon_surface_sanity(struct radeon_surface_manager *surf_man,
                                  struct radeon_surface *surf,
                                  unsigned type,
@@ -2545,7 +2665,7 @@ radeon_surface_init(struct radeon_surface_manager *surf_man,
     if (r) {
         return r;
     }
-    return surf_man->surface_init(surf_man, surf);
+    return radeon_surface_compute(surf_man, surf, 0);
 }
 
 drm_public int
@@ -2562,5 +2682,5 @@ radeon_surface_best(struct radeon_surface_manager *surf_man,
     if (r) {
         return r;
     }
-    return surf_man->surface_best(surf_man, surf);
+    return radeon_surface_compute(surf_man, surf, 1);
 }
@@ -0,0 +1,169 @@
+/*
+ * Copyright © 2012, 2013 Thierry Reding
+ * Copyright © 2013 Erik Faye-Lund
+ * Copyright © 2014 NVIDIA Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <xf86drm.h>
+
+#include "private.h"
+
+static int drm_tegra_channel_read(struct drm_tegra_channel *channel)
+{
+	struct drm_tegra_syncpt_read args;
+	int err;
+
+	memset(&args, 0, sizeof(args));
+	args.id = channel->syncpt;
+
+	err = drmIoctl(channel->drm->fd, DRM_IOCTL_TEGRA_SYNCPT_READ, &args);
+	if (err < 0)
+		return -errno;
+
+	channel->completed = args.value;
+
+	return 0;
+}
+
+drm_public int drm_tegra_channel_open(struct drm_tegra_channel **channelp,
+				      struct drm_tegra *drm,
+				      enum drm_tegra_class client)
+{
+	struct drm_tegra_open_channel args;
+	struct drm_tegra_get_syncpt syncpt;
+	struct drm_tegra_channel *channel;
+	int err;
+
+	if (!channelp || !drm)
+		return -EINVAL;
+
+	memset(&args, 0, sizeof(args));
+
+	switch (client) {
+	case DRM_TEGRA_GR2D:
+		args.client = HOST1X_CLASS_GR2D;
+		break;
+
+	case DRM_TEGRA_GR3D:
+		args.client = HOST1X_CLASS_GR3D;
+		break;
+
+	default:
+		return -EINVAL;
+	}
+
+	channel = calloc(1, sizeof(*channel));
+	if (!channel)
+		return -ENOMEM;
+
+	channel->drm = drm;
+	channel->class = client;
+
+	err = drmIoctl(drm->fd, DRM_IOCTL_TEGRA_OPEN_CHANNEL, &args);
+	if (err < 0) {
+		err = -errno;
+		free(channel);
+		return err;
+	}
+
+	channel->context = args.context;
+
+	memset(&syncpt, 0, sizeof(syncpt));
+	syncpt.context = args.context;
+	syncpt.index = 0;
+
+	err = drmIoctl(drm->fd, DRM_IOCTL_TEGRA_GET_SYNCPT, &syncpt);
+	if (err < 0) {
+		err = -errno;
+		drm_tegra_channel_close(channel);
+		return err;
+	}
+
+	channel->syncpt = syncpt.id;
+
+	err = drm_tegra_channel_read(channel);
+	if (err < 0) {
+		drm_tegra_channel_close(channel);
+		return err;
+	}
+
+	*channelp = channel;
+
+	return 0;
+}
+
+drm_public int drm_tegra_channel_close(struct drm_tegra_channel *channel)
+{
+	struct drm_tegra_close_channel args;
+	struct drm_tegra *drm;
+	int err;
+
+	if (!channel)
+		return -EINVAL;
+
+	drm = channel->drm;
+
+	memset(&args, 0, sizeof(args));
+	args.context = channel->context;
+
+	err = drmIoctl(drm->fd, DRM_IOCTL_TEGRA_CLOSE_CHANNEL, &args);
+	if (err < 0)
+		err = -errno;
+
+	free(channel);
+
+	return err;
+}
+
+drm_public int drm_tegra_channel_get_syncpt(struct drm_tegra_channel *channel,
+					    uint32_t *syncpt)
+{
+	if (!channel || !syncpt)
+		return -EINVAL;
+
+	*syncpt = channel->syncpt;
+
+	return 0;
+}
+
+/*
+ * Returns 1 if the channel's syncpoint has reached value, 0 if not, or a
+ * negative error code.  Only reads back the syncpoint if the value last
+ * seen isn't recent enough.
+ */
+drm_private int drm_tegra_channel_idle(struct drm_tegra_channel *channel,
+				       uint32_t value)
+{
+	int err;
+
+	/* syncpoint values wrap around */
+	if ((int32_t)(channel->completed - value) >= 0)
+		return 1;
+
+	err = drm_tegra_channel_read(channel);
+	if (err < 0)
+		return err;
+
+	return (int32_t)(channel->completed - value) >= 0;
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright © 2012, 2013 Thierry Reding
+ * Copyright © 2013 Erik Faye-Lund
+ * Copyright © 2014 NVIDIA Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <xf86drm.h>
+
+#include "private.h"
+
+/*
+ * Fences are returned by drm_tegra_job_submit() and stay valid until
+ * freed, but not beyond the channel the job was submitted to.
+ */
+
+/* returns 1 if the fence has signaled, 0 if not, or a negative error */
+drm_public int drm_tegra_fence_is_signaled(struct drm_tegra_fence *fence)
+{
+	if (!fence)
+		return -EINVAL;
+
+	return drm_tegra_channel_idle(fence->channel, fence->value);
+}
+
+/*
+ * Waits up to timeout milliseconds for the fence, forever if timeout is
+ * ULONG_MAX.  A timeout of 0 never blocks.  Returns -ETIMEDOUT if the
+ * fence hasn't signaled in time.
+ */
+drm_public int drm_tegra_fence_wait_timeout(struct drm_tegra_fence *fence,
+					    unsigned long timeout)
+{
+	struct drm_tegra_channel *channel;
+	struct drm_tegra_syncpt_wait args;
+	int err;
+
+	err = drm_tegra_fence_is_signaled(fence);
+	if (err != 0)
+		return err < 0 ? err : 0;
+
+	if (timeout == 0)
+		return -ETIMEDOUT;
+
+	channel = fence->channel;
+
+	memset(&args, 0, sizeof(args));
+	args.id = channel->syncpt;
+	args.thresh = fence->value;
+
+	if (timeout >= DRM_TEGRA_NO_TIMEOUT)
+		args.timeout = DRM_TEGRA_NO_TIMEOUT;
+	else
+		args.timeout = timeout;
+
+	err = drmIoctl(channel->drm->fd, DRM_IOCTL_TEGRA_SYNCPT_WAIT, &args);
+	if (err < 0) {
+		if (errno == EAGAIN || errno == ETIMEDOUT)
+			return -ETIMEDOUT;
+
+		return -errno;
+	}
+
+	channel->completed = args.value;
+
+	return 0;
+}
+
+drm_public void drm_tegra_fence_free(struct drm_tegra_fence *fence)
+{
+	free(fence);
+}
@@ -0,0 +1,218 @@
+/*
+ * Copyright © 2012, 2013 Thierry Reding
+ * Copyright © 2013 Erik Faye-Lund
+ * Copyright © 2014 NVIDIA Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <xf86drm.h>
+
+#include "private.h"
+
+drm_public int drm_tegra_job_new(struct drm_tegra_job **jobp,
+				 struct drm_tegra_channel *channel)
+{
+	struct drm_tegra_job *job;
+
+	if (!jobp || !channel)
+		return -EINVAL;
+
+	job = calloc(1, sizeof(*job));
+	if (!job)
+		return -ENOMEM;
+
+	list_inithead(&job->pending);
+	list_inithead(&job->retired);
+	list_inithead(&job->free);
+	job->channel = channel;
+
+	*jobp = job;
+
+	return 0;
+}
+
+static void drm_tegra_job_free_bos(struct list_head *list)
+{
+	struct drm_tegra_pushbuf_bo *pbo, *tmp;
+
+	LIST_FOR_EACH_ENTRY_SAFE(pbo, tmp, list, list) {
+		list_del(&pbo->list);
+		drm_tegra_pushbuf_put_bo(pbo);
+	}
+}
+
+drm_public int drm_tegra_job_free(struct drm_tegra_job *job)
+{
+	if (!job)
+		return -EINVAL;
+
+	if (job->pushbuf)
+		drm_tegra_pushbuf_free(&job->pushbuf->base);
+
+	/* the kernel holds on to the bo's of jobs still in flight */
+	drm_tegra_job_free_bos(&job->pending);
+	drm_tegra_job_free_bos(&job->retired);
+	drm_tegra_job_free_bos(&job->free);
+
+	free(job->cmdbufs);
+	free(job->relocs);
+	free(job);
+
+	return 0;
+}
+
+drm_private int drm_tegra_job_add_cmdbuf(struct drm_tegra_job *job,
+					 uint32_t handle, uint32_t offset,
+					 uint32_t words)
+{
+	struct drm_tegra_cmdbuf *cmdbuf;
+
+	if (job->num_cmdbufs == job->max_cmdbufs) {
+		unsigned int max = job->max_cmdbufs ? 2 * job->max_cmdbufs : 8;
+
+		cmdbuf = realloc(job->cmdbufs, max * sizeof(*cmdbuf));
+		if (!cmdbuf)
+			return -ENOMEM;
+
+		job->max_cmdbufs = max;
+		job->cmdbufs = cmdbuf;
+	}
+
+	cmdbuf = &job->cmdbufs[job->num_cmdbufs++];
+	memset(cmdbuf, 0, sizeof(*cmdbuf));
+	cmdbuf->handle = handle;
+	cmdbuf->offset = offset;
+	cmdbuf->words = words;
+
+	return 0;
+}
+
+drm_private int drm_tegra_job_add_reloc(struct drm_tegra_job *job,
+					const struct drm_tegra_reloc *reloc)
+{
+	struct drm_tegra_reloc *relocs;
+
+	if (job->num_relocs == job->max_relocs) {
+		unsigned int max = job->max_relocs ? 2 * job->max_relocs : 16;
+
+		relocs = realloc(job->relocs, max * sizeof(*relocs));
+		if (!relocs)
+			return -ENOMEM;
+
+		job->max_relocs = max;
+		job->relocs = relocs;
+	}
+
+	job->relocs[job->num_relocs++] = *reloc;
+
+	return 0;
+}
+
+/*
+ * Submits the commands written to the job's pushbuf so far.  The job is
+ * empty again afterwards, whether the submission succeeded or not, and
+ * can be reused right away: its command buffers are only rewritten once
+ * the hardware is done with them, so any number of submissions of the
+ * same job can be in flight.  If fencep is not NULL, a fence signaling
+ * completion of this submission is returned in it.
+ */
+drm_public int drm_tegra_job_submit(struct drm_tegra_job *job,
+				    struct drm_tegra_fence **fencep)
+{
+	struct drm_tegra_fence *fence = NULL;
+	struct drm_tegra_syncpt syncpt;
+	struct drm_tegra_submit args;
+	struct drm_tegra *drm;
+	int err;
+
+	if (!job)
+		return -EINVAL;
+
+	drm = job->channel->drm;
+
+	if (job->pushbuf) {
+		err = drm_tegra_pushbuf_flush(job->pushbuf);
+		if (err < 0)
+			goto reset;
+	}
+
+	if (!job->num_cmdbufs) {
+		err = -EINVAL;
+		goto reset;
+	}
+
+	if (fencep) {
+		fence = calloc(1, sizeof(*fence));
+		if (!fence) {
+			err = -ENOMEM;
+			goto reset;
+		}
+	}
+
+	memset(&syncpt, 0, sizeof(syncpt));
+	syncpt.id = job->channel->syncpt;
+	syncpt.incrs = job->increments;
+
+	memset(&args, 0, sizeof(args));
+	args.context = job->channel->context;
+	args.num_syncpts = 1;
+	args.num_cmdbufs = job->num_cmdbufs;
+	args.num_relocs = job->num_relocs;
+	args.num_waitchks = 0;
+	args.waitchk_mask = 0;
+	args.timeout = 1000;
+
+	args.syncpts = (uintptr_t)&syncpt;
+	args.cmdbufs = (uintptr_t)job->cmdbufs;
+	args.relocs = (uintptr_t)job->relocs;
+	args.waitchks = 0;
+
+	err = drmIoctl(drm->fd, DRM_IOCTL_TEGRA_SUBMIT, &args);
+	if (err < 0) {
+		err = -errno;
+		free(fence);
+		goto reset;
+	}
+
+	drm_tegra_pushbuf_retire(job, args.fence, true);
+
+	if (fence) {
+		fence->channel = job->channel;
+		fence->value = args.fence;
+		*fencep = fence;
+	}
+
+	job->num_cmdbufs = 0;
+	job->num_relocs = 0;
+	job->increments = 0;
+
+	return 0;
+
+reset:
+	drm_tegra_pushbuf_retire(job, 0, false);
+	job->num_cmdbufs = 0;
+	job->num_relocs = 0;
+	job->increments = 0;
+
+	return err;
+}
@@ -25,17 +25,38 @@
 #ifndef __DRM_TEGRA_PRIVATE_H__
 #define __DRM_TEGRA_PRIVATE_H__ 1
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <time.h>
 
 #include <libdrm_macros.h>
 #include <xf86atomic.h>
 
+#include "util_double_list.h"
 #include "tegra.h"
 
+#include <tegra_drm.h>
+
+#define DRM_TEGRA_BO_CACHE_BUCKETS 56
+
+struct drm_tegra_bo_bucket {
+	uint32_t size;
+	struct list_head list;
+};
+
 struct drm_tegra {
 	bool close;
 	int fd;
+
+	/* protects the handle table and the bo cache */
+	pthread_mutex_t lock;
+	void *handles;
+
+	bool cache_enabled;
+	time_t time;
+	unsigned int num_buckets;
+	struct drm_tegra_bo_bucket buckets[DRM_TEGRA_BO_CACHE_BUCKETS];
 };
 
 struct drm_tegra_bo {
@@ -46,6 +67,88 @@ struct drm_tegra_bo {
 	uint32_t size;
 	atomic_t ref;
 	void *map;
+
+	/* bo cache, only bo's allocated by drm_tegra_bo_new() are reused */
+	struct list_head list;
+	time_t free_time;
+	bool reusable;
+};
+
+struct drm_tegra_channel {
+	struct drm_tegra *drm;
+	enum drm_tegra_class class;
+	uint64_t context;
+	uint32_t syncpt;
+
+	/* last syncpoint value read back, to avoid ioctls for idle checks */
+	uint32_t completed;
+};
+
+struct drm_tegra_fence {
+	struct drm_tegra_channel *channel;
+	uint32_t value;
 };
 
+/*
+ * A command buffer chunk owned by a job.  Consecutive jobs keep filling
+ * the same chunk; once full it is retired with the fence of the last job
+ * that used it and only refilled when that fence has passed.
+ */
+struct drm_tegra_pushbuf_bo {
+	struct list_head list;
+	struct drm_tegra_bo *bo;
+	uint32_t *map;
+	uint32_t words;
+	uint32_t fence;
+	bool busy;
+};
+
+struct drm_tegra_pushbuf_private {
+	struct drm_tegra_pushbuf base;
+	struct drm_tegra_job *job;
+
+	struct drm_tegra_pushbuf_bo *current;
+	uint32_t *start;
+	uint32_t *end;
+};
+
+struct drm_tegra_job {
+	struct drm_tegra_channel *channel;
+	struct drm_tegra_pushbuf_private *pushbuf;
+	unsigned int increments;
+
+	struct drm_tegra_cmdbuf *cmdbufs;
+	unsigned int num_cmdbufs;
+	unsigned int max_cmdbufs;
+
+	struct drm_tegra_reloc *relocs;
+	unsigned int num_relocs;
+	unsigned int max_relocs;
+
+	/* chunks filled by this job, retired chunks, and idle ones */
+	struct list_head pending;
+	struct list_head retired;
+	struct list_head free;
+};
+
+static inline struct drm_tegra_pushbuf_private *
+drm_tegra_pushbuf(struct drm_tegra_pushbuf *pb)
+{
+	return (struct drm_tegra_pushbuf_private *)pb;
+}
+
+drm_private int drm_tegra_channel_idle(struct drm_tegra_channel *channel,
+				       uint32_t value);
+drm_private int drm_tegra_job_add_cmdbuf(struct drm_tegra_job *job,
+					 uint32_t handle, uint32_t offset,
+					 uint32_t words);
+drm_private int drm_tegra_job_add_reloc(struct drm_tegra_job *job,
+					const struct drm_tegra_reloc *reloc);
+drm_private int drm_tegra_pushbuf_flush(struct drm_tegra_pushbuf_private *pb);
+drm_private void drm_tegra_pushbuf_retire(struct drm_tegra_job *job,
+					  uint32_t fence, bool submitted);
+drm_private struct drm_tegra_pushbuf_bo *
+drm_tegra_pushbuf_get_bo(struct drm_tegra_job *job, uint32_t words);
+drm_private void drm_tegra_pushbuf_put_bo(struct drm_tegra_pushbuf_bo *pbo);
+
 #endif /* __DRM_TEGRA_PRIVATE_H__ */
@@ -0,0 +1,271 @@
+/*
+ * Copyright © 2012, 2013 Thierry Reding
+ * Copyright © 2013 Erik Faye-Lund
+ * Copyright © 2014 NVIDIA Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include "private.h"
+
+/* size of a command buffer chunk, in words */
+#define DRM_TEGRA_PUSHBUF_CHUNK 4096
+
+drm_private struct drm_tegra_pushbuf_bo *
+drm_tegra_pushbuf_get_bo(struct drm_tegra_job *job, uint32_t words)
+{
+	struct drm_tegra_pushbuf_bo *pbo, *tmp;
+	void *map;
+	int err;
+
+	/* chunks are retired in submission order, stop at the first busy one */
+	LIST_FOR_EACH_ENTRY_SAFE(pbo, tmp, &job->retired, list) {
+		if (drm_tegra_channel_idle(job->channel, pbo->fence) <= 0)
+			break;
+
+		pbo->busy = false;
+		list_del(&pbo->list);
+		list_addtail(&pbo->list, &job->free);
+	}
+
+	LIST_FOR_EACH_ENTRY(pbo, &job->free, list) {
+		if (pbo->words >= words) {
+			list_del(&pbo->list);
+			return pbo;
+		}
+	}
+
+	pbo = calloc(1, sizeof(*pbo));
+	if (!pbo)
+		return NULL;
+
+	if (words < DRM_TEGRA_PUSHBUF_CHUNK)
+		words = DRM_TEGRA_PUSHBUF_CHUNK;
+
+	/* round up to whole pages */
+	words = (words + 1023) & ~1023;
+
+	err = drm_tegra_bo_new(&pbo->bo, job->channel->drm, 0, words * 4);
+	if (err < 0)
+		goto free;
+
+	err = drm_tegra_bo_map(pbo->bo, &map);
+	if (err < 0)
+		goto unref;
+
+	pbo->map = map;
+	pbo->words = words;
+
+	return pbo;
+
+unref:
+	drm_tegra_bo_unref(pbo->bo);
+free:
+	free(pbo);
+	return NULL;
+}
+
+drm_private void drm_tegra_pushbuf_put_bo(struct drm_tegra_pushbuf_bo *pbo)
+{
+	drm_tegra_bo_unref(pbo->bo);
+	free(pbo);
+}
+
+/* records the commands written since the last flush as a cmdbuf */
+drm_private int drm_tegra_pushbuf_flush(struct drm_tegra_pushbuf_private *pb)
+{
+	struct drm_tegra_pushbuf_bo *pbo = pb->current;
+	int err;
+
+	if (!pbo || pb->base.ptr == pb->start)
+		return 0;
+
+	err = drm_tegra_job_add_cmdbuf(pb->job, pbo->bo->handle,
+				       (pb->start - pbo->map) * 4,
+				       pb->base.ptr - pb->start);
+	if (err < 0)
+		return err;
+
+	pb->start = pb->base.ptr;
+
+	return 0;
+}
+
+/*
+ * Tags the chunks used by the job just submitted with its fence.  If
+ * nothing was submitted, the commands written since the last submission
+ * are dropped and chunks keep the fence they had.
+ */
+drm_private void drm_tegra_pushbuf_retire(struct drm_tegra_job *job,
+					  uint32_t fence, bool submitted)
+{
+	struct drm_tegra_pushbuf_private *pb = job->pushbuf;
+	struct drm_tegra_pushbuf_bo *pbo, *tmp;
+
+	if (pb && pb->current) {
+		if (submitted) {
+			pb->current->fence = fence;
+			pb->current->busy = true;
+		}
+
+		pb->base.ptr = pb->start;
+	}
+
+	LIST_FOR_EACH_ENTRY_SAFE(pbo, tmp, &job->pending, list) {
+		list_del(&pbo->list);
+
+		if (submitted) {
+			pbo->fence = fence;
+			pbo->busy = true;
+		}
+
+		list_addtail(&pbo->list, pbo->busy ? &job->retired : &job->free);
+	}
+}
+
+drm_public int drm_tegra_pushbuf_new(struct drm_tegra_pushbuf **pushbufp,
+				     struct drm_tegra_job *job)
+{
+	struct drm_tegra_pushbuf_private *pb;
+
+	if (!pushbufp || !job)
+		return -EINVAL;
+
+	if (job->pushbuf)
+		return -EBUSY;
+
+	pb = calloc(1, sizeof(*pb));
+	if (!pb)
+		return -ENOMEM;
+
+	pb->job = job;
+	job->pushbuf = pb;
+
+	*pushbufp = &pb->base;
+
+	return 0;
+}
+
+drm_public int drm_tegra_pushbuf_free(struct drm_tegra_pushbuf *pushbuf)
+{
+	struct drm_tegra_pushbuf_private *pb = drm_tegra_pushbuf(pushbuf);
+	struct drm_tegra_pushbuf_bo *pbo;
+	struct drm_tegra_job *job;
+
+	if (!pb)
+		return -EINVAL;
+
+	job = pb->job;
+	pbo = pb->current;
+
+	/* the job keeps the chunk for its next pushbuf */
+	if (pbo)
+		list_addtail(&pbo->list, pbo->busy ? &job->retired : &job->free);
+
+	job->pushbuf = NULL;
+	free(pb);
+
+	return 0;
+}
+
+/*
+ * Makes sure there's room for at least words more words at ptr.  Has to
+ * be called before writing commands, including relocations and syncpoint
+ * increments.
+ */
+drm_public int drm_tegra_pushbuf_prepare(struct drm_tegra_pushbuf *pushbuf,
+					 unsigned int words)
+{
+	struct drm_tegra_pushbuf_private *pb = drm_tegra_pushbuf(pushbuf);
+	struct drm_tegra_pushbuf_bo *pbo;
+	int err;
+
+	if (!pb)
+		return -EINVAL;
+
+	if (pb->current && pushbuf->ptr + words <= pb->end)
+		return 0;
+
+	if (pb->current) {
+		err = drm_tegra_pushbuf_flush(pb);
+		if (err < 0)
+			return err;
+
+		list_addtail(&pb->current->list, &pb->job->pending);
+		pb->current = NULL;
+	}
+
+	pbo = drm_tegra_pushbuf_get_bo(pb->job, words);
+	if (!pbo)
+		return -ENOMEM;
+
+	pb->current = pbo;
+	pb->start = pbo->map;
+	pb->end = pbo->map + pbo->words;
+	pushbuf->ptr = pb->start;
+
+	return 0;
+}
+
+drm_public int drm_tegra_pushbuf_relocate(struct drm_tegra_pushbuf *pushbuf,
+					  struct drm_tegra_bo *target,
+					  unsigned long offset,
+					  unsigned long shift)
+{
+	struct drm_tegra_pushbuf_private *pb = drm_tegra_pushbuf(pushbuf);
+	struct drm_tegra_reloc reloc;
+	int err;
+
+	if (!pb || !pb->current || !target)
+		return -EINVAL;
+
+	memset(&reloc, 0, sizeof(reloc));
+	reloc.cmdbuf.handle = pb->current->bo->handle;
+	reloc.cmdbuf.offset = (pushbuf->ptr - pb->current->map) * 4;
+	reloc.target.handle = target->handle;
+	reloc.target.offset = offset;
+	reloc.shift = shift;
+
+	err = drm_tegra_job_add_reloc(pb->job, &reloc);
+	if (err < 0)
+		return err;
+
+	/* patched by the kernel */
+	*pushbuf->ptr++ = 0xdeadbeef;
+
+	return 0;
+}
+
+drm_public int drm_tegra_pushbuf_sync(struct drm_tegra_pushbuf *pushbuf,
+				      enum drm_tegra_syncpt_cond cond)
+{
+	struct drm_tegra_pushbuf_private *pb = drm_tegra_pushbuf(pushbuf);
+
+	if (!pb || !pb->current || cond >= DRM_TEGRA_SYNCPT_COND_MAX)
+		return -EINVAL;
+
+	*pushbuf->ptr++ = HOST1X_OPCODE_NONINCR(0x0, 0x1);
+	*pushbuf->ptr++ = cond << 8 | pb->job->channel->syncpt;
+	pb->job->increments++;
+
+	return 0;
+}
@@ -35,11 +35,14 @@
 
 #include "private.h"
 
+/* called with drm->lock held */
 static void drm_tegra_bo_free(struct drm_tegra_bo *bo)
 {
 	struct drm_tegra *drm = bo->drm;
 	struct drm_gem_close args;
 
+	drmHashDelete(drm->handles, bo->handle);
+
 	if (bo->map)
 		munmap(bo->map, bo->size);
 
@@ -51,6 +54,127 @@ static void drm_tegra_bo_free(struct drm_tegra_bo *bo)
 	free(bo);
 }
 
+/*
+ * bo reuse cache: with the cache enabled, the last unreference of a bo
+ * allocated by drm_tegra_bo_new() parks it, mapping included, in the
+ * bucket for its size, and drm_tegra_bo_new() hands it out again for
+ * the same flags.  bo's idle in the cache for more than a second are
+ * freed.  The kernel can't tell userspace when the engines are done
+ * with a bo, so the cache is only enabled on request.
+ */
+static void drm_tegra_add_bucket(struct drm_tegra *drm, uint32_t size)
+{
+	struct drm_tegra_bo_bucket *bucket = &drm->buckets[drm->num_buckets++];
+
+	bucket->size = size;
+	list_inithead(&bucket->list);
+}
+
+static void drm_tegra_bo_cache_init(struct drm_tegra *drm)
+{
+	uint32_t size;
+
+	drm_tegra_add_bucket(drm, 4096);
+	drm_tegra_add_bucket(drm, 4096 * 2);
+	drm_tegra_add_bucket(drm, 4096 * 3);
+
+	for (size = 4 * 4096; size <= 64 * 1024 * 1024; size *= 2) {
+		drm_tegra_add_bucket(drm, size);
+		drm_tegra_add_bucket(drm, size + size * 1 / 4);
+		drm_tegra_add_bucket(drm, size + size * 2 / 4);
+		drm_tegra_add_bucket(drm, size + size * 3 / 4);
+	}
+}
+
+static struct drm_tegra_bo_bucket *
+drm_tegra_get_bucket(struct drm_tegra *drm, uint32_t size)
+{
+	unsigned int i;
+
+	for (i = 0; i < drm->num_buckets; i++)
+		if (drm->buckets[i].size >= size)
+			return &drm->buckets[i];
+
+	return NULL;
+}
+
+/* frees bo's cached for more than a second, or all if time is 0 */
+static void drm_tegra_bo_cache_cleanup(struct drm_tegra *drm, time_t time)
+{
+	unsigned int i;
+
+	if (time && drm->time == time)
+		return;
+
+	for (i = 0; i < drm->num_buckets; i++) {
+		struct drm_tegra_bo_bucket *bucket = &drm->buckets[i];
+		struct drm_tegra_bo *bo;
+
+		while (!LIST_IS_EMPTY(&bucket->list)) {
+			bo = LIST_FIRST_ENTRY(&bucket->list, struct drm_tegra_bo,
+					      list);
+			if (time && time - bo->free_time <= 1)
+				break;
+
+			list_del(&bo->list);
+			drm_tegra_bo_free(bo);
+		}
+	}
+
+	drm->time = time;
+}
+
+/* returns true if the bo was taken by the cache, called with drm->lock held */
+static bool drm_tegra_bo_cache_put(struct drm_tegra_bo *bo)
+{
+	struct drm_tegra *drm = bo->drm;
+	struct drm_tegra_bo_bucket *bucket;
+	struct timespec now;
+
+	if (!drm->cache_enabled || !bo->reusable)
+		return false;
+
+	bucket = drm_tegra_get_bucket(drm, bo->size);
+	if (!bucket || bucket->size != bo->size)
+		return false;
+
+	/* nobody can look it up by handle while it's cached */
+	drmHashDelete(drm->handles, bo->handle);
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	bo->free_time = now.tv_sec;
+	list_addtail(&bo->list, &bucket->list);
+	drm_tegra_bo_cache_cleanup(drm, now.tv_sec);
+
+	return true;
+}
+
+/* called with drm->lock held */
+static struct drm_tegra_bo *
+drm_tegra_bo_cache_get(struct drm_tegra *drm, uint32_t *size, uint32_t flags)
+{
+	struct drm_tegra_bo_bucket *bucket;
+	struct drm_tegra_bo *bo, *tmp;
+
+	bucket = drm_tegra_get_bucket(drm, *size);
+	if (!bucket)
+		return NULL;
+
+	*size = bucket->size;
+
+	/* most recently freed first */
+	LIST_FOR_EACH_ENTRY_SAFE_REV(bo, tmp, &bucket->list, list) {
+		if (bo->flags == flags) {
+			list_del(&bo->list);
+			atomic_set(&bo->ref, 1);
+			drmHashInsert(drm->handles, bo->handle, bo);
+			return bo;
+		}
+	}
+
+	return NULL;
+}
+
 static int drm_tegra_wrap(struct drm_tegra **drmp, int fd, bool close)
 {
 	struct drm_tegra *drm;
@@ -62,6 +186,14 @@ static int drm_tegra_wrap(struct drm_tegra **drmp, int fd, bool close)
 	if (!drm)
 		return -ENOMEM;
 
+	drm->handles = drmHashCreate();
+	if (!drm->handles) {
+		free(drm);
+		return -ENOMEM;
+	}
+
+	pthread_mutex_init(&drm->lock, NULL);
+	drm_tegra_bo_cache_init(drm);
 	drm->close = close;
 	drm->fd = fd;
 
@@ -95,12 +227,36 @@ drm_public void drm_tegra_close(struct drm_tegra *drm)
 	if (!drm)
 		return;
 
+	pthread_mutex_lock(&drm->lock);
+	drm_tegra_bo_cache_cleanup(drm, 0);
+	pthread_mutex_unlock(&drm->lock);
+
+	pthread_mutex_destroy(&drm->lock);
+	drmHashDestroy(drm->handles);
+
 	if (drm->close)
 		close(drm->fd);
 
 	free(drm);
 }
 
+/*
+ * Enable or disable reuse of unreferenced bo's.  Only enable the cache
+ * if a bo is idle by the time its last reference is dropped; disabling
+ * it frees the bo's cached so far.
+ */
+drm_public void drm_tegra_set_bo_cache(struct drm_tegra *drm, int enable)
+{
+	if (!drm)
+		return;
+
+	pthread_mutex_lock(&drm->lock);
+	drm->cache_enabled = !!enable;
+	if (!enable)
+		drm_tegra_bo_cache_cleanup(drm, 0);
+	pthread_mutex_unlock(&drm->lock);
+}
+
 drm_public int drm_tegra_bo_new(struct drm_tegra_bo **bop, struct drm_tegra *drm,
 		     uint32_t flags, uint32_t size)
 {
@@ -111,11 +267,23 @@ drm_public int drm_tegra_bo_new(struct drm_tegra_bo **bop, struct drm_tegra *drm
 	if (!drm || size == 0 || !bop)
 		return -EINVAL;
 
+	pthread_mutex_lock(&drm->lock);
+	if (drm->cache_enabled) {
+		bo = drm_tegra_bo_cache_get(drm, &size, flags);
+		if (bo) {
+			pthread_mutex_unlock(&drm->lock);
+			*bop = bo;
+			return 0;
+		}
+	}
+	pthread_mutex_unlock(&drm->lock);
+
 	bo = calloc(1, sizeof(*bo));
 	if (!bo)
 		return -ENOMEM;
 
 	atomic_set(&bo->ref, 1);
+	bo->reusable = true;
 	bo->flags = flags;
 	bo->size = size;
 	bo->drm = drm;
@@ -134,6 +302,10 @@ drm_public int drm_tegra_bo_new(struct drm_tegra_bo **bop, struct drm_tegra *drm
 
 	bo->handle = args.handle;
 
+	pthread_mutex_lock(&drm->lock);
+	drmHashInsert(drm->handles, bo->handle, bo);
+	pthread_mutex_unlock(&drm->lock);
+
 	*bop = bo;
 
 	return 0;
@@ -143,13 +315,27 @@ drm_public int drm_tegra_bo_wrap(struct drm_tegra_bo **bop, struct drm_tegra *dr
 		      uint32_t handle, uint32_t flags, uint32_t size)
 {
 	struct drm_tegra_bo *bo;
+	void *value;
 
 	if (!drm || !bop)
 		return -EINVAL;
 
+	pthread_mutex_lock(&drm->lock);
+
+	/* the handle may already be wrapped, hand out the same bo */
+	if (!drmHashLookup(drm->handles, handle, &value)) {
+		bo = value;
+		atomic_inc(&bo->ref);
+		pthread_mutex_unlock(&drm->lock);
+		*bop = bo;
+		return 0;
+	}
+
 	bo = calloc(1, sizeof(*bo));
-	if (!bo)
+	if (!bo) {
+		pthread_mutex_unlock(&drm->lock);
 		return -ENOMEM;
+	}
 
 	atomic_set(&bo->ref, 1);
 	bo->handle = handle;
@@ -157,6 +343,9 @@ drm_public int drm_tegra_bo_wrap(struct drm_tegra_bo **bop, struct drm_tegra *dr
 	bo->size = size;
 	bo->drm = drm;
 
+	drmHashInsert(drm->handles, bo->handle, bo);
+	pthread_mutex_unlock(&drm->lock);
+
 	*bop = bo;
 
 	return 0;
@@ -172,8 +361,24 @@ drm_public struct drm_tegra_bo *drm_tegra_bo_ref(struct drm_tegra_bo *bo)
 
 drm_public void drm_tegra_bo_unref(struct drm_tegra_bo *bo)
 {
-	if (bo && atomic_dec_and_test(&bo->ref))
+	struct drm_tegra *drm;
+
+	if (!bo)
+		return;
+
+	/* not the last reference, no need to lock */
+	if (!atomic_add_unless(&bo->ref, -1, 1))
+		return;
+
+	/*
+	 * Drop the last reference under the lock so that a concurrent
+	 * drm_tegra_bo_wrap() can't find the bo in the handle table.
+	 */
+	drm = bo->drm;
+	pthread_mutex_lock(&drm->lock);
+	if (atomic_dec_and_test(&bo->ref) && !drm_tegra_bo_cache_put(bo))
 		drm_tegra_bo_free(bo);
+	pthread_mutex_unlock(&drm->lock);
 }
 
 drm_public int drm_tegra_bo_get_handle(struct drm_tegra_bo *bo, uint32_t *handle)
@@ -275,6 +480,9 @@ drm_public int drm_tegra_bo_set_flags(struct drm_tegra_bo *bo, uint32_t flags)
 	if (err < 0)
 		return -errno;
 
+	/* the flags no longer match what the bo was created with */
+	bo->reusable = false;
+
 	return 0;
 }
 
@@ -324,5 +532,8 @@ drm_public int drm_tegra_bo_set_tiling(struct drm_tegra_bo *bo,
 	if (err < 0)
 		return -errno;
 
+	/* don't hand out a bo with a stale tiling mode from the cache */
+	bo->reusable = false;
+
 	return 0;
 }
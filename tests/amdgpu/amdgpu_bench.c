@@ -0,0 +1,473 @@
+/*
+ * Copyright 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Throughput benchmark for the libdrm_amdgpu hot paths: buffer allocation,
+ * CPU mapping, VA allocation in a fragmented address space, BO list
+ * creation, NOP submissions and fence waits.  Every test runs for the same
+ * wall-clock time and the results are printed as JSON, one object per test,
+ * so that runs can be compared by a script.
+ *
+ * Usage: amdgpu_bench [render node] [milliseconds per test]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "xf86drm.h"
+#include "amdgpu.h"
+#include "amdgpu_drm.h"
+
+#define NUM_LIST_BOS	64
+#define NUM_FRAG_VAS	4096
+#define NUM_IB_DWORDS	16
+#define SUBMIT_DEPTH	64
+
+static amdgpu_device_handle device;
+static double duration;
+static int bo_reuse;
+static int num_results;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct timer {
+	double start;
+	double elapsed;
+	unsigned long ops;
+};
+
+static void timer_start(struct timer *t)
+{
+	t->ops = 0;
+	t->elapsed = 0;
+	t->start = now();
+}
+
+static int timer_running(struct timer *t)
+{
+	t->elapsed = now() - t->start;
+	return t->elapsed < duration;
+}
+
+/* @params is a JSON fragment of extra members, or NULL. */
+static void report(const char *name, const char *params, struct timer *t,
+		   int error)
+{
+	printf("%s\n    { \"name\": \"%s\"", num_results++ ? "," : "", name);
+	if (params)
+		printf(", %s", params);
+	if (error)
+		printf(", \"error\": %d }", error);
+	else
+		printf(", \"ops\": %lu, \"ops_per_sec\": %.1f, \"ns_per_op\": %.1f }",
+		       t->ops, t->ops / t->elapsed,
+		       t->ops ? t->elapsed * 1e9 / t->ops : 0.0);
+}
+
+static int alloc_and_map(uint64_t size, uint32_t heap, amdgpu_bo_handle *bo,
+			 amdgpu_va_handle *va_handle, uint64_t *va)
+{
+	struct amdgpu_bo_alloc_request req = {0};
+	int r;
+
+	req.alloc_size = size;
+	req.phys_alignment = 4096;
+	req.preferred_heap = heap;
+	r = amdgpu_bo_alloc(device, &req, bo);
+	if (r)
+		return r;
+
+	r = amdgpu_va_range_alloc(device, amdgpu_gpu_va_range_general, size,
+				  4096, 0, va, va_handle, 0);
+	if (r)
+		goto error_va_alloc;
+
+	r = amdgpu_bo_va_op(*bo, 0, size, *va, 0, AMDGPU_VA_OP_MAP);
+	if (r)
+		goto error_va_map;
+
+	return 0;
+
+error_va_map:
+	amdgpu_va_range_free(*va_handle);
+error_va_alloc:
+	amdgpu_bo_free(*bo);
+	return r;
+}
+
+static void unmap_and_free(amdgpu_bo_handle bo, amdgpu_va_handle va_handle,
+			   uint64_t va, uint64_t size)
+{
+	amdgpu_bo_va_op(bo, 0, size, va, 0, AMDGPU_VA_OP_UNMAP);
+	amdgpu_va_range_free(va_handle);
+	amdgpu_bo_free(bo);
+}
+
+static void bench_bo_alloc(uint32_t heap, const char *heap_name,
+			   uint64_t size)
+{
+	struct amdgpu_bo_alloc_request req = {0};
+	amdgpu_bo_handle bo;
+	struct timer t;
+	char params[96];
+	int r = 0;
+
+	req.alloc_size = size;
+	req.phys_alignment = 4096;
+	req.preferred_heap = heap;
+
+	timer_start(&t);
+	while (timer_running(&t)) {
+		r = amdgpu_bo_alloc(device, &req, &bo);
+		if (r)
+			break;
+		amdgpu_bo_free(bo);
+		t.ops++;
+	}
+
+	snprintf(params, sizeof(params),
+		 "\"heap\": \"%s\", \"size\": %llu, \"reuse\": %s",
+		 heap_name, (unsigned long long)size,
+		 bo_reuse ? "true" : "false");
+	report("bo_alloc_free", params, &t, r);
+}
+
+static void bench_cpu_map(int keep_mapped)
+{
+	struct amdgpu_bo_alloc_request req = {0};
+	amdgpu_bo_handle bo;
+	struct timer t;
+	void *cpu, *keep;
+	int r;
+
+	req.alloc_size = 64 * 1024;
+	req.phys_alignment = 4096;
+	req.preferred_heap = AMDGPU_GEM_DOMAIN_GTT;
+	r = amdgpu_bo_alloc(device, &req, &bo);
+	if (r)
+		goto out;
+
+	/* With a mapping held, the others are only reference counted. */
+	if (keep_mapped) {
+		r = amdgpu_bo_cpu_map(bo, &keep);
+		if (r)
+			goto out_free;
+	}
+
+	timer_start(&t);
+	while (timer_running(&t)) {
+		r = amdgpu_bo_cpu_map(bo, &cpu);
+		if (r)
+			break;
+		amdgpu_bo_cpu_unmap(bo);
+		t.ops++;
+	}
+
+	if (keep_mapped)
+		amdgpu_bo_cpu_unmap(bo);
+out_free:
+	amdgpu_bo_free(bo);
+out:
+	report("bo_cpu_map_unmap",
+	       keep_mapped ? "\"mapped\": true" : "\"mapped\": false", &t, r);
+}
+
+static void bench_va_alloc_fragmented(void)
+{
+	amdgpu_va_handle *holes, handle;
+	uint64_t va;
+	struct timer t;
+	unsigned seed = 1;
+	int i, r = 0;
+
+	holes = calloc(NUM_FRAG_VAS, sizeof(*holes));
+	if (!holes) {
+		report("va_alloc_free_fragmented", NULL, &t, -ENOMEM);
+		return;
+	}
+
+	/* Leave a 64 KiB hole after every other 64 KiB range. */
+	for (i = 0; i < NUM_FRAG_VAS; i++) {
+		r = amdgpu_va_range_alloc(device, amdgpu_gpu_va_range_general,
+					  64 * 1024, 4096, 0, &va, &holes[i], 0);
+		if (r)
+			goto out;
+	}
+	for (i = 1; i < NUM_FRAG_VAS; i += 2) {
+		amdgpu_va_range_free(holes[i]);
+		holes[i] = NULL;
+	}
+
+	/* Half of the requests fit a hole, the others don't. */
+	timer_start(&t);
+	while (timer_running(&t)) {
+		uint64_t size = (rand_r(&seed) & 1) ? 64 * 1024 : 256 * 1024;
+
+		r = amdgpu_va_range_alloc(device, amdgpu_gpu_va_range_general,
+					  size, 4096, 0, &va, &handle, 0);
+		if (r)
+			break;
+		amdgpu_va_range_free(handle);
+		t.ops++;
+	}
+
+out:
+	for (i = 0; i < NUM_FRAG_VAS; i++) {
+		if (holes[i])
+			amdgpu_va_range_free(holes[i]);
+	}
+	free(holes);
+	report("va_alloc_free_fragmented", NULL, &t, r);
+}
+
+static void bench_bo_list_create(void)
+{
+	struct amdgpu_bo_alloc_request req = {0};
+	amdgpu_bo_handle bos[NUM_LIST_BOS];
+	amdgpu_bo_list_handle list;
+	struct timer t;
+	char params[32];
+	int i, n, r = 0;
+
+	req.alloc_size = 4096;
+	req.phys_alignment = 4096;
+	req.preferred_heap = AMDGPU_GEM_DOMAIN_GTT;
+	for (n = 0; n < NUM_LIST_BOS; n++) {
+		r = amdgpu_bo_alloc(device, &req, &bos[n]);
+		if (r)
+			goto out;
+	}
+
+	timer_start(&t);
+	while (timer_running(&t)) {
+		r = amdgpu_bo_list_create(device, NUM_LIST_BOS, bos, NULL, &list);
+		if (r)
+			break;
+		amdgpu_bo_list_destroy(list);
+		t.ops++;
+	}
+
+out:
+	for (i = 0; i < n; i++)
+		amdgpu_bo_free(bos[i]);
+	snprintf(params, sizeof(params), "\"bos\": %d", NUM_LIST_BOS);
+	report("bo_list_create_destroy", params, &t, r);
+}
+
+struct nop_submit {
+	amdgpu_context_handle context;
+	amdgpu_bo_handle ib_bo;
+	amdgpu_va_handle ib_va_handle;
+	uint64_t ib_va;
+	amdgpu_bo_list_handle list;
+	struct amdgpu_cs_ib_info ib;
+	struct amdgpu_cs_request request;
+};
+
+static int nop_submit_init(struct nop_submit *s)
+{
+	struct amdgpu_gpu_info info;
+	uint32_t *ptr, nop;
+	void *cpu;
+	int i, r;
+
+	r = amdgpu_query_gpu_info(device, &info);
+	if (r)
+		return r;
+	nop = info.family_id == AMDGPU_FAMILY_SI ? 0x80000000 : 0xffff1000;
+
+	r = amdgpu_cs_ctx_create(device, &s->context);
+	if (r)
+		return r;
+
+	r = alloc_and_map(4096, AMDGPU_GEM_DOMAIN_GTT, &s->ib_bo,
+			  &s->ib_va_handle, &s->ib_va);
+	if (r)
+		goto error_ib;
+
+	r = amdgpu_bo_cpu_map(s->ib_bo, &cpu);
+	if (r)
+		goto error_map;
+	ptr = cpu;
+	for (i = 0; i < NUM_IB_DWORDS; i++)
+		ptr[i] = nop;
+	amdgpu_bo_cpu_unmap(s->ib_bo);
+
+	r = amdgpu_bo_list_create(device, 1, &s->ib_bo, NULL, &s->list);
+	if (r)
+		goto error_map;
+
+	s->ib.ib_mc_address = s->ib_va;
+	s->ib.size = NUM_IB_DWORDS;
+	s->request.ip_type = AMDGPU_HW_IP_GFX;
+	s->request.number_of_ibs = 1;
+	s->request.ibs = &s->ib;
+	s->request.resources = s->list;
+	return 0;
+
+error_map:
+	unmap_and_free(s->ib_bo, s->ib_va_handle, s->ib_va, 4096);
+error_ib:
+	amdgpu_cs_ctx_free(s->context);
+	return r;
+}
+
+static void nop_submit_fini(struct nop_submit *s)
+{
+	amdgpu_bo_list_destroy(s->list);
+	unmap_and_free(s->ib_bo, s->ib_va_handle, s->ib_va, 4096);
+	amdgpu_cs_ctx_free(s->context);
+}
+
+static int nop_submit_wait(struct nop_submit *s, uint64_t timeout)
+{
+	struct amdgpu_cs_fence fence = {0};
+	uint32_t expired;
+
+	fence.context = s->context;
+	fence.ip_type = s->request.ip_type;
+	fence.fence = s->request.seq_no;
+	return amdgpu_cs_query_fence_status(&fence, timeout, 0, &expired);
+}
+
+/*
+ * Submissions per second with up to SUBMIT_DEPTH in flight, the latency of
+ * a submission waited for right away, and the cost of asking for a fence
+ * that has already signalled.
+ */
+static void bench_cs(void)
+{
+	struct nop_submit s = {0};
+	struct timer t;
+	char params[32];
+	int r;
+
+	r = nop_submit_init(&s);
+	if (r) {
+		report("cs_nop_submit", NULL, &t, r);
+		return;
+	}
+
+	timer_start(&t);
+	while (timer_running(&t)) {
+		r = amdgpu_cs_submit(s.context, 0, &s.request, 1);
+		if (r)
+			break;
+		if (++t.ops % SUBMIT_DEPTH == 0) {
+			r = nop_submit_wait(&s, AMDGPU_TIMEOUT_INFINITE);
+			if (r)
+				break;
+		}
+	}
+	if (!r)
+		r = nop_submit_wait(&s, AMDGPU_TIMEOUT_INFINITE);
+	snprintf(params, sizeof(params), "\"in_flight\": %d", SUBMIT_DEPTH);
+	report("cs_nop_submit", params, &t, r);
+
+	timer_start(&t);
+	while (timer_running(&t)) {
+		r = amdgpu_cs_submit(s.context, 0, &s.request, 1);
+		if (!r)
+			r = nop_submit_wait(&s, AMDGPU_TIMEOUT_INFINITE);
+		if (r)
+			break;
+		t.ops++;
+	}
+	report("cs_nop_submit_wait", NULL, &t, r);
+
+	timer_start(&t);
+	while (timer_running(&t)) {
+		r = nop_submit_wait(&s, 0);
+		if (r)
+			break;
+		t.ops++;
+	}
+	report("fence_query_signaled", NULL, &t, r);
+
+	nop_submit_fini(&s);
+}
+
+int main(int argc, char **argv)
+{
+	static const uint64_t sizes[] = { 4096, 64 * 1024, 1024 * 1024,
+					  16 * 1024 * 1024 };
+	const char *node = argc > 1 ? argv[1] : "/dev/dri/renderD128";
+	int ms = argc > 2 ? atoi(argv[2]) : 0;
+	const char *name;
+	uint32_t major, minor;
+	unsigned i;
+	int fd, r;
+
+	if (ms <= 0)
+		ms = 250;
+	duration = ms / 1000.0;
+
+	fd = open(node, O_RDWR | O_CLOEXEC);
+	if (fd < 0) {
+		perror(node);
+		return 1;
+	}
+
+	r = amdgpu_device_initialize(fd, &major, &minor, &device);
+	if (r) {
+		fprintf(stderr, "amdgpu_device_initialize: %d\n", r);
+		return 1;
+	}
+
+	name = amdgpu_get_marketing_name(device);
+	printf("{\n  \"device\": \"%s\",\n  \"drm_version\": \"%u.%u\",\n"
+	       "  \"ms_per_test\": %d,\n  \"results\": [",
+	       name ? name : "unknown", major, minor, ms);
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		bench_bo_alloc(AMDGPU_GEM_DOMAIN_GTT, "gtt", sizes[i]);
+		bench_bo_alloc(AMDGPU_GEM_DOMAIN_VRAM, "vram", sizes[i]);
+	}
+	bench_cpu_map(0);
+	bench_cpu_map(1);
+	bench_va_alloc_fragmented();
+	bench_bo_list_create();
+	bench_cs();
+
+	/* Again with the cache, which costs a bucket lookup per call. */
+	amdgpu_device_enable_bo_reuse(device);
+	bo_reuse = 1;
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+		bench_bo_alloc(AMDGPU_GEM_DOMAIN_GTT, "gtt", sizes[i]);
+
+	printf("\n  ]\n}\n");
+
+	amdgpu_device_deinitialize(device);
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,157 @@
+/*
+ * Copyright 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Contention benchmark for amdgpu_bo_import(): several threads repeatedly
+ * import and free dma-bufs of buffers that stay alive for the whole run,
+ * which is what a multi-threaded Vulkan driver does with shared images.
+ *
+ * Usage: amdgpu_bo_import_bench [render node] [threads] [seconds]
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "xf86drm.h"
+#include "amdgpu.h"
+#include "amdgpu_drm.h"
+
+#define NUM_BOS 64
+
+static amdgpu_device_handle device;
+static int dmabuf_fds[NUM_BOS];
+static volatile int stop;
+
+struct thread_result {
+	pthread_t thread;
+	unsigned seed;
+	unsigned long imports;
+	int error;
+};
+
+static void *import_thread(void *data)
+{
+	struct thread_result *res = data;
+	struct amdgpu_bo_import_result out;
+	int r;
+
+	while (!stop) {
+		int fd = dmabuf_fds[rand_r(&res->seed) % NUM_BOS];
+
+		r = amdgpu_bo_import(device, amdgpu_bo_handle_type_dma_buf_fd,
+				     fd, &out);
+		if (r) {
+			res->error = r;
+			break;
+		}
+		amdgpu_bo_free(out.buf_handle);
+		res->imports++;
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	const char *node = argc > 1 ? argv[1] : "/dev/dri/renderD128";
+	int num_threads = argc > 2 ? atoi(argv[2]) : 4;
+	int seconds = argc > 3 ? atoi(argv[3]) : 2;
+	struct amdgpu_bo_alloc_request req = {0};
+	amdgpu_bo_handle bos[NUM_BOS];
+	struct thread_result *threads;
+	struct timespec start, end;
+	uint32_t major, minor, fd_handle;
+	unsigned long total = 0;
+	double elapsed;
+	int fd, i, r;
+
+	if (num_threads < 1)
+		num_threads = 1;
+
+	fd = open(node, O_RDWR | O_CLOEXEC);
+	if (fd < 0) {
+		perror(node);
+		return 1;
+	}
+
+	r = amdgpu_device_initialize(fd, &major, &minor, &device);
+	if (r) {
+		fprintf(stderr, "amdgpu_device_initialize: %d\n", r);
+		return 1;
+	}
+
+	req.alloc_size = 4096;
+	req.phys_alignment = 4096;
+	req.preferred_heap = AMDGPU_GEM_DOMAIN_GTT;
+	for (i = 0; i < NUM_BOS; i++) {
+		r = amdgpu_bo_alloc(device, &req, &bos[i]);
+		if (!r)
+			r = amdgpu_bo_export(bos[i], amdgpu_bo_handle_type_dma_buf_fd,
+					     &fd_handle);
+		if (r) {
+			fprintf(stderr, "buffer setup: %d\n", r);
+			return 1;
+		}
+		dmabuf_fds[i] = fd_handle;
+	}
+
+	threads = calloc(num_threads, sizeof(*threads));
+	if (!threads)
+		return 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < num_threads; i++) {
+		threads[i].seed = i + 1;
+		pthread_create(&threads[i].thread, NULL, import_thread,
+			       &threads[i]);
+	}
+	sleep(seconds);
+	stop = 1;
+	for (i = 0; i < num_threads; i++) {
+		pthread_join(threads[i].thread, NULL);
+		if (threads[i].error)
+			fprintf(stderr, "thread %d: import failed: %d\n", i,
+				threads[i].error);
+		total += threads[i].imports;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	elapsed = (end.tv_sec - start.tv_sec) +
+		  (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%d threads: %lu imports in %.2f s, %.0f imports/s\n",
+	       num_threads, total, elapsed, total / elapsed);
+
+	for (i = 0; i < NUM_BOS; i++) {
+		close(dmabuf_fds[i]);
+		amdgpu_bo_free(bos[i]);
+	}
+	free(threads);
+	amdgpu_device_deinitialize(device);
+	close(fd);
+
+	return 0;
+}
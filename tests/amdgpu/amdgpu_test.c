@@ -68,6 +68,10 @@ int drm_amdgpu[MAX_CARDS_SUPPORTED];
 /** Open render node to test */
 int open_render_node = 0;	/* By default run most tests on primary node */
 
+/** Throughput tests, off by default */
+unsigned throughput_frames = 0;
+unsigned throughput_sessions = 2;
+
 /** The table of all known test suites to run */
 static CU_SuiteInfo suites[] = {
 	{
@@ -240,10 +244,111 @@ static void display_test_suites(void)
 }
 
 
+#define THROUGHPUT_DEPTH	4
+
+static double throughput_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct throughput_slot {
+	struct amdgpu_cs_fence fence;
+	double submitted;
+};
+
+int amdgpu_throughput_run(const char *name,
+			  struct amdgpu_throughput_stream *streams,
+			  unsigned num_streams)
+{
+	double start, t, submit_sum = 0, submit_max = 0;
+	double fence_sum = 0, fence_max = 0, elapsed;
+	struct amdgpu_cs_request request;
+	struct amdgpu_cs_ib_info ib;
+	struct throughput_slot *slots, *slot;
+	unsigned *sent, *done, s, total = 0;
+	uint32_t expired;
+	int r = 0;
+
+	slots = calloc(num_streams * THROUGHPUT_DEPTH, sizeof(*slots));
+	sent = calloc(num_streams, sizeof(*sent));
+	done = calloc(num_streams, sizeof(*done));
+	if (!slots || !sent || !done) {
+		r = -ENOMEM;
+		goto out;
+	}
+
+	start = throughput_now();
+	while (total < num_streams * throughput_frames) {
+		for (s = 0; s < num_streams; s++) {
+			/* retire the oldest submission once the stream is full */
+			if (sent[s] - done[s] == THROUGHPUT_DEPTH ||
+			    (sent[s] == throughput_frames && done[s] < sent[s])) {
+				slot = &slots[s * THROUGHPUT_DEPTH +
+					      done[s] % THROUGHPUT_DEPTH];
+				r = amdgpu_cs_query_fence_status(&slot->fence,
+						AMDGPU_TIMEOUT_INFINITE, 0,
+						&expired);
+				if (r)
+					goto out;
+				t = throughput_now() - slot->submitted;
+				fence_sum += t;
+				fence_max = t > fence_max ? t : fence_max;
+				done[s]++;
+				total++;
+			}
+
+			if (sent[s] == throughput_frames)
+				continue;
+
+			memset(&ib, 0, sizeof(ib));
+			ib.ib_mc_address = streams[s].ib_mc_address;
+			ib.size = streams[s].ib_size;
+			memset(&request, 0, sizeof(request));
+			request.ip_type = streams[s].ip_type;
+			request.ring = streams[s].ring;
+			request.resources = streams[s].resources;
+			request.number_of_ibs = 1;
+			request.ibs = &ib;
+
+			slot = &slots[s * THROUGHPUT_DEPTH +
+				      sent[s] % THROUGHPUT_DEPTH];
+			slot->submitted = throughput_now();
+			r = amdgpu_cs_submit(streams[s].context, 0, &request, 1);
+			if (r)
+				goto out;
+			t = throughput_now() - slot->submitted;
+			submit_sum += t;
+			submit_max = t > submit_max ? t : submit_max;
+
+			slot->fence.context = streams[s].context;
+			slot->fence.ip_type = streams[s].ip_type;
+			slot->fence.ring = streams[s].ring;
+			slot->fence.fence = request.seq_no;
+			sent[s]++;
+		}
+	}
+	elapsed = throughput_now() - start;
+
+	printf("\n%s: %u frames, %u sessions, %.1f frames/s, "
+	       "submit %.1f/%.1f us, fence %.2f/%.2f ms (avg/max)\n",
+	       name, total, num_streams, total / elapsed,
+	       submit_sum / total * 1e6, submit_max * 1e6,
+	       fence_sum / total * 1e3, fence_max * 1e3);
+
+out:
+	free(done);
+	free(sent);
+	free(slots);
+	return r;
+}
+
 /** Help string for command line parameters */
 static const char usage[] =
 	"Usage: %s [-hlpr] [<-s <suite id>> [-t <test id>] [-f]] "
-	"[-b <pci_bus_id> [-d <pci_device_id>]]\n"
+	"[-b <pci_bus_id> [-d <pci_device_id>]] [-n <frames> [-j <sessions>]]\n"
 	"where:\n"
 	"       l - Display all suites and their tests\n"
 	"       r - Run the tests on render node\n"
@@ -251,9 +356,12 @@ static const char usage[] =
 	"       d - Specify device's PCI device id to run tests (optional)\n"
 	"       p - Display information of AMDGPU devices in system\n"
 	"       f - Force executing inactive suite or test\n"
+	"       n - Stream this many frames per session in the video\n"
+	"           throughput tests, which are skipped otherwise\n"
+	"       j - Number of decode sessions in the throughput tests\n"
 	"       h - Display this help\n";
 /** Specified options strings for getopt */
-static const char options[]   = "hlrps:t:b:d:f";
+static const char options[]   = "hlrps:t:b:d:fn:j:";
 
 /* Open AMD devices.
  * Return the number of AMD device opened.
@@ -533,6 +641,14 @@ int main(int argc, char **argv)
 		case 'f':
 			force_run = 1;
 			break;
+		case 'n':
+			throughput_frames = atoi(optarg);
+			break;
+		case 'j':
+			throughput_sessions = atoi(optarg);
+			if (!throughput_sessions)
+				throughput_sessions = 1;
+			break;
 		case '?':
 		case 'h':
 			fprintf(stderr, usage, argv[0]);
@@ -38,6 +38,31 @@ extern int drm_amdgpu[MAX_CARDS_SUPPORTED];
 /* Global variables */
 extern int open_render_node;
 
+/* Frames and sessions of the throughput tests, which are skipped for 0 */
+extern unsigned throughput_frames;
+extern unsigned throughput_sessions;
+
+/**
+ * One stream of identical submissions for amdgpu_throughput_run()
+ */
+struct amdgpu_throughput_stream {
+	amdgpu_context_handle context;
+	amdgpu_bo_list_handle resources;
+	unsigned ip_type;
+	uint32_t ring;
+	uint64_t ib_mc_address;
+	uint32_t ib_size;	/* in dwords */
+};
+
+/**
+ * Submit the IB of each stream throughput_frames times, keeping a few
+ * submissions of every stream in flight, and print frames per second and
+ * the submit and fence latencies.
+ */
+int amdgpu_throughput_run(const char *name,
+			  struct amdgpu_throughput_stream *streams,
+			  unsigned num_streams);
+
 /*************************  Basic test suite ********************************/
 
 /*
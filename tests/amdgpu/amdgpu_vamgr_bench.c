@@ -0,0 +1,283 @@
+/*
+ * Copyright 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Fragmentation stress benchmark for the VA hole allocator.  It first
+ * punches single-page holes into the bottom of the address space, which no
+ * later request fits, then churns a large set of allocations of mixed size
+ * and alignment on top.  At the end everything is freed and the holes must
+ * have coalesced back into one.  A second phase has several threads churn
+ * small ranges, first through the shared manager and then through the
+ * per-thread caches.  The allocator is built into this program, so no GPU
+ * is needed.
+ *
+ * Usage: amdgpu_vamgr_bench [live allocations] [operations] [threads]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "amdgpu.h"
+#include "amdgpu_drm.h"
+#include "amdgpu_internal.h"
+
+#define VA_START	(1ull << 20)
+#define VA_END		(1ull << 47)
+#define VA_ALIGNMENT	4096
+
+#define THREAD_LIVE	64
+
+struct live_va {
+	amdgpu_va_handle handle;
+	uint64_t address;
+	uint64_t size;
+};
+
+struct worker {
+	pthread_t thread;
+	struct amdgpu_device *dev;
+	uint64_t flags;
+	long ops;
+	int num_live;
+	int failed;
+	struct live_va live[THREAD_LIVE];
+};
+
+static int cmp_live(const void *a, const void *b)
+{
+	const struct live_va *la = a, *lb = b;
+
+	return la->address < lb->address ? -1 : la->address > lb->address;
+}
+
+static uint64_t random_size(unsigned *seed)
+{
+	/* Mostly small buffers with the odd large one, like a driver. */
+	switch (rand_r(seed) % 8) {
+	case 0:
+		return (uint64_t)(1 + rand_r(seed) % 64) << 20;
+	case 1:
+	case 2:
+		return (uint64_t)(1 + rand_r(seed) % 512) << 12;
+	default:
+		return (uint64_t)(2 + rand_r(seed) % 16) << 12;
+	}
+}
+
+static double seconds_since(const struct timespec *start)
+{
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) +
+	       (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int check_overlaps(struct live_va *live, int num_live)
+{
+	int i;
+
+	qsort(live, num_live, sizeof(*live), cmp_live);
+	for (i = 1; i < num_live; i++) {
+		if (live[i - 1].address + live[i - 1].size > live[i].address) {
+			fprintf(stderr, "overlapping VA ranges at 0x%llx\n",
+				(unsigned long long)live[i].address);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void *worker_main(void *data)
+{
+	struct worker *w = data;
+	unsigned seed = (unsigned)(uintptr_t)w;
+	long op;
+	int i;
+
+	for (op = 0; op < w->ops; op++) {
+		if (w->num_live == THREAD_LIVE ||
+		    (w->num_live && rand_r(&seed) % 2)) {
+			i = rand_r(&seed) % w->num_live;
+			amdgpu_va_range_free(w->live[i].handle);
+			w->live[i] = w->live[--w->num_live];
+			continue;
+		}
+
+		i = w->num_live;
+		w->live[i].size = (uint64_t)(1 + rand_r(&seed) % 4) << 12;
+		if (amdgpu_va_range_alloc(w->dev, amdgpu_gpu_va_range_general,
+					  w->live[i].size, 0, 0,
+					  &w->live[i].address,
+					  &w->live[i].handle, w->flags)) {
+			w->failed = 1;
+			break;
+		}
+		w->num_live++;
+	}
+	return NULL;
+}
+
+static int run_threads(struct amdgpu_device *dev, int threads, long ops,
+		       uint64_t flags, const char *name)
+{
+	struct worker *w = calloc(threads, sizeof(*w));
+	struct live_va *all = calloc(threads, sizeof(w->live));
+	struct timespec start;
+	double elapsed;
+	int i, j, num = 0, r = -1;
+
+	if (!w || !all)
+		goto out;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < threads; i++) {
+		w[i].dev = dev;
+		w[i].flags = flags;
+		w[i].ops = ops / threads;
+		pthread_create(&w[i].thread, NULL, worker_main, &w[i]);
+	}
+	for (i = 0; i < threads; i++)
+		pthread_join(w[i].thread, NULL);
+	elapsed = seconds_since(&start);
+
+	printf("%s: %d threads, %.0f ops/s\n", name, threads, ops / elapsed);
+
+	for (i = 0; i < threads; i++) {
+		if (w[i].failed) {
+			fprintf(stderr, "%s: allocation failed\n", name);
+			goto out;
+		}
+		for (j = 0; j < w[i].num_live; j++)
+			all[num++] = w[i].live[j];
+	}
+	r = check_overlaps(all, num);
+	for (i = 0; i < num; i++)
+		amdgpu_va_range_free(all[i].handle);
+out:
+	free(all);
+	free(w);
+	return r;
+}
+
+int main(int argc, char **argv)
+{
+	int max_live = argc > 1 ? atoi(argv[1]) : 20000;
+	long ops = argc > 2 ? atol(argv[2]) : 1000000;
+	int threads = argc > 3 ? atoi(argv[3]) : 4;
+	struct amdgpu_device dev = {0};
+	struct live_va *live;
+	struct timespec start;
+	unsigned seed = 1;
+	uint64_t alignment;
+	int num_live = 0, i, r;
+	double elapsed;
+	long op;
+
+	if (max_live < 1)
+		max_live = 1;
+	live = calloc(max_live, sizeof(*live));
+	if (!live)
+		return 1;
+
+	amdgpu_vamgr_init(&dev.vamgr, VA_START, VA_END, VA_ALIGNMENT);
+	amdgpu_vamgr_init(&dev.vamgr_32, VA_START, VA_START, VA_ALIGNMENT);
+
+	/* Leave a page-sized hole after every other page. */
+	for (i = 0; i < max_live; i++) {
+		live[i].size = VA_ALIGNMENT;
+		r = amdgpu_va_range_alloc(&dev, amdgpu_gpu_va_range_general,
+					  live[i].size, 0, 0, &live[i].address,
+					  &live[i].handle, 0);
+		if (r) {
+			fprintf(stderr, "allocation failed: %d\n", r);
+			return 1;
+		}
+	}
+	for (i = 0; i < max_live; i++) {
+		if (i % 2)
+			amdgpu_va_range_free(live[i].handle);
+		else
+			live[num_live++] = live[i];
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (op = 0; op < ops; op++) {
+		if (num_live == max_live ||
+		    (num_live && rand_r(&seed) % 2)) {
+			i = rand_r(&seed) % num_live;
+			amdgpu_va_range_free(live[i].handle);
+			live[i] = live[--num_live];
+			continue;
+		}
+
+		alignment = (rand_r(&seed) % 4 == 0) ? 1ull << 21 : 0;
+		live[num_live].size = random_size(&seed);
+		r = amdgpu_va_range_alloc(&dev, amdgpu_gpu_va_range_general,
+					  live[num_live].size, alignment, 0,
+					  &live[num_live].address,
+					  &live[num_live].handle, 0);
+		if (r) {
+			fprintf(stderr, "allocation failed: %d\n", r);
+			return 1;
+		}
+		if (alignment && live[num_live].address % alignment) {
+			fprintf(stderr, "misaligned VA 0x%llx\n",
+				(unsigned long long)live[num_live].address);
+			return 1;
+		}
+		num_live++;
+	}
+	elapsed = seconds_since(&start);
+	printf("%ld operations with up to %d live ranges in %.2f s, %.0f ops/s\n",
+	       ops, max_live, elapsed, ops / elapsed);
+
+	if (check_overlaps(live, num_live))
+		return 1;
+	for (i = 0; i < num_live; i++)
+		amdgpu_va_range_free(live[i].handle);
+
+	if (threads < 1)
+		threads = 1;
+	if (run_threads(&dev, threads, ops, 0, "shared") ||
+	    run_threads(&dev, threads, ops, AMDGPU_VA_RANGE_THREAD_CACHE,
+			"thread cache"))
+		return 1;
+
+	amdgpu_vamgr_flush_cache(&dev.vamgr);
+
+	if (!dev.vamgr.va_holes || dev.vamgr.va_holes->left ||
+	    dev.vamgr.va_holes->right ||
+	    dev.vamgr.va_holes->offset != VA_START ||
+	    dev.vamgr.va_holes->size != VA_END - VA_START) {
+		fprintf(stderr, "holes did not coalesce\n");
+		return 1;
+	}
+
+	amdgpu_vamgr_deinit(&dev.vamgr);
+	amdgpu_vamgr_deinit(&dev.vamgr_32);
+	free(live);
+	return 0;
+}
@@ -21,7 +21,9 @@
  *
 */
 
+#include <errno.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "CUnit/Basic.h"
 
@@ -46,6 +48,11 @@ static void amdgpu_bo_map_unmap(void);
 static void amdgpu_memory_alloc(void);
 static void amdgpu_mem_fail_alloc(void);
 static void amdgpu_bo_find_by_cpu_mapping(void);
+static void amdgpu_bo_reuse(void);
+static void amdgpu_bo_slab(void);
+static void amdgpu_bo_va_batch(void);
+static void amdgpu_bo_upload_ring(void);
+static void amdgpu_host_pool(void);
 
 CU_TestInfo bo_tests[] = {
 	{ "Export/Import",  amdgpu_bo_export_import },
@@ -54,6 +61,11 @@ CU_TestInfo bo_tests[] = {
 	{ "Memory alloc Test",  amdgpu_memory_alloc },
 	{ "Memory fail alloc Test",  amdgpu_mem_fail_alloc },
 	{ "Find bo by CPU mapping",  amdgpu_bo_find_by_cpu_mapping },
+	{ "BO reuse",  amdgpu_bo_reuse },
+	{ "Slab suballocation",  amdgpu_bo_slab },
+	{ "Batched VA operations",  amdgpu_bo_va_batch },
+	{ "Upload ring",  amdgpu_bo_upload_ring },
+	{ "Host memory pool",  amdgpu_host_pool },
 	CU_TEST_INFO_NULL,
 };
 
@@ -179,6 +191,25 @@ static void amdgpu_bo_metadata(void)
 
 	CU_ASSERT_EQUAL(info.metadata.size_metadata, 1);
 	CU_ASSERT_EQUAL(info.metadata.umd_metadata[0], 0xdeadbeef);
+
+	/* Setting the metadata again drops the cached copy */
+	meta.umd_metadata[0] = 0xcafef00d;
+	r = amdgpu_bo_set_metadata(buffer_handle, &meta);
+	CU_ASSERT_EQUAL(r, 0);
+
+	r = amdgpu_bo_query_info(buffer_handle, &info);
+	CU_ASSERT_EQUAL(r, 0);
+	CU_ASSERT_EQUAL(info.metadata.umd_metadata[0], 0xcafef00d);
+
+	memset(&info, 0, sizeof(info));
+	r = amdgpu_bo_query_info2(buffer_handle, AMDGPU_BO_QUERY_INFO_REFRESH,
+				  &info);
+	CU_ASSERT_EQUAL(r, 0);
+	CU_ASSERT_EQUAL(info.metadata.size_metadata, 1);
+	CU_ASSERT_EQUAL(info.metadata.umd_metadata[0], 0xcafef00d);
+
+	r = amdgpu_bo_query_info2(buffer_handle, ~0u, &info);
+	CU_ASSERT_EQUAL(r, -EINVAL);
 }
 
 static void amdgpu_bo_map_unmap(void)
@@ -315,3 +346,200 @@ static void amdgpu_bo_find_by_cpu_mapping(void)
 				     bo_mc_address, 4096);
 	CU_ASSERT_EQUAL(r, 0);
 }
+
+static void amdgpu_bo_reuse(void)
+{
+	struct amdgpu_bo_alloc_request req = {0};
+	amdgpu_bo_handle bo, reused, other;
+	uint32_t handle;
+	int r;
+
+	amdgpu_device_enable_bo_reuse(device_handle);
+
+	req.alloc_size = BUFFER_SIZE;
+	req.phys_alignment = BUFFER_ALIGN;
+	req.preferred_heap = AMDGPU_GEM_DOMAIN_GTT;
+
+	r = amdgpu_bo_alloc(device_handle, &req, &bo);
+	CU_ASSERT_EQUAL(r, 0);
+	handle = bo->handle;
+	r = amdgpu_bo_free(bo);
+	CU_ASSERT_EQUAL(r, 0);
+
+	/* An idle buffer with the same parameters comes back */
+	r = amdgpu_bo_alloc(device_handle, &req, &reused);
+	CU_ASSERT_EQUAL(r, 0);
+	CU_ASSERT_EQUAL(reused->handle, handle);
+
+	/* A different heap doesn't match */
+	req.preferred_heap = AMDGPU_GEM_DOMAIN_VRAM;
+	r = amdgpu_bo_alloc(device_handle, &req, &other);
+	CU_ASSERT_EQUAL(r, 0);
+	CU_ASSERT_NOT_EQUAL(other->handle, handle);
+
+	r = amdgpu_bo_free(other);
+	CU_ASSERT_EQUAL(r, 0);
+	r = amdgpu_bo_free(reused);
+	CU_ASSERT_EQUAL(r, 0);
+}
+
+static void amdgpu_bo_slab(void)
+{
+	struct amdgpu_bo_slab_entry *a, *b;
+	amdgpu_bo_slab_handle slab;
+	int r;
+
+	r = amdgpu_bo_slab_create(device_handle, AMDGPU_GEM_DOMAIN_GTT, 0,
+				  &slab);
+	CU_ASSERT_EQUAL(r, 0);
+
+	r = amdgpu_bo_slab_alloc(slab, 1000, &a);
+	CU_ASSERT_EQUAL(r, 0);
+	r = amdgpu_bo_slab_alloc(slab, 1024, &b);
+	CU_ASSERT_EQUAL(r, 0);
+
+	/* Same size class, so both come out of one parent buffer */
+	CU_ASSERT_EQUAL(a->bo, b->bo);
+	CU_ASSERT_EQUAL(a->size, 1024);
+	CU_ASSERT_NOT_EQUAL(a->offset, b->offset);
+	CU_ASSERT_EQUAL(b->va - a->va, b->offset - a->offset);
+	CU_ASSERT_NOT_EQUAL(a->cpu, NULL);
+	memset(a->cpu, 0xaa, a->size);
+	memset(b->cpu, 0x55, b->size);
+	CU_ASSERT_EQUAL(((uint8_t *)a->cpu)[a->size - 1], 0xaa);
+
+	r = amdgpu_bo_slab_alloc(slab, 128 * 1024, &a);
+	CU_ASSERT_EQUAL(r, -EINVAL);
+
+	r = amdgpu_bo_slab_free(b);
+	CU_ASSERT_EQUAL(r, 0);
+	r = amdgpu_bo_slab_destroy(slab);
+	CU_ASSERT_EQUAL(r, 0);
+}
+
+static void amdgpu_bo_va_batch(void)
+{
+	struct amdgpu_bo_alloc_request req = {0};
+	amdgpu_bo_va_batch_handle batch;
+	amdgpu_bo_handle bo;
+	amdgpu_va_handle va_range;
+	uint64_t va, flags;
+	int r;
+
+	req.alloc_size = 2 * BUFFER_SIZE;
+	req.phys_alignment = BUFFER_ALIGN;
+	req.preferred_heap = AMDGPU_GEM_DOMAIN_GTT;
+	r = amdgpu_bo_alloc(device_handle, &req, &bo);
+	CU_ASSERT_EQUAL(r, 0);
+
+	r = amdgpu_va_range_alloc(device_handle, amdgpu_gpu_va_range_general,
+				  2 * BUFFER_SIZE, BUFFER_ALIGN, 0, &va,
+				  &va_range, 0);
+	CU_ASSERT_EQUAL(r, 0);
+
+	r = amdgpu_bo_va_batch_create(device_handle, AMDGPU_VA_BATCH_MERGE_MAPS,
+				      &batch);
+	CU_ASSERT_EQUAL(r, 0);
+
+	/* Two halves that become one mapping */
+	flags = AMDGPU_VM_PAGE_READABLE | AMDGPU_VM_PAGE_WRITEABLE;
+	r = amdgpu_bo_va_batch_add(batch, bo, 0, BUFFER_SIZE, va, flags,
+				   AMDGPU_VA_OP_MAP);
+	CU_ASSERT_EQUAL(r, 0);
+	r = amdgpu_bo_va_batch_add(batch, bo, BUFFER_SIZE, BUFFER_SIZE,
+				   va + BUFFER_SIZE, flags, AMDGPU_VA_OP_MAP);
+	CU_ASSERT_EQUAL(r, 0);
+
+	/* The queue keeps the buffer alive until the flush */
+	r = amdgpu_bo_free(bo);
+	CU_ASSERT_EQUAL(r, 0);
+	r = amdgpu_bo_va_batch_flush(batch);
+	CU_ASSERT_EQUAL(r, 0);
+
+	r = amdgpu_bo_va_batch_add(batch, NULL, 0, 2 * BUFFER_SIZE, va, 0,
+				   AMDGPU_VA_OP_CLEAR);
+	CU_ASSERT_EQUAL(r, 0);
+	r = amdgpu_bo_va_batch_flush(batch);
+	CU_ASSERT_EQUAL(r, 0);
+
+	r = amdgpu_bo_va_batch_add(batch, NULL, 0, BUFFER_SIZE, va, 0, 42);
+	CU_ASSERT_EQUAL(r, -EINVAL);
+
+	r = amdgpu_bo_va_batch_destroy(batch);
+	CU_ASSERT_EQUAL(r, 0);
+	r = amdgpu_va_range_free(va_range);
+	CU_ASSERT_EQUAL(r, 0);
+}
+
+static void amdgpu_bo_upload_ring(void)
+{
+	struct amdgpu_upload_chunk a, b;
+	amdgpu_upload_ring_handle ring;
+	int r;
+
+	r = amdgpu_upload_ring_create(device_handle, 3 * BUFFER_SIZE,
+				      AMDGPU_GEM_CREATE_CPU_GTT_USWC, &ring);
+	CU_ASSERT_EQUAL(r, 0);
+
+	r = amdgpu_upload_ring_alloc(ring, 1000, 0, 0, &a);
+	CU_ASSERT_EQUAL(r, 0);
+	r = amdgpu_upload_ring_alloc(ring, BUFFER_SIZE, 256, 0, &b);
+	CU_ASSERT_EQUAL(r, 0);
+
+	CU_ASSERT_EQUAL(a.bo, b.bo);
+	CU_ASSERT_EQUAL(b.offset, 1024);
+	CU_ASSERT_EQUAL(b.va - a.va, b.offset - a.offset);
+	memset(a.cpu, 0xaa, 1000);
+	memset(b.cpu, 0x55, BUFFER_SIZE);
+	CU_ASSERT_EQUAL(((uint8_t *)a.cpu)[999], 0xaa);
+
+	/* Nothing was fenced, so the space can't be reclaimed */
+	r = amdgpu_upload_ring_alloc(ring, 2 * BUFFER_SIZE, 0, 0, &a);
+	CU_ASSERT_EQUAL(r, -ENOSPC);
+	r = amdgpu_upload_ring_alloc(ring, 4 * BUFFER_SIZE, 0, 0, &a);
+	CU_ASSERT_EQUAL(r, -EINVAL);
+
+	r = amdgpu_upload_ring_destroy(ring);
+	CU_ASSERT_EQUAL(r, 0);
+}
+
+static void amdgpu_host_pool(void)
+{
+	struct amdgpu_host_pool_entry *a, *b, *c;
+	amdgpu_host_pool_handle pool;
+	int r;
+
+	r = amdgpu_host_pool_create(device_handle, 0, 0, &pool);
+	CU_ASSERT_EQUAL(r, 0);
+
+	r = amdgpu_host_pool_alloc(pool, 1000, 0, &a);
+	CU_ASSERT_EQUAL(r, 0);
+	r = amdgpu_host_pool_alloc(pool, 64 * 1024, 64 * 1024, &b);
+	CU_ASSERT_EQUAL(r, 0);
+
+	/* Both come out of one registered chunk */
+	CU_ASSERT_EQUAL(a->bo, b->bo);
+	CU_ASSERT_EQUAL(a->size, 1024);
+	CU_ASSERT_EQUAL(b->offset % (64 * 1024), 0);
+	CU_ASSERT_EQUAL(b->va - a->va, b->offset - a->offset);
+	memset(a->cpu, 0xaa, a->size);
+	memset(b->cpu, 0x55, b->size);
+	CU_ASSERT_EQUAL(((uint8_t *)a->cpu)[a->size - 1], 0xaa);
+
+	/* The hole left by a is reused */
+	r = amdgpu_host_pool_free(a);
+	CU_ASSERT_EQUAL(r, 0);
+	r = amdgpu_host_pool_alloc(pool, 512, 0, &c);
+	CU_ASSERT_EQUAL(r, 0);
+	CU_ASSERT_EQUAL(c->offset, 0);
+
+	r = amdgpu_host_pool_alloc(pool, 4096, 4 * 1024 * 1024, &a);
+	CU_ASSERT_EQUAL(r, -EINVAL);
+
+	r = amdgpu_host_pool_free(c);
+	CU_ASSERT_EQUAL(r, 0);
+	r = amdgpu_host_pool_free(b);
+	CU_ASSERT_EQUAL(r, 0);
+	r = amdgpu_host_pool_destroy(pool);
+	CU_ASSERT_EQUAL(r, 0);
+}
@@ -193,6 +193,28 @@ static int submit(unsigned ndw, unsigned ip)
 	return 0;
 }
 
+/* Streams the IB of length ndw through the test's context. */
+static void stream(const char *name, unsigned ndw, unsigned ip)
+{
+	struct amdgpu_throughput_stream s = {0};
+	int r;
+
+	s.context = context_handle;
+	s.ip_type = ip;
+	s.ib_mc_address = ib_mc_address;
+	s.ib_size = ndw;
+
+	r = amdgpu_bo_list_create(device_handle, num_resources, resources,
+				  NULL, &s.resources);
+	CU_ASSERT_EQUAL(r, 0);
+
+	r = amdgpu_throughput_run(name, &s, 1);
+	CU_ASSERT_EQUAL(r, 0);
+
+	r = amdgpu_bo_list_destroy(s.resources);
+	CU_ASSERT_EQUAL(r, 0);
+}
+
 static void alloc_resource(struct amdgpu_uvd_enc_bo *uvd_enc_bo,
 			unsigned size, unsigned domain)
 {
@@ -456,6 +478,9 @@ static void amdgpu_cs_uvd_enc_encode(void)
 
 	check_result(&enc);
 
+	if (throughput_frames)
+		stream("UVD ENC", len, AMDGPU_HW_IP_UVD_ENC);
+
 	free_resource(&enc.fb);
 	free_resource(&enc.bs);
 	free_resource(&enc.vbuf);
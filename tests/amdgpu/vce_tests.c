@@ -235,6 +235,28 @@ static int submit(unsigned ndw, unsigned ip)
 	return 0;
 }
 
+/* Streams the IB of length ndw through the test's context. */
+static void stream(const char *name, unsigned ndw, unsigned ip)
+{
+	struct amdgpu_throughput_stream s = {0};
+	int r;
+
+	s.context = context_handle;
+	s.ip_type = ip;
+	s.ib_mc_address = ib_mc_address;
+	s.ib_size = ndw;
+
+	r = amdgpu_bo_list_create(device_handle, num_resources, resources,
+				  NULL, &s.resources);
+	CU_ASSERT_EQUAL(r, 0);
+
+	r = amdgpu_throughput_run(name, &s, 1);
+	CU_ASSERT_EQUAL(r, 0);
+
+	r = amdgpu_bo_list_destroy(s.resources);
+	CU_ASSERT_EQUAL(r, 0);
+}
+
 static void alloc_resource(struct amdgpu_vce_bo *vce_bo, unsigned size, unsigned domain)
 {
 	struct amdgpu_bo_alloc_request req = {0};
@@ -453,6 +475,7 @@ static void amdgpu_cs_vce_encode_p(struct amdgpu_vce_encode *enc)
 	ib_cpu[len + 81] = 1;
 	ib_cpu[len + 82] = 1;
 	len += sizeof(vce_encode) / 4;
+	enc->ib_len = len;
 
 	r = submit(len, AMDGPU_HW_IP_VCE);
 	CU_ASSERT_EQUAL(r, 0);
@@ -554,6 +577,10 @@ static void amdgpu_cs_vce_encode(void)
 		check_result(&enc);
 	}
 
+	/* the IB is still the one of the last P frame */
+	if (throughput_frames)
+		stream("VCE ENC", enc.ib_len, AMDGPU_HW_IP_VCE);
+
 	free_resource(&enc.fb[0]);
 	free_resource(&enc.fb[1]);
 	free_resource(&enc.bs[0]);
@@ -22,6 +22,7 @@
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <inttypes.h>
 
 #include "CUnit/Basic.h"
@@ -69,6 +70,7 @@ static struct amdgpu_vcn_reg reg;
 
 static void amdgpu_cs_vcn_dec_create(void);
 static void amdgpu_cs_vcn_dec_decode(void);
+static void amdgpu_cs_vcn_dec_throughput(void);
 static void amdgpu_cs_vcn_dec_destroy(void);
 
 static void amdgpu_cs_vcn_enc_create(void);
@@ -79,6 +81,7 @@ CU_TestInfo vcn_tests[] = {
 
 	{ "VCN DEC create",  amdgpu_cs_vcn_dec_create },
 	{ "VCN DEC decode",  amdgpu_cs_vcn_dec_decode },
+	{ "VCN DEC throughput",  amdgpu_cs_vcn_dec_throughput },
 	{ "VCN DEC destroy",  amdgpu_cs_vcn_dec_destroy },
 
 	{ "VCN ENC create",  amdgpu_cs_vcn_enc_create },
@@ -259,19 +262,32 @@ static void free_resource(struct amdgpu_vcn_bo *vcn_bo)
 	memset(vcn_bo, 0, sizeof(*vcn_bo));
 }
 
-static void vcn_dec_cmd(uint64_t addr, unsigned cmd, int *idx)
+static void vcn_dec_cmd(uint32_t *ib, uint64_t addr, unsigned cmd, int *idx)
 {
-	ib_cpu[(*idx)++] = reg.data0;
-	ib_cpu[(*idx)++] = addr;
-	ib_cpu[(*idx)++] = reg.data1;
-	ib_cpu[(*idx)++] = addr >> 32;
-	ib_cpu[(*idx)++] = reg.cmd;
-	ib_cpu[(*idx)++] = cmd << 1;
+	ib[(*idx)++] = reg.data0;
+	ib[(*idx)++] = addr;
+	ib[(*idx)++] = reg.data1;
+	ib[(*idx)++] = addr >> 32;
+	ib[(*idx)++] = reg.cmd;
+	ib[(*idx)++] = cmd << 1;
 }
 
-static void amdgpu_cs_vcn_dec_create(void)
+/* The messages carry the session handle at this offset. */
+#define VCN_DEC_MSG_HANDLE	16
+
+static uint32_t vcn_dec_handle(unsigned session)
+{
+	uint32_t handle;
+
+	memcpy(&handle, vcn_dec_create_msg + VCN_DEC_MSG_HANDLE,
+	       sizeof(handle));
+	return handle + session;
+}
+
+static void amdgpu_cs_vcn_dec_create_session(unsigned session)
 {
 	struct amdgpu_vcn_bo msg_buf;
+	uint32_t handle = vcn_dec_handle(session);
 	int len, r;
 
 	num_resources  = 0;
@@ -284,6 +300,7 @@ static void amdgpu_cs_vcn_dec_create(void)
 
 	memset(msg_buf.ptr, 0, 4096);
 	memcpy(msg_buf.ptr, vcn_dec_create_msg, sizeof(vcn_dec_create_msg));
+	memcpy(msg_buf.ptr + VCN_DEC_MSG_HANDLE, &handle, sizeof(handle));
 
 	len = 0;
 	ib_cpu[len++] = reg.data0;
@@ -303,12 +320,24 @@ static void amdgpu_cs_vcn_dec_create(void)
 	free_resource(&msg_buf);
 }
 
-static void amdgpu_cs_vcn_dec_decode(void)
+static void amdgpu_cs_vcn_dec_create(void)
 {
-	const unsigned dpb_size = 15923584, dt_size = 737280;
-	uint64_t msg_addr, fb_addr, bs_addr, dpb_addr, ctx_addr, dt_addr, it_addr, sum;
-	struct amdgpu_vcn_bo dec_buf;
-	int size, len, i, r;
+	amdgpu_cs_vcn_dec_create_session(0);
+}
+
+static const unsigned vcn_dec_dt_size = 737280;
+
+/*
+ * Allocates and fills the buffers for decoding a frame in a session and
+ * writes the IB.  Returns the IB size in dwords and the decoded image.
+ */
+static int vcn_dec_prepare(struct amdgpu_vcn_bo *dec_buf, uint32_t *ib,
+			   unsigned session, uint8_t **dt)
+{
+	const unsigned dpb_size = 15923584, dt_size = vcn_dec_dt_size;
+	uint64_t msg_addr, fb_addr, bs_addr, dpb_addr, ctx_addr, dt_addr, it_addr;
+	uint32_t handle = vcn_dec_handle(session);
+	int size, len, r;
 	uint8_t *dec;
 
 	size = 4*1024; /* msg */
@@ -318,18 +347,16 @@ static void amdgpu_cs_vcn_dec_decode(void)
 	size += ALIGN(dpb_size, 4*1024);
 	size += ALIGN(dt_size, 4*1024);
 
-	num_resources  = 0;
-	alloc_resource(&dec_buf, size, AMDGPU_GEM_DOMAIN_GTT);
-	resources[num_resources++] = dec_buf.handle;
-	resources[num_resources++] = ib_handle;
+	alloc_resource(dec_buf, size, AMDGPU_GEM_DOMAIN_GTT);
 
-	r = amdgpu_bo_cpu_map(dec_buf.handle, (void **)&dec_buf.ptr);
-	dec = dec_buf.ptr;
+	r = amdgpu_bo_cpu_map(dec_buf->handle, (void **)&dec_buf->ptr);
+	dec = dec_buf->ptr;
 
 	CU_ASSERT_EQUAL(r, 0);
-	memset(dec_buf.ptr, 0, size);
-	memcpy(dec_buf.ptr, vcn_dec_decode_msg, sizeof(vcn_dec_decode_msg));
-	memcpy(dec_buf.ptr + sizeof(vcn_dec_decode_msg),
+	memset(dec_buf->ptr, 0, size);
+	memcpy(dec_buf->ptr, vcn_dec_decode_msg, sizeof(vcn_dec_decode_msg));
+	memcpy(dec_buf->ptr + VCN_DEC_MSG_HANDLE, &handle, sizeof(handle));
+	memcpy(dec_buf->ptr + sizeof(vcn_dec_decode_msg),
 			avc_decode_msg, sizeof(avc_decode_msg));
 
 	dec += 4*1024;
@@ -343,7 +370,7 @@ static void amdgpu_cs_vcn_dec_decode(void)
 
 	dec += ALIGN(dpb_size, 4*1024);
 
-	msg_addr = dec_buf.addr;
+	msg_addr = dec_buf->addr;
 	fb_addr = msg_addr + 4*1024;
 	it_addr = fb_addr + 4*1024;
 	bs_addr = it_addr + 4*1024;
@@ -352,35 +379,126 @@ static void amdgpu_cs_vcn_dec_decode(void)
 	dt_addr = ALIGN(dpb_addr + dpb_size, 4*1024);
 
 	len = 0;
-	vcn_dec_cmd(msg_addr, 0x0, &len);
-	vcn_dec_cmd(dpb_addr, 0x1, &len);
-	vcn_dec_cmd(dt_addr, 0x2, &len);
-	vcn_dec_cmd(fb_addr, 0x3, &len);
-	vcn_dec_cmd(bs_addr, 0x100, &len);
-	vcn_dec_cmd(it_addr, 0x204, &len);
-	vcn_dec_cmd(ctx_addr, 0x206, &len);
-
-	ib_cpu[len++] = reg.cntl;
-	ib_cpu[len++] = 0x1;
+	vcn_dec_cmd(ib, msg_addr, 0x0, &len);
+	vcn_dec_cmd(ib, dpb_addr, 0x1, &len);
+	vcn_dec_cmd(ib, dt_addr, 0x2, &len);
+	vcn_dec_cmd(ib, fb_addr, 0x3, &len);
+	vcn_dec_cmd(ib, bs_addr, 0x100, &len);
+	vcn_dec_cmd(ib, it_addr, 0x204, &len);
+	vcn_dec_cmd(ib, ctx_addr, 0x206, &len);
+
+	ib[len++] = reg.cntl;
+	ib[len++] = 0x1;
 	for (; len % 16; ) {
-		ib_cpu[len++] = reg.nop;
-		ib_cpu[len++] = 0;
+		ib[len++] = reg.nop;
+		ib[len++] = 0;
 	}
 
+	*dt = dec;
+	return len;
+}
+
+static uint64_t vcn_dec_sum(const uint8_t *dt)
+{
+	uint64_t sum = 0;
+	unsigned i;
+
+	for (i = 0; i < vcn_dec_dt_size; ++i)
+		sum += dt[i];
+	return sum;
+}
+
+static void amdgpu_cs_vcn_dec_decode(void)
+{
+	struct amdgpu_vcn_bo dec_buf;
+	uint8_t *dt;
+	int len, r;
+
+	len = vcn_dec_prepare(&dec_buf, ib_cpu, 0, &dt);
+	num_resources  = 0;
+	resources[num_resources++] = dec_buf.handle;
+	resources[num_resources++] = ib_handle;
+
 	r = submit(len, AMDGPU_HW_IP_VCN_DEC);
 	CU_ASSERT_EQUAL(r, 0);
 
-	for (i = 0, sum = 0; i < dt_size; ++i)
-		sum += dec[i];
-
-	CU_ASSERT_EQUAL(sum, SUM_DECODE);
+	CU_ASSERT_EQUAL(vcn_dec_sum(dt), SUM_DECODE);
 
 	free_resource(&dec_buf);
 }
 
-static void amdgpu_cs_vcn_dec_destroy(void)
+static void amdgpu_cs_vcn_dec_destroy_session(unsigned session);
+
+/*
+ * Streams throughput_frames decodes through each of throughput_sessions
+ * sessions; session 0 is the one of "VCN DEC create", the others are
+ * created here.  Every session has buffers and an IB of its own, so the
+ * same IB can be submitted again and again.
+ */
+static void amdgpu_cs_vcn_dec_throughput(void)
+{
+	struct amdgpu_throughput_stream *streams;
+	struct amdgpu_vcn_bo *dec_bufs, *ibs;
+	amdgpu_bo_handle list[2];
+	uint8_t *dt = NULL, *session_dt;
+	unsigned i;
+	int r;
+
+	if (!throughput_frames)
+		return;
+
+	streams = calloc(throughput_sessions, sizeof(*streams));
+	dec_bufs = calloc(throughput_sessions, sizeof(*dec_bufs));
+	ibs = calloc(throughput_sessions, sizeof(*ibs));
+	CU_ASSERT_NOT_EQUAL(streams, NULL);
+	CU_ASSERT_NOT_EQUAL(dec_bufs, NULL);
+	CU_ASSERT_NOT_EQUAL(ibs, NULL);
+
+	for (i = 0; i < throughput_sessions; i++) {
+		if (i)
+			amdgpu_cs_vcn_dec_create_session(i);
+
+		alloc_resource(&ibs[i], IB_SIZE, AMDGPU_GEM_DOMAIN_GTT);
+		r = amdgpu_bo_cpu_map(ibs[i].handle, (void **)&ibs[i].ptr);
+		CU_ASSERT_EQUAL(r, 0);
+
+		streams[i].context = context_handle;
+		streams[i].ip_type = AMDGPU_HW_IP_VCN_DEC;
+		streams[i].ib_mc_address = ibs[i].addr;
+		streams[i].ib_size = vcn_dec_prepare(&dec_bufs[i],
+						     (uint32_t *)ibs[i].ptr,
+						     i, &session_dt);
+		if (!i)
+			dt = session_dt;
+
+		list[0] = dec_bufs[i].handle;
+		list[1] = ibs[i].handle;
+		r = amdgpu_bo_list_create(device_handle, 2, list, NULL,
+					  &streams[i].resources);
+		CU_ASSERT_EQUAL(r, 0);
+	}
+
+	r = amdgpu_throughput_run("VCN DEC", streams, throughput_sessions);
+	CU_ASSERT_EQUAL(r, 0);
+	CU_ASSERT_EQUAL(vcn_dec_sum(dt), SUM_DECODE);
+
+	for (i = 0; i < throughput_sessions; i++) {
+		amdgpu_bo_list_destroy(streams[i].resources);
+		amdgpu_bo_cpu_unmap(ibs[i].handle);
+		free_resource(&ibs[i]);
+		free_resource(&dec_bufs[i]);
+		if (i)
+			amdgpu_cs_vcn_dec_destroy_session(i);
+	}
+	free(ibs);
+	free(dec_bufs);
+	free(streams);
+}
+
+static void amdgpu_cs_vcn_dec_destroy_session(unsigned session)
 {
 	struct amdgpu_vcn_bo msg_buf;
+	uint32_t handle = vcn_dec_handle(session);
 	int len, r;
 
 	num_resources  = 0;
@@ -393,6 +511,7 @@ static void amdgpu_cs_vcn_dec_destroy(void)
 
 	memset(msg_buf.ptr, 0, 1024);
 	memcpy(msg_buf.ptr, vcn_dec_destroy_msg, sizeof(vcn_dec_destroy_msg));
+	memcpy(msg_buf.ptr + VCN_DEC_MSG_HANDLE, &handle, sizeof(handle));
 
 	len = 0;
 	ib_cpu[len++] = reg.data0;
@@ -412,6 +531,11 @@ static void amdgpu_cs_vcn_dec_destroy(void)
 	free_resource(&msg_buf);
 }
 
+static void amdgpu_cs_vcn_dec_destroy(void)
+{
+	amdgpu_cs_vcn_dec_destroy_session(0);
+}
+
 static void amdgpu_cs_vcn_enc_create(void)
 {
 	/* TODO */
@@ -0,0 +1,228 @@
+/*
+ * Copyright 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+/*
+ * libdrm-bench: one harness for the libdrm benchmarks that CI runs across
+ * upgrades.  Suites cover the core containers, atomic request building and
+ * committing, event dispatch, device enumeration and, when the device is
+ * driven by a driver libdrm has a library for, its buffer and submission
+ * paths.  Results are printed as JSON.
+ *
+ * Usage: libdrm-bench [-d device node] [-t milliseconds per test]
+ *                     [-s suite[,suite...]] [-l]
+ *
+ * Without -d the first device with a primary node is used, and the suites
+ * that need none still run when there isn't one.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "xf86drm.h"
+#include "bench.h"
+
+static const struct bench_suite *suites[] = {
+	&bench_core,
+	&bench_atomic,
+	&bench_events,
+	&bench_device,
+#ifdef BENCH_AMDGPU
+	&bench_amdgpu,
+#endif
+#ifdef BENCH_INTEL
+	&bench_intel,
+#endif
+};
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void bench_timer_start(struct bench_ctx *ctx, struct bench_timer *t)
+{
+	t->ops = 0;
+	t->elapsed = 0;
+	t->duration = ctx->duration;
+	t->start = now();
+}
+
+int bench_timer_running(struct bench_timer *t)
+{
+	t->elapsed = now() - t->start;
+	return t->elapsed < t->duration;
+}
+
+void bench_report(struct bench_ctx *ctx, const char *name,
+		  const char *params, struct bench_timer *t, int error)
+{
+	printf("%s\n    { \"name\": \"%s.%s\"", ctx->num_results++ ? "," : "",
+	       ctx->suite, name);
+	if (params)
+		printf(", %s", params);
+	if (error || !t)
+		printf(", \"error\": %d }", error ? error : -EINVAL);
+	else
+		printf(", \"ops\": %lu, \"ops_per_sec\": %.1f, \"ns_per_op\": %.1f }",
+		       t->ops, t->elapsed ? t->ops / t->elapsed : 0.0,
+		       t->ops ? t->elapsed * 1e9 / t->ops : 0.0);
+}
+
+static int open_default_device(void)
+{
+	drmDevicePtr devices[16];
+	int i, n, fd = -1;
+
+	n = drmGetDevices2(0, devices, 16);
+	if (n <= 0)
+		return -1;
+
+	for (i = 0; i < n && fd < 0; i++)
+		if (devices[i]->available_nodes & (1 << DRM_NODE_PRIMARY))
+			fd = open(devices[i]->nodes[DRM_NODE_PRIMARY],
+				  O_RDWR | O_CLOEXEC);
+	drmFreeDevices(devices, n);
+	return fd;
+}
+
+static int suite_selected(const char *list, const char *name)
+{
+	size_t len = strlen(name);
+	const char *p;
+
+	if (!list)
+		return 1;
+	for (p = list; p; p = strchr(p, ',')) {
+		if (*p == ',')
+			p++;
+		if (!strncmp(p, name, len) && (p[len] == ',' || !p[len]))
+			return 1;
+	}
+	return 0;
+}
+
+static int suite_enabled(const struct bench_ctx *ctx, const char *list,
+			 const struct bench_suite *suite)
+{
+	if (!suite_selected(list, suite->name))
+		return 0;
+	return !suite->driver ||
+	       (ctx->driver && !strcmp(ctx->driver, suite->driver));
+}
+
+static void usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [-d device] [-t ms] [-s suite[,suite...]] "
+		"[-l]\n", argv0);
+}
+
+int main(int argc, char **argv)
+{
+	struct bench_ctx ctx = { .fd = -1 };
+	const char *node = NULL, *list = NULL;
+	drmVersionPtr version = NULL;
+	int c, ms = 250, first = 1;
+	unsigned i;
+
+	while ((c = getopt(argc, argv, "d:t:s:lh")) != -1) {
+		switch (c) {
+		case 'd':
+			node = optarg;
+			break;
+		case 't':
+			ms = atoi(optarg);
+			break;
+		case 's':
+			list = optarg;
+			break;
+		case 'l':
+			for (i = 0; i < sizeof(suites) / sizeof(suites[0]); i++)
+				printf("%s%s%s\n", suites[i]->name,
+				       suites[i]->driver ? "\t" : "",
+				       suites[i]->driver ? suites[i]->driver : "");
+			return 0;
+		default:
+			usage(argv[0]);
+			return c == 'h' ? 0 : 1;
+		}
+	}
+	if (ms <= 0)
+		ms = 250;
+	ctx.duration = ms / 1000.0;
+
+	if (node) {
+		ctx.fd = open(node, O_RDWR | O_CLOEXEC);
+		if (ctx.fd < 0) {
+			perror(node);
+			return 1;
+		}
+	} else {
+		ctx.fd = open_default_device();
+	}
+	if (ctx.fd >= 0) {
+		version = drmGetVersion(ctx.fd);
+		if (version)
+			ctx.driver = version->name;
+	}
+
+	printf("{\n  \"libdrm\": \"%s\",\n", LIBDRM_VERSION);
+	if (version)
+		printf("  \"driver\": \"%s\",\n  \"driver_version\": "
+		       "\"%d.%d.%d\",\n", version->name,
+		       version->version_major, version->version_minor,
+		       version->version_patchlevel);
+	else
+		printf("  \"driver\": null,\n");
+	printf("  \"ms_per_test\": %d,\n  \"suites\": [", ms);
+	for (i = 0; i < sizeof(suites) / sizeof(suites[0]); i++) {
+		if (!suite_enabled(&ctx, list, suites[i]))
+			continue;
+		printf("%s\"%s\"", first ? " " : ", ", suites[i]->name);
+		first = 0;
+	}
+	printf(" ],\n  \"results\": [");
+
+	for (i = 0; i < sizeof(suites) / sizeof(suites[0]); i++) {
+		if (!suite_enabled(&ctx, list, suites[i]))
+			continue;
+		ctx.suite = suites[i]->name;
+		suites[i]->run(&ctx);
+		fflush(stdout);
+	}
+
+	printf("\n  ]\n}\n");
+
+	drmFreeVersion(version);
+	if (ctx.fd >= 0)
+		close(ctx.fd);
+	return 0;
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+/*
+ * A suite is a set of tests sharing a setup.  Every test runs for the same
+ * wall-clock time and reports one result named "<suite>.<test>"; the names
+ * are kept stable so runs of different libdrm versions can be compared.
+ * Tests that need a device report -ENODEV without one rather than being
+ * left out.
+ */
+
+struct bench_ctx {
+	int fd;			/* -1 without a device */
+	const char *driver;	/* NULL without a device */
+	const char *suite;
+	double duration;
+	int num_results;
+};
+
+struct bench_timer {
+	double start;
+	double elapsed;
+	double duration;
+	unsigned long ops;
+};
+
+struct bench_suite {
+	const char *name;
+	const char *driver;	/* only run on this driver, NULL for any */
+	void (*run)(struct bench_ctx *ctx);
+};
+
+void bench_timer_start(struct bench_ctx *ctx, struct bench_timer *t);
+int bench_timer_running(struct bench_timer *t);
+
+/* @params is a JSON fragment of extra members, or NULL. */
+void bench_report(struct bench_ctx *ctx, const char *name,
+		  const char *params, struct bench_timer *t, int error);
+
+extern const struct bench_suite bench_core;
+extern const struct bench_suite bench_atomic;
+extern const struct bench_suite bench_events;
+extern const struct bench_suite bench_device;
+#ifdef BENCH_AMDGPU
+extern const struct bench_suite bench_amdgpu;
+#endif
+#ifdef BENCH_INTEL
+extern const struct bench_suite bench_intel;
+#endif
+
+#endif
@@ -0,0 +1,214 @@
+/*
+ * Copyright 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+/*
+ * libdrm_amdgpu buffer and submission paths: allocation with and without
+ * the reuse cache, CPU mapping, and NOP submissions on the GFX ring waited
+ * for right away.  tests/amdgpu/amdgpu_bench has the full set.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+
+#include "xf86drm.h"
+#include "amdgpu.h"
+#include "amdgpu_drm.h"
+#include "bench.h"
+
+#define NUM_IB_DWORDS	16
+
+static const char *const tests[] = {
+	"bo_alloc_free",
+	"bo_alloc_free_reuse",
+	"bo_cpu_map",
+	"cs_nop_submit_wait",
+};
+
+static void bench_bo_alloc(struct bench_ctx *ctx, amdgpu_device_handle dev,
+			   const char *name)
+{
+	struct amdgpu_bo_alloc_request req = {0};
+	amdgpu_bo_handle bo;
+	struct bench_timer t;
+	int r = 0;
+
+	req.alloc_size = 64 * 1024;
+	req.phys_alignment = 4096;
+	req.preferred_heap = AMDGPU_GEM_DOMAIN_GTT;
+
+	bench_timer_start(ctx, &t);
+	while (bench_timer_running(&t)) {
+		r = amdgpu_bo_alloc(dev, &req, &bo);
+		if (r)
+			break;
+		amdgpu_bo_free(bo);
+		t.ops++;
+	}
+	bench_report(ctx, name, "\"heap\": \"gtt\", \"size\": 65536", &t, r);
+}
+
+static void bench_cpu_map(struct bench_ctx *ctx, amdgpu_device_handle dev)
+{
+	struct amdgpu_bo_alloc_request req = {0};
+	amdgpu_bo_handle bo;
+	struct bench_timer t;
+	void *cpu;
+	int r;
+
+	req.alloc_size = 64 * 1024;
+	req.phys_alignment = 4096;
+	req.preferred_heap = AMDGPU_GEM_DOMAIN_GTT;
+	r = amdgpu_bo_alloc(dev, &req, &bo);
+	if (r) {
+		bench_report(ctx, "bo_cpu_map", NULL, NULL, r);
+		return;
+	}
+
+	bench_timer_start(ctx, &t);
+	while (bench_timer_running(&t)) {
+		r = amdgpu_bo_cpu_map(bo, &cpu);
+		if (r)
+			break;
+		amdgpu_bo_cpu_unmap(bo);
+		t.ops++;
+	}
+	bench_report(ctx, "bo_cpu_map", NULL, &t, r);
+
+	amdgpu_bo_free(bo);
+}
+
+static void bench_cs(struct bench_ctx *ctx, amdgpu_device_handle dev)
+{
+	struct amdgpu_bo_alloc_request req = {0};
+	struct amdgpu_cs_request request = {0};
+	struct amdgpu_cs_fence fence = {0};
+	struct amdgpu_cs_ib_info ib = {0};
+	struct amdgpu_gpu_info info;
+	amdgpu_context_handle context;
+	amdgpu_bo_list_handle list;
+	amdgpu_va_handle va_handle;
+	amdgpu_bo_handle bo;
+	struct bench_timer t;
+	uint32_t *ptr, expired;
+	uint64_t va;
+	void *cpu;
+	int i, r;
+
+	r = amdgpu_query_gpu_info(dev, &info);
+	if (r)
+		goto out;
+	r = amdgpu_cs_ctx_create(dev, &context);
+	if (r)
+		goto out;
+
+	req.alloc_size = 4096;
+	req.phys_alignment = 4096;
+	req.preferred_heap = AMDGPU_GEM_DOMAIN_GTT;
+	r = amdgpu_bo_alloc(dev, &req, &bo);
+	if (r)
+		goto out_ctx;
+	r = amdgpu_va_range_alloc(dev, amdgpu_gpu_va_range_general, 4096,
+				  4096, 0, &va, &va_handle, 0);
+	if (r)
+		goto out_bo;
+	r = amdgpu_bo_va_op(bo, 0, 4096, va, 0, AMDGPU_VA_OP_MAP);
+	if (r)
+		goto out_va;
+
+	r = amdgpu_bo_cpu_map(bo, &cpu);
+	if (r)
+		goto out_map;
+	ptr = cpu;
+	for (i = 0; i < NUM_IB_DWORDS; i++)
+		ptr[i] = info.family_id == AMDGPU_FAMILY_SI ? 0x80000000 :
+							      0xffff1000;
+	amdgpu_bo_cpu_unmap(bo);
+
+	r = amdgpu_bo_list_create(dev, 1, &bo, NULL, &list);
+	if (r)
+		goto out_map;
+
+	ib.ib_mc_address = va;
+	ib.size = NUM_IB_DWORDS;
+	request.ip_type = AMDGPU_HW_IP_GFX;
+	request.number_of_ibs = 1;
+	request.ibs = &ib;
+	request.resources = list;
+	fence.context = context;
+	fence.ip_type = AMDGPU_HW_IP_GFX;
+
+	bench_timer_start(ctx, &t);
+	while (bench_timer_running(&t)) {
+		r = amdgpu_cs_submit(context, 0, &request, 1);
+		if (r)
+			break;
+		fence.fence = request.seq_no;
+		r = amdgpu_cs_query_fence_status(&fence, AMDGPU_TIMEOUT_INFINITE,
+						 0, &expired);
+		if (r)
+			break;
+		t.ops++;
+	}
+
+	amdgpu_bo_list_destroy(list);
+out_map:
+	amdgpu_bo_va_op(bo, 0, 4096, va, 0, AMDGPU_VA_OP_UNMAP);
+out_va:
+	amdgpu_va_range_free(va_handle);
+out_bo:
+	amdgpu_bo_free(bo);
+out_ctx:
+	amdgpu_cs_ctx_free(context);
+out:
+	bench_report(ctx, "cs_nop_submit_wait", NULL, r ? NULL : &t, r);
+}
+
+static void run(struct bench_ctx *ctx)
+{
+	amdgpu_device_handle dev;
+	uint32_t major, minor;
+	unsigned i;
+	int r;
+
+	r = amdgpu_device_initialize(ctx->fd, &major, &minor, &dev);
+	if (r) {
+		for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++)
+			bench_report(ctx, tests[i], NULL, NULL, r);
+		return;
+	}
+
+	bench_bo_alloc(ctx, dev, tests[0]);
+	amdgpu_device_enable_bo_reuse(dev);
+	bench_bo_alloc(ctx, dev, tests[1]);
+	bench_cpu_map(ctx, dev);
+	bench_cs(ctx, dev);
+
+	amdgpu_device_deinitialize(dev);
+}
+
+const struct bench_suite bench_amdgpu = {
+	.name = "amdgpu",
+	.driver = "amdgpu",
+	.run = run,
+};
@@ -0,0 +1,206 @@
+/*
+ * Copyright 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+/*
+ * Atomic requests: building them, and TEST_ONLY commits through the plain,
+ * compiled, test cached and shadowed paths.  The commits set the ACTIVE
+ * property of the first CRTC to the value it has, so they change nothing
+ * even if the device is in use; they need DRM master.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "xf86drm.h"
+#include "xf86drmMode.h"
+#include "bench.h"
+
+#define BUILD_OBJECTS	8
+#define BUILD_PROPS	8
+
+static const char *const commit_tests[] = {
+	"commit_test_only",
+	"compiled_commit_test_only",
+	"cached_commit_test_only",
+	"shadow_commit_noop",
+};
+
+static void bench_build(struct bench_ctx *ctx)
+{
+	drmModeAtomicReqPtr req;
+	struct bench_timer t;
+	char params[32];
+	uint32_t obj, prop;
+	int r = 0;
+
+	req = drmModeAtomicAlloc();
+	if (!req) {
+		bench_report(ctx, "build", NULL, NULL, -ENOMEM);
+		return;
+	}
+
+	bench_timer_start(ctx, &t);
+	while (bench_timer_running(&t) && !r) {
+		drmModeAtomicReset(req);
+		for (obj = 1; obj <= BUILD_OBJECTS; obj++)
+			for (prop = 1; prop <= BUILD_PROPS; prop++)
+				if (drmModeAtomicAddProperty(req, obj, prop,
+							     obj + prop) < 0)
+					r = -ENOMEM;
+		t.ops++;
+	}
+	snprintf(params, sizeof(params), "\"props\": %d",
+		 BUILD_OBJECTS * BUILD_PROPS);
+	bench_report(ctx, "build", params, &t, r);
+
+	drmModeAtomicFree(req);
+}
+
+/* Fills @req with a no-op change of the first CRTC. */
+static int noop_request(int fd, drmModeAtomicReqPtr req)
+{
+	drmModePropertyCachePtr cache;
+	const drmModePropertyInfo *info;
+	drmModeObjectPropertiesPtr props;
+	drmModeResPtr res;
+	uint32_t crtc_id, i;
+	int r = -ENOENT;
+
+	res = drmModeGetResources(fd);
+	if (!res)
+		return -errno;
+	if (res->count_crtcs < 1) {
+		drmModeFreeResources(res);
+		return -ENODEV;
+	}
+	crtc_id = res->crtcs[0];
+	drmModeFreeResources(res);
+
+	cache = drmModePropertyCacheCreate(fd);
+	if (!cache)
+		return -ENOMEM;
+	info = drmModePropertyCacheLookup(cache, crtc_id, DRM_MODE_OBJECT_CRTC,
+					  "ACTIVE");
+	props = drmModeObjectGetProperties(fd, crtc_id, DRM_MODE_OBJECT_CRTC);
+	for (i = 0; info && props && i < props->count_props; i++) {
+		if (props->props[i] != info->prop_id)
+			continue;
+		r = drmModeAtomicAddProperty(req, crtc_id, info->prop_id,
+					     props->prop_values[i]);
+		if (r > 0)
+			r = 0;
+	}
+	drmModeFreeObjectProperties(props);
+	drmModePropertyCacheDestroy(cache);
+	return r;
+}
+
+static void bench_commit(struct bench_ctx *ctx)
+{
+	const uint32_t flags = DRM_MODE_ATOMIC_TEST_ONLY;
+	drmModeAtomicCompiledPtr compiled;
+	drmModeAtomicTestCachePtr cache;
+	drmModeAtomicShadowPtr shadow;
+	drmModeAtomicReqPtr req;
+	struct bench_timer t;
+	unsigned i;
+	int r;
+
+	if (ctx->fd < 0)
+		r = -ENODEV;
+	else if (drmSetClientCap(ctx->fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1) ||
+		 drmSetClientCap(ctx->fd, DRM_CLIENT_CAP_ATOMIC, 1))
+		r = -EOPNOTSUPP;
+	else if (!(req = drmModeAtomicAlloc()))
+		r = -ENOMEM;
+	else if ((r = noop_request(ctx->fd, req)) ||
+		 (r = drmModeAtomicCommit(ctx->fd, req, flags, NULL)))
+		drmModeAtomicFree(req);
+	if (r) {
+		for (i = 0; i < sizeof(commit_tests) / sizeof(commit_tests[0]); i++)
+			bench_report(ctx, commit_tests[i], NULL, NULL, r);
+		return;
+	}
+
+	bench_timer_start(ctx, &t);
+	while (bench_timer_running(&t)) {
+		r = drmModeAtomicCommit(ctx->fd, req, flags, NULL);
+		if (r)
+			break;
+		t.ops++;
+	}
+	bench_report(ctx, commit_tests[0], NULL, &t, r);
+
+	compiled = drmModeAtomicCompile(req);
+	r = compiled ? 0 : -ENOMEM;
+	bench_timer_start(ctx, &t);
+	while (compiled && bench_timer_running(&t)) {
+		r = drmModeAtomicCompiledCommit(ctx->fd, compiled, flags, NULL);
+		if (r)
+			break;
+		t.ops++;
+	}
+	bench_report(ctx, commit_tests[1], NULL, &t, r);
+	drmModeAtomicCompiledFree(compiled);
+
+	/* After the first pass every test is answered from the cache. */
+	cache = drmModeAtomicTestCacheCreate(ctx->fd, 0);
+	r = cache ? 0 : -ENOMEM;
+	bench_timer_start(ctx, &t);
+	while (cache && bench_timer_running(&t)) {
+		r = drmModeAtomicCommitCached(cache, req, flags, NULL);
+		if (r)
+			break;
+		t.ops++;
+	}
+	bench_report(ctx, commit_tests[2], NULL, &t, r);
+	drmModeAtomicTestCacheDestroy(cache);
+
+	/* The request changes nothing, so the shadow drops it. */
+	shadow = drmModeAtomicShadowCreate(ctx->fd);
+	r = shadow ? 0 : -errno;
+	bench_timer_start(ctx, &t);
+	while (shadow && bench_timer_running(&t)) {
+		r = drmModeAtomicShadowCommit(shadow, req, flags, NULL);
+		if (r)
+			break;
+		t.ops++;
+	}
+	bench_report(ctx, commit_tests[3], NULL, &t, r);
+	drmModeAtomicShadowDestroy(shadow);
+
+	drmModeAtomicFree(req);
+}
+
+static void run(struct bench_ctx *ctx)
+{
+	bench_build(ctx);
+	bench_commit(ctx);
+}
+
+const struct bench_suite bench_atomic = {
+	.name = "atomic",
+	.run = run,
+};
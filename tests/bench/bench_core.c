@@ -0,0 +1,156 @@
+/*
+ * Copyright 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+/*
+ * Core containers: the hash table behind the handle and magic lookups of
+ * most drivers, and the skip list.  Keys are spread like GEM handles and
+ * pointers would be, by the libdrm random number generator.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "xf86drm.h"
+#include "bench.h"
+
+#define NUM_KEYS	1024
+
+struct container {
+	const char *name;
+	void *(*create)(void);
+	int (*destroy)(void *t);
+	int (*insert)(void *t, unsigned long key, void *value);
+	int (*remove)(void *t, unsigned long key);
+	int (*lookup)(void *t, unsigned long key, void **value);
+};
+
+static const struct container containers[] = {
+	{ "hash", drmHashCreate, drmHashDestroy, drmHashInsert,
+	  drmHashDelete, drmHashLookup },
+	{ "skiplist", drmSLCreate, drmSLDestroy, drmSLInsert,
+	  drmSLDelete, drmSLLookup },
+};
+
+static void bench_container(struct bench_ctx *ctx,
+			    const struct container *c,
+			    const unsigned long *keys)
+{
+	struct bench_timer t;
+	char name[64], params[32];
+	void *table, *value;
+	int i, r = 0;
+
+	snprintf(params, sizeof(params), "\"keys\": %d", NUM_KEYS);
+
+	table = c->create();
+	if (!table) {
+		snprintf(name, sizeof(name), "%s_insert_delete", c->name);
+		bench_report(ctx, name, params, NULL, -ENOMEM);
+		return;
+	}
+
+	/* Every op is the insertion and the deletion of one key. */
+	bench_timer_start(ctx, &t);
+	while (bench_timer_running(&t)) {
+		for (i = 0; i < NUM_KEYS; i++)
+			c->insert(table, keys[i], &table);
+		for (i = 0; i < NUM_KEYS; i++)
+			c->remove(table, keys[i]);
+		t.ops += NUM_KEYS;
+	}
+	snprintf(name, sizeof(name), "%s_insert_delete", c->name);
+	bench_report(ctx, name, params, &t, 0);
+
+	for (i = 0; i < NUM_KEYS; i++)
+		c->insert(table, keys[i], &table);
+
+	bench_timer_start(ctx, &t);
+	while (bench_timer_running(&t) && !r) {
+		for (i = 0; i < NUM_KEYS; i++)
+			if (c->lookup(table, keys[i], &value))
+				r = -ENOENT;
+		t.ops += NUM_KEYS;
+	}
+	snprintf(name, sizeof(name), "%s_lookup", c->name);
+	bench_report(ctx, name, params, &t, r);
+
+	/* Half the lookups miss, as for handles that aren't cached. */
+	bench_timer_start(ctx, &t);
+	while (bench_timer_running(&t)) {
+		for (i = 0; i < NUM_KEYS; i++)
+			c->lookup(table, keys[i] ^ (i & 1), &value);
+		t.ops += NUM_KEYS;
+	}
+	snprintf(name, sizeof(name), "%s_lookup_miss_half", c->name);
+	bench_report(ctx, name, params, &t, 0);
+
+	c->destroy(table);
+}
+
+static void bench_random(struct bench_ctx *ctx)
+{
+	struct bench_timer t;
+	void *state;
+	unsigned long sum = 0;
+
+	state = drmRandomCreate(1);
+	if (!state) {
+		bench_report(ctx, "random", NULL, NULL, -ENOMEM);
+		return;
+	}
+
+	bench_timer_start(ctx, &t);
+	while (bench_timer_running(&t)) {
+		sum += drmRandom(state);
+		t.ops++;
+	}
+	bench_report(ctx, "random", NULL, &t, sum ? 0 : -EINVAL);
+
+	drmRandomDestroy(state);
+}
+
+static void run(struct bench_ctx *ctx)
+{
+	unsigned long keys[NUM_KEYS];
+	void *state;
+	unsigned i;
+
+	state = drmRandomCreate(42);
+	if (!state)
+		return;
+	/* even keys, so that key ^ 1 is never one of them */
+	for (i = 0; i < NUM_KEYS; i++)
+		keys[i] = drmRandom(state) << 1;
+	drmRandomDestroy(state);
+
+	for (i = 0; i < sizeof(containers) / sizeof(containers[0]); i++)
+		bench_container(ctx, &containers[i], keys);
+	bench_random(ctx);
+}
+
+const struct bench_suite bench_core = {
+	.name = "core",
+	.run = run,
+};
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+/*
+ * Device enumeration and identification, which every client pays for at
+ * startup and which some call again on every hotplug.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+
+#include "xf86drm.h"
+#include "bench.h"
+
+#define MAX_DEVICES	16
+
+static void bench_get_devices(struct bench_ctx *ctx)
+{
+	drmDevicePtr devices[MAX_DEVICES];
+	struct bench_timer t;
+	char params[32];
+	int n = 0;
+
+	bench_timer_start(ctx, &t);
+	while (bench_timer_running(&t)) {
+		n = drmGetDevices2(0, devices, MAX_DEVICES);
+		if (n < 0)
+			break;
+		drmFreeDevices(devices, n);
+		t.ops++;
+	}
+	snprintf(params, sizeof(params), "\"devices\": %d", n < 0 ? 0 : n);
+	bench_report(ctx, "get_devices2", params, &t, n < 0 ? n : 0);
+}
+
+static void bench_get_device(struct bench_ctx *ctx)
+{
+	drmDevicePtr device;
+	struct bench_timer t;
+	int r = -ENODEV;
+
+	bench_timer_start(ctx, &t);
+	while (ctx->fd >= 0 && bench_timer_running(&t)) {
+		r = drmGetDevice2(ctx->fd, 0, &device);
+		if (r)
+			break;
+		drmFreeDevice(&device);
+		t.ops++;
+	}
+	bench_report(ctx, "get_device2", NULL, &t, r);
+}
+
+static void bench_get_version(struct bench_ctx *ctx)
+{
+	drmVersionPtr version;
+	struct bench_timer t;
+	int r = -ENODEV;
+
+	bench_timer_start(ctx, &t);
+	while (ctx->fd >= 0 && bench_timer_running(&t)) {
+		version = drmGetVersion(ctx->fd);
+		r = version ? 0 : -errno;
+		if (r)
+			break;
+		drmFreeVersion(version);
+		t.ops++;
+	}
+	bench_report(ctx, "get_version", NULL, &t, r);
+}
+
+static void run(struct bench_ctx *ctx)
+{
+	bench_get_devices(ctx);
+	bench_get_device(ctx);
+	bench_get_version(ctx);
+}
+
+const struct bench_suite bench_device = {
+	.name = "device",
+	.run = run,
+};
@@ -0,0 +1,109 @@
+/*
+ * Copyright 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+/*
+ * Event dispatch.  Vblank events are written into a pipe by the benchmark
+ * itself, so only the reading and the dispatch loop are measured, not the
+ * kernel; no device is needed.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "xf86drm.h"
+#include "xf86drmMode.h"
+#include "bench.h"
+
+#define EVENT_BATCH	32	/* 1 KiB, what drmHandleEvent() reads at once */
+
+static unsigned long dispatched;
+
+static void vblank_handler(int fd, unsigned int sequence, unsigned int tv_sec,
+			   unsigned int tv_usec, void *user_data)
+{
+	dispatched++;
+}
+
+static void bench_dispatch(struct bench_ctx *ctx, const char *name,
+			   int batched)
+{
+	struct drm_event_vblank events[EVENT_BATCH];
+	drmEventContext evctx = {
+		.version = 2,
+		.vblank_handler = vblank_handler,
+	};
+	struct bench_timer t;
+	char params[32];
+	int fds[2], i, r = 0;
+
+	if (pipe(fds)) {
+		bench_report(ctx, name, NULL, NULL, -errno);
+		return;
+	}
+
+	memset(events, 0, sizeof(events));
+	for (i = 0; i < EVENT_BATCH; i++) {
+		events[i].base.type = DRM_EVENT_VBLANK;
+		events[i].base.length = sizeof(events[i]);
+		events[i].sequence = i;
+	}
+
+	dispatched = 0;
+	bench_timer_start(ctx, &t);
+	while (bench_timer_running(&t)) {
+		if (write(fds[1], events, sizeof(events)) != sizeof(events)) {
+			r = -errno;
+			break;
+		}
+		if (batched)
+			r = drmHandleEvents2(fds[0], &evctx, NULL, 0) < 0;
+		else
+			r = drmHandleEvent(fds[0], &evctx);
+		if (r) {
+			r = -EIO;
+			break;
+		}
+		t.ops += EVENT_BATCH;
+	}
+	if (!r && dispatched != t.ops)
+		r = -EIO;
+	snprintf(params, sizeof(params), "\"batch\": %d", EVENT_BATCH);
+	bench_report(ctx, name, params, &t, r);
+
+	close(fds[0]);
+	close(fds[1]);
+}
+
+static void run(struct bench_ctx *ctx)
+{
+	bench_dispatch(ctx, "handle_event", 0);
+	bench_dispatch(ctx, "handle_events2", 1);
+}
+
+const struct bench_suite bench_events = {
+	.name = "events",
+	.run = run,
+};
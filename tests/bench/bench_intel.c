@@ -0,0 +1,142 @@
+/*
+ * Copyright 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+
+/*
+ * libdrm_intel buffer and submission paths: cached allocation, uploads with
+ * drm_intel_bo_subdata() and empty batches waited for right away.
+ * intel/intel_bufmgr_bench covers allocation over the whole size range.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "xf86drm.h"
+#include "intel_bufmgr.h"
+#include "bench.h"
+
+#define MI_BATCH_BUFFER_END	(0x0a << 23)
+
+static const char *const tests[] = {
+	"bo_alloc_free",
+	"bo_subdata",
+	"exec_wait",
+};
+
+static void bench_alloc(struct bench_ctx *ctx, drm_intel_bufmgr *bufmgr)
+{
+	struct bench_timer t;
+	drm_intel_bo *bo;
+	int r = 0;
+
+	bench_timer_start(ctx, &t);
+	while (bench_timer_running(&t)) {
+		bo = drm_intel_bo_alloc(bufmgr, "bench", 64 * 1024, 0);
+		if (!bo) {
+			r = -ENOMEM;
+			break;
+		}
+		drm_intel_bo_unreference(bo);
+		t.ops++;
+	}
+	bench_report(ctx, tests[0], "\"size\": 65536", &t, r);
+}
+
+static void bench_subdata(struct bench_ctx *ctx, drm_intel_bufmgr *bufmgr)
+{
+	static uint32_t data[1024];
+	struct bench_timer t;
+	drm_intel_bo *bo;
+	int r;
+
+	bo = drm_intel_bo_alloc(bufmgr, "bench", sizeof(data), 0);
+	if (!bo) {
+		bench_report(ctx, tests[1], NULL, NULL, -ENOMEM);
+		return;
+	}
+
+	bench_timer_start(ctx, &t);
+	while (bench_timer_running(&t)) {
+		r = drm_intel_bo_subdata(bo, 0, sizeof(data), data);
+		if (r)
+			break;
+		t.ops++;
+	}
+	bench_report(ctx, tests[1], "\"size\": 4096", &t, r);
+
+	drm_intel_bo_unreference(bo);
+}
+
+static void bench_exec(struct bench_ctx *ctx, drm_intel_bufmgr *bufmgr)
+{
+	uint32_t batch[2] = { MI_BATCH_BUFFER_END, 0 };
+	struct bench_timer t;
+	drm_intel_bo *bo;
+	int r;
+
+	bo = drm_intel_bo_alloc(bufmgr, "batch", 4096, 0);
+	if (!bo) {
+		bench_report(ctx, tests[2], NULL, NULL, -ENOMEM);
+		return;
+	}
+	r = drm_intel_bo_subdata(bo, 0, sizeof(batch), batch);
+
+	bench_timer_start(ctx, &t);
+	while (!r && bench_timer_running(&t)) {
+		r = drm_intel_bo_exec(bo, sizeof(batch), NULL, 0, 0);
+		if (r)
+			break;
+		drm_intel_bo_wait_rendering(bo);
+		t.ops++;
+	}
+	bench_report(ctx, tests[2], NULL, &t, r);
+
+	drm_intel_bo_unreference(bo);
+}
+
+static void run(struct bench_ctx *ctx)
+{
+	drm_intel_bufmgr *bufmgr;
+	unsigned i;
+
+	bufmgr = drm_intel_bufmgr_gem_init(ctx->fd, 4096);
+	if (!bufmgr) {
+		for (i = 0; i < sizeof(tests) / sizeof(tests[0]); i++)
+			bench_report(ctx, tests[i], NULL, NULL, -ENODEV);
+		return;
+	}
+	drm_intel_bufmgr_gem_enable_reuse(bufmgr);
+
+	bench_alloc(ctx, bufmgr);
+	bench_subdata(ctx, bufmgr);
+	bench_exec(ctx, bufmgr);
+
+	drm_intel_bufmgr_destroy(bufmgr);
+}
+
+const struct bench_suite bench_intel = {
+	.name = "intel",
+	.driver = "i915",
+	.run = run,
+};
@@ -0,0 +1,198 @@
+/*
+ * Copyright © 2007 Intel Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Checks the bucket indexing and reuse policy of the bo cache the driver
+ * libraries share, with fake bo's standing in for GEM objects.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "drm_bo_cache.h"
+
+struct fake_bo {
+	struct drm_bo_cache_entry entry;
+	int busy;
+	int purged;
+	int destroyed;
+};
+
+static int fake_busy(struct drm_bo_cache_entry *entry)
+{
+	return LIST_ENTRY(struct fake_bo, entry, entry)->busy;
+}
+
+static int fake_madvise(struct drm_bo_cache_entry *entry, int willneed)
+{
+	return !LIST_ENTRY(struct fake_bo, entry, entry)->purged;
+}
+
+static void fake_destroy(struct drm_bo_cache_entry *entry)
+{
+	LIST_ENTRY(struct fake_bo, entry, entry)->destroyed = 1;
+}
+
+static const struct drm_bo_cache_funcs fake_funcs = {
+	.busy = fake_busy,
+	.madvise = fake_madvise,
+	.destroy = fake_destroy,
+};
+
+static int failures;
+
+#define check(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", \
+			__func__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while (0)
+
+/* the calculated bucket must be the smallest one the size fits in */
+static void test_buckets(int coarse)
+{
+	struct drm_bo_cache cache = { 0 };
+	uint64_t size, max;
+	unsigned i;
+
+	drm_bo_cache_init(&cache, coarse, &fake_funcs);
+	max = cache.cache_bucket[cache.num_buckets - 1].size;
+
+	for (size = 1; size <= max + 4096; size += size < 65536 ? 1 : 4093) {
+		struct drm_bo_cache_bucket *bucket;
+
+		bucket = drm_bo_cache_bucket(&cache, size);
+		for (i = 0; i < cache.num_buckets; i++)
+			if (cache.cache_bucket[i].size >= size)
+				break;
+
+		if (i == cache.num_buckets) {
+			check(bucket == NULL);
+		} else if (bucket != &cache.cache_bucket[i]) {
+			fprintf(stderr, "size %llu: bucket %d, expected %u\n",
+				(unsigned long long)size,
+				bucket ? (int)(bucket - cache.cache_bucket) : -1,
+				i);
+			failures++;
+			return;
+		}
+	}
+}
+
+static void test_reuse(void)
+{
+	struct drm_bo_cache cache = { 0 };
+	struct fake_bo a = { .busy = 1 }, b = { 0 }, c = { 0 };
+	uint64_t size;
+
+	drm_bo_cache_init(&cache, 0, &fake_funcs);
+
+	/* sizes are rounded up to the bucket size */
+	size = 5000;
+	check(drm_bo_cache_get(&cache, &size, 0, 0) == NULL);
+	check(size == 8192);
+
+	check(drm_bo_cache_put(&cache, &a.entry, 8192, 10) == 0);
+	check(drm_bo_cache_put(&cache, &b.entry, 8192, 10) == 0);
+	b.entry.flags = 1;
+	check(cache.size == 2 * 8192 && cache.count == 2);
+
+	/* the busy one is skipped, and flags have to match */
+	size = 8192;
+	check(drm_bo_cache_get(&cache, &size, 0, 0) == NULL);
+	check(drm_bo_cache_get(&cache, &size, 1, 0) == &b.entry);
+	check(!drm_bo_cache_entry_is_cached(&b.entry));
+
+	/* render targets take the MRU one, busy or not */
+	check(drm_bo_cache_put(&cache, &c.entry, 8192, 10) == 0);
+	check(drm_bo_cache_get(&cache, &size, 0, 1) == &c.entry);
+	check(drm_bo_cache_get(&cache, &size, 0, 1) == &a.entry);
+	check(cache.size == 0 && cache.count == 0);
+
+	/* too big for any bucket */
+	check(drm_bo_cache_put(&cache, &c.entry, 1ull << 32, 10) == -1);
+}
+
+static void test_tolerance(void)
+{
+	struct drm_bo_cache cache = { 0 };
+	struct fake_bo a = { 0 };
+	uint64_t size;
+
+	drm_bo_cache_init(&cache, 0, &fake_funcs);
+	cache.tolerance = 10;
+
+	check(drm_bo_cache_put(&cache, &a.entry, 20 * 4096, 10) == 0);
+
+	/* no rounding, and only bo's at most 10% bigger */
+	size = 17 * 4096;
+	check(drm_bo_cache_get(&cache, &size, 0, 0) == NULL);
+	check(size == 17 * 4096);
+	size = 19 * 4096;
+	check(drm_bo_cache_get(&cache, &size, 0, 0) == &a.entry);
+}
+
+static void test_aging(void)
+{
+	struct drm_bo_cache cache = { 0 };
+	struct fake_bo a = { 0 }, b = { 0 }, c = { 0 };
+	uint64_t size = 4096;
+
+	drm_bo_cache_init(&cache, 0, &fake_funcs);
+	cache.budget = 3 * 4096;
+
+	check(drm_bo_cache_put(&cache, &a.entry, 4096, 10) == 0);
+	check(drm_bo_cache_put(&cache, &b.entry, 8192, 11) == 0);
+
+	/* a is marked DONTNEED once it's been cached for a second */
+	check(a.entry.dontneed && !b.entry.dontneed);
+
+	/* over budget, the oldest goes first */
+	check(drm_bo_cache_put(&cache, &c.entry, 4096, 11) == 0);
+	check(a.destroyed && !b.destroyed && !c.destroyed);
+	check(cache.size == 3 * 4096);
+
+	/* and a purged one isn't handed out */
+	c.entry.dontneed = 1;
+	c.purged = 1;
+	check(drm_bo_cache_get(&cache, &size, 0, 0) == NULL);
+	check(c.destroyed);
+
+	/* older than two seconds */
+	drm_bo_cache_cleanup(&cache, 14);
+	check(b.destroyed);
+	check(cache.size == 0 && cache.count == 0);
+}
+
+int main(void)
+{
+	test_buckets(0);
+	test_buckets(1);
+	test_reuse();
+	test_tolerance();
+	test_aging();
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
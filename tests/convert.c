@@ -0,0 +1,292 @@
+/*
+ * Copyright © 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Checks util_convert_from_xrgb8888() and util_convert_to_xrgb8888()
+ * against a straightforward per-pixel conversion, on random images whose
+ * sizes exercise both the vector loops and the scalar tails, and the
+ * format table lookup.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <drm_fourcc.h>
+
+#include "util/common.h"
+#include "util/convert.h"
+#include "util/format.h"
+
+static const uint32_t formats[] = {
+	DRM_FORMAT_NV12, DRM_FORMAT_NV21,
+	DRM_FORMAT_YUYV, DRM_FORMAT_YVYU, DRM_FORMAT_UYVY, DRM_FORMAT_VYUY,
+	DRM_FORMAT_RGB565, DRM_FORMAT_BGR565,
+};
+
+static const unsigned int sizes[][2] = {
+	{ 1, 1 }, { 2, 2 }, { 3, 5 }, { 15, 3 }, { 16, 2 }, { 17, 7 },
+	{ 33, 4 }, { 64, 9 }, { 127, 3 },
+};
+
+static unsigned int r_(uint32_t p) { return (p >> 16) & 0xff; }
+static unsigned int g_(uint32_t p) { return (p >> 8) & 0xff; }
+static unsigned int b_(uint32_t p) { return p & 0xff; }
+
+static uint8_t ref_y(unsigned int r, unsigned int g, unsigned int b)
+{
+	return ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+}
+
+static uint8_t ref_u(int r, int g, int b)
+{
+	return ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+}
+
+static uint8_t ref_v(int r, int g, int b)
+{
+	return ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+}
+
+/* Averages the pixels of the w x h block with top left corner x, y. */
+static void ref_average(const uint32_t *src, unsigned int width,
+			unsigned int height, unsigned int x, unsigned int y,
+			unsigned int w, unsigned int h, int rgb[3])
+{
+	unsigned int i, j, sx, sy, n = w * h;
+	uint32_t p;
+
+	rgb[0] = rgb[1] = rgb[2] = 0;
+	for (j = 0; j < h; j++) {
+		for (i = 0; i < w; i++) {
+			sx = x + i < width ? x + i : width - 1;
+			sy = y + j < height ? y + j : height - 1;
+			p = src[sy * width + sx];
+			rgb[0] += r_(p);
+			rgb[1] += g_(p);
+			rgb[2] += b_(p);
+		}
+	}
+	for (i = 0; i < 3; i++)
+		rgb[i] = (rgb[i] + n / 2) / n;
+}
+
+/* Offsets of y0, u, y1 and v in a pixel pair. */
+static const unsigned int *packed_offsets(uint32_t format)
+{
+	static const unsigned int yuyv[] = { 0, 1, 2, 3 };
+	static const unsigned int yvyu[] = { 0, 3, 2, 1 };
+	static const unsigned int uyvy[] = { 1, 0, 3, 2 };
+	static const unsigned int vyuy[] = { 1, 2, 3, 0 };
+
+	switch (format) {
+	case DRM_FORMAT_YUYV: return yuyv;
+	case DRM_FORMAT_YVYU: return yvyu;
+	case DRM_FORMAT_UYVY: return uyvy;
+	case DRM_FORMAT_VYUY: return vyuy;
+	}
+	return NULL;
+}
+
+static int check_from(uint32_t format, const uint32_t *src,
+		      unsigned int width, unsigned int height,
+		      const uint8_t *out, unsigned int stride)
+{
+	const unsigned int *off;
+	unsigned int x, y, r, b, swap;
+	const uint8_t *chroma;
+	uint16_t pixel;
+	uint32_t p;
+	int rgb[3];
+
+	switch (format) {
+	case DRM_FORMAT_NV12:
+	case DRM_FORMAT_NV21:
+		swap = format == DRM_FORMAT_NV21;
+		chroma = out + stride * height;
+		for (y = 0; y < height; y++) {
+			for (x = 0; x < width; x++) {
+				p = src[y * width + x];
+				if (out[y * stride + x] != ref_y(r_(p), g_(p), b_(p)))
+					return -1;
+				if ((x | y) & 1)
+					continue;
+				ref_average(src, width, height, x, y, 2, 2, rgb);
+				if (chroma[y / 2 * stride + x + swap] !=
+				    ref_u(rgb[0], rgb[1], rgb[2]) ||
+				    chroma[y / 2 * stride + x + !swap] !=
+				    ref_v(rgb[0], rgb[1], rgb[2]))
+					return -1;
+			}
+		}
+		return 0;
+
+	case DRM_FORMAT_RGB565:
+	case DRM_FORMAT_BGR565:
+		for (y = 0; y < height; y++) {
+			for (x = 0; x < width; x++) {
+				p = src[y * width + x];
+				r = r_(p) >> 3;
+				b = b_(p) >> 3;
+				if (format == DRM_FORMAT_BGR565)
+					pixel = b << 11 | (g_(p) >> 2) << 5 | r;
+				else
+					pixel = r << 11 | (g_(p) >> 2) << 5 | b;
+				if (memcmp(out + y * stride + 2 * x, &pixel, 2))
+					return -1;
+			}
+		}
+		return 0;
+	}
+
+	off = packed_offsets(format);
+	for (y = 0; y < height; y++) {
+		for (x = 0; x < width; x += 2) {
+			const uint8_t *pair = out + y * stride + 2 * x;
+			unsigned int x1 = x + 1 < width ? x + 1 : x;
+
+			p = src[y * width + x];
+			if (pair[off[0]] != ref_y(r_(p), g_(p), b_(p)))
+				return -1;
+			p = src[y * width + x1];
+			if (pair[off[2]] != ref_y(r_(p), g_(p), b_(p)))
+				return -1;
+			ref_average(src, width, height, x, y, 2, 1, rgb);
+			if (pair[off[1]] != ref_u(rgb[0], rgb[1], rgb[2]) ||
+			    pair[off[3]] != ref_v(rgb[0], rgb[1], rgb[2]))
+				return -1;
+		}
+	}
+	return 0;
+}
+
+static int test_format(uint32_t format, unsigned int width,
+		       unsigned int height)
+{
+	unsigned int stride = 2 * width + 6, x, i;
+	uint32_t *src, *back;
+	void *planes[3];
+	uint8_t *out;
+	int ret = -1;
+
+	src = malloc(width * height * sizeof(*src));
+	back = malloc(width * height * sizeof(*back));
+	out = calloc(stride, height * 2);
+	if (!src || !back || !out)
+		goto done;
+
+	for (i = 0; i < width * height; i++)
+		src[i] = random() & 0xffffff;
+
+	planes[0] = out;
+	planes[1] = out + stride * height;
+	planes[2] = NULL;
+	if (util_convert_from_xrgb8888(format, src, width * sizeof(*src),
+				       planes, width, height, stride) ||
+	    check_from(format, src, width, height, out, stride))
+		goto done;
+
+	if (util_convert_to_xrgb8888(format, planes, stride, back,
+				     width * sizeof(*back), width, height))
+		goto done;
+
+	/* 565 round trips exactly on the bits it keeps */
+	if (format == DRM_FORMAT_RGB565 || format == DRM_FORMAT_BGR565) {
+		for (i = 0; i < width * height; i++) {
+			if ((back[i] & 0xf8fcf8) != (src[i] & 0xf8fcf8) ||
+			    back[i] >> 24 != 0xff)
+				goto done;
+		}
+	} else {
+		/* a grey row has no chroma to lose */
+		for (x = 0; x < width; x++)
+			src[x] = 0x010101 * (16 + x % 220);
+		util_convert_from_xrgb8888(format, src, width * sizeof(*src),
+					   planes, width, 1, stride);
+		util_convert_to_xrgb8888(format, planes, stride, back,
+					 width * sizeof(*back), width, 1);
+		for (x = 0; x < width; x++) {
+			int d = (int)(back[x] & 0xff) - (int)(src[x] & 0xff);
+
+			if (d < -2 || d > 2)
+				goto done;
+		}
+	}
+	ret = 0;
+
+done:
+	free(src);
+	free(back);
+	free(out);
+	return ret;
+}
+
+static int test_lookup(void)
+{
+	const struct util_format_info *info;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(formats); i++) {
+		info = util_format_info_find(formats[i]);
+		if (!info || info->format != formats[i] ||
+		    util_format_fourcc(info->name) != formats[i])
+			return -1;
+	}
+	if (util_format_info_find(0) ||
+	    util_format_info_find(fourcc_code('N', 'O', 'P', 'E')))
+		return -1;
+	return 0;
+}
+
+int main(void)
+{
+	unsigned int i, j;
+	int ret = 0;
+
+	srandom(0x5eed);
+
+	for (i = 0; i < ARRAY_SIZE(formats); i++) {
+		for (j = 0; j < ARRAY_SIZE(sizes); j++) {
+			if (test_format(formats[i], sizes[j][0], sizes[j][1])) {
+				printf("%.4s %ux%u: FAIL\n",
+				       (const char *)&formats[i],
+				       sizes[j][0], sizes[j][1]);
+				ret = 1;
+			}
+		}
+	}
+
+	if (util_convert_from_xrgb8888(DRM_FORMAT_YUV420, NULL, 0, NULL,
+				       0, 0, 0) != -EINVAL) {
+		printf("unsupported format: FAIL\n");
+		ret = 1;
+	}
+
+	if (test_lookup()) {
+		printf("format lookup: FAIL\n");
+		ret = 1;
+	}
+
+	return ret;
+}
@@ -22,12 +22,15 @@
  */
 
 #include <errno.h>
+#include <dirent.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <string.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <time.h>
 #include <unistd.h>
 #include <xf86drm.h>
 
@@ -104,12 +107,162 @@ print_device_info(drmDevicePtr device, int i, bool print_revision)
     printf("\n");
 }
 
+static double
+now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+struct timing {
+    const char *name;
+    unsigned int count;
+    double first, min, max, total;
+};
+
+static void
+timing_add(struct timing *t, double start)
+{
+    double elapsed = now_us() - start;
+
+    if (t->count == 0) {
+        t->first = t->min = t->max = elapsed;
+    } else {
+        if (elapsed < t->min)
+            t->min = elapsed;
+        if (elapsed > t->max)
+            t->max = elapsed;
+    }
+    t->total += elapsed;
+    t->count++;
+}
+
+static void
+timing_print(const struct timing *t)
+{
+    if (!t->count)
+        return;
+
+    printf("%-34s first %9.1fus  min %9.1fus  avg %9.1fus  max %9.1fus\n",
+           t->name, t->first, t->min, t->total / t->count, t->max);
+}
+
+/*
+ * Time the enumeration through the public entry points. The phases inside
+ * drmGetDevices2 aren't observable from here, so they're approximated by
+ * the steps a caller could do on its own: listing the device directory,
+ * parsing a single node with drmGetDevice2, and the full enumeration which
+ * adds folding the nodes of each device together.
+ */
+static int
+run_timing(unsigned int iterations)
+{
+    struct timing readdir_t = { .name = "readdir(" DRM_DIR_NAME ")" };
+    struct timing count_t = { .name = "drmGetDevices2 (count)" };
+    struct timing enum_t = { .name = "drmGetDevices2" };
+    struct timing enum_rev_t = { .name = "drmGetDevices2 (PCI revision)" };
+    struct timing node_t = { .name = "drmGetDevice2 per node" };
+    drmDevicePtr *devices;
+    drmDevicePtr device;
+    int max_devices, ret, fd;
+    unsigned int i;
+    double start;
+
+    max_devices = drmGetDevices2(0, NULL, 0);
+    if (max_devices <= 0) {
+        printf("drmGetDevices2() has not found any devices (errno=%d)\n",
+               -max_devices);
+        return 77;
+    }
+
+    devices = calloc(max_devices, sizeof(drmDevicePtr));
+    if (devices == NULL) {
+        printf("Failed to allocate memory for the drmDevicePtr array\n");
+        return -1;
+    }
+
+    for (i = 0; i < iterations; i++) {
+        DIR *dir;
+
+        start = now_us();
+        dir = opendir(DRM_DIR_NAME);
+        if (dir) {
+            while (readdir(dir))
+                ;
+            closedir(dir);
+        }
+        timing_add(&readdir_t, start);
+
+        start = now_us();
+        drmGetDevices2(0, NULL, 0);
+        timing_add(&count_t, start);
+
+        start = now_us();
+        ret = drmGetDevices2(0, devices, max_devices);
+        timing_add(&enum_t, start);
+        if (ret > 0)
+            drmFreeDevices(devices, ret);
+
+        start = now_us();
+        ret = drmGetDevices2(DRM_DEVICE_GET_PCI_REVISION, devices, max_devices);
+        timing_add(&enum_rev_t, start);
+        if (ret < 0) {
+            printf("drmGetDevices2() returned an error %d\n", ret);
+            free(devices);
+            return -1;
+        }
+
+        for (int j = 0; j < ret; j++) {
+            for (int k = 0; k < DRM_NODE_MAX; k++) {
+                if (!(devices[j]->available_nodes & 1 << k))
+                    continue;
+
+                fd = open(devices[j]->nodes[k], O_RDONLY | O_CLOEXEC, 0);
+                if (fd < 0)
+                    continue;
+
+                start = now_us();
+                if (drmGetDevice2(fd, DRM_DEVICE_GET_PCI_REVISION, &device) == 0) {
+                    timing_add(&node_t, start);
+                    drmFreeDevice(&device);
+                }
+                close(fd);
+            }
+        }
+
+        drmFreeDevices(devices, ret);
+    }
+
+    printf("--- %d devices, %u iterations ---\n", max_devices, iterations);
+    timing_print(&readdir_t);
+    timing_print(&count_t);
+    timing_print(&enum_t);
+    timing_print(&enum_rev_t);
+    timing_print(&node_t);
+
+    free(devices);
+    return 0;
+}
+
 int
-main(void)
+main(int argc, char **argv)
 {
     drmDevicePtr *devices;
     drmDevicePtr device;
     int fd, ret, max_devices;
+    int c;
+
+    while ((c = getopt(argc, argv, "t:")) != -1) {
+        switch (c) {
+        case 't':
+            return run_timing(strtoul(optarg, NULL, 0));
+        default:
+            fprintf(stderr, "usage: %s [-t iterations]\n", argv[0]);
+            return 1;
+        }
+    }
 
     printf("--- Checking the number of DRM device available ---\n");
     max_devices = drmGetDevices2(0, NULL, 0);
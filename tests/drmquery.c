@@ -0,0 +1,122 @@
+/*
+ * Copyright © 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Time the queries a driver or loader typically makes while creating a
+ * context, with and without the per-fd query cache.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <xf86drm.h>
+
+static const uint64_t caps[] = {
+    DRM_CAP_DUMB_BUFFER,
+    DRM_CAP_PRIME,
+    DRM_CAP_TIMESTAMP_MONOTONIC,
+    DRM_CAP_SYNCOBJ,
+    DRM_CAP_SYNCOBJ_TIMELINE,
+};
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int startup(int fd)
+{
+    drmVersionPtr version;
+    uint64_t value;
+    char *busid;
+    unsigned i;
+
+    version = drmGetVersion(fd);
+    if (!version)
+        return -1;
+    drmFreeVersion(version);
+
+    /* Render nodes have no bus id, so a NULL result is fine. */
+    busid = drmGetBusid(fd);
+    drmFreeBusid(busid);
+
+    for (i = 0; i < sizeof(caps) / sizeof(caps[0]); i++)
+        drmGetCap(fd, caps[i], &value);
+
+    return 0;
+}
+
+static int run(int fd, int iterations, const char *label)
+{
+    double start, elapsed;
+    int i;
+
+    start = now();
+    for (i = 0; i < iterations; i++) {
+        if (startup(fd)) {
+            fprintf(stderr, "drmGetVersion: %s\n", strerror(errno));
+            return -1;
+        }
+    }
+    elapsed = now() - start;
+
+    printf("%-10s %8.3f us per startup\n", label, elapsed * 1e6 / iterations);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = "/dev/dri/renderD128";
+    int iterations = 10000;
+    int fd, ret;
+
+    if (argc > 1)
+        path = argv[1];
+    if (argc > 2)
+        iterations = atoi(argv[2]);
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: %s [device node] [iterations]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    ret = run(fd, iterations, "uncached");
+    if (ret == 0) {
+        drmSetQueryCacheEnabled(fd, 1);
+        ret = run(fd, iterations, "cached");
+    }
+
+    drmClose(fd);
+    return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
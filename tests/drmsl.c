@@ -56,25 +56,43 @@ static void print(void* list)
     }
 }
 
+static double elapsed(const struct timeval *start)
+{
+    struct timeval stop;
+
+    gettimeofday(&stop, NULL);
+    return (double)(stop.tv_sec * 1000000 + stop.tv_usec
+		    - start->tv_sec * 1000000 - start->tv_usec);
+}
+
 static double do_time(int size, int iter)
 {
     void           *list;
     int            i, j;
-    unsigned long  keys[1000000];
+    unsigned long  *keys;
     unsigned long  previous;
-    unsigned long  key;
-    void           *value;
-    struct timeval start, stop;
-    double         usec;
+    unsigned long  key, prev_key, next_key;
+    void           *value, *prev_value, *next_value;
+    struct timeval start;
+    double         usec, insert_usec, walk_usec;
     void           *ranstate;
 
+    keys = malloc(size * sizeof(*keys));
+    if (!keys) {
+	printf("Out of memory\n");
+	exit(1);
+    }
+
     list = drmSLCreate();
     ranstate = drmRandomCreate(12345);
 
-    for (i = 0; i < size; i++) {
+    for (i = 0; i < size; i++)
 	keys[i] = drmRandom(ranstate);
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < size; i++)
 	drmSLInsert(list, keys[i], NULL);
-    }
+    insert_usec = elapsed(&start);
 
     previous = 0;
     if (drmSLFirst(list, &key, &value)) {
@@ -93,15 +111,30 @@ static double do_time(int size, int iter)
 		printf("Error %lu %d\n", keys[i], i);
 	}
     }
-    gettimeofday(&stop, NULL);
+    usec = elapsed(&start) / ((double)size * iter);
 
-    usec = (double)(stop.tv_sec * 1000000 + stop.tv_usec
-		    - start.tv_sec * 1000000 - start.tv_usec) / (size * iter);
+    /* Walk the list in key order through the neighbor lookups */
+    gettimeofday(&start, NULL);
+    key = 0;
+    for (i = 0; i < size; i++) {
+	if (drmSLLookupNeighbors(list, key + 1, &prev_key, &prev_value,
+				 &next_key, &next_value) < 2)
+	    break;
+	key = next_key;
+    }
+    walk_usec = elapsed(&start);
+    if (i != size)
+	printf("Error: neighbor walk stopped after %d of %d keys\n", i, size);
 
-    printf("%0.2f microseconds for list length %d\n", usec, size);
+    printf("%0.2f microseconds for list length %d "
+	   "(%0.0f inserts/s, %0.0f lookups/s, %0.0f sequential lookups/s)\n",
+	   usec, size, size / insert_usec * 1e6, 1e6 / usec,
+	   size / walk_usec * 1e6);
 
     drmRandomDouble(ranstate);
+    drmRandomDestroy(ranstate);
     drmSLDestroy(list);
+    free(keys);
 
     return usec;
 }
@@ -136,7 +169,7 @@ static void print_neighbors(void *list, unsigned long key,
 int main(void)
 {
     void*    list;
-    double   usec, usec2, usec3, usec4;
+    double   usec, usec2, usec3;
 
     list = drmSLCreate();
     printf( "list at %p\n", list);
@@ -167,18 +200,14 @@ int main(void)
     drmSLDestroy(list);
     printf("\n==============================\n\n");
 
-    usec  = do_time(100, 10000);
-    usec2 = do_time(1000, 500);
-    printf("Table size increased by %0.2f, search time increased by %0.2f\n",
-	   1000.0/100.0, usec2 / usec);
-
-    usec3 = do_time(10000, 50);
+    usec  = do_time(1000, 1000);
+    usec2 = do_time(100000, 10);
     printf("Table size increased by %0.2f, search time increased by %0.2f\n",
-	   10000.0/100.0, usec3 / usec);
+	   100000.0/1000.0, usec2 / usec);
 
-    usec4 = do_time(100000, 4);
+    usec3 = do_time(1000000, 1);
     printf("Table size increased by %0.2f, search time increased by %0.2f\n",
-	   100000.0/100.0, usec4 / usec);
+	   1000000.0/1000.0, usec3 / usec);
 
     return 0;
 }
@@ -0,0 +1,142 @@
+/*
+ * Copyright © 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * Decode an ioctl trace ring buffer written by drmIoctlTraceOpen() (or by
+ * running a program with LIBDRM_IOCTL_TRACE=<file>).
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <xf86drm.h>
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s [-s seconds] <trace file>\n\n"
+            "Print the records of an ioctl trace, oldest first.\n"
+            "  -s seconds    only print the last <seconds> before the newest record\n",
+            name);
+}
+
+int main(int argc, char **argv)
+{
+    const drmIoctlTraceHeader *trace;
+    const drmIoctlTraceEntry *entries;
+    uint64_t first, last, idx, mask, cutoff = 0, base = 0;
+    double seconds = 0.0;
+    struct stat st;
+    int fd, opt;
+
+    while ((opt = getopt(argc, argv, "s:h")) != -1) {
+        switch (opt) {
+        case 's':
+            seconds = atof(optarg);
+            break;
+        case 'h':
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    fd = open(argv[optind], O_RDONLY);
+    if (fd < 0 || fstat(fd, &st)) {
+        fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    if ((size_t)st.st_size < sizeof(*trace)) {
+        fprintf(stderr, "%s: file too small\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    trace = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (trace == MAP_FAILED) {
+        fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    if (trace->magic != DRM_IOCTL_TRACE_MAGIC ||
+        trace->version != DRM_IOCTL_TRACE_VERSION ||
+        trace->entry_size != sizeof(drmIoctlTraceEntry) ||
+        trace->num_entries == 0 ||
+        (trace->num_entries & (trace->num_entries - 1)) ||
+        (uint64_t)st.st_size < sizeof(*trace) +
+            (uint64_t)trace->num_entries * sizeof(drmIoctlTraceEntry)) {
+        fprintf(stderr, "%s: not a libdrm ioctl trace\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    entries = (const drmIoctlTraceEntry *)(trace + 1);
+    mask = trace->num_entries - 1;
+    last = trace->head;
+    first = last > trace->num_entries ? last - trace->num_entries : 0;
+
+    printf("pid %d, %" PRIu64 " records, %u slots\n",
+           trace->pid, last, trace->num_entries);
+    if (first == last)
+        return EXIT_SUCCESS;
+
+    if (seconds > 0.0) {
+        const drmIoctlTraceEntry *newest = &entries[(last - 1) & mask];
+        uint64_t window = seconds * 1e9;
+
+        if (newest->timestamp_ns > window)
+            cutoff = newest->timestamp_ns - window;
+    }
+
+    printf("%14s %5s %10s %4s %12s %6s\n",
+           "time (us)", "fd", "request", "nr", "duration(ns)", "ret");
+
+    for (idx = first; idx < last; idx++) {
+        const drmIoctlTraceEntry *entry = &entries[idx & mask];
+
+        /* Skip slots that were overwritten or are still being written */
+        if (entry->seq != idx + 1)
+            continue;
+        if (entry->timestamp_ns < cutoff)
+            continue;
+        if (!base)
+            base = entry->timestamp_ns;
+
+        printf("%14.3f %5d 0x%08" PRIx64 " 0x%02" PRIx64 " %12" PRIu64 " %6d%s%s\n",
+               (entry->timestamp_ns - base) / 1000.0, entry->fd,
+               entry->request, entry->request & 0xff, entry->duration_ns,
+               entry->ret, entry->ret < 0 ? " " : "",
+               entry->ret < 0 ? strerror(-entry->ret) : "");
+    }
+
+    return EXIT_SUCCESS;
+}
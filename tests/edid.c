@@ -0,0 +1,169 @@
+/*
+ * Copyright © 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Checks drmModeEdidParse() on a made up EDID with a CTA-861 extension.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xf86drm.h"
+#include "xf86drmMode.h"
+
+static int failures;
+
+#define check(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", \
+			__func__, __LINE__, #cond); \
+		failures++; \
+	} \
+} while (0)
+
+/* 1920x1080@60, CEA timing 16 */
+static const uint8_t dtd_1080p[18] = {
+	0x02, 0x3a, 0x80, 0x18, 0x71, 0x38, 0x2d, 0x40,
+	0x58, 0x2c, 0x45, 0x00, 0x40, 0x84, 0x63, 0x00, 0x00, 0x1e,
+};
+
+/* 1280x720@60, CEA timing 4 */
+static const uint8_t dtd_720p[18] = {
+	0x01, 0x1d, 0x00, 0x72, 0x51, 0xd0, 0x1e, 0x20,
+	0x6e, 0x28, 0x55, 0x00, 0x40, 0x84, 0x63, 0x00, 0x00, 0x1e,
+};
+
+static void checksum(uint8_t *block)
+{
+	uint8_t sum = 0;
+	int i;
+
+	for (i = 0; i < 127; i++)
+		sum += block[i];
+	block[127] = -sum;
+}
+
+static void build_edid(uint8_t *edid)
+{
+	static const uint8_t header[8] = {
+		0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00
+	};
+	uint8_t *d, *ext = edid + 128;
+
+	memset(edid, 0, 256);
+	memcpy(edid, header, sizeof(header));
+	edid[8] = 0x10;			/* "DEL" */
+	edid[9] = 0xac;
+	edid[10] = 0x34;
+	edid[11] = 0x12;
+	edid[12] = 0x78;
+	edid[13] = 0x56;
+	edid[16] = 10;
+	edid[17] = 30;
+	edid[18] = 1;
+	edid[19] = 4;
+	edid[21] = 60;
+	edid[22] = 34;
+
+	memcpy(edid + 54, dtd_1080p, sizeof(dtd_1080p));
+
+	d = edid + 72;			/* monitor name */
+	d[3] = 0xfc;
+	memcpy(d + 5, "Test Panel\n  ", 13);
+
+	d = edid + 90;			/* range limits, 48-144 Hz */
+	d[3] = 0xfd;
+	d[5] = 48;
+	d[6] = 144;
+
+	d = edid + 108;			/* dummy */
+	d[3] = 0x10;
+
+	edid[126] = 1;
+	checksum(edid);
+
+	ext[0] = 0x02;
+	ext[1] = 3;
+	ext[2] = 4 + 7;
+	ext[4] = 0x7 << 5 | 6;		/* HDR static metadata */
+	ext[5] = 6;
+	ext[6] = 0x05;			/* SDR, PQ */
+	ext[7] = 0x01;
+	ext[8] = 0x60;
+	ext[9] = 0x50;
+	ext[10] = 0x10;
+	memcpy(ext + 11, dtd_720p, sizeof(dtd_720p));
+	checksum(ext);
+}
+
+int main(void)
+{
+	uint8_t data[256];
+	drmModeEdidPtr edid;
+	drmModeModeInfoPtr mode;
+
+	build_edid(data);
+	edid = drmModeEdidParse(data, sizeof(data));
+	check(edid != NULL);
+	if (!edid)
+		return EXIT_FAILURE;
+
+	check(!strcmp(edid->vendor, "DEL"));
+	check(edid->product == 0x1234);
+	check(edid->serial == 0x5678);
+	check(edid->year == 2020 && edid->week == 10);
+	check(!strcmp(edid->name, "Test Panel"));
+	check(edid->width_mm == 600 && edid->height_mm == 340);
+	check(edid->min_vrefresh == 48 && edid->max_vrefresh == 144);
+
+	check(edid->count_modes == 2);
+	mode = &edid->modes[0];
+	check(edid->preferred == mode);
+	check(mode->clock == 148500 && mode->vrefresh == 60);
+	check(mode->hdisplay == 1920 && mode->hsync_start == 2008 &&
+	      mode->hsync_end == 2052 && mode->htotal == 2200);
+	check(mode->vdisplay == 1080 && mode->vsync_start == 1084 &&
+	      mode->vsync_end == 1089 && mode->vtotal == 1125);
+	check(mode->flags == (DRM_MODE_FLAG_PHSYNC | DRM_MODE_FLAG_PVSYNC));
+	check(mode->type & DRM_MODE_TYPE_PREFERRED);
+	check(!strcmp(mode->name, "1920x1080"));
+
+	mode = &edid->modes[1];
+	check(mode->hdisplay == 1280 && mode->vdisplay == 720 &&
+	      mode->vrefresh == 60);
+	check(!(mode->type & DRM_MODE_TYPE_PREFERRED));
+
+	check(edid->has_hdr && edid->hdr_eotfs == 0x05);
+	check(edid->hdr_max_luminance == 0x60 &&
+	      edid->hdr_max_frame_avg == 0x50 &&
+	      edid->hdr_min_luminance == 0x10);
+	drmModeFreeEdid(edid);
+
+	/* a damaged base block is rejected */
+	data[20] ^= 1;
+	check(drmModeEdidParse(data, sizeof(data)) == NULL);
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
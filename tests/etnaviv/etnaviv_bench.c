@@ -0,0 +1,296 @@
+/*
+ * Copyright 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Timings for the libdrm_etnaviv hot paths: etna_bo_new()/etna_bo_del()
+ * with and without the bo cache, etna_cmd_stream_reloc() against a growing
+ * number of distinct BOs, and the cost of a flush with and without waiting
+ * for the GPU.  Like amdgpu_bench every test runs for the same wall-clock
+ * time and the results are printed as JSON, one object per test.
+ *
+ * The streams only load the 2D source address, so nothing is drawn.
+ *
+ * Usage: etnaviv_bench <device> [milliseconds per test]
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "xf86drm.h"
+#include "etnaviv_drmif.h"
+#include "etnaviv_drm.h"
+
+#include "state.xml.h"
+#include "state_2d.xml.h"
+#include "cmdstream.xml.h"
+
+#define STREAM_SIZE	0x2000
+#define THROTTLE_DEPTH	4
+
+static struct etna_device *dev;
+static struct etna_pipe *bench_pipe;
+static double duration;
+static int num_results;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct timer {
+	double start;
+	double elapsed;
+	unsigned long ops;
+};
+
+static void timer_start(struct timer *t)
+{
+	t->ops = 0;
+	t->elapsed = 0;
+	t->start = now();
+}
+
+static int timer_running(struct timer *t)
+{
+	t->elapsed = now() - t->start;
+	return t->elapsed < duration;
+}
+
+/* @params is a JSON fragment of extra members, or NULL. */
+static void report(const char *name, const char *params, struct timer *t,
+		   double elapsed, int error)
+{
+	printf("%s\n    { \"name\": \"%s\"", num_results++ ? "," : "", name);
+	if (params)
+		printf(", %s", params);
+	if (error)
+		printf(", \"error\": %d }", error);
+	else
+		printf(", \"ops\": %lu, \"ops_per_sec\": %.1f, \"ns_per_op\": %.1f }",
+		       t->ops, t->ops / elapsed,
+		       t->ops ? elapsed * 1e9 / t->ops : 0.0);
+}
+
+static inline void emit_src_address(struct etna_cmd_stream *stream,
+		struct etna_bo *bo)
+{
+	etna_cmd_stream_emit(stream, VIV_FE_LOAD_STATE_HEADER_OP_LOAD_STATE |
+			VIV_FE_LOAD_STATE_HEADER_OFFSET(VIVS_DE_SRC_ADDRESS >> 2) |
+			VIV_FE_LOAD_STATE_HEADER_COUNT(1));
+	etna_cmd_stream_reloc(stream, &(struct etna_reloc){
+		.bo = bo,
+		.flags = ETNA_RELOC_READ,
+		.offset = 0,
+	});
+}
+
+static void bench_bo_new(uint32_t size, int cached)
+{
+	struct timer t = { 0 };
+	struct etna_bo *bo;
+	char params[64];
+
+	/* a budget of one byte evicts every bo as soon as it is freed */
+	etna_device_bo_cache_trim(dev, 0);
+	etna_device_set_bo_cache_budget(dev, cached ? 0 : 1);
+
+	snprintf(params, sizeof(params), "\"size\": %u, \"cached\": %s",
+		 size, cached ? "true" : "false");
+	timer_start(&t);
+	while (timer_running(&t)) {
+		bo = etna_bo_new(dev, size, ETNA_BO_WC);
+		if (!bo) {
+			report("bo_new_del", params, &t, t.elapsed, 1);
+			goto out;
+		}
+		etna_bo_del(bo);
+		t.ops++;
+	}
+	report("bo_new_del", params, &t, t.elapsed, 0);
+out:
+	etna_device_set_bo_cache_budget(dev, 0);
+	etna_device_bo_cache_trim(dev, 0);
+}
+
+/* Only the time spent emitting relocs is counted, not the flushes that
+ * empty the stream again.
+ */
+static void bench_reloc(unsigned nr_bos)
+{
+	struct etna_cmd_stream *stream;
+	struct etna_bo **bos;
+	struct timer t = { 0 };
+	double emitting = 0, start;
+	char params[32];
+	unsigned i, n = 0;
+	int error = 0;
+
+	snprintf(params, sizeof(params), "\"bos\": %u", nr_bos);
+
+	bos = calloc(nr_bos, sizeof(*bos));
+	stream = etna_cmd_stream_new(bench_pipe, STREAM_SIZE, NULL, NULL);
+	if (!bos || !stream) {
+		error = 1;
+		goto out;
+	}
+	for (i = 0; i < nr_bos; i++) {
+		bos[i] = etna_bo_new(dev, 0x1000, ETNA_BO_WC);
+		if (!bos[i]) {
+			error = 1;
+			goto out;
+		}
+	}
+
+	timer_start(&t);
+	while (timer_running(&t)) {
+		start = now();
+		while (etna_cmd_stream_avail(stream) >= 2) {
+			emit_src_address(stream, bos[n]);
+			if (++n == nr_bos)
+				n = 0;
+			t.ops++;
+		}
+		emitting += now() - start;
+
+		etna_cmd_stream_flush(stream);
+		etna_cmd_stream_throttle(stream, THROTTLE_DEPTH);
+	}
+	etna_cmd_stream_finish(stream);
+
+out:
+	report("cmd_stream_reloc", params, &t, emitting, error);
+	if (bos) {
+		for (i = 0; i < nr_bos && bos[i]; i++)
+			etna_bo_del(bos[i]);
+		free(bos);
+	}
+	if (stream)
+		etna_cmd_stream_del(stream);
+}
+
+/* A flush of a small stream, either just queued (throttled to a few in
+ * flight) or waited for, which is the submit to completion latency.
+ */
+static void bench_flush(int wait)
+{
+	struct etna_cmd_stream *stream;
+	struct etna_bo *bo;
+	struct timer t = { 0 };
+	const char *params = wait ? "\"wait\": true" : "\"wait\": false";
+
+	bo = etna_bo_new(dev, 0x1000, ETNA_BO_WC);
+	stream = etna_cmd_stream_new(bench_pipe, STREAM_SIZE, NULL, NULL);
+	if (!bo || !stream) {
+		report("cmd_stream_flush", params, &t, 0, 1);
+		goto out;
+	}
+
+	timer_start(&t);
+	while (timer_running(&t)) {
+		emit_src_address(stream, bo);
+		if (wait) {
+			etna_cmd_stream_finish(stream);
+		} else {
+			etna_cmd_stream_flush(stream);
+			etna_cmd_stream_throttle(stream, THROTTLE_DEPTH);
+		}
+		t.ops++;
+	}
+	etna_cmd_stream_finish(stream);
+	report("cmd_stream_flush", params, &t, t.elapsed, 0);
+
+out:
+	if (stream)
+		etna_cmd_stream_del(stream);
+	if (bo)
+		etna_bo_del(bo);
+}
+
+int main(int argc, char *argv[])
+{
+	static const uint32_t sizes[] = { 0x1000, 0x10000, 0x100000 };
+	static const unsigned nr_bos[] = { 16, 64, 256, 1024 };
+	struct etna_gpu *gpu;
+	unsigned i;
+	int fd, ret = 0;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <device> [milliseconds per test]\n",
+			argv[0]);
+		return 1;
+	}
+	duration = (argc > 2 ? atoi(argv[2]) : 1000) / 1000.0;
+
+	fd = open(argv[1], O_RDWR);
+	if (fd < 0)
+		return 1;
+
+	dev = etna_device_new(fd);
+	if (!dev) {
+		ret = 2;
+		goto out;
+	}
+
+	/* TODO: we assume that core 0 is a 2D capable one */
+	gpu = etna_gpu_new(dev, 0);
+	if (!gpu) {
+		ret = 3;
+		goto out_device;
+	}
+
+	bench_pipe = etna_pipe_new(gpu, ETNA_PIPE_2D);
+	if (!bench_pipe) {
+		ret = 4;
+		goto out_gpu;
+	}
+
+	printf("[");
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		bench_bo_new(sizes[i], 1);
+		bench_bo_new(sizes[i], 0);
+	}
+	for (i = 0; i < sizeof(nr_bos) / sizeof(nr_bos[0]); i++)
+		bench_reloc(nr_bos[i]);
+	bench_flush(0);
+	bench_flush(1);
+	printf("\n]\n");
+
+	etna_pipe_del(bench_pipe);
+
+out_gpu:
+	etna_gpu_del(gpu);
+
+out_device:
+	etna_device_del(dev);
+
+out:
+	close(fd);
+
+	return ret;
+}
@@ -57,6 +57,32 @@ static void test_cache(struct etna_device *dev)
 	printf("ok\n");
 }
 
+static void test_render_mru(struct etna_device *dev)
+{
+	struct etna_bo *a, *b, *tmp;
+
+	/* render allocations must get the most recently freed bo, others
+	 * the least recently freed one. */
+	printf("testing render mru ... ");
+
+	a = etna_bo_new(dev, 0x1000, ETNA_BO_UNCACHED);
+	b = etna_bo_new(dev, 0x1000, ETNA_BO_UNCACHED);
+	assert(a && b);
+	etna_bo_del(a);
+	etna_bo_del(b);
+
+	tmp = etna_bo_new(dev, 0x1000,
+			  ETNA_BO_UNCACHED | DRM_ETNA_GEM_ALLOC_FOR_RENDER);
+	assert(tmp == b);
+	etna_bo_del(tmp);
+
+	tmp = etna_bo_new(dev, 0x1000, ETNA_BO_UNCACHED);
+	assert(tmp == a);
+	etna_bo_del(tmp);
+
+	printf("ok\n");
+}
+
 static void test_size_rounding(struct etna_device *dev)
 {
 	struct etna_bo *bo;
@@ -78,6 +104,63 @@ static void test_size_rounding(struct etna_device *dev)
 	printf("ok\n");
 }
 
+static void test_tolerance(struct etna_device *dev)
+{
+	struct etna_bo *bo, *tmp;
+
+	/* with a tolerance sizes aren't rounded to the bucket size, and a
+	 * slightly bigger free bo of the same bucket is reused. */
+	printf("testing reuse tolerance ... ");
+
+	etna_device_set_bo_cache_tolerance(dev, 10);
+
+	bo = etna_bo_new(dev, 0x12000, ETNA_BO_UNCACHED);
+	assert(etna_bo_size(bo) == 0x12000);
+	etna_bo_del(bo);
+
+	tmp = etna_bo_new(dev, 0x11000, ETNA_BO_UNCACHED);
+	assert(tmp == bo);
+	etna_bo_del(tmp);
+
+	/* 0x12000 is more than 5% above 0x11000 */
+	etna_device_set_bo_cache_tolerance(dev, 5);
+	tmp = etna_bo_new(dev, 0x11000, ETNA_BO_UNCACHED);
+	assert(tmp != bo && etna_bo_size(tmp) == 0x11000);
+	etna_bo_del(tmp);
+
+	etna_device_set_bo_cache_tolerance(dev, 0);
+	tmp = etna_bo_new(dev, 0x11000, ETNA_BO_UNCACHED);
+	assert(etna_bo_size(tmp) == 0x14000);
+	etna_bo_del(tmp);
+
+	printf("ok\n");
+}
+
+static void test_budget(struct etna_device *dev)
+{
+	struct etna_bo *a, *b, *tmp;
+
+	/* freeing past the budget evicts the oldest cached bo */
+	printf("testing cache budget ... ");
+
+	etna_device_bo_cache_trim(dev, 0);
+	etna_device_set_bo_cache_budget(dev, 0x4000);
+
+	a = etna_bo_new(dev, 0x4000, ETNA_BO_UNCACHED);
+	b = etna_bo_new(dev, 0x4000, ETNA_BO_UNCACHED);
+	etna_bo_del(a);
+	etna_bo_del(b);
+
+	tmp = etna_bo_new(dev, 0x4000, ETNA_BO_UNCACHED);
+	assert(tmp == b);
+	etna_bo_del(tmp);
+
+	etna_device_set_bo_cache_budget(dev, 0);
+	etna_device_bo_cache_trim(dev, 0);
+
+	printf("ok\n");
+}
+
 int main(int argc, char *argv[])
 {
 	struct etna_device *dev;
@@ -106,7 +189,10 @@ int main(int argc, char *argv[])
 	}
 
 	test_cache(dev);
+	test_render_mru(dev);
 	test_size_rounding(dev);
+	test_tolerance(dev);
+	test_budget(dev);
 
 	etna_device_del(dev);
 
@@ -34,6 +34,24 @@
 #include "exynos_fimg2d.h"
 
 static int output_mathematica = 0;
+static int output_json = 0;
+
+enum perf_op {
+	PERF_OP_FILL,
+	PERF_OP_COPY,
+	PERF_OP_COPY_SCALE,
+	PERF_OP_BLEND,
+	PERF_OP_SCALE_BLEND,
+	PERF_OP_NR
+};
+
+static const char *const perf_op_names[PERF_OP_NR] = {
+	[PERF_OP_FILL] = "fill",
+	[PERF_OP_COPY] = "copy",
+	[PERF_OP_COPY_SCALE] = "copy_with_scale",
+	[PERF_OP_BLEND] = "blend",
+	[PERF_OP_SCALE_BLEND] = "scale_and_blend",
+};
 
 static int fimg2d_perf_simple(struct exynos_bo *bo, struct g2d_context *ctx,
 			unsigned buf_width, unsigned buf_height, unsigned iterations)
@@ -208,9 +226,219 @@ static int fimg2d_perf_multi(struct exynos_bo *bo, struct g2d_context *ctx,
 	return ret;
 }
 
+static void random_rect(unsigned buf_width, unsigned buf_height,
+			unsigned *x, unsigned *y, unsigned *w, unsigned *h)
+{
+	*x = rand() % buf_width;
+	*y = rand() % buf_height;
+
+	if (*x == (buf_width - 1))
+		*x -= 1;
+	if (*y == (buf_height - 1))
+		*y -= 1;
+
+	*w = rand() % (buf_width - *x);
+	*h = rand() % (buf_height - *y);
+
+	if (*w == 0) *w = 1;
+	if (*h == 0) *h = 1;
+}
+
+/* emit one operation with a random destination rectangle */
+static int perf_emit_op(struct g2d_context *ctx, enum perf_op op,
+			struct g2d_image *src, struct g2d_image *dst,
+			unsigned buf_width, unsigned buf_height, unsigned *num_pixels)
+{
+	unsigned sx, sy, sw, sh, dx, dy, dw, dh;
+
+	random_rect(buf_width, buf_height, &dx, &dy, &dw, &dh);
+	*num_pixels += dw * dh;
+
+	/* unscaled operations take a source rectangle of the same size */
+	sx = rand() % (buf_width - dw + 1);
+	sy = rand() % (buf_height - dh + 1);
+
+	switch (op) {
+	case PERF_OP_FILL:
+		dst->color = rand();
+		return g2d_solid_fill(ctx, dst, dx, dy, dw, dh);
+	case PERF_OP_COPY:
+		return g2d_copy(ctx, src, dst, sx, sy, dx, dy, dw, dh);
+	case PERF_OP_COPY_SCALE:
+		random_rect(buf_width, buf_height, &sx, &sy, &sw, &sh);
+		return g2d_copy_with_scale(ctx, src, dst, sx, sy, sw, sh,
+				dx, dy, dw, dh, 0);
+	case PERF_OP_BLEND:
+		return g2d_blend(ctx, src, dst, sx, sy, dx, dy, dw, dh,
+				G2D_OP_OVER);
+	case PERF_OP_SCALE_BLEND:
+		random_rect(buf_width, buf_height, &sx, &sy, &sw, &sh);
+		return g2d_scale_and_blend(ctx, src, dst, sx, sy, sw, sh,
+				dx, dy, dw, dh, G2D_OP_OVER);
+	case PERF_OP_NR:
+		break;
+	}
+
+	return -EINVAL;
+}
+
+/*
+ * fimg2d_perf_op - time @iterations execs of @batch operations each.
+ * The time includes setting up the command lists, as that is what a
+ * batch saves on.  A batch larger than the kernel's command list limit
+ * exercises the automatic intermediate exec.
+ */
+static int fimg2d_perf_op(struct g2d_context *ctx, enum perf_op op,
+			struct g2d_image *src, struct g2d_image *dst,
+			unsigned buf_width, unsigned buf_height,
+			unsigned iterations, unsigned batch)
+{
+	const char *src_name = "none";
+	unsigned long long g2d_time, total_time = 0, total_pixels = 0;
+	unsigned i, j;
+	int ret = 0;
+
+	if (op != PERF_OP_FILL)
+		src_name = src->buf_type == G2D_IMGBUF_USERPTR ? "userptr" : "gem";
+
+	srand(time(NULL));
+
+	if (!output_json) {
+		printf("starting %s G2D performance test (source = %s, batch size = %u)\n",
+			perf_op_names[op], src_name, batch);
+		printf("buffer width = %u, buffer height = %u, iterations = %u\n",
+			buf_width, buf_height, iterations);
+	}
+
+	if (output_mathematica)
+		putchar('{');
+
+	for (i = 0; i < iterations; ++i) {
+		struct timespec tspec = { 0 }, end = { 0 };
+		unsigned num_pixels = 0;
+
+		clock_gettime(CLOCK_MONOTONIC, &tspec);
+
+		for (j = 0; j < batch && ret == 0; ++j)
+			ret = perf_emit_op(ctx, op, src, dst, buf_width, buf_height,
+					&num_pixels);
+
+		if (ret == 0)
+			ret = g2d_exec(ctx);
+
+		if (ret != 0) {
+			fprintf(stderr, "error: %s iteration %u failed (num_pixels = %u)\n",
+				perf_op_names[op], i, num_pixels);
+			break;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		g2d_time = (end.tv_sec - tspec.tv_sec) * 1000000000ULL;
+		g2d_time += (end.tv_nsec - tspec.tv_nsec);
+
+		total_time += g2d_time;
+		total_pixels += num_pixels;
+
+		if (output_mathematica) {
+			if (i != 0) putchar(',');
+			printf("{%u,%llu}", num_pixels, g2d_time);
+		} else if (!output_json) {
+			printf("num_pixels = %u, usecs = %llu\n", num_pixels, g2d_time);
+		}
+	}
+
+	if (output_mathematica)
+		printf("}\n");
+
+	if (output_json && ret == 0) {
+		printf("{\"test\": \"%s\", \"source\": \"%s\", \"batch\": %u, "
+			"\"width\": %u, \"height\": %u, \"iterations\": %u, "
+			"\"pixels\": %llu, \"ns\": %llu, \"ops_per_sec\": %.1f, "
+			"\"mpixels_per_sec\": %.1f}\n",
+			perf_op_names[op], src_name, batch, buf_width, buf_height,
+			iterations, total_pixels, total_time,
+			total_time ? 1e9 * iterations * batch / total_time : 0.0,
+			total_time ? 1e3 * total_pixels / total_time : 0.0);
+	}
+
+	return ret;
+}
+
+static void init_image(struct g2d_image *img, unsigned buf_width,
+			unsigned buf_height)
+{
+	img->width = buf_width;
+	img->height = buf_height;
+	img->stride = buf_width * 4;
+	img->color_mode = G2D_COLOR_FMT_ARGB8888 | G2D_ORDER_AXRGB;
+	img->select_mode = G2D_SELECT_MODE_NORMAL;
+}
+
+/* all operations, with a GEM and a userptr source, unbatched and batched */
+static int fimg2d_perf_suite(struct exynos_device *dev, struct exynos_bo *bo,
+			struct g2d_context *ctx, unsigned buf_width,
+			unsigned buf_height, unsigned iterations, unsigned batch)
+{
+	const unsigned long size = buf_width * buf_height * 4;
+	struct g2d_image dst = { 0 }, src[2] = { { 0 } };
+	struct exynos_bo *src_bo;
+	void *userptr;
+	unsigned op, s, b;
+	int ret = 0;
+
+	src_bo = exynos_bo_create(dev, size, 0);
+	if (src_bo == NULL) {
+		fprintf(stderr, "error: failed to create source bo\n");
+		return -ENOMEM;
+	}
+
+	userptr = malloc(size);
+	if (userptr == NULL) {
+		fprintf(stderr, "error: failed to allocate userptr source\n");
+		exynos_bo_destroy(src_bo);
+		return -ENOMEM;
+	}
+
+	init_image(&dst, buf_width, buf_height);
+	dst.buf_type = G2D_IMGBUF_GEM;
+	dst.bo[0] = bo->handle;
+
+	init_image(&src[0], buf_width, buf_height);
+	src[0].buf_type = G2D_IMGBUF_GEM;
+	src[0].bo[0] = src_bo->handle;
+
+	init_image(&src[1], buf_width, buf_height);
+	src[1].buf_type = G2D_IMGBUF_USERPTR;
+	src[1].user_ptr[0].userptr = (unsigned long)userptr;
+	src[1].user_ptr[0].size = size;
+
+	for (op = 0; op < PERF_OP_NR && ret == 0; ++op) {
+		for (s = 0; s < 2 && ret == 0; ++s) {
+			/* fills have no source */
+			if (op == PERF_OP_FILL && s != 0)
+				break;
+
+			for (b = 0; b < 2 && ret == 0; ++b) {
+				if (b == 1 && batch == 1)
+					break;
+
+				ret = fimg2d_perf_op(ctx, op, &src[s], &dst,
+						buf_width, buf_height, iterations,
+						b ? batch : 1);
+			}
+		}
+	}
+
+	free(userptr);
+	exynos_bo_destroy(src_bo);
+
+	return ret;
+}
+
 static void usage(const char *name)
 {
-	fprintf(stderr, "usage: %s [-ibwh]\n\n", name);
+	fprintf(stderr, "usage: %s [-ibwhMAJ]\n\n", name);
 
 	fprintf(stderr, "\t-i <number of iterations>\n");
 	fprintf(stderr, "\t-b <size of a batch> (default = 3)\n\n");
@@ -219,13 +447,15 @@ static void usage(const char *name)
 	fprintf(stderr, "\t-h <buffer height> (default = 4096)\n\n");
 
 	fprintf(stderr, "\t-M <enable Mathematica styled output>\n");
+	fprintf(stderr, "\t-A <run all operations: copy, scale, blend, ...>\n");
+	fprintf(stderr, "\t-J <one JSON object per test, implies -A>\n");
 
 	exit(0);
 }
 
 int main(int argc, char **argv)
 {
-	int fd, ret, c, parsefail;
+	int fd, ret, c, parsefail, all = 0;
 
 	struct exynos_device *dev;
 	struct g2d_context *ctx;
@@ -237,7 +467,7 @@ int main(int argc, char **argv)
 	ret = 0;
 	parsefail = 0;
 
-	while ((c = getopt(argc, argv, "i:b:w:h:M")) != -1) {
+	while ((c = getopt(argc, argv, "i:b:w:h:MAJ")) != -1) {
 		switch (c) {
 		case 'i':
 			if (sscanf(optarg, "%u", &iters) != 1)
@@ -258,15 +488,29 @@ int main(int argc, char **argv)
 		case 'M':
 			output_mathematica = 1;
 			break;
+		case 'A':
+			all = 1;
+			break;
+		case 'J':
+			output_json = 1;
+			all = 1;
+			break;
 		default:
 			parsefail = 1;
 			break;
 		}
 	}
 
-	if (parsefail || (argc == 1) || (iters == 0))
+	if (parsefail || (argc == 1) || (iters == 0) || (batch == 0))
 		usage(argv[0]);
 
+	if (output_json && output_mathematica) {
+		fprintf(stderr, "error: -M and -J are mutually exclusive.\n");
+		ret = -1;
+
+		goto out;
+	}
+
 	if (bufw < 2 || bufw > 4096 || bufh < 2 || bufh > 4096) {
 		fprintf(stderr, "error: buffer width/height should be in the range 2 to 4096.\n");
 		ret = -1;
@@ -306,10 +550,16 @@ int main(int argc, char **argv)
 		goto bo_fail;
 	}
 
-	ret = fimg2d_perf_simple(bo, ctx, bufw, bufh, iters);
+	/* the JSON output is for the suite only, keep it parseable */
+	if (!output_json) {
+		ret = fimg2d_perf_simple(bo, ctx, bufw, bufh, iters);
+
+		if (ret == 0)
+			ret = fimg2d_perf_multi(bo, ctx, bufw, bufh, iters, batch);
+	}
 
-	if (ret == 0)
-		ret = fimg2d_perf_multi(bo, ctx, bufw, bufh, iters, batch);
+	if (ret == 0 && all)
+		ret = fimg2d_perf_suite(dev, bo, ctx, bufw, bufh, iters, batch);
 
 	exynos_bo_destroy(bo);
 
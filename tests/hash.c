@@ -68,8 +68,10 @@
  *
  */
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include "xf86drm.h"
 #include "xf86drmHash.h"
@@ -103,14 +105,16 @@ static void update_dist(int count)
 
 static void compute_dist(HashTablePtr table)
 {
+    unsigned long b;
     int           i;
     HashBucketPtr bucket;
 
     printf("Entries = %ld, hits = %ld, partials = %ld, misses = %ld\n",
           table->entries, table->hits, table->partials, table->misses);
+    printf("Buckets = %ld\n", table->size);
     clear_dist();
-    for (i = 0; i < HASH_SIZE; i++) {
-        bucket = table->buckets[i];
+    for (b = 0; b < table->size; b++) {
+        bucket = table->buckets[b];
         update_dist(count_entries(bucket));
     }
     for (i = 0; i < DIST_LIMIT; i++) {
@@ -152,6 +156,79 @@ static int check_table(HashTablePtr table,
     return retcode;
 }
 
+static int check_intmap(void)
+{
+    uint32_t      keys[4096];
+    unsigned long i;
+    void         *map, *value;
+    int           ret = 0;
+
+    printf("\n***** intmap: 4096 random keys, half deleted ****\n");
+    map = drmIntMapCreate();
+    srandom(0xbeefbeef);
+    for (i = 0; i < 4096; i++) {
+        keys[i] = random();
+        if (drmIntMapInsert(map, keys[i], (void *)(i << 16 | i)) < 0)
+            ret = -1;
+    }
+    for (i = 0; i < 4096; i += 2)
+        drmIntMapDelete(map, keys[i]);
+    for (i = 0; i < 4096; i++) {
+        int found = drmIntMapLookup(map, keys[i], &value) == 0;
+
+        if (found != (int)(i & 1) ||
+            (found && value != (void *)(i << 16 | i))) {
+            printf("Bad lookup: key = %u, found = %d\n", keys[i], found);
+            ret = -1;
+        }
+    }
+    printf("Entries = %u\n", drmIntMapCount(map));
+    drmIntMapDestroy(map);
+
+    return ret;
+}
+
+static double elapsed(const struct timespec *start)
+{
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Compare drmHash and drmIntMap lookups of dense, handle-like keys */
+static void bench_lookups(unsigned long count)
+{
+    unsigned long   i, rounds = 2000000 / count;
+    struct timespec start;
+    void           *hash, *map, *value;
+    double          t_hash, t_map;
+
+    hash = drmHashCreate();
+    map = drmIntMapCreate();
+    for (i = 1; i <= count; i++) {
+        drmHashInsert(hash, i, (void *)i);
+        drmIntMapInsert(map, i, (void *)i);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < rounds * count; i++)
+        drmHashLookup(hash, 1 + (i * 7919) % count, &value);
+    t_hash = elapsed(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < rounds * count; i++)
+        drmIntMapLookup(map, 1 + (i * 7919) % count, &value);
+    t_map = elapsed(&start);
+
+    printf("%7lu keys: drmHash %6.1f ns/lookup, drmIntMap %6.1f ns/lookup\n",
+           count, t_hash * 1e9 / (rounds * count),
+           t_map * 1e9 / (rounds * count));
+
+    drmHashDestroy(hash);
+    drmIntMapDestroy(map);
+}
+
 int main(void)
 {
     HashTablePtr  table;
@@ -213,5 +290,31 @@ int main(void)
     compute_dist(table);
     drmHashDestroy(table);
 
+    printf("\n***** 50000 consecutive integers, reserved, half deleted ****\n");
+    table = drmHashCreate();
+    drmHashReserve(table, 50000);
+    for (i = 0; i < 50000; i++)
+        drmHashInsert(table, i, (void *)(i << 16 | i));
+    for (i = 0; i < 50000; i += 2)
+        drmHashDelete(table, i);
+    for (i = 1; i < 50000; i += 2)
+        ret |= check_table(table, i, (void *)(i << 16 | i));
+    for (i = 0; i < 50000; i += 2) {
+        void *value;
+        if (drmHashLookup(table, i, &value) != 1) {
+            printf("Deleted key %lu still found\n", i);
+            ret = -1;
+        }
+    }
+    compute_dist(table);
+    drmHashDestroy(table);
+
+    ret |= check_intmap();
+
+    printf("\n***** lookup benchmark ****\n");
+    bench_lookups(100);
+    bench_lookups(10000);
+    bench_lookups(1000000);
+
     return ret;
 }
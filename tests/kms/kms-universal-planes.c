@@ -21,12 +21,14 @@
  * IN THE SOFTWARE.
  */
 
+#include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 #ifdef HAVE_SYS_SELECT_H
 #include <sys/select.h>
@@ -116,17 +118,436 @@ static void prepare_framebuffer(struct kms_framebuffer *fb, bool invert)
 	kms_framebuffer_unmap(fb);
 }
 
+/*
+ * Stress mode: every overlay and cursor plane of one CRTC is moved, and
+ * overlays are also resized by cropping, once per vblank.  With --atomic
+ * each frame is a single nonblocking commit of all planes that asks for a
+ * page-flip event; otherwise the loop waits for a vblank event and then
+ * updates the planes one drmModeSetPlane() at a time.  An update lands on
+ * the vblank its flip event reports, or for the legacy path on the vblank
+ * count right after drmModeSetPlane() returns.  Every vblank between two
+ * landed updates of a plane counts as dropped for it.
+ */
+enum {
+	STRESS_FB_ID,
+	STRESS_CRTC_ID,
+	STRESS_CRTC_X,
+	STRESS_CRTC_Y,
+	STRESS_CRTC_W,
+	STRESS_CRTC_H,
+	STRESS_SRC_X,
+	STRESS_SRC_Y,
+	STRESS_SRC_W,
+	STRESS_SRC_H,
+	STRESS_NUM_PROPS
+};
+
+static const char *const stress_prop_names[STRESS_NUM_PROPS] = {
+	"FB_ID", "CRTC_ID", "CRTC_X", "CRTC_Y", "CRTC_W", "CRTC_H",
+	"SRC_X", "SRC_Y", "SRC_W", "SRC_H",
+};
+
+struct stress_plane {
+	struct kms_plane *plane;
+	struct kms_framebuffer *fb;
+	uint32_t props[STRESS_NUM_PROPS];
+	bool resize;
+
+	unsigned int x, y, width, height;
+
+	unsigned int updates;
+	unsigned int dropped;
+	unsigned int errors;
+	unsigned int last_sequence;
+};
+
+struct stress_event {
+	bool done;
+	unsigned int sequence;
+};
+
+static const char *plane_type_name(unsigned int type)
+{
+	switch (type) {
+	case DRM_PLANE_TYPE_OVERLAY:
+		return "overlay";
+	case DRM_PLANE_TYPE_PRIMARY:
+		return "primary";
+	case DRM_PLANE_TYPE_CURSOR:
+		return "cursor";
+	}
+	return "unknown";
+}
+
+static int stress_find_props(int fd, struct stress_plane *sp)
+{
+	drmModeObjectPropertiesPtr props;
+	drmModePropertyPtr prop;
+	unsigned int i, j;
+
+	props = drmModeObjectGetProperties(fd, sp->plane->id,
+					   DRM_MODE_OBJECT_PLANE);
+	if (!props)
+		return -errno;
+
+	for (i = 0; i < props->count_props; i++) {
+		prop = drmModeGetProperty(fd, props->props[i]);
+		if (!prop)
+			continue;
+		for (j = 0; j < STRESS_NUM_PROPS; j++)
+			if (strcmp(prop->name, stress_prop_names[j]) == 0)
+				sp->props[j] = prop->prop_id;
+		drmModeFreeProperty(prop);
+	}
+	drmModeFreeObjectProperties(props);
+
+	for (j = 0; j < STRESS_NUM_PROPS; j++)
+		if (!sp->props[j])
+			return -ENOENT;
+	return 0;
+}
+
+/* 0 .. range .. 0, one step per n */
+static unsigned int bounce(unsigned int n, unsigned int range)
+{
+	if (range == 0)
+		return 0;
+
+	n %= 2 * range;
+	return n < range ? n : 2 * range - n;
+}
+
+static void stress_plane_move(struct stress_plane *sp, unsigned int index,
+			      unsigned int frame, unsigned int width,
+			      unsigned int height)
+{
+	sp->width = sp->fb->width;
+	sp->height = sp->fb->height;
+	if (sp->resize) {
+		sp->width = sp->fb->width / 2 +
+			    bounce(frame * 2, sp->fb->width / 2);
+		sp->height = sp->fb->height / 2 +
+			     bounce(frame * 2, sp->fb->height / 2);
+	}
+	if (sp->width > width)
+		sp->width = width;
+	if (sp->height > height)
+		sp->height = height;
+
+	sp->x = bounce(frame * (4 + 2 * index), width - sp->width);
+	sp->y = bounce(frame * (3 + index), height - sp->height);
+}
+
+static void stress_plane_landed(struct stress_plane *sp,
+				unsigned int sequence)
+{
+	if (sp->updates && sequence - sp->last_sequence > 1)
+		sp->dropped += sequence - sp->last_sequence - 1;
+	sp->last_sequence = sequence;
+	sp->updates++;
+}
+
+static void stress_event_handler(int fd, unsigned int sequence,
+				 unsigned int tv_sec, unsigned int tv_usec,
+				 void *user_data)
+{
+	struct stress_event *event = user_data;
+
+	event->sequence = sequence;
+	event->done = true;
+}
+
+static int stress_wait_event(int fd, struct stress_event *event)
+{
+	drmEventContext evctx = {
+		.version = 2,
+		.vblank_handler = stress_event_handler,
+		.page_flip_handler = stress_event_handler,
+	};
+	struct timeval timeout;
+	fd_set fds;
+	int err;
+
+	while (!event->done) {
+		timeout.tv_sec = 1;
+		timeout.tv_usec = 0;
+		FD_ZERO(&fds);
+		FD_SET(fd, &fds);
+
+		err = select(fd + 1, &fds, NULL, NULL, &timeout);
+		if (err < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (err == 0)
+			return -ETIMEDOUT;
+
+		drmHandleEvent(fd, &evctx);
+	}
+	return 0;
+}
+
+static uint32_t stress_vblank_type(unsigned int pipe)
+{
+	if (pipe > 1)
+		return (pipe << DRM_VBLANK_HIGH_CRTC_SHIFT) &
+		       DRM_VBLANK_HIGH_CRTC_MASK;
+	return pipe ? DRM_VBLANK_SECONDARY : 0;
+}
+
+static int stress_vblank(int fd, unsigned int pipe, bool event,
+			 unsigned int *sequence, void *data)
+{
+	drmVBlank vbl;
+
+	memset(&vbl, 0, sizeof(vbl));
+	vbl.request.type = DRM_VBLANK_RELATIVE | stress_vblank_type(pipe);
+	if (event) {
+		vbl.request.type |= DRM_VBLANK_EVENT;
+		vbl.request.sequence = 1;
+		vbl.request.signal = (unsigned long)data;
+	}
+	if (drmWaitVBlank(fd, &vbl))
+		return -errno;
+
+	if (sequence)
+		*sequence = vbl.reply.sequence;
+	return 0;
+}
+
+static int stress_commit(int fd, struct kms_crtc *crtc,
+			 struct stress_plane *planes, unsigned int count,
+			 struct stress_event *event)
+{
+	drmModeAtomicReqPtr req;
+	unsigned int i;
+	int err = 0;
+
+	req = drmModeAtomicAlloc();
+	if (!req)
+		return -ENOMEM;
+
+	for (i = 0; i < count; i++) {
+		struct stress_plane *sp = &planes[i];
+		const uint64_t values[STRESS_NUM_PROPS] = {
+			[STRESS_FB_ID] = sp->fb->id,
+			[STRESS_CRTC_ID] = crtc->id,
+			[STRESS_CRTC_X] = sp->x,
+			[STRESS_CRTC_Y] = sp->y,
+			[STRESS_CRTC_W] = sp->width,
+			[STRESS_CRTC_H] = sp->height,
+			[STRESS_SRC_X] = 0,
+			[STRESS_SRC_Y] = 0,
+			[STRESS_SRC_W] = (uint64_t)sp->width << 16,
+			[STRESS_SRC_H] = (uint64_t)sp->height << 16,
+		};
+		unsigned int j;
+
+		for (j = 0; j < STRESS_NUM_PROPS; j++)
+			if (drmModeAtomicAddProperty(req, sp->plane->id,
+						     sp->props[j],
+						     values[j]) < 0)
+				err = -ENOMEM;
+	}
+
+	if (!err && drmModeAtomicCommit(fd, req, DRM_MODE_PAGE_FLIP_EVENT |
+					DRM_MODE_ATOMIC_NONBLOCK, event))
+		err = -errno;
+
+	drmModeAtomicFree(req);
+	return err;
+}
+
+static double elapsed_since(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) +
+	       (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int stress_planes(struct kms_device *device, bool atomic,
+			 unsigned int seconds)
+{
+	struct stress_plane planes[32];
+	struct kms_crtc *crtc = NULL;
+	unsigned int count = 0, pipe = 0, frame, sequence, i;
+	uint64_t cursor_width, cursor_height;
+	struct stress_event event;
+	struct timespec start;
+	drmModeCrtcPtr mode;
+	unsigned int width, height;
+	double elapsed;
+	int fd = device->fd;
+	int err = 0;
+
+	if (drmGetCap(fd, DRM_CAP_CURSOR_WIDTH, &cursor_width))
+		cursor_width = 64;
+	if (drmGetCap(fd, DRM_CAP_CURSOR_HEIGHT, &cursor_height))
+		cursor_height = 64;
+
+	memset(planes, 0, sizeof(planes));
+
+	for (i = 0; i < device->num_planes && count < ARRAY_SIZE(planes); i++) {
+		struct kms_plane *plane = device->planes[i];
+		struct stress_plane *sp = &planes[count];
+		uint32_t format;
+
+		if (plane->type != DRM_PLANE_TYPE_OVERLAY &&
+		    plane->type != DRM_PLANE_TYPE_CURSOR)
+			continue;
+		if (!plane->crtc || (crtc && plane->crtc != crtc))
+			continue;
+
+		format = choose_format(plane);
+		if (!format)
+			continue;
+
+		sp->plane = plane;
+		sp->resize = plane->type == DRM_PLANE_TYPE_OVERLAY;
+		if (atomic && stress_find_props(fd, sp) < 0) {
+			fprintf(stderr, "plane %x lacks atomic properties\n",
+				plane->id);
+			continue;
+		}
+
+		if (sp->resize)
+			sp->fb = kms_framebuffer_create(device, 320, 240,
+							format);
+		else
+			sp->fb = kms_framebuffer_create(device, cursor_width,
+							cursor_height, format);
+		if (!sp->fb) {
+			fprintf(stderr, "failed to create %ux%u buffer\n",
+				sp->resize ? 320 : (unsigned int)cursor_width,
+				sp->resize ? 240 : (unsigned int)cursor_height);
+			continue;
+		}
+		prepare_framebuffer(sp->fb, false);
+
+		crtc = plane->crtc;
+		count++;
+	}
+
+	if (!count) {
+		fprintf(stderr, "no overlay or cursor planes to stress\n");
+		return 1;
+	}
+
+	for (i = 0; i < device->num_crtcs; i++)
+		if (device->crtcs[i] == crtc)
+			pipe = i;
+
+	mode = drmModeGetCrtc(fd, crtc->id);
+	if (!mode || !mode->mode_valid) {
+		fprintf(stderr, "CRTC %x is not active\n", crtc->id);
+		drmModeFreeCrtc(mode);
+		err = -EINVAL;
+		goto out;
+	}
+	width = mode->mode.hdisplay;
+	height = mode->mode.vdisplay;
+	drmModeFreeCrtc(mode);
+
+	printf("stressing %u planes on CRTC %x (%ux%u) for %u s, %s\n",
+	       count, crtc->id, width, height, seconds,
+	       atomic ? "atomic" : "legacy");
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (frame = 0; elapsed_since(&start) < seconds; frame++) {
+		for (i = 0; i < count; i++)
+			stress_plane_move(&planes[i], i, frame, width, height);
+
+		memset(&event, 0, sizeof(event));
+
+		if (atomic) {
+			bool committed;
+
+			err = stress_commit(fd, crtc, planes, count, &event);
+			committed = err == 0;
+			if (!committed) {
+				for (i = 0; i < count; i++)
+					planes[i].errors++;
+				/* no flip event coming, keep the pace */
+				err = stress_vblank(fd, pipe, true, NULL,
+						    &event);
+			}
+			if (!err)
+				err = stress_wait_event(fd, &event);
+			if (err < 0)
+				break;
+
+			for (i = 0; committed && i < count; i++)
+				stress_plane_landed(&planes[i], event.sequence);
+			continue;
+		}
+
+		err = stress_vblank(fd, pipe, true, NULL, &event);
+		if (!err)
+			err = stress_wait_event(fd, &event);
+		if (err < 0)
+			break;
+
+		for (i = 0; i < count; i++) {
+			struct stress_plane *sp = &planes[i];
+
+			if (drmModeSetPlane(fd, sp->plane->id, crtc->id,
+					    sp->fb->id, 0, sp->x, sp->y,
+					    sp->width, sp->height, 0, 0,
+					    sp->width << 16,
+					    sp->height << 16)) {
+				sp->errors++;
+				continue;
+			}
+			if (stress_vblank(fd, pipe, false, &sequence,
+					  NULL) == 0)
+				stress_plane_landed(sp, sequence);
+		}
+	}
+
+	elapsed = elapsed_since(&start);
+	if (err < 0)
+		fprintf(stderr, "stopped after %u frames: %s\n", frame,
+			strerror(-err));
+
+	for (i = 0; i < count; i++) {
+		struct stress_plane *sp = &planes[i];
+
+		printf("plane %x (%s): %u updates in %.1f s, %.2f Hz, "
+		       "%u dropped, %u errors\n", sp->plane->id,
+		       plane_type_name(sp->plane->type), sp->updates, elapsed,
+		       elapsed > 0 ? sp->updates / elapsed : 0.0, sp->dropped,
+		       sp->errors);
+	}
+
+out:
+	for (i = 0; i < count; i++) {
+		drmModeSetPlane(fd, planes[i].plane->id, crtc->id, 0, 0,
+				0, 0, 0, 0, 0, 0, 0, 0);
+		kms_framebuffer_free(planes[i].fb);
+	}
+
+	return err < 0 ? 1 : 0;
+}
+
 int main(int argc, char *argv[])
 {
-	static const char opts[] = "chopv";
+	static const char opts[] = "achops:v";
 	static struct option options[] = {
+		{ "atomic", 0, 0, 'a' },
 		{ "cursor", 0, 0, 'c' },
 		{ "help", 0, 0, 'h' },
 		{ "overlay", 0, 0, 'o' },
 		{ "primary", 0, 0, 'p' },
+		{ "stress", 1, 0, 's' },
 		{ "verbose", 0, 0, 'v' },
 		{ 0, 0, 0, 0 },
 	};
+	unsigned int stress_seconds = 0;
+	bool use_atomic = false;
 	struct kms_framebuffer *cursor = NULL;
 	struct kms_framebuffer *root = NULL;
 	struct kms_framebuffer *fb = NULL;
@@ -142,6 +563,10 @@ int main(int argc, char *argv[])
 
 	while ((opt = getopt_long(argc, argv, opts, options, &idx)) != -1) {
 		switch (opt) {
+		case 'a':
+			use_atomic = true;
+			break;
+
 		case 'c':
 			use_cursor = true;
 			break;
@@ -157,6 +582,10 @@ int main(int argc, char *argv[])
 			use_primary = true;
 			break;
 
+		case 's':
+			stress_seconds = strtoul(optarg, NULL, 10);
+			break;
+
 		case 'v':
 			verbose = true;
 			break;
@@ -184,6 +613,14 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 
+	if (use_atomic) {
+		err = drmSetClientCap(fd, DRM_CLIENT_CAP_ATOMIC, 1);
+		if (err < 0) {
+			fprintf(stderr, "drmSetClientCap() failed: %d\n", err);
+			return 1;
+		}
+	}
+
 	device = kms_device_open(fd);
 	if (!device)
 		return 1;
@@ -232,6 +669,13 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	if (stress_seconds) {
+		err = stress_planes(device, use_atomic, stress_seconds);
+		kms_device_close(device);
+		close(fd);
+		return err;
+	}
+
 	if (use_cursor) {
 		unsigned int x, y;
 		uint32_t format;
@@ -50,6 +50,7 @@
 #include <strings.h>
 #include <errno.h>
 #include <poll.h>
+#include <time.h>
 #include <sys/time.h>
 #ifdef HAVE_SYS_SELECT_H
 #include <sys/select.h>
@@ -157,6 +158,8 @@ struct device {
 
 	int use_atomic;
 	drmModeAtomicReq *req;
+
+	FILE *flip_log;
 };
 
 static inline int64_t U642I64(uint64_t val)
@@ -844,6 +847,15 @@ static drmModeEncoder *get_encoder_by_id(struct device *dev, uint32_t id)
  * Then you need to find the encoder attached to that connector so you
  * can bind it with a free crtc.
  */
+#define FLIP_STATS_BIN_US	50
+#define FLIP_STATS_BINS		4096
+
+struct flip_stats {
+	unsigned int count;
+	uint64_t min, max, sum;
+	unsigned int bins[FLIP_STATS_BINS];
+};
+
 struct pipe_arg {
 	const char **cons;
 	uint32_t *con_ids;
@@ -859,6 +871,16 @@ struct pipe_arg {
 	struct timeval start;
 
 	int swap_count;
+
+	/* page flip timing, in microseconds */
+	uint64_t flip_submit;
+	uint64_t last_flip;
+	uint64_t last_interval;
+	unsigned int last_frame;
+	unsigned int missed;
+	uint64_t jitter_sum;
+	struct flip_stats *interval;
+	struct flip_stats *latency;
 };
 
 struct plane_arg {
@@ -1082,6 +1104,104 @@ static bool set_property(struct device *dev, struct property_arg *p)
 
 /* -------------------------------------------------------------------------- */
 
+static FILE *flip_log;
+
+static uint64_t get_monotonic_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+static void flip_stats_add(struct flip_stats *stats, uint64_t value)
+{
+	uint64_t bin = value / FLIP_STATS_BIN_US;
+
+	if (stats->count == 0 || value < stats->min)
+		stats->min = value;
+	if (value > stats->max)
+		stats->max = value;
+	stats->sum += value;
+	stats->count++;
+	stats->bins[bin < FLIP_STATS_BINS ? bin : FLIP_STATS_BINS - 1]++;
+}
+
+/* upper edge of the histogram bin holding the given percentile */
+static uint64_t flip_stats_percentile(const struct flip_stats *stats,
+				      unsigned int pct)
+{
+	uint64_t target = ((uint64_t)stats->count * pct + 99) / 100;
+	uint64_t seen = 0;
+	unsigned int i;
+
+	for (i = 0; i < FLIP_STATS_BINS - 1; i++) {
+		seen += stats->bins[i];
+		if (seen >= target)
+			break;
+	}
+
+	if (i == FLIP_STATS_BINS - 1)
+		return stats->max;
+
+	target = (uint64_t)(i + 1) * FLIP_STATS_BIN_US;
+	return target < stats->max ? target : stats->max;
+}
+
+static void flip_stats_print(const char *name, const struct flip_stats *stats)
+{
+	if (!stats->count)
+		return;
+
+	fprintf(stderr, "  %-10s min %.3fms avg %.3fms p99 %.3fms max %.3fms\n",
+		name, stats->min / 1000.0,
+		(double)stats->sum / stats->count / 1000.0,
+		flip_stats_percentile(stats, 99) / 1000.0,
+		stats->max / 1000.0);
+}
+
+static void
+page_flip_stats(struct pipe_arg *pipe, unsigned int frame,
+		unsigned int sec, unsigned int usec)
+{
+	uint64_t now = sec * 1000000ull + usec;
+	uint64_t latency = now - pipe->flip_submit;
+	uint64_t interval = 0;
+
+	if (pipe->last_flip) {
+		interval = now - pipe->last_flip;
+		if (frame - pipe->last_frame > 1)
+			pipe->missed += frame - pipe->last_frame - 1;
+		flip_stats_add(pipe->interval, interval);
+
+		if (pipe->last_interval)
+			pipe->jitter_sum += interval > pipe->last_interval ?
+					    interval - pipe->last_interval :
+					    pipe->last_interval - interval;
+		pipe->last_interval = interval;
+	}
+
+	flip_stats_add(pipe->latency, latency);
+
+	if (flip_log)
+		fprintf(flip_log, "%u,%u,%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+			pipe->crtc->crtc->crtc_id, frame, now, interval, latency);
+
+	pipe->last_flip = now;
+	pipe->last_frame = frame;
+}
+
+static void page_flip_report(struct pipe_arg *pipe)
+{
+	unsigned int count = pipe->interval->count;
+
+	fprintf(stderr, "CRTC %u: %u flips, %u missed vblanks, jitter %.3fms\n",
+		pipe->crtc->crtc->crtc_id, pipe->latency->count, pipe->missed,
+		count > 1 ? (double)pipe->jitter_sum / (count - 1) / 1000.0 : 0.0);
+	flip_stats_print("interval", pipe->interval);
+	flip_stats_print("latency", pipe->latency);
+}
+
 static void
 page_flip_handler(int fd, unsigned int frame,
 		  unsigned int sec, unsigned int usec, void *data)
@@ -1092,6 +1212,8 @@ page_flip_handler(int fd, unsigned int frame,
 	double t;
 
 	pipe = data;
+	page_flip_stats(pipe, frame, sec, usec);
+
 	if (pipe->current_fb_id == pipe->fb_id[0])
 		new_fb_id = pipe->fb_id[1];
 	else
@@ -1099,6 +1221,7 @@ page_flip_handler(int fd, unsigned int frame,
 
 	drmModePageFlip(fd, pipe->crtc->crtc->crtc_id, new_fb_id,
 			DRM_MODE_PAGE_FLIP_EVENT, pipe);
+	pipe->flip_submit = get_monotonic_us();
 	pipe->current_fb_id = new_fb_id;
 	pipe->swap_count++;
 	if (pipe->swap_count == 60) {
@@ -1482,6 +1605,238 @@ static void atomic_clear_mode(struct device *dev, struct pipe_arg *pipes, unsign
 	}
 }
 
+/*
+ * Non-blocking atomic flip benchmark. Every plane gets three framebuffers
+ * of its own, and each CRTC flips its planes with a commit of its own, so
+ * the heads run at their own pace and never wait on each other.
+ */
+#define BENCH_BUFFERS 3
+
+struct bench_plane {
+	struct plane_arg *p;
+	struct bo *bo[BENCH_BUFFERS];
+	uint32_t fb_id[BENCH_BUFFERS];
+};
+
+struct bench_crtc {
+	uint32_t crtc_id;
+	struct bench_plane **planes;
+	unsigned int num_planes;
+	unsigned int frame;
+	unsigned int completed;
+	bool pending;
+	uint64_t submit;
+	uint64_t first, last;
+	struct flip_stats ioctl;
+	struct flip_stats event;
+};
+
+static void bench_flip_handler(int fd, unsigned int sequence,
+			       unsigned int sec, unsigned int usec,
+			       unsigned int crtc_id, void *data)
+{
+	struct bench_crtc *crtc = data;
+	uint64_t now = sec * 1000000ull + usec;
+
+	flip_stats_add(&crtc->event, now - crtc->submit);
+	if (!crtc->completed)
+		crtc->first = now;
+	crtc->last = now;
+	crtc->completed++;
+	crtc->pending = false;
+}
+
+static int bench_commit(struct device *dev, struct bench_crtc *crtc)
+{
+	drmModeAtomicReq *req = dev->req;
+	unsigned int buf = crtc->frame % BENCH_BUFFERS;
+	uint64_t start;
+	unsigned int i;
+	int ret;
+
+	dev->req = drmModeAtomicAlloc();
+	for (i = 0; i < crtc->num_planes; i++)
+		add_property(dev, crtc->planes[i]->p->plane_id, "FB_ID",
+			     crtc->planes[i]->fb_id[buf]);
+
+	start = get_monotonic_us();
+	ret = drmModeAtomicCommit(dev->fd, dev->req,
+				  DRM_MODE_ATOMIC_NONBLOCK |
+				  DRM_MODE_PAGE_FLIP_EVENT, crtc);
+	crtc->submit = get_monotonic_us();
+
+	drmModeAtomicFree(dev->req);
+	dev->req = req;
+
+	if (ret) {
+		fprintf(stderr, "non-blocking commit on CRTC %u failed: %s\n",
+			crtc->crtc_id, strerror(errno));
+		return ret;
+	}
+
+	flip_stats_add(&crtc->ioctl, crtc->submit - start);
+	crtc->pending = true;
+	crtc->frame++;
+	return 0;
+}
+
+static void atomic_flip_benchmark(struct device *dev, struct plane_arg *p,
+				  unsigned int count, unsigned int frames)
+{
+	uint32_t handles[4] = {0}, pitches[4] = {0}, offsets[4] = {0};
+	struct bench_plane *planes;
+	struct bench_plane **by_crtc;
+	struct bench_crtc *crtcs;
+	unsigned int num_crtcs = 0;
+	drmEventContext evctx;
+	uint64_t start, end;
+	unsigned int i, j;
+	int ret;
+
+	planes = calloc(count, sizeof(*planes));
+	by_crtc = calloc(count, sizeof(*by_crtc));
+	crtcs = calloc(count, sizeof(*crtcs));
+	if (!planes || !by_crtc || !crtcs) {
+		fprintf(stderr, "memory allocation failed\n");
+		goto out;
+	}
+
+	for (i = 0; i < count; i++) {
+		planes[i].p = &p[i];
+
+		for (j = 0; j < BENCH_BUFFERS; j++) {
+			planes[i].bo[j] = bo_create(dev->fd, p[i].fourcc,
+						    p[i].w, p[i].h, handles,
+						    pitches, offsets,
+						    j == 1 ? UTIL_PATTERN_PLAIN :
+						    primary_fill);
+			if (!planes[i].bo[j])
+				goto out;
+
+			if (drmModeAddFB2(dev->fd, p[i].w, p[i].h, p[i].fourcc,
+					  handles, pitches, offsets,
+					  &planes[i].fb_id[j], 0)) {
+				fprintf(stderr, "failed to add fb: %s\n",
+					strerror(errno));
+				goto out;
+			}
+		}
+
+		for (j = 0; j < num_crtcs; j++) {
+			if (crtcs[j].crtc_id == p[i].crtc_id)
+				break;
+		}
+
+		if (j == num_crtcs)
+			crtcs[num_crtcs++].crtc_id = p[i].crtc_id;
+	}
+
+	/* group the planes by CRTC */
+	for (i = 0, j = 0; i < num_crtcs; i++) {
+		unsigned int k;
+
+		crtcs[i].planes = &by_crtc[j];
+		for (k = 0; k < count; k++) {
+			if (p[k].crtc_id == crtcs[i].crtc_id) {
+				by_crtc[j++] = &planes[k];
+				crtcs[i].num_planes++;
+			}
+		}
+	}
+
+	fprintf(stderr, "benchmarking %u non-blocking flips on %u planes, "
+		"%u CRTCs\n", frames, count, num_crtcs);
+
+	memset(&evctx, 0, sizeof evctx);
+	evctx.version = DRM_EVENT_CONTEXT_VERSION;
+	evctx.page_flip_handler2 = bench_flip_handler;
+
+	start = get_monotonic_us();
+
+	while (1) {
+		struct timeval timeout = { .tv_sec = 3, .tv_usec = 0 };
+		bool busy = false;
+		fd_set fds;
+
+		for (i = 0; i < num_crtcs; i++) {
+			if (!crtcs[i].pending && crtcs[i].frame < frames &&
+			    bench_commit(dev, &crtcs[i]))
+				goto report;
+			busy |= crtcs[i].pending;
+		}
+
+		if (!busy)
+			break;
+
+		FD_ZERO(&fds);
+		FD_SET(0, &fds);
+		FD_SET(dev->fd, &fds);
+		ret = select(dev->fd + 1, &fds, NULL, NULL, &timeout);
+
+		if (ret <= 0) {
+			fprintf(stderr, "select timed out or error (ret %d)\n",
+				ret);
+			continue;
+		} else if (FD_ISSET(0, &fds)) {
+			break;
+		}
+
+		drmHandleEvent(dev->fd, &evctx);
+	}
+
+report:
+	/* drain outstanding events before the framebuffers go away */
+	for (i = 0; i < num_crtcs; i++) {
+		while (crtcs[i].pending) {
+			if (drmHandleEvent(dev->fd, &evctx))
+				break;
+		}
+	}
+
+	end = get_monotonic_us();
+
+	for (i = 0, j = 0; i < num_crtcs; i++) {
+		struct bench_crtc *crtc = &crtcs[i];
+		double t = (crtc->last - crtc->first) / 1000000.0;
+
+		j += crtc->completed;
+		fprintf(stderr, "CRTC %u: %u planes, %u flips, %.02f commits/s\n",
+			crtc->crtc_id, crtc->num_planes, crtc->completed,
+			crtc->completed > 1 && t > 0 ?
+			(crtc->completed - 1) / t : 0.0);
+		flip_stats_print("ioctl", &crtc->ioctl);
+		flip_stats_print("event", &crtc->event);
+	}
+
+	if (end > start)
+		fprintf(stderr, "total: %u flips, %.02f commits/s\n", j,
+			j / ((end - start) / 1000000.0));
+
+	/* put the planes back on their original framebuffers */
+	drmModeAtomicFree(dev->req);
+	dev->req = drmModeAtomicAlloc();
+	for (i = 0; i < count; i++)
+		add_property(dev, p[i].plane_id, "FB_ID", p[i].fb_id);
+	ret = drmModeAtomicCommit(dev->fd, dev->req, 0, NULL);
+	if (ret)
+		fprintf(stderr, "failed to restore planes: %s\n",
+			strerror(errno));
+
+out:
+	for (i = 0; planes && i < count; i++) {
+		for (j = 0; j < BENCH_BUFFERS; j++) {
+			if (planes[i].fb_id[j])
+				drmModeRmFB(dev->fd, planes[i].fb_id[j]);
+			if (planes[i].bo[j])
+				bo_destroy(planes[i].bo[j]);
+		}
+	}
+
+	free(crtcs);
+	free(by_crtc);
+	free(planes);
+}
+
 static void set_mode(struct device *dev, struct pipe_arg *pipes, unsigned int count)
 {
 	uint32_t handles[4] = {0}, pitches[4] = {0}, offsets[4] = {0};
@@ -1625,9 +1980,19 @@ static void test_page_flip(struct device *dev, struct pipe_arg *pipes, unsigned
 	unsigned int other_fb_id;
 	struct bo *other_bo;
 	drmEventContext evctx;
+	uint64_t cap = 0;
 	unsigned int i;
 	int ret;
 
+	/* the flip statistics compare event timestamps against our clock */
+	if (drmGetCap(dev->fd, DRM_CAP_TIMESTAMP_MONOTONIC, &cap) || !cap)
+		fprintf(stderr, "warning: vblank timestamps aren't monotonic, "
+			"flip latencies will be bogus\n");
+
+	flip_log = dev->flip_log;
+	if (flip_log)
+		fprintf(flip_log, "crtc,frame,timestamp_us,interval_us,latency_us\n");
+
 	other_bo = bo_create(dev->fd, pipes[0].fourcc, dev->mode.width,
 			     dev->mode.height, handles, pitches, offsets,
 			     UTIL_PATTERN_PLAIN);
@@ -1648,6 +2013,13 @@ static void test_page_flip(struct device *dev, struct pipe_arg *pipes, unsigned
 		if (pipe->mode == NULL)
 			continue;
 
+		pipe->interval = calloc(1, sizeof(*pipe->interval));
+		pipe->latency = calloc(1, sizeof(*pipe->latency));
+		if (!pipe->interval || !pipe->latency) {
+			fprintf(stderr, "memory allocation failed\n");
+			goto err_rmfb;
+		}
+
 		ret = drmModePageFlip(dev->fd, pipe->crtc->crtc->crtc_id,
 				      other_fb_id, DRM_MODE_PAGE_FLIP_EVENT,
 				      pipe);
@@ -1655,6 +2027,7 @@ static void test_page_flip(struct device *dev, struct pipe_arg *pipes, unsigned
 			fprintf(stderr, "failed to page flip: %s\n", strerror(errno));
 			goto err_rmfb;
 		}
+		pipe->flip_submit = get_monotonic_us();
 		gettimeofday(&pipe->start, NULL);
 		pipe->swap_count = 0;
 		pipe->fb_id[0] = dev->mode.fb_id;
@@ -1704,7 +2077,17 @@ static void test_page_flip(struct device *dev, struct pipe_arg *pipes, unsigned
 		drmHandleEvent(dev->fd, &evctx);
 	}
 
+	for (i = 0; i < count; i++) {
+		if (pipes[i].mode != NULL)
+			page_flip_report(&pipes[i]);
+	}
+
 err_rmfb:
+	for (i = 0; i < count; i++) {
+		free(pipes[i].interval);
+		free(pipes[i].latency);
+		pipes[i].interval = pipes[i].latency = NULL;
+	}
 	drmModeRmFB(dev->fd, other_fb_id);
 err:
 	bo_destroy(other_bo);
@@ -1867,7 +2250,7 @@ static void parse_fill_patterns(char *arg)
 
 static void usage(char *name)
 {
-	fprintf(stderr, "usage: %s [-acDdefMPprsCvw]\n", name);
+	fprintf(stderr, "usage: %s [-abcDdefMPprsCtvw]\n", name);
 
 	fprintf(stderr, "\n Query options:\n\n");
 	fprintf(stderr, "\t-c\tlist connectors\n");
@@ -1880,8 +2263,10 @@ static void usage(char *name)
 	fprintf(stderr, "\t-s <connector_id>[,<connector_id>][@<crtc_id>]:<mode>[-<vrefresh>][@<format>]\tset a mode\n");
 	fprintf(stderr, "\t-C\ttest hw cursor\n");
 	fprintf(stderr, "\t-v\ttest vsynced page flipping\n");
+	fprintf(stderr, "\t-t <file>\twrite per-flip timings as CSV (with -v)\n");
 	fprintf(stderr, "\t-w <obj_id>:<prop_name>:<value>\tset property\n");
 	fprintf(stderr, "\t-a \tuse atomic API\n");
+	fprintf(stderr, "\t-b <frames>\tbenchmark non-blocking atomic flips (with -a)\n");
 	fprintf(stderr, "\t-F pattern1,pattern2\tspecify fill patterns\n");
 
 	fprintf(stderr, "\n Generic options:\n\n");
@@ -1947,7 +2332,7 @@ static int pipe_resolve_connectors(struct device *dev, struct pipe_arg *pipe)
 	return 0;
 }
 
-static char optstr[] = "acdD:efF:M:P:prs:Cvw:";
+static char optstr[] = "ab:cdD:efF:M:P:prs:Ct:vw:";
 
 int main(int argc, char **argv)
 {
@@ -1959,6 +2344,7 @@ int main(int argc, char **argv)
 	int test_vsync = 0;
 	int test_cursor = 0;
 	int use_atomic = 0;
+	unsigned int bench_frames = 0;
 	char *device = NULL;
 	char *module = NULL;
 	unsigned int i;
@@ -1980,6 +2366,9 @@ int main(int argc, char **argv)
 		case 'a':
 			use_atomic = 1;
 			break;
+		case 'b':
+			bench_frames = strtoul(optarg, NULL, 0);
+			break;
 		case 'c':
 			connectors = 1;
 			break;
@@ -2043,6 +2432,14 @@ int main(int argc, char **argv)
 		case 'C':
 			test_cursor = 1;
 			break;
+		case 't':
+			dev.flip_log = fopen(optarg, "w");
+			if (!dev.flip_log) {
+				fprintf(stderr, "failed to open %s: %s\n",
+					optarg, strerror(errno));
+				return 1;
+			}
+			break;
 		case 'v':
 			test_vsync = 1;
 			break;
@@ -2143,6 +2540,10 @@ int main(int argc, char **argv)
 				return 1;
 			}
 
+			if (bench_frames)
+				atomic_flip_benchmark(&dev, plane_args,
+						      plane_count, bench_frames);
+
 			gettimeofday(&pipe_args->start, NULL);
 			pipe_args->swap_count = 0;
 
@@ -2231,5 +2632,8 @@ int main(int argc, char **argv)
 
 	free_resources(dev.resources);
 
+	if (dev.flip_log)
+		fclose(dev.flip_log);
+
 	return 0;
 }
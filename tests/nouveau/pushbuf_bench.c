@@ -0,0 +1,393 @@
+/*
+ * Copyright 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ *
+ */
+
+/*
+ * Throughput benchmark for the libdrm_nouveau submission paths: filling an
+ * immediate pushbuf, referencing buffers (which exercises the client kref
+ * table), revalidating a buffer context, kicking and buffer allocation.
+ * The command stream is padded with zero words, which the FIFO treats as
+ * empty method headers.  Every test runs for the same wall-clock time and
+ * the results are printed as JSON like amdgpu_bench does.
+ *
+ * Usage: pushbuf_bench [render node] [milliseconds per test]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "xf86drm.h"
+#include "nouveau.h"
+
+#define PUSH_DWORDS	64
+#define PUSH_SIZE	(32 * 1024)
+#define REFN_CHUNK	256
+
+static struct nouveau_device *dev;
+static struct nouveau_client *client;
+static struct nouveau_object *chan;
+static struct nouveau_pushbuf *push;
+static double duration;
+static int num_results;
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct timer {
+	double start;
+	double elapsed;
+	unsigned long ops;
+};
+
+static void timer_start(struct timer *t)
+{
+	t->ops = 0;
+	t->elapsed = 0;
+	t->start = now();
+}
+
+static int timer_running(struct timer *t)
+{
+	t->elapsed = now() - t->start;
+	return t->elapsed < duration;
+}
+
+/* @params is a JSON fragment of extra members, or NULL. */
+static void report(const char *name, const char *params, struct timer *t,
+		   int error)
+{
+	printf("%s\n    { \"name\": \"%s\"", num_results++ ? "," : "", name);
+	if (params)
+		printf(", %s", params);
+	if (error)
+		printf(", \"error\": %d }", error);
+	else
+		printf(", \"ops\": %lu, \"ops_per_sec\": %.1f, \"ns_per_op\": %.1f }",
+		       t->ops, t->ops / t->elapsed,
+		       t->ops ? t->elapsed * 1e9 / t->ops : 0.0);
+}
+
+static int channel_new(void)
+{
+	struct nv04_fifo nv04_data = { .vram = 0xbeef0201,
+				       .gart = 0xbeef0202 };
+	struct nvc0_fifo nvc0_data = { };
+	struct nve0_fifo nve0_data = { .engine = NVE0_FIFO_ENGINE_GR };
+	void *data;
+	uint32_t size;
+
+	if (dev->chipset < 0xc0) {
+		data = &nv04_data;
+		size = sizeof(nv04_data);
+	} else
+	if (dev->chipset < 0xe0) {
+		data = &nvc0_data;
+		size = sizeof(nvc0_data);
+	} else {
+		data = &nve0_data;
+		size = sizeof(nve0_data);
+	}
+
+	return nouveau_object_new(&dev->object, 0, NOUVEAU_FIFO_CHANNEL_CLASS,
+				  data, size, &chan);
+}
+
+/* One op is reserving PUSH_DWORDS words and writing them. */
+static void bench_push_data(void)
+{
+	struct timer t;
+	char params[32];
+	int i, r = 0;
+
+	timer_start(&t);
+	while (timer_running(&t)) {
+		r = nouveau_pushbuf_space(push, PUSH_DWORDS, 0, 0);
+		if (r)
+			break;
+		for (i = 0; i < PUSH_DWORDS; i++)
+			*push->cur++ = 0;
+		t.ops++;
+	}
+	if (!r)
+		r = nouveau_pushbuf_kick(push, chan);
+
+	snprintf(params, sizeof(params), "\"dwords\": %d", PUSH_DWORDS);
+	report("pushbuf_space_data", params, &t, r);
+}
+
+static int bos_new(struct nouveau_bo **bos, int nr)
+{
+	int i, r;
+
+	for (i = 0; i < nr; i++) {
+		r = nouveau_bo_new(dev, NOUVEAU_BO_GART, 0, 4096, NULL, &bos[i]);
+		if (r) {
+			while (i--)
+				nouveau_bo_ref(NULL, &bos[i]);
+			return r;
+		}
+	}
+	return 0;
+}
+
+static void bos_del(struct nouveau_bo **bos, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		nouveau_bo_ref(NULL, &bos[i]);
+}
+
+/*
+ * One op is referencing every one of nr buffers through
+ * nouveau_pushbuf_refn() in chunks, kicking whenever a chunk no longer
+ * fits the kernel's buffer list.  The reported cost is per buffer.
+ */
+static void bench_refn(int nr)
+{
+	struct nouveau_pushbuf_refn *refs;
+	struct nouveau_bo **bos;
+	struct timer t;
+	char params[32];
+	int i, n, r;
+
+	snprintf(params, sizeof(params), "\"bos\": %d", nr);
+
+	bos = calloc(nr, sizeof(*bos));
+	refs = calloc(nr, sizeof(*refs));
+	if (!bos || !refs) {
+		r = -ENOMEM;
+		goto out;
+	}
+
+	r = bos_new(bos, nr);
+	if (r)
+		goto out;
+	for (i = 0; i < nr; i++) {
+		refs[i].bo = bos[i];
+		refs[i].flags = NOUVEAU_BO_GART | NOUVEAU_BO_RD;
+	}
+
+	timer_start(&t);
+	while (timer_running(&t)) {
+		for (i = 0; i < nr; i += n) {
+			n = nr - i < REFN_CHUNK ? nr - i : REFN_CHUNK;
+			r = nouveau_pushbuf_refn(push, &refs[i], n);
+			if (r) {
+				r = nouveau_pushbuf_kick(push, chan);
+				if (!r)
+					r = nouveau_pushbuf_refn(push, &refs[i], n);
+			}
+			if (r)
+				break;
+		}
+		if (r)
+			break;
+		t.ops += nr;
+	}
+	if (!r)
+		r = nouveau_pushbuf_kick(push, chan);
+
+	bos_del(bos, nr);
+out:
+	free(refs);
+	free(bos);
+	report("pushbuf_refn", params, &t, r);
+}
+
+/*
+ * One op is refilling a bufctx bin with the same nr buffers and
+ * validating it again, the pattern of a state tracker re-emitting state.
+ */
+static void bench_bufctx_validate(int nr)
+{
+	struct nouveau_bufctx *bctx;
+	struct nouveau_bo **bos;
+	struct timer t;
+	char params[32];
+	int i, r;
+
+	snprintf(params, sizeof(params), "\"bos\": %d", nr);
+
+	bos = calloc(nr, sizeof(*bos));
+	if (!bos) {
+		r = -ENOMEM;
+		goto out;
+	}
+
+	r = bos_new(bos, nr);
+	if (r)
+		goto out;
+
+	r = nouveau_bufctx_new(client, 1, &bctx);
+	if (r)
+		goto out_bos;
+	nouveau_pushbuf_bufctx(push, bctx);
+
+	timer_start(&t);
+	while (timer_running(&t)) {
+		nouveau_bufctx_reset(bctx, 0);
+		for (i = 0; i < nr; i++)
+			nouveau_bufctx_refn(bctx, 0, bos[i],
+					    NOUVEAU_BO_GART | NOUVEAU_BO_RD);
+		r = nouveau_pushbuf_validate(push);
+		if (r)
+			break;
+		t.ops++;
+	}
+	if (!r)
+		r = nouveau_pushbuf_kick(push, chan);
+
+	nouveau_pushbuf_bufctx(push, NULL);
+	nouveau_bufctx_del(&bctx);
+out_bos:
+	bos_del(bos, nr);
+out:
+	free(bos);
+	report("bufctx_validate", params, &t, r);
+}
+
+/* Kicks of a few words each, without and with waiting for the GPU. */
+static void bench_kick(int wait)
+{
+	struct nouveau_bo *bo = NULL;
+	struct timer t;
+	int r;
+
+	r = nouveau_bo_new(dev, NOUVEAU_BO_GART, 0, 4096, NULL, &bo);
+	if (r)
+		goto out;
+
+	timer_start(&t);
+	while (timer_running(&t)) {
+		struct nouveau_pushbuf_refn ref = {
+			bo, NOUVEAU_BO_GART | NOUVEAU_BO_WR
+		};
+
+		r = nouveau_pushbuf_space(push, 8, 0, 0);
+		if (!r)
+			r = nouveau_pushbuf_refn(push, &ref, 1);
+		if (r)
+			break;
+		*push->cur++ = 0;
+		r = nouveau_pushbuf_kick(push, chan);
+		if (!r && wait)
+			r = nouveau_bo_wait(bo, NOUVEAU_BO_RDWR, client);
+		if (r)
+			break;
+		t.ops++;
+	}
+
+	nouveau_bo_ref(NULL, &bo);
+out:
+	report("pushbuf_kick", wait ? "\"wait\": true" : "\"wait\": false",
+	       &t, r);
+}
+
+/* Transient buffer churn, which the reuse cache is meant to absorb. */
+static void bench_bo_new(uint32_t size)
+{
+	struct nouveau_bo *bo = NULL;
+	struct timer t;
+	char params[32];
+	int r = 0;
+
+	timer_start(&t);
+	while (timer_running(&t)) {
+		r = nouveau_bo_new(dev, NOUVEAU_BO_GART | NOUVEAU_BO_MAP, 0,
+				   size, NULL, &bo);
+		if (!r)
+			r = nouveau_bo_map(bo, NOUVEAU_BO_WR, client);
+		nouveau_bo_ref(NULL, &bo);
+		if (r)
+			break;
+		t.ops++;
+	}
+
+	snprintf(params, sizeof(params), "\"size\": %u", size);
+	report("bo_new_map_del", params, &t, r);
+}
+
+int main(int argc, char **argv)
+{
+	static const int nr_bos[] = { 10, 100, 1000, 10000 };
+	static const uint32_t sizes[] = { 4096, 64 * 1024, 1024 * 1024 };
+	int ms = argc > 2 ? atoi(argv[2]) : 0;
+	unsigned i;
+	int fd, r;
+
+	if (ms <= 0)
+		ms = 250;
+	duration = ms / 1000.0;
+
+	if (argc > 1)
+		fd = open(argv[1], O_RDWR | O_CLOEXEC);
+	else
+		fd = drmOpenWithType("nouveau", NULL, DRM_NODE_RENDER);
+	if (fd < 0) {
+		fprintf(stderr, "Opening nouveau render node failed\n");
+		return argc > 1 ? 1 : 77;
+	}
+
+	r = nouveau_device_wrap(fd, 0, &dev);
+	if (!r)
+		r = nouveau_client_new(dev, &client);
+	if (!r)
+		r = channel_new();
+	if (!r)
+		r = nouveau_pushbuf_new(client, chan, 4, PUSH_SIZE, true, &push);
+	if (r) {
+		fprintf(stderr, "Setting up a nouveau channel failed: %d\n", r);
+		return 1;
+	}
+
+	printf("{\n  \"chipset\": \"0x%02x\",\n  \"ms_per_test\": %d,\n"
+	       "  \"results\": [", dev->chipset, ms);
+
+	bench_push_data();
+	for (i = 0; i < sizeof(nr_bos) / sizeof(nr_bos[0]); i++)
+		bench_refn(nr_bos[i]);
+	for (i = 0; i < sizeof(nr_bos) / sizeof(nr_bos[0]) - 1; i++)
+		bench_bufctx_validate(nr_bos[i]);
+	bench_kick(0);
+	bench_kick(1);
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+		bench_bo_new(sizes[i]);
+
+	printf("\n  ]\n}\n");
+
+	nouveau_pushbuf_del(&push);
+	nouveau_object_del(&chan);
+	nouveau_client_del(&client);
+	nouveau_device_del(&dev);
+	close(fd);
+	return 0;
+}
@@ -29,9 +29,11 @@
 #include <errno.h>
 #include <getopt.h>
 #include <inttypes.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #include "xf86drm.h"
 #include "xf86drmMode.h"
@@ -230,10 +232,273 @@ static void listAllProperties(void)
 	listCrtcProperties();
 }
 
-static int setProperty(char *argv[])
+/*
+ * Atomic mode.  A property change is classified by TEST_ONLY commits: a
+ * fast update passes without DRM_MODE_ATOMIC_ALLOW_MODESET, a full modeset
+ * only passes with it, anything else is rejected.  Real commits are
+ * blocking, so their latency includes waiting for the hardware.
+ */
+enum atomic_class {
+	ATOMIC_FAST,
+	ATOMIC_MODESET,
+	ATOMIC_REJECTED,
+};
+
+static const char *const atomic_class_names[] = {
+	[ATOMIC_FAST] = "fast update",
+	[ATOMIC_MODESET] = "full modeset",
+	[ATOMIC_REJECTED] = "rejected",
+};
+
+struct atomic_result {
+	char name[DRM_PROP_NAME_LEN + 32];
+	enum atomic_class class;
+};
+
+static struct atomic_result *results;
+static unsigned int num_results;
+
+static const char *objectTypeName(uint32_t type)
+{
+	switch (type) {
+	case DRM_MODE_OBJECT_CONNECTOR:
+		return "connector";
+	case DRM_MODE_OBJECT_CRTC:
+		return "crtc";
+	case DRM_MODE_OBJECT_PLANE:
+		return "plane";
+	}
+	return "object";
+}
+
+static double elapsedUs(const struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1e6 +
+	       (now.tv_nsec - start->tv_nsec) / 1e3;
+}
+
+static int atomicCommitProperty(uint32_t obj_id, uint32_t prop_id,
+				uint64_t value, uint32_t flags, double *us)
+{
+	struct timespec start;
+	drmModeAtomicReqPtr req;
+	int ret;
+
+	req = drmModeAtomicAlloc();
+	if (!req)
+		return -ENOMEM;
+
+	if (drmModeAtomicAddProperty(req, obj_id, prop_id, value) < 0) {
+		drmModeAtomicFree(req);
+		return -ENOMEM;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	ret = drmModeAtomicCommit(fd, req, flags, NULL);
+	if (ret)
+		ret = -errno;
+	*us = elapsedUs(&start);
+
+	drmModeAtomicFree(req);
+	return ret;
+}
+
+/*
+ * Test, and with @commit apply, @prop of @obj_id changing to @value.  With
+ * @restore the old value is committed back afterwards.  Prints one line of
+ * timings and returns how the change classified.
+ */
+static enum atomic_class atomicProperty(uint32_t obj_id, uint32_t obj_type,
+					drmModePropertyPtr prop,
+					uint64_t old_value, uint64_t value,
+					bool commit, bool restore)
+{
+	enum atomic_class class = ATOMIC_FAST;
+	uint32_t flags = 0;
+	double us;
+	int ret;
+
+	printf("%s %u %s: %"PRIu64" -> %"PRIu64":", objectTypeName(obj_type),
+	       obj_id, prop->name, old_value, value);
+
+	ret = atomicCommitProperty(obj_id, prop->prop_id, value,
+				   DRM_MODE_ATOMIC_TEST_ONLY, &us);
+	printf(" test %.0f us", us);
+	if (ret == -EINVAL) {
+		flags = DRM_MODE_ATOMIC_ALLOW_MODESET;
+		ret = atomicCommitProperty(obj_id, prop->prop_id, value,
+					   DRM_MODE_ATOMIC_TEST_ONLY | flags,
+					   &us);
+		printf(", test with modeset %.0f us", us);
+		class = ATOMIC_MODESET;
+	}
+	if (ret) {
+		printf(", %s: %s\n", atomic_class_names[ATOMIC_REJECTED],
+		       strerror(-ret));
+		return ATOMIC_REJECTED;
+	}
+
+	if (commit) {
+		ret = atomicCommitProperty(obj_id, prop->prop_id, value, flags,
+					   &us);
+		if (ret)
+			printf(", commit failed: %s", strerror(-ret));
+		else
+			printf(", commit %.0f us", us);
+	}
+	if (commit && restore && !ret) {
+		ret = atomicCommitProperty(obj_id, prop->prop_id, old_value,
+					   flags, &us);
+		if (ret)
+			printf(", restore failed: %s", strerror(-ret));
+		else
+			printf(", restore %.0f us", us);
+	}
+
+	printf(", %s\n", atomic_class_names[class]);
+	return class;
+}
+
+/*
+ * A nearby value to try for @prop, or false if it isn't a knob: immutable,
+ * blob and object properties are left alone.
+ */
+static bool atomicCandidate(drmModePropertyPtr prop, uint64_t value,
+			    uint64_t *candidate)
+{
+	int i;
+
+	if (prop->flags & DRM_MODE_PROP_IMMUTABLE)
+		return false;
+
+	if (drm_property_type_is(prop, DRM_MODE_PROP_RANGE) &&
+	    prop->count_values == 2) {
+		if (value < prop->values[1])
+			*candidate = value + 1;
+		else if (value > prop->values[0])
+			*candidate = value - 1;
+		else
+			return false;
+		return true;
+	}
+
+	if (drm_property_type_is(prop, DRM_MODE_PROP_SIGNED_RANGE) &&
+	    prop->count_values == 2) {
+		if (U642I64(value) < U642I64(prop->values[1]))
+			*candidate = value + 1;
+		else if (U642I64(value) > U642I64(prop->values[0]))
+			*candidate = value - 1;
+		else
+			return false;
+		return true;
+	}
+
+	/* the next enum, or for a bitmask the bit after the lowest set one */
+	if (drm_property_type_is(prop, DRM_MODE_PROP_ENUM) ||
+	    drm_property_type_is(prop, DRM_MODE_PROP_BITMASK)) {
+		bool bitmask = drm_property_type_is(prop,
+						    DRM_MODE_PROP_BITMASK);
+
+		if (prop->count_enums < 2)
+			return false;
+
+		for (i = 0; i < prop->count_enums; i++) {
+			if (bitmask ? value & (1ULL << prop->enums[i].value) :
+				      value == prop->enums[i].value)
+				break;
+		}
+		i = (i + 1) % prop->count_enums;
+		*candidate = bitmask ? 1ULL << prop->enums[i].value :
+				       prop->enums[i].value;
+		return *candidate != value;
+	}
+
+	return false;
+}
+
+static void atomicObject(uint32_t obj_id, uint32_t obj_type, bool commit)
+{
+	drmModeObjectPropertiesPtr props;
+	struct atomic_result *result;
+	drmModePropertyPtr prop;
+	uint64_t candidate;
+	unsigned int i;
+
+	props = drmModeObjectGetProperties(fd, obj_id, obj_type);
+	if (!props)
+		return;
+
+	for (i = 0; i < props->count_props; i++) {
+		prop = drmModeGetProperty(fd, props->props[i]);
+		if (!prop)
+			continue;
+
+		if (atomicCandidate(prop, props->prop_values[i], &candidate)) {
+			result = realloc(results,
+					 (num_results + 1) * sizeof(*results));
+			if (result) {
+				results = result;
+				result = &results[num_results++];
+				snprintf(result->name, sizeof(result->name),
+					 "%s %u %s", objectTypeName(obj_type),
+					 obj_id, prop->name);
+				result->class =
+					atomicProperty(obj_id, obj_type, prop,
+						       props->prop_values[i],
+						       candidate, commit, true);
+			}
+		}
+
+		drmModeFreeProperty(prop);
+	}
+
+	drmModeFreeObjectProperties(props);
+}
+
+/*
+ * Try a nearby value for every mutable enum, bitmask and range property of
+ * every connector, CRTC and plane, then list them by class.  Nothing is
+ * applied unless @commit, and then the old value is put back right away.
+ */
+static void atomicSurvey(bool commit)
+{
+	drmModePlaneResPtr planes;
+	unsigned int i, class;
+
+	for (i = 0; i < (unsigned int)res->count_connectors; i++)
+		atomicObject(res->connectors[i], DRM_MODE_OBJECT_CONNECTOR,
+			     commit);
+	for (i = 0; i < (unsigned int)res->count_crtcs; i++)
+		atomicObject(res->crtcs[i], DRM_MODE_OBJECT_CRTC, commit);
+
+	planes = drmModeGetPlaneResources(fd);
+	for (i = 0; planes && i < planes->count_planes; i++)
+		atomicObject(planes->planes[i], DRM_MODE_OBJECT_PLANE, commit);
+	drmModeFreePlaneResources(planes);
+
+	for (class = ATOMIC_FAST; class <= ATOMIC_REJECTED; class++) {
+		printf("\n%s:\n", atomic_class_names[class]);
+		for (i = 0; i < num_results; i++)
+			if (results[i].class == class)
+				printf("\t%s\n", results[i].name);
+	}
+
+	free(results);
+	results = NULL;
+	num_results = 0;
+}
+
+static int setProperty(char *argv[], bool atomic)
 {
 	uint32_t obj_id, obj_type, prop_id;
-	uint64_t value;
+	drmModeObjectPropertiesPtr props;
+	drmModePropertyPtr prop;
+	uint64_t value, old_value = 0;
+	enum atomic_class class;
+	unsigned int i;
 
 	obj_id = atoi(argv[0]);
 
@@ -241,6 +506,8 @@ static int setProperty(char *argv[])
 		obj_type = DRM_MODE_OBJECT_CONNECTOR;
 	} else if (!strcmp(argv[1], "crtc")) {
 		obj_type = DRM_MODE_OBJECT_CRTC;
+	} else if (atomic && !strcmp(argv[1], "plane")) {
+		obj_type = DRM_MODE_OBJECT_PLANE;
 	} else {
 		fprintf(stderr, "Invalid object type.\n");
 		return 1;
@@ -249,7 +516,27 @@ static int setProperty(char *argv[])
 	prop_id = atoi(argv[2]);
 	value = atoll(argv[3]);
 
-	return drmModeObjectSetProperty(fd, obj_id, obj_type, prop_id, value);
+	if (!atomic)
+		return drmModeObjectSetProperty(fd, obj_id, obj_type, prop_id,
+						value);
+
+	prop = drmModeGetProperty(fd, prop_id);
+	if (!prop) {
+		fprintf(stderr, "Invalid property.\n");
+		return 1;
+	}
+
+	props = drmModeObjectGetProperties(fd, obj_id, obj_type);
+	for (i = 0; props && i < props->count_props; i++)
+		if (props->props[i] == prop_id)
+			old_value = props->prop_values[i];
+	drmModeFreeObjectProperties(props);
+
+	class = atomicProperty(obj_id, obj_type, prop, old_value, value,
+			       true, false);
+	drmModeFreeProperty(prop);
+
+	return class == ATOMIC_REJECTED;
 }
 
 static void usage(const char *program)
@@ -261,11 +548,19 @@ static void usage(const char *program)
 "options:\n"
 "  -D DEVICE  use the given device\n"
 "  -M MODULE  use the given driver\n"
+"  -a         go through atomic commits and time them\n"
+"  -c         with -a and no property, also apply each change\n"
 "\n"
 "The first form just prints all the existing properties. The second one is\n"
 "used to set the value of a specified property. The object type can be one of\n"
 "the following strings:\n"
-"  connector crtc\n"
+"  connector crtc plane (-a only)\n"
+"\n"
+"With -a the first form instead tries a nearby value for every mutable enum,\n"
+"bitmask and range property with TEST_ONLY commits, reports their latency\n"
+"and lists which properties take a fast update and which a full modeset.\n"
+"With -c each change is also committed and then reverted. The second form\n"
+"tests and commits the given value.\n"
 "\n"
 "Example:\n"
 "  proptest 7 connector 2 1\n"
@@ -274,7 +569,8 @@ static void usage(const char *program)
 
 int main(int argc, char *argv[])
 {
-	static const char optstr[] = "D:M:";
+	static const char optstr[] = "D:M:ac";
+	bool atomic = false, commit = false;
 	int c, args, ret = 0;
 	char *device = NULL;
 	char *module = NULL;
@@ -289,6 +585,14 @@ int main(int argc, char *argv[])
 			module = optarg;
 			break;
 
+		case 'a':
+			atomic = true;
+			break;
+
+		case 'c':
+			commit = true;
+			break;
+
 		default:
 			usage(argv[0]);
 			break;
@@ -301,6 +605,13 @@ int main(int argc, char *argv[])
 	if (fd < 0)
 		return 1;
 
+	if (atomic && drmSetClientCap(fd, DRM_CLIENT_CAP_ATOMIC, 1)) {
+		fprintf(stderr, "Atomic modesetting not supported: %s\n",
+			strerror(errno));
+		ret = 1;
+		goto done;
+	}
+
 	res = drmModeGetResources(fd);
 	if (!res) {
 		fprintf(stderr, "Failed to get resources: %s\n",
@@ -309,10 +620,12 @@ int main(int argc, char *argv[])
 		goto done;
 	}
 
-	if (args < 1) {
+	if (args < 1 && atomic) {
+		atomicSurvey(commit);
+	} else if (args < 1) {
 		listAllProperties();
 	} else if (args == 4) {
-		ret = setProperty(&argv[optind]);
+		ret = setProperty(&argv[optind], atomic);
 	} else {
 		usage(argv[0]);
 		ret = 1;
@@ -0,0 +1,184 @@
+/*
+ * Copyright © 2014 NVIDIA Corporation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE COPYRIGHT HOLDER(S) OR AUTHOR(S) BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Fills a buffer with gr2d a number of times, submitting all fills
+ * before waiting for the last one, and checks the buffer holds the color
+ * of the last fill.  Exercises job reuse with several jobs in flight.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "xf86drm.h"
+#include "tegra.h"
+
+#define WIDTH 256
+#define HEIGHT 256
+#define PITCH (WIDTH * 4)
+#define NUM_FILLS 64
+
+static const char default_device[] = "/dev/dri/card0";
+
+static int gr2d_fill(struct drm_tegra_pushbuf *pushbuf,
+		     struct drm_tegra_bo *bo, uint32_t color)
+{
+	int err;
+
+	err = drm_tegra_pushbuf_prepare(pushbuf, 32);
+	if (err < 0)
+		return err;
+
+	*pushbuf->ptr++ = HOST1X_OPCODE_SETCL(0, HOST1X_CLASS_GR2D, 0);
+
+	*pushbuf->ptr++ = HOST1X_OPCODE_MASK(0x9, 0x9);
+	*pushbuf->ptr++ = 0x0000003a;
+	*pushbuf->ptr++ = 0x00000000;
+
+	*pushbuf->ptr++ = HOST1X_OPCODE_MASK(0x1e, 0x7);
+	*pushbuf->ptr++ = 0x00000000;
+	*pushbuf->ptr++ = (2 << 16) | (1 << 6) | (1 << 2);
+	*pushbuf->ptr++ = 0x000000cc;
+
+	*pushbuf->ptr++ = HOST1X_OPCODE_MASK(0x2b, 0x9);
+
+	err = drm_tegra_pushbuf_relocate(pushbuf, bo, 0, 0);
+	if (err < 0)
+		return err;
+
+	*pushbuf->ptr++ = PITCH;
+
+	*pushbuf->ptr++ = HOST1X_OPCODE_NONINCR(0x35, 1);
+	*pushbuf->ptr++ = color;
+
+	*pushbuf->ptr++ = HOST1X_OPCODE_NONINCR(0x46, 1);
+	*pushbuf->ptr++ = 0x00000000;
+
+	*pushbuf->ptr++ = HOST1X_OPCODE_MASK(0x38, 0x5);
+	*pushbuf->ptr++ = HEIGHT << 16 | WIDTH;
+	*pushbuf->ptr++ = 0x00000000;
+
+	return drm_tegra_pushbuf_sync(pushbuf, DRM_TEGRA_SYNCPT_COND_OP_DONE);
+}
+
+int main(int argc, char *argv[])
+{
+	struct drm_tegra_fence *fence = NULL;
+	struct drm_tegra_channel *channel;
+	struct drm_tegra_pushbuf *pushbuf;
+	struct drm_tegra_job *job;
+	struct drm_tegra_bo *bo;
+	struct drm_tegra *tegra;
+	const char *device;
+	uint32_t *pixels;
+	void *map;
+	int err, fd, i, ret = 1;
+
+	if (argc < 2)
+		device = default_device;
+	else
+		device = argv[1];
+
+	fd = open(device, O_RDWR);
+	if (fd < 0)
+		return 1;
+
+	err = drm_tegra_new(&tegra, fd);
+	if (err < 0)
+		goto close;
+
+	err = drm_tegra_bo_new(&bo, tegra, 0, PITCH * HEIGHT);
+	if (err < 0)
+		goto free;
+
+	err = drm_tegra_bo_map(bo, &map);
+	if (err < 0)
+		goto unref;
+
+	memset(map, 0, PITCH * HEIGHT);
+
+	err = drm_tegra_channel_open(&channel, tegra, DRM_TEGRA_GR2D);
+	if (err < 0) {
+		fprintf(stderr, "failed to open channel: %s\n", strerror(-err));
+		goto unref;
+	}
+
+	err = drm_tegra_job_new(&job, channel);
+	if (err < 0)
+		goto channel;
+
+	err = drm_tegra_pushbuf_new(&pushbuf, job);
+	if (err < 0)
+		goto job;
+
+	for (i = 0; i < NUM_FILLS; i++) {
+		err = gr2d_fill(pushbuf, bo, 0xff000000 | i);
+		if (err < 0)
+			goto fence;
+
+		if (fence)
+			drm_tegra_fence_free(fence);
+
+		err = drm_tegra_job_submit(job, &fence);
+		if (err < 0) {
+			fprintf(stderr, "failed to submit job: %s\n",
+				strerror(-err));
+			fence = NULL;
+			goto fence;
+		}
+	}
+
+	err = drm_tegra_fence_wait_timeout(fence, 1000);
+	if (err < 0) {
+		fprintf(stderr, "failed to wait for fence: %s\n",
+			strerror(-err));
+		goto fence;
+	}
+
+	pixels = map;
+
+	for (i = 0; i < WIDTH * HEIGHT; i++) {
+		if (pixels[i] != (0xff000000 | (NUM_FILLS - 1))) {
+			fprintf(stderr, "pixel %d: %08x, expected %08x\n", i,
+				pixels[i], 0xff000000 | (NUM_FILLS - 1));
+			goto fence;
+		}
+	}
+
+	ret = 0;
+
+fence:
+	drm_tegra_fence_free(fence);
+job:
+	drm_tegra_job_free(job);
+channel:
+	drm_tegra_channel_close(channel);
+unref:
+	drm_tegra_bo_unref(bo);
+free:
+	drm_tegra_close(tegra);
+close:
+	close(fd);
+	return ret;
+}
@@ -0,0 +1,663 @@
+/*
+ * Copyright © 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+/*
+ * The row kernels come in a scalar version and, where the compiler targets
+ * SSE2 or NEON, a vector version that converts 8 or 16 pixels at a time
+ * and leaves the rest of the row to the scalar one.  Both compute exactly the
+ * same values, so the output doesn't depend on the machine.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <drm_fourcc.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define HAVE_SSE2 1
+#elif defined(__ARM_NEON) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#include <arm_neon.h>
+#define HAVE_NEON 1
+#endif
+
+#include "convert.h"
+
+#define PIXEL_R(p)	(((p) >> 16) & 0xff)
+#define PIXEL_G(p)	(((p) >> 8) & 0xff)
+#define PIXEL_B(p)	((p) & 0xff)
+
+/* BT.601 limited range, in the fixed point of MAKE_YUV_601() in pattern.c */
+static inline uint8_t rgb_to_y(int r, int g, int b)
+{
+	return ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+}
+
+static inline uint8_t rgb_to_u(int r, int g, int b)
+{
+	return ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+}
+
+static inline uint8_t rgb_to_v(int r, int g, int b)
+{
+	return ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+}
+
+static inline uint8_t clamp_u8(int v)
+{
+	return v < 0 ? 0 : v > 255 ? 255 : v;
+}
+
+static inline uint32_t yuv_to_xrgb(int y, int u, int v)
+{
+	int c = 298 * (y - 16) + 128;
+	int d = u - 128;
+	int e = v - 128;
+
+	return 0xff000000 | clamp_u8((c + 409 * e) >> 8) << 16 |
+	       clamp_u8((c - 100 * d - 208 * e) >> 8) << 8 |
+	       clamp_u8((c + 516 * d) >> 8);
+}
+
+/* Byte offsets of the components in a pixel pair of a packed format. */
+struct packed_layout {
+	unsigned int y0, u, y1, v;
+};
+
+static const struct packed_layout layout_yuyv = { 0, 1, 2, 3 };
+static const struct packed_layout layout_yvyu = { 0, 3, 2, 1 };
+static const struct packed_layout layout_uyvy = { 1, 0, 3, 2 };
+static const struct packed_layout layout_vyuy = { 1, 2, 3, 0 };
+
+#if HAVE_SSE2
+/* r, g and b of 8 pixels, as 16-bit lanes */
+static inline void sse2_load8(const uint32_t *p, __m128i *r, __m128i *g,
+			      __m128i *b)
+{
+	const __m128i mask = _mm_set1_epi32(0xff);
+	__m128i lo = _mm_loadu_si128((const __m128i *)p);
+	__m128i hi = _mm_loadu_si128((const __m128i *)(p + 4));
+
+	*r = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 16), mask),
+			     _mm_and_si128(_mm_srli_epi32(hi, 16), mask));
+	*g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(lo, 8), mask),
+			     _mm_and_si128(_mm_srli_epi32(hi, 8), mask));
+	*b = _mm_packs_epi32(_mm_and_si128(lo, mask), _mm_and_si128(hi, mask));
+}
+
+/* Wraps around in 16 bits but the final shift makes up for it. */
+static inline __m128i sse2_luma(__m128i r, __m128i g, __m128i b)
+{
+	__m128i y;
+
+	y = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)),
+			  _mm_mullo_epi16(g, _mm_set1_epi16(129)));
+	y = _mm_add_epi16(y, _mm_mullo_epi16(b, _mm_set1_epi16(25)));
+	y = _mm_add_epi16(y, _mm_set1_epi16(128));
+	return _mm_add_epi16(_mm_srli_epi16(y, 8), _mm_set1_epi16(16));
+}
+
+static inline __m128i sse2_chroma(__m128i r, __m128i g, __m128i b,
+				  short cr, short cg, short cb)
+{
+	__m128i c;
+
+	c = _mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(cr)),
+			  _mm_mullo_epi16(g, _mm_set1_epi16(cg)));
+	c = _mm_add_epi16(c, _mm_mullo_epi16(b, _mm_set1_epi16(cb)));
+	c = _mm_add_epi16(c, _mm_set1_epi16(128));
+	return _mm_add_epi16(_mm_srai_epi16(c, 8), _mm_set1_epi16(128));
+}
+
+/* Sums of adjacent lanes of a, then of b. */
+static inline __m128i sse2_pair_sums(__m128i a, __m128i b)
+{
+	const __m128i one = _mm_set1_epi16(1);
+
+	return _mm_packs_epi32(_mm_madd_epi16(a, one), _mm_madd_epi16(b, one));
+}
+
+static inline __m128i sse2_shift_round(__m128i v, int shift)
+{
+	return _mm_srli_epi16(_mm_add_epi16(v, _mm_set1_epi16(1 << (shift - 1))),
+			      shift);
+}
+
+static unsigned int nv12_rows_simd(const uint32_t *s0, const uint32_t *s1,
+				   uint8_t *y0, uint8_t *y1, uint8_t *uv,
+				   unsigned int width, int swap)
+{
+	__m128i r0a, g0a, b0a, r0b, g0b, b0b, r1a, g1a, b1a, r1b, g1b, b1b;
+	__m128i r, g, b, u, v;
+	unsigned int x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		sse2_load8(s0 + x, &r0a, &g0a, &b0a);
+		sse2_load8(s0 + x + 8, &r0b, &g0b, &b0b);
+		sse2_load8(s1 + x, &r1a, &g1a, &b1a);
+		sse2_load8(s1 + x + 8, &r1b, &g1b, &b1b);
+
+		_mm_storeu_si128((__m128i *)(y0 + x),
+				 _mm_packus_epi16(sse2_luma(r0a, g0a, b0a),
+						  sse2_luma(r0b, g0b, b0b)));
+		_mm_storeu_si128((__m128i *)(y1 + x),
+				 _mm_packus_epi16(sse2_luma(r1a, g1a, b1a),
+						  sse2_luma(r1b, g1b, b1b)));
+
+		r = sse2_shift_round(sse2_pair_sums(_mm_add_epi16(r0a, r1a),
+						    _mm_add_epi16(r0b, r1b)), 2);
+		g = sse2_shift_round(sse2_pair_sums(_mm_add_epi16(g0a, g1a),
+						    _mm_add_epi16(g0b, g1b)), 2);
+		b = sse2_shift_round(sse2_pair_sums(_mm_add_epi16(b0a, b1a),
+						    _mm_add_epi16(b0b, b1b)), 2);
+		u = sse2_chroma(r, g, b, -38, -74, 112);
+		v = sse2_chroma(r, g, b, 112, -94, -18);
+		u = _mm_packus_epi16(u, u);
+		v = _mm_packus_epi16(v, v);
+		_mm_storeu_si128((__m128i *)(uv + x),
+				 swap ? _mm_unpacklo_epi8(v, u) :
+					_mm_unpacklo_epi8(u, v));
+	}
+	return x;
+}
+
+static unsigned int packed_row_simd(const uint32_t *s, uint8_t *d,
+				    unsigned int width,
+				    const struct packed_layout *l)
+{
+	__m128i ra, ga, ba, rb, gb, bb, r, g, b, y, u, v, c;
+	int c_first = l->y0 == 1, swap = l->v < l->u;
+	unsigned int x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		sse2_load8(s + x, &ra, &ga, &ba);
+		sse2_load8(s + x + 8, &rb, &gb, &bb);
+
+		y = _mm_packus_epi16(sse2_luma(ra, ga, ba),
+				     sse2_luma(rb, gb, bb));
+
+		r = sse2_shift_round(sse2_pair_sums(ra, rb), 1);
+		g = sse2_shift_round(sse2_pair_sums(ga, gb), 1);
+		b = sse2_shift_round(sse2_pair_sums(ba, bb), 1);
+		u = sse2_chroma(r, g, b, -38, -74, 112);
+		v = sse2_chroma(r, g, b, 112, -94, -18);
+		u = _mm_packus_epi16(u, u);
+		v = _mm_packus_epi16(v, v);
+		c = swap ? _mm_unpacklo_epi8(v, u) : _mm_unpacklo_epi8(u, v);
+
+		_mm_storeu_si128((__m128i *)(d + 2 * x),
+				 c_first ? _mm_unpacklo_epi8(c, y) :
+					   _mm_unpacklo_epi8(y, c));
+		_mm_storeu_si128((__m128i *)(d + 2 * x + 16),
+				 c_first ? _mm_unpackhi_epi8(c, y) :
+					   _mm_unpackhi_epi8(y, c));
+	}
+	return x;
+}
+
+/* Sign extends the low 16 bits, so that packing doesn't saturate. */
+static inline __m128i sse2_low16(__m128i v)
+{
+	return _mm_srai_epi32(_mm_slli_epi32(v, 16), 16);
+}
+
+static inline __m128i sse2_rgb565(__m128i p, int swap)
+{
+	__m128i r, g, b;
+
+	g = _mm_and_si128(_mm_srli_epi32(p, 5), _mm_set1_epi32(0x07e0));
+	if (swap) {
+		r = _mm_and_si128(_mm_srli_epi32(p, 19), _mm_set1_epi32(0x001f));
+		b = _mm_and_si128(_mm_slli_epi32(p, 8), _mm_set1_epi32(0xf800));
+	} else {
+		r = _mm_and_si128(_mm_srli_epi32(p, 8), _mm_set1_epi32(0xf800));
+		b = _mm_and_si128(_mm_srli_epi32(p, 3), _mm_set1_epi32(0x001f));
+	}
+	return sse2_low16(_mm_or_si128(_mm_or_si128(r, g), b));
+}
+
+static unsigned int rgb565_row_simd(const uint32_t *s, uint16_t *d,
+				    unsigned int width, int swap)
+{
+	__m128i lo, hi;
+	unsigned int x;
+
+	for (x = 0; x + 8 <= width; x += 8) {
+		lo = _mm_loadu_si128((const __m128i *)(s + x));
+		hi = _mm_loadu_si128((const __m128i *)(s + x + 4));
+		_mm_storeu_si128((__m128i *)(d + x),
+				 _mm_packs_epi32(sse2_rgb565(lo, swap),
+						 sse2_rgb565(hi, swap)));
+	}
+	return x;
+}
+
+static inline __m128i sse2_xrgb(__m128i v, int swap)
+{
+	__m128i r, g, b, t;
+
+	r = _mm_and_si128(_mm_srli_epi32(v, 11), _mm_set1_epi32(0x1f));
+	g = _mm_and_si128(_mm_srli_epi32(v, 5), _mm_set1_epi32(0x3f));
+	b = _mm_and_si128(v, _mm_set1_epi32(0x1f));
+	if (swap) {
+		t = r;
+		r = b;
+		b = t;
+	}
+	r = _mm_or_si128(_mm_slli_epi32(r, 3), _mm_srli_epi32(r, 2));
+	g = _mm_or_si128(_mm_slli_epi32(g, 2), _mm_srli_epi32(g, 4));
+	b = _mm_or_si128(_mm_slli_epi32(b, 3), _mm_srli_epi32(b, 2));
+	return _mm_or_si128(_mm_or_si128(_mm_set1_epi32(0xff000000),
+					 _mm_slli_epi32(r, 16)),
+			    _mm_or_si128(_mm_slli_epi32(g, 8), b));
+}
+
+static unsigned int rgb565_to_xrgb_row_simd(const uint16_t *s, uint32_t *d,
+					    unsigned int width, int swap)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i v;
+	unsigned int x;
+
+	for (x = 0; x + 8 <= width; x += 8) {
+		v = _mm_loadu_si128((const __m128i *)(s + x));
+		_mm_storeu_si128((__m128i *)(d + x),
+				 sse2_xrgb(_mm_unpacklo_epi16(v, zero), swap));
+		_mm_storeu_si128((__m128i *)(d + x + 4),
+				 sse2_xrgb(_mm_unpackhi_epi16(v, zero), swap));
+	}
+	return x;
+}
+#elif HAVE_NEON
+static inline uint8x16_t neon_luma(uint8x16x4_t p)
+{
+	uint16x8_t lo, hi;
+
+	lo = vmull_u8(vget_low_u8(p.val[2]), vdup_n_u8(66));
+	lo = vmlal_u8(lo, vget_low_u8(p.val[1]), vdup_n_u8(129));
+	lo = vmlal_u8(lo, vget_low_u8(p.val[0]), vdup_n_u8(25));
+	hi = vmull_u8(vget_high_u8(p.val[2]), vdup_n_u8(66));
+	hi = vmlal_u8(hi, vget_high_u8(p.val[1]), vdup_n_u8(129));
+	hi = vmlal_u8(hi, vget_high_u8(p.val[0]), vdup_n_u8(25));
+	return vaddq_u8(vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)),
+			vdupq_n_u8(16));
+}
+
+static inline uint8x8_t neon_chroma(int16x8_t r, int16x8_t g, int16x8_t b,
+				    int16_t cr, int16_t cg, int16_t cb)
+{
+	int16x8_t c;
+
+	c = vmulq_n_s16(r, cr);
+	c = vmlaq_n_s16(c, g, cg);
+	c = vmlaq_n_s16(c, b, cb);
+	c = vaddq_s16(c, vdupq_n_s16(128));
+	return vqmovun_s16(vaddq_s16(vshrq_n_s16(c, 8), vdupq_n_s16(128)));
+}
+
+static unsigned int nv12_rows_simd(const uint32_t *s0, const uint32_t *s1,
+				   uint8_t *y0, uint8_t *y1, uint8_t *uv,
+				   unsigned int width, int swap)
+{
+	uint8x16x4_t p0, p1;
+	uint8x8x2_t c;
+	int16x8_t r, g, b;
+	unsigned int x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		p0 = vld4q_u8((const uint8_t *)(s0 + x));
+		p1 = vld4q_u8((const uint8_t *)(s1 + x));
+
+		vst1q_u8(y0 + x, neon_luma(p0));
+		vst1q_u8(y1 + x, neon_luma(p1));
+
+		r = vreinterpretq_s16_u16(vrshrq_n_u16(
+			vpadalq_u8(vpaddlq_u8(p0.val[2]), p1.val[2]), 2));
+		g = vreinterpretq_s16_u16(vrshrq_n_u16(
+			vpadalq_u8(vpaddlq_u8(p0.val[1]), p1.val[1]), 2));
+		b = vreinterpretq_s16_u16(vrshrq_n_u16(
+			vpadalq_u8(vpaddlq_u8(p0.val[0]), p1.val[0]), 2));
+		c.val[swap] = neon_chroma(r, g, b, -38, -74, 112);
+		c.val[!swap] = neon_chroma(r, g, b, 112, -94, -18);
+		vst2_u8(uv + x, c);
+	}
+	return x;
+}
+
+static unsigned int packed_row_simd(const uint32_t *s, uint8_t *d,
+				    unsigned int width,
+				    const struct packed_layout *l)
+{
+	uint8x16x4_t p;
+	uint8x8x2_t y;
+	uint8x8x4_t out;
+	int16x8_t r, g, b;
+	unsigned int x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		p = vld4q_u8((const uint8_t *)(s + x));
+
+		y = vuzp_u8(vget_low_u8(neon_luma(p)),
+			    vget_high_u8(neon_luma(p)));
+		r = vreinterpretq_s16_u16(vrshrq_n_u16(vpaddlq_u8(p.val[2]), 1));
+		g = vreinterpretq_s16_u16(vrshrq_n_u16(vpaddlq_u8(p.val[1]), 1));
+		b = vreinterpretq_s16_u16(vrshrq_n_u16(vpaddlq_u8(p.val[0]), 1));
+
+		out.val[l->y0] = y.val[0];
+		out.val[l->y1] = y.val[1];
+		out.val[l->u] = neon_chroma(r, g, b, -38, -74, 112);
+		out.val[l->v] = neon_chroma(r, g, b, 112, -94, -18);
+		vst4_u8(d + 2 * x, out);
+	}
+	return x;
+}
+
+static unsigned int rgb565_row_simd(const uint32_t *s, uint16_t *d,
+				    unsigned int width, int swap)
+{
+	uint8x16x4_t p;
+	uint8x16_t r, b;
+	uint16x8_t lo, hi;
+	unsigned int x;
+
+	for (x = 0; x + 16 <= width; x += 16) {
+		p = vld4q_u8((const uint8_t *)(s + x));
+		r = swap ? p.val[0] : p.val[2];
+		b = swap ? p.val[2] : p.val[0];
+
+		lo = vshll_n_u8(vget_low_u8(r), 8);
+		lo = vsriq_n_u16(lo, vshll_n_u8(vget_low_u8(p.val[1]), 8), 5);
+		lo = vsriq_n_u16(lo, vshll_n_u8(vget_low_u8(b), 8), 11);
+		hi = vshll_n_u8(vget_high_u8(r), 8);
+		hi = vsriq_n_u16(hi, vshll_n_u8(vget_high_u8(p.val[1]), 8), 5);
+		hi = vsriq_n_u16(hi, vshll_n_u8(vget_high_u8(b), 8), 11);
+		vst1q_u16(d + x, lo);
+		vst1q_u16(d + x + 8, hi);
+	}
+	return x;
+}
+
+static unsigned int rgb565_to_xrgb_row_simd(const uint16_t *s, uint32_t *d,
+					    unsigned int width, int swap)
+{
+	uint16x8_t v;
+	uint8x8_t r, g, b;
+	uint8x8x4_t out;
+	unsigned int x;
+
+	for (x = 0; x + 8 <= width; x += 8) {
+		v = vld1q_u16(s + x);
+		r = vand_u8(vshrn_n_u16(v, 8), vdup_n_u8(0xf8));
+		g = vand_u8(vshrn_n_u16(v, 3), vdup_n_u8(0xfc));
+		b = vshl_n_u8(vmovn_u16(v), 3);
+
+		out.val[swap ? 0 : 2] = vorr_u8(r, vshr_n_u8(r, 5));
+		out.val[1] = vorr_u8(g, vshr_n_u8(g, 6));
+		out.val[swap ? 2 : 0] = vorr_u8(b, vshr_n_u8(b, 5));
+		out.val[3] = vdup_n_u8(0xff);
+		vst4_u8((uint8_t *)(d + x), out);
+	}
+	return x;
+}
+#else
+static unsigned int nv12_rows_simd(const uint32_t *s0, const uint32_t *s1,
+				   uint8_t *y0, uint8_t *y1, uint8_t *uv,
+				   unsigned int width, int swap)
+{
+	return 0;
+}
+
+static unsigned int packed_row_simd(const uint32_t *s, uint8_t *d,
+				    unsigned int width,
+				    const struct packed_layout *l)
+{
+	return 0;
+}
+
+static unsigned int rgb565_row_simd(const uint32_t *s, uint16_t *d,
+				    unsigned int width, int swap)
+{
+	return 0;
+}
+
+static unsigned int rgb565_to_xrgb_row_simd(const uint16_t *s, uint32_t *d,
+					    unsigned int width, int swap)
+{
+	return 0;
+}
+#endif
+
+/* Two rows of pixels into two luma rows and their chroma row. */
+static void nv12_rows(const uint32_t *s0, const uint32_t *s1, uint8_t *y0,
+		      uint8_t *y1, uint8_t *uv, unsigned int width, int swap)
+{
+	unsigned int x, x1;
+	int r, g, b;
+
+	for (x = nv12_rows_simd(s0, s1, y0, y1, uv, width, swap); x < width;
+	     x += 2) {
+		x1 = x + 1 < width ? x + 1 : x;
+
+		y0[x] = rgb_to_y(PIXEL_R(s0[x]), PIXEL_G(s0[x]), PIXEL_B(s0[x]));
+		y1[x] = rgb_to_y(PIXEL_R(s1[x]), PIXEL_G(s1[x]), PIXEL_B(s1[x]));
+		if (x1 != x) {
+			y0[x1] = rgb_to_y(PIXEL_R(s0[x1]), PIXEL_G(s0[x1]),
+					  PIXEL_B(s0[x1]));
+			y1[x1] = rgb_to_y(PIXEL_R(s1[x1]), PIXEL_G(s1[x1]),
+					  PIXEL_B(s1[x1]));
+		}
+
+		r = (PIXEL_R(s0[x]) + PIXEL_R(s0[x1]) + PIXEL_R(s1[x]) +
+		     PIXEL_R(s1[x1]) + 2) >> 2;
+		g = (PIXEL_G(s0[x]) + PIXEL_G(s0[x1]) + PIXEL_G(s1[x]) +
+		     PIXEL_G(s1[x1]) + 2) >> 2;
+		b = (PIXEL_B(s0[x]) + PIXEL_B(s0[x1]) + PIXEL_B(s1[x]) +
+		     PIXEL_B(s1[x1]) + 2) >> 2;
+		uv[x + swap] = rgb_to_u(r, g, b);
+		uv[x + !swap] = rgb_to_v(r, g, b);
+	}
+}
+
+/* A row of pixels into a packed row; an odd last pixel is doubled. */
+static void packed_row(const uint32_t *s, uint8_t *d, unsigned int width,
+		       const struct packed_layout *l)
+{
+	unsigned int x, x1;
+	uint8_t *pair;
+	int r, g, b;
+
+	for (x = packed_row_simd(s, d, width, l); x < width; x += 2) {
+		x1 = x + 1 < width ? x + 1 : x;
+		pair = d + 2 * x;
+
+		pair[l->y0] = rgb_to_y(PIXEL_R(s[x]), PIXEL_G(s[x]),
+				       PIXEL_B(s[x]));
+		pair[l->y1] = rgb_to_y(PIXEL_R(s[x1]), PIXEL_G(s[x1]),
+				       PIXEL_B(s[x1]));
+
+		r = (PIXEL_R(s[x]) + PIXEL_R(s[x1]) + 1) >> 1;
+		g = (PIXEL_G(s[x]) + PIXEL_G(s[x1]) + 1) >> 1;
+		b = (PIXEL_B(s[x]) + PIXEL_B(s[x1]) + 1) >> 1;
+		pair[l->u] = rgb_to_u(r, g, b);
+		pair[l->v] = rgb_to_v(r, g, b);
+	}
+}
+
+static void rgb565_row(const uint32_t *s, uint16_t *d, unsigned int width,
+		       int swap)
+{
+	unsigned int x;
+	uint32_t r, b;
+
+	for (x = rgb565_row_simd(s, d, width, swap); x < width; x++) {
+		r = PIXEL_R(s[x]);
+		b = PIXEL_B(s[x]);
+		if (swap) {
+			r = b;
+			b = PIXEL_R(s[x]);
+		}
+		d[x] = (r >> 3) << 11 | (PIXEL_G(s[x]) >> 2) << 5 | b >> 3;
+	}
+}
+
+static void rgb565_to_xrgb_row(const uint16_t *s, uint32_t *d,
+			       unsigned int width, int swap)
+{
+	unsigned int x;
+	uint32_t r, g, b, t;
+
+	for (x = rgb565_to_xrgb_row_simd(s, d, width, swap); x < width; x++) {
+		r = s[x] >> 11;
+		g = (s[x] >> 5) & 0x3f;
+		b = s[x] & 0x1f;
+		if (swap) {
+			t = r;
+			r = b;
+			b = t;
+		}
+		d[x] = 0xff000000 | ((r << 3) | (r >> 2)) << 16 |
+		       ((g << 2) | (g >> 4)) << 8 | ((b << 3) | (b >> 2));
+	}
+}
+
+static const struct packed_layout *packed_layout(uint32_t format)
+{
+	switch (format) {
+	case DRM_FORMAT_YUYV:
+		return &layout_yuyv;
+	case DRM_FORMAT_YVYU:
+		return &layout_yvyu;
+	case DRM_FORMAT_UYVY:
+		return &layout_uyvy;
+	case DRM_FORMAT_VYUY:
+		return &layout_vyuy;
+	}
+	return NULL;
+}
+
+int util_convert_from_xrgb8888(uint32_t format, const void *src,
+			       unsigned int src_stride, void *planes[3],
+			       unsigned int width, unsigned int height,
+			       unsigned int stride)
+{
+	const struct packed_layout *layout;
+	const uint32_t *s0, *s1;
+	uint8_t *y0, *y1;
+	unsigned int y;
+
+	switch (format) {
+	case DRM_FORMAT_NV12:
+	case DRM_FORMAT_NV21:
+		/* an odd last row is paired with itself */
+		for (y = 0; y < height; y += 2) {
+			s0 = (const void *)((const uint8_t *)src + y * src_stride);
+			s1 = y + 1 < height ?
+			     (const void *)((const uint8_t *)s0 + src_stride) : s0;
+			y0 = (uint8_t *)planes[0] + y * stride;
+			y1 = y + 1 < height ? y0 + stride : y0;
+			nv12_rows(s0, s1, y0, y1,
+				  (uint8_t *)planes[1] + y / 2 * stride, width,
+				  format == DRM_FORMAT_NV21);
+		}
+		return 0;
+
+	case DRM_FORMAT_YUYV:
+	case DRM_FORMAT_YVYU:
+	case DRM_FORMAT_UYVY:
+	case DRM_FORMAT_VYUY:
+		layout = packed_layout(format);
+		for (y = 0; y < height; y++)
+			packed_row((const void *)((const uint8_t *)src +
+						  y * src_stride),
+				   (uint8_t *)planes[0] + y * stride, width,
+				   layout);
+		return 0;
+
+	case DRM_FORMAT_RGB565:
+	case DRM_FORMAT_BGR565:
+		for (y = 0; y < height; y++)
+			rgb565_row((const void *)((const uint8_t *)src +
+						  y * src_stride),
+				   (void *)((uint8_t *)planes[0] + y * stride),
+				   width, format == DRM_FORMAT_BGR565);
+		return 0;
+	}
+
+	return -EINVAL;
+}
+
+int util_convert_to_xrgb8888(uint32_t format, void *planes[3],
+			     unsigned int stride, void *dst,
+			     unsigned int dst_stride, unsigned int width,
+			     unsigned int height)
+{
+	const struct packed_layout *layout;
+	const uint8_t *luma, *chroma;
+	unsigned int x, y, swap;
+	uint32_t *d;
+
+	switch (format) {
+	case DRM_FORMAT_NV12:
+	case DRM_FORMAT_NV21:
+		swap = format == DRM_FORMAT_NV21;
+		for (y = 0; y < height; y++) {
+			luma = (const uint8_t *)planes[0] + y * stride;
+			chroma = (const uint8_t *)planes[1] + y / 2 * stride;
+			d = (void *)((uint8_t *)dst + y * dst_stride);
+			for (x = 0; x < width; x++)
+				d[x] = yuv_to_xrgb(luma[x],
+						   chroma[(x & ~1) + swap],
+						   chroma[(x & ~1) + !swap]);
+		}
+		return 0;
+
+	case DRM_FORMAT_YUYV:
+	case DRM_FORMAT_YVYU:
+	case DRM_FORMAT_UYVY:
+	case DRM_FORMAT_VYUY:
+		layout = packed_layout(format);
+		for (y = 0; y < height; y++) {
+			luma = (const uint8_t *)planes[0] + y * stride;
+			d = (void *)((uint8_t *)dst + y * dst_stride);
+			for (x = 0; x < width; x++) {
+				chroma = luma + 2 * (x & ~1);
+				d[x] = yuv_to_xrgb(chroma[x & 1 ? layout->y1 :
+								  layout->y0],
+						   chroma[layout->u],
+						   chroma[layout->v]);
+			}
+		}
+		return 0;
+
+	case DRM_FORMAT_RGB565:
+	case DRM_FORMAT_BGR565:
+		for (y = 0; y < height; y++)
+			rgb565_to_xrgb_row((const void *)((const uint8_t *)planes[0] +
+							  y * stride),
+					   (void *)((uint8_t *)dst + y * dst_stride),
+					   width, format == DRM_FORMAT_BGR565);
+		return 0;
+	}
+
+	return -EINVAL;
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright © 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef UTIL_CONVERT_H
+#define UTIL_CONVERT_H
+
+#include <stdint.h>
+
+/*
+ * Conversion between XRGB8888 and NV12, NV21, the packed 4:2:2 formats,
+ * RGB565 and BGR565.  Planes and strides are laid out as for
+ * util_fill_pattern(): semi-planar chroma rows use the luma stride.  YUV is
+ * BT.601 limited range, as in the test patterns, and each chroma sample is
+ * made from the average of the pixels it covers.  Both return 0, or
+ * -EINVAL for other formats.
+ */
+int util_convert_from_xrgb8888(uint32_t format, const void *src,
+			       unsigned int src_stride, void *planes[3],
+			       unsigned int width, unsigned int height,
+			       unsigned int stride);
+int util_convert_to_xrgb8888(uint32_t format, void *planes[3],
+			     unsigned int stride, void *dst,
+			     unsigned int dst_stride, unsigned int width,
+			     unsigned int height);
+
+#endif /* UTIL_CONVERT_H */
@@ -111,13 +111,49 @@ uint32_t util_format_fourcc(const char *name)
 	return 0;
 }
 
+/*
+ * Open-addressed index of format_info by fourcc, built on first use.  Slots
+ * hold 1 + the table index, 0 is empty; the table is well under half the
+ * size of the index so probe sequences stay short.
+ */
+#define FORMAT_INDEX_BITS	7
+#define FORMAT_INDEX_SIZE	(1 << FORMAT_INDEX_BITS)
+
+static uint8_t format_index[FORMAT_INDEX_SIZE];
+static int format_index_built;
+
+static unsigned int format_hash(uint32_t format)
+{
+	return (format * 0x9e3779b1u) >> (32 - FORMAT_INDEX_BITS);
+}
+
+static void format_index_build(void)
+{
+	unsigned int i, slot;
+
+	for (i = 0; i < ARRAY_SIZE(format_info); i++) {
+		slot = format_hash(format_info[i].format);
+		while (format_index[slot])
+			slot = (slot + 1) % FORMAT_INDEX_SIZE;
+		format_index[slot] = i + 1;
+	}
+	format_index_built = 1;
+}
+
 const struct util_format_info *util_format_info_find(uint32_t format)
 {
-	unsigned int i;
+	const struct util_format_info *info;
+	unsigned int slot;
 
-	for (i = 0; i < ARRAY_SIZE(format_info); i++)
-		if (format_info[i].format == format)
-			return &format_info[i];
+	if (!format_index_built)
+		format_index_build();
+
+	for (slot = format_hash(format); format_index[slot];
+	     slot = (slot + 1) % FORMAT_INDEX_SIZE) {
+		info = &format_info[format_index[slot] - 1];
+		if (info->format == format)
+			return info;
+	}
 
 	return NULL;
 }
@@ -23,6 +23,7 @@
  * IN THE SOFTWARE.
  */
 
+#include <errno.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -36,6 +37,7 @@
 #endif
 
 #include "common.h"
+#include "convert.h"
 #include "format.h"
 #include "pattern.h"
 
@@ -156,6 +158,23 @@ static uint16_t uint16_div_64k_to_half(uint16_t v)
 	 shiftcolor16(&(rgb)->blue, uint16_div_64k_to_half((b) << 6)) | \
 	 shiftcolor16(&(rgb)->alpha, uint16_div_64k_to_half((a) << 6)))
 
+/*
+ * The SMPTE pattern is made of three horizontal bands whose rows are all
+ * identical. The fill functions only compute the first row of each band,
+ * which is then copied down to the remaining rows.
+ */
+static void replicate_smpte_rows(void *mem, unsigned int size,
+				 unsigned int height, unsigned int stride)
+{
+	unsigned int y;
+
+	for (y = 1; y < height; ++y) {
+		if (y == height * 6 / 9 || y == height * 7 / 9)
+			continue;
+		memcpy(mem + y * stride, mem + (y - 1) * stride, size);
+	}
+}
+
 static void fill_smpte_yuv_planar(const struct util_yuv_info *yuv,
 				  unsigned char *y_mem, unsigned char *u_mem,
 				  unsigned char *v_mem, unsigned int width,
@@ -192,71 +211,76 @@ static void fill_smpte_yuv_planar(const struct util_yuv_info *yuv,
 	unsigned int cs = yuv->chroma_stride;
 	unsigned int xsub = yuv->xsub;
 	unsigned int ysub = yuv->ysub;
+	unsigned int c_stride = stride * cs / xsub;
+	unsigned int c_height = height / ysub;
+	unsigned int c_size = (width + xsub - 1) / xsub * cs;
+	unsigned char *y_row, *u_row, *v_row;
 	unsigned int x;
-	unsigned int y;
 
 	/* Luma */
-	for (y = 0; y < height * 6 / 9; ++y) {
-		for (x = 0; x < width; ++x)
-			y_mem[x] = colors_top[x * 7 / width].y;
-		y_mem += stride;
-	}
+	y_row = y_mem;
+	for (x = 0; x < width; ++x)
+		y_row[x] = colors_top[x * 7 / width].y;
 
-	for (; y < height * 7 / 9; ++y) {
-		for (x = 0; x < width; ++x)
-			y_mem[x] = colors_middle[x * 7 / width].y;
-		y_mem += stride;
-	}
+	y_row = y_mem + height * 6 / 9 * stride;
+	for (x = 0; x < width; ++x)
+		y_row[x] = colors_middle[x * 7 / width].y;
 
-	for (; y < height; ++y) {
-		for (x = 0; x < width * 5 / 7; ++x)
-			y_mem[x] = colors_bottom[x * 4 / (width * 5 / 7)].y;
-		for (; x < width * 6 / 7; ++x)
-			y_mem[x] = colors_bottom[(x - width * 5 / 7) * 3
-						 / (width / 7) + 4].y;
-		for (; x < width; ++x)
-			y_mem[x] = colors_bottom[7].y;
-		y_mem += stride;
-	}
+	y_row = y_mem + height * 7 / 9 * stride;
+	for (x = 0; x < width * 5 / 7; ++x)
+		y_row[x] = colors_bottom[x * 4 / (width * 5 / 7)].y;
+	for (; x < width * 6 / 7; ++x)
+		y_row[x] = colors_bottom[(x - width * 5 / 7) * 3
+					 / (width / 7) + 4].y;
+	for (; x < width; ++x)
+		y_row[x] = colors_bottom[7].y;
+
+	replicate_smpte_rows(y_mem, width, height, stride);
 
 	/* Chroma */
-	for (y = 0; y < height / ysub * 6 / 9; ++y) {
-		for (x = 0; x < width; x += xsub) {
-			u_mem[x*cs/xsub] = colors_top[x * 7 / width].u;
-			v_mem[x*cs/xsub] = colors_top[x * 7 / width].v;
-		}
-		u_mem += stride * cs / xsub;
-		v_mem += stride * cs / xsub;
+	if (!c_height)
+		return;
+
+	u_row = u_mem;
+	v_row = v_mem;
+	for (x = 0; x < width; x += xsub) {
+		u_row[x*cs/xsub] = colors_top[x * 7 / width].u;
+		v_row[x*cs/xsub] = colors_top[x * 7 / width].v;
 	}
 
-	for (; y < height / ysub * 7 / 9; ++y) {
-		for (x = 0; x < width; x += xsub) {
-			u_mem[x*cs/xsub] = colors_middle[x * 7 / width].u;
-			v_mem[x*cs/xsub] = colors_middle[x * 7 / width].v;
-		}
-		u_mem += stride * cs / xsub;
-		v_mem += stride * cs / xsub;
+	u_row = u_mem + c_height * 6 / 9 * c_stride;
+	v_row = v_mem + c_height * 6 / 9 * c_stride;
+	for (x = 0; x < width; x += xsub) {
+		u_row[x*cs/xsub] = colors_middle[x * 7 / width].u;
+		v_row[x*cs/xsub] = colors_middle[x * 7 / width].v;
 	}
 
-	for (; y < height / ysub; ++y) {
-		for (x = 0; x < width * 5 / 7; x += xsub) {
-			u_mem[x*cs/xsub] =
-				colors_bottom[x * 4 / (width * 5 / 7)].u;
-			v_mem[x*cs/xsub] =
-				colors_bottom[x * 4 / (width * 5 / 7)].v;
-		}
-		for (; x < width * 6 / 7; x += xsub) {
-			u_mem[x*cs/xsub] = colors_bottom[(x - width * 5 / 7) *
-							 3 / (width / 7) + 4].u;
-			v_mem[x*cs/xsub] = colors_bottom[(x - width * 5 / 7) *
-							 3 / (width / 7) + 4].v;
-		}
-		for (; x < width; x += xsub) {
-			u_mem[x*cs/xsub] = colors_bottom[7].u;
-			v_mem[x*cs/xsub] = colors_bottom[7].v;
-		}
-		u_mem += stride * cs / xsub;
-		v_mem += stride * cs / xsub;
+	u_row = u_mem + c_height * 7 / 9 * c_stride;
+	v_row = v_mem + c_height * 7 / 9 * c_stride;
+	for (x = 0; x < width * 5 / 7; x += xsub) {
+		u_row[x*cs/xsub] =
+			colors_bottom[x * 4 / (width * 5 / 7)].u;
+		v_row[x*cs/xsub] =
+			colors_bottom[x * 4 / (width * 5 / 7)].v;
+	}
+	for (; x < width * 6 / 7; x += xsub) {
+		u_row[x*cs/xsub] = colors_bottom[(x - width * 5 / 7) *
+						 3 / (width / 7) + 4].u;
+		v_row[x*cs/xsub] = colors_bottom[(x - width * 5 / 7) *
+						 3 / (width / 7) + 4].v;
+	}
+	for (; x < width; x += xsub) {
+		u_row[x*cs/xsub] = colors_bottom[7].u;
+		v_row[x*cs/xsub] = colors_bottom[7].v;
+	}
+
+	/* Cb and Cr share rows for semi-planar formats */
+	if (cs == 1) {
+		replicate_smpte_rows(u_mem, c_size, c_height, c_stride);
+		replicate_smpte_rows(v_mem, c_size, c_height, c_stride);
+	} else {
+		replicate_smpte_rows(u_mem < v_mem ? u_mem : v_mem, c_size,
+				     c_height, c_stride);
 	}
 }
 
@@ -296,67 +320,57 @@ static void fill_smpte_yuv_packed(const struct util_yuv_info *yuv, void *mem,
 	unsigned char *c_mem = (yuv->order & YUV_CY) ? mem : mem + 1;
 	unsigned int u = (yuv->order & YUV_YCrCb) ? 2 : 0;
 	unsigned int v = (yuv->order & YUV_YCbCr) ? 2 : 0;
+	unsigned char *y_row, *c_row;
 	unsigned int x;
-	unsigned int y;
 
 	/* Luma */
-	for (y = 0; y < height * 6 / 9; ++y) {
-		for (x = 0; x < width; ++x)
-			y_mem[2*x] = colors_top[x * 7 / width].y;
-		y_mem += stride;
-	}
+	y_row = y_mem;
+	for (x = 0; x < width; ++x)
+		y_row[2*x] = colors_top[x * 7 / width].y;
+
+	y_row = y_mem + height * 6 / 9 * stride;
+	for (x = 0; x < width; ++x)
+		y_row[2*x] = colors_middle[x * 7 / width].y;
+
+	y_row = y_mem + height * 7 / 9 * stride;
+	for (x = 0; x < width * 5 / 7; ++x)
+		y_row[2*x] = colors_bottom[x * 4 / (width * 5 / 7)].y;
+	for (; x < width * 6 / 7; ++x)
+		y_row[2*x] = colors_bottom[(x - width * 5 / 7) * 3
+					   / (width / 7) + 4].y;
+	for (; x < width; ++x)
+		y_row[2*x] = colors_bottom[7].y;
 
-	for (; y < height * 7 / 9; ++y) {
-		for (x = 0; x < width; ++x)
-			y_mem[2*x] = colors_middle[x * 7 / width].y;
-		y_mem += stride;
+	/* Chroma */
+	c_row = c_mem;
+	for (x = 0; x < width; x += 2) {
+		c_row[2*x+u] = colors_top[x * 7 / width].u;
+		c_row[2*x+v] = colors_top[x * 7 / width].v;
 	}
 
-	for (; y < height; ++y) {
-		for (x = 0; x < width * 5 / 7; ++x)
-			y_mem[2*x] = colors_bottom[x * 4 / (width * 5 / 7)].y;
-		for (; x < width * 6 / 7; ++x)
-			y_mem[2*x] = colors_bottom[(x - width * 5 / 7) * 3
-						   / (width / 7) + 4].y;
-		for (; x < width; ++x)
-			y_mem[2*x] = colors_bottom[7].y;
-		y_mem += stride;
+	c_row = c_mem + height * 6 / 9 * stride;
+	for (x = 0; x < width; x += 2) {
+		c_row[2*x+u] = colors_middle[x * 7 / width].u;
+		c_row[2*x+v] = colors_middle[x * 7 / width].v;
 	}
 
-	/* Chroma */
-	for (y = 0; y < height * 6 / 9; ++y) {
-		for (x = 0; x < width; x += 2) {
-			c_mem[2*x+u] = colors_top[x * 7 / width].u;
-			c_mem[2*x+v] = colors_top[x * 7 / width].v;
-		}
-		c_mem += stride;
+	c_row = c_mem + height * 7 / 9 * stride;
+	for (x = 0; x < width * 5 / 7; x += 2) {
+		c_row[2*x+u] = colors_bottom[x * 4 / (width * 5 / 7)].u;
+		c_row[2*x+v] = colors_bottom[x * 4 / (width * 5 / 7)].v;
 	}
-
-	for (; y < height * 7 / 9; ++y) {
-		for (x = 0; x < width; x += 2) {
-			c_mem[2*x+u] = colors_middle[x * 7 / width].u;
-			c_mem[2*x+v] = colors_middle[x * 7 / width].v;
-		}
-		c_mem += stride;
+	for (; x < width * 6 / 7; x += 2) {
+		c_row[2*x+u] = colors_bottom[(x - width * 5 / 7) *
+					     3 / (width / 7) + 4].u;
+		c_row[2*x+v] = colors_bottom[(x - width * 5 / 7) *
+					     3 / (width / 7) + 4].v;
 	}
-
-	for (; y < height; ++y) {
-		for (x = 0; x < width * 5 / 7; x += 2) {
-			c_mem[2*x+u] = colors_bottom[x * 4 / (width * 5 / 7)].u;
-			c_mem[2*x+v] = colors_bottom[x * 4 / (width * 5 / 7)].v;
-		}
-		for (; x < width * 6 / 7; x += 2) {
-			c_mem[2*x+u] = colors_bottom[(x - width * 5 / 7) *
-						     3 / (width / 7) + 4].u;
-			c_mem[2*x+v] = colors_bottom[(x - width * 5 / 7) *
-						     3 / (width / 7) + 4].v;
-		}
-		for (; x < width; x += 2) {
-			c_mem[2*x+u] = colors_bottom[7].u;
-			c_mem[2*x+v] = colors_bottom[7].v;
-		}
-		c_mem += stride;
+	for (; x < width; x += 2) {
+		c_row[2*x+u] = colors_bottom[7].u;
+		c_row[2*x+v] = colors_bottom[7].v;
 	}
+
+	replicate_smpte_rows(mem, (width + 1) / 2 * 4, height, stride);
 }
 
 static void fill_smpte_rgb16(const struct util_rgb_info *rgb, void *mem,
@@ -392,32 +406,28 @@ static void fill_smpte_rgb16(const struct util_rgb_info *rgb, void *mem,
 		MAKE_RGBA(rgb, 19, 19, 19, 255),	/* black */
 	};
 	unsigned int x;
-	unsigned int y;
-
-	for (y = 0; y < height * 6 / 9; ++y) {
-		for (x = 0; x < width; ++x)
-			((uint16_t *)mem)[x] = colors_top[x * 7 / width];
-		mem += stride;
-	}
-
-	for (; y < height * 7 / 9; ++y) {
-		for (x = 0; x < width; ++x)
-			((uint16_t *)mem)[x] = colors_middle[x * 7 / width];
-		mem += stride;
-	}
-
-	for (; y < height; ++y) {
-		for (x = 0; x < width * 5 / 7; ++x)
-			((uint16_t *)mem)[x] =
-				colors_bottom[x * 4 / (width * 5 / 7)];
-		for (; x < width * 6 / 7; ++x)
-			((uint16_t *)mem)[x] =
-				colors_bottom[(x - width * 5 / 7) * 3
-					      / (width / 7) + 4];
-		for (; x < width; ++x)
-			((uint16_t *)mem)[x] = colors_bottom[7];
-		mem += stride;
-	}
+	void *row;
+
+	row = mem;
+	for (x = 0; x < width; ++x)
+		((uint16_t *)row)[x] = colors_top[x * 7 / width];
+
+	row = mem + height * 6 / 9 * stride;
+	for (x = 0; x < width; ++x)
+		((uint16_t *)row)[x] = colors_middle[x * 7 / width];
+
+	row = mem + height * 7 / 9 * stride;
+	for (x = 0; x < width * 5 / 7; ++x)
+		((uint16_t *)row)[x] =
+			colors_bottom[x * 4 / (width * 5 / 7)];
+	for (; x < width * 6 / 7; ++x)
+		((uint16_t *)row)[x] =
+			colors_bottom[(x - width * 5 / 7) * 3
+				      / (width / 7) + 4];
+	for (; x < width; ++x)
+		((uint16_t *)row)[x] = colors_bottom[7];
+
+	replicate_smpte_rows(mem, width * 2, height, stride);
 }
 
 static void fill_smpte_rgb24(const struct util_rgb_info *rgb, void *mem,
@@ -453,34 +463,30 @@ static void fill_smpte_rgb24(const struct util_rgb_info *rgb, void *mem,
 		MAKE_RGB24(rgb, 19, 19, 19),	/* black */
 	};
 	unsigned int x;
-	unsigned int y;
-
-	for (y = 0; y < height * 6 / 9; ++y) {
-		for (x = 0; x < width; ++x)
-			((struct color_rgb24 *)mem)[x] =
-				colors_top[x * 7 / width];
-		mem += stride;
-	}
-
-	for (; y < height * 7 / 9; ++y) {
-		for (x = 0; x < width; ++x)
-			((struct color_rgb24 *)mem)[x] =
-				colors_middle[x * 7 / width];
-		mem += stride;
-	}
-
-	for (; y < height; ++y) {
-		for (x = 0; x < width * 5 / 7; ++x)
-			((struct color_rgb24 *)mem)[x] =
-				colors_bottom[x * 4 / (width * 5 / 7)];
-		for (; x < width * 6 / 7; ++x)
-			((struct color_rgb24 *)mem)[x] =
-				colors_bottom[(x - width * 5 / 7) * 3
-					      / (width / 7) + 4];
-		for (; x < width; ++x)
-			((struct color_rgb24 *)mem)[x] = colors_bottom[7];
-		mem += stride;
-	}
+	void *row;
+
+	row = mem;
+	for (x = 0; x < width; ++x)
+		((struct color_rgb24 *)row)[x] =
+			colors_top[x * 7 / width];
+
+	row = mem + height * 6 / 9 * stride;
+	for (x = 0; x < width; ++x)
+		((struct color_rgb24 *)row)[x] =
+			colors_middle[x * 7 / width];
+
+	row = mem + height * 7 / 9 * stride;
+	for (x = 0; x < width * 5 / 7; ++x)
+		((struct color_rgb24 *)row)[x] =
+			colors_bottom[x * 4 / (width * 5 / 7)];
+	for (; x < width * 6 / 7; ++x)
+		((struct color_rgb24 *)row)[x] =
+			colors_bottom[(x - width * 5 / 7) * 3
+				      / (width / 7) + 4];
+	for (; x < width; ++x)
+		((struct color_rgb24 *)row)[x] = colors_bottom[7];
+
+	replicate_smpte_rows(mem, width * 3, height, stride);
 }
 
 static void fill_smpte_rgb32(const struct util_rgb_info *rgb, void *mem,
@@ -516,32 +522,28 @@ static void fill_smpte_rgb32(const struct util_rgb_info *rgb, void *mem,
 		MAKE_RGBA(rgb, 19, 19, 19, 255),	/* black */
 	};
 	unsigned int x;
-	unsigned int y;
-
-	for (y = 0; y < height * 6 / 9; ++y) {
-		for (x = 0; x < width; ++x)
-			((uint32_t *)mem)[x] = colors_top[x * 7 / width];
-		mem += stride;
-	}
-
-	for (; y < height * 7 / 9; ++y) {
-		for (x = 0; x < width; ++x)
-			((uint32_t *)mem)[x] = colors_middle[x * 7 / width];
-		mem += stride;
-	}
-
-	for (; y < height; ++y) {
-		for (x = 0; x < width * 5 / 7; ++x)
-			((uint32_t *)mem)[x] =
-				colors_bottom[x * 4 / (width * 5 / 7)];
-		for (; x < width * 6 / 7; ++x)
-			((uint32_t *)mem)[x] =
-				colors_bottom[(x - width * 5 / 7) * 3
-					      / (width / 7) + 4];
-		for (; x < width; ++x)
-			((uint32_t *)mem)[x] = colors_bottom[7];
-		mem += stride;
-	}
+	void *row;
+
+	row = mem;
+	for (x = 0; x < width; ++x)
+		((uint32_t *)row)[x] = colors_top[x * 7 / width];
+
+	row = mem + height * 6 / 9 * stride;
+	for (x = 0; x < width; ++x)
+		((uint32_t *)row)[x] = colors_middle[x * 7 / width];
+
+	row = mem + height * 7 / 9 * stride;
+	for (x = 0; x < width * 5 / 7; ++x)
+		((uint32_t *)row)[x] =
+			colors_bottom[x * 4 / (width * 5 / 7)];
+	for (; x < width * 6 / 7; ++x)
+		((uint32_t *)row)[x] =
+			colors_bottom[(x - width * 5 / 7) * 3
+				      / (width / 7) + 4];
+	for (; x < width; ++x)
+		((uint32_t *)row)[x] = colors_bottom[7];
+
+	replicate_smpte_rows(mem, width * 4, height, stride);
 }
 
 static void fill_smpte_rgb16fp(const struct util_rgb_info *rgb, void *mem,
@@ -577,64 +579,56 @@ static void fill_smpte_rgb16fp(const struct util_rgb_info *rgb, void *mem,
 		MAKE_RGBA8FP16(rgb, 19, 19, 19, 255),	/* black */
 	};
 	unsigned int x;
-	unsigned int y;
-
-	for (y = 0; y < height * 6 / 9; ++y) {
-		for (x = 0; x < width; ++x)
-			((uint64_t *)mem)[x] = colors_top[x * 7 / width];
-		mem += stride;
-	}
-
-	for (; y < height * 7 / 9; ++y) {
-		for (x = 0; x < width; ++x)
-			((uint64_t *)mem)[x] = colors_middle[x * 7 / width];
-		mem += stride;
-	}
-
-	for (; y < height; ++y) {
-		for (x = 0; x < width * 5 / 7; ++x)
-			((uint64_t *)mem)[x] =
-				colors_bottom[x * 4 / (width * 5 / 7)];
-		for (; x < width * 6 / 7; ++x)
-			((uint64_t *)mem)[x] =
-				colors_bottom[(x - width * 5 / 7) * 3
-					      / (width / 7) + 4];
-		for (; x < width; ++x)
-			((uint64_t *)mem)[x] = colors_bottom[7];
-		mem += stride;
-	}
+	void *row;
+
+	row = mem;
+	for (x = 0; x < width; ++x)
+		((uint64_t *)row)[x] = colors_top[x * 7 / width];
+
+	row = mem + height * 6 / 9 * stride;
+	for (x = 0; x < width; ++x)
+		((uint64_t *)row)[x] = colors_middle[x * 7 / width];
+
+	row = mem + height * 7 / 9 * stride;
+	for (x = 0; x < width * 5 / 7; ++x)
+		((uint64_t *)row)[x] =
+			colors_bottom[x * 4 / (width * 5 / 7)];
+	for (; x < width * 6 / 7; ++x)
+		((uint64_t *)row)[x] =
+			colors_bottom[(x - width * 5 / 7) * 3
+				      / (width / 7) + 4];
+	for (; x < width; ++x)
+		((uint64_t *)row)[x] = colors_bottom[7];
+
+	replicate_smpte_rows(mem, width * 8, height, stride);
 }
 
 static void fill_smpte_c8(void *mem, unsigned int width, unsigned int height,
 			  unsigned int stride)
 {
 	unsigned int x;
-	unsigned int y;
-
-	for (y = 0; y < height * 6 / 9; ++y) {
-		for (x = 0; x < width; ++x)
-			((uint8_t *)mem)[x] = x * 7 / width;
-		mem += stride;
-	}
-
-	for (; y < height * 7 / 9; ++y) {
-		for (x = 0; x < width; ++x)
-			((uint8_t *)mem)[x] = 7 + (x * 7 / width);
-		mem += stride;
-	}
-
-	for (; y < height; ++y) {
-		for (x = 0; x < width * 5 / 7; ++x)
-			((uint8_t *)mem)[x] =
-				14 + (x * 4 / (width * 5 / 7));
-		for (; x < width * 6 / 7; ++x)
-			((uint8_t *)mem)[x] =
-				14 + ((x - width * 5 / 7) * 3
-					      / (width / 7) + 4);
-		for (; x < width; ++x)
-			((uint8_t *)mem)[x] = 14 + 7;
-		mem += stride;
-	}
+	void *row;
+
+	row = mem;
+	for (x = 0; x < width; ++x)
+		((uint8_t *)row)[x] = x * 7 / width;
+
+	row = mem + height * 6 / 9 * stride;
+	for (x = 0; x < width; ++x)
+		((uint8_t *)row)[x] = 7 + (x * 7 / width);
+
+	row = mem + height * 7 / 9 * stride;
+	for (x = 0; x < width * 5 / 7; ++x)
+		((uint8_t *)row)[x] =
+			14 + (x * 4 / (width * 5 / 7));
+	for (; x < width * 6 / 7; ++x)
+		((uint8_t *)row)[x] =
+			14 + ((x - width * 5 / 7) * 3
+				      / (width / 7) + 4);
+	for (; x < width; ++x)
+		((uint8_t *)row)[x] = 14 + 7;
+
+	replicate_smpte_rows(mem, width, height, stride);
 }
 
 void util_smpte_c8_gamma(unsigned size, struct drm_color_lut *lut)
@@ -839,6 +833,29 @@ static void make_pwetty(void *data, unsigned int width, unsigned int height,
 #endif
 }
 
+/*
+ * The tiles pattern only depends on x + y, so every row is the previous one
+ * shifted left by one pixel. The fill functions copy the shifted row and
+ * only compute the pixels the shift doesn't provide.
+ */
+static uint32_t tiles_rgb32(unsigned int x, unsigned int y, unsigned int width)
+{
+	div_t d = div(x+y, width);
+
+	return 0x00130502 * (d.quot >> 6) + 0x000a1120 * (d.rem >> 6);
+}
+
+static struct color_yuv tiles_yuv(unsigned int x, unsigned int y,
+				  unsigned int width)
+{
+	uint32_t rgb32 = tiles_rgb32(x, y, width);
+	struct color_yuv color =
+		MAKE_YUV_601((rgb32 >> 16) & 0xff,
+			     (rgb32 >> 8) & 0xff, rgb32 & 0xff);
+
+	return color;
+}
+
 static void fill_tiles_yuv_planar(const struct util_format_info *info,
 				  unsigned char *y_mem, unsigned char *u_mem,
 				  unsigned char *v_mem, unsigned int width,
@@ -851,25 +868,37 @@ static void fill_tiles_yuv_planar(const struct util_format_info *info,
 	unsigned int x;
 	unsigned int y;
 
+	/* Luma */
 	for (y = 0; y < height; ++y) {
-		for (x = 0; x < width; ++x) {
-			div_t d = div(x+y, width);
-			uint32_t rgb32 = 0x00130502 * (d.quot >> 6)
-				       + 0x000a1120 * (d.rem >> 6);
-			struct color_yuv color =
-				MAKE_YUV_601((rgb32 >> 16) & 0xff,
-					     (rgb32 >> 8) & 0xff, rgb32 & 0xff);
-
-			y_mem[x] = color.y;
-			u_mem[x/xsub*cs] = color.u;
-			v_mem[x/xsub*cs] = color.v;
+		x = 0;
+		if (y > 0 && width > 0) {
+			memcpy(y_mem, y_mem - stride + 1, width - 1);
+			x = width - 1;
 		}
 
+		for (; x < width; ++x)
+			y_mem[x] = tiles_yuv(x, y, width).y;
+
 		y_mem += stride;
-		if ((y + 1) % ysub == 0) {
-			u_mem += stride * cs / xsub;
-			v_mem += stride * cs / xsub;
+	}
+
+	/*
+	 * Chroma, sampled from the bottom-right pixel of each block as the
+	 * per-pixel loop used to end up doing.
+	 */
+	for (y = 0; y < height; y += ysub) {
+		unsigned int sy = y + ysub - 1 < height ? y + ysub - 1 : height - 1;
+
+		for (x = 0; x < width; x += xsub) {
+			unsigned int sx = x + xsub - 1 < width ? x + xsub - 1 : width - 1;
+			struct color_yuv color = tiles_yuv(sx, sy, width);
+
+			u_mem[x/xsub*cs] = color.u;
+			v_mem[x/xsub*cs] = color.v;
 		}
+
+		u_mem += stride * cs / xsub;
+		v_mem += stride * cs / xsub;
 	}
 }
 
@@ -882,17 +911,20 @@ static void fill_tiles_yuv_packed(const struct util_format_info *info,
 	unsigned char *c_mem = (yuv->order & YUV_CY) ? mem : mem + 1;
 	unsigned int u = (yuv->order & YUV_YCrCb) ? 2 : 0;
 	unsigned int v = (yuv->order & YUV_YCbCr) ? 2 : 0;
+	unsigned int pairs = (width + 1) / 2;
 	unsigned int x;
 	unsigned int y;
 
 	for (y = 0; y < height; ++y) {
-		for (x = 0; x < width; x += 2) {
-			div_t d = div(x+y, width);
-			uint32_t rgb32 = 0x00130502 * (d.quot >> 6)
-				       + 0x000a1120 * (d.rem >> 6);
-			struct color_yuv color =
-				MAKE_YUV_601((rgb32 >> 16) & 0xff,
-					     (rgb32 >> 8) & 0xff, rgb32 & 0xff);
+		x = 0;
+		/* pixels come in pairs, so shift by one pair from two rows up */
+		if (y > 1 && pairs > 0) {
+			memcpy(mem, mem - 2 * stride + 4, (pairs - 1) * 4);
+			x = (pairs - 1) * 2;
+		}
+
+		for (; x < width; x += 2) {
+			struct color_yuv color = tiles_yuv(x, y, width);
 
 			y_mem[2*x] = color.y;
 			c_mem[2*x+u] = color.u;
@@ -900,11 +932,57 @@ static void fill_tiles_yuv_packed(const struct util_format_info *info,
 			c_mem[2*x+v] = color.v;
 		}
 
+		mem += stride;
 		y_mem += stride;
 		c_mem += stride;
 	}
 }
 
+/*
+ * Formats util_convert_from_xrgb8888() handles are filled by rendering two
+ * XRGB8888 rows at a time and converting them, which averages the chroma of
+ * each block instead of sampling it.
+ */
+static int fill_tiles_convert(uint32_t format, void *planes[3],
+			      unsigned int width, unsigned int height,
+			      unsigned int stride)
+{
+	unsigned int lines, x, y;
+	void *dst[3] = { NULL };
+	uint32_t *rows;
+
+	if (!width)
+		return 0;
+
+	rows = malloc(width * 2 * sizeof(*rows));
+	if (!rows)
+		return -ENOMEM;
+
+	for (y = 0; y < height; y += 2) {
+		/* each row is the one above shifted left by a pixel */
+		x = 0;
+		if (y > 0) {
+			memmove(rows, rows + width + 1,
+				(width - 1) * sizeof(*rows));
+			x = width - 1;
+		}
+		for (; x < width; ++x)
+			rows[x] = tiles_rgb32(x, y, width);
+		memcpy(rows + width, rows + 1, (width - 1) * sizeof(*rows));
+		rows[2 * width - 1] = tiles_rgb32(width - 1, y + 1, width);
+
+		lines = height - y < 2 ? height - y : 2;
+		dst[0] = (uint8_t *)planes[0] + y * stride;
+		if (planes[1])
+			dst[1] = (uint8_t *)planes[1] + y / 2 * stride;
+		util_convert_from_xrgb8888(format, rows, width * sizeof(*rows),
+					   dst, width, lines, stride);
+	}
+
+	free(rows);
+	return 0;
+}
+
 static void fill_tiles_rgb16(const struct util_format_info *info, void *mem,
 			     unsigned int width, unsigned int height,
 			     unsigned int stride)
@@ -914,10 +992,14 @@ static void fill_tiles_rgb16(const struct util_format_info *info, void *mem,
 	unsigned int x, y;
 
 	for (y = 0; y < height; ++y) {
-		for (x = 0; x < width; ++x) {
-			div_t d = div(x+y, width);
-			uint32_t rgb32 = 0x00130502 * (d.quot >> 6)
-				       + 0x000a1120 * (d.rem >> 6);
+		x = 0;
+		if (y > 0 && width > 0) {
+			memcpy(mem, mem - stride + 2, (width - 1) * 2);
+			x = width - 1;
+		}
+
+		for (; x < width; ++x) {
+			uint32_t rgb32 = tiles_rgb32(x, y, width);
 			uint16_t color =
 				MAKE_RGBA(rgb, (rgb32 >> 16) & 0xff,
 					  (rgb32 >> 8) & 0xff, rgb32 & 0xff,
@@ -939,10 +1021,14 @@ static void fill_tiles_rgb24(const struct util_format_info *info, void *mem,
 	unsigned int x, y;
 
 	for (y = 0; y < height; ++y) {
-		for (x = 0; x < width; ++x) {
-			div_t d = div(x+y, width);
-			uint32_t rgb32 = 0x00130502 * (d.quot >> 6)
-				       + 0x000a1120 * (d.rem >> 6);
+		x = 0;
+		if (y > 0 && width > 0) {
+			memcpy(mem, mem - stride + 3, (width - 1) * 3);
+			x = width - 1;
+		}
+
+		for (; x < width; ++x) {
+			uint32_t rgb32 = tiles_rgb32(x, y, width);
 			struct color_rgb24 color =
 				MAKE_RGB24(rgb, (rgb32 >> 16) & 0xff,
 					   (rgb32 >> 8) & 0xff, rgb32 & 0xff);
@@ -953,6 +1039,17 @@ static void fill_tiles_rgb24(const struct util_format_info *info, void *mem,
 	}
 }
 
+static uint32_t tiles_rgba32(const struct util_rgb_info *rgb,
+			     unsigned int x, unsigned int y,
+			     unsigned int width, unsigned int height)
+{
+	uint32_t rgb32 = tiles_rgb32(x, y, width);
+	uint32_t alpha = ((y < height/2) && (x < width/2)) ? 127 : 255;
+
+	return MAKE_RGBA(rgb, (rgb32 >> 16) & 0xff, (rgb32 >> 8) & 0xff,
+			 rgb32 & 0xff, alpha);
+}
+
 static void fill_tiles_rgb32(const struct util_format_info *info, void *mem,
 			     unsigned int width, unsigned int height,
 			     unsigned int stride)
@@ -962,24 +1059,37 @@ static void fill_tiles_rgb32(const struct util_format_info *info, void *mem,
 	unsigned int x, y;
 
 	for (y = 0; y < height; ++y) {
-		for (x = 0; x < width; ++x) {
-			div_t d = div(x+y, width);
-			uint32_t rgb32 = 0x00130502 * (d.quot >> 6)
-				       + 0x000a1120 * (d.rem >> 6);
-			uint32_t alpha = ((y < height/2) && (x < width/2)) ? 127 : 255;
-			uint32_t color =
-				MAKE_RGBA(rgb, (rgb32 >> 16) & 0xff,
-					  (rgb32 >> 8) & 0xff, rgb32 & 0xff,
-					  alpha);
-
-			((uint32_t *)mem)[x] = color;
+		x = 0;
+		if (y > 0 && y != height / 2 && width > 0) {
+			memcpy(mem, mem - stride + 4, (width - 1) * 4);
+			x = width - 1;
+			/* the pixel shifted in from the opaque half */
+			if (y < height / 2 && width / 2 > 0)
+				((uint32_t *)mem)[width / 2 - 1] =
+					tiles_rgba32(rgb, width / 2 - 1, y,
+						     width, height);
 		}
+
+		for (; x < width; ++x)
+			((uint32_t *)mem)[x] =
+				tiles_rgba32(rgb, x, y, width, height);
 		mem += stride;
 	}
 
 	make_pwetty(mem_base, width, height, stride, info->format);
 }
 
+static uint64_t tiles_rgba16fp(const struct util_rgb_info *rgb,
+			       unsigned int x, unsigned int y,
+			       unsigned int width, unsigned int height)
+{
+	uint32_t rgb32 = tiles_rgb32(x, y, width);
+	uint32_t alpha = ((y < height/2) && (x < width/2)) ? 127 : 255;
+
+	return MAKE_RGBA8FP16(rgb, (rgb32 >> 16) & 0xff, (rgb32 >> 8) & 0xff,
+			      rgb32 & 0xff, alpha);
+}
+
 static void fill_tiles_rgb16fp(const struct util_format_info *info, void *mem,
 			       unsigned int width, unsigned int height,
 			       unsigned int stride)
@@ -990,18 +1100,20 @@ static void fill_tiles_rgb16fp(const struct util_format_info *info, void *mem,
 
 	/* TODO: Give this actual fp16 precision */
 	for (y = 0; y < height; ++y) {
-		for (x = 0; x < width; ++x) {
-			div_t d = div(x+y, width);
-			uint32_t rgb32 = 0x00130502 * (d.quot >> 6)
-				       + 0x000a1120 * (d.rem >> 6);
-			uint32_t alpha = ((y < height/2) && (x < width/2)) ? 127 : 255;
-			uint64_t color =
-				MAKE_RGBA8FP16(rgb, (rgb32 >> 16) & 0xff,
-					       (rgb32 >> 8) & 0xff, rgb32 & 0xff,
-					       alpha);
-
-			((uint64_t *)mem)[x] = color;
+		x = 0;
+		if (y > 0 && y != height / 2 && width > 0) {
+			memcpy(mem, mem - stride + 8, (width - 1) * 8);
+			x = width - 1;
+			/* the pixel shifted in from the opaque half */
+			if (y < height / 2 && width / 2 > 0)
+				((uint64_t *)mem)[width / 2 - 1] =
+					tiles_rgba16fp(rgb, width / 2 - 1, y,
+						       width, height);
 		}
+
+		for (; x < width; ++x)
+			((uint64_t *)mem)[x] =
+				tiles_rgba16fp(rgb, x, y, width, height);
 		mem += stride;
 	}
 }
@@ -1017,11 +1129,18 @@ static void fill_tiles(const struct util_format_info *info, void *planes[3],
 	case DRM_FORMAT_VYUY:
 	case DRM_FORMAT_YUYV:
 	case DRM_FORMAT_YVYU:
+		if (!fill_tiles_convert(info->format, planes, width, height,
+					stride))
+			return;
 		return fill_tiles_yuv_packed(info, planes[0],
 					     width, height, stride);
 
 	case DRM_FORMAT_NV12:
 	case DRM_FORMAT_NV21:
+		if (!fill_tiles_convert(info->format, planes, width, height,
+					stride))
+			return;
+		/* fall through */
 	case DRM_FORMAT_NV16:
 	case DRM_FORMAT_NV61:
 		u = info->yuv.order & YUV_YCbCr ? planes[1] : planes[1] + 1;
@@ -28,10 +28,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
 #include <poll.h>
+#include <time.h>
 #include <sys/time.h>
 #ifdef HAVE_SYS_SELECT_H
 #include <sys/select.h>
@@ -45,7 +47,7 @@
 
 extern char *optarg;
 extern int optind, opterr, optopt;
-static char optstr[] = "D:M:s";
+static char optstr[] = "D:l:M:s";
 
 int secondary = 0;
 
@@ -82,12 +84,223 @@ static void vblank_handler(int fd, unsigned int frame, unsigned int sec,
 	}
 }
 
+/*
+ * Delivery latency measurement: how long after the kernel timestamped a
+ * vblank does userspace actually get to see it, for each of the ways of
+ * waiting for one.
+ */
+struct latency_info {
+	const char *name;
+	unsigned int count, max_count;
+	uint64_t *samples;
+	int done;
+};
+
+static uint64_t monotonic_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+static void latency_add(struct latency_info *info, uint64_t stamp)
+{
+	uint64_t now = monotonic_us();
+
+	info->samples[info->count++] = now > stamp ? now - stamp : 0;
+	if (info->count == info->max_count)
+		info->done = 1;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static void latency_report(struct latency_info *info)
+{
+	static const unsigned int pct[] = { 50, 90, 99, 999 };
+	unsigned int bins[16] = { 0 };
+	unsigned int i, j, peak = 0;
+	uint64_t sum = 0;
+
+	if (!info->count)
+		return;
+
+	qsort(info->samples, info->count, sizeof(*info->samples), compare_u64);
+
+	for (i = 0; i < info->count; i++) {
+		uint64_t v = info->samples[i];
+
+		sum += v;
+		for (j = 0; v > 1 && j < 15; j++)
+			v >>= 1;
+		if (++bins[j] > peak)
+			peak = bins[j];
+	}
+
+	printf("%s: %u events, min %" PRIu64 "us avg %" PRIu64 "us",
+	       info->name, info->count, info->samples[0], sum / info->count);
+	for (i = 0; i < sizeof(pct) / sizeof(pct[0]); i++) {
+		unsigned int scale = pct[i] > 100 ? 1000 : 100;
+		unsigned int idx = (uint64_t)info->count * pct[i] / scale;
+
+		if (idx >= info->count)
+			idx = info->count - 1;
+		printf(" p%g %" PRIu64 "us", pct[i] * 100.0 / scale,
+		       info->samples[idx]);
+	}
+	printf(" max %" PRIu64 "us\n", info->samples[info->count - 1]);
+
+	for (j = 0; j < 16; j++) {
+		if (!bins[j])
+			continue;
+		printf("  <%6uus %6u %.*s\n", 2u << j, bins[j],
+		       (int)(bins[j] * 50 / peak),
+		       "##################################################");
+	}
+}
+
+static void latency_vblank_handler(int fd, unsigned int frame,
+				   unsigned int sec, unsigned int usec,
+				   void *data)
+{
+	struct latency_info *info = data;
+	drmVBlank vbl;
+
+	latency_add(info, sec * 1000000ull + usec);
+	if (info->done)
+		return;
+
+	vbl.request.type = DRM_VBLANK_RELATIVE | DRM_VBLANK_EVENT;
+	if (secondary)
+		vbl.request.type |= DRM_VBLANK_SECONDARY;
+	vbl.request.sequence = 1;
+	vbl.request.signal = (unsigned long)data;
+	if (drmWaitVBlank(fd, &vbl))
+		info->done = 1;
+}
+
+static uint32_t latency_crtc_id;
+
+static void latency_sequence_handler(int fd, uint64_t sequence, uint64_t ns,
+				     uint64_t user_data)
+{
+	struct latency_info *info = (struct latency_info *)(uintptr_t)user_data;
+
+	latency_add(info, ns / 1000);
+	if (info->done)
+		return;
+
+	if (drmCrtcQueueSequence(fd, latency_crtc_id,
+				 DRM_CRTC_SEQUENCE_RELATIVE, 1, NULL,
+				 user_data))
+		info->done = 1;
+}
+
+static int latency_run_events(int fd, struct latency_info *info)
+{
+	drmEventContext evctx;
+
+	memset(&evctx, 0, sizeof evctx);
+	evctx.version = DRM_EVENT_CONTEXT_VERSION;
+	evctx.vblank_handler = latency_vblank_handler;
+	evctx.sequence_handler = latency_sequence_handler;
+
+	while (!info->done) {
+		struct pollfd pfd = { .fd = fd, .events = POLLIN };
+
+		if (poll(&pfd, 1, 3000) <= 0) {
+			fprintf(stderr, "%s: timed out waiting for events\n",
+				info->name);
+			return -1;
+		}
+
+		if (drmHandleEvent(fd, &evctx))
+			return -1;
+	}
+
+	return 0;
+}
+
+static int latency_test(int fd, unsigned int count)
+{
+	struct latency_info info[3] = {
+		{ .name = "blocking drmWaitVBlank" },
+		{ .name = "DRM_VBLANK_EVENT" },
+		{ .name = "drmCrtcQueueSequence" },
+	};
+	drmModeResPtr res;
+	drmVBlank vbl;
+	uint64_t cap = 0;
+	unsigned int i;
+	int ret;
+
+	if (drmGetCap(fd, DRM_CAP_TIMESTAMP_MONOTONIC, &cap) || !cap)
+		fprintf(stderr, "warning: vblank timestamps aren't monotonic\n");
+
+	for (i = 0; i < 3; i++) {
+		info[i].max_count = count;
+		info[i].samples = calloc(count, sizeof(*info[i].samples));
+		if (!info[i].samples)
+			return -1;
+	}
+
+	/* blocking waits, the reply carries the vblank timestamp */
+	while (!info[0].done) {
+		vbl.request.type = DRM_VBLANK_RELATIVE;
+		if (secondary)
+			vbl.request.type |= DRM_VBLANK_SECONDARY;
+		vbl.request.sequence = 1;
+		ret = drmWaitVBlank(fd, &vbl);
+		if (ret) {
+			fprintf(stderr, "drmWaitVBlank failed: %i\n", ret);
+			break;
+		}
+		latency_add(&info[0], vbl.reply.tval_sec * 1000000ull +
+			    vbl.reply.tval_usec);
+	}
+
+	/* vblank events delivered through drmHandleEvent */
+	vbl.request.type = DRM_VBLANK_RELATIVE | DRM_VBLANK_EVENT;
+	if (secondary)
+		vbl.request.type |= DRM_VBLANK_SECONDARY;
+	vbl.request.sequence = 1;
+	vbl.request.signal = (unsigned long)&info[1];
+	if (drmWaitVBlank(fd, &vbl) == 0)
+		latency_run_events(fd, &info[1]);
+
+	/* CRTC sequence events, which carry a nanosecond timestamp */
+	res = drmModeGetResources(fd);
+	if (res && res->count_crtcs > secondary) {
+		latency_crtc_id = res->crtcs[secondary];
+		if (drmCrtcQueueSequence(fd, latency_crtc_id,
+					 DRM_CRTC_SEQUENCE_RELATIVE, 1, NULL,
+					 (uintptr_t)&info[2]) == 0)
+			latency_run_events(fd, &info[2]);
+		else
+			fprintf(stderr, "drmCrtcQueueSequence not supported\n");
+	}
+	drmModeFreeResources(res);
+
+	for (i = 0; i < 3; i++) {
+		latency_report(&info[i]);
+		free(info[i].samples);
+	}
+
+	return 0;
+}
+
 static void usage(char *name)
 {
-	fprintf(stderr, "usage: %s [-DMs]\n", name);
+	fprintf(stderr, "usage: %s [-DlMs]\n", name);
 	fprintf(stderr, "\n");
 	fprintf(stderr, "options:\n");
 	fprintf(stderr, "  -D DEVICE  open the given device\n");
+	fprintf(stderr, "  -l COUNT   measure vblank delivery latency over COUNT events\n");
 	fprintf(stderr, "  -M MODULE  open the given module\n");
 	fprintf(stderr, "  -s         use secondary pipe\n");
 	exit(0);
@@ -100,6 +313,7 @@ int main(int argc, char **argv)
 	drmVBlank vbl;
 	drmEventContext evctx;
 	struct vbl_info handler_info;
+	unsigned int latency_count = 0;
 
 	opterr = 0;
 	while ((c = getopt(argc, argv, optstr)) != -1) {
@@ -107,6 +321,9 @@ int main(int argc, char **argv)
 		case 'D':
 			device = optarg;
 			break;
+		case 'l':
+			latency_count = strtoul(optarg, NULL, 0);
+			break;
 		case 'M':
 			module = optarg;
 			break;
@@ -123,6 +340,9 @@ int main(int argc, char **argv)
 	if (fd < 0)
 		return 1;
 
+	if (latency_count)
+		return latency_test(fd, latency_count) ? 1 : 0;
+
 	/* Get current count first */
 	vbl.request.type = DRM_VBLANK_RELATIVE;
 	if (secondary)
@@ -0,0 +1,459 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <sys/mman.h>
+
+#include "vc4_priv.h"
+
+/*
+ * bo cache: bo's from vc4_bo_new() are CMA allocations, which are slow to
+ * allocate and a scarce resource, so deleted ones are kept in size
+ * buckets for a second or so and handed out again once idle.  With
+ * madvise support the kernel may reclaim their pages while cached.
+ */
+
+static void add_bucket(struct vc4_bo_cache *cache, uint32_t size)
+{
+	struct vc4_bo_bucket *bucket = &cache->buckets[cache->num_buckets++];
+
+	bucket->size = size;
+	list_inithead(&bucket->list);
+}
+
+drm_private void vc4_bo_cache_init(struct vc4_bo_cache *cache)
+{
+	uint32_t size;
+
+	add_bucket(cache, 4096);
+	add_bucket(cache, 4096 * 2);
+	add_bucket(cache, 4096 * 3);
+
+	for (size = 4 * 4096; size <= 64 * 1024 * 1024; size *= 2) {
+		add_bucket(cache, size);
+		add_bucket(cache, size + size * 1 / 4);
+		add_bucket(cache, size + size * 2 / 4);
+		add_bucket(cache, size + size * 3 / 4);
+	}
+}
+
+static struct vc4_bo_bucket * get_bucket(struct vc4_bo_cache *cache,
+		uint32_t size)
+{
+	unsigned i;
+
+	for (i = 0; i < cache->num_buckets; i++)
+		if (cache->buckets[i].size >= size)
+			return &cache->buckets[i];
+
+	return NULL;
+}
+
+static int bo_madvise(struct vc4_bo *bo, uint32_t madv)
+{
+	struct drm_vc4_gem_madvise req = {
+			.handle = bo->handle,
+			.madv = madv,
+	};
+
+	if (drmIoctl(bo->dev->fd, DRM_IOCTL_VC4_GEM_MADVISE, &req))
+		return -errno;
+
+	return req.retained;
+}
+
+/* called with table_lock held */
+static void bo_free(struct vc4_bo *bo)
+{
+	struct vc4_device *dev = bo->dev;
+	struct drm_gem_close req = {
+			.handle = bo->handle,
+	};
+
+	if (bo->map)
+		drm_munmap(bo->map, bo->size);
+
+	drmHashDelete(dev->handle_table, bo->handle);
+	if (bo->name)
+		drmHashDelete(dev->name_table, bo->name);
+
+	drmPrimeCacheForget(dev->fd, bo->handle);
+	drmIoctl(dev->fd, DRM_IOCTL_GEM_CLOSE, &req);
+
+	free(bo);
+}
+
+/* frees bo's cached for more than a second, or all of them if time is 0,
+ * called with table_lock held
+ */
+drm_private void vc4_bo_cache_cleanup(struct vc4_device *dev, time_t time)
+{
+	struct vc4_bo_cache *cache = &dev->bo_cache;
+	unsigned i;
+
+	if (time && cache->time == time)
+		return;
+
+	for (i = 0; i < cache->num_buckets; i++) {
+		struct vc4_bo_bucket *bucket = &cache->buckets[i];
+
+		while (!LIST_IS_EMPTY(&bucket->list)) {
+			struct vc4_bo *bo = LIST_FIRST_ENTRY(&bucket->list,
+					struct vc4_bo, list);
+
+			if (time && (time - bo->free_time) <= 1)
+				break;
+
+			list_del(&bo->list);
+			bo_free(bo);
+		}
+	}
+
+	cache->time = time;
+}
+
+/* called with table_lock held, size is rounded up to the bucket size */
+static struct vc4_bo * bo_cache_alloc(struct vc4_device *dev, uint32_t *size)
+{
+	struct vc4_bo_bucket *bucket;
+	struct vc4_bo *bo, *tmp;
+
+	bucket = get_bucket(&dev->bo_cache, *size);
+	if (!bucket)
+		return NULL;
+
+	*size = bucket->size;
+
+retry:
+	/* the oldest bo's are the most likely to be idle: */
+	LIST_FOR_EACH_ENTRY_SAFE(bo, tmp, &bucket->list, list) {
+		if (!vc4_seqno_passed(dev, bo->seqno))
+			break;
+
+		list_del(&bo->list);
+
+		if (bo->dontneed && bo_madvise(bo, VC4_MADV_WILLNEED) <= 0) {
+			/* the pages are gone, try the next one: */
+			bo_free(bo);
+			goto retry;
+		}
+
+		bo->dontneed = 0;
+		atomic_set(&bo->refcnt, 1);
+		vc4_device_ref(dev);
+		drmHashInsert(dev->handle_table, bo->handle, bo);
+		return bo;
+	}
+
+	return NULL;
+}
+
+/* called with table_lock held, returns 0 if the cache took the bo */
+static int bo_cache_free(struct vc4_bo *bo)
+{
+	struct vc4_device *dev = bo->dev;
+	struct vc4_bo_bucket *bucket;
+	struct timespec time;
+
+	if (!bo->reuse || bo->shared)
+		return -1;
+
+	bucket = get_bucket(&dev->bo_cache, bo->size);
+	if (!bucket || bucket->size != bo->size)
+		return -1;
+
+	if (dev->has_madvise && bo_madvise(bo, VC4_MADV_DONTNEED) >= 0)
+		bo->dontneed = 1;
+
+	/* nobody can look it up while it is cached: */
+	drmHashDelete(dev->handle_table, bo->handle);
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	bo->free_time = time.tv_sec;
+	list_addtail(&bo->list, &bucket->list);
+	vc4_bo_cache_cleanup(dev, time.tv_sec);
+
+	return 0;
+}
+
+/* called with table_lock held */
+static struct vc4_bo * lookup_bo(void *table, uint32_t key)
+{
+	void *bo;
+
+	if (drmHashLookup(table, key, &bo))
+		return NULL;
+
+	return vc4_bo_ref(bo);
+}
+
+/* called with table_lock held */
+static struct vc4_bo * bo_from_handle(struct vc4_device *dev,
+		uint32_t size, uint32_t handle)
+{
+	struct vc4_bo *bo = calloc(sizeof(*bo), 1);
+
+	if (!bo) {
+		struct drm_gem_close req = {
+				.handle = handle,
+		};
+
+		drmPrimeCacheForget(dev->fd, handle);
+		drmIoctl(dev->fd, DRM_IOCTL_GEM_CLOSE, &req);
+		return NULL;
+	}
+
+	bo->dev = vc4_device_ref(dev);
+	bo->size = size;
+	bo->handle = handle;
+	atomic_set(&bo->refcnt, 1);
+	list_inithead(&bo->list);
+
+	drmHashInsert(dev->handle_table, handle, bo);
+
+	return bo;
+}
+
+drm_public struct vc4_bo * vc4_bo_new(struct vc4_device *dev, uint32_t size)
+{
+	struct drm_vc4_create_bo req = { 0 };
+	struct vc4_bo *bo;
+
+	if (!size)
+		return NULL;
+
+	size = (size + 4095) & ~4095;
+
+	pthread_mutex_lock(&dev->table_lock);
+	bo = bo_cache_alloc(dev, &size);
+	pthread_mutex_unlock(&dev->table_lock);
+
+	if (bo)
+		return bo;
+
+	req.size = size;
+	if (drmIoctl(dev->fd, DRM_IOCTL_VC4_CREATE_BO, &req))
+		return NULL;
+
+	pthread_mutex_lock(&dev->table_lock);
+	bo = bo_from_handle(dev, size, req.handle);
+	if (bo)
+		bo->reuse = 1;
+	pthread_mutex_unlock(&dev->table_lock);
+
+	return bo;
+}
+
+/* shader bo's are validated and read-only, so never cached */
+drm_public struct vc4_bo * vc4_bo_new_shader(struct vc4_device *dev,
+		const void *data, uint32_t size)
+{
+	struct drm_vc4_create_shader_bo req = {
+			.size = size,
+			.data = (uintptr_t)data,
+	};
+	struct vc4_bo *bo;
+
+	if (drmIoctl(dev->fd, DRM_IOCTL_VC4_CREATE_SHADER_BO, &req))
+		return NULL;
+
+	pthread_mutex_lock(&dev->table_lock);
+	bo = bo_from_handle(dev, size, req.handle);
+	pthread_mutex_unlock(&dev->table_lock);
+
+	return bo;
+}
+
+drm_public struct vc4_bo * vc4_bo_from_name(struct vc4_device *dev,
+		uint32_t name)
+{
+	struct drm_gem_open req = {
+			.name = name,
+	};
+	struct vc4_bo *bo;
+
+	pthread_mutex_lock(&dev->table_lock);
+
+	bo = lookup_bo(dev->name_table, name);
+	if (bo)
+		goto out_unlock;
+
+	if (drmIoctl(dev->fd, DRM_IOCTL_GEM_OPEN, &req))
+		goto out_unlock;
+
+	bo = lookup_bo(dev->handle_table, req.handle);
+	if (bo)
+		goto out_unlock;
+
+	bo = bo_from_handle(dev, req.size, req.handle);
+	if (bo) {
+		bo->name = name;
+		bo->shared = 1;
+		drmHashInsert(dev->name_table, name, bo);
+	}
+
+out_unlock:
+	pthread_mutex_unlock(&dev->table_lock);
+
+	return bo;
+}
+
+drm_public struct vc4_bo * vc4_bo_from_dmabuf(struct vc4_device *dev, int fd)
+{
+	struct vc4_bo *bo;
+	uint32_t handle;
+	uint64_t size;
+
+	pthread_mutex_lock(&dev->table_lock);
+
+	if (drmPrimeFDToHandleCached(dev->fd, fd, &handle, &size)) {
+		pthread_mutex_unlock(&dev->table_lock);
+		return NULL;
+	}
+
+	bo = lookup_bo(dev->handle_table, handle);
+	if (bo)
+		goto out_unlock;
+
+	bo = bo_from_handle(dev, size, handle);
+	if (bo)
+		bo->shared = 1;
+
+out_unlock:
+	pthread_mutex_unlock(&dev->table_lock);
+
+	return bo;
+}
+
+drm_public struct vc4_bo * vc4_bo_ref(struct vc4_bo *bo)
+{
+	atomic_inc(&bo->refcnt);
+
+	return bo;
+}
+
+drm_public void vc4_bo_del(struct vc4_bo *bo)
+{
+	struct vc4_device *dev;
+
+	if (!bo)
+		return;
+
+	if (!atomic_dec_and_test(&bo->refcnt))
+		return;
+
+	dev = bo->dev;
+
+	pthread_mutex_lock(&dev->table_lock);
+	if (bo_cache_free(bo))
+		bo_free(bo);
+	pthread_mutex_unlock(&dev->table_lock);
+
+	vc4_device_del(dev);
+}
+
+drm_public int vc4_bo_get_name(struct vc4_bo *bo, uint32_t *name)
+{
+	if (!bo->name) {
+		struct drm_gem_flink req = {
+				.handle = bo->handle,
+		};
+
+		if (drmIoctl(bo->dev->fd, DRM_IOCTL_GEM_FLINK, &req))
+			return -errno;
+
+		pthread_mutex_lock(&bo->dev->table_lock);
+		bo->name = req.name;
+		bo->shared = 1;
+		drmHashInsert(bo->dev->name_table, req.name, bo);
+		pthread_mutex_unlock(&bo->dev->table_lock);
+	}
+
+	*name = bo->name;
+
+	return 0;
+}
+
+drm_public int vc4_bo_dmabuf(struct vc4_bo *bo)
+{
+	int ret, prime_fd;
+
+	ret = drmPrimeHandleToFD(bo->dev->fd, bo->handle, DRM_CLOEXEC,
+			&prime_fd);
+	if (ret)
+		return ret;
+
+	bo->shared = 1;
+
+	return prime_fd;
+}
+
+drm_public uint32_t vc4_bo_handle(struct vc4_bo *bo)
+{
+	return bo->handle;
+}
+
+drm_public uint32_t vc4_bo_size(struct vc4_bo *bo)
+{
+	return bo->size;
+}
+
+/* the mapping is kept for the lifetime of the bo, including while it is
+ * in the cache
+ */
+drm_public void * vc4_bo_map(struct vc4_bo *bo)
+{
+	if (!bo->map) {
+		struct drm_vc4_mmap_bo req = {
+				.handle = bo->handle,
+		};
+		void *map;
+
+		if (drmIoctl(bo->dev->fd, DRM_IOCTL_VC4_MMAP_BO, &req))
+			return NULL;
+
+		map = drm_mmap(0, bo->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+				bo->dev->fd, req.offset);
+		if (map == MAP_FAILED)
+			return NULL;
+
+		bo->map = map;
+	}
+
+	return bo->map;
+}
+
+/* waits for jobs using the bo, timeout_ns of 0 polls */
+drm_public int vc4_bo_wait(struct vc4_bo *bo, uint64_t timeout_ns)
+{
+	struct drm_vc4_wait_bo req = {
+			.handle = bo->handle,
+			.timeout_ns = timeout_ns,
+	};
+
+	/* others may use shared bo's, ask the kernel: */
+	if (bo->shared || !bo->seqno) {
+		if (drmIoctl(bo->dev->fd, DRM_IOCTL_VC4_WAIT_BO, &req))
+			return -errno;
+		return 0;
+	}
+
+	return vc4_device_wait_seqno(bo->dev, bo->seqno, timeout_ns);
+}
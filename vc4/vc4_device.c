@@ -0,0 +1,141 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "vc4_priv.h"
+
+drm_public struct vc4_device * vc4_device_new(int fd)
+{
+	struct vc4_device *dev;
+	uint64_t value = 0;
+
+	dev = calloc(sizeof(*dev), 1);
+	if (!dev)
+		return NULL;
+
+	dev->fd = fd;
+	atomic_set(&dev->refcnt, 1);
+	pthread_mutex_init(&dev->table_lock, NULL);
+	dev->handle_table = drmHashCreate();
+	dev->name_table = drmHashCreate();
+	vc4_bo_cache_init(&dev->bo_cache);
+
+	if (!vc4_device_get_param(dev, DRM_VC4_PARAM_SUPPORTS_MADVISE, &value))
+		dev->has_madvise = !!value;
+
+	return dev;
+}
+
+drm_public struct vc4_device * vc4_device_ref(struct vc4_device *dev)
+{
+	atomic_inc(&dev->refcnt);
+
+	return dev;
+}
+
+drm_public void vc4_device_del(struct vc4_device *dev)
+{
+	if (!atomic_dec_and_test(&dev->refcnt))
+		return;
+
+	pthread_mutex_lock(&dev->table_lock);
+	vc4_bo_cache_cleanup(dev, 0);
+	pthread_mutex_unlock(&dev->table_lock);
+
+	drmHashDestroy(dev->handle_table);
+	drmHashDestroy(dev->name_table);
+	pthread_mutex_destroy(&dev->table_lock);
+	free(dev);
+}
+
+drm_public int vc4_device_fd(struct vc4_device *dev)
+{
+	return dev->fd;
+}
+
+drm_public int vc4_device_get_param(struct vc4_device *dev, uint32_t param,
+		uint64_t *value)
+{
+	struct drm_vc4_get_param req = {
+			.param = param,
+	};
+	int ret;
+
+	ret = drmIoctl(dev->fd, DRM_IOCTL_VC4_GET_PARAM, &req);
+	if (ret)
+		return -errno;
+
+	*value = req.value;
+
+	return 0;
+}
+
+static int wait_seqno(struct vc4_device *dev, uint64_t seqno,
+		uint64_t timeout_ns)
+{
+	struct drm_vc4_wait_seqno req = {
+			.seqno = seqno,
+			.timeout_ns = timeout_ns,
+	};
+
+	if (drmIoctl(dev->fd, DRM_IOCTL_VC4_WAIT_SEQNO, &req))
+		return -errno;
+
+	return 0;
+}
+
+/* non-blocking check, call with table_lock held */
+drm_private int vc4_seqno_passed(struct vc4_device *dev, uint64_t seqno)
+{
+	if (seqno <= dev->finished_seqno)
+		return 1;
+
+	if (wait_seqno(dev, seqno, 0))
+		return 0;
+
+	dev->finished_seqno = seqno;
+
+	return 1;
+}
+
+drm_public int vc4_device_wait_seqno(struct vc4_device *dev, uint64_t seqno,
+		uint64_t timeout_ns)
+{
+	int ret, passed;
+
+	/* seqnos are 64 bit, don't go to the kernel for ones seen passing: */
+	pthread_mutex_lock(&dev->table_lock);
+	passed = seqno <= dev->finished_seqno;
+	pthread_mutex_unlock(&dev->table_lock);
+
+	if (passed)
+		return 0;
+
+	ret = wait_seqno(dev, seqno, timeout_ns);
+	if (ret)
+		return ret;
+
+	pthread_mutex_lock(&dev->table_lock);
+	if (seqno > dev->finished_seqno)
+		dev->finished_seqno = seqno;
+	pthread_mutex_unlock(&dev->table_lock);
+
+	return 0;
+}
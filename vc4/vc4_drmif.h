@@ -0,0 +1,159 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef VC4_DRMIF_H_
+#define VC4_DRMIF_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vc4_drm.h>
+
+#include "vc4_packet.h"
+
+struct vc4_device;
+struct vc4_bo;
+struct vc4_job;
+struct vc4_stream;
+
+/* device functions:
+ */
+
+struct vc4_device * vc4_device_new(int fd);
+struct vc4_device * vc4_device_ref(struct vc4_device *dev);
+void vc4_device_del(struct vc4_device *dev);
+int vc4_device_fd(struct vc4_device *dev);
+int vc4_device_get_param(struct vc4_device *dev, uint32_t param,
+		uint64_t *value);
+/* timeout_ns of 0 polls, returns -ETIME if the seqno hasn't passed */
+int vc4_device_wait_seqno(struct vc4_device *dev, uint64_t seqno,
+		uint64_t timeout_ns);
+
+/* buffer-object functions:
+ */
+
+struct vc4_bo * vc4_bo_new(struct vc4_device *dev, uint32_t size);
+struct vc4_bo * vc4_bo_new_shader(struct vc4_device *dev, const void *data,
+		uint32_t size);
+struct vc4_bo * vc4_bo_from_name(struct vc4_device *dev, uint32_t name);
+struct vc4_bo * vc4_bo_from_dmabuf(struct vc4_device *dev, int fd);
+struct vc4_bo * vc4_bo_ref(struct vc4_bo *bo);
+void vc4_bo_del(struct vc4_bo *bo);
+int vc4_bo_get_name(struct vc4_bo *bo, uint32_t *name);
+int vc4_bo_dmabuf(struct vc4_bo *bo);
+uint32_t vc4_bo_handle(struct vc4_bo *bo);
+uint32_t vc4_bo_size(struct vc4_bo *bo);
+void * vc4_bo_map(struct vc4_bo *bo);
+int vc4_bo_wait(struct vc4_bo *bo, uint64_t timeout_ns);
+
+/* control lists:
+ *
+ * A job has three growable streams: the binner control list, the shader
+ * records and the uniforms.  Reserve space with vc4_cl_ensure_space()
+ * before emitting into a stream.  bo's are referenced through indices
+ * into the job's bo handle list:
+ *
+ *  - in the binner CL, vc4_cl_start_reloc() emits a GEM_HANDLES packet
+ *    whose slots the following vc4_cl_reloc() calls fill in,
+ *  - in shader records, vc4_cl_start_shader_reloc() reserves the slots
+ *    at the start of the record, filled the same way,
+ *  - in uniforms, vc4_cl_aligned_reloc() emits the index followed by
+ *    the offset.
+ */
+
+struct vc4_cl {
+	uint8_t *base;
+	uint8_t *next;
+	uint8_t *end;
+	uint8_t *reloc_next;	/* next handle index slot to fill in */
+	uint32_t reloc_count;	/* handle index slots left */
+};
+
+int vc4_cl_ensure_space(struct vc4_cl *cl, uint32_t size);
+
+static inline uint32_t vc4_cl_offset(struct vc4_cl *cl)
+{
+	return cl->next - cl->base;
+}
+
+static inline void vc4_cl_u8(struct vc4_cl *cl, uint8_t n)
+{
+	*cl->next++ = n;
+}
+
+static inline void vc4_cl_u16(struct vc4_cl *cl, uint16_t n)
+{
+	memcpy(cl->next, &n, sizeof(n));
+	cl->next += sizeof(n);
+}
+
+static inline void vc4_cl_u32(struct vc4_cl *cl, uint32_t n)
+{
+	memcpy(cl->next, &n, sizeof(n));
+	cl->next += sizeof(n);
+}
+
+static inline void vc4_cl_f(struct vc4_cl *cl, float f)
+{
+	memcpy(cl->next, &f, sizeof(f));
+	cl->next += sizeof(f);
+}
+
+void vc4_cl_start_reloc(struct vc4_cl *cl, uint32_t n);
+void vc4_cl_start_shader_reloc(struct vc4_cl *cl, uint32_t n);
+int vc4_cl_reloc(struct vc4_job *job, struct vc4_cl *cl, struct vc4_bo *bo,
+		uint32_t offset);
+int vc4_cl_aligned_reloc(struct vc4_job *job, struct vc4_cl *cl,
+		struct vc4_bo *bo, uint32_t offset);
+
+/* job functions:
+ */
+
+struct vc4_job * vc4_job_new(struct vc4_device *dev);
+void vc4_job_del(struct vc4_job *job);
+struct vc4_cl * vc4_job_bcl(struct vc4_job *job);
+struct vc4_cl * vc4_job_shader_rec(struct vc4_job *job);
+struct vc4_cl * vc4_job_uniforms(struct vc4_job *job);
+/* index of bo in the job's handle list, adding it if needed */
+int vc4_job_hindex(struct vc4_job *job, struct vc4_bo *bo);
+/* submit the job, the render setup (size, tiles, surfaces, clear values,
+ * flags, shader_rec_count) is taken from args, the streams and bo handles
+ * are filled in.  The job is empty again afterwards.
+ */
+int vc4_job_submit(struct vc4_job *job, struct drm_vc4_submit_cl *args,
+		uint64_t *seqno);
+void vc4_job_reset(struct vc4_job *job);
+
+/* streaming arena functions:
+ *
+ * Shader records and uniforms are copied by the kernel, they live in the
+ * job's streams.  Arenas are for the data draws reference by bo, like
+ * vertex buffers.
+ */
+
+struct vc4_stream * vc4_stream_new(struct vc4_device *dev,
+		uint32_t bo_size, uint32_t max_bos);
+void vc4_stream_del(struct vc4_stream *stream);
+void * vc4_stream_alloc(struct vc4_stream *stream, uint32_t size,
+		uint32_t align, struct vc4_bo **bo, uint32_t *offset);
+void vc4_stream_submitted(struct vc4_stream *stream, uint64_t seqno);
+
+#endif /* VC4_DRMIF_H_ */
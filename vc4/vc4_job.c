@@ -0,0 +1,257 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <assert.h>
+
+#include "vc4_priv.h"
+
+drm_public int vc4_cl_ensure_space(struct vc4_cl *cl, uint32_t size)
+{
+	uint32_t used, cap, reloc;
+	uint8_t *base;
+
+	if (cl->next + size <= cl->end)
+		return 0;
+
+	used = cl->next - cl->base;
+	reloc = cl->reloc_next ? cl->reloc_next - cl->base : 0;
+
+	cap = cl->end - cl->base;
+	cap = cap ? cap * 2 : 4096;
+	while (cap < used + size)
+		cap *= 2;
+
+	base = realloc(cl->base, cap);
+	if (!base)
+		return -ENOMEM;
+
+	if (cl->reloc_next)
+		cl->reloc_next = base + reloc;
+	cl->base = base;
+	cl->next = base + used;
+	cl->end = base + cap;
+
+	return 0;
+}
+
+static void cl_reset(struct vc4_cl *cl)
+{
+	cl->next = cl->base;
+	cl->reloc_next = NULL;
+	cl->reloc_count = 0;
+}
+
+/* emits a GEM_HANDLES packet for the n (at most 2) relocations of the
+ * next packet, space for it has to be reserved
+ */
+drm_public void vc4_cl_start_reloc(struct vc4_cl *cl, uint32_t n)
+{
+	assert(n == 1 || n == 2);
+
+	vc4_cl_u8(cl, VC4_PACKET_GEM_HANDLES);
+	cl->reloc_next = cl->next;
+	cl->reloc_count = n;
+	vc4_cl_u32(cl, 0);
+	vc4_cl_u32(cl, 0);
+}
+
+/* reserves the handle index slots at the start of a shader record */
+drm_public void vc4_cl_start_shader_reloc(struct vc4_cl *cl, uint32_t n)
+{
+	cl->reloc_next = cl->next;
+	cl->reloc_count = n;
+	memset(cl->next, 0, n * 4);
+	cl->next += n * 4;
+}
+
+drm_public int vc4_cl_reloc(struct vc4_job *job, struct vc4_cl *cl,
+		struct vc4_bo *bo, uint32_t offset)
+{
+	uint32_t index;
+	int ret;
+
+	if (!cl->reloc_count)
+		return -EINVAL;
+
+	ret = vc4_job_hindex(job, bo);
+	if (ret < 0)
+		return ret;
+
+	index = ret;
+	memcpy(cl->reloc_next, &index, sizeof(index));
+	cl->reloc_next += sizeof(index);
+	cl->reloc_count--;
+
+	vc4_cl_u32(cl, offset);
+
+	return 0;
+}
+
+drm_public int vc4_cl_aligned_reloc(struct vc4_job *job, struct vc4_cl *cl,
+		struct vc4_bo *bo, uint32_t offset)
+{
+	int ret;
+
+	ret = vc4_job_hindex(job, bo);
+	if (ret < 0)
+		return ret;
+
+	vc4_cl_u32(cl, ret);
+	vc4_cl_u32(cl, offset);
+
+	return 0;
+}
+
+drm_public struct vc4_job * vc4_job_new(struct vc4_device *dev)
+{
+	struct vc4_job *job;
+
+	job = calloc(sizeof(*job), 1);
+	if (!job)
+		return NULL;
+
+	job->dev = vc4_device_ref(dev);
+
+	return job;
+}
+
+drm_public void vc4_job_reset(struct vc4_job *job)
+{
+	uint32_t i;
+
+	for (i = 0; i < job->nr_bos; i++) {
+		job->bos[i]->current_job = NULL;
+		vc4_bo_del(job->bos[i]);
+	}
+	job->nr_bos = 0;
+
+	/* keep the storage of the streams for the next job: */
+	cl_reset(&job->bcl);
+	cl_reset(&job->shader_rec);
+	cl_reset(&job->uniforms);
+}
+
+drm_public void vc4_job_del(struct vc4_job *job)
+{
+	if (!job)
+		return;
+
+	vc4_job_reset(job);
+
+	free(job->bcl.base);
+	free(job->shader_rec.base);
+	free(job->uniforms.base);
+	free(job->bos);
+	free(job->handles);
+
+	vc4_device_del(job->dev);
+	free(job);
+}
+
+drm_public struct vc4_cl * vc4_job_bcl(struct vc4_job *job)
+{
+	return &job->bcl;
+}
+
+drm_public struct vc4_cl * vc4_job_shader_rec(struct vc4_job *job)
+{
+	return &job->shader_rec;
+}
+
+drm_public struct vc4_cl * vc4_job_uniforms(struct vc4_job *job)
+{
+	return &job->uniforms;
+}
+
+drm_public int vc4_job_hindex(struct vc4_job *job, struct vc4_bo *bo)
+{
+	uint32_t i;
+
+	/* fast path, the bo was last added to this job: */
+	if (bo->current_job == job && bo->hindex < job->nr_bos &&
+			job->bos[bo->hindex] == bo)
+		return bo->hindex;
+
+	for (i = 0; i < job->nr_bos; i++)
+		if (job->bos[i] == bo)
+			goto found;
+
+	if (job->nr_bos == job->max_bos) {
+		uint32_t max = job->max_bos ? job->max_bos * 2 : 16;
+		struct vc4_bo **bos;
+		uint32_t *handles;
+
+		bos = realloc(job->bos, max * sizeof(*bos));
+		if (!bos)
+			return -ENOMEM;
+		job->bos = bos;
+
+		handles = realloc(job->handles, max * sizeof(*handles));
+		if (!handles)
+			return -ENOMEM;
+		job->handles = handles;
+
+		job->max_bos = max;
+	}
+
+	i = job->nr_bos++;
+	job->bos[i] = vc4_bo_ref(bo);
+	job->handles[i] = bo->handle;
+
+found:
+	bo->current_job = job;
+	bo->hindex = i;
+
+	return i;
+}
+
+drm_public int vc4_job_submit(struct vc4_job *job,
+		struct drm_vc4_submit_cl *args, uint64_t *seqno)
+{
+	uint32_t i;
+	int ret = 0;
+
+	args->bin_cl = (uintptr_t)job->bcl.base;
+	args->bin_cl_size = vc4_cl_offset(&job->bcl);
+	args->shader_rec = (uintptr_t)job->shader_rec.base;
+	args->shader_rec_size = vc4_cl_offset(&job->shader_rec);
+	args->uniforms = (uintptr_t)job->uniforms.base;
+	args->uniforms_size = vc4_cl_offset(&job->uniforms);
+	args->bo_handles = (uintptr_t)job->handles;
+	args->bo_handle_count = job->nr_bos;
+
+	if (drmIoctl(job->dev->fd, DRM_IOCTL_VC4_SUBMIT_CL, args)) {
+		ret = -errno;
+		goto out;
+	}
+
+	/* lets the bo cache and vc4_bo_wait() use the seqno: */
+	for (i = 0; i < job->nr_bos; i++)
+		job->bos[i]->seqno = args->seqno;
+
+	if (seqno)
+		*seqno = args->seqno;
+
+out:
+	vc4_job_reset(job);
+
+	return ret;
+}
@@ -0,0 +1,108 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#ifndef VC4_PRIV_H_
+#define VC4_PRIV_H_
+
+#include <stdlib.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "libdrm_macros.h"
+#include "xf86drm.h"
+#include "xf86atomic.h"
+
+#include "util_double_list.h"
+
+#include "vc4_drmif.h"
+
+#define VC4_BO_CACHE_BUCKETS 56
+
+struct vc4_bo_bucket {
+	uint32_t size;
+	struct list_head list;
+};
+
+struct vc4_bo_cache {
+	struct vc4_bo_bucket buckets[VC4_BO_CACHE_BUCKETS];
+	unsigned num_buckets;
+	time_t time;
+};
+
+struct vc4_device {
+	int fd;
+	atomic_t refcnt;
+
+	/* protects the handle tables and the bo cache */
+	pthread_mutex_t table_lock;
+	void *handle_table, *name_table;
+
+	struct vc4_bo_cache bo_cache;
+	int has_madvise;
+
+	/* highest seqno known to have completed */
+	uint64_t finished_seqno;
+};
+
+struct vc4_bo {
+	struct vc4_device *dev;
+	void *map;
+	uint32_t size;
+	uint32_t handle;
+	uint32_t name;
+	atomic_t refcnt;
+
+	/* seqno of the last job submitted through us using the bo */
+	uint64_t seqno;
+	/* imported or exported, can be used behind our back */
+	int shared;
+	/* allocated by vc4_bo_new(), so a candidate for the cache */
+	int reuse;
+	int dontneed;
+	time_t free_time;
+	struct list_head list;
+
+	/* handle index hint for the job the bo was last added to */
+	struct vc4_job *current_job;
+	uint32_t hindex;
+};
+
+struct vc4_job {
+	struct vc4_device *dev;
+
+	struct vc4_cl bcl;
+	struct vc4_cl shader_rec;
+	struct vc4_cl uniforms;
+
+	struct vc4_bo **bos;
+	uint32_t *handles;
+	uint32_t nr_bos, max_bos;
+};
+
+drm_private void vc4_bo_cache_init(struct vc4_bo_cache *cache);
+drm_private void vc4_bo_cache_cleanup(struct vc4_device *dev, time_t time);
+drm_private int vc4_seqno_passed(struct vc4_device *dev, uint64_t seqno);
+
+#endif /* VC4_PRIV_H_ */
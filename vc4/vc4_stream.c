@@ -0,0 +1,212 @@
+/*
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "vc4_priv.h"
+
+/*
+ * Streaming arena for per-draw GPU data (vertex and index data, texture
+ * uploads, ...): allocations are carved linearly out of a ring of bo's,
+ * so a draw costs a pointer bump rather than a CMA allocation.  A bo is
+ * only refilled once the seqno of the last submission using it passed.
+ * The total number of bo's is bounded to keep the CMA footprint fixed,
+ * once reached we wait for the oldest bo instead of allocating.
+ *
+ * A stream is not thread-safe, use one per thread.
+ */
+
+struct vc4_stream_buf {
+	struct list_head list;
+	struct vc4_bo *bo;
+	uint8_t *map;
+	uint64_t seqno;
+};
+
+struct vc4_stream {
+	struct vc4_device *dev;
+	uint32_t bo_size;
+	uint32_t max_bos, nr_bos;
+
+	struct vc4_stream_buf *current;
+	uint32_t offset;
+
+	/* filled since the last vc4_stream_submitted(): */
+	struct list_head used;
+	/* waiting for their seqno, oldest first: */
+	struct list_head retired;
+};
+
+drm_public struct vc4_stream * vc4_stream_new(struct vc4_device *dev,
+		uint32_t bo_size, uint32_t max_bos)
+{
+	struct vc4_stream *stream;
+
+	stream = calloc(sizeof(*stream), 1);
+	if (!stream)
+		return NULL;
+
+	stream->dev = vc4_device_ref(dev);
+	stream->bo_size = (bo_size + 4095) & ~4095;
+	stream->max_bos = max_bos;
+	list_inithead(&stream->used);
+	list_inithead(&stream->retired);
+
+	return stream;
+}
+
+static void buf_free(struct vc4_stream_buf *buf)
+{
+	vc4_bo_del(buf->bo);
+	free(buf);
+}
+
+drm_public void vc4_stream_del(struct vc4_stream *stream)
+{
+	struct vc4_stream_buf *buf, *tmp;
+
+	if (!stream)
+		return;
+
+	/* the bo cache keeps busy bo's until they're idle: */
+	if (stream->current)
+		buf_free(stream->current);
+
+	LIST_FOR_EACH_ENTRY_SAFE(buf, tmp, &stream->used, list)
+		buf_free(buf);
+	LIST_FOR_EACH_ENTRY_SAFE(buf, tmp, &stream->retired, list)
+		buf_free(buf);
+
+	vc4_device_del(stream->dev);
+	free(stream);
+}
+
+static int buf_idle(struct vc4_stream *stream, struct vc4_stream_buf *buf)
+{
+	int idle;
+
+	pthread_mutex_lock(&stream->dev->table_lock);
+	idle = vc4_seqno_passed(stream->dev, buf->seqno);
+	pthread_mutex_unlock(&stream->dev->table_lock);
+
+	return idle;
+}
+
+static struct vc4_stream_buf * buf_get(struct vc4_stream *stream,
+		uint32_t size)
+{
+	struct vc4_stream_buf *buf;
+
+	if (!LIST_IS_EMPTY(&stream->retired)) {
+		buf = LIST_FIRST_ENTRY(&stream->retired,
+				struct vc4_stream_buf, list);
+
+		if (vc4_bo_size(buf->bo) >= size) {
+			int full = stream->max_bos && stream->nr_bos >= stream->max_bos;
+
+			/* at the limit, rather wait than grow the ring: */
+			if (buf_idle(stream, buf) ||
+					(full && !vc4_device_wait_seqno(stream->dev,
+							buf->seqno, ~0ull))) {
+				list_del(&buf->list);
+				return buf;
+			}
+		}
+	}
+
+	buf = calloc(sizeof(*buf), 1);
+	if (!buf)
+		return NULL;
+
+	buf->bo = vc4_bo_new(stream->dev,
+			size > stream->bo_size ? size : stream->bo_size);
+	if (!buf->bo)
+		goto fail;
+
+	buf->map = vc4_bo_map(buf->bo);
+	if (!buf->map)
+		goto fail_bo;
+
+	stream->nr_bos++;
+
+	return buf;
+
+fail_bo:
+	vc4_bo_del(buf->bo);
+fail:
+	free(buf);
+	return NULL;
+}
+
+/*
+ * Returns a CPU pointer to size bytes aligned to align (a power of two),
+ * and the bo and offset to reference them with.  The memory stays valid
+ * until the submissions reported by the next vc4_stream_submitted() call
+ * have completed.
+ */
+drm_public void * vc4_stream_alloc(struct vc4_stream *stream, uint32_t size,
+		uint32_t align, struct vc4_bo **bo, uint32_t *offset)
+{
+	struct vc4_stream_buf *buf = stream->current;
+	uint32_t start;
+
+	if (!align)
+		align = 1;
+
+	start = (stream->offset + align - 1) & ~(align - 1);
+
+	if (!buf || start + size > vc4_bo_size(buf->bo)) {
+		if (buf)
+			list_addtail(&buf->list, &stream->used);
+
+		buf = buf_get(stream, size);
+		stream->current = buf;
+		stream->offset = 0;
+		if (!buf)
+			return NULL;
+
+		start = 0;
+	}
+
+	stream->offset = start + size;
+
+	*bo = buf->bo;
+	*offset = start;
+
+	return buf->map + start;
+}
+
+/*
+ * Tells the stream that everything allocated so far is referenced by
+ * submissions up to seqno, typically called once per frame.
+ */
+drm_public void vc4_stream_submitted(struct vc4_stream *stream, uint64_t seqno)
+{
+	struct vc4_stream_buf *buf, *tmp;
+
+	/* the current bo keeps being filled, just bump its seqno: */
+	if (stream->current)
+		stream->current->seqno = seqno;
+
+	LIST_FOR_EACH_ENTRY_SAFE(buf, tmp, &stream->used, list) {
+		list_del(&buf->list);
+		buf->seqno = seqno;
+		list_addtail(&buf->list, &stream->retired);
+	}
+}
@@ -42,11 +42,25 @@ typedef struct {
 	int atomic;
 } atomic_t;
 
+#if HAVE_LIBDRM_ATOMIC_BUILTINS
+/*
+ * Reference counts only need the final decrement to be ordered: taking a
+ * reference is always done through a pointer the caller already owns, and
+ * the acquire/release pair on the decrement makes every access made
+ * through earlier references visible to whoever ends up freeing the object.
+ * The remaining operations keep their full barriers.
+ */
+# define atomic_read(x) __atomic_load_n(&(x)->atomic, __ATOMIC_RELAXED)
+# define atomic_set(x, val) __atomic_store_n(&(x)->atomic, (val), __ATOMIC_RELAXED)
+# define atomic_inc(x) ((void) __atomic_fetch_add(&(x)->atomic, 1, __ATOMIC_RELAXED))
+# define atomic_dec_and_test(x) (__atomic_sub_fetch(&(x)->atomic, 1, __ATOMIC_ACQ_REL) == 0)
+#else
 # define atomic_read(x) ((x)->atomic)
 # define atomic_set(x, val) ((x)->atomic = (val))
 # define atomic_inc(x) ((void) __sync_fetch_and_add (&(x)->atomic, 1))
-# define atomic_inc_return(x) (__sync_add_and_fetch (&(x)->atomic, 1))
 # define atomic_dec_and_test(x) (__sync_add_and_fetch (&(x)->atomic, -1) == 0)
+#endif
+# define atomic_inc_return(x) (__sync_add_and_fetch (&(x)->atomic, 1))
 # define atomic_add(x, v) ((void) __sync_add_and_fetch(&(x)->atomic, (v)))
 # define atomic_dec(x, v) ((void) __sync_sub_and_fetch(&(x)->atomic, (v)))
 # define atomic_cmpxchg(x, oldv, newv) __sync_val_compare_and_swap (&(x)->atomic, oldv, newv)
@@ -64,7 +78,7 @@ typedef struct {
 
 # define atomic_read(x) AO_load_full(&(x)->atomic)
 # define atomic_set(x, val) AO_store_full(&(x)->atomic, (val))
-# define atomic_inc(x) ((void) AO_fetch_and_add1_full(&(x)->atomic))
+# define atomic_inc(x) ((void) AO_fetch_and_add1(&(x)->atomic))
 # define atomic_inc_return(x) (AO_fetch_and_add1_full(&(x)->atomic) + 1)
 # define atomic_add(x, v) ((void) AO_fetch_and_add_full(&(x)->atomic, (v)))
 # define atomic_dec(x, v) ((void) AO_fetch_and_add_full(&(x)->atomic, -(v)))
@@ -50,6 +50,9 @@
 #define stat_t struct stat
 #include <sys/ioctl.h>
 #include <sys/time.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
 #include <stdarg.h>
 #ifdef MAJOR_IN_MKDEV
 #include <sys/mkdev.h>
@@ -58,6 +61,7 @@
 #include <sys/sysmacros.h>
 #endif
 #include <math.h>
+#include <pthread.h>
 
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
 
@@ -168,6 +172,336 @@ drm_public void drmFree(void *pt)
     free(pt);
 }
 
+#if HAVE_LIBDRM_ATOMIC_PRIMITIVES
+/*
+ * Per-ioctl statistics, indexed by the ioctl number (the low 8 bits of the
+ * request).  The counters are updated with atomic operations so no locking
+ * is needed in drmIoctl().  Collection is off unless LIBDRM_IOCTL_STATS is
+ * set in the environment or drmSetIoctlStatsEnabled() is called.
+ */
+static int drm_ioctl_stats_enabled;
+static drmIoctlStats drm_ioctl_stats[DRM_IOCTL_STATS_SIZE];
+
+/*
+ * Ioctl trace ring buffer, see drmIoctlTraceOpen().  The header is followed
+ * by a power of two number of entries; writers reserve a slot by atomically
+ * bumping the header's head counter.
+ */
+static drmIoctlTraceHeader *drm_ioctl_trace;
+static size_t drm_ioctl_trace_size;
+static uint64_t drm_ioctl_trace_mask;
+
+/* 0: environment not checked yet, 1: being checked, 2: done */
+static int drm_ioctl_env_state;
+
+static void drmIoctlCheckEnvironment(void)
+{
+    const char *env;
+
+    if (__sync_val_compare_and_swap(&drm_ioctl_env_state, 0, 1) != 0)
+        return;
+
+    env = getenv("LIBDRM_IOCTL_STATS");
+    if (env && strcmp(env, "0") != 0)
+        drm_ioctl_stats_enabled = 1;
+
+    env = getenv("LIBDRM_IOCTL_TRACE");
+    if (env && *env && !drm_ioctl_trace) {
+        const char *entries = getenv("LIBDRM_IOCTL_TRACE_ENTRIES");
+
+        drmIoctlTraceOpen(env, entries ? strtoul(entries, NULL, 0) : 0);
+    }
+
+    __sync_synchronize();
+    drm_ioctl_env_state = 2;
+}
+
+static int drmIoctlInstrumentActive(void)
+{
+    if (drm_ioctl_env_state != 2)
+        drmIoctlCheckEnvironment();
+    return drm_ioctl_stats_enabled || drm_ioctl_trace;
+}
+
+static uint64_t drmIoctlStatsNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void drmIoctlStatsRecord(unsigned long request, uint64_t ns,
+                                uint32_t eintr, uint32_t eagain)
+{
+    drmIoctlStats *stats = &drm_ioctl_stats[request & (DRM_IOCTL_STATS_SIZE - 1)];
+    uint64_t max;
+
+    __sync_add_and_fetch(&stats->count, 1);
+    __sync_add_and_fetch(&stats->total_ns, ns);
+    if (eintr)
+        __sync_add_and_fetch(&stats->eintr, eintr);
+    if (eagain)
+        __sync_add_and_fetch(&stats->eagain, eagain);
+
+    max = stats->max_ns;
+    while (ns > max) {
+        uint64_t old = __sync_val_compare_and_swap(&stats->max_ns, max, ns);
+        if (old == max)
+            break;
+        max = old;
+    }
+}
+
+static void drmIoctlTraceRecord(drmIoctlTraceHeader *trace, int fd,
+                                unsigned long request, uint64_t start,
+                                uint64_t ns, int ret)
+{
+    drmIoctlTraceEntry *entries = (drmIoctlTraceEntry *)(trace + 1);
+    uint64_t idx = __sync_fetch_and_add(&trace->head, 1);
+    drmIoctlTraceEntry *entry = &entries[idx & drm_ioctl_trace_mask];
+
+    /* A zero sequence number marks the slot as being rewritten */
+    entry->seq = 0;
+    __sync_synchronize();
+    entry->timestamp_ns = start;
+    entry->duration_ns = ns;
+    entry->request = request;
+    entry->fd = fd;
+    entry->ret = ret;
+    __sync_synchronize();
+    entry->seq = idx + 1;
+}
+
+static int drmIoctlInstrumented(int fd, unsigned long request, void *arg)
+{
+    drmIoctlTraceHeader *trace = drm_ioctl_trace;
+    uint32_t eintr = 0, eagain = 0;
+    uint64_t start, ns;
+    int ret, err;
+
+    start = drmIoctlStatsNow();
+    for (;;) {
+        ret = ioctl(fd, request, arg);
+        if (ret != -1)
+            break;
+        if (errno == EINTR)
+            eintr++;
+        else if (errno == EAGAIN)
+            eagain++;
+        else
+            break;
+    }
+    err = errno;
+    ns = drmIoctlStatsNow() - start;
+
+    if (drm_ioctl_stats_enabled)
+        drmIoctlStatsRecord(request, ns, eintr, eagain);
+    if (trace)
+        drmIoctlTraceRecord(trace, fd, request, start, ns,
+                            ret == -1 ? -err : ret);
+
+    errno = err;
+    return ret;
+}
+
+/**
+ * Enable or disable collection of per-ioctl statistics.
+ *
+ * \param enable non-zero to start collecting, zero to stop.
+ *
+ * \return zero on success, or -ENOSYS if libdrm was built without atomic
+ * primitives.
+ *
+ * \internal
+ * Overrides the LIBDRM_IOCTL_STATS environment variable.  Counters that were
+ * already collected are kept; use drmResetIoctlStats() to clear them.
+ */
+drm_public int drmSetIoctlStatsEnabled(int enable)
+{
+    drmIoctlCheckEnvironment();
+    drm_ioctl_stats_enabled = !!enable;
+    return 0;
+}
+
+/**
+ * Take a snapshot of the per-ioctl statistics.
+ *
+ * \param stats array receiving the counters, indexed by ioctl number.
+ * \param count number of elements in \p stats.
+ *
+ * \return the number of elements written on success, or a negative errno
+ * value on failure.
+ *
+ * \internal
+ * Each counter is read atomically, but the snapshot as a whole is not taken
+ * atomically with respect to concurrent drmIoctl() callers.
+ */
+drm_public int drmGetIoctlStats(drmIoctlStatsPtr stats, int count)
+{
+    int i;
+
+    if (!stats || count < 0)
+        return -EINVAL;
+
+    if (count > DRM_IOCTL_STATS_SIZE)
+        count = DRM_IOCTL_STATS_SIZE;
+
+    for (i = 0; i < count; i++) {
+        drmIoctlStats *src = &drm_ioctl_stats[i];
+
+        stats[i].count = __sync_add_and_fetch(&src->count, 0);
+        stats[i].total_ns = __sync_add_and_fetch(&src->total_ns, 0);
+        stats[i].max_ns = __sync_add_and_fetch(&src->max_ns, 0);
+        stats[i].eintr = __sync_add_and_fetch(&src->eintr, 0);
+        stats[i].eagain = __sync_add_and_fetch(&src->eagain, 0);
+    }
+    return count;
+}
+
+/**
+ * Clear all per-ioctl statistics.
+ */
+drm_public void drmResetIoctlStats(void)
+{
+    int i;
+
+    for (i = 0; i < DRM_IOCTL_STATS_SIZE; i++) {
+        drmIoctlStats *stats = &drm_ioctl_stats[i];
+
+        __sync_and_and_fetch(&stats->count, 0);
+        __sync_and_and_fetch(&stats->total_ns, 0);
+        __sync_and_and_fetch(&stats->max_ns, 0);
+        __sync_and_and_fetch(&stats->eintr, 0);
+        __sync_and_and_fetch(&stats->eagain, 0);
+    }
+}
+
+/**
+ * Start recording every drmIoctl() call into a memory-mapped ring buffer.
+ *
+ * \param path file backing the ring buffer; it is created or truncated.
+ * \param num_entries number of records kept, rounded up to a power of two.
+ * Zero selects DRM_IOCTL_TRACE_DEFAULT_ENTRIES.
+ *
+ * \return zero on success, or a negative errno value on failure.
+ *
+ * \internal
+ * The file is mapped shared, so its contents survive a crash of the process
+ * and can be decoded with the drmtrace test program.  Once the ring is full
+ * the oldest records are overwritten.  The LIBDRM_IOCTL_TRACE and
+ * LIBDRM_IOCTL_TRACE_ENTRIES environment variables have the same effect.
+ */
+drm_public int drmIoctlTraceOpen(const char *path, uint32_t num_entries)
+{
+    drmIoctlTraceHeader *trace;
+    uint32_t entries;
+    size_t size;
+    int fd;
+
+    if (!path)
+        return -EINVAL;
+
+    if (num_entries == 0)
+        num_entries = DRM_IOCTL_TRACE_DEFAULT_ENTRIES;
+    if (num_entries > (1u << 24))
+        return -EINVAL;
+    for (entries = 1; entries < num_entries; entries <<= 1)
+        ;
+
+    drmIoctlCheckEnvironment();
+    if (drm_ioctl_trace)
+        return -EBUSY;
+
+    size = sizeof(*trace) + (size_t)entries * sizeof(drmIoctlTraceEntry);
+
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -errno;
+
+    if (ftruncate(fd, size)) {
+        int ret = -errno;
+        close(fd);
+        return ret;
+    }
+
+    trace = drm_mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (trace == MAP_FAILED)
+        return -errno;
+
+    trace->magic = DRM_IOCTL_TRACE_MAGIC;
+    trace->version = DRM_IOCTL_TRACE_VERSION;
+    trace->num_entries = entries;
+    trace->entry_size = sizeof(drmIoctlTraceEntry);
+    trace->pid = getpid();
+    trace->head = 0;
+
+    drm_ioctl_trace_size = size;
+    drm_ioctl_trace_mask = entries - 1;
+    __sync_synchronize();
+
+    if (__sync_val_compare_and_swap(&drm_ioctl_trace, NULL, trace) != NULL) {
+        drm_munmap(trace, size);
+        return -EBUSY;
+    }
+    return 0;
+}
+
+/**
+ * Stop ioctl tracing and unmap the ring buffer.
+ *
+ * \internal
+ * The caller must make sure no other thread is inside drmIoctl() while the
+ * ring buffer is being unmapped.
+ */
+drm_public void drmIoctlTraceClose(void)
+{
+    drmIoctlTraceHeader *trace = drm_ioctl_trace;
+
+    if (!trace)
+        return;
+
+    drm_ioctl_trace = NULL;
+    __sync_synchronize();
+    msync(trace, drm_ioctl_trace_size, MS_ASYNC);
+    drm_munmap(trace, drm_ioctl_trace_size);
+}
+#else
+static int drmIoctlInstrumentActive(void)
+{
+    return 0;
+}
+
+static int drmIoctlInstrumented(int fd, unsigned long request, void *arg)
+{
+    return ioctl(fd, request, arg);
+}
+
+drm_public int drmSetIoctlStatsEnabled(int enable)
+{
+    return -ENOSYS;
+}
+
+drm_public int drmGetIoctlStats(drmIoctlStatsPtr stats, int count)
+{
+    return -ENOSYS;
+}
+
+drm_public void drmResetIoctlStats(void)
+{
+}
+
+drm_public int drmIoctlTraceOpen(const char *path, uint32_t num_entries)
+{
+    return -ENOSYS;
+}
+
+drm_public void drmIoctlTraceClose(void)
+{
+}
+#endif
+
 /**
  * Call ioctl, restarting if it is interrupted
  */
@@ -176,12 +510,155 @@ drmIoctl(int fd, unsigned long request, void *arg)
 {
     int ret;
 
+    if (drmIoctlInstrumentActive())
+        return drmIoctlInstrumented(fd, request, arg);
+
     do {
         ret = ioctl(fd, request, arg);
     } while (ret == -1 && (errno == EINTR || errno == EAGAIN));
     return ret;
 }
 
+/*
+ * Submission tracing, see drmSetSubmitTraceHook() and
+ * drmSetSubmitTraceMarker().  Both are off unless enabled, leaving
+ * drmSubmitTraceBegin() and drmSubmitTraceEnd() with two loads each.
+ */
+static drmSubmitTraceHook drm_submit_trace_hook;
+static void *drm_submit_trace_data;
+static int drm_submit_trace_marker = -1;
+static pthread_once_t drm_submit_trace_once = PTHREAD_ONCE_INIT;
+
+static void drmSubmitTraceCheckEnvironment(void)
+{
+    const char *env = getenv("LIBDRM_TRACE_MARKER");
+
+    if (env && strcmp(env, "0") != 0)
+        drmSetSubmitTraceMarker(1);
+}
+
+static void drmSubmitTraceInit(void)
+{
+    pthread_once(&drm_submit_trace_once, drmSubmitTraceCheckEnvironment);
+}
+
+/**
+ * Install a function called at the entry and exit of each command
+ * submission made through the driver libraries and drmModeAtomicCommit().
+ *
+ * \param hook function to call, or NULL to remove it.
+ * \param data passed to \p hook.
+ *
+ * \internal
+ * The hook runs on the submitting thread, it should be cheap and must not
+ * submit itself.  Install it before other threads start submitting.
+ */
+drm_public void drmSetSubmitTraceHook(drmSubmitTraceHook hook, void *data)
+{
+    drmSubmitTraceInit();
+    drm_submit_trace_data = data;
+    __sync_synchronize();
+    drm_submit_trace_hook = hook;
+}
+
+/**
+ * Write submissions to the ftrace trace_marker.
+ *
+ * \param enable non-zero to start writing, zero to stop.
+ *
+ * \return zero on success, or a negative errno value if the trace_marker
+ * can't be opened.
+ *
+ * \internal
+ * The markers are in the systrace "B|pid|name" and "E|pid" format, so the
+ * submissions show up as slices in Perfetto and systrace next to the GPU
+ * scheduler events.  Setting LIBDRM_TRACE_MARKER in the environment has the
+ * same effect as enabling it.
+ */
+drm_public int drmSetSubmitTraceMarker(int enable)
+{
+    static const char *paths[] = {
+        "/sys/kernel/tracing/trace_marker",
+        "/sys/kernel/debug/tracing/trace_marker",
+    };
+    unsigned i;
+    int fd = -1;
+
+    drmSubmitTraceInit();
+
+    if (enable) {
+        if (drm_submit_trace_marker >= 0)
+            return 0;
+        for (i = 0; i < ARRAY_SIZE(paths) && fd < 0; i++)
+            fd = open(paths[i], O_WRONLY | O_CLOEXEC);
+        if (fd < 0)
+            return -errno;
+        if (__sync_val_compare_and_swap(&drm_submit_trace_marker, -1, fd) != -1)
+            close(fd);
+        return 0;
+    }
+
+    fd = __sync_lock_test_and_set(&drm_submit_trace_marker, -1);
+    if (fd >= 0)
+        close(fd);
+    return 0;
+}
+
+static void drmSubmitTraceWrite(int marker, int end,
+                                const drmSubmitTrace *trace)
+{
+    char buf[160];
+    int len;
+
+    if (end)
+        len = snprintf(buf, sizeof(buf), "E|%d|%s fence=%llu ret=%d",
+                       (int)getpid(), trace->name,
+                       (unsigned long long)trace->fence, trace->ret);
+    else
+        len = snprintf(buf, sizeof(buf), "B|%d|%s fd=%d bos=%u bytes=%u",
+                       (int)getpid(), trace->name, trace->fd,
+                       trace->num_bos, trace->cmd_bytes);
+    /* best effort, a full trace buffer drops the marker */
+    if (len > 0)
+        len = write(marker, buf, MIN2((size_t)len, sizeof(buf) - 1));
+}
+
+static void drmSubmitTraceReport(int end, const drmSubmitTrace *trace)
+{
+    drmSubmitTraceHook hook;
+    int marker;
+
+    drmSubmitTraceInit();
+    hook = drm_submit_trace_hook;
+    marker = drm_submit_trace_marker;
+
+    if (marker >= 0)
+        drmSubmitTraceWrite(marker, end, trace);
+    if (hook)
+        hook(end, trace, drm_submit_trace_data);
+}
+
+/**
+ * Report the start of a command submission, for the driver libraries.
+ *
+ * \param trace the submit path, fd, number of bos and command bytes.
+ */
+drm_public void drmSubmitTraceBegin(const drmSubmitTrace *trace)
+{
+    drmSubmitTraceReport(0, trace);
+}
+
+/**
+ * Report the end of a command submission, for the driver libraries.
+ *
+ * \param trace as passed to drmSubmitTraceBegin(), with the result and
+ * fence filled in.
+ */
+drm_public void drmSubmitTraceEnd(const drmSubmitTrace *trace)
+{
+    drmSubmitTraceReport(1, trace);
+}
+
 static unsigned long drmGetKeyFromFd(int fd)
 {
     stat_t     st;
@@ -605,6 +1082,92 @@ static int drmOpenByBusid(const char *busid, int type)
 }
 
 
+/*
+ * Open @minor if its driver is called @name and it isn't already in use.  If
+ * it's in use it will have a busid assigned already.
+ */
+static int drmOpenByNameMinor(const char *name, int minor, int type)
+{
+    drmVersionPtr version;
+    char *        id;
+    int           fd;
+
+    if ((fd = drmOpenMinor(minor, 1, type)) < 0)
+        return -1;
+
+    if ((version = drmGetVersion(fd))) {
+        if (!strcmp(version->name, name)) {
+            drmFreeVersion(version);
+            id = drmGetBusid(fd);
+            drmMsg("drmGetBusid returned '%s'\n", id ? id : "NULL");
+            if (!id || !*id) {
+                if (id)
+                    drmFreeBusid(id);
+                return fd;
+            }
+            drmFreeBusid(id);
+        } else {
+            drmFreeVersion(version);
+        }
+    }
+    close(fd);
+    return -1;
+}
+
+#ifdef __linux__
+#define DRM_SYSFS_MINOR_OTHER  1
+#define DRM_SYSFS_MINOR_DRIVER 2
+
+/*
+ * Find the minors of @type in /sys/class/drm.  state[i] for minor base + i
+ * is set to DRM_SYSFS_MINOR_DRIVER if the node is bound to a kernel driver
+ * called @name, DRM_SYSFS_MINOR_OTHER if it exists but isn't, and 0 if it
+ * doesn't exist.  Returns 0, or -1 without sysfs.
+ */
+static int drmGetSysfsMinors(const char *name, int type,
+                             char state[DRM_MAX_MINOR])
+{
+    char path[PATH_MAX + 1], link[PATH_MAX + 1];
+    const char *prefix = drmGetMinorName(type), *driver;
+    size_t len = strlen(prefix);
+    int base = drmGetMinorBase(type);
+    struct dirent *ent;
+    DIR *sysdir;
+    ssize_t n;
+    char *end;
+    long minor;
+
+    sysdir = opendir("/sys/class/drm");
+    if (!sysdir)
+        return -1;
+
+    memset(state, 0, DRM_MAX_MINOR);
+    while ((ent = readdir(sysdir))) {
+        /* skip connectors such as card0-DP-1 */
+        if (strncmp(ent->d_name, prefix, len) ||
+            !isdigit((unsigned char)ent->d_name[len]))
+            continue;
+        minor = strtol(ent->d_name + len, &end, 10) - base;
+        if (*end || minor < 0 || minor >= DRM_MAX_MINOR)
+            continue;
+
+        state[minor] = DRM_SYSFS_MINOR_OTHER;
+        snprintf(path, sizeof(path), "/sys/class/drm/%s/device/driver",
+                 ent->d_name);
+        n = readlink(path, link, PATH_MAX);
+        if (n <= 0)
+            continue;
+        link[n] = '\0';
+        driver = strrchr(link, '/');
+        driver = driver ? driver + 1 : link;
+        if (!strcmp(driver, name))
+            state[minor] = DRM_SYSFS_MINOR_DRIVER;
+    }
+    closedir(sysdir);
+    return 0;
+}
+#endif
+
 /**
  * Open the device by name.
  *
@@ -618,44 +1181,47 @@ static int drmOpenByBusid(const char *busid, int type)
  * isn't already in use.  If it's in use it then it will already have a bus ID
  * assigned.
  *
+ * On Linux the minors bound to a kernel driver of the same name are tried
+ * first, as found in sysfs, then the other minors sysfs knows about, since
+ * the kernel and DRM driver names can differ.  Minors without a node are
+ * never opened.
+ *
  * \sa drmOpenMinor(), drmGetVersion() and drmGetBusid().
  */
 static int drmOpenByName(const char *name, int type)
 {
     int           i;
     int           fd;
-    drmVersionPtr version;
-    char *        id;
     int           base = drmGetMinorBase(type);
 
     if (base < 0)
         return -1;
 
-    /*
-     * Open the first minor number that matches the driver name and isn't
-     * already in use.  If it's in use it will have a busid assigned already.
-     */
-    for (i = base; i < base + DRM_MAX_MINOR; i++) {
-        if ((fd = drmOpenMinor(i, 1, type)) >= 0) {
-            if ((version = drmGetVersion(fd))) {
-                if (!strcmp(version->name, name)) {
-                    drmFreeVersion(version);
-                    id = drmGetBusid(fd);
-                    drmMsg("drmGetBusid returned '%s'\n", id ? id : "NULL");
-                    if (!id || !*id) {
-                        if (id)
-                            drmFreeBusid(id);
-                        return fd;
-                    } else {
-                        drmFreeBusid(id);
-                    }
-                } else {
-                    drmFreeVersion(version);
-                }
-            }
-            close(fd);
+#ifdef __linux__
+    {
+        char state[DRM_MAX_MINOR];
+
+        if (drmGetSysfsMinors(name, type, state) == 0) {
+            for (i = 0; i < DRM_MAX_MINOR; i++)
+                if (state[i] == DRM_SYSFS_MINOR_DRIVER &&
+                    (fd = drmOpenByNameMinor(name, base + i, type)) >= 0)
+                    return fd;
+            for (i = 0; i < DRM_MAX_MINOR; i++)
+                if (state[i] == DRM_SYSFS_MINOR_OTHER &&
+                    (fd = drmOpenByNameMinor(name, base + i, type)) >= 0)
+                    return fd;
+            goto proc;
         }
     }
+#endif
+
+    for (i = base; i < base + DRM_MAX_MINOR; i++)
+        if ((fd = drmOpenByNameMinor(name, i, type)) >= 0)
+            return fd;
+
+#ifdef __linux__
+proc:
+#endif
 
 #ifdef __linux__
     /* Backward-compatibility /proc support */
@@ -762,6 +1328,129 @@ drm_public int drmOpenRender(int minor)
     return drmOpenMinor(minor, 0, DRM_NODE_RENDER);
 }
 
+/*
+ * Per-fd cache of query results which cannot change during the fd's
+ * lifetime.  Only fds registered with drmSetQueryCacheEnabled() are cached,
+ * and the entry is dropped by drmClose(), since an fd closed behind our back
+ * may be reused for another device.  Errors are cached only when they mean
+ * "not supported", which is just as stable as a value.
+ */
+#define DRM_QUERY_CACHE_CAPS 32
+
+struct drm_query_cache {
+    uint32_t cap_valid;
+    struct {
+        int err;
+        uint64_t value;
+    } caps[DRM_QUERY_CACHE_CAPS];
+    drmVersionPtr version;
+    char *busid;
+};
+
+static void *drm_query_caches; /* fd -> struct drm_query_cache */
+static pthread_mutex_t drm_query_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct drm_query_cache *drmQueryCacheLookup(int fd)
+{
+    void *value;
+
+    if (fd < 0 || !drm_query_caches ||
+        drmIntMapLookup(drm_query_caches, fd, &value))
+        return NULL;
+    return value;
+}
+
+static void drmQueryCacheDrop(int fd)
+{
+    struct drm_query_cache *cache;
+
+    pthread_mutex_lock(&drm_query_cache_lock);
+    cache = drmQueryCacheLookup(fd);
+    if (cache) {
+        drmIntMapDelete(drm_query_caches, fd);
+        drmFreeVersion(cache->version);
+        drmFree(cache->busid);
+        drmFree(cache);
+    }
+    pthread_mutex_unlock(&drm_query_cache_lock);
+}
+
+static void drmQueryCacheForgetBusid(int fd)
+{
+    struct drm_query_cache *cache;
+
+    pthread_mutex_lock(&drm_query_cache_lock);
+    cache = drmQueryCacheLookup(fd);
+    if (cache) {
+        drmFree(cache->busid);
+        cache->busid = NULL;
+    }
+    pthread_mutex_unlock(&drm_query_cache_lock);
+}
+
+static drmVersionPtr drmDupVersion(const drmVersion *s)
+{
+    drmVersionPtr d = drmMalloc(sizeof(*d));
+
+    if (!d)
+        return NULL;
+
+    *d = *s;
+    d->name = strdup(s->name);
+    d->date = strdup(s->date);
+    d->desc = strdup(s->desc);
+    if (!d->name || !d->date || !d->desc) {
+        drmFreeVersion(d);
+        return NULL;
+    }
+    return d;
+}
+
+/**
+ * Enable or disable caching of query results for a file descriptor.
+ *
+ * \param fd file descriptor.
+ * \param enable non-zero to enable caching, zero to disable it.
+ *
+ * \return zero on success, negative error code otherwise.
+ *
+ * \internal
+ * While enabled, the results of drmGetVersion(), drmGetBusid() and
+ * drmGetCap() are remembered and repeated calls make no ioctls.  The cache
+ * is dropped by drmClose(); callers that close the fd with plain close()
+ * must disable caching first.
+ */
+drm_public int drmSetQueryCacheEnabled(int fd, int enable)
+{
+    struct drm_query_cache *cache;
+    int ret = 0;
+
+    if (fd < 0)
+        return -EINVAL;
+
+    if (!enable) {
+        drmQueryCacheDrop(fd);
+        return 0;
+    }
+
+    pthread_mutex_lock(&drm_query_cache_lock);
+    if (!drm_query_caches)
+        drm_query_caches = drmIntMapCreate();
+    if (!drm_query_caches) {
+        ret = -ENOMEM;
+    } else if (!drmQueryCacheLookup(fd)) {
+        cache = drmMalloc(sizeof(*cache));
+        if (!cache) {
+            ret = -ENOMEM;
+        } else if (drmIntMapInsert(drm_query_caches, fd, cache)) {
+            drmFree(cache);
+            ret = -ENOMEM;
+        }
+    }
+    pthread_mutex_unlock(&drm_query_cache_lock);
+    return ret;
+}
+
 /**
  * Free the version information returned by drmGetVersion().
  *
@@ -843,9 +1532,18 @@ static void drmCopyVersion(drmVersionPtr d, const drm_version_t *s)
  */
 drm_public drmVersionPtr drmGetVersion(int fd)
 {
+    struct drm_query_cache *cache;
     drmVersionPtr retval;
-    drm_version_t *version = drmMalloc(sizeof(*version));
+    drm_version_t *version;
+
+    pthread_mutex_lock(&drm_query_cache_lock);
+    cache = drmQueryCacheLookup(fd);
+    retval = cache && cache->version ? drmDupVersion(cache->version) : NULL;
+    pthread_mutex_unlock(&drm_query_cache_lock);
+    if (retval)
+        return retval;
 
+    version = drmMalloc(sizeof(*version));
     if (drmIoctl(fd, DRM_IOCTL_VERSION, version)) {
         drmFreeKernelVersion(version);
         return NULL;
@@ -872,6 +1570,13 @@ drm_public drmVersionPtr drmGetVersion(int fd)
     retval = drmMalloc(sizeof(*retval));
     drmCopyVersion(retval, version);
     drmFreeKernelVersion(version);
+
+    pthread_mutex_lock(&drm_query_cache_lock);
+    cache = drmQueryCacheLookup(fd);
+    if (cache && !cache->version)
+        cache->version = drmDupVersion(retval);
+    pthread_mutex_unlock(&drm_query_cache_lock);
+
     return retval;
 }
 
@@ -912,15 +1617,53 @@ drm_public drmVersionPtr drmGetLibVersion(int fd)
 
 drm_public int drmGetCap(int fd, uint64_t capability, uint64_t *value)
 {
+    struct drm_query_cache *cache;
     struct drm_get_cap cap;
+    int cached = 0, err = 0;
     int ret;
 
+    if (capability < DRM_QUERY_CACHE_CAPS) {
+        pthread_mutex_lock(&drm_query_cache_lock);
+        cache = drmQueryCacheLookup(fd);
+        if (cache && (cache->cap_valid & (1u << capability))) {
+            cached = 1;
+            err = cache->caps[capability].err;
+            cap.value = cache->caps[capability].value;
+        }
+        pthread_mutex_unlock(&drm_query_cache_lock);
+
+        if (cached) {
+            if (err) {
+                errno = err;
+                return -1;
+            }
+            *value = cap.value;
+            return 0;
+        }
+    }
+
     memclear(cap);
     cap.capability = capability;
 
     ret = drmIoctl(fd, DRM_IOCTL_GET_CAP, &cap);
-    if (ret)
+    err = ret ? errno : 0;
+
+    /* EINVAL means the capability is unknown, which won't change either. */
+    if (capability < DRM_QUERY_CACHE_CAPS && (err == 0 || err == EINVAL)) {
+        pthread_mutex_lock(&drm_query_cache_lock);
+        cache = drmQueryCacheLookup(fd);
+        if (cache) {
+            cache->caps[capability].err = err;
+            cache->caps[capability].value = cap.value;
+            cache->cap_valid |= 1u << capability;
+        }
+        pthread_mutex_unlock(&drm_query_cache_lock);
+    }
+
+    if (ret) {
+        errno = err;
         return ret;
+    }
 
     *value = cap.value;
     return 0;
@@ -965,7 +1708,16 @@ drm_public void drmFreeBusid(const char *busid)
  */
 drm_public char *drmGetBusid(int fd)
 {
+    struct drm_query_cache *cache;
     drm_unique_t u;
+    char *busid;
+
+    pthread_mutex_lock(&drm_query_cache_lock);
+    cache = drmQueryCacheLookup(fd);
+    busid = cache && cache->busid ? strdup(cache->busid) : NULL;
+    pthread_mutex_unlock(&drm_query_cache_lock);
+    if (busid)
+        return busid;
 
     memclear(u);
 
@@ -978,6 +1730,12 @@ drm_public char *drmGetBusid(int fd)
     }
     u.unique[u.unique_len] = '\0';
 
+    pthread_mutex_lock(&drm_query_cache_lock);
+    cache = drmQueryCacheLookup(fd);
+    if (cache && !cache->busid)
+        cache->busid = strdup(u.unique);
+    pthread_mutex_unlock(&drm_query_cache_lock);
+
     return u.unique;
 }
 
@@ -1002,6 +1760,7 @@ drm_public int drmSetBusid(int fd, const char *busid)
     u.unique     = (char *)busid;
     u.unique_len = strlen(busid);
 
+    drmQueryCacheForgetBusid(fd);
     if (drmIoctl(fd, DRM_IOCTL_SET_UNIQUE, &u)) {
         return -errno;
     }
@@ -1228,6 +1987,9 @@ drm_public int drmClose(int fd)
     drmHashDelete(drmHashTable, key);
     drmFree(entry);
 
+    drmQueryCacheDrop(fd);
+    drmPrimeCacheDrop(fd);
+
     return close(fd);
 }
 
@@ -2524,6 +3286,8 @@ drm_public int drmSetInterfaceVersion(int fd, drmSetVersion *version)
     sv.drm_dd_major = version->drm_dd_major;
     sv.drm_dd_minor = version->drm_dd_minor;
 
+    /* Setting the interface version may update the bus id. */
+    drmQueryCacheForgetBusid(fd);
     if (drmIoctl(fd, DRM_IOCTL_SET_VERSION, &sv)) {
         retcode = -errno;
     }
@@ -2837,6 +3601,201 @@ drm_public int drmPrimeFDToHandle(int fd, int prime_fd, uint32_t *handle)
     return 0;
 }
 
+/*
+ * dma-buf import cache: per device fd, the GEM handle and size of every
+ * dma-buf imported through drmPrimeFDToHandleCached(), keyed by the
+ * dma-buf's inode.  An imported handle holds a reference on the dma-buf,
+ * so its inode can't be recycled while the entry is valid.
+ */
+struct drm_prime_entry {
+    dev_t dev;
+    ino_t ino;
+    uint32_t handle;
+    uint64_t size;
+};
+
+struct drm_prime_cache {
+    void *by_ino;    /* inode -> struct drm_prime_entry */
+    void *by_handle; /* handle -> struct drm_prime_entry */
+};
+
+static void *drm_prime_caches; /* fd -> struct drm_prime_cache */
+static pthread_mutex_t drm_prime_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct drm_prime_cache *drmPrimeCacheLookup(int fd, int create)
+{
+    struct drm_prime_cache *cache;
+    void *value;
+
+    if (!drm_prime_caches) {
+        if (!create)
+            return NULL;
+        drm_prime_caches = drmIntMapCreate();
+        if (!drm_prime_caches)
+            return NULL;
+    }
+
+    if (!drmIntMapLookup(drm_prime_caches, fd, &value))
+        return value;
+    if (!create)
+        return NULL;
+
+    cache = drmMalloc(sizeof(*cache));
+    if (!cache)
+        return NULL;
+
+    cache->by_ino = drmHashCreate();
+    cache->by_handle = drmIntMapCreate();
+    if (!cache->by_ino || !cache->by_handle ||
+        drmIntMapInsert(drm_prime_caches, fd, cache)) {
+        if (cache->by_ino)
+            drmHashDestroy(cache->by_ino);
+        if (cache->by_handle)
+            drmIntMapDestroy(cache->by_handle);
+        drmFree(cache);
+        return NULL;
+    }
+
+    return cache;
+}
+
+static void drmPrimeCacheRemove(struct drm_prime_cache *cache,
+                                struct drm_prime_entry *entry)
+{
+    void *value;
+
+    if (!drmHashLookup(cache->by_ino, entry->ino, &value) && value == entry)
+        drmHashDelete(cache->by_ino, entry->ino);
+    drmIntMapDelete(cache->by_handle, entry->handle);
+    drmFree(entry);
+}
+
+/**
+ * Import a dma-buf, reusing the result of an earlier import when the same
+ * dma-buf was already imported on this device fd.
+ *
+ * \param fd file descriptor.
+ * \param prime_fd dma-buf file descriptor.
+ * \param handle returns the GEM handle.
+ * \param size if not NULL, returns the size of the dma-buf.
+ *
+ * 
+eturn zero on success, negative error code otherwise.
+ *
+ * \internal
+ * A hit only costs an fstat(), no ioctl.  Callers must call
+ * drmPrimeCacheForget() before closing a GEM handle that may have been
+ * returned here, or a later import of the same dma-buf would return the
+ * closed handle.  The cache is dropped by drmClose(); callers that close
+ * the fd with plain close() must call drmPrimeCacheDrop() first.
+ */
+drm_public int drmPrimeFDToHandleCached(int fd, int prime_fd, uint32_t *handle,
+                                        uint64_t *size)
+{
+    struct drm_prime_cache *cache;
+    struct drm_prime_entry *entry;
+    struct stat st;
+    void *value;
+    off_t end;
+    int ret;
+
+    if (fstat(prime_fd, &st))
+        return -errno;
+
+    pthread_mutex_lock(&drm_prime_cache_lock);
+    cache = drmPrimeCacheLookup(fd, 0);
+    if (cache && !drmHashLookup(cache->by_ino, st.st_ino, &value)) {
+        entry = value;
+        if (entry->ino == st.st_ino && entry->dev == st.st_dev) {
+            *handle = entry->handle;
+            if (size)
+                *size = entry->size;
+            pthread_mutex_unlock(&drm_prime_cache_lock);
+            return 0;
+        }
+    }
+    pthread_mutex_unlock(&drm_prime_cache_lock);
+
+    ret = drmPrimeFDToHandle(fd, prime_fd, handle);
+    if (ret)
+        return ret;
+
+    end = lseek(prime_fd, 0, SEEK_END);
+    if (size)
+        *size = end < 0 ? 0 : end;
+
+    entry = drmMalloc(sizeof(*entry));
+    if (!entry)
+        return 0;
+    entry->dev = st.st_dev;
+    entry->ino = st.st_ino;
+    entry->handle = *handle;
+    entry->size = end < 0 ? 0 : end;
+
+    pthread_mutex_lock(&drm_prime_cache_lock);
+    cache = drmPrimeCacheLookup(fd, 1);
+    if (!cache) {
+        drmFree(entry);
+    } else {
+        /* replace whatever a concurrent import or a stale slot left */
+        if (!drmIntMapLookup(cache->by_handle, entry->handle, &value))
+            drmPrimeCacheRemove(cache, value);
+        if (!drmHashLookup(cache->by_ino, entry->ino, &value))
+            drmPrimeCacheRemove(cache, value);
+
+        if (drmHashInsert(cache->by_ino, entry->ino, entry)) {
+            drmFree(entry);
+        } else if (drmIntMapInsert(cache->by_handle, entry->handle, entry)) {
+            drmHashDelete(cache->by_ino, entry->ino);
+            drmFree(entry);
+        }
+    }
+    pthread_mutex_unlock(&drm_prime_cache_lock);
+
+    return 0;
+}
+
+/**
+ * Forget the cached import of a GEM handle, to be called before the handle
+ * is closed.  Handles that never went through drmPrimeFDToHandleCached()
+ * are ignored.
+ */
+drm_public void drmPrimeCacheForget(int fd, uint32_t handle)
+{
+    struct drm_prime_cache *cache;
+    void *value;
+
+    pthread_mutex_lock(&drm_prime_cache_lock);
+    cache = drmPrimeCacheLookup(fd, 0);
+    if (cache && !drmIntMapLookup(cache->by_handle, handle, &value))
+        drmPrimeCacheRemove(cache, value);
+    pthread_mutex_unlock(&drm_prime_cache_lock);
+}
+
+/**
+ * Drop every cached import for a file descriptor.
+ */
+drm_public void drmPrimeCacheDrop(int fd)
+{
+    struct drm_prime_cache *cache;
+    unsigned long key;
+    void *value;
+
+    pthread_mutex_lock(&drm_prime_cache_lock);
+    cache = drmPrimeCacheLookup(fd, 0);
+    if (cache) {
+        while (drmHashFirst(cache->by_ino, &key, &value) == 1) {
+            drmHashDelete(cache->by_ino, key);
+            drmFree(value);
+        }
+        drmHashDestroy(cache->by_ino);
+        drmIntMapDestroy(cache->by_handle);
+        drmIntMapDelete(drm_prime_caches, fd);
+        drmFree(cache);
+    }
+    pthread_mutex_unlock(&drm_prime_cache_lock);
+}
+
 static char *drmGetMinorNameForFD(int fd, int type)
 {
 #ifdef __linux__
@@ -3276,24 +4235,64 @@ static void drmFreeHost1xDevice(drmDevicePtr device)
     }
 }
 
+/*
+ * Devices returned by drmGetDevice2 may be shared with the per-node cache,
+ * so every device carries a reference count in front of the public struct.
+ */
+struct drm_device_private {
+    int refcount;
+    drmDevice device;
+};
+
+static pthread_mutex_t drm_device_ref_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct drm_device_private *drmDevicePrivate(drmDevicePtr device)
+{
+    return (struct drm_device_private *)
+        ((char *)device - offsetof(struct drm_device_private, device));
+}
+
+static drmDevicePtr drmDeviceRef(drmDevicePtr device)
+{
+    pthread_mutex_lock(&drm_device_ref_lock);
+    drmDevicePrivate(device)->refcount++;
+    pthread_mutex_unlock(&drm_device_ref_lock);
+    return device;
+}
+
+/* Free the storage of a device which was never handed out */
+static void drmDeviceFreeStorage(drmDevicePtr device)
+{
+    free(drmDevicePrivate(device));
+}
+
 drm_public void drmFreeDevice(drmDevicePtr *device)
 {
+    int refcount;
+
     if (device == NULL)
         return;
 
     if (*device) {
-        switch ((*device)->bustype) {
-        case DRM_BUS_PLATFORM:
-            drmFreePlatformDevice(*device);
-            break;
+        pthread_mutex_lock(&drm_device_ref_lock);
+        refcount = --drmDevicePrivate(*device)->refcount;
+        pthread_mutex_unlock(&drm_device_ref_lock);
+
+        if (refcount == 0) {
+            switch ((*device)->bustype) {
+            case DRM_BUS_PLATFORM:
+                drmFreePlatformDevice(*device);
+                break;
+
+            case DRM_BUS_HOST1X:
+                drmFreeHost1xDevice(*device);
+                break;
+            }
 
-        case DRM_BUS_HOST1X:
-            drmFreeHost1xDevice(*device);
-            break;
+            drmDeviceFreeStorage(*device);
         }
     }
 
-    free(*device);
     *device = NULL;
 }
 
@@ -3313,6 +4312,7 @@ static drmDevicePtr drmDeviceAlloc(unsigned int type, const char *node,
                                    size_t bus_size, size_t device_size,
                                    char **ptrp)
 {
+    struct drm_device_private *priv;
     size_t max_node_length, extra, size;
     drmDevicePtr device;
     unsigned int i;
@@ -3321,15 +4321,17 @@ static drmDevicePtr drmDeviceAlloc(unsigned int type, const char *node,
     max_node_length = ALIGN(drmGetMaxNodeName(), sizeof(void *));
     extra = DRM_NODE_MAX * (sizeof(void *) + max_node_length);
 
-    size = sizeof(*device) + extra + bus_size + device_size;
+    size = sizeof(*priv) + extra + bus_size + device_size;
 
-    device = calloc(1, size);
-    if (!device)
+    priv = calloc(1, size);
+    if (!priv)
         return NULL;
 
+    priv->refcount = 1;
+    device = &priv->device;
     device->available_nodes = 1 << type;
 
-    ptr = (char *)device + sizeof(*device);
+    ptr = (char *)(priv + 1);
     device->nodes = (char **)ptr;
 
     ptr += DRM_NODE_MAX * sizeof(void *);
@@ -3383,7 +4385,7 @@ static int drmProcessPciDevice(drmDevicePtr *device,
     return 0;
 
 free_device:
-    free(dev);
+    drmDeviceFreeStorage(dev);
     return ret;
 }
 
@@ -3490,7 +4492,7 @@ static int drmProcessUsbDevice(drmDevicePtr *device, const char *node,
     return 0;
 
 free_device:
-    free(dev);
+    drmDeviceFreeStorage(dev);
     return ret;
 }
 
@@ -3625,7 +4627,7 @@ static int drmProcessPlatformDevice(drmDevicePtr *device,
     return 0;
 
 free_device:
-    free(dev);
+    drmDeviceFreeStorage(dev);
     return ret;
 }
 
@@ -3665,7 +4667,7 @@ static int drmProcessHost1xDevice(drmDevicePtr *device,
     return 0;
 
 free_device:
-    free(dev);
+    drmDeviceFreeStorage(dev);
     return ret;
 }
 
@@ -3716,25 +4718,110 @@ process_device(drmDevicePtr *device, const char *d_name,
    }
 }
 
+/*
+ * The kernel drm core has a number of places that assume maximum of
+ * 3x64 devices nodes. That's 64 for each of primary, control and
+ * render nodes. Rounded it up to 256 for simplicity.
+ */
+#define MAX_DRM_NODES 256
+
+static size_t drmDeviceBusInfoSize(int bustype)
+{
+    switch (bustype) {
+    case DRM_BUS_PCI:
+        return sizeof(drmPciBusInfo);
+    case DRM_BUS_USB:
+        return sizeof(drmUsbBusInfo);
+    case DRM_BUS_PLATFORM:
+        return sizeof(drmPlatformBusInfo);
+    case DRM_BUS_HOST1X:
+        return sizeof(drmHost1xBusInfo);
+    default:
+        return 0;
+    }
+}
+
+static size_t drmDeviceDeviceInfoSize(int bustype)
+{
+    switch (bustype) {
+    case DRM_BUS_PCI:
+        return sizeof(drmPciDeviceInfo);
+    case DRM_BUS_USB:
+        return sizeof(drmUsbDeviceInfo);
+    case DRM_BUS_PLATFORM:
+        return sizeof(drmPlatformDeviceInfo);
+    case DRM_BUS_HOST1X:
+        return sizeof(drmHost1xDeviceInfo);
+    default:
+        return 0;
+    }
+}
+
+/* All businfo/deviceinfo union members are pointers to the same storage */
+static const void *drmDeviceBusInfo(drmDevicePtr device)
+{
+    return device->businfo.pci;
+}
+
+struct drm_fold_entry {
+    drmDevicePtr device;
+    int index;
+};
+
+static int drmCompareFoldEntries(const void *a, const void *b)
+{
+    const struct drm_fold_entry *ea = a, *eb = b;
+    size_t size;
+    int ret;
+
+    if (ea->device->bustype != eb->device->bustype)
+        return ea->device->bustype < eb->device->bustype ? -1 : 1;
+
+    size = drmDeviceBusInfoSize(ea->device->bustype);
+    if (size) {
+        ret = memcmp(drmDeviceBusInfo(ea->device),
+                     drmDeviceBusInfo(eb->device), size);
+        if (ret)
+            return ret;
+    }
+
+    return ea->index - eb->index;
+}
+
 /* Consider devices located on the same bus as duplicate and fold the respective
  * entries into a single one.
  *
+ * The nodes are sorted by bus so duplicates end up next to each other, and
+ * each one is folded into the first node of its bus in readdir order.
+ *
  * Note: this leaves "gaps" in the array, while preserving the length.
  */
 static void drmFoldDuplicatedDevices(drmDevicePtr local_devices[], int count)
 {
-    int node_type, i, j;
+    struct drm_fold_entry entries[MAX_DRM_NODES];
+    int node_type, i, first;
 
     for (i = 0; i < count; i++) {
-        for (j = i + 1; j < count; j++) {
-            if (drmDevicesEqual(local_devices[i], local_devices[j])) {
-                local_devices[i]->available_nodes |= local_devices[j]->available_nodes;
-                node_type = log2(local_devices[j]->available_nodes);
-                memcpy(local_devices[i]->nodes[node_type],
-                       local_devices[j]->nodes[node_type], drmGetMaxNodeName());
-                drmFreeDevice(&local_devices[j]);
-            }
+        entries[i].device = local_devices[i];
+        entries[i].index = i;
+    }
+
+    qsort(entries, count, sizeof(entries[0]), drmCompareFoldEntries);
+
+    for (first = 0, i = 1; i < count; i++) {
+        drmDevicePtr dst = local_devices[entries[first].index];
+        drmDevicePtr src = entries[i].device;
+
+        if (!drmDevicesEqual(dst, src)) {
+            first = i;
+            continue;
         }
+
+        dst->available_nodes |= src->available_nodes;
+        node_type = log2(src->available_nodes);
+        memcpy(dst->nodes[node_type], src->nodes[node_type],
+               drmGetMaxNodeName());
+        drmFreeDevice(&local_devices[entries[i].index]);
     }
 }
 
@@ -3761,11 +4848,88 @@ drm_device_has_rdev(drmDevicePtr device, dev_t find_rdev)
 }
 
 /*
- * The kernel drm core has a number of places that assume maximum of
- * 3x64 devices nodes. That's 64 for each of primary, control and
- * render nodes. Rounded it up to 256 for simplicity.
+ * Cache of the device information, one per flags combination.  It holds the
+ * drmGetDevices2() result as well as a st_rdev keyed table of the devices
+ * returned by drmGetDevice2().  Everything is dropped whenever the DRM device
+ * directory is modified, which is what happens on hotplug, or by
+ * drmInvalidateDeviceCache().
  */
-#define MAX_DRM_NODES 256
+struct drm_devices_cache {
+    bool dir_valid;
+    stat_t dir;
+    void *nodes;
+    bool valid;
+    int count;
+    drmDevicePtr devices[MAX_DRM_NODES];
+};
+
+static pthread_mutex_t drm_devices_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct drm_devices_cache drm_devices_cache[DRM_DEVICE_GET_PCI_REVISION + 1];
+
+static bool drmDirUnchanged(const stat_t *a, const stat_t *b)
+{
+    if (a->st_dev != b->st_dev || a->st_ino != b->st_ino)
+        return false;
+#ifdef __linux__
+    return a->st_mtim.tv_sec == b->st_mtim.tv_sec &&
+           a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+#else
+    return a->st_mtime == b->st_mtime;
+#endif
+}
+
+static void drmDevicesCacheFlush(struct drm_devices_cache *cache)
+{
+    unsigned long key;
+    void *value;
+
+    drmFreeDevices(cache->devices, cache->count);
+    cache->count = 0;
+    cache->valid = false;
+
+    if (cache->nodes) {
+        if (drmHashFirst(cache->nodes, &key, &value)) {
+            do {
+                drmDevicePtr device = value;
+                drmFreeDevice(&device);
+            } while (drmHashNext(cache->nodes, &key, &value));
+        }
+        drmHashDestroy(cache->nodes);
+        cache->nodes = NULL;
+    }
+
+    cache->dir_valid = false;
+}
+
+/* Drop the cache if the DRM device directory changed since it was filled */
+static void drmDevicesCacheCheck(struct drm_devices_cache *cache,
+                                 const stat_t *dir)
+{
+    if (cache->dir_valid && drmDirUnchanged(&cache->dir, dir))
+        return;
+
+    drmDevicesCacheFlush(cache);
+    cache->dir = *dir;
+    cache->dir_valid = true;
+}
+
+/**
+ * Drop the cached device information used by drmGetDevice2 and
+ * drmGetDevices2
+ *
+ * \note The cache is also dropped automatically when nodes are added to or
+ * removed from the DRM device directory, this is only needed when the
+ * information of an existing node is known to have changed.
+ */
+drm_public void drmInvalidateDeviceCache(void)
+{
+    unsigned int i;
+
+    pthread_mutex_lock(&drm_devices_cache_lock);
+    for (i = 0; i < ARRAY_SIZE(drm_devices_cache); i++)
+        drmDevicesCacheFlush(&drm_devices_cache[i]);
+    pthread_mutex_unlock(&drm_devices_cache_lock);
+}
 
 /**
  * Get information about the opened drm device
@@ -3779,6 +4943,10 @@ drm_device_has_rdev(drmDevicePtr device, dev_t find_rdev)
  *
  * \note Unlike drmGetDevice it does not retrieve the pci device revision field
  * unless the DRM_DEVICE_GET_PCI_REVISION \p flag is set.
+ *
+ * \note The result is cached per device node until the DRM device directory
+ * changes, repeated calls for the same node return a new reference to the
+ * same read-only device.  It must still be released with drmFreeDevice.
  */
 drm_public int drmGetDevice2(int fd, uint32_t flags, drmDevicePtr *device)
 {
@@ -3834,10 +5002,13 @@ drm_public int drmGetDevice2(int fd, uint32_t flags, drmDevicePtr *device)
     return 0;
 #else
     drmDevicePtr local_devices[MAX_DRM_NODES];
+    struct drm_devices_cache *cache;
     drmDevicePtr d;
     DIR *sysdir;
     struct dirent *dent;
     struct stat sbuf;
+    stat_t dir;
+    void *value;
     int subsystem_type;
     int maj, min;
     int ret, i, node_count;
@@ -3859,6 +5030,20 @@ drm_public int drmGetDevice2(int fd, uint32_t flags, drmDevicePtr *device)
     if (!drmNodeIsDRM(maj, min) || !S_ISCHR(sbuf.st_mode))
         return -EINVAL;
 
+    if (stat(DRM_DIR_NAME, &dir))
+        return -errno;
+
+    /* Fast path: the node was already described by a previous call */
+    cache = &drm_devices_cache[flags & DRM_DEVICE_GET_PCI_REVISION];
+    pthread_mutex_lock(&drm_devices_cache_lock);
+    drmDevicesCacheCheck(cache, &dir);
+    if (cache->nodes && !drmHashLookup(cache->nodes, find_rdev, &value)) {
+        *device = drmDeviceRef(value);
+        pthread_mutex_unlock(&drm_devices_cache_lock);
+        return 0;
+    }
+    pthread_mutex_unlock(&drm_devices_cache_lock);
+
     subsystem_type = drmParseSubsystemType(maj, min);
     if (subsystem_type < 0)
         return subsystem_type;
@@ -3901,6 +5086,22 @@ drm_public int drmGetDevice2(int fd, uint32_t flags, drmDevicePtr *device)
     closedir(sysdir);
     if (*device == NULL)
         return -ENODEV;
+
+    /*
+     * Only remember the result if the directory did not change while it was
+     * walked, the cache will be checked against the new state next time.
+     */
+    pthread_mutex_lock(&drm_devices_cache_lock);
+    if (cache->dir_valid && drmDirUnchanged(&cache->dir, &dir)) {
+        if (!cache->nodes)
+            cache->nodes = drmHashCreate();
+        if (cache->nodes &&
+            drmHashLookup(cache->nodes, find_rdev, &value) == 1 &&
+            drmHashInsert(cache->nodes, find_rdev, *device) == 0)
+            drmDeviceRef(*device);
+    }
+    pthread_mutex_unlock(&drm_devices_cache_lock);
+
     return 0;
 #endif
 }
@@ -3919,41 +5120,105 @@ drm_public int drmGetDevice(int fd, drmDevicePtr *device)
     return drmGetDevice2(fd, DRM_DEVICE_GET_PCI_REVISION, device);
 }
 
-/**
- * Get drm devices on the system
- *
- * \param flags feature/behaviour bitmask
- * \param devices the array of devices with drmDevicePtr elements
- *                can be NULL to get the device number first
- * \param max_devices the maximum number of devices for the array
- *
- * \return on error - negative error code,
- *         if devices is NULL - total number of devices available on the system,
- *         alternatively the number of devices stored in devices[], which is
- *         capped by the max_devices.
- *
- * \note Unlike drmGetDevices it does not retrieve the pci device revision field
- * unless the DRM_DEVICE_GET_PCI_REVISION \p flag is set.
+static char **drmDupCompatible(char **src)
+{
+    char **compatible;
+    int i, count;
+
+    for (count = 0; src[count]; count++)
+        ;
+
+    compatible = calloc(count + 1, sizeof(*compatible));
+    if (!compatible)
+        return NULL;
+
+    for (i = 0; i < count; i++) {
+        compatible[i] = strdup(src[i]);
+        if (!compatible[i]) {
+            while (i--)
+                free(compatible[i]);
+            free(compatible);
+            return NULL;
+        }
+    }
+
+    return compatible;
+}
+
+/* Make a deep copy of a device, as returned to the users of drmGetDevices2 */
+static drmDevicePtr drmDeviceDup(drmDevicePtr src)
+{
+    size_t bus_size = drmDeviceBusInfoSize(src->bustype);
+    size_t device_size = drmDeviceDeviceInfoSize(src->bustype);
+    drmDevicePtr dev;
+    char *ptr;
+    int i;
+
+    dev = drmDeviceAlloc(0, src->nodes[0], bus_size, device_size, &ptr);
+    if (!dev)
+        return NULL;
+
+    dev->available_nodes = src->available_nodes;
+    for (i = 0; i < DRM_NODE_MAX; i++)
+        memcpy(dev->nodes[i], src->nodes[i], drmGetMaxNodeName());
+
+    dev->bustype = src->bustype;
+    dev->businfo.pci = (drmPciBusInfoPtr)ptr;
+    memcpy(ptr, drmDeviceBusInfo(src), bus_size);
+
+    if (!src->deviceinfo.pci)
+        return dev;
+
+    ptr += bus_size;
+    dev->deviceinfo.pci = (drmPciDeviceInfoPtr)ptr;
+    memcpy(ptr, src->deviceinfo.pci, device_size);
+
+    switch (src->bustype) {
+    case DRM_BUS_PLATFORM:
+        if (!src->deviceinfo.platform->compatible)
+            break;
+        dev->deviceinfo.platform->compatible =
+            drmDupCompatible(src->deviceinfo.platform->compatible);
+        if (!dev->deviceinfo.platform->compatible)
+            goto free_device;
+        break;
+
+    case DRM_BUS_HOST1X:
+        if (!src->deviceinfo.host1x->compatible)
+            break;
+        dev->deviceinfo.host1x->compatible =
+            drmDupCompatible(src->deviceinfo.host1x->compatible);
+        if (!dev->deviceinfo.host1x->compatible)
+            goto free_device;
+        break;
+    }
+
+    return dev;
+
+free_device:
+    drmDeviceFreeStorage(dev);
+    return NULL;
+}
+
+/*
+ * Walk the DRM device directory and return the folded list of devices,
+ * without gaps.
  */
-drm_public int drmGetDevices2(uint32_t flags, drmDevicePtr devices[],
-                              int max_devices)
+static int drmScanDevices(uint32_t flags, bool fetch_deviceinfo,
+                          drmDevicePtr local_devices[])
 {
-    drmDevicePtr local_devices[MAX_DRM_NODES];
     drmDevicePtr device;
     DIR *sysdir;
     struct dirent *dent;
     int ret, i, node_count, device_count;
 
-    if (drm_device_validate_flags(flags))
-        return -EINVAL;
-
     sysdir = opendir(DRM_DIR_NAME);
     if (!sysdir)
         return -errno;
 
     i = 0;
     while ((dent = readdir(sysdir))) {
-        ret = process_device(&device, dent->d_name, -1, devices != NULL, flags);
+        ret = process_device(&device, dent->d_name, -1, fetch_deviceinfo, flags);
         if (ret)
             continue;
 
@@ -3968,22 +5233,91 @@ drm_public int drmGetDevices2(uint32_t flags, drmDevicePtr devices[],
     }
     node_count = i;
 
+    closedir(sysdir);
+
     drmFoldDuplicatedDevices(local_devices, node_count);
 
     device_count = 0;
     for (i = 0; i < node_count; i++) {
-        if (!local_devices[i])
-            continue;
+        if (local_devices[i])
+            local_devices[device_count++] = local_devices[i];
+    }
 
-        if ((devices != NULL) && (device_count < max_devices))
-            devices[device_count] = local_devices[i];
-        else
-            drmFreeDevice(&local_devices[i]);
+    return device_count;
+}
+
+/**
+ * Get drm devices on the system
+ *
+ * \param flags feature/behaviour bitmask
+ * \param devices the array of devices with drmDevicePtr elements
+ *                can be NULL to get the device number first
+ * \param max_devices the maximum number of devices for the array
+ *
+ * \return on error - negative error code,
+ *         if devices is NULL - total number of devices available on the system,
+ *         alternatively the number of devices stored in devices[], which is
+ *         capped by the max_devices.
+ *
+ * \note Unlike drmGetDevices it does not retrieve the pci device revision field
+ * unless the DRM_DEVICE_GET_PCI_REVISION \p flag is set.
+ *
+ * \note The result of the directory walk is cached until the DRM device
+ * directory changes, so repeated calls only copy the cached devices.
+ */
+drm_public int drmGetDevices2(uint32_t flags, drmDevicePtr devices[],
+                              int max_devices)
+{
+    drmDevicePtr local_devices[MAX_DRM_NODES];
+    struct drm_devices_cache *cache;
+    stat_t dir;
+    int ret, i, device_count;
+
+    if (drm_device_validate_flags(flags))
+        return -EINVAL;
+
+    if (stat(DRM_DIR_NAME, &dir))
+        return -errno;
 
-        device_count++;
+    cache = &drm_devices_cache[flags & DRM_DEVICE_GET_PCI_REVISION];
+
+    pthread_mutex_lock(&drm_devices_cache_lock);
+    drmDevicesCacheCheck(cache, &dir);
+
+    if (devices == NULL && !cache->valid) {
+        pthread_mutex_unlock(&drm_devices_cache_lock);
+
+        /* Counting only, skip the device info just like before caching */
+        device_count = drmScanDevices(flags, false, local_devices);
+        if (device_count > 0)
+            drmFreeDevices(local_devices, device_count);
+        return device_count;
     }
 
-    closedir(sysdir);
+    if (!cache->valid) {
+        ret = drmScanDevices(flags, true, cache->devices);
+        if (ret < 0) {
+            pthread_mutex_unlock(&drm_devices_cache_lock);
+            return ret;
+        }
+
+        cache->count = ret;
+        cache->valid = true;
+    }
+
+    device_count = cache->count;
+    if (devices != NULL) {
+        for (i = 0; i < device_count && i < max_devices; i++) {
+            devices[i] = drmDeviceDup(cache->devices[i]);
+            if (!devices[i]) {
+                drmFreeDevices(devices, i);
+                device_count = -ENOMEM;
+                break;
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&drm_devices_cache_lock);
     return device_count;
 }
 
@@ -4286,3 +5620,286 @@ drm_public int drmSyncobjTransfer(int fd,
 
     return ret;
 }
+
+drm_public int drmSyncobjEventfd(int fd, uint32_t handle, uint64_t point,
+                                 int ev_fd, uint32_t flags)
+{
+    struct drm_syncobj_eventfd args;
+
+    memclear(args);
+    args.handle = handle;
+    args.point = point;
+    args.fd = ev_fd;
+    args.flags = flags;
+
+    return drmIoctl(fd, DRM_IOCTL_SYNCOBJ_EVENTFD, &args);
+}
+
+/**
+ * Get an eventfd which becomes readable once a syncobj point is signalled
+ *
+ * \param fd file descriptor of the drm device
+ * \param handle syncobj handle
+ * \param point timeline point, zero for binary syncobjs
+ * \param flags zero, or DRM_SYNCOBJ_WAIT_FLAGS_WAIT_AVAILABLE to wait for a
+ *              fence to be available for the point instead
+ * \param ev_fd the address where the new eventfd will be stored
+ *
+ * \return zero on success, negative error code otherwise.
+ *
+ * \note The eventfd is non-blocking and close-on-exec, and can be added to an
+ * epoll set so many syncobjs can be waited for without blocking a thread.
+ * Further syncobjs can be attached to the same eventfd with
+ * drmSyncobjEventfd().  The caller owns the eventfd and must close it.
+ */
+drm_public int drmSyncobjWaitEventfd(int fd, uint32_t handle, uint64_t point,
+                                     uint32_t flags, int *ev_fd)
+{
+#ifdef __linux__
+    int efd, ret;
+
+    if (ev_fd == NULL)
+        return -EINVAL;
+
+    efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (efd < 0)
+        return -errno;
+
+    ret = drmSyncobjEventfd(fd, handle, point, efd, flags);
+    if (ret) {
+        ret = -errno;
+        close(efd);
+        return ret;
+    }
+
+    *ev_fd = efd;
+    return 0;
+#else
+    return -ENOSYS;
+#endif
+}
+
+/**
+ * Create several syncobjs
+ *
+ * \param fd file descriptor of the drm device
+ * \param flags creation flags, as for drmSyncobjCreate()
+ * \param handles array receiving \p count new handles
+ * \param count number of syncobjs to create
+ *
+ * \return zero on success, negative error code otherwise.  On failure no
+ * syncobj is left behind.
+ *
+ * \note The kernel has no array variant of the create ioctl, so this is one
+ * ioctl per syncobj.  Use a drmSyncobjPool to avoid the syscalls altogether.
+ */
+drm_public int drmSyncobjCreateN(int fd, uint32_t flags, uint32_t *handles,
+                                 uint32_t count)
+{
+    uint32_t i;
+    int ret;
+
+    for (i = 0; i < count; i++) {
+        if (drmSyncobjCreate(fd, flags, &handles[i])) {
+            ret = -errno;
+            drmSyncobjDestroyN(fd, handles, i);
+            return ret;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Destroy several syncobjs
+ *
+ * \param fd file descriptor of the drm device
+ * \param handles syncobj handles
+ * \param count number of handles
+ *
+ * \return zero on success, otherwise the negative error code of the first
+ * failure.  All handles are attempted even if some of them fail.
+ */
+drm_public int drmSyncobjDestroyN(int fd, const uint32_t *handles,
+                                  uint32_t count)
+{
+    uint32_t i;
+    int ret = 0;
+
+    for (i = 0; i < count; i++) {
+        if (drmSyncobjDestroy(fd, handles[i]) && ret == 0)
+            ret = -errno;
+    }
+    return ret;
+}
+
+/**
+ * Transfer several syncobj points
+ *
+ * Performs drmSyncobjTransfer() for each (dst, src) pair in turn.
+ *
+ * \param fd file descriptor of the drm device
+ * \param dst_handles destination syncobj handles
+ * \param dst_points destination points, or NULL for binary syncobjs
+ * \param src_handles source syncobj handles
+ * \param src_points source points, or NULL for binary syncobjs
+ * \param flags transfer flags, applied to every pair
+ * \param count number of pairs
+ *
+ * \return zero on success, negative error code otherwise.  Pairs before
+ * the failing one have already been transferred.
+ */
+drm_public int drmSyncobjTransferN(int fd,
+                                   const uint32_t *dst_handles,
+                                   const uint64_t *dst_points,
+                                   const uint32_t *src_handles,
+                                   const uint64_t *src_points,
+                                   uint32_t flags, uint32_t count)
+{
+    uint32_t i;
+
+    for (i = 0; i < count; i++) {
+        if (drmSyncobjTransfer(fd,
+                               dst_handles[i], dst_points ? dst_points[i] : 0,
+                               src_handles[i], src_points ? src_points[i] : 0,
+                               flags))
+            return -errno;
+    }
+    return 0;
+}
+
+struct _drmSyncobjPool {
+    int fd;
+    uint32_t max_free;
+    uint32_t num_free;
+    uint32_t *free;     /* reset syncobjs ready for reuse */
+    pthread_mutex_t lock;
+};
+
+/**
+ * Create a syncobj recycling pool
+ *
+ * \param fd file descriptor of the drm device
+ * \param max_free maximum number of idle syncobjs kept for reuse
+ *
+ * \return the new pool, or NULL on allocation failure.
+ */
+drm_public drmSyncobjPoolPtr drmSyncobjPoolCreate(int fd, uint32_t max_free)
+{
+    drmSyncobjPoolPtr pool;
+
+    pool = calloc(1, sizeof(*pool));
+    if (pool == NULL)
+        return NULL;
+
+    pool->free = calloc(max_free ? max_free : 1, sizeof(*pool->free));
+    if (pool->free == NULL) {
+        free(pool);
+        return NULL;
+    }
+
+    pool->fd = fd;
+    pool->max_free = max_free;
+    pthread_mutex_init(&pool->lock, NULL);
+    return pool;
+}
+
+/**
+ * Destroy a syncobj pool and the idle syncobjs it holds
+ *
+ * Syncobjs handed out by drmSyncobjPoolGet() and not returned are left
+ * alone.
+ */
+drm_public void drmSyncobjPoolDestroy(drmSyncobjPoolPtr pool)
+{
+    if (pool == NULL)
+        return;
+
+    drmSyncobjDestroyN(pool->fd, pool->free, pool->num_free);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->free);
+    free(pool);
+}
+
+/**
+ * Get syncobjs from a pool
+ *
+ * Recycled syncobjs are handed out first and new ones are only created once
+ * the pool runs dry.
+ *
+ * \param pool the syncobj pool
+ * \param flags creation flags, as for drmSyncobjCreate()
+ * \param handles array receiving \p count handles
+ * \param count number of syncobjs wanted
+ *
+ * \return zero on success, negative error code otherwise.
+ */
+drm_public int drmSyncobjPoolGet(drmSyncobjPoolPtr pool, uint32_t flags,
+                                 uint32_t *handles, uint32_t count)
+{
+    uint32_t n;
+    int ret;
+
+    pthread_mutex_lock(&pool->lock);
+    n = MIN2(count, pool->num_free);
+    pool->num_free -= n;
+    memcpy(handles, &pool->free[pool->num_free], n * sizeof(*handles));
+    pthread_mutex_unlock(&pool->lock);
+
+    /* Pooled syncobjs are unsignalled, one ioctl signals all of them. */
+    if (n && (flags & DRM_SYNCOBJ_CREATE_SIGNALED) &&
+        drmSyncobjSignal(pool->fd, handles, n)) {
+        ret = -errno;
+        drmSyncobjDestroyN(pool->fd, handles, n);
+        return ret;
+    }
+
+    ret = drmSyncobjCreateN(pool->fd, flags, &handles[n], count - n);
+    if (ret)
+        drmSyncobjPoolPut(pool, handles, n);
+    return ret;
+}
+
+/**
+ * Return syncobjs to a pool
+ *
+ * The syncobjs are reset with a single ioctl and kept for reuse, up to the
+ * pool's limit.  Any excess is destroyed.
+ *
+ * \param pool the syncobj pool
+ * \param handles syncobj handles obtained from drmSyncobjPoolGet() or
+ *                otherwise owned by the caller
+ * \param count number of handles
+ *
+ * \return zero on success, negative error code otherwise.  The handles must
+ * not be used after this call either way.
+ */
+drm_public int drmSyncobjPoolPut(drmSyncobjPoolPtr pool,
+                                 const uint32_t *handles, uint32_t count)
+{
+    uint32_t n;
+    int ret = 0;
+
+    if (count == 0)
+        return 0;
+
+    pthread_mutex_lock(&pool->lock);
+    n = MIN2(count, pool->max_free - pool->num_free);
+    if (n) {
+        if (drmSyncobjReset(pool->fd, handles, n) == 0) {
+            memcpy(&pool->free[pool->num_free], handles,
+                   n * sizeof(*handles));
+            pool->num_free += n;
+        } else {
+            ret = -errno;
+            n = 0;
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (n < count) {
+        int err = drmSyncobjDestroyN(pool->fd, &handles[n], count - n);
+        if (ret == 0)
+            ret = err;
+    }
+    return ret;
+}
@@ -586,6 +586,7 @@ extern int           drmClose(int fd);
 extern drmVersionPtr drmGetVersion(int fd);
 extern drmVersionPtr drmGetLibVersion(int fd);
 extern int           drmGetCap(int fd, uint64_t capability, uint64_t *value);
+extern int           drmSetQueryCacheEnabled(int fd, int enable);
 extern void          drmFreeVersion(drmVersionPtr);
 extern int           drmGetMagic(int fd, drm_magic_t * magic);
 extern char          *drmGetBusid(int fd);
@@ -703,6 +704,88 @@ extern int           drmScatterGatherFree(int fd, drm_handle_t handle);
 
 extern int           drmWaitVBlank(int fd, drmVBlankPtr vbl);
 
+/* ioctl statistics */
+#define DRM_IOCTL_STATS_SIZE 256 /* indexed by ioctl number */
+
+typedef struct _drmIoctlStats {
+    uint64_t count;       /* number of drmIoctl() calls */
+    uint64_t total_ns;    /* cumulative time spent, including restarts */
+    uint64_t max_ns;      /* longest single call */
+    uint64_t eintr;       /* restarts due to EINTR */
+    uint64_t eagain;      /* restarts due to EAGAIN */
+} drmIoctlStats, *drmIoctlStatsPtr;
+
+extern int           drmSetIoctlStatsEnabled(int enable);
+extern int           drmGetIoctlStats(drmIoctlStatsPtr stats, int count);
+extern void          drmResetIoctlStats(void);
+
+/*
+ * Buffer object memory held by a process through one driver library
+ * (libdrm_intel, libdrm_amdgpu, ...), filled in by its get_bo_stats()
+ * call. Cached bo's are counted as allocated too, imported ones only as
+ * imported.
+ */
+typedef struct _drmBOStats {
+    uint64_t allocated_bytes; /* bo's created by the library */
+    uint64_t allocated_count;
+    uint64_t cached_bytes;    /* freed bo's kept in its bo cache */
+    uint64_t cached_count;
+    uint64_t mapped_bytes;    /* CPU mappings of bo's */
+    uint64_t mapped_count;
+    uint64_t imported_bytes;  /* bo's opened from names, dma-bufs or user memory */
+    uint64_t imported_count;
+} drmBOStats, *drmBOStatsPtr;
+
+/* ioctl trace ring buffer */
+#define DRM_IOCTL_TRACE_MAGIC           0x544d5244 /* "DRMT" */
+#define DRM_IOCTL_TRACE_VERSION         1
+#define DRM_IOCTL_TRACE_DEFAULT_ENTRIES 65536
+
+typedef struct _drmIoctlTraceHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_entries; /* power of two */
+    uint32_t entry_size;
+    uint64_t head;        /* total number of records written */
+    int32_t  pid;
+    uint32_t pad;
+} drmIoctlTraceHeader;
+
+typedef struct _drmIoctlTraceEntry {
+    uint64_t seq;          /* record index + 1, 0 while being written */
+    uint64_t timestamp_ns; /* CLOCK_MONOTONIC at entry */
+    uint64_t duration_ns;
+    uint64_t request;
+    int32_t  fd;
+    int32_t  ret;          /* return value, or -errno on failure */
+} drmIoctlTraceEntry;
+
+extern int           drmIoctlTraceOpen(const char *path, uint32_t num_entries);
+extern void          drmIoctlTraceClose(void);
+
+/*
+ * Command submission tracing: the driver libraries report the entry and
+ * exit of each submit ioctl path, so CPU submit cost can be lined up with
+ * GPU timelines.  Atomic commits report the objects they touch as bos and
+ * their property arrays as command bytes.
+ */
+typedef struct _drmSubmitTrace {
+    const char *name;      /* submit path, e.g. "amdgpu_cs_submit" */
+    int32_t  fd;
+    uint32_t num_bos;
+    uint32_t cmd_bytes;
+    int32_t  ret;          /* end only: 0, or -errno on failure */
+    uint64_t fence;        /* end only: fence or sequence number, or 0 */
+} drmSubmitTrace, *drmSubmitTracePtr;
+
+typedef void (*drmSubmitTraceHook)(int end, const drmSubmitTrace *trace,
+                                   void *data);
+
+extern void          drmSetSubmitTraceHook(drmSubmitTraceHook hook, void *data);
+extern int           drmSetSubmitTraceMarker(int enable);
+extern void          drmSubmitTraceBegin(const drmSubmitTrace *trace);
+extern void          drmSubmitTraceEnd(const drmSubmitTrace *trace);
+
 /* Support routines */
 extern void          drmSetServerInfo(drmServerInfoPtr info);
 extern int           drmError(int err, const char *label);
@@ -717,6 +800,16 @@ extern int  drmHashInsert(void *t, unsigned long key, void *value);
 extern int  drmHashDelete(void *t, unsigned long key);
 extern int  drmHashFirst(void *t, unsigned long *key, void **value);
 extern int  drmHashNext(void *t, unsigned long *key, void **value);
+extern int  drmHashReserve(void *t, unsigned long count);
+
+/* Open-addressing uint32_t -> pointer map routines */
+extern void     *drmIntMapCreate(void);
+extern int      drmIntMapDestroy(void *m);
+extern int      drmIntMapLookup(void *m, uint32_t key, void **value);
+extern int      drmIntMapInsert(void *m, uint32_t key, void *value);
+extern int      drmIntMapDelete(void *m, uint32_t key);
+extern int      drmIntMapReserve(void *m, uint32_t count);
+extern uint32_t drmIntMapCount(void *m);
 
 /* PRNG routines */
 extern void          *drmRandomCreate(unsigned long seed);
@@ -781,6 +874,35 @@ typedef struct _drmEventContext {
 } drmEventContext, *drmEventContextPtr;
 
 extern int drmHandleEvent(int fd, drmEventContextPtr evctx);
+extern int drmHandleEvents2(int fd, drmEventContextPtr evctx,
+			    void *buffer, size_t size);
+
+/*
+ * Event loop that demultiplexes vblank, page flip and CRTC sequence events
+ * by CRTC.  Timestamps are CLOCK_MONOTONIC nanoseconds.
+ */
+typedef struct _drmEventLoopHandlers {
+	void (*vblank_handler)(int fd, uint32_t crtc_id, uint64_t sequence,
+			       uint64_t ns, void *user_data);
+	void (*page_flip_handler)(int fd, uint32_t crtc_id, uint64_t sequence,
+				  uint64_t ns, void *user_data);
+	void (*sequence_handler)(int fd, uint32_t crtc_id, uint64_t sequence,
+				 uint64_t ns, void *user_data);
+} drmEventLoopHandlers;
+
+typedef struct _drmEventLoop drmEventLoop, *drmEventLoopPtr;
+
+extern drmEventLoopPtr drmEventLoopCreate(int fd,
+					  const drmEventContext *fallback);
+extern void drmEventLoopDestroy(drmEventLoopPtr loop);
+extern int drmEventLoopGetFd(drmEventLoopPtr loop);
+extern int drmEventLoopSetCrtcHandlers(drmEventLoopPtr loop, uint32_t crtc_id,
+				       const drmEventLoopHandlers *handlers);
+extern int drmEventLoopQueueSequence(drmEventLoopPtr loop, uint32_t crtc_id,
+				     uint32_t flags, uint64_t sequence,
+				     uint64_t *sequence_queued,
+				     void *user_data);
+extern int drmEventLoopDispatch(drmEventLoopPtr loop);
 
 extern char *drmGetDeviceNameFromFd(int fd);
 
@@ -792,6 +914,10 @@ extern int drmGetNodeTypeFromFd(int fd);
 
 extern int drmPrimeHandleToFD(int fd, uint32_t handle, uint32_t flags, int *prime_fd);
 extern int drmPrimeFDToHandle(int fd, int prime_fd, uint32_t *handle);
+extern int drmPrimeFDToHandleCached(int fd, int prime_fd, uint32_t *handle,
+                                    uint64_t *size);
+extern void drmPrimeCacheForget(int fd, uint32_t handle);
+extern void drmPrimeCacheDrop(int fd);
 
 extern char *drmGetPrimaryDeviceNameFromFd(int fd);
 extern char *drmGetRenderDeviceNameFromFd(int fd);
@@ -873,6 +999,7 @@ extern void drmFreeDevices(drmDevicePtr devices[], int count);
 #define DRM_DEVICE_GET_PCI_REVISION (1 << 0)
 extern int drmGetDevice2(int fd, uint32_t flags, drmDevicePtr *device);
 extern int drmGetDevices2(uint32_t flags, drmDevicePtr devices[], int max_devices);
+extern void drmInvalidateDeviceCache(void);
 
 extern int drmDevicesEqual(drmDevicePtr a, drmDevicePtr b);
 
@@ -902,6 +1029,28 @@ extern int drmSyncobjTransfer(int fd,
 			      uint32_t dst_handle, uint64_t dst_point,
 			      uint32_t src_handle, uint64_t src_point,
 			      uint32_t flags);
+extern int drmSyncobjEventfd(int fd, uint32_t handle, uint64_t point,
+			     int ev_fd, uint32_t flags);
+extern int drmSyncobjWaitEventfd(int fd, uint32_t handle, uint64_t point,
+				 uint32_t flags, int *ev_fd);
+extern int drmSyncobjCreateN(int fd, uint32_t flags, uint32_t *handles,
+			     uint32_t count);
+extern int drmSyncobjDestroyN(int fd, const uint32_t *handles, uint32_t count);
+extern int drmSyncobjTransferN(int fd,
+			       const uint32_t *dst_handles,
+			       const uint64_t *dst_points,
+			       const uint32_t *src_handles,
+			       const uint64_t *src_points,
+			       uint32_t flags, uint32_t count);
+
+typedef struct _drmSyncobjPool *drmSyncobjPoolPtr;
+
+extern drmSyncobjPoolPtr drmSyncobjPoolCreate(int fd, uint32_t max_free);
+extern void drmSyncobjPoolDestroy(drmSyncobjPoolPtr pool);
+extern int drmSyncobjPoolGet(drmSyncobjPoolPtr pool, uint32_t flags,
+			     uint32_t *handles, uint32_t count);
+extern int drmSyncobjPoolPut(drmSyncobjPoolPtr pool,
+			     const uint32_t *handles, uint32_t count);
 
 #if defined(__cplusplus)
 }
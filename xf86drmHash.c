@@ -27,9 +27,9 @@
  *
  * DESCRIPTION
  *
- * This file contains a straightforward implementation of a fixed-sized
+ * This file contains a straightforward implementation of a dynamic
  * hash table using self-organizing linked lists [Knuth73, pp. 398-399] for
- * collision resolution.  There are two potentially interesting things
+ * collision resolution.  There are three potentially interesting things
  * about this implementation:
  *
  * 1) The table is power-of-two sized.  Prime sized tables are more
@@ -40,19 +40,14 @@
  * 2) The hash computation uses a table of random integers [Hanson97,
  * pp. 39-41].
  *
- * FUTURE ENHANCEMENTS
- *
- * With a table size of 512, the current implementation is sufficient for a
- * few hundred keys.  Since this is well above the expected size of the
- * tables for which this implementation was designed, the implementation of
- * dynamic hash tables was postponed until the need arises.  A common (and
- * naive) approach to dynamic hash table implementation simply creates a
- * new hash table when necessary, rehashes all the data into the new table,
- * and destroys the old table.  The approach in [Larson88] is superior in
- * two ways: 1) only a portion of the table is expanded when needed,
- * distributing the expansion cost over several insertions, and 2) portions
- * of the table can be locked, enabling a scalable thread-safe
- * implementation.
+ * 3) The table grows with linear hashing [Larson88].  The table starts
+ * with HASH_SIZE buckets, and whenever the load exceeds HASH_LOAD entries
+ * per bucket the bucket pointed to by the split pointer is split in two.
+ * Only that one bucket is rehashed, so the expansion cost is distributed
+ * over the insertions instead of rehashing the whole table at once.  Once
+ * every bucket of a round has been split the table size has doubled and
+ * the next round starts.  drmHashReserve() can be used to do the splits up
+ * front when the number of keys is known.
  *
  * REFERENCES
  *
@@ -98,17 +93,76 @@ static unsigned long HashHash(unsigned long key)
 	tmp >>= 8;
     }
 
-    hash %= HASH_SIZE;
     return hash;
 }
 
+/* Map a hash value to one of the buckets currently in use */
+static unsigned long HashBucketIndex(HashTablePtr table, unsigned long hash)
+{
+    unsigned long index = hash & (table->maxp - 1);
+
+    if (index < table->split)
+	index = hash & (2 * table->maxp - 1);
+    return index;
+}
+
+/* Split the bucket at the split pointer, growing the table by one bucket */
+static int HashSplit(HashTablePtr table)
+{
+    HashBucketPtr bucket, next, *old, *new;
+
+    if (table->size == table->allocated) {
+	HashBucketPtr *buckets;
+	unsigned long i;
+
+	buckets = realloc(table->buckets,
+			  2 * table->allocated * sizeof(*buckets));
+	if (!buckets) return -1;
+	for (i = table->allocated; i < 2 * table->allocated; i++)
+	    buckets[i] = NULL;
+	table->buckets   = buckets;
+	table->allocated = 2 * table->allocated;
+    }
+
+    old    = &table->buckets[table->split];
+    new    = &table->buckets[table->split + table->maxp];
+    bucket = *old;
+    *old   = NULL;
+
+    for (; bucket; bucket = next) {
+	next = bucket->next;
+	if (HashHash(bucket->key) & table->maxp) {
+	    bucket->next = *new;
+	    *new         = bucket;
+	} else {
+	    bucket->next = *old;
+	    *old         = bucket;
+	}
+    }
+
+    ++table->size;
+    if (++table->split == table->maxp) {
+	table->maxp  *= 2;
+	table->split  = 0;
+    }
+    return 0;
+}
+
 drm_public void *drmHashCreate(void)
 {
     HashTablePtr table;
 
     table           = drmMalloc(sizeof(*table));
     if (!table) return NULL;
-    table->magic    = HASH_MAGIC;
+    table->buckets  = calloc(HASH_SIZE, sizeof(*table->buckets));
+    if (!table->buckets) {
+	drmFree(table);
+	return NULL;
+    }
+    table->magic     = HASH_MAGIC;
+    table->size      = HASH_SIZE;
+    table->maxp      = HASH_SIZE;
+    table->allocated = HASH_SIZE;
 
     return table;
 }
@@ -118,28 +172,41 @@ drm_public int drmHashDestroy(void *t)
     HashTablePtr  table = (HashTablePtr)t;
     HashBucketPtr bucket;
     HashBucketPtr next;
-    int           i;
+    unsigned long i;
 
     if (table->magic != HASH_MAGIC) return -1; /* Bad magic */
 
-    for (i = 0; i < HASH_SIZE; i++) {
+    for (i = 0; i < table->size; i++) {
 	for (bucket = table->buckets[i]; bucket;) {
 	    next = bucket->next;
 	    drmFree(bucket);
 	    bucket = next;
 	}
     }
+    free(table->buckets);
     drmFree(table);
     return 0;
 }
 
+drm_public int drmHashReserve(void *t, unsigned long count)
+{
+    HashTablePtr  table = (HashTablePtr)t;
+
+    if (table->magic != HASH_MAGIC) return -1; /* Bad magic */
+
+    while (count > table->size * HASH_LOAD) {
+	if (HashSplit(table)) return -1;
+    }
+    return 0;
+}
+
 /* Find the bucket and organize the list so that this bucket is at the
    top. */
 
 static HashBucketPtr HashFind(HashTablePtr table,
 			      unsigned long key, unsigned long *h)
 {
-    unsigned long hash = HashHash(key);
+    unsigned long hash = HashBucketIndex(table, HashHash(key));
     HashBucketPtr prev = NULL;
     HashBucketPtr bucket;
 
@@ -193,6 +260,10 @@ drm_public int drmHashInsert(void *t, unsigned long key, void *value)
     bucket->value        = value;
     bucket->next         = table->buckets[hash];
     table->buckets[hash] = bucket;
+    ++table->entries;
+
+    /* Failing to grow is not fatal, the chains just get longer */
+    if (table->entries > table->size * HASH_LOAD) HashSplit(table);
     return 0;			/* Added to table */
 }
 
@@ -210,6 +281,7 @@ drm_public int drmHashDelete(void *t, unsigned long key)
 
     table->buckets[hash] = bucket->next;
     drmFree(bucket);
+    --table->entries;
     return 0;
 }
 
@@ -217,7 +289,7 @@ drm_public int drmHashNext(void *t, unsigned long *key, void **value)
 {
     HashTablePtr  table = (HashTablePtr)t;
 
-    while (table->p0 < HASH_SIZE) {
+    while (table->p0 < table->size) {
 	if (table->p1) {
 	    *key       = table->p1->key;
 	    *value     = table->p1->value;
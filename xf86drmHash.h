@@ -24,10 +24,9 @@
  * Authors: Rickard E. (Rik) Faith <faith@valinux.com>
  */
 
-#define HASH_SIZE  512		/* Good for about 100 entries */
-				/* If you change this value, you probably
-                                   have to change the HashHash hashing
-                                   function! */
+#define HASH_SIZE  512		/* Initial number of buckets */
+#define HASH_LOAD  1		/* Split a bucket above this many entries
+				   per bucket */
 
 typedef struct HashBucket {
     unsigned long     key;
@@ -41,7 +40,11 @@ typedef struct HashTable {
     unsigned long    hits;	/* At top of linked list */
     unsigned long    partials;	/* Not at top of linked list */
     unsigned long    misses;	/* Not in table */
-    HashBucketPtr    buckets[HASH_SIZE];
-    int              p0;
+    HashBucketPtr    *buckets;
+    unsigned long    size;	/* Buckets in use: maxp + split */
+    unsigned long    maxp;	/* Buckets at the start of this round */
+    unsigned long    split;	/* Next bucket to be split */
+    unsigned long    allocated;	/* Allocated length of buckets */
+    unsigned long    p0;
     HashBucketPtr    p1;
 } HashTable, *HashTablePtr;
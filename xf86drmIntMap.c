@@ -0,0 +1,249 @@
+/* xf86drmIntMap.c -- Open-addressing hash map for uint32_t -> pointer mapping
+ *
+ * Copyright © 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * DESCRIPTION
+ *
+ * This file contains a hash map intended for the handle -> object tables
+ * of the driver libraries, where the keys are small, dense 32-bit GEM
+ * handles or flink names.  Unlike the drmHash tables it does not chain
+ * buckets and it never modifies the table on lookup, so lookups touch a
+ * single cache line in the common case and can run concurrently as long as
+ * writers are serialized against them.
+ *
+ * 1) Collisions are resolved with linear probing in a power-of-two sized
+ * slot array.  The home slot of a key is computed with Fibonacci
+ * (multiplicative) hashing [Knuth73, pp. 516-518].
+ *
+ * 2) Deletion uses backward shifting [Knuth73, Algorithm R, p. 527]
+ * instead of tombstones, so the probe sequences never degrade over time.
+ *
+ * 3) The table is grown (and completely rehashed) once it is half full,
+ * drmIntMapReserve() can be used to avoid rehashing when the number of keys
+ * is known up front.
+ *
+ * REFERENCES
+ *
+ * [Knuth73] Donald E. Knuth. The Art of Computer Programming.  Volume 3:
+ * Sorting and Searching.  Reading, Massachusetts: Addison-Wesley, 1973.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "libdrm_macros.h"
+#include "xf86drm.h"
+
+#define INTMAP_MAGIC    0x1a7ea9b0
+#define INTMAP_MIN_BITS 4
+
+typedef struct IntMapSlot {
+    void     *value;
+    uint32_t key;
+    uint32_t used;
+} IntMapSlot;
+
+typedef struct IntMap {
+    unsigned long magic;
+    uint32_t      bits;     /* log2 of the number of slots */
+    uint32_t      entries;
+    IntMapSlot    *slots;
+} IntMap, *IntMapPtr;
+
+static uint32_t IntMapHome(IntMapPtr map, uint32_t key)
+{
+    return (uint32_t)(key * 2654435769u) >> (32 - map->bits);
+}
+
+static uint32_t IntMapMask(IntMapPtr map)
+{
+    return (1u << map->bits) - 1;
+}
+
+/* Return the slot holding key, or the empty slot where it would go */
+static IntMapSlot *IntMapFind(IntMapPtr map, uint32_t key)
+{
+    uint32_t mask = IntMapMask(map);
+    uint32_t i = IntMapHome(map, key);
+
+    while (map->slots[i].used && map->slots[i].key != key)
+        i = (i + 1) & mask;
+
+    return &map->slots[i];
+}
+
+static int IntMapResize(IntMapPtr map, uint32_t bits)
+{
+    IntMapSlot *old = map->slots;
+    uint32_t    old_size = 1u << map->bits;
+    uint32_t    i;
+
+    map->slots = calloc(1u << bits, sizeof(*map->slots));
+    if (!map->slots) {
+        map->slots = old;
+        return -1;
+    }
+    map->bits = bits;
+
+    for (i = 0; i < old_size; i++) {
+        if (old[i].used)
+            *IntMapFind(map, old[i].key) = old[i];
+    }
+
+    free(old);
+    return 0;
+}
+
+drm_public void *drmIntMapCreate(void)
+{
+    IntMapPtr map;
+
+    map = drmMalloc(sizeof(*map));
+    if (!map)
+        return NULL;
+
+    map->slots = calloc(1u << INTMAP_MIN_BITS, sizeof(*map->slots));
+    if (!map->slots) {
+        drmFree(map);
+        return NULL;
+    }
+    map->magic = INTMAP_MAGIC;
+    map->bits  = INTMAP_MIN_BITS;
+
+    return map;
+}
+
+drm_public int drmIntMapDestroy(void *m)
+{
+    IntMapPtr map = (IntMapPtr)m;
+
+    if (!map || map->magic != INTMAP_MAGIC)
+        return -1; /* Bad magic */
+
+    free(map->slots);
+    drmFree(map);
+    return 0;
+}
+
+drm_public int drmIntMapReserve(void *m, uint32_t count)
+{
+    IntMapPtr map = (IntMapPtr)m;
+    uint32_t  bits;
+
+    if (!map || map->magic != INTMAP_MAGIC)
+        return -1; /* Bad magic */
+
+    /* Keep the load factor at or below 1/2 */
+    for (bits = map->bits; bits < 31 && (1u << (bits - 1)) < count; bits++)
+        ;
+
+    if (bits == map->bits)
+        return 0;
+    return IntMapResize(map, bits);
+}
+
+drm_public int drmIntMapLookup(void *m, uint32_t key, void **value)
+{
+    IntMapPtr   map = (IntMapPtr)m;
+    IntMapSlot *slot;
+
+    if (!map || map->magic != INTMAP_MAGIC)
+        return -1; /* Bad magic */
+
+    slot = IntMapFind(map, key);
+    if (!slot->used)
+        return 1; /* Not found */
+
+    *value = slot->value;
+    return 0; /* Found */
+}
+
+drm_public int drmIntMapInsert(void *m, uint32_t key, void *value)
+{
+    IntMapPtr   map = (IntMapPtr)m;
+    IntMapSlot *slot;
+
+    if (!map || map->magic != INTMAP_MAGIC)
+        return -1; /* Bad magic */
+
+    slot = IntMapFind(map, key);
+    if (slot->used)
+        return 1; /* Already in map */
+
+    if (map->entries + 1 > (1u << (map->bits - 1))) {
+        if (IntMapResize(map, map->bits + 1))
+            return -1; /* Error */
+        slot = IntMapFind(map, key);
+    }
+
+    slot->key   = key;
+    slot->value = value;
+    slot->used  = 1;
+    map->entries++;
+    return 0; /* Added to map */
+}
+
+drm_public int drmIntMapDelete(void *m, uint32_t key)
+{
+    IntMapPtr   map = (IntMapPtr)m;
+    IntMapSlot *slot;
+    uint32_t    mask, hole, i;
+
+    if (!map || map->magic != INTMAP_MAGIC)
+        return -1; /* Bad magic */
+
+    slot = IntMapFind(map, key);
+    if (!slot->used)
+        return 1; /* Not found */
+
+    mask = IntMapMask(map);
+    hole = slot - map->slots;
+
+    /*
+     * Shift back every following entry of the cluster whose home slot is
+     * not between the hole and its current position, so no lookup ever
+     * stops early at the hole.
+     */
+    for (i = (hole + 1) & mask; map->slots[i].used; i = (i + 1) & mask) {
+        uint32_t home = IntMapHome(map, map->slots[i].key);
+
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            map->slots[hole] = map->slots[i];
+            hole = i;
+        }
+    }
+
+    map->slots[hole].used  = 0;
+    map->slots[hole].value = NULL;
+    map->entries--;
+    return 0;
+}
+
+drm_public uint32_t drmIntMapCount(void *m)
+{
+    IntMapPtr map = (IntMapPtr)m;
+
+    if (!map || map->magic != INTMAP_MAGIC)
+        return 0;
+
+    return map->entries;
+}
@@ -49,13 +49,18 @@
 #include <stdbool.h>
 
 #include "libdrm_macros.h"
+#include "util_double_list.h"
+#include "util_math.h"
 #include "xf86drmMode.h"
 #include "xf86drm.h"
 #include <drm.h>
+#include <drm_fourcc.h>
 #include <string.h>
 #include <dirent.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 
 #define memclear(s) memset(&s, 0, sizeof(s))
 
@@ -245,6 +250,66 @@ err_allocs:
 	return r;
 }
 
+/*
+ * Copy a count the kernel may have raised back to the caller, noting whether
+ * it still fits the capacity the caller passed in.
+ */
+static int drm_count_fits(uint32_t capacity, uint32_t count, int *out)
+{
+	*out = count;
+	return count <= capacity;
+}
+
+/*
+ * Fill a caller-owned drmModeRes in a single ioctl.  On entry the count_*
+ * fields give the capacity of the arrays pointed to by fbs, crtcs,
+ * connectors and encoders; on return they hold the actual counts.  Returns
+ * 0 on success, -ENOSPC if an array was too small (the counts then say how
+ * much room is needed), or a negative error code.  The result must not be
+ * passed to drmModeFreeResources().
+ */
+drm_public int drmModeGetResourcesInto(int fd, drmModeResPtr r)
+{
+	struct drm_mode_card_res res;
+	uint32_t count_fbs, count_crtcs, count_connectors, count_encoders;
+	int fits;
+
+	if (!r)
+		return -EINVAL;
+
+	count_fbs = r->fbs ? MAX2(r->count_fbs, 0) : 0;
+	count_crtcs = r->crtcs ? MAX2(r->count_crtcs, 0) : 0;
+	count_connectors = r->connectors ? MAX2(r->count_connectors, 0) : 0;
+	count_encoders = r->encoders ? MAX2(r->count_encoders, 0) : 0;
+
+	memclear(res);
+	res.fb_id_ptr = VOID2U64(r->fbs);
+	res.count_fbs = count_fbs;
+	res.crtc_id_ptr = VOID2U64(r->crtcs);
+	res.count_crtcs = count_crtcs;
+	res.connector_id_ptr = VOID2U64(r->connectors);
+	res.count_connectors = count_connectors;
+	res.encoder_id_ptr = VOID2U64(r->encoders);
+	res.count_encoders = count_encoders;
+
+	if (drmIoctl(fd, DRM_IOCTL_MODE_GETRESOURCES, &res))
+		return -errno;
+
+	fits = drm_count_fits(count_fbs, res.count_fbs, &r->count_fbs);
+	fits &= drm_count_fits(count_crtcs, res.count_crtcs, &r->count_crtcs);
+	fits &= drm_count_fits(count_connectors, res.count_connectors,
+			       &r->count_connectors);
+	fits &= drm_count_fits(count_encoders, res.count_encoders,
+			       &r->count_encoders);
+
+	r->min_width     = res.min_width;
+	r->max_width     = res.max_width;
+	r->min_height    = res.min_height;
+	r->max_height    = res.max_height;
+
+	return fits ? 0 : -ENOSPC;
+}
+
 
 drm_public int drmModeAddFB(int fd, uint32_t width, uint32_t height, uint8_t depth,
                             uint8_t bpp, uint32_t pitch, uint32_t bo_handle,
@@ -335,6 +400,38 @@ drm_public drmModeFBPtr drmModeGetFB(int fd, uint32_t buf)
 	return r;
 }
 
+drm_public drmModeFB2Ptr drmModeGetFB2(int fd, uint32_t buf)
+{
+	struct drm_mode_fb_cmd2 info;
+	drmModeFB2Ptr r;
+
+	memclear(info);
+	info.fb_id = buf;
+
+	if (drmIoctl(fd, DRM_IOCTL_MODE_GETFB2, &info))
+		return NULL;
+
+	if (!(r = drmMalloc(sizeof(*r))))
+		return NULL;
+
+	r->fb_id = info.fb_id;
+	r->width = info.width;
+	r->height = info.height;
+	r->pixel_format = info.pixel_format;
+	r->modifier = info.modifier[0];
+	r->flags = info.flags;
+	memcpy(r->handles, info.handles, sizeof(r->handles));
+	memcpy(r->pitches, info.pitches, sizeof(r->pitches));
+	memcpy(r->offsets, info.offsets, sizeof(r->offsets));
+
+	return r;
+}
+
+drm_public void drmModeFreeFB2(drmModeFB2Ptr ptr)
+{
+	drmFree(ptr);
+}
+
 drm_public int drmModeDirtyFB(int fd, uint32_t bufferId,
 		   drmModeClipPtr clips, uint32_t num_clips)
 {
@@ -600,6 +697,65 @@ drm_public drmModeConnectorPtr drmModeGetConnectorCurrent(int fd, uint32_t conne
 	return _drmModeGetConnector(fd, connector_id, 0);
 }
 
+/*
+ * Fill a caller-owned drmModeConnector in a single ioctl, without forcing a
+ * probe, like drmModeGetConnectorCurrent().  The count_* fields give the
+ * capacity of the modes, props/prop_values and encoders arrays on entry and
+ * the actual counts on return.  Returns 0 on success, -ENOSPC if an array
+ * was too small, or a negative error code.
+ */
+drm_public int drmModeGetConnectorCurrentInto(int fd, uint32_t connector_id,
+					      drmModeConnectorPtr r)
+{
+	struct drm_mode_get_connector conn;
+	struct drm_mode_modeinfo stack_mode;
+	uint32_t count_modes, count_props, count_encoders;
+	int fits;
+
+	if (!r)
+		return -EINVAL;
+
+	count_modes = r->modes ? MAX2(r->count_modes, 0) : 0;
+	count_props = r->props && r->prop_values ? MAX2(r->count_props, 0) : 0;
+	count_encoders = r->encoders ? MAX2(r->count_encoders, 0) : 0;
+
+	memclear(conn);
+	conn.connector_id = connector_id;
+	conn.props_ptr = VOID2U64(r->props);
+	conn.prop_values_ptr = VOID2U64(r->prop_values);
+	conn.count_props = count_props;
+	conn.encoders_ptr = VOID2U64(r->encoders);
+	conn.count_encoders = count_encoders;
+	/* A zero mode count would make the kernel probe the connector. */
+	if (count_modes) {
+		conn.modes_ptr = VOID2U64(r->modes);
+		conn.count_modes = count_modes;
+	} else {
+		conn.modes_ptr = VOID2U64(&stack_mode);
+		conn.count_modes = 1;
+	}
+
+	if (drmIoctl(fd, DRM_IOCTL_MODE_GETCONNECTOR, &conn))
+		return -errno;
+
+	fits = drm_count_fits(count_modes, conn.count_modes, &r->count_modes);
+	fits &= drm_count_fits(count_props, conn.count_props, &r->count_props);
+	fits &= drm_count_fits(count_encoders, conn.count_encoders,
+			       &r->count_encoders);
+
+	r->connector_id = conn.connector_id;
+	r->encoder_id = conn.encoder_id;
+	r->connection   = conn.connection;
+	r->mmWidth      = conn.mm_width;
+	r->mmHeight     = conn.mm_height;
+	/* convert subpixel from kernel to userspace */
+	r->subpixel     = conn.subpixel + 1;
+	r->connector_type  = conn.connector_type;
+	r->connector_type_id = conn.connector_type_id;
+
+	return fits ? 0 : -ENOSPC;
+}
+
 drm_public int drmModeAttachMode(int fd, uint32_t connector_id, drmModeModeInfoPtr mode_info)
 {
 	struct drm_mode_mode_cmd res;
@@ -887,14 +1043,61 @@ drm_public int drmModeCrtcSetGamma(int fd, uint32_t crtc_id, uint32_t size,
 	return DRM_IOCTL(fd, DRM_IOCTL_MODE_SETGAMMA, &l);
 }
 
+static void drmDispatchEvent(int fd, drmEventContextPtr evctx,
+			     struct drm_event *e)
+{
+	struct drm_event_vblank *vblank;
+	struct drm_event_crtc_sequence *seq;
+	void *user_data;
+
+	switch (e->type) {
+	case DRM_EVENT_VBLANK:
+		if (evctx->version < 1 ||
+		    evctx->vblank_handler == NULL)
+			break;
+		vblank = (struct drm_event_vblank *) e;
+		evctx->vblank_handler(fd,
+				      vblank->sequence,
+				      vblank->tv_sec,
+				      vblank->tv_usec,
+				      U642VOID (vblank->user_data));
+		break;
+	case DRM_EVENT_FLIP_COMPLETE:
+		vblank = (struct drm_event_vblank *) e;
+		user_data = U642VOID (vblank->user_data);
+
+		if (evctx->version >= 3 && evctx->page_flip_handler2)
+			evctx->page_flip_handler2(fd,
+						 vblank->sequence,
+						 vblank->tv_sec,
+						 vblank->tv_usec,
+						 vblank->crtc_id,
+						 user_data);
+		else if (evctx->version >= 2 && evctx->page_flip_handler)
+			evctx->page_flip_handler(fd,
+						 vblank->sequence,
+						 vblank->tv_sec,
+						 vblank->tv_usec,
+						 user_data);
+		break;
+	case DRM_EVENT_CRTC_SEQUENCE:
+		seq = (struct drm_event_crtc_sequence *) e;
+		if (evctx->version >= 4 && evctx->sequence_handler)
+			evctx->sequence_handler(fd,
+						seq->sequence,
+						seq->time_ns,
+						seq->user_data);
+		break;
+	default:
+		break;
+	}
+}
+
 drm_public int drmHandleEvent(int fd, drmEventContextPtr evctx)
 {
 	char buffer[1024];
 	int len, i;
 	struct drm_event *e;
-	struct drm_event_vblank *vblank;
-	struct drm_event_crtc_sequence *seq;
-	void *user_data;
 
 	/* The DRM read semantics guarantees that we always get only
 	 * complete events. */
@@ -908,53 +1111,364 @@ drm_public int drmHandleEvent(int fd, drmEventContextPtr evctx)
 	i = 0;
 	while (i < len) {
 		e = (struct drm_event *)(buffer + i);
-		switch (e->type) {
-		case DRM_EVENT_VBLANK:
-			if (evctx->version < 1 ||
-			    evctx->vblank_handler == NULL)
-				break;
-			vblank = (struct drm_event_vblank *) e;
-			evctx->vblank_handler(fd,
-					      vblank->sequence,
-					      vblank->tv_sec,
-					      vblank->tv_usec,
-					      U642VOID (vblank->user_data));
-			break;
-		case DRM_EVENT_FLIP_COMPLETE:
-			vblank = (struct drm_event_vblank *) e;
-			user_data = U642VOID (vblank->user_data);
-
-			if (evctx->version >= 3 && evctx->page_flip_handler2)
-				evctx->page_flip_handler2(fd,
-							 vblank->sequence,
-							 vblank->tv_sec,
-							 vblank->tv_usec,
-							 vblank->crtc_id,
-							 user_data);
-			else if (evctx->version >= 2 && evctx->page_flip_handler)
-				evctx->page_flip_handler(fd,
-							 vblank->sequence,
-							 vblank->tv_sec,
-							 vblank->tv_usec,
-							 user_data);
-			break;
-		case DRM_EVENT_CRTC_SEQUENCE:
-			seq = (struct drm_event_crtc_sequence *) e;
-			if (evctx->version >= 4 && evctx->sequence_handler)
-				evctx->sequence_handler(fd,
-							seq->sequence,
-							seq->time_ns,
-							seq->user_data);
+		drmDispatchEvent(fd, evctx, e);
+		i += e->length;
+	}
+
+	return 0;
+}
+
+/* Largest event the core DRM sends. */
+#define DRM_EVENT_MAX_SIZE \
+	MAX2(sizeof(struct drm_event_vblank), \
+	     sizeof(struct drm_event_crtc_sequence))
+
+/*
+ * Read and dispatch events until the queue is empty.  With \p may_block
+ * clear a blocking fd is polled before every read, otherwise only from the
+ * second read on.  Returns the number of events dispatched, or -1 with errno
+ * set on failure.
+ */
+static int drmReadEvents(int fd, void *buffer, size_t size, int may_block,
+			 void (*dispatch)(int fd, struct drm_event *e,
+					  void *data),
+			 void *data)
+{
+	int count = 0, nonblock = -1;
+	ssize_t len, i;
+	struct drm_event *e;
+	struct pollfd pfd;
+	int flags;
+
+	for (;;) {
+		if (!may_block) {
+			if (nonblock < 0) {
+				flags = fcntl(fd, F_GETFL);
+				nonblock = flags >= 0 && (flags & O_NONBLOCK);
+			}
+			if (!nonblock) {
+				pfd.fd = fd;
+				pfd.events = POLLIN;
+				pfd.revents = 0;
+				if (poll(&pfd, 1, 0) <= 0)
+					break;
+			}
+		}
+
+		len = read(fd, buffer, size);
+		if (len < 0)
+			return errno == EAGAIN ? count : -1;
+		if (len == 0)
 			break;
-		default:
+		if (len < (ssize_t)sizeof *e)
+			return -1;
+
+		/* Events are dispatched straight out of the read buffer, in
+		 * the order the kernel queued them. */
+		for (i = 0; i < len; i += e->length) {
+			e = (struct drm_event *)((char *)buffer + i);
+			dispatch(fd, e, data);
+			count++;
+		}
+
+		/* The kernel only stops filling the buffer early when the
+		 * queue is empty or the next event doesn't fit, so a read
+		 * with room to spare has drained everything. */
+		if (size - len >= DRM_EVENT_MAX_SIZE)
 			break;
+
+		/* More may be queued, but don't block to find out. */
+		may_block = 0;
+	}
+
+	return count;
+}
+
+static void drmDispatchEventContext(int fd, struct drm_event *e, void *data)
+{
+	drmDispatchEvent(fd, data, e);
+}
+
+/*
+ * Like drmHandleEvent(), but keeps reading until the event queue is empty so
+ * that a single wakeup handles everything that is pending.  Events are read
+ * into \p buffer (or a 4 KiB stack buffer when it is NULL) and dispatched
+ * from there in kernel order.  Blocking fds are never blocked on once the
+ * first read has returned.  Returns the number of events dispatched, or -1
+ * with errno set on failure.
+ */
+drm_public int drmHandleEvents2(int fd, drmEventContextPtr evctx,
+				void *buffer, size_t size)
+{
+	char stack[4096];
+	struct drm_event *e;
+
+	if (buffer == NULL) {
+		buffer = stack;
+		size = sizeof stack;
+	}
+	if (size < sizeof *e) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return drmReadEvents(fd, buffer, size, 1, drmDispatchEventContext,
+			     evctx);
+}
+
+/*
+ * Event loop with per-CRTC handlers.
+ */
+
+/* Tags the user_data of sequence events queued through a loop. */
+#define DRM_EVENT_LOOP_SEQ_TAG 0x64726d6cull
+
+struct drm_event_loop_seq {
+	uint32_t crtc_id;
+	void *user_data;
+};
+
+struct _drmEventLoop {
+	int fd;
+	drmEventContext fallback;
+	void *crtcs;			/* crtc_id -> drmEventLoopHandlers */
+	void *seqs;			/* serial -> drm_event_loop_seq */
+	uint32_t seq_serial;
+	uint32_t last_crtc_id;		/* one entry lookup cache */
+	drmEventLoopHandlers *last_handlers;
+	char buffer[4096];
+};
+
+/*
+ * Create an event loop for @fd.  Events for CRTCs without handlers, and
+ * sequence events not queued through the loop, go to @fallback if it isn't
+ * NULL.  Returns NULL with errno set on failure.
+ */
+drm_public drmEventLoopPtr drmEventLoopCreate(int fd,
+					      const drmEventContext *fallback)
+{
+	drmEventLoopPtr loop;
+
+	loop = drmMalloc(sizeof(*loop));
+	if (!loop) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	loop->fd = fd;
+	if (fallback)
+		loop->fallback = *fallback;
+	loop->crtcs = drmHashCreate();
+	loop->seqs = drmHashCreate();
+	if (!loop->crtcs || !loop->seqs) {
+		drmEventLoopDestroy(loop);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	return loop;
+}
+
+static void drm_event_loop_free_values(void *table)
+{
+	unsigned long key;
+	void *value;
+
+	if (drmHashFirst(table, &key, &value) == 1) {
+		do
+			drmFree(value);
+		while (drmHashNext(table, &key, &value) == 1);
+	}
+	drmHashDestroy(table);
+}
+
+/* Sequence events still queued through the loop are dropped. */
+drm_public void drmEventLoopDestroy(drmEventLoopPtr loop)
+{
+	if (!loop)
+		return;
+
+	if (loop->crtcs)
+		drm_event_loop_free_values(loop->crtcs);
+	if (loop->seqs)
+		drm_event_loop_free_values(loop->seqs);
+	drmFree(loop);
+}
+
+/*
+ * The fd to poll or add to an epoll set for EPOLLIN; call
+ * drmEventLoopDispatch() when it is readable.
+ */
+drm_public int drmEventLoopGetFd(drmEventLoopPtr loop)
+{
+	return loop ? loop->fd : -1;
+}
+
+/*
+ * Install the handlers for @crtc_id, replacing earlier ones, or remove them
+ * if @handlers is NULL.  Returns 0 or -ENOMEM.
+ */
+drm_public int drmEventLoopSetCrtcHandlers(drmEventLoopPtr loop,
+					   uint32_t crtc_id,
+					   const drmEventLoopHandlers *handlers)
+{
+	drmEventLoopHandlers *h;
+	void *value;
+
+	if (!loop)
+		return -EINVAL;
+
+	loop->last_crtc_id = 0;
+	loop->last_handlers = NULL;
+
+	if (drmHashLookup(loop->crtcs, crtc_id, &value) == 0) {
+		if (handlers) {
+			*(drmEventLoopHandlers *)value = *handlers;
+			return 0;
 		}
-		i += e->length;
+		drmHashDelete(loop->crtcs, crtc_id);
+		drmFree(value);
+		return 0;
+	}
+	if (!handlers)
+		return 0;
+
+	h = drmMalloc(sizeof(*h));
+	if (!h)
+		return -ENOMEM;
+	*h = *handlers;
+	if (drmHashInsert(loop->crtcs, crtc_id, h)) {
+		drmFree(h);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+/*
+ * drmCrtcQueueSequence() whose event is delivered to the sequence handler
+ * of @crtc_id, with @user_data.  Returns 0 or -errno.
+ */
+drm_public int drmEventLoopQueueSequence(drmEventLoopPtr loop,
+					 uint32_t crtc_id, uint32_t flags,
+					 uint64_t sequence,
+					 uint64_t *sequence_queued,
+					 void *user_data)
+{
+	struct drm_event_loop_seq *seq;
+	uint32_t serial;
+	void *value;
+
+	if (!loop)
+		return -EINVAL;
+
+	do
+		serial = ++loop->seq_serial;
+	while (drmHashLookup(loop->seqs, serial, &value) == 0);
+
+	seq = drmMalloc(sizeof(*seq));
+	if (!seq)
+		return -ENOMEM;
+	seq->crtc_id = crtc_id;
+	seq->user_data = user_data;
+	if (drmHashInsert(loop->seqs, serial, seq)) {
+		drmFree(seq);
+		return -ENOMEM;
 	}
 
+	if (drmCrtcQueueSequence(loop->fd, crtc_id, flags, sequence,
+				 sequence_queued,
+				 DRM_EVENT_LOOP_SEQ_TAG << 32 | serial)) {
+		int ret = -errno;
+
+		drmHashDelete(loop->seqs, serial);
+		drmFree(seq);
+		return ret;
+	}
 	return 0;
 }
 
+static drmEventLoopHandlers *drm_event_loop_crtc(drmEventLoopPtr loop,
+						 uint32_t crtc_id)
+{
+	void *value;
+
+	if (crtc_id == 0)
+		return NULL;
+	if (crtc_id == loop->last_crtc_id)
+		return loop->last_handlers;
+	if (drmHashLookup(loop->crtcs, crtc_id, &value))
+		return NULL;
+
+	loop->last_crtc_id = crtc_id;
+	loop->last_handlers = value;
+	return value;
+}
+
+static void drm_event_loop_dispatch(int fd, struct drm_event *e, void *data)
+{
+	drmEventLoopPtr loop = data;
+	struct drm_event_vblank *vblank;
+	struct drm_event_crtc_sequence *seq;
+	struct drm_event_loop_seq *queued;
+	drmEventLoopHandlers *h;
+	uint64_t ns;
+	void *value;
+
+	switch (e->type) {
+	case DRM_EVENT_VBLANK:
+	case DRM_EVENT_FLIP_COMPLETE:
+		vblank = (struct drm_event_vblank *) e;
+		h = drm_event_loop_crtc(loop, vblank->crtc_id);
+		if (!h)
+			break;
+		ns = (uint64_t)vblank->tv_sec * 1000000000 +
+		     (uint64_t)vblank->tv_usec * 1000;
+		if (e->type == DRM_EVENT_VBLANK && h->vblank_handler)
+			h->vblank_handler(fd, vblank->crtc_id, vblank->sequence,
+					  ns, U642VOID(vblank->user_data));
+		else if (e->type == DRM_EVENT_FLIP_COMPLETE &&
+			 h->page_flip_handler)
+			h->page_flip_handler(fd, vblank->crtc_id,
+					     vblank->sequence, ns,
+					     U642VOID(vblank->user_data));
+		return;
+	case DRM_EVENT_CRTC_SEQUENCE:
+		seq = (struct drm_event_crtc_sequence *) e;
+		if (seq->user_data >> 32 != DRM_EVENT_LOOP_SEQ_TAG ||
+		    drmHashLookup(loop->seqs, (uint32_t)seq->user_data,
+				    &value))
+			break;
+		queued = value;
+		drmHashDelete(loop->seqs, (uint32_t)seq->user_data);
+		h = drm_event_loop_crtc(loop, queued->crtc_id);
+		if (h && h->sequence_handler)
+			h->sequence_handler(fd, queued->crtc_id, seq->sequence,
+					    seq->time_ns, queued->user_data);
+		drmFree(queued);
+		return;
+	default:
+		break;
+	}
+
+	drmDispatchEvent(fd, &loop->fallback, e);
+}
+
+/*
+ * Dispatch everything that is pending without ever blocking, whether or not
+ * the fd is O_NONBLOCK.  Returns the number of events read, or -1 with errno
+ * set on failure.
+ */
+drm_public int drmEventLoopDispatch(drmEventLoopPtr loop)
+{
+	if (!loop) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	return drmReadEvents(loop->fd, loop->buffer, sizeof(loop->buffer), 0,
+			     drm_event_loop_dispatch, loop);
+}
+
 drm_public int drmModePageFlip(int fd, uint32_t crtc_id, uint32_t fb_id,
 		    uint32_t flags, void *user_data)
 {
@@ -1116,6 +1630,33 @@ err_allocs:
 	return r;
 }
 
+/*
+ * Fill a caller-owned drmModePlaneRes in a single ioctl.  count_planes is
+ * the capacity of the planes array on entry and the number of planes on
+ * return.  Returns 0 on success, -ENOSPC if the array was too small, or a
+ * negative error code.
+ */
+drm_public int drmModeGetPlaneResourcesInto(int fd, drmModePlaneResPtr r)
+{
+	struct drm_mode_get_plane_res res;
+	uint32_t count;
+
+	if (!r)
+		return -EINVAL;
+
+	count = r->planes ? r->count_planes : 0;
+
+	memclear(res);
+	res.plane_id_ptr = VOID2U64(r->planes);
+	res.count_planes = count;
+
+	if (drmIoctl(fd, DRM_IOCTL_MODE_GETPLANERESOURCES, &res))
+		return -errno;
+
+	r->count_planes = res.count_planes;
+	return res.count_planes <= count ? 0 : -ENOSPC;
+}
+
 drm_public void drmModeFreePlaneResources(drmModePlaneResPtr ptr)
 {
 	if (!ptr)
@@ -1186,19 +1727,52 @@ err_allocs:
 	return ret;
 }
 
-drm_public void drmModeFreeObjectProperties(drmModeObjectPropertiesPtr ptr)
+/*
+ * Read an object's properties into caller-owned arrays in a single ioctl,
+ * e.g. for per-frame readback.  count_props is the capacity of the props
+ * and prop_values arrays on entry and the number of properties on return.
+ * Returns 0 on success, -ENOSPC if the arrays were too small, or a negative
+ * error code.
+ */
+drm_public int drmModeObjectGetPropertiesInto(int fd, uint32_t object_id,
+					      uint32_t object_type,
+					      drmModeObjectPropertiesPtr r)
 {
-	if (!ptr)
-		return;
-	drmFree(ptr->props);
-	drmFree(ptr->prop_values);
-	drmFree(ptr);
-}
+	struct drm_mode_obj_get_properties properties;
+	uint32_t count;
 
-drm_public int drmModeObjectSetProperty(int fd, uint32_t object_id, uint32_t object_type,
-			     uint32_t property_id, uint64_t value)
-{
-	struct drm_mode_obj_set_property prop;
+	if (!r)
+		return -EINVAL;
+
+	count = r->props && r->prop_values ? r->count_props : 0;
+
+	memclear(properties);
+	properties.obj_id = object_id;
+	properties.obj_type = object_type;
+	properties.props_ptr = VOID2U64(r->props);
+	properties.prop_values_ptr = VOID2U64(r->prop_values);
+	properties.count_props = count;
+
+	if (drmIoctl(fd, DRM_IOCTL_MODE_OBJ_GETPROPERTIES, &properties))
+		return -errno;
+
+	r->count_props = properties.count_props;
+	return properties.count_props <= count ? 0 : -ENOSPC;
+}
+
+drm_public void drmModeFreeObjectProperties(drmModeObjectPropertiesPtr ptr)
+{
+	if (!ptr)
+		return;
+	drmFree(ptr->props);
+	drmFree(ptr->prop_values);
+	drmFree(ptr);
+}
+
+drm_public int drmModeObjectSetProperty(int fd, uint32_t object_id, uint32_t object_type,
+			     uint32_t property_id, uint64_t value)
+{
+	struct drm_mode_obj_set_property prop;
 
 	memclear(prop);
 	prop.value = value;
@@ -1221,6 +1795,8 @@ struct _drmModeAtomicReq {
 	uint32_t cursor;
 	uint32_t size_items;
 	drmModeAtomicReqItemPtr items;
+	void *arena;		/* commit scratch space, kept across commits */
+	size_t arena_size;
 };
 
 drm_public drmModeAtomicReqPtr drmModeAtomicAlloc(void)
@@ -1234,6 +1810,8 @@ drm_public drmModeAtomicReqPtr drmModeAtomicAlloc(void)
 	req->items = NULL;
 	req->cursor = 0;
 	req->size_items = 0;
+	req->arena = NULL;
+	req->arena_size = 0;
 
 	return req;
 }
@@ -1251,6 +1829,8 @@ drm_public drmModeAtomicReqPtr drmModeAtomicDuplicate(drmModeAtomicReqPtr old)
 
 	new->cursor = old->cursor;
 	new->size_items = old->size_items;
+	new->arena = NULL;
+	new->arena_size = 0;
 
 	if (old->size_items) {
 		new->items = drmMalloc(old->size_items * sizeof(*new->items));
@@ -1310,6 +1890,17 @@ drm_public void drmModeAtomicSetCursor(drmModeAtomicReqPtr req, int cursor)
 		req->cursor = cursor;
 }
 
+/*
+ * Empty the request so it can be filled again, keeping the memory allocated
+ * for its items and commit scratch space.  Reusing one request per frame
+ * avoids heap allocations in steady state.
+ */
+drm_public void drmModeAtomicReset(drmModeAtomicReqPtr req)
+{
+	if (req)
+		req->cursor = 0;
+}
+
 drm_public int drmModeAtomicAddProperty(drmModeAtomicReqPtr req,
                                         uint32_t object_id,
                                         uint32_t property_id,
@@ -1322,16 +1913,22 @@ drm_public int drmModeAtomicAddProperty(drmModeAtomicReqPtr req,
 		return -EINVAL;
 
 	if (req->cursor >= req->size_items) {
-		const uint32_t item_size_inc = getpagesize() / sizeof(*req->items);
+		uint32_t size_items = req->size_items;
 		drmModeAtomicReqItemPtr new;
 
-		req->size_items += item_size_inc;
-		new = realloc(req->items, req->size_items * sizeof(*req->items));
-		if (!new) {
-			req->size_items -= item_size_inc;
+		/* Start with a page worth of items and double from there. */
+		if (size_items == 0)
+			size_items = getpagesize() / sizeof(*req->items);
+		else if (size_items <= UINT32_MAX / 2)
+			size_items *= 2;
+		else
+			return -ENOMEM;
+
+		new = realloc(req->items, size_items * sizeof(*req->items));
+		if (!new)
 			return -ENOMEM;
-		}
 		req->items = new;
+		req->size_items = size_items;
 	}
 
 	req->items[req->cursor].object_id = object_id;
@@ -1349,248 +1946,2812 @@ drm_public void drmModeAtomicFree(drmModeAtomicReqPtr req)
 
 	if (req->items)
 		drmFree(req->items);
+	free(req->arena);
 	drmFree(req);
 }
 
+/* A request item tagged with its position, so later sets win. */
+struct drm_atomic_sort_item {
+	uint32_t object_id;
+	uint32_t property_id;
+	uint32_t seq;
+	uint64_t value;
+};
+
 static int sort_req_list(const void *misc, const void *other)
 {
-	const drmModeAtomicReqItem *first = misc;
-	const drmModeAtomicReqItem *second = other;
-
-	if (first->object_id < second->object_id)
-		return -1;
-	else if (first->object_id > second->object_id)
-		return 1;
-	else
-		return second->property_id - first->property_id;
+	const struct drm_atomic_sort_item *first = misc;
+	const struct drm_atomic_sort_item *second = other;
+
+	if (first->object_id != second->object_id)
+		return first->object_id < second->object_id ? -1 : 1;
+	if (first->property_id != second->property_id)
+		return first->property_id < second->property_id ? -1 : 1;
+	return first->seq < second->seq ? -1 : first->seq > second->seq;
 }
 
-drm_public int drmModeAtomicCommit(int fd, drmModeAtomicReqPtr req,
-                                   uint32_t flags, void *user_data)
+/*
+ * Sort and dedup the request into the ioctl arrays, which live in the
+ * request's arena.  The caller fills in flags and user_data.
+ */
+static int drm_atomic_prepare(drmModeAtomicReqPtr req,
+			      struct drm_mode_atomic *atomic,
+			      uint32_t *total_props)
 {
-	drmModeAtomicReqPtr sorted;
-	struct drm_mode_atomic atomic;
-	uint32_t *objs_ptr = NULL;
-	uint32_t *count_props_ptr = NULL;
-	uint32_t *props_ptr = NULL;
-	uint64_t *prop_values_ptr = NULL;
+	struct drm_atomic_sort_item *sorted, *item;
+	uint32_t *objs_ptr;
+	uint32_t *count_props_ptr;
+	uint32_t *props_ptr;
+	uint64_t *prop_values_ptr;
 	uint32_t last_obj_id = 0;
-	uint32_t i;
+	uint32_t i, n, count_props = 0;
+	size_t item_size;
+	void *arena;
 	int obj_idx = -1;
-	int ret = -1;
-
-	if (!req)
-		return -EINVAL;
 
-	if (req->cursor == 0)
-		return 0;
-
-	sorted = drmModeAtomicDuplicate(req);
-	if (sorted == NULL)
+	/* One allocation holds the sort buffer and all four ioctl arrays,
+	 * the 64-bit ones first to keep them aligned.  It is kept in the
+	 * request so that committing a reused request doesn't allocate. */
+	n = req->cursor;
+	item_size = sizeof(*sorted) + sizeof(*prop_values_ptr) +
+		    sizeof(*objs_ptr) + sizeof(*count_props_ptr) +
+		    sizeof(*props_ptr);
+	if (n > SIZE_MAX / item_size)
 		return -ENOMEM;
 
-	memclear(atomic);
+	if (n * item_size > req->arena_size) {
+		arena = malloc(n * item_size);
+		if (!arena)
+			return -ENOMEM;
+		free(req->arena);
+		req->arena = arena;
+		req->arena_size = n * item_size;
+	}
 
-	/* Sort the list by object ID, then by property ID. */
-	qsort(sorted->items, sorted->cursor, sizeof(*sorted->items),
-	      sort_req_list);
+	sorted = req->arena;
+	prop_values_ptr = (uint64_t *)(sorted + n);
+	objs_ptr = (uint32_t *)(prop_values_ptr + n);
+	count_props_ptr = objs_ptr + n;
+	props_ptr = count_props_ptr + n;
+
+	for (i = 0; i < n; i++) {
+		sorted[i].object_id = req->items[i].object_id;
+		sorted[i].property_id = req->items[i].property_id;
+		sorted[i].seq = i;
+		sorted[i].value = req->items[i].value;
+	}
 
-	/* Now the list is sorted, eliminate duplicate property sets. */
-	for (i = 0; i < sorted->cursor; i++) {
-		if (sorted->items[i].object_id != last_obj_id) {
-			atomic.count_objs++;
-			last_obj_id = sorted->items[i].object_id;
-		}
+	/* Sort the list by object ID, then by property ID, keeping repeated
+	 * sets of a property in the order they were added. */
+	qsort(sorted, n, sizeof(*sorted), sort_req_list);
 
-		if (i == sorted->cursor - 1)
-			continue;
+	/* Build the ioctl arrays in one pass, keeping only the last set of
+	 * each property. */
+	for (i = 0; i < n; i++) {
+		item = &sorted[i];
 
-		if (sorted->items[i].object_id != sorted->items[i + 1].object_id ||
-		    sorted->items[i].property_id != sorted->items[i + 1].property_id)
+		if (i + 1 < n && item[1].object_id == item->object_id &&
+		    item[1].property_id == item->property_id)
 			continue;
 
-		memmove(&sorted->items[i], &sorted->items[i + 1],
-			(sorted->cursor - i - 1) * sizeof(*sorted->items));
-		sorted->cursor--;
-	}
+		if (item->object_id != last_obj_id) {
+			obj_idx++;
+			objs_ptr[obj_idx] = item->object_id;
+			count_props_ptr[obj_idx] = 0;
+			last_obj_id = item->object_id;
+		}
 
-	objs_ptr = drmMalloc(atomic.count_objs * sizeof objs_ptr[0]);
-	if (!objs_ptr) {
-		errno = ENOMEM;
-		goto out;
+		count_props_ptr[obj_idx]++;
+		props_ptr[count_props] = item->property_id;
+		prop_values_ptr[count_props] = item->value;
+		count_props++;
 	}
 
-	count_props_ptr = drmMalloc(atomic.count_objs * sizeof count_props_ptr[0]);
-	if (!count_props_ptr) {
-		errno = ENOMEM;
-		goto out;
-	}
+	memclear(*atomic);
+	atomic->count_objs = obj_idx + 1;
+	atomic->objs_ptr = VOID2U64(objs_ptr);
+	atomic->count_props_ptr = VOID2U64(count_props_ptr);
+	atomic->props_ptr = VOID2U64(props_ptr);
+	atomic->prop_values_ptr = VOID2U64(prop_values_ptr);
+	*total_props = count_props;
 
-	props_ptr = drmMalloc(sorted->cursor * sizeof props_ptr[0]);
-	if (!props_ptr) {
-		errno = ENOMEM;
-		goto out;
-	}
+	return 0;
+}
 
-	prop_values_ptr = drmMalloc(sorted->cursor * sizeof prop_values_ptr[0]);
-	if (!prop_values_ptr) {
-		errno = ENOMEM;
-		goto out;
-	}
+drm_public int drmModeAtomicCommit(int fd, drmModeAtomicReqPtr req,
+                                   uint32_t flags, void *user_data)
+{
+	struct drm_mode_atomic atomic;
+	drmSubmitTrace trace;
+	uint32_t count_props;
+	int ret;
 
-	for (i = 0, last_obj_id = 0; i < sorted->cursor; i++) {
-		if (sorted->items[i].object_id != last_obj_id) {
-			obj_idx++;
-			objs_ptr[obj_idx] = sorted->items[i].object_id;
-			last_obj_id = objs_ptr[obj_idx];
-		}
+	if (!req)
+		return -EINVAL;
 
-		count_props_ptr[obj_idx]++;
-		props_ptr[i] = sorted->items[i].property_id;
-		prop_values_ptr[i] = sorted->items[i].value;
+	if (req->cursor == 0)
+		return 0;
 
-	}
+	ret = drm_atomic_prepare(req, &atomic, &count_props);
+	if (ret)
+		return ret;
 
 	atomic.flags = flags;
-	atomic.objs_ptr = VOID2U64(objs_ptr);
-	atomic.count_props_ptr = VOID2U64(count_props_ptr);
-	atomic.props_ptr = VOID2U64(props_ptr);
-	atomic.prop_values_ptr = VOID2U64(prop_values_ptr);
 	atomic.user_data = VOID2U64(user_data);
 
-	ret = DRM_IOCTL(fd, DRM_IOCTL_MODE_ATOMIC, &atomic);
+	memclear(trace);
+	trace.name = "drmModeAtomicCommit";
+	trace.fd = fd;
+	trace.num_bos = atomic.count_objs;
+	/* objs and count_props, then props and values: */
+	trace.cmd_bytes = atomic.count_objs * 2 * sizeof(uint32_t) +
+			  count_props * (sizeof(uint32_t) + sizeof(uint64_t));
+	drmSubmitTraceBegin(&trace);
 
-out:
-	drmFree(objs_ptr);
-	drmFree(count_props_ptr);
-	drmFree(props_ptr);
-	drmFree(prop_values_ptr);
-	drmModeAtomicFree(sorted);
+	ret = DRM_IOCTL(fd, DRM_IOCTL_MODE_ATOMIC, &atomic);
 
+	trace.ret = ret;
+	drmSubmitTraceEnd(&trace);
 	return ret;
 }
 
-drm_public int
-drmModeCreatePropertyBlob(int fd, const void *data, size_t length,
-                                     uint32_t *id)
+/*
+ * A request compiled into the ioctl arrays once.  Its values are the only
+ * thing that changes between commits, so committing it is just the ioctl.
+ */
+struct _drmModeAtomicCompiled {
+	uint32_t count_objs;
+	uint32_t count_props;
+	uint64_t *prop_values;
+	uint32_t *objs;
+	uint32_t *count_props_ptr;
+	uint32_t *props;
+	uint32_t *first_prop;	/* index of each object's first property */
+};
+
+drm_public drmModeAtomicCompiledPtr
+drmModeAtomicCompile(drmModeAtomicReqPtr req)
 {
-	struct drm_mode_create_blob create;
-	int ret;
+	drmModeAtomicCompiledPtr compiled;
+	struct drm_mode_atomic atomic;
+	uint32_t count_props, i, first;
+	size_t objs_size, props_size;
 
-	if (length >= 0xffffffff)
-		return -ERANGE;
+	if (!req || req->cursor == 0)
+		return NULL;
 
-	memclear(create);
+	if (drm_atomic_prepare(req, &atomic, &count_props))
+		return NULL;
 
-	create.length = length;
-	create.data = (uintptr_t) data;
-	create.blob_id = 0;
-	*id = 0;
+	/* One allocation, the 64-bit values right after the struct. */
+	objs_size = atomic.count_objs * sizeof(uint32_t);
+	props_size = count_props * sizeof(uint32_t);
+	compiled = drmMalloc(sizeof(*compiled) +
+			     count_props * sizeof(uint64_t) +
+			     3 * objs_size + props_size);
+	if (!compiled)
+		return NULL;
 
-	ret = DRM_IOCTL(fd, DRM_IOCTL_MODE_CREATEPROPBLOB, &create);
-	if (ret != 0)
-		return ret;
+	compiled->count_objs = atomic.count_objs;
+	compiled->count_props = count_props;
+	compiled->prop_values = (uint64_t *)(compiled + 1);
+	compiled->objs = (uint32_t *)(compiled->prop_values + count_props);
+	compiled->count_props_ptr = compiled->objs + atomic.count_objs;
+	compiled->first_prop = compiled->count_props_ptr + atomic.count_objs;
+	compiled->props = compiled->first_prop + atomic.count_objs;
+
+	memcpy(compiled->prop_values, U642VOID(atomic.prop_values_ptr),
+	       count_props * sizeof(uint64_t));
+	memcpy(compiled->objs, U642VOID(atomic.objs_ptr), objs_size);
+	memcpy(compiled->count_props_ptr, U642VOID(atomic.count_props_ptr),
+	       objs_size);
+	memcpy(compiled->props, U642VOID(atomic.props_ptr), props_size);
+
+	for (i = 0, first = 0; i < atomic.count_objs; i++) {
+		compiled->first_prop[i] = first;
+		first += compiled->count_props_ptr[i];
+	}
 
-	*id = create.blob_id;
-	return 0;
+	return compiled;
 }
 
-drm_public int
-drmModeDestroyPropertyBlob(int fd, uint32_t id)
+drm_public void drmModeAtomicCompiledFree(drmModeAtomicCompiledPtr compiled)
 {
-	struct drm_mode_destroy_blob destroy;
+	drmFree(compiled);
+}
 
-	memclear(destroy);
-	destroy.blob_id = id;
-	return DRM_IOCTL(fd, DRM_IOCTL_MODE_DESTROYPROPBLOB, &destroy);
+drm_public int drmModeAtomicCompiledGetCount(drmModeAtomicCompiledPtr compiled)
+{
+	if (!compiled)
+		return -EINVAL;
+	return compiled->count_props;
 }
 
-drm_public int
-drmModeCreateLease(int fd, const uint32_t *objects, int num_objects, int flags,
-                   uint32_t *lessee_id)
+static int compare_u32(const void *a, const void *b)
 {
-	struct drm_mode_create_lease create;
-	int ret;
+	uint32_t first = *(const uint32_t *)a, second = *(const uint32_t *)b;
 
-	memclear(create);
-	create.object_ids = (uintptr_t) objects;
-	create.object_count = num_objects;
-	create.flags = flags;
+	return first < second ? -1 : first > second;
+}
 
-	ret = DRM_IOCTL(fd, DRM_IOCTL_MODE_CREATE_LEASE, &create);
-	if (ret == 0) {
-		*lessee_id = create.lessee_id;
-		return create.fd;
-	}
-	return -errno;
+/*
+ * Returns the slot of a property, to be looked up once and then passed to
+ * drmModeAtomicCompiledSetValue() every frame, or -ENOENT.
+ */
+drm_public int drmModeAtomicCompiledFindSlot(drmModeAtomicCompiledPtr compiled,
+					     uint32_t object_id,
+					     uint32_t property_id)
+{
+	uint32_t *obj, *prop, idx;
+
+	if (!compiled)
+		return -EINVAL;
+
+	/* Both arrays are sorted, objects and each object's properties. */
+	obj = bsearch(&object_id, compiled->objs, compiled->count_objs,
+		      sizeof(*obj), compare_u32);
+	if (!obj)
+		return -ENOENT;
+
+	idx = obj - compiled->objs;
+	prop = bsearch(&property_id,
+		       compiled->props + compiled->first_prop[idx],
+		       compiled->count_props_ptr[idx], sizeof(*prop),
+		       compare_u32);
+	if (!prop)
+		return -ENOENT;
+
+	return prop - compiled->props;
 }
 
-drm_public drmModeLesseeListPtr
-drmModeListLessees(int fd)
+drm_public int drmModeAtomicCompiledSetValue(drmModeAtomicCompiledPtr compiled,
+					     uint32_t slot, uint64_t value)
 {
-	struct drm_mode_list_lessees list;
-	uint32_t count;
-	drmModeLesseeListPtr ret;
+	if (!compiled || slot >= compiled->count_props)
+		return -EINVAL;
 
-	memclear(list);
+	compiled->prop_values[slot] = value;
+	return 0;
+}
 
-	if (DRM_IOCTL(fd, DRM_IOCTL_MODE_LIST_LESSEES, &list))
-		return NULL;
+drm_public int drmModeAtomicCompiledCommit(int fd,
+					   drmModeAtomicCompiledPtr compiled,
+					   uint32_t flags, void *user_data)
+{
+	struct drm_mode_atomic atomic;
+	drmSubmitTrace trace;
+	int ret;
 
-	count = list.count_lessees;
-	ret = drmMalloc(sizeof (drmModeLesseeListRes) + count * sizeof (ret->lessees[0]));
-	if (!ret)
-		return NULL;
+	if (!compiled)
+		return -EINVAL;
 
-	list.lessees_ptr = VOID2U64(&ret->lessees[0]);
-	if (DRM_IOCTL(fd, DRM_IOCTL_MODE_LIST_LESSEES, &list)) {
-		drmFree(ret);
-		return NULL;
-	}
+	memclear(atomic);
+	atomic.flags = flags;
+	atomic.count_objs = compiled->count_objs;
+	atomic.objs_ptr = VOID2U64(compiled->objs);
+	atomic.count_props_ptr = VOID2U64(compiled->count_props_ptr);
+	atomic.props_ptr = VOID2U64(compiled->props);
+	atomic.prop_values_ptr = VOID2U64(compiled->prop_values);
+	atomic.user_data = VOID2U64(user_data);
 
-	ret->count = count;
+	memclear(trace);
+	trace.name = "drmModeAtomicCommit";
+	trace.fd = fd;
+	trace.num_bos = compiled->count_objs;
+	trace.cmd_bytes = compiled->count_objs * 2 * sizeof(uint32_t) +
+			  compiled->count_props *
+			  (sizeof(uint32_t) + sizeof(uint64_t));
+	drmSubmitTraceBegin(&trace);
+
+	ret = DRM_IOCTL(fd, DRM_IOCTL_MODE_ATOMIC, &atomic);
+
+	trace.ret = ret;
+	drmSubmitTraceEnd(&trace);
 	return ret;
 }
 
-drm_public drmModeObjectListPtr
-drmModeGetLease(int fd)
-{
-	struct drm_mode_get_lease get;
-	uint32_t count;
-	drmModeObjectListPtr ret;
+/*
+ * Memoized TEST_ONLY commits.  Entries are keyed by the sorted, deduped
+ * property set and the commit flags; the table is direct mapped, so a
+ * colliding configuration simply replaces the older one.
+ */
+struct drm_atomic_test_entry {
+	uint64_t hash;
+	uint32_t flags;
+	uint32_t count_objs;
+	uint32_t count_props;
+	int valid;
+	int result;
+	size_t key_size;
+	void *key;	/* values, then objs, count_props and props */
+};
 
-	memclear(get);
+struct _drmModeAtomicTestCache {
+	int fd;
+	uint32_t mask;
+	struct drm_atomic_test_entry *entries;
+};
 
-	if (DRM_IOCTL(fd, DRM_IOCTL_MODE_GET_LEASE, &get))
-		return NULL;
+static uint64_t drm_atomic_hash(uint64_t hash, const void *data, size_t size)
+{
+	const unsigned char *p = data;
 
-	count = get.count_objects;
-	ret = drmMalloc(sizeof (drmModeObjectListRes) + count * sizeof (ret->objects[0]));
-	if (!ret)
+	while (size--)
+		hash = (hash ^ *p++) * 0x100000001b3ull;
+	return hash;
+}
+
+drm_public drmModeAtomicTestCachePtr
+drmModeAtomicTestCacheCreate(int fd, uint32_t num_entries)
+{
+	drmModeAtomicTestCachePtr cache;
+	uint32_t size;
+
+	if (num_entries == 0)
+		num_entries = 256;
+	if (num_entries > (1u << 20))
+		num_entries = 1u << 20;
+	for (size = 1; size < num_entries; size *= 2)
+		;
+
+	cache = drmMalloc(sizeof(*cache));
+	if (!cache)
 		return NULL;
 
-	get.objects_ptr = VOID2U64(&ret->objects[0]);
-	if (DRM_IOCTL(fd, DRM_IOCTL_MODE_GET_LEASE, &get)) {
-		drmFree(ret);
+	cache->entries = drmMalloc(size * sizeof(*cache->entries));
+	if (!cache->entries) {
+		drmFree(cache);
 		return NULL;
 	}
+	cache->fd = fd;
+	cache->mask = size - 1;
 
-	ret->count = count;
-	return ret;
+	return cache;
 }
 
-drm_public int
-drmModeRevokeLease(int fd, uint32_t lessee_id)
+drm_public void drmModeAtomicTestCacheDestroy(drmModeAtomicTestCachePtr cache)
 {
-	struct drm_mode_revoke_lease revoke;
+	uint32_t i;
+
+	if (!cache)
+		return;
+
+	for (i = 0; i <= cache->mask; i++)
+		free(cache->entries[i].key);
+	drmFree(cache->entries);
+	drmFree(cache);
+}
+
+/*
+ * Forget all remembered results.  Needed whenever the outcome of a test
+ * could change: after a modeset that wasn't made through
+ * drmModeAtomicCommitCached(), on hotplug, or when framebuffer or blob IDs
+ * used in tested requests are destroyed and may be reused.
+ */
+drm_public void drmModeAtomicTestCacheInvalidate(drmModeAtomicTestCachePtr cache)
+{
+	uint32_t i;
+
+	if (!cache)
+		return;
+
+	for (i = 0; i <= cache->mask; i++)
+		cache->entries[i].valid = 0;
+}
+
+/*
+ * Like drmModeAtomicCommit(), but TEST_ONLY commits of a configuration that
+ * has been tested before return the remembered result without an ioctl.
+ * Other commits go straight to the kernel, and a successful commit with
+ * DRM_MODE_ATOMIC_ALLOW_MODESET invalidates the cache.
+ */
+drm_public int drmModeAtomicCommitCached(drmModeAtomicTestCachePtr cache,
+					 drmModeAtomicReqPtr req,
+					 uint32_t flags, void *user_data)
+{
+	struct drm_atomic_test_entry *entry;
+	struct drm_mode_atomic atomic;
+	size_t objs_size, props_size, key_size;
+	uint32_t count_props;
+	uint64_t hash;
+	char *key;
 	int ret;
 
-	memclear(revoke);
+	if (!cache || !req)
+		return -EINVAL;
 
-	revoke.lessee_id = lessee_id;
+	if (!(flags & DRM_MODE_ATOMIC_TEST_ONLY)) {
+		ret = drmModeAtomicCommit(cache->fd, req, flags, user_data);
+		if (ret == 0 && (flags & DRM_MODE_ATOMIC_ALLOW_MODESET))
+			drmModeAtomicTestCacheInvalidate(cache);
+		return ret;
+	}
 
-	ret = DRM_IOCTL(fd, DRM_IOCTL_MODE_REVOKE_LEASE, &revoke);
-	if (ret == 0)
+	if (req->cursor == 0)
 		return 0;
-	return -errno;
+
+	ret = drm_atomic_prepare(req, &atomic, &count_props);
+	if (ret)
+		return ret;
+
+	objs_size = atomic.count_objs * sizeof(uint32_t);
+	props_size = count_props * sizeof(uint32_t);
+	key_size = count_props * sizeof(uint64_t) + 2 * objs_size + props_size;
+
+	hash = drm_atomic_hash(0xcbf29ce484222325ull, &flags, sizeof(flags));
+	hash = drm_atomic_hash(hash, U642VOID(atomic.prop_values_ptr),
+			       count_props * sizeof(uint64_t));
+	hash = drm_atomic_hash(hash, U642VOID(atomic.objs_ptr), objs_size);
+	hash = drm_atomic_hash(hash, U642VOID(atomic.count_props_ptr),
+			       objs_size);
+	hash = drm_atomic_hash(hash, U642VOID(atomic.props_ptr), props_size);
+
+	entry = &cache->entries[hash & cache->mask];
+	key = entry->key;
+	if (entry->valid && entry->hash == hash && entry->flags == flags &&
+	    entry->count_objs == atomic.count_objs &&
+	    entry->count_props == count_props &&
+	    !memcmp(key, U642VOID(atomic.prop_values_ptr),
+		    count_props * sizeof(uint64_t)) &&
+	    !memcmp(key + count_props * sizeof(uint64_t),
+		    U642VOID(atomic.objs_ptr), objs_size) &&
+	    !memcmp(key + count_props * sizeof(uint64_t) + objs_size,
+		    U642VOID(atomic.count_props_ptr), objs_size) &&
+	    !memcmp(key + count_props * sizeof(uint64_t) + 2 * objs_size,
+		    U642VOID(atomic.props_ptr), props_size))
+		return entry->result;
+
+	atomic.flags = flags;
+	atomic.user_data = VOID2U64(user_data);
+	ret = DRM_IOCTL(cache->fd, DRM_IOCTL_MODE_ATOMIC, &atomic);
+
+	/* Only remember verdicts on the configuration itself, not transient
+	 * failures such as EINTR, EBUSY or ENOMEM. */
+	if (ret != 0 && ret != -EINVAL && ret != -ERANGE && ret != -ENOSPC)
+		return ret;
+
+	if (key_size > entry->key_size) {
+		key = malloc(key_size);
+		if (!key)
+			return ret;
+		free(entry->key);
+		entry->key = key;
+		entry->key_size = key_size;
+	}
+
+	key = entry->key;
+	memcpy(key, U642VOID(atomic.prop_values_ptr),
+	       count_props * sizeof(uint64_t));
+	key += count_props * sizeof(uint64_t);
+	memcpy(key, U642VOID(atomic.objs_ptr), objs_size);
+	key += objs_size;
+	memcpy(key, U642VOID(atomic.count_props_ptr), objs_size);
+	key += objs_size;
+	memcpy(key, U642VOID(atomic.props_ptr), props_size);
+
+	entry->hash = hash;
+	entry->flags = flags;
+	entry->count_objs = atomic.count_objs;
+	entry->count_props = count_props;
+	entry->result = ret;
+	entry->valid = 1;
+
+	return ret;
+}
+
+/*
+ * Splitting of atomic requests into independent commits per group of
+ * CRTCs.  The splitter remembers which CRTC every plane and connector is
+ * bound to, starting from a snapshot and following its own commits, so a
+ * request can be partitioned without any ioctl: CRTC properties go with
+ * their CRTC, plane and connector properties with the CRTC the object is
+ * moved to or, if the request doesn't set CRTC_ID, already bound to.  An
+ * object moved from one CRTC to another ties both into one commit.
+ */
+#define DRM_SPLIT_MAX_CRTCS 32
+#define DRM_SPLIT_UNSET -2
+
+struct drm_split_object {
+	uint32_t id;
+	uint32_t crtc_prop;	/* CRTC_ID, 0 for CRTCs */
+	int crtc;		/* index of the bound CRTC, -1 if none */
+	int pending;		/* CRTC_ID set by the request being split */
+	int index;		/* the CRTC's own index, -1 for others */
+};
+
+struct _drmModeAtomicSplitter {
+	int fd;
+	uint32_t count_crtcs;
+	uint32_t crtc_ids[DRM_SPLIT_MAX_CRTCS];
+	uint32_t count_objects;
+	struct drm_split_object *objects;	/* sorted by id */
+	drmModeAtomicReqPtr reqs[DRM_SPLIT_MAX_CRTCS];
+};
+
+static int drm_split_cmp(const void *a, const void *b)
+{
+	const struct drm_split_object *oa = a, *ob = b;
+
+	return oa->id < ob->id ? -1 : oa->id > ob->id;
+}
+
+static struct drm_split_object *
+drm_split_find(drmModeAtomicSplitterPtr split, uint32_t id)
+{
+	struct drm_split_object key = { .id = id };
+
+	return bsearch(&key, split->objects, split->count_objects,
+		       sizeof(key), drm_split_cmp);
+}
+
+static int drm_split_crtc_index(drmModeAtomicSplitterPtr split,
+				uint32_t crtc_id)
+{
+	uint32_t i;
+
+	for (i = 0; crtc_id && i < split->count_crtcs; i++)
+		if (split->crtc_ids[i] == crtc_id)
+			return i;
+	return -1;
+}
+
+static uint32_t drm_split_crtc_prop(drmModePropertyCachePtr props,
+				    uint32_t id, uint32_t type)
+{
+	const drmModePropertyInfo *info;
+
+	info = drmModePropertyCacheLookup(props, id, type, "CRTC_ID");
+	return info ? info->prop_id : 0;
+}
+
+static int drm_split_build(drmModeAtomicSplitterPtr split)
+{
+	drmModePropertyCachePtr props;
+	drmModeSnapshotPtr snap;
+	struct drm_split_object *o;
+	uint32_t count, encoder_crtc, i;
+	int j;
+
+	snap = drmModeGetSnapshot(split->fd, 0);
+	if (!snap)
+		return -errno;
+	props = drmModePropertyCacheCreate(split->fd);
+	if (!props) {
+		drmModeFreeSnapshot(snap);
+		return -ENOMEM;
+	}
+
+	split->count_crtcs = 0;
+	for (i = 0; i < (uint32_t)snap->count_crtcs &&
+		    i < DRM_SPLIT_MAX_CRTCS; i++)
+		split->crtc_ids[split->count_crtcs++] = snap->crtcs[i].crtc_id;
+
+	count = snap->count_connectors + split->count_crtcs + snap->count_planes;
+	free(split->objects);
+	split->objects = calloc(count ? count : 1, sizeof(*split->objects));
+	if (!split->objects) {
+		split->count_objects = 0;
+		drmModePropertyCacheDestroy(props);
+		drmModeFreeSnapshot(snap);
+		return -ENOMEM;
+	}
+
+	o = split->objects;
+	for (i = 0; i < split->count_crtcs; i++, o++) {
+		o->id = split->crtc_ids[i];
+		o->crtc = o->index = i;
+	}
+	for (i = 0; i < snap->count_planes; i++, o++) {
+		o->id = snap->planes[i].plane_id;
+		o->crtc_prop = drm_split_crtc_prop(props, o->id,
+						   DRM_MODE_OBJECT_PLANE);
+		o->crtc = drm_split_crtc_index(split, snap->planes[i].crtc_id);
+		o->index = -1;
+	}
+	for (i = 0; i < (uint32_t)snap->count_connectors; i++, o++) {
+		o->id = snap->connectors[i].connector_id;
+		o->crtc_prop = drm_split_crtc_prop(props, o->id,
+						   DRM_MODE_OBJECT_CONNECTOR);
+		encoder_crtc = 0;
+		for (j = 0; j < snap->count_encoders; j++)
+			if (snap->encoders[j].encoder_id ==
+			    snap->connectors[i].encoder_id)
+				encoder_crtc = snap->encoders[j].crtc_id;
+		o->crtc = drm_split_crtc_index(split, encoder_crtc);
+		o->index = -1;
+	}
+
+	split->count_objects = o - split->objects;
+	for (i = 0; i < split->count_objects; i++)
+		split->objects[i].pending = DRM_SPLIT_UNSET;
+	qsort(split->objects, split->count_objects, sizeof(*split->objects),
+	      drm_split_cmp);
+
+	drmModePropertyCacheDestroy(props);
+	drmModeFreeSnapshot(snap);
+	return 0;
+}
+
+/*
+ * Create a splitter for the CRTCs, planes and connectors of @fd.  Enables
+ * DRM_CLIENT_CAP_UNIVERSAL_PLANES and DRM_CLIENT_CAP_ATOMIC.  Returns NULL
+ * with errno set on failure.
+ */
+drm_public drmModeAtomicSplitterPtr drmModeAtomicSplitterCreate(int fd)
+{
+	drmModeAtomicSplitterPtr split;
+	int ret;
+
+	if (drmSetClientCap(fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1) ||
+	    drmSetClientCap(fd, DRM_CLIENT_CAP_ATOMIC, 1))
+		return NULL;
+
+	split = drmMalloc(sizeof(*split));
+	if (!split) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	split->fd = fd;
+
+	ret = drm_split_build(split);
+	if (ret) {
+		drmModeAtomicSplitterDestroy(split);
+		errno = -ret;
+		return NULL;
+	}
+
+	return split;
+}
+
+drm_public void drmModeAtomicSplitterDestroy(drmModeAtomicSplitterPtr split)
+{
+	uint32_t i;
+
+	if (!split)
+		return;
+
+	for (i = 0; i < DRM_SPLIT_MAX_CRTCS; i++)
+		drmModeAtomicFree(split->reqs[i]);
+	free(split->objects);
+	drmFree(split);
+}
+
+/*
+ * Read the bindings of planes and connectors again, after they were
+ * changed by commits that didn't go through the splitter, or on hotplug.
+ */
+drm_public int drmModeAtomicSplitterInvalidate(drmModeAtomicSplitterPtr split)
+{
+	if (!split)
+		return -EINVAL;
+
+	return drm_split_build(split);
+}
+
+static int drm_split_find_root(int *parent, int i)
+{
+	while (parent[i] != i)
+		i = parent[i] = parent[parent[i]];
+	return i;
+}
+
+/* The CRTC an object's properties go with, -1 if it has none. */
+static int drm_split_object_crtc(const struct drm_split_object *o)
+{
+	if (o->index >= 0)
+		return o->index;
+	if (o->pending >= 0)
+		return o->pending;
+	return o->crtc;
+}
+
+/*
+ * Commit @req as one commit per group of CRTCs it touches, in the order
+ * the groups first appear in the request.  Unless @flags has
+ * DRM_MODE_ATOMIC_TEST_ONLY, DRM_MODE_ATOMIC_NONBLOCK is added, so the
+ * commits run concurrently and each CRTC flips at its own pace; with
+ * DRM_MODE_PAGE_FLIP_EVENT every CRTC reports its completion with its own
+ * page_flip_handler2 event carrying @user_data.  Properties of planes and
+ * connectors bound to no CRTC go with the first group.
+ *
+ * The groups are committed independently, so a failing one doesn't hold
+ * back the others.  Returns 0 or the error of the first group that
+ * failed, or -EINVAL if the request sets properties of objects other than
+ * CRTCs, planes and connectors.  If @committed isn't NULL, it gets a mask
+ * of the indices (as in possible_crtcs) of the CRTCs that were committed.
+ */
+drm_public int drmModeAtomicSplitterCommit(drmModeAtomicSplitterPtr split,
+					   drmModeAtomicReqPtr req,
+					   uint32_t flags, void *user_data,
+					   uint32_t *committed)
+{
+	int parent[DRM_SPLIT_MAX_CRTCS], result[DRM_SPLIT_MAX_CRTCS];
+	drmModeAtomicReqItemPtr item;
+	struct drm_split_object *o;
+	uint32_t used = 0, done = 0, i;
+	int first = -1, crtc, root, ret = 0;
+
+	if (committed)
+		*committed = 0;
+	if (!split || !req)
+		return -EINVAL;
+
+	for (i = 0; i < req->cursor; i++) {
+		o = drm_split_find(split, req->items[i].object_id);
+		if (!o)
+			return -EINVAL;
+		o->pending = DRM_SPLIT_UNSET;
+	}
+
+	for (i = 0; i < split->count_crtcs; i++)
+		parent[i] = i;
+	for (i = 0; i < req->cursor; i++) {
+		item = &req->items[i];
+		o = drm_split_find(split, item->object_id);
+		if (!o->crtc_prop || item->property_id != o->crtc_prop)
+			continue;
+		o->pending = drm_split_crtc_index(split, item->value);
+		if (item->value && o->pending < 0) {
+			ret = -EINVAL;
+			goto out;
+		}
+		if (o->pending >= 0 && o->crtc >= 0)
+			parent[drm_split_find_root(parent, o->pending)] =
+				drm_split_find_root(parent, o->crtc);
+	}
+
+	for (i = 0; i < req->cursor; i++) {
+		item = &req->items[i];
+		crtc = drm_split_object_crtc(drm_split_find(split,
+							    item->object_id));
+		if (crtc < 0)
+			continue;
+		root = drm_split_find_root(parent, crtc);
+		if (!split->reqs[root]) {
+			split->reqs[root] = drmModeAtomicAlloc();
+			if (!split->reqs[root]) {
+				ret = -ENOMEM;
+				goto out;
+			}
+		}
+		if (!(used & (1u << root))) {
+			drmModeAtomicReset(split->reqs[root]);
+			used |= 1u << root;
+			if (first < 0)
+				first = root;
+		}
+		if (drmModeAtomicAddProperty(split->reqs[root], item->object_id,
+					     item->property_id,
+					     item->value) < 0) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	/* nothing bound to a CRTC, the request can't be split */
+	if (first < 0) {
+		ret = drmModeAtomicCommit(split->fd, req, flags, user_data);
+		goto out;
+	}
+
+	for (i = 0; i < req->cursor; i++) {
+		item = &req->items[i];
+		if (drm_split_object_crtc(drm_split_find(split,
+							 item->object_id)) >= 0)
+			continue;
+		if (drmModeAtomicAddProperty(split->reqs[first], item->object_id,
+					     item->property_id,
+					     item->value) < 0) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	if (!(flags & DRM_MODE_ATOMIC_TEST_ONLY))
+		flags |= DRM_MODE_ATOMIC_NONBLOCK;
+	for (i = 0; i < req->cursor; i++) {
+		crtc = drm_split_object_crtc(drm_split_find(split,
+							    req->items[i].object_id));
+		root = crtc < 0 ? first : drm_split_find_root(parent, crtc);
+		if (done & (1u << root))
+			continue;
+		done |= 1u << root;
+		result[root] = drmModeAtomicCommit(split->fd, split->reqs[root],
+						   flags, user_data);
+		if (result[root] && !ret)
+			ret = result[root];
+	}
+
+	for (i = 0; i < split->count_crtcs; i++)
+		if (used & (1u << drm_split_find_root(parent, i)) &&
+		    !result[drm_split_find_root(parent, i)] && committed)
+			*committed |= 1u << i;
+
+	/* follow the bindings of the groups that went through */
+	if (!(flags & DRM_MODE_ATOMIC_TEST_ONLY)) {
+		for (i = 0; i < req->cursor; i++) {
+			o = drm_split_find(split, req->items[i].object_id);
+			if (o->pending == DRM_SPLIT_UNSET)
+				continue;
+			crtc = drm_split_object_crtc(o);
+			root = crtc < 0 ? first : drm_split_find_root(parent, crtc);
+			if (!result[root])
+				o->crtc = o->pending;
+			o->pending = DRM_SPLIT_UNSET;
+		}
+	}
+
+out:
+	for (i = 0; i < req->cursor; i++)
+		drm_split_find(split, req->items[i].object_id)->pending =
+			DRM_SPLIT_UNSET;
+	return ret;
+}
+
+/*
+ * Mirror of the property values last committed to the CRTCs, planes and
+ * connectors of a device.  It starts from the values read when it is
+ * created and follows the commits made through it, so properties that a
+ * request sets to the value they already have can be dropped without an
+ * ioctl, and a request left with nothing to change isn't committed at all.
+ * Fence and writeback properties act once per commit instead of holding
+ * state and are never dropped.
+ */
+struct drm_shadow_prop {
+	uint32_t object_id;
+	uint32_t prop_id;
+	uint64_t value;
+	int transient;
+	uint32_t last;		/* scratch: last item of a request setting it */
+};
+
+struct _drmModeAtomicShadow {
+	int fd;
+	uint32_t count_props;
+	struct drm_shadow_prop *props;		/* sorted by object, then id */
+	drmModeAtomicReqPtr req;		/* the filtered request */
+};
+
+static const char *const drm_shadow_transient[] = {
+	"IN_FENCE_FD",
+	"OUT_FENCE_PTR",
+	"WRITEBACK_FB_ID",
+	"WRITEBACK_OUT_FENCE_PTR",
+};
+
+static int drm_shadow_cmp(const void *a, const void *b)
+{
+	const struct drm_shadow_prop *pa = a, *pb = b;
+
+	if (pa->object_id != pb->object_id)
+		return pa->object_id < pb->object_id ? -1 : 1;
+	return pa->prop_id < pb->prop_id ? -1 : pa->prop_id > pb->prop_id;
+}
+
+static struct drm_shadow_prop *
+drm_shadow_find(drmModeAtomicShadowPtr shadow, uint32_t object_id,
+		uint32_t prop_id)
+{
+	struct drm_shadow_prop key = {
+		.object_id = object_id,
+		.prop_id = prop_id,
+	};
+
+	return bsearch(&key, shadow->props, shadow->count_props,
+		       sizeof(key), drm_shadow_cmp);
+}
+
+static int drm_shadow_add_object(drmModeAtomicShadowPtr shadow,
+				 drmModePropertyCachePtr cache,
+				 uint32_t *size, uint32_t object_id,
+				 uint32_t object_type,
+				 const drmModeObjectProperties *props)
+{
+	const drmModePropertyInfo *info;
+	struct drm_shadow_prop *p;
+	uint32_t first, i, j, n;
+
+	if (shadow->count_props + props->count_props > *size) {
+		n = 2 * *size + props->count_props;
+		p = realloc(shadow->props, n * sizeof(*p));
+		if (!p)
+			return -ENOMEM;
+		shadow->props = p;
+		*size = n;
+	}
+
+	first = shadow->count_props;
+	for (i = 0; i < props->count_props; i++) {
+		p = &shadow->props[shadow->count_props++];
+		p->object_id = object_id;
+		p->prop_id = props->props[i];
+		p->value = props->prop_values[i];
+		p->transient = 0;
+	}
+
+	for (j = 0; j < sizeof(drm_shadow_transient) /
+			sizeof(drm_shadow_transient[0]); j++) {
+		info = drmModePropertyCacheLookup(cache, object_id, object_type,
+						  drm_shadow_transient[j]);
+		if (!info)
+			continue;
+		for (i = first; i < shadow->count_props; i++)
+			if (shadow->props[i].prop_id == info->prop_id)
+				shadow->props[i].transient = 1;
+	}
+	return 0;
+}
+
+static int drm_shadow_build(drmModeAtomicShadowPtr shadow)
+{
+	drmModeObjectPropertiesPtr props;
+	drmModePropertyCachePtr cache;
+	drmModeSnapshotPtr snap;
+	uint32_t size = 0, i;
+	int ret = 0;
+
+	snap = drmModeGetSnapshot(shadow->fd, 0);
+	if (!snap)
+		return -errno;
+	cache = drmModePropertyCacheCreate(shadow->fd);
+	if (!cache) {
+		drmModeFreeSnapshot(snap);
+		return -ENOMEM;
+	}
+
+	shadow->count_props = 0;
+	for (i = 0; !ret && i < (uint32_t)snap->count_crtcs; i++)
+		ret = drm_shadow_add_object(shadow, cache, &size,
+					    snap->crtcs[i].crtc_id,
+					    DRM_MODE_OBJECT_CRTC,
+					    &snap->crtc_props[i]);
+	for (i = 0; !ret && i < snap->count_planes; i++)
+		ret = drm_shadow_add_object(shadow, cache, &size,
+					    snap->planes[i].plane_id,
+					    DRM_MODE_OBJECT_PLANE,
+					    &snap->plane_props[i]);
+	for (i = 0; !ret && i < (uint32_t)snap->count_connectors; i++) {
+		/* gone since the snapshot, e.g. an unplugged MST port */
+		props = drmModeObjectGetProperties(shadow->fd,
+						   snap->connectors[i].connector_id,
+						   DRM_MODE_OBJECT_CONNECTOR);
+		if (!props)
+			continue;
+		ret = drm_shadow_add_object(shadow, cache, &size,
+					    snap->connectors[i].connector_id,
+					    DRM_MODE_OBJECT_CONNECTOR, props);
+		drmModeFreeObjectProperties(props);
+	}
+
+	if (ret)
+		shadow->count_props = 0;
+	else
+		qsort(shadow->props, shadow->count_props,
+		      sizeof(*shadow->props), drm_shadow_cmp);
+
+	drmModePropertyCacheDestroy(cache);
+	drmModeFreeSnapshot(snap);
+	return ret;
+}
+
+/*
+ * Create a mirror of the current property values of the CRTCs, planes and
+ * connectors of @fd.  Enables DRM_CLIENT_CAP_UNIVERSAL_PLANES and
+ * DRM_CLIENT_CAP_ATOMIC.  Returns NULL with errno set on failure.
+ */
+drm_public drmModeAtomicShadowPtr drmModeAtomicShadowCreate(int fd)
+{
+	drmModeAtomicShadowPtr shadow;
+	int ret;
+
+	if (drmSetClientCap(fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1) ||
+	    drmSetClientCap(fd, DRM_CLIENT_CAP_ATOMIC, 1))
+		return NULL;
+
+	shadow = drmMalloc(sizeof(*shadow));
+	if (!shadow) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	shadow->fd = fd;
+
+	shadow->req = drmModeAtomicAlloc();
+	if (!shadow->req) {
+		drmModeAtomicShadowDestroy(shadow);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	ret = drm_shadow_build(shadow);
+	if (ret) {
+		drmModeAtomicShadowDestroy(shadow);
+		errno = -ret;
+		return NULL;
+	}
+
+	return shadow;
+}
+
+drm_public void drmModeAtomicShadowDestroy(drmModeAtomicShadowPtr shadow)
+{
+	if (!shadow)
+		return;
+
+	drmModeAtomicFree(shadow->req);
+	free(shadow->props);
+	drmFree(shadow);
+}
+
+/*
+ * Read the property values again, after they were changed by commits or
+ * legacy calls such as drmModeSetCrtc() that didn't go through the mirror,
+ * on hotplug, or after another master held the device.
+ */
+drm_public int drmModeAtomicShadowInvalidate(drmModeAtomicShadowPtr shadow)
+{
+	if (!shadow)
+		return -EINVAL;
+
+	return drm_shadow_build(shadow);
+}
+
+/*
+ * Like drmModeAtomicCommit(), but properties @req sets to the value they
+ * already have are left out, and a request that changes nothing returns 0
+ * without an ioctl.  Requests asking for DRM_MODE_PAGE_FLIP_EVENT are
+ * still committed in full then, so the events arrive.  @req itself is not
+ * modified.  A successful commit without DRM_MODE_ATOMIC_TEST_ONLY updates
+ * the mirror with the values it set.
+ */
+drm_public int drmModeAtomicShadowCommit(drmModeAtomicShadowPtr shadow,
+					 drmModeAtomicReqPtr req,
+					 uint32_t flags, void *user_data)
+{
+	drmModeAtomicReqItemPtr item;
+	drmModeAtomicReqPtr commit;
+	struct drm_shadow_prop *p;
+	uint32_t i;
+	int ret;
+
+	if (!shadow || !req)
+		return -EINVAL;
+
+	/* a property set twice takes its last value */
+	for (i = 0; i < req->cursor; i++) {
+		item = &req->items[i];
+		p = drm_shadow_find(shadow, item->object_id, item->property_id);
+		if (p)
+			p->last = i;
+	}
+
+	drmModeAtomicReset(shadow->req);
+	for (i = 0; i < req->cursor; i++) {
+		item = &req->items[i];
+		p = drm_shadow_find(shadow, item->object_id, item->property_id);
+		if (p && (p->last != i ||
+			  (!p->transient && p->value == item->value)))
+			continue;
+		if (drmModeAtomicAddProperty(shadow->req, item->object_id,
+					     item->property_id,
+					     item->value) < 0)
+			return -ENOMEM;
+	}
+
+	commit = shadow->req;
+	if (commit->cursor == 0) {
+		if (!(flags & DRM_MODE_PAGE_FLIP_EVENT))
+			return 0;
+		commit = req;
+	}
+
+	ret = drmModeAtomicCommit(shadow->fd, commit, flags, user_data);
+	if (ret || (flags & DRM_MODE_ATOMIC_TEST_ONLY))
+		return ret;
+
+	for (i = 0; i < commit->cursor; i++) {
+		item = &commit->items[i];
+		p = drm_shadow_find(shadow, item->object_id, item->property_id);
+		if (p && !p->transient)
+			p->value = item->value;
+	}
+	return 0;
+}
+
+drm_public int
+drmModeCreatePropertyBlob(int fd, const void *data, size_t length,
+                                     uint32_t *id)
+{
+	struct drm_mode_create_blob create;
+	int ret;
+
+	if (length >= 0xffffffff)
+		return -ERANGE;
+
+	memclear(create);
+
+	create.length = length;
+	create.data = (uintptr_t) data;
+	create.blob_id = 0;
+	*id = 0;
+
+	ret = DRM_IOCTL(fd, DRM_IOCTL_MODE_CREATEPROPBLOB, &create);
+	if (ret != 0)
+		return ret;
+
+	*id = create.blob_id;
+	return 0;
+}
+
+drm_public int
+drmModeDestroyPropertyBlob(int fd, uint32_t id)
+{
+	struct drm_mode_destroy_blob destroy;
+
+	memclear(destroy);
+	destroy.blob_id = id;
+	return DRM_IOCTL(fd, DRM_IOCTL_MODE_DESTROYPROPBLOB, &destroy);
+}
+
+drm_public int
+drmModeCreateLease(int fd, const uint32_t *objects, int num_objects, int flags,
+                   uint32_t *lessee_id)
+{
+	struct drm_mode_create_lease create;
+	int ret;
+
+	memclear(create);
+	create.object_ids = (uintptr_t) objects;
+	create.object_count = num_objects;
+	create.flags = flags;
+
+	ret = DRM_IOCTL(fd, DRM_IOCTL_MODE_CREATE_LEASE, &create);
+	if (ret == 0) {
+		*lessee_id = create.lessee_id;
+		return create.fd;
+	}
+	return -errno;
+}
+
+drm_public drmModeLesseeListPtr
+drmModeListLessees(int fd)
+{
+	struct drm_mode_list_lessees list;
+	uint32_t count;
+	drmModeLesseeListPtr ret;
+
+	memclear(list);
+
+	if (DRM_IOCTL(fd, DRM_IOCTL_MODE_LIST_LESSEES, &list))
+		return NULL;
+
+	count = list.count_lessees;
+	ret = drmMalloc(sizeof (drmModeLesseeListRes) + count * sizeof (ret->lessees[0]));
+	if (!ret)
+		return NULL;
+
+	list.lessees_ptr = VOID2U64(&ret->lessees[0]);
+	if (DRM_IOCTL(fd, DRM_IOCTL_MODE_LIST_LESSEES, &list)) {
+		drmFree(ret);
+		return NULL;
+	}
+
+	ret->count = count;
+	return ret;
+}
+
+drm_public drmModeObjectListPtr
+drmModeGetLease(int fd)
+{
+	struct drm_mode_get_lease get;
+	uint32_t count;
+	drmModeObjectListPtr ret;
+
+	memclear(get);
+
+	if (DRM_IOCTL(fd, DRM_IOCTL_MODE_GET_LEASE, &get))
+		return NULL;
+
+	count = get.count_objects;
+	ret = drmMalloc(sizeof (drmModeObjectListRes) + count * sizeof (ret->objects[0]));
+	if (!ret)
+		return NULL;
+
+	get.objects_ptr = VOID2U64(&ret->objects[0]);
+	if (DRM_IOCTL(fd, DRM_IOCTL_MODE_GET_LEASE, &get)) {
+		drmFree(ret);
+		return NULL;
+	}
+
+	ret->count = count;
+	return ret;
+}
+
+drm_public int
+drmModeRevokeLease(int fd, uint32_t lessee_id)
+{
+	struct drm_mode_revoke_lease revoke;
+	int ret;
+
+	memclear(revoke);
+
+	revoke.lessee_id = lessee_id;
+
+	ret = DRM_IOCTL(fd, DRM_IOCTL_MODE_REVOKE_LEASE, &revoke);
+	if (ret == 0)
+		return 0;
+	return -errno;
+}
+
+/*
+ * Property name to ID cache.  Property definitions are per device, so each
+ * one is fetched once however many objects carry it, and each object then
+ * costs a single GETPROPERTIES ioctl to build its name table.
+ */
+struct drm_prop_cache_info {
+	drmModePropertyInfo info;
+	struct drm_prop_cache_info *next;
+};
+
+struct drm_prop_cache_slot {
+	uint32_t hash;
+	const drmModePropertyInfo *info;
+};
+
+struct drm_prop_cache_object {
+	struct drm_prop_cache_object *next;
+	uint32_t object_id;
+	uint32_t mask;
+	struct drm_prop_cache_slot slots[];
+};
+
+struct _drmModePropertyCache {
+	int fd;
+	void *props;	/* prop_id -> struct drm_prop_cache_info */
+	void *objects;	/* object_id -> struct drm_prop_cache_object */
+	struct drm_prop_cache_info *prop_list;
+	struct drm_prop_cache_object *object_list;
+};
+
+static uint32_t drm_prop_name_hash(const char *name)
+{
+	uint32_t hash = 2166136261u;
+
+	while (*name)
+		hash = (hash ^ (unsigned char)*name++) * 16777619u;
+	return hash;
+}
+
+static const drmModePropertyInfo *
+drm_prop_cache_get_info(drmModePropertyCachePtr cache, uint32_t prop_id)
+{
+	struct drm_prop_cache_info *entry;
+	struct drm_mode_get_property prop;
+	uint64_t values[2] = { 0, 0 };
+	void *value;
+
+	if (!drmIntMapLookup(cache->props, prop_id, &value))
+		return &((struct drm_prop_cache_info *)value)->info;
+
+	/* Two values hold the limits of range properties.  The enum and blob
+	 * lists aren't wanted, so one ioctl is enough. */
+	memclear(prop);
+	prop.prop_id = prop_id;
+	prop.values_ptr = VOID2U64(values);
+	prop.count_values = 2;
+
+	if (DRM_IOCTL(cache->fd, DRM_IOCTL_MODE_GETPROPERTY, &prop))
+		return NULL;
+
+	entry = drmMalloc(sizeof(*entry));
+	if (!entry)
+		return NULL;
+
+	entry->info.prop_id = prop.prop_id;
+	entry->info.flags = prop.flags;
+	if ((prop.flags & (DRM_MODE_PROP_RANGE | DRM_MODE_PROP_SIGNED_RANGE)) &&
+	    prop.count_values == 2) {
+		entry->info.min = values[0];
+		entry->info.max = values[1];
+	}
+	strncpy(entry->info.name, prop.name, DRM_PROP_NAME_LEN);
+	entry->info.name[DRM_PROP_NAME_LEN - 1] = 0;
+
+	if (drmIntMapInsert(cache->props, prop_id, entry)) {
+		drmFree(entry);
+		return NULL;
+	}
+	entry->next = cache->prop_list;
+	cache->prop_list = entry;
+
+	return &entry->info;
+}
+
+static struct drm_prop_cache_object *
+drm_prop_cache_get_object(drmModePropertyCachePtr cache, uint32_t object_id,
+			  uint32_t object_type)
+{
+	struct drm_prop_cache_object *object = NULL;
+	struct drm_mode_obj_get_properties properties;
+	uint32_t stack_ids[64], *ids = stack_ids;
+	uint64_t stack_values[64], *values = stack_values;
+	const drmModePropertyInfo *info;
+	uint32_t count, slots, hash, i, j;
+	void *value;
+
+	if (!drmIntMapLookup(cache->objects, object_id, &value))
+		return value;
+
+	/* A stack buffer fits every object the kernel has today, which saves
+	 * the usual ioctl to query the count first. */
+	memclear(properties);
+	properties.obj_id = object_id;
+	properties.obj_type = object_type;
+	properties.count_props = sizeof(stack_ids) / sizeof(stack_ids[0]);
+	properties.props_ptr = VOID2U64(ids);
+	properties.prop_values_ptr = VOID2U64(values);
+
+	if (DRM_IOCTL(cache->fd, DRM_IOCTL_MODE_OBJ_GETPROPERTIES, &properties))
+		return NULL;
+
+	count = properties.count_props;
+	if (count > sizeof(stack_ids) / sizeof(stack_ids[0])) {
+		ids = drmMalloc(count * sizeof(*ids));
+		values = drmMalloc(count * sizeof(*values));
+		if (!ids || !values)
+			goto out;
+
+		properties.props_ptr = VOID2U64(ids);
+		properties.prop_values_ptr = VOID2U64(values);
+		if (DRM_IOCTL(cache->fd, DRM_IOCTL_MODE_OBJ_GETPROPERTIES,
+			      &properties))
+			goto out;
+
+		/* Properties are fixed once an object is registered. */
+		if (properties.count_props > count) {
+			errno = EAGAIN;
+			goto out;
+		}
+		count = properties.count_props;
+	}
+
+	for (slots = 8; slots < 2 * count; slots *= 2)
+		;
+
+	object = drmMalloc(sizeof(*object) + slots * sizeof(object->slots[0]));
+	if (!object)
+		goto out;
+	object->object_id = object_id;
+	object->mask = slots - 1;
+
+	for (i = 0; i < count; i++) {
+		info = drm_prop_cache_get_info(cache, ids[i]);
+		if (!info)
+			goto fail;
+
+		hash = drm_prop_name_hash(info->name);
+		for (j = hash & object->mask; object->slots[j].info;
+		     j = (j + 1) & object->mask)
+			;
+		object->slots[j].hash = hash;
+		object->slots[j].info = info;
+	}
+
+	if (drmIntMapInsert(cache->objects, object_id, object))
+		goto fail;
+	object->next = cache->object_list;
+	cache->object_list = object;
+	goto out;
+
+fail:
+	drmFree(object);
+	object = NULL;
+out:
+	if (ids != stack_ids) {
+		drmFree(ids);
+		drmFree(values);
+	}
+	return object;
+}
+
+drm_public drmModePropertyCachePtr drmModePropertyCacheCreate(int fd)
+{
+	drmModePropertyCachePtr cache;
+
+	cache = drmMalloc(sizeof(*cache));
+	if (!cache)
+		return NULL;
+
+	cache->fd = fd;
+	cache->props = drmIntMapCreate();
+	cache->objects = drmIntMapCreate();
+	if (!cache->props || !cache->objects) {
+		drmModePropertyCacheDestroy(cache);
+		return NULL;
+	}
+
+	return cache;
+}
+
+/*
+ * Forget everything that was fetched, e.g. after a hotplug event.  Pointers
+ * returned by drmModePropertyCacheLookup() become invalid.
+ */
+drm_public void drmModePropertyCacheInvalidate(drmModePropertyCachePtr cache)
+{
+	struct drm_prop_cache_object *object;
+	struct drm_prop_cache_info *info;
+
+	if (!cache)
+		return;
+
+	while ((object = cache->object_list)) {
+		cache->object_list = object->next;
+		drmIntMapDelete(cache->objects, object->object_id);
+		drmFree(object);
+	}
+
+	while ((info = cache->prop_list)) {
+		cache->prop_list = info->next;
+		drmIntMapDelete(cache->props, info->info.prop_id);
+		drmFree(info);
+	}
+}
+
+drm_public void drmModePropertyCacheDestroy(drmModePropertyCachePtr cache)
+{
+	if (!cache)
+		return;
+
+	if (cache->props && cache->objects)
+		drmModePropertyCacheInvalidate(cache);
+	if (cache->props)
+		drmIntMapDestroy(cache->props);
+	if (cache->objects)
+		drmIntMapDestroy(cache->objects);
+	drmFree(cache);
+}
+
+/*
+ * Look up a property of a KMS object by name.  The first lookup on an
+ * object fetches all of its properties; later ones make no ioctls.
+ * object_type may be DRM_MODE_OBJECT_ANY.  Returns NULL with errno set if
+ * the object can't be queried or has no such property.
+ */
+drm_public const drmModePropertyInfo *
+drmModePropertyCacheLookup(drmModePropertyCachePtr cache, uint32_t object_id,
+			   uint32_t object_type, const char *name)
+{
+	struct drm_prop_cache_object *object;
+	uint32_t hash, j;
+
+	if (!cache || !name) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	object = drm_prop_cache_get_object(cache, object_id, object_type);
+	if (!object)
+		return NULL;
+
+	hash = drm_prop_name_hash(name);
+	for (j = hash & object->mask; object->slots[j].info;
+	     j = (j + 1) & object->mask) {
+		if (object->slots[j].hash == hash &&
+		    !strcmp(object->slots[j].info->name, name))
+			return object->slots[j].info;
+	}
+
+	errno = ENOENT;
+	return NULL;
+}
+
+/*
+ * KMS topology snapshots.  Everything is written into one buffer that may
+ * move while it grows, so pointers are kept as offsets into it (zero meaning
+ * NULL, as offset zero is the header) and only turned into real pointers
+ * once the snapshot is complete.
+ */
+struct drm_snapshot_builder {
+	char *buf;
+	size_t size;
+	size_t used;
+};
+
+#define SNAP_AT(b, off, type)	((type *)(void *)((b)->buf + (off)))
+#define SNAP(b)			SNAP_AT(b, 0, drmModeSnapshot)
+#define SNAP_OFF(p)		((size_t)(uintptr_t)(p))
+#define OFF_SNAP(off)		((void *)(uintptr_t)(off))
+
+static int drm_snapshot_alloc(struct drm_snapshot_builder *b, size_t size,
+			      size_t *offset)
+{
+	size_t start = (b->used + 7) & ~(size_t)7;
+	size_t new_size;
+	char *buf;
+
+	*offset = 0;
+	if (size == 0)
+		return 0;
+
+	if (start + size > b->size) {
+		for (new_size = b->size ? b->size : 4096;
+		     new_size < start + size; new_size *= 2)
+			;
+		buf = realloc(b->buf, new_size);
+		if (!buf)
+			return -ENOMEM;
+		b->buf = buf;
+		b->size = new_size;
+	}
+
+	memset(b->buf + start, 0, size);
+	b->used = start + size;
+	*offset = start;
+	return 0;
+}
+
+static uint64_t drm_snapshot_user_ptr(struct drm_snapshot_builder *b,
+				      size_t offset)
+{
+	return offset ? VOID2U64(b->buf + offset) : 0;
+}
+
+static int drm_snapshot_props(int fd, struct drm_snapshot_builder *b,
+			      uint32_t object_id, uint32_t object_type,
+			      size_t offset)
+{
+	struct drm_mode_obj_get_properties properties;
+	drmModeObjectPropertiesPtr p;
+	size_t props, values;
+	uint32_t count;
+	int ret;
+
+	memclear(properties);
+	properties.obj_id = object_id;
+	properties.obj_type = object_type;
+
+	if (drmIoctl(fd, DRM_IOCTL_MODE_OBJ_GETPROPERTIES, &properties))
+		return -errno;
+
+	count = properties.count_props;
+	if ((ret = drm_snapshot_alloc(b, count * sizeof(uint32_t), &props)) ||
+	    (ret = drm_snapshot_alloc(b, count * sizeof(uint64_t), &values)))
+		return ret;
+
+	properties.props_ptr = drm_snapshot_user_ptr(b, props);
+	properties.prop_values_ptr = drm_snapshot_user_ptr(b, values);
+
+	if (drmIoctl(fd, DRM_IOCTL_MODE_OBJ_GETPROPERTIES, &properties))
+		return -errno;
+	if (count < properties.count_props)
+		return -EAGAIN;
+
+	p = SNAP_AT(b, offset, drmModeObjectProperties);
+	p->count_props = properties.count_props;
+	p->props = OFF_SNAP(props);
+	p->prop_values = OFF_SNAP(values);
+	return 0;
+}
+
+static int drm_snapshot_connector(int fd, uint32_t flags,
+				  struct drm_snapshot_builder *b,
+				  uint32_t connector_id, size_t offset)
+{
+	struct drm_mode_get_connector conn, counts;
+	struct drm_mode_modeinfo stack_mode;
+	size_t modes, props, values, encoders;
+	drmModeConnectorPtr r;
+	int ret;
+
+	memclear(conn);
+	conn.connector_id = connector_id;
+	if (!(flags & DRM_MODE_SNAPSHOT_PROBE)) {
+		conn.count_modes = 1;
+		conn.modes_ptr = VOID2U64(&stack_mode);
+	}
+
+	if (drmIoctl(fd, DRM_IOCTL_MODE_GETCONNECTOR, &conn))
+		return -errno;
+
+	counts = conn;
+	if ((ret = drm_snapshot_alloc(b, counts.count_modes *
+				      sizeof(struct drm_mode_modeinfo),
+				      &modes)) ||
+	    (ret = drm_snapshot_alloc(b, counts.count_props * sizeof(uint32_t),
+				      &props)) ||
+	    (ret = drm_snapshot_alloc(b, counts.count_props * sizeof(uint64_t),
+				      &values)) ||
+	    (ret = drm_snapshot_alloc(b, counts.count_encoders *
+				      sizeof(uint32_t), &encoders)))
+		return ret;
+
+	conn.props_ptr = drm_snapshot_user_ptr(b, props);
+	conn.prop_values_ptr = drm_snapshot_user_ptr(b, values);
+	conn.encoders_ptr = drm_snapshot_user_ptr(b, encoders);
+	if (modes) {
+		conn.modes_ptr = drm_snapshot_user_ptr(b, modes);
+	} else {
+		/* Don't let a zero mode count make the kernel probe again. */
+		conn.count_modes = 1;
+		conn.modes_ptr = VOID2U64(&stack_mode);
+	}
+
+	if (drmIoctl(fd, DRM_IOCTL_MODE_GETCONNECTOR, &conn))
+		return -errno;
+
+	if (counts.count_props < conn.count_props ||
+	    counts.count_modes < conn.count_modes ||
+	    counts.count_encoders < conn.count_encoders)
+		return -EAGAIN;
+
+	r = SNAP_AT(b, offset, drmModeConnector);
+	r->connector_id = conn.connector_id;
+	r->encoder_id = conn.encoder_id;
+	r->connection   = conn.connection;
+	r->mmWidth      = conn.mm_width;
+	r->mmHeight     = conn.mm_height;
+	/* convert subpixel from kernel to userspace */
+	r->subpixel     = conn.subpixel + 1;
+	r->count_modes  = conn.count_modes;
+	r->modes        = OFF_SNAP(modes);
+	r->count_props  = conn.count_props;
+	r->props        = OFF_SNAP(props);
+	r->prop_values  = OFF_SNAP(values);
+	r->count_encoders = conn.count_encoders;
+	r->encoders     = OFF_SNAP(encoders);
+	r->connector_type  = conn.connector_type;
+	r->connector_type_id = conn.connector_type_id;
+	return 0;
+}
+
+static int drm_snapshot_encoder(int fd, struct drm_snapshot_builder *b,
+				uint32_t encoder_id, size_t offset)
+{
+	struct drm_mode_get_encoder enc;
+	drmModeEncoderPtr r;
+
+	memclear(enc);
+	enc.encoder_id = encoder_id;
+
+	if (drmIoctl(fd, DRM_IOCTL_MODE_GETENCODER, &enc))
+		return -errno;
+
+	r = SNAP_AT(b, offset, drmModeEncoder);
+	r->encoder_id = enc.encoder_id;
+	r->crtc_id = enc.crtc_id;
+	r->encoder_type = enc.encoder_type;
+	r->possible_crtcs = enc.possible_crtcs;
+	r->possible_clones = enc.possible_clones;
+	return 0;
+}
+
+static int drm_snapshot_crtc(int fd, struct drm_snapshot_builder *b,
+			     uint32_t crtc_id, size_t offset)
+{
+	struct drm_mode_crtc crtc;
+	drmModeCrtcPtr r;
+
+	memclear(crtc);
+	crtc.crtc_id = crtc_id;
+
+	if (drmIoctl(fd, DRM_IOCTL_MODE_GETCRTC, &crtc))
+		return -errno;
+
+	r = SNAP_AT(b, offset, drmModeCrtc);
+	r->crtc_id         = crtc.crtc_id;
+	r->x               = crtc.x;
+	r->y               = crtc.y;
+	r->mode_valid      = crtc.mode_valid;
+	if (r->mode_valid) {
+		memcpy(&r->mode, &crtc.mode, sizeof(struct drm_mode_modeinfo));
+		r->width = crtc.mode.hdisplay;
+		r->height = crtc.mode.vdisplay;
+	}
+	r->buffer_id       = crtc.fb_id;
+	r->gamma_size      = crtc.gamma_size;
+	return 0;
+}
+
+static int drm_snapshot_plane(int fd, struct drm_snapshot_builder *b,
+			      uint32_t plane_id, size_t offset)
+{
+	struct drm_mode_get_plane ovr;
+	drmModePlanePtr r;
+	size_t formats;
+	uint32_t count;
+	int ret;
+
+	memclear(ovr);
+	ovr.plane_id = plane_id;
+
+	if (drmIoctl(fd, DRM_IOCTL_MODE_GETPLANE, &ovr))
+		return -errno;
+
+	count = ovr.count_format_types;
+	ret = drm_snapshot_alloc(b, count * sizeof(uint32_t), &formats);
+	if (ret)
+		return ret;
+
+	ovr.format_type_ptr = drm_snapshot_user_ptr(b, formats);
+	if (drmIoctl(fd, DRM_IOCTL_MODE_GETPLANE, &ovr))
+		return -errno;
+	if (count < ovr.count_format_types)
+		return -EAGAIN;
+
+	r = SNAP_AT(b, offset, drmModePlane);
+	r->count_formats = ovr.count_format_types;
+	r->formats = OFF_SNAP(formats);
+	r->plane_id = ovr.plane_id;
+	r->crtc_id = ovr.crtc_id;
+	r->fb_id = ovr.fb_id;
+	r->possible_crtcs = ovr.possible_crtcs;
+	r->gamma_size = ovr.gamma_size;
+	return 0;
+}
+
+static int drm_snapshot_fill(int fd, uint32_t flags,
+			     struct drm_snapshot_builder *b)
+{
+	struct drm_mode_card_res res, counts;
+	struct drm_mode_get_plane_res plane_res;
+	size_t header, fbs, crtc_ids, connector_ids, encoder_ids, plane_ids;
+	size_t connectors, encoders, crtcs, crtc_props, planes, plane_props;
+	drmModeSnapshotPtr snap;
+	uint32_t count_planes, i;
+	int ret;
+
+	ret = drm_snapshot_alloc(b, sizeof(drmModeSnapshot), &header);
+	if (ret)
+		return ret;
+
+	memclear(res);
+	if (drmIoctl(fd, DRM_IOCTL_MODE_GETRESOURCES, &res))
+		return -errno;
+
+	counts = res;
+	if ((ret = drm_snapshot_alloc(b, counts.count_fbs * sizeof(uint32_t),
+				      &fbs)) ||
+	    (ret = drm_snapshot_alloc(b, counts.count_crtcs * sizeof(uint32_t),
+				      &crtc_ids)) ||
+	    (ret = drm_snapshot_alloc(b, counts.count_connectors *
+				      sizeof(uint32_t), &connector_ids)) ||
+	    (ret = drm_snapshot_alloc(b, counts.count_encoders *
+				      sizeof(uint32_t), &encoder_ids)))
+		return ret;
+
+	res.fb_id_ptr = drm_snapshot_user_ptr(b, fbs);
+	res.crtc_id_ptr = drm_snapshot_user_ptr(b, crtc_ids);
+	res.connector_id_ptr = drm_snapshot_user_ptr(b, connector_ids);
+	res.encoder_id_ptr = drm_snapshot_user_ptr(b, encoder_ids);
+
+	if (drmIoctl(fd, DRM_IOCTL_MODE_GETRESOURCES, &res))
+		return -errno;
+
+	if (counts.count_fbs < res.count_fbs ||
+	    counts.count_crtcs < res.count_crtcs ||
+	    counts.count_connectors < res.count_connectors ||
+	    counts.count_encoders < res.count_encoders)
+		return -EAGAIN;
+
+	memclear(plane_res);
+	if (drmIoctl(fd, DRM_IOCTL_MODE_GETPLANERESOURCES, &plane_res))
+		return -errno;
+
+	count_planes = plane_res.count_planes;
+	ret = drm_snapshot_alloc(b, count_planes * sizeof(uint32_t),
+				 &plane_ids);
+	if (ret)
+		return ret;
+
+	plane_res.plane_id_ptr = drm_snapshot_user_ptr(b, plane_ids);
+	if (drmIoctl(fd, DRM_IOCTL_MODE_GETPLANERESOURCES, &plane_res))
+		return -errno;
+	if (count_planes < plane_res.count_planes)
+		return -EAGAIN;
+
+	if ((ret = drm_snapshot_alloc(b, res.count_connectors *
+				      sizeof(drmModeConnector),
+				      &connectors)) ||
+	    (ret = drm_snapshot_alloc(b, res.count_encoders *
+				      sizeof(drmModeEncoder), &encoders)) ||
+	    (ret = drm_snapshot_alloc(b, res.count_crtcs * sizeof(drmModeCrtc),
+				      &crtcs)) ||
+	    (ret = drm_snapshot_alloc(b, res.count_crtcs *
+				      sizeof(drmModeObjectProperties),
+				      &crtc_props)) ||
+	    (ret = drm_snapshot_alloc(b, plane_res.count_planes *
+				      sizeof(drmModePlane), &planes)) ||
+	    (ret = drm_snapshot_alloc(b, plane_res.count_planes *
+				      sizeof(drmModeObjectProperties),
+				      &plane_props)))
+		return ret;
+
+	for (i = 0; i < res.count_connectors; i++) {
+		ret = drm_snapshot_connector(fd, flags, b,
+				SNAP_AT(b, connector_ids, uint32_t)[i],
+				connectors + i * sizeof(drmModeConnector));
+		if (ret)
+			return ret;
+	}
+
+	for (i = 0; i < res.count_encoders; i++) {
+		ret = drm_snapshot_encoder(fd, b,
+				SNAP_AT(b, encoder_ids, uint32_t)[i],
+				encoders + i * sizeof(drmModeEncoder));
+		if (ret)
+			return ret;
+	}
+
+	for (i = 0; i < res.count_crtcs; i++) {
+		uint32_t crtc_id = SNAP_AT(b, crtc_ids, uint32_t)[i];
+
+		ret = drm_snapshot_crtc(fd, b, crtc_id,
+					crtcs + i * sizeof(drmModeCrtc));
+		if (!ret)
+			ret = drm_snapshot_props(fd, b, crtc_id,
+					DRM_MODE_OBJECT_CRTC, crtc_props +
+					i * sizeof(drmModeObjectProperties));
+		if (ret)
+			return ret;
+	}
+
+	for (i = 0; i < plane_res.count_planes; i++) {
+		uint32_t plane_id = SNAP_AT(b, plane_ids, uint32_t)[i];
+
+		ret = drm_snapshot_plane(fd, b, plane_id,
+					 planes + i * sizeof(drmModePlane));
+		if (!ret)
+			ret = drm_snapshot_props(fd, b, plane_id,
+					DRM_MODE_OBJECT_PLANE, plane_props +
+					i * sizeof(drmModeObjectProperties));
+		if (ret)
+			return ret;
+	}
+
+	snap = SNAP(b);
+	snap->min_width = res.min_width;
+	snap->max_width = res.max_width;
+	snap->min_height = res.min_height;
+	snap->max_height = res.max_height;
+	snap->count_fbs = res.count_fbs;
+	snap->fbs = OFF_SNAP(fbs);
+	snap->count_connectors = res.count_connectors;
+	snap->connectors = OFF_SNAP(connectors);
+	snap->count_encoders = res.count_encoders;
+	snap->encoders = OFF_SNAP(encoders);
+	snap->count_crtcs = res.count_crtcs;
+	snap->crtcs = OFF_SNAP(crtcs);
+	snap->crtc_props = OFF_SNAP(crtc_props);
+	snap->count_planes = plane_res.count_planes;
+	snap->planes = OFF_SNAP(planes);
+	snap->plane_props = OFF_SNAP(plane_props);
+	return 0;
+}
+
+static void *drm_snapshot_fixup(char *base, const void *offset)
+{
+	return offset ? base + SNAP_OFF(offset) : NULL;
+}
+
+/*
+ * Capture the whole KMS topology: resources, connectors (with their
+ * properties), encoders, CRTCs and planes (with their properties), in a
+ * single allocation.  Pass DRM_MODE_SNAPSHOT_PROBE to probe connectors the
+ * way drmModeGetConnector() does.  The snapshot is read-only and its
+ * pointers stay valid until drmModeFreeSnapshot().  Returns NULL with errno
+ * set on failure.
+ */
+drm_public drmModeSnapshotPtr drmModeGetSnapshot(int fd, uint32_t flags)
+{
+	struct drm_snapshot_builder b = { NULL, 0, 0 };
+	drmModeSnapshotPtr snap;
+	char *buf;
+	int i, ret;
+
+	if (flags & ~DRM_MODE_SNAPSHOT_PROBE) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	/* The topology may change between the count and fill ioctls, in
+	 * which case start over. */
+	do {
+		b.used = 0;
+		ret = drm_snapshot_fill(fd, flags, &b);
+	} while (ret == -EAGAIN);
+
+	if (ret) {
+		free(b.buf);
+		errno = -ret;
+		return NULL;
+	}
+
+	buf = realloc(b.buf, b.used);
+	if (buf)
+		b.buf = buf;
+
+	snap = SNAP(&b);
+	snap->size = b.used;
+	snap->fbs = drm_snapshot_fixup(b.buf, snap->fbs);
+	snap->connectors = drm_snapshot_fixup(b.buf, snap->connectors);
+	snap->encoders = drm_snapshot_fixup(b.buf, snap->encoders);
+	snap->crtcs = drm_snapshot_fixup(b.buf, snap->crtcs);
+	snap->crtc_props = drm_snapshot_fixup(b.buf, snap->crtc_props);
+	snap->planes = drm_snapshot_fixup(b.buf, snap->planes);
+	snap->plane_props = drm_snapshot_fixup(b.buf, snap->plane_props);
+
+	for (i = 0; i < snap->count_connectors; i++) {
+		drmModeConnectorPtr c = &snap->connectors[i];
+
+		c->modes = drm_snapshot_fixup(b.buf, c->modes);
+		c->props = drm_snapshot_fixup(b.buf, c->props);
+		c->prop_values = drm_snapshot_fixup(b.buf, c->prop_values);
+		c->encoders = drm_snapshot_fixup(b.buf, c->encoders);
+	}
+	for (i = 0; i < snap->count_crtcs; i++) {
+		drmModeObjectPropertiesPtr p = &snap->crtc_props[i];
+
+		p->props = drm_snapshot_fixup(b.buf, p->props);
+		p->prop_values = drm_snapshot_fixup(b.buf, p->prop_values);
+	}
+	for (i = 0; i < (int)snap->count_planes; i++) {
+		drmModeObjectPropertiesPtr p = &snap->plane_props[i];
+
+		snap->planes[i].formats =
+			drm_snapshot_fixup(b.buf, snap->planes[i].formats);
+		p->props = drm_snapshot_fixup(b.buf, p->props);
+		p->prop_values = drm_snapshot_fixup(b.buf, p->prop_values);
+	}
+
+	return snap;
+}
+
+drm_public void drmModeFreeSnapshot(drmModeSnapshotPtr snapshot)
+{
+	free(snapshot);
+}
+
+/*
+ * Framebuffer ID cache.  Entries are keyed by the complete ADDFB2 argument
+ * block, hashed into chained buckets, and kept on an LRU list; the least
+ * recently used framebuffer is removed once the cache is full.
+ */
+struct drm_fb_cache_entry {
+	struct list_head lru;
+	struct drm_fb_cache_entry *next;	/* bucket chain */
+	uint64_t hash;
+	struct drm_mode_fb_cmd2 key;		/* fb_id is 0 */
+	uint32_t fb_id;
+};
+
+struct _drmModeFBCache {
+	int fd;
+	uint32_t max_entries;
+	uint32_t count;
+	uint32_t mask;
+	struct drm_fb_cache_entry **buckets;
+	struct list_head lru;			/* most recently used first */
+};
+
+drm_public drmModeFBCachePtr drmModeFBCacheCreate(int fd, uint32_t max_entries)
+{
+	drmModeFBCachePtr cache;
+	uint32_t size;
+
+	if (max_entries == 0)
+		max_entries = 32;
+	if (max_entries > (1u << 16))
+		max_entries = 1u << 16;
+	for (size = 1; size < max_entries; size *= 2)
+		;
+
+	cache = drmMalloc(sizeof(*cache));
+	if (!cache)
+		return NULL;
+
+	cache->buckets = drmMalloc(size * sizeof(*cache->buckets));
+	if (!cache->buckets) {
+		drmFree(cache);
+		return NULL;
+	}
+	cache->fd = fd;
+	cache->max_entries = max_entries;
+	cache->mask = size - 1;
+	list_inithead(&cache->lru);
+
+	return cache;
+}
+
+static void drm_fb_cache_remove(drmModeFBCachePtr cache,
+				struct drm_fb_cache_entry *entry)
+{
+	struct drm_fb_cache_entry **link;
+
+	for (link = &cache->buckets[entry->hash & cache->mask]; *link != entry;
+	     link = &(*link)->next)
+		;
+	*link = entry->next;
+	list_del(&entry->lru);
+	cache->count--;
+
+	drmModeRmFB(cache->fd, entry->fb_id);
+	free(entry);
+}
+
+/*
+ * Remove all cached framebuffers, which disables any plane still scanning
+ * one of them out, and free the cache.
+ */
+drm_public void drmModeFBCacheDestroy(drmModeFBCachePtr cache)
+{
+	struct drm_fb_cache_entry *entry, *tmp;
+
+	if (!cache)
+		return;
+
+	LIST_FOR_EACH_ENTRY_SAFE(entry, tmp, &cache->lru, lru)
+		drm_fb_cache_remove(cache, entry);
+	drmFree(cache->buckets);
+	drmFree(cache);
+}
+
+/*
+ * Like drmModeAddFB2WithModifiers(), but returns the framebuffer created by
+ * an earlier call with the same arguments instead of creating a new one.
+ * The framebuffer belongs to the cache: don't pass it to drmModeRmFB().
+ *
+ * The least recently used framebuffer is removed when the cache is full, so
+ * max_entries must be larger than the number of buffers that can be on
+ * screen or queued for a flip at the same time.
+ */
+drm_public int drmModeFBCacheAddFB2(drmModeFBCachePtr cache, uint32_t width,
+		uint32_t height, uint32_t pixel_format, const uint32_t bo_handles[4],
+		const uint32_t pitches[4], const uint32_t offsets[4],
+		const uint64_t modifier[4], uint32_t *buf_id, uint32_t flags)
+{
+	struct drm_fb_cache_entry *entry, **bucket;
+	struct drm_mode_fb_cmd2 key;
+	uint64_t hash = 0xcbf29ce484222325ull;
+	const unsigned char *p;
+	size_t i;
+	int ret;
+
+	if (!cache)
+		return -EINVAL;
+
+	memclear(key);
+	key.width = width;
+	key.height = height;
+	key.pixel_format = pixel_format;
+	key.flags = flags;
+	memcpy(key.handles, bo_handles, 4 * sizeof(bo_handles[0]));
+	memcpy(key.pitches, pitches, 4 * sizeof(pitches[0]));
+	memcpy(key.offsets, offsets, 4 * sizeof(offsets[0]));
+	if (modifier)
+		memcpy(key.modifier, modifier, 4 * sizeof(modifier[0]));
+
+	for (p = (const unsigned char *)&key, i = 0; i < sizeof(key); i++)
+		hash = (hash ^ p[i]) * 0x100000001b3ull;
+
+	bucket = &cache->buckets[hash & cache->mask];
+	for (entry = *bucket; entry; entry = entry->next) {
+		if (entry->hash == hash && !memcmp(&entry->key, &key, sizeof(key))) {
+			list_del(&entry->lru);
+			list_add(&entry->lru, &cache->lru);
+			*buf_id = entry->fb_id;
+			return 0;
+		}
+	}
+
+	entry = malloc(sizeof(*entry));
+	if (!entry)
+		return -ENOMEM;
+
+	entry->key = key;
+	if ((ret = DRM_IOCTL(cache->fd, DRM_IOCTL_MODE_ADDFB2, &entry->key))) {
+		free(entry);
+		return ret;
+	}
+	entry->fb_id = entry->key.fb_id;
+	entry->key.fb_id = 0;
+	entry->hash = hash;
+
+	if (cache->count == cache->max_entries)
+		drm_fb_cache_remove(cache,
+				    LIST_LAST_ENTRY(&cache->lru,
+						    struct drm_fb_cache_entry,
+						    lru));
+
+	entry->next = *bucket;
+	*bucket = entry;
+	list_add(&entry->lru, &cache->lru);
+	cache->count++;
+
+	*buf_id = entry->fb_id;
+	return 0;
+}
+
+/*
+ * Remove every cached framebuffer that references GEM handle @bo_handle.
+ * Call this before closing the handle, since the kernel may hand the same
+ * handle out again for a different buffer.  Returns the number of
+ * framebuffers removed.
+ */
+drm_public int drmModeFBCacheEvictHandle(drmModeFBCachePtr cache,
+					 uint32_t bo_handle)
+{
+	struct drm_fb_cache_entry *entry, *tmp;
+	int i, count = 0;
+
+	if (!cache)
+		return 0;
+
+	LIST_FOR_EACH_ENTRY_SAFE(entry, tmp, &cache->lru, lru) {
+		for (i = 0; i < 4; i++) {
+			if (entry->key.handles[i] == bo_handle) {
+				drm_fb_cache_remove(cache, entry);
+				count++;
+				break;
+			}
+		}
+	}
+
+	return count;
+}
+
+/*
+ * Damage coalescing for drmModeDirtyFB().
+ */
+
+/*
+ * Pixels a merge may add that weren't damaged, in exchange for one rect
+ * less.  Drivers that push damage over USB or SPI pay a per-rect setup cost
+ * of roughly this order.
+ */
+#define DRM_CLIP_MERGE_SLACK 4096
+
+struct _drmModeDamage {
+	int fd;
+	uint32_t fb_id;
+	uint16_t width, height;
+	uint32_t max_clips;
+	uint32_t count;
+	uint32_t size;
+	drmModeClipPtr clips;
+	uint32_t crtc_id;		/* vblank flush pending when non-zero */
+};
+
+static uint64_t drm_clip_area(const drmModeClip *c)
+{
+	return (uint64_t)(c->x2 - c->x1) * (c->y2 - c->y1);
+}
+
+/* Pixels that merging @a and @b would add on top of what they cover. */
+static uint64_t drm_clip_merge_waste(const drmModeClip *a, const drmModeClip *b)
+{
+	drmModeClip u, i;
+	uint64_t covered;
+
+	u.x1 = MIN2(a->x1, b->x1);
+	u.y1 = MIN2(a->y1, b->y1);
+	u.x2 = MAX2(a->x2, b->x2);
+	u.y2 = MAX2(a->y2, b->y2);
+
+	covered = drm_clip_area(a) + drm_clip_area(b);
+	i.x1 = MAX2(a->x1, b->x1);
+	i.y1 = MAX2(a->y1, b->y1);
+	i.x2 = MIN2(a->x2, b->x2);
+	i.y2 = MIN2(a->y2, b->y2);
+	if (i.x1 < i.x2 && i.y1 < i.y2)
+		covered -= drm_clip_area(&i);
+
+	return drm_clip_area(&u) - covered;
+}
+
+static void drm_clip_merge(drmModeClipPtr clips, uint32_t *count,
+			   uint32_t i, uint32_t j)
+{
+	clips[i].x1 = MIN2(clips[i].x1, clips[j].x1);
+	clips[i].y1 = MIN2(clips[i].y1, clips[j].y1);
+	clips[i].x2 = MAX2(clips[i].x2, clips[j].x2);
+	clips[i].y2 = MAX2(clips[i].y2, clips[j].y2);
+	clips[j] = clips[--(*count)];
+}
+
+/*
+ * Clip @clips to a @width x @height framebuffer, drop empty and contained
+ * rects, merge rects whose union wastes little, and then merge the cheapest
+ * pairs until at most @max_clips are left (no limit if 0).  Works in place
+ * and returns the new number of rects.
+ */
+drm_public uint32_t drmModeCoalesceClips(drmModeClipPtr clips,
+					 uint32_t num_clips,
+					 uint16_t width, uint16_t height,
+					 uint32_t max_clips)
+{
+	uint32_t i, j, count = 0, best_i, best_j;
+	uint64_t waste, best;
+
+	for (i = 0; i < num_clips; i++) {
+		drmModeClip c = clips[i];
+
+		c.x2 = MIN2(c.x2, width);
+		c.y2 = MIN2(c.y2, height);
+		if (c.x1 < c.x2 && c.y1 < c.y2)
+			clips[count++] = c;
+	}
+
+	/* The grown rect may now merge with one that was already looked at,
+	 * so it is checked against everything again. */
+	i = 0;
+	while (i < count) {
+		for (j = 0; j < count; j++)
+			if (j != i && drm_clip_merge_waste(&clips[i], &clips[j]) <=
+				      DRM_CLIP_MERGE_SLACK)
+				break;
+		if (j == count) {
+			i++;
+			continue;
+		}
+		drm_clip_merge(clips, &count, MIN2(i, j), MAX2(i, j));
+		i = MIN2(i, j);
+	}
+
+	while (max_clips && count > max_clips) {
+		best = UINT64_MAX;
+		best_i = 0;
+		best_j = 1;
+		for (i = 0; i < count; i++) {
+			for (j = i + 1; j < count; j++) {
+				waste = drm_clip_merge_waste(&clips[i], &clips[j]);
+				if (waste < best) {
+					best = waste;
+					best_i = i;
+					best_j = j;
+				}
+			}
+		}
+		drm_clip_merge(clips, &count, best_i, best_j);
+	}
+
+	return count;
+}
+
+/*
+ * Create a damage accumulator for framebuffer @fb_id that submits at most
+ * @max_clips rects per drmModeDirtyFB() call (0 for no limit).  Returns NULL
+ * with errno set on failure.
+ */
+drm_public drmModeDamagePtr drmModeDamageCreate(int fd, uint32_t fb_id,
+						uint32_t max_clips)
+{
+	drmModeDamagePtr damage;
+	drmModeFBPtr fb;
+
+	fb = drmModeGetFB(fd, fb_id);
+	if (!fb)
+		return NULL;
+
+	damage = drmMalloc(sizeof(*damage));
+	if (!damage) {
+		drmModeFreeFB(fb);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	damage->fd = fd;
+	damage->fb_id = fb_id;
+	damage->width = MIN2(fb->width, 0xffff);
+	damage->height = MIN2(fb->height, 0xffff);
+	damage->max_clips = max_clips;
+	drmModeFreeFB(fb);
+
+	return damage;
+}
+
+drm_public void drmModeDamageDestroy(drmModeDamagePtr damage)
+{
+	if (!damage)
+		return;
+
+	drmFree(damage->clips);
+	drmFree(damage);
+}
+
+/*
+ * Add rects to the pending damage.  They are clipped to the framebuffer and
+ * coalesced with what is already pending.  Returns 0 or -ENOMEM.
+ */
+drm_public int drmModeDamageAdd(drmModeDamagePtr damage,
+				const drmModeClip *clips, uint32_t num_clips)
+{
+	drmModeClipPtr tmp;
+	uint32_t size;
+
+	if (!damage || (num_clips && !clips))
+		return -EINVAL;
+
+	if (num_clips > damage->size - damage->count) {
+		if (num_clips > UINT32_MAX / 2 - damage->count)
+			return -ENOMEM;
+		size = MAX2(damage->size * 2, damage->count + num_clips);
+		size = MAX2(size, 16);
+		tmp = realloc(damage->clips, size * sizeof(*tmp));
+		if (!tmp)
+			return -ENOMEM;
+		damage->clips = tmp;
+		damage->size = size;
+	}
+
+	memcpy(damage->clips + damage->count, clips,
+	       num_clips * sizeof(*clips));
+	damage->count = drmModeCoalesceClips(damage->clips,
+					     damage->count + num_clips,
+					     damage->width, damage->height,
+					     damage->max_clips);
+	return 0;
+}
+
+/*
+ * Submit the pending damage with drmModeDirtyFB() now.  The damage is kept
+ * if the ioctl fails.
+ */
+drm_public int drmModeDamageFlush(drmModeDamagePtr damage)
+{
+	int ret;
+
+	if (!damage)
+		return -EINVAL;
+	if (damage->count == 0)
+		return 0;
+
+	ret = drmModeDirtyFB(damage->fd, damage->fb_id, damage->clips,
+			     damage->count);
+	if (ret == 0)
+		damage->count = 0;
+	return ret;
+}
+
+/*
+ * Defer the flush to the next vblank on @crtc_id, so that everything drawn
+ * until then goes out in one transfer.  The flush happens when the CRTC
+ * sequence event is passed to drmModeDamageSequenceEvent().
+ */
+drm_public int drmModeDamageFlushOnVblank(drmModeDamagePtr damage,
+					  uint32_t crtc_id)
+{
+	if (!damage)
+		return -EINVAL;
+	if (damage->crtc_id)
+		return 0;
+
+	if (drmCrtcQueueSequence(damage->fd, crtc_id,
+				 DRM_CRTC_SEQUENCE_RELATIVE, 1, NULL,
+				 VOID2U64(damage)))
+		return -errno;
+
+	damage->crtc_id = crtc_id;
+	return 0;
+}
+
+/*
+ * Feed a CRTC sequence event to the accumulator; call this from the
+ * sequence_handler of the event context.  Returns 0 if the event belongs to
+ * the caller, 1 if the damage was flushed, or -errno if the flush failed.
+ */
+drm_public int drmModeDamageSequenceEvent(drmModeDamagePtr damage,
+					  uint64_t sequence, uint64_t ns,
+					  uint64_t user_data)
+{
+	int ret;
+
+	if (!damage || !damage->crtc_id || user_data != VOID2U64(damage))
+		return 0;
+
+	damage->crtc_id = 0;
+	ret = drmModeDamageFlush(damage);
+	return ret ? ret : 1;
+}
+
+/*
+ * Content-addressed property blob cache.  Blobs are found by the FNV-1a hash
+ * of their bytes and by ID; released blobs stay around on an LRU list, up to
+ * max_unused of them, so toggling back to an earlier value is free.
+ */
+#define DRM_BLOB_CACHE_BUCKETS 64
+
+struct drm_blob_cache_entry {
+	struct list_head unused;	/* linked while refcount is 0 */
+	struct drm_blob_cache_entry *next;
+	uint64_t hash;
+	uint32_t blob_id;
+	uint32_t refcount;
+	size_t size;
+	unsigned char data[];
+};
+
+struct _drmModeBlobCache {
+	int fd;
+	uint32_t max_unused;
+	uint32_t count_unused;
+	void *ids;			/* blob ID -> entry */
+	struct drm_blob_cache_entry *buckets[DRM_BLOB_CACHE_BUCKETS];
+	struct list_head unused;	/* most recently released first */
+};
+
+drm_public drmModeBlobCachePtr drmModeBlobCacheCreate(int fd,
+						      uint32_t max_unused)
+{
+	drmModeBlobCachePtr cache;
+
+	cache = drmMalloc(sizeof(*cache));
+	if (!cache)
+		return NULL;
+
+	cache->ids = drmIntMapCreate();
+	if (!cache->ids) {
+		drmFree(cache);
+		return NULL;
+	}
+	cache->fd = fd;
+	cache->max_unused = max_unused ? max_unused : 16;
+	list_inithead(&cache->unused);
+
+	return cache;
+}
+
+static void drm_blob_cache_remove(drmModeBlobCachePtr cache,
+				  struct drm_blob_cache_entry *entry)
+{
+	struct drm_blob_cache_entry **link;
+
+	for (link = &cache->buckets[entry->hash % DRM_BLOB_CACHE_BUCKETS];
+	     *link != entry; link = &(*link)->next)
+		;
+	*link = entry->next;
+	if (entry->refcount == 0) {
+		list_del(&entry->unused);
+		cache->count_unused--;
+	}
+	drmIntMapDelete(cache->ids, entry->blob_id);
+
+	drmModeDestroyPropertyBlob(cache->fd, entry->blob_id);
+	free(entry);
+}
+
+/*
+ * Destroy every blob the cache created.  Blobs still attached to a property
+ * are kept alive by the kernel until they are replaced.
+ */
+drm_public void drmModeBlobCacheDestroy(drmModeBlobCachePtr cache)
+{
+	uint32_t i;
+
+	if (!cache)
+		return;
+
+	for (i = 0; i < DRM_BLOB_CACHE_BUCKETS; i++)
+		while (cache->buckets[i])
+			drm_blob_cache_remove(cache, cache->buckets[i]);
+	drmIntMapDestroy(cache->ids);
+	drmFree(cache);
+}
+
+/*
+ * Return a blob holding @data, creating it only if no blob with the same
+ * bytes exists yet, and take a reference on it.  Returns 0 or -errno.
+ */
+drm_public int drmModeBlobCacheGet(drmModeBlobCachePtr cache,
+				   const void *data, size_t size,
+				   uint32_t *id)
+{
+	struct drm_blob_cache_entry *entry, **bucket;
+	uint64_t hash = 0xcbf29ce484222325ull;
+	const unsigned char *p = data;
+	size_t i;
+	int ret;
+
+	if (!cache || (size && !data))
+		return -EINVAL;
+
+	for (i = 0; i < size; i++)
+		hash = (hash ^ p[i]) * 0x100000001b3ull;
+
+	bucket = &cache->buckets[hash % DRM_BLOB_CACHE_BUCKETS];
+	for (entry = *bucket; entry; entry = entry->next) {
+		if (entry->hash == hash && entry->size == size &&
+		    !memcmp(entry->data, data, size))
+			break;
+	}
+
+	if (!entry) {
+		entry = malloc(sizeof(*entry) + size);
+		if (!entry)
+			return -ENOMEM;
+
+		ret = drmModeCreatePropertyBlob(cache->fd, data, size,
+						&entry->blob_id);
+		if (ret) {
+			free(entry);
+			return ret;
+		}
+		if (drmIntMapInsert(cache->ids, entry->blob_id, entry)) {
+			drmModeDestroyPropertyBlob(cache->fd, entry->blob_id);
+			free(entry);
+			return -ENOMEM;
+		}
+
+		memcpy(entry->data, data, size);
+		entry->hash = hash;
+		entry->size = size;
+		entry->refcount = 0;
+		entry->next = *bucket;
+		*bucket = entry;
+	} else if (entry->refcount == 0) {
+		list_del(&entry->unused);
+		cache->count_unused--;
+	}
+
+	entry->refcount++;
+	*id = entry->blob_id;
+	return 0;
+}
+
+/*
+ * Drop a reference taken with drmModeBlobCacheGet().  The blob is destroyed
+ * once more than max_unused blobs are unreferenced, least recently released
+ * first.  Returns 0, or -ENOENT if @id isn't a referenced cached blob.
+ */
+drm_public int drmModeBlobCachePut(drmModeBlobCachePtr cache, uint32_t id)
+{
+	struct drm_blob_cache_entry *entry;
+	void *value;
+
+	if (!cache)
+		return -EINVAL;
+
+	if (drmIntMapLookup(cache->ids, id, &value))
+		return -ENOENT;
+	entry = value;
+	if (entry->refcount == 0)
+		return -ENOENT;
+
+	if (--entry->refcount)
+		return 0;
+
+	list_add(&entry->unused, &cache->unused);
+	if (++cache->count_unused > cache->max_unused)
+		drm_blob_cache_remove(cache,
+				      LIST_LAST_ENTRY(&cache->unused,
+						      struct drm_blob_cache_entry,
+						      unused));
+	return 0;
+}
+
+/*
+ * (format, modifier) pairs a plane takes, decoded once from IN_FORMATS into
+ * an open-addressed hash table.  Legacy format list entries are stored with
+ * DRM_FORMAT_MOD_INVALID and stand for implicit modifiers; without
+ * IN_FORMATS they also stand for DRM_FORMAT_MOD_LINEAR.
+ */
+struct drm_plane_format {
+	uint32_t format;
+	uint32_t used;
+	uint64_t modifier;
+};
+
+struct _drmModePlaneFormats {
+	uint32_t plane_id;
+	int in_formats;
+	uint32_t count;
+	struct drm_plane_format *pairs;	/* in IN_FORMATS order */
+	uint32_t mask;
+	struct drm_plane_format *table;
+};
+
+static uint32_t drm_plane_format_hash(uint32_t format, uint64_t modifier)
+{
+	uint64_t hash = 0xcbf29ce484222325ull;
+
+	hash = drm_atomic_hash(hash, &format, sizeof(format));
+	hash = drm_atomic_hash(hash, &modifier, sizeof(modifier));
+	return hash ^ (hash >> 32);
+}
+
+static struct drm_plane_format *
+drm_plane_format_slot(drmModePlaneFormatsPtr formats, uint32_t format,
+		      uint64_t modifier)
+{
+	struct drm_plane_format *slot;
+	uint32_t i;
+
+	i = drm_plane_format_hash(format, modifier);
+	for (;; i++) {
+		slot = &formats->table[i & formats->mask];
+		if (!slot->used ||
+		    (slot->format == format && slot->modifier == modifier))
+			return slot;
+	}
+}
+
+static void drm_plane_formats_add(drmModePlaneFormatsPtr formats,
+				  uint32_t format, uint64_t modifier)
+{
+	struct drm_plane_format *slot;
+
+	slot = drm_plane_format_slot(formats, format, modifier);
+	if (slot->used)
+		return;
+	slot->used = 1;
+	slot->format = format;
+	slot->modifier = modifier;
+	formats->pairs[formats->count++] = *slot;
+}
+
+static drmModePropertyBlobPtr drm_plane_in_formats(int fd, uint32_t plane_id)
+{
+	drmModeObjectPropertiesPtr props;
+	drmModePropertyPtr prop;
+	uint32_t i, blob_id = 0;
+
+	props = drmModeObjectGetProperties(fd, plane_id, DRM_MODE_OBJECT_PLANE);
+	if (!props)
+		return NULL;
+	for (i = 0; i < props->count_props && !blob_id; i++) {
+		prop = drmModeGetProperty(fd, props->props[i]);
+		if (!prop)
+			continue;
+		if (!strcmp(prop->name, "IN_FORMATS"))
+			blob_id = props->prop_values[i];
+		drmModeFreeProperty(prop);
+	}
+	drmModeFreeObjectProperties(props);
+
+	return blob_id ? drmModeGetPropertyBlob(fd, blob_id) : NULL;
+}
+
+/*
+ * Decode the formats and modifiers @plane_id takes.  Returns NULL with
+ * errno set on failure.
+ */
+drm_public drmModePlaneFormatsPtr drmModeGetPlaneFormats(int fd,
+							 uint32_t plane_id)
+{
+	const struct drm_format_modifier_blob *header = NULL;
+	const struct drm_format_modifier *mods = NULL;
+	const uint32_t *in_formats = NULL;
+	drmModePlaneFormatsPtr formats;
+	drmModePropertyBlobPtr blob;
+	drmModePlanePtr plane;
+	uint32_t i, j, n, size;
+
+	plane = drmModeGetPlane(fd, plane_id);
+	if (!plane)
+		return NULL;
+
+	blob = drm_plane_in_formats(fd, plane_id);
+	if (blob) {
+		header = blob->data;
+		if (blob->length < sizeof(*header) ||
+		    header->formats_offset +
+		    header->count_formats * sizeof(*in_formats) > blob->length ||
+		    header->modifiers_offset +
+		    header->count_modifiers * sizeof(*mods) > blob->length) {
+			drmModeFreePropertyBlob(blob);
+			blob = NULL;
+		}
+	}
+
+	n = plane->count_formats;
+	if (blob) {
+		in_formats = (const uint32_t *)((const char *)header +
+						header->formats_offset);
+		mods = (const struct drm_format_modifier *)
+			((const char *)header + header->modifiers_offset);
+		for (i = 0; i < header->count_modifiers; i++)
+			for (j = 0; j < 64; j++)
+				if (mods[i].formats & (1ull << j))
+					n++;
+	}
+	for (size = 4; size < 2 * n; size *= 2)
+		;
+
+	formats = drmMalloc(sizeof(*formats));
+	if (formats) {
+		formats->pairs = drmMalloc(MAX2(n, 1) * sizeof(*formats->pairs));
+		formats->table = drmMalloc(size * sizeof(*formats->table));
+	}
+	if (!formats || !formats->pairs || !formats->table) {
+		if (formats) {
+			drmFree(formats->pairs);
+			drmFree(formats->table);
+			drmFree(formats);
+		}
+		drmModeFreePropertyBlob(blob);
+		drmModeFreePlane(plane);
+		errno = ENOMEM;
+		return NULL;
+	}
+	formats->plane_id = plane_id;
+	formats->in_formats = blob != NULL;
+	formats->mask = size - 1;
+
+	if (blob) {
+		for (i = 0; i < header->count_modifiers; i++) {
+			for (j = 0; j < 64; j++) {
+				if (!(mods[i].formats & (1ull << j)) ||
+				    mods[i].offset + j >= header->count_formats)
+					continue;
+				drm_plane_formats_add(formats,
+						      in_formats[mods[i].offset + j],
+						      mods[i].modifier);
+			}
+		}
+	}
+	for (i = 0; i < plane->count_formats; i++)
+		drm_plane_formats_add(formats, plane->formats[i],
+				      DRM_FORMAT_MOD_INVALID);
+
+	drmModeFreePropertyBlob(blob);
+	drmModeFreePlane(plane);
+	return formats;
+}
+
+drm_public void drmModeFreePlaneFormats(drmModePlaneFormatsPtr formats)
+{
+	if (!formats)
+		return;
+
+	drmFree(formats->pairs);
+	drmFree(formats->table);
+	drmFree(formats);
+}
+
+/*
+ * Whether the plane takes @format with @modifier, DRM_FORMAT_MOD_INVALID
+ * asking for an implicit modifier.  Returns 1 or 0.
+ */
+drm_public int drmModePlaneSupports(drmModePlaneFormatsPtr formats,
+				    uint32_t format, uint64_t modifier)
+{
+	if (!formats)
+		return 0;
+
+	if (!formats->in_formats && modifier == DRM_FORMAT_MOD_LINEAR)
+		modifier = DRM_FORMAT_MOD_INVALID;
+	return drm_plane_format_slot(formats, format, modifier)->used;
+}
+
+/*
+ * Fill @modifiers with up to @max explicit modifiers the plane takes
+ * @format with, in the order of IN_FORMATS.  Returns how many there are,
+ * which may be more than @max.
+ */
+drm_public uint32_t drmModePlaneGetModifiers(drmModePlaneFormatsPtr formats,
+					     uint32_t format,
+					     uint64_t *modifiers, uint32_t max)
+{
+	uint32_t i, n = 0;
+
+	if (!formats)
+		return 0;
+
+	if (!formats->in_formats) {
+		if (!drmModePlaneSupports(formats, format,
+					  DRM_FORMAT_MOD_INVALID))
+			return 0;
+		if (max && modifiers)
+			modifiers[0] = DRM_FORMAT_MOD_LINEAR;
+		return 1;
+	}
+
+	for (i = 0; i < formats->count; i++) {
+		if (formats->pairs[i].format != format ||
+		    formats->pairs[i].modifier == DRM_FORMAT_MOD_INVALID)
+			continue;
+		if (n < max && modifiers)
+			modifiers[n] = formats->pairs[i].modifier;
+		n++;
+	}
+	return n;
 }
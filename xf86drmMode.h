@@ -225,6 +225,19 @@ typedef struct _drmModeFB {
 	uint32_t handle;
 } drmModeFB, *drmModeFBPtr;
 
+typedef struct _drmModeFB2 {
+	uint32_t fb_id;
+	uint32_t width, height;
+	uint32_t pixel_format; /* fourcc code from drm_fourcc.h */
+	uint64_t modifier; /* applies to all buffers */
+	uint32_t flags;
+
+	/* per-plane GEM handle; may be duplicate entries for multiple planes */
+	uint32_t handles[4];
+	uint32_t pitches[4]; /* bytes */
+	uint32_t offsets[4]; /* bytes */
+} drmModeFB2, *drmModeFB2Ptr;
+
 typedef struct drm_clip_rect drmModeClip, *drmModeClipPtr;
 
 typedef struct _drmModePropertyBlob {
@@ -343,6 +356,7 @@ typedef struct _drmModePlaneRes {
 extern void drmModeFreeModeInfo( drmModeModeInfoPtr ptr );
 extern void drmModeFreeResources( drmModeResPtr ptr );
 extern void drmModeFreeFB( drmModeFBPtr ptr );
+extern void drmModeFreeFB2( drmModeFB2Ptr ptr );
 extern void drmModeFreeCrtc( drmModeCrtcPtr ptr );
 extern void drmModeFreeConnector( drmModeConnectorPtr ptr );
 extern void drmModeFreeEncoder( drmModeEncoderPtr ptr );
@@ -353,6 +367,7 @@ extern void drmModeFreePlaneResources(drmModePlaneResPtr ptr);
  * Retrieves all of the resources associated with a card.
  */
 extern drmModeResPtr drmModeGetResources(int fd);
+extern int drmModeGetResourcesInto(int fd, drmModeResPtr res);
 
 /*
  * FrameBuffer manipulation.
@@ -363,6 +378,13 @@ extern drmModeResPtr drmModeGetResources(int fd);
  */
 extern drmModeFBPtr drmModeGetFB(int fd, uint32_t bufferId);
 
+/**
+ * Like drmModeGetFB(), for multi-planar framebuffers with modifiers.  The
+ * GEM handles are only filled in for the DRM master or CAP_SYS_ADMIN, and
+ * the caller has to close them.
+ */
+extern drmModeFB2Ptr drmModeGetFB2(int fd, uint32_t bufferId);
+
 /**
  * Creates a new framebuffer with an buffer object as its scanout buffer.
  */
@@ -452,6 +474,8 @@ extern drmModeConnectorPtr drmModeGetConnector(int fd,
  */
 extern drmModeConnectorPtr drmModeGetConnectorCurrent(int fd,
 						      uint32_t connector_id);
+extern int drmModeGetConnectorCurrentInto(int fd, uint32_t connector_id,
+					  drmModeConnectorPtr connector);
 
 /**
  * Attaches the given mode to an connector.
@@ -484,6 +508,7 @@ extern int drmModePageFlipTarget(int fd, uint32_t crtc_id, uint32_t fb_id,
 				 uint32_t target_vblank);
 
 extern drmModePlaneResPtr drmModeGetPlaneResources(int fd);
+extern int drmModeGetPlaneResourcesInto(int fd, drmModePlaneResPtr res);
 extern drmModePlanePtr drmModeGetPlane(int fd, uint32_t plane_id);
 extern int drmModeSetPlane(int fd, uint32_t plane_id, uint32_t crtc_id,
 			   uint32_t fb_id, uint32_t flags,
@@ -495,6 +520,9 @@ extern int drmModeSetPlane(int fd, uint32_t plane_id, uint32_t crtc_id,
 extern drmModeObjectPropertiesPtr drmModeObjectGetProperties(int fd,
 							uint32_t object_id,
 							uint32_t object_type);
+extern int drmModeObjectGetPropertiesInto(int fd, uint32_t object_id,
+					  uint32_t object_type,
+					  drmModeObjectPropertiesPtr props);
 extern void drmModeFreeObjectProperties(drmModeObjectPropertiesPtr ptr);
 extern int drmModeObjectSetProperty(int fd, uint32_t object_id,
 				    uint32_t object_type, uint32_t property_id,
@@ -510,6 +538,7 @@ extern int drmModeAtomicMerge(drmModeAtomicReqPtr base,
 extern void drmModeAtomicFree(drmModeAtomicReqPtr req);
 extern int drmModeAtomicGetCursor(drmModeAtomicReqPtr req);
 extern void drmModeAtomicSetCursor(drmModeAtomicReqPtr req, int cursor);
+extern void drmModeAtomicReset(drmModeAtomicReqPtr req);
 extern int drmModeAtomicAddProperty(drmModeAtomicReqPtr req,
 				    uint32_t object_id,
 				    uint32_t property_id,
@@ -519,6 +548,57 @@ extern int drmModeAtomicCommit(int fd,
 			       uint32_t flags,
 			       void *user_data);
 
+/*
+ * A request compiled once for commits that differ only in their values,
+ * e.g. FB_ID or IN_FENCE_FD every frame.  The set of objects and
+ * properties is fixed; values are updated in place by slot, and committing
+ * does no sorting or allocation.
+ */
+typedef struct _drmModeAtomicCompiled drmModeAtomicCompiled, *drmModeAtomicCompiledPtr;
+
+extern drmModeAtomicCompiledPtr drmModeAtomicCompile(drmModeAtomicReqPtr req);
+extern void drmModeAtomicCompiledFree(drmModeAtomicCompiledPtr compiled);
+extern int drmModeAtomicCompiledGetCount(drmModeAtomicCompiledPtr compiled);
+extern int drmModeAtomicCompiledFindSlot(drmModeAtomicCompiledPtr compiled,
+					 uint32_t object_id,
+					 uint32_t property_id);
+extern int drmModeAtomicCompiledSetValue(drmModeAtomicCompiledPtr compiled,
+					 uint32_t slot, uint64_t value);
+extern int drmModeAtomicCompiledCommit(int fd,
+				       drmModeAtomicCompiledPtr compiled,
+				       uint32_t flags,
+				       void *user_data);
+
+typedef struct _drmModeAtomicTestCache drmModeAtomicTestCache, *drmModeAtomicTestCachePtr;
+
+extern drmModeAtomicTestCachePtr drmModeAtomicTestCacheCreate(int fd,
+							      uint32_t num_entries);
+extern void drmModeAtomicTestCacheDestroy(drmModeAtomicTestCachePtr cache);
+extern void drmModeAtomicTestCacheInvalidate(drmModeAtomicTestCachePtr cache);
+extern int drmModeAtomicCommitCached(drmModeAtomicTestCachePtr cache,
+				     drmModeAtomicReqPtr req,
+				     uint32_t flags,
+				     void *user_data);
+
+typedef struct _drmModeAtomicSplitter drmModeAtomicSplitter, *drmModeAtomicSplitterPtr;
+
+extern drmModeAtomicSplitterPtr drmModeAtomicSplitterCreate(int fd);
+extern void drmModeAtomicSplitterDestroy(drmModeAtomicSplitterPtr split);
+extern int drmModeAtomicSplitterInvalidate(drmModeAtomicSplitterPtr split);
+extern int drmModeAtomicSplitterCommit(drmModeAtomicSplitterPtr split,
+				       drmModeAtomicReqPtr req,
+				       uint32_t flags, void *user_data,
+				       uint32_t *committed);
+
+typedef struct _drmModeAtomicShadow drmModeAtomicShadow, *drmModeAtomicShadowPtr;
+
+extern drmModeAtomicShadowPtr drmModeAtomicShadowCreate(int fd);
+extern void drmModeAtomicShadowDestroy(drmModeAtomicShadowPtr shadow);
+extern int drmModeAtomicShadowInvalidate(drmModeAtomicShadowPtr shadow);
+extern int drmModeAtomicShadowCommit(drmModeAtomicShadowPtr shadow,
+				     drmModeAtomicReqPtr req,
+				     uint32_t flags, void *user_data);
+
 extern int drmModeCreatePropertyBlob(int fd, const void *data, size_t size,
 				     uint32_t *id);
 extern int drmModeDestroyPropertyBlob(int fd, uint32_t id);
@@ -546,6 +626,446 @@ extern drmModeObjectListPtr drmModeGetLease(int fd);
 
 extern int drmModeRevokeLease(int fd, uint32_t lessee_id);
 
+/*
+ * Connectors, CRTCs and planes partitioned among lessees.
+ */
+
+typedef struct _drmModeLeaseManager drmModeLeaseManager, *drmModeLeaseManagerPtr;
+
+extern drmModeLeaseManagerPtr drmModeLeaseManagerCreate(int fd);
+extern void drmModeLeaseManagerDestroy(drmModeLeaseManagerPtr mgr);
+extern int drmModeLeaseManagerCreateLease(drmModeLeaseManagerPtr mgr,
+					  const uint32_t *objects,
+					  uint32_t count, int flags,
+					  uint32_t *lessee_id);
+extern int drmModeLeaseManagerLeaseConnector(drmModeLeaseManagerPtr mgr,
+					     uint32_t connector_id, int flags,
+					     uint32_t *lessee_id);
+extern int drmModeLeaseManagerRevoke(drmModeLeaseManagerPtr mgr,
+				     uint32_t lessee_id);
+extern int drmModeLeaseManagerReclaim(drmModeLeaseManagerPtr mgr);
+extern uint32_t drmModeLeaseManagerGetLessee(drmModeLeaseManagerPtr mgr,
+					     uint32_t object_id);
+
+/*
+ * Property name to ID cache for KMS objects.
+ */
+
+typedef struct _drmModePropertyInfo {
+	uint32_t prop_id;
+	uint32_t flags;
+	uint64_t min;		/* range properties only */
+	uint64_t max;
+	char name[DRM_PROP_NAME_LEN];
+} drmModePropertyInfo, *drmModePropertyInfoPtr;
+
+typedef struct _drmModePropertyCache drmModePropertyCache, *drmModePropertyCachePtr;
+
+extern drmModePropertyCachePtr drmModePropertyCacheCreate(int fd);
+extern void drmModePropertyCacheDestroy(drmModePropertyCachePtr cache);
+extern void drmModePropertyCacheInvalidate(drmModePropertyCachePtr cache);
+extern const drmModePropertyInfo *
+drmModePropertyCacheLookup(drmModePropertyCachePtr cache, uint32_t object_id,
+			   uint32_t object_type, const char *name);
+
+/*
+ * KMS topology snapshot, held in a single read-only allocation.
+ */
+
+#define DRM_MODE_SNAPSHOT_PROBE (1 << 0)
+
+typedef struct _drmModeSnapshot {
+	size_t size;		/* bytes, including this header */
+
+	uint32_t min_width, max_width;
+	uint32_t min_height, max_height;
+
+	int count_fbs;
+	uint32_t *fbs;
+
+	int count_connectors;
+	drmModeConnector *connectors;
+
+	int count_encoders;
+	drmModeEncoder *encoders;
+
+	int count_crtcs;
+	drmModeCrtc *crtcs;
+	drmModeObjectProperties *crtc_props;	/* indexed like crtcs */
+
+	uint32_t count_planes;
+	drmModePlane *planes;
+	drmModeObjectProperties *plane_props;	/* indexed like planes */
+} drmModeSnapshot, *drmModeSnapshotPtr;
+
+extern drmModeSnapshotPtr drmModeGetSnapshot(int fd, uint32_t flags);
+extern void drmModeFreeSnapshot(drmModeSnapshotPtr snapshot);
+
+/*
+ * Hardware plane assignment on top of atomic TEST_ONLY commits.
+ */
+
+typedef struct _drmModeLayer {
+	uint32_t fb_id;
+	uint32_t format;	/* DRM_FORMAT_* */
+	uint64_t modifier;	/* DRM_FORMAT_MOD_INVALID for implicit */
+	uint32_t zpos;		/* stacking order, bottom first */
+
+	uint32_t src_x, src_y;	/* 16.16 fixed point */
+	uint32_t src_w, src_h;
+	int32_t crtc_x, crtc_y;
+	uint32_t crtc_w, crtc_h;
+
+	uint32_t plane_id;	/* out: the plane assigned to this layer */
+} drmModeLayer, *drmModeLayerPtr;
+
+typedef struct _drmModePlaneAllocator drmModePlaneAllocator, *drmModePlaneAllocatorPtr;
+
+extern drmModePlaneAllocatorPtr drmModePlaneAllocatorCreate(int fd,
+							    uint32_t crtc_id);
+extern void drmModePlaneAllocatorDestroy(drmModePlaneAllocatorPtr alloc);
+extern void drmModePlaneAllocatorInvalidate(drmModePlaneAllocatorPtr alloc);
+extern int drmModePlaneAllocatorAssign(drmModePlaneAllocatorPtr alloc,
+				       drmModeAtomicReqPtr req,
+				       drmModeLayerPtr layers, uint32_t count,
+				       uint32_t flags);
+
+/*
+ * Page flips scheduled for a target vblank sequence.
+ */
+
+typedef struct _drmModePresentFeedback {
+	uint64_t target_seq;	/* sequence the present was scheduled for */
+	uint64_t seq;		/* sequence the flip landed on */
+	uint64_t ns;		/* CLOCK_MONOTONIC time of first pixel out */
+	uint64_t missed;	/* vblanks late, 0 if on time */
+	int status;		/* 0, or -errno if the flip was not submitted */
+} drmModePresentFeedback, *drmModePresentFeedbackPtr;
+
+typedef void (*drmModePresentHandler)(int fd,
+				      const drmModePresentFeedback *feedback,
+				      void *user_data);
+
+typedef struct _drmModePresentQueue drmModePresentQueue, *drmModePresentQueuePtr;
+
+extern drmModePresentQueuePtr drmModePresentQueueCreate(int fd,
+							uint32_t crtc_id,
+							drmModePresentHandler handler);
+extern void drmModePresentQueueDestroy(drmModePresentQueuePtr queue);
+extern int drmModePresentQueuePredict(drmModePresentQueuePtr queue,
+				      uint64_t seq, int64_t *ns);
+extern int drmModePresentQueueSequenceForTime(drmModePresentQueuePtr queue,
+					      int64_t ns, uint64_t *seq);
+extern int drmModePresentQueueSchedule(drmModePresentQueuePtr queue,
+				       uint32_t fb_id, uint64_t target_seq,
+				       void *user_data);
+extern int drmModePresentQueueSequenceEvent(drmModePresentQueuePtr queue,
+					    uint64_t sequence, uint64_t ns,
+					    uint64_t user_data);
+extern int drmModePresentQueueFlipEvent(drmModePresentQueuePtr queue,
+					unsigned int sequence,
+					unsigned int tv_sec,
+					unsigned int tv_usec,
+					void *user_data);
+extern int drmModePresentQueueEnableVrr(drmModePresentQueuePtr queue,
+					uint32_t connector_id);
+extern int drmModePresentQueueDisableVrr(drmModePresentQueuePtr queue);
+extern int drmModePresentQueuePresent(drmModePresentQueuePtr queue,
+				      uint32_t fb_id, void *user_data);
+extern int drmModePresentQueueGetTimeout(drmModePresentQueuePtr queue);
+extern int drmModePresentQueueDispatch(drmModePresentQueuePtr queue);
+
+/*
+ * Framebuffer IDs reused across identical AddFB2 calls.
+ */
+
+typedef struct _drmModeFBCache drmModeFBCache, *drmModeFBCachePtr;
+
+extern drmModeFBCachePtr drmModeFBCacheCreate(int fd, uint32_t max_entries);
+extern void drmModeFBCacheDestroy(drmModeFBCachePtr cache);
+extern int drmModeFBCacheAddFB2(drmModeFBCachePtr cache, uint32_t width,
+		uint32_t height, uint32_t pixel_format, const uint32_t bo_handles[4],
+		const uint32_t pitches[4], const uint32_t offsets[4],
+		const uint64_t modifier[4], uint32_t *buf_id, uint32_t flags);
+extern int drmModeFBCacheEvictHandle(drmModeFBCachePtr cache,
+				     uint32_t bo_handle);
+
+/*
+ * Damage coalescing for drmModeDirtyFB().
+ */
+
+typedef struct _drmModeDamage drmModeDamage, *drmModeDamagePtr;
+
+extern uint32_t drmModeCoalesceClips(drmModeClipPtr clips, uint32_t num_clips,
+				     uint16_t width, uint16_t height,
+				     uint32_t max_clips);
+extern drmModeDamagePtr drmModeDamageCreate(int fd, uint32_t fb_id,
+					    uint32_t max_clips);
+extern void drmModeDamageDestroy(drmModeDamagePtr damage);
+extern int drmModeDamageAdd(drmModeDamagePtr damage,
+			    const drmModeClip *clips, uint32_t num_clips);
+extern int drmModeDamageFlush(drmModeDamagePtr damage);
+extern int drmModeDamageFlushOnVblank(drmModeDamagePtr damage,
+				      uint32_t crtc_id);
+extern int drmModeDamageSequenceEvent(drmModeDamagePtr damage,
+				      uint64_t sequence, uint64_t ns,
+				      uint64_t user_data);
+
+/*
+ * Cursor updates applied at most once per vblank.
+ */
+
+typedef struct _drmModeCursor drmModeCursor, *drmModeCursorPtr;
+
+extern drmModeCursorPtr drmModeCursorCreate(int fd, uint32_t crtc_id);
+extern void drmModeCursorDestroy(drmModeCursorPtr cursor);
+extern int drmModeCursorSetImage(drmModeCursorPtr cursor,
+				 uint32_t bo_handle, uint32_t fb_id,
+				 uint32_t width, uint32_t height,
+				 int32_t hot_x, int32_t hot_y);
+extern int drmModeCursorMove(drmModeCursorPtr cursor, int32_t x, int32_t y);
+extern int drmModeCursorSequenceEvent(drmModeCursorPtr cursor,
+				      uint64_t sequence, uint64_t ns,
+				      uint64_t user_data);
+
+/*
+ * Property blobs shared between identical contents.
+ */
+
+typedef struct _drmModeBlobCache drmModeBlobCache, *drmModeBlobCachePtr;
+
+extern drmModeBlobCachePtr drmModeBlobCacheCreate(int fd, uint32_t max_unused);
+extern void drmModeBlobCacheDestroy(drmModeBlobCachePtr cache);
+extern int drmModeBlobCacheGet(drmModeBlobCachePtr cache,
+			       const void *data, size_t size, uint32_t *id);
+extern int drmModeBlobCachePut(drmModeBlobCachePtr cache, uint32_t id);
+
+/*
+ * Scanout capture as dma-bufs, without CPU copies.
+ */
+
+typedef struct _drmModeCaptureFrame {
+	uint32_t buffer_id;	/* stable while the same buffer is scanned out */
+	uint32_t fb_id;
+	uint32_t width, height;
+	uint32_t pixel_format;
+	uint64_t modifier;	/* DRM_FORMAT_MOD_INVALID if the fb has none */
+	uint32_t num_planes;
+	int fds[4];		/* dma-buf per plane, owned by the capture */
+	uint32_t pitches[4];
+	uint32_t offsets[4];
+} drmModeCaptureFrame, *drmModeCaptureFramePtr;
+
+typedef struct _drmModeCapture drmModeCapture, *drmModeCapturePtr;
+
+extern drmModeCapturePtr drmModeCaptureCreate(int fd, uint32_t crtc_id);
+extern void drmModeCaptureDestroy(drmModeCapturePtr capture);
+extern int drmModeCaptureGetFrame(drmModeCapturePtr capture,
+				  drmModeCaptureFramePtr frame);
+
+/*
+ * Capture through writeback connectors into a ring of framebuffers.
+ */
+
+typedef void (*drmModeWritebackHandler)(int fd, uint32_t fb_id, int status,
+					void *user_data);
+
+typedef struct _drmModeWriteback drmModeWriteback, *drmModeWritebackPtr;
+
+extern drmModeWritebackPtr drmModeWritebackCreate(int fd, uint32_t crtc_id,
+						  drmModeWritebackHandler handler);
+extern void drmModeWritebackDestroy(drmModeWritebackPtr wb);
+extern uint32_t drmModeWritebackGetConnector(drmModeWritebackPtr wb);
+extern int drmModeWritebackAddFB(drmModeWritebackPtr wb, uint32_t fb_id,
+				 void *user_data);
+extern int drmModeWritebackRemoveFB(drmModeWritebackPtr wb, uint32_t fb_id);
+extern int drmModeWritebackQueue(drmModeWritebackPtr wb,
+				 drmModeAtomicReqPtr req);
+extern void drmModeWritebackCommitted(drmModeWritebackPtr wb, int ret);
+extern int drmModeWritebackGetFd(drmModeWritebackPtr wb);
+extern int drmModeWritebackDispatch(drmModeWritebackPtr wb);
+
+/*
+ * Formats and modifiers of a plane, decoded once from IN_FORMATS.
+ */
+
+typedef struct _drmModePlaneFormats drmModePlaneFormats, *drmModePlaneFormatsPtr;
+
+extern drmModePlaneFormatsPtr drmModeGetPlaneFormats(int fd,
+						     uint32_t plane_id);
+extern void drmModeFreePlaneFormats(drmModePlaneFormatsPtr formats);
+extern int drmModePlaneSupports(drmModePlaneFormatsPtr formats,
+				uint32_t format, uint64_t modifier);
+extern uint32_t drmModePlaneGetModifiers(drmModePlaneFormatsPtr formats,
+					 uint32_t format,
+					 uint64_t *modifiers, uint32_t max);
+
+/*
+ * Explicit fencing: plane in-fences and CRTC out-fences of atomic commits.
+ */
+
+typedef struct _drmModeFences drmModeFences, *drmModeFencesPtr;
+
+extern drmModeFencesPtr drmModeFencesCreate(int fd);
+extern void drmModeFencesDestroy(drmModeFencesPtr fences);
+extern int drmModeFencesAddInFence(drmModeFencesPtr fences,
+				   drmModeAtomicReqPtr req,
+				   uint32_t plane_id, int fence_fd);
+extern int drmModeFencesAddOutFence(drmModeFencesPtr fences,
+				    drmModeAtomicReqPtr req, uint32_t crtc_id);
+extern void drmModeFencesCommitted(drmModeFencesPtr fences, int ret);
+extern int drmModeFencesCommit(drmModeFencesPtr fences,
+			       drmModeAtomicReqPtr req, uint32_t flags,
+			       void *user_data);
+extern int drmModeFencesGetOutFence(drmModeFencesPtr fences,
+				    uint32_t crtc_id);
+
+/*
+ * Scanout of buffers rendered on another device (PRIME offload).
+ */
+
+#define DRM_MODE_PRIME_SCANOUT_DIRECT	0
+#define DRM_MODE_PRIME_SCANOUT_COPY	1
+
+typedef struct _drmModePrimeScanout drmModePrimeScanout, *drmModePrimeScanoutPtr;
+
+extern drmModePrimeScanoutPtr drmModePrimeScanoutCreate(int render_fd,
+							int display_fd,
+							uint32_t plane_id);
+extern void drmModePrimeScanoutDestroy(drmModePrimeScanoutPtr scanout);
+extern int drmModePrimeScanoutNegotiate(drmModePrimeScanoutPtr scanout,
+					uint32_t format,
+					const uint64_t *modifiers,
+					uint32_t count, uint64_t *modifier);
+extern int drmModePrimeScanoutGetFB(drmModePrimeScanoutPtr scanout,
+				    uint32_t handle, uint32_t width,
+				    uint32_t height, uint32_t format,
+				    uint64_t modifier,
+				    const uint32_t pitches[4],
+				    const uint32_t offsets[4],
+				    uint32_t *fb_id);
+extern int drmModePrimeScanoutGetFd(drmModePrimeScanoutPtr scanout,
+				    uint32_t handle);
+extern int drmModePrimeScanoutForget(drmModePrimeScanoutPtr scanout,
+				     uint32_t handle);
+
+/*
+ * Hotplug uevent handling that only probes the connectors affected.
+ */
+
+typedef void (*drmModeHotplugHandler)(int fd, uint32_t connector_id,
+				      drmModeConnectorPtr connector,
+				      uint32_t property_id, void *user_data);
+
+typedef struct _drmModeHotplug drmModeHotplug, *drmModeHotplugPtr;
+
+extern drmModeHotplugPtr drmModeHotplugCreate(int fd, uint32_t debounce_ms,
+					      drmModeHotplugHandler handler,
+					      void *user_data);
+extern void drmModeHotplugDestroy(drmModeHotplugPtr hp);
+extern drmModeConnectorPtr drmModeHotplugGetConnector(drmModeHotplugPtr hp,
+						      uint32_t connector_id);
+extern int drmModeHotplugEvent(drmModeHotplugPtr hp, uint32_t connector_id,
+			       uint32_t property_id);
+extern int drmModeHotplugUevent(drmModeHotplugPtr hp, const char *buf,
+				size_t len);
+extern int drmModeHotplugGetTimeout(drmModeHotplugPtr hp);
+extern int drmModeHotplugDispatch(drmModeHotplugPtr hp);
+
+/*
+ * Forced connector probes on a worker thread.
+ */
+
+typedef void (*drmModeProbeHandler)(int fd, uint32_t connector_id,
+				    drmModeConnectorPtr connector, int status,
+				    void *user_data);
+
+typedef struct _drmModeProber drmModeProber, *drmModeProberPtr;
+
+extern drmModeProberPtr drmModeProberCreate(int fd, drmModeProbeHandler handler,
+					    void *user_data);
+extern void drmModeProberDestroy(drmModeProberPtr prober);
+extern drmModeConnectorPtr drmModeProberGetConnector(drmModeProberPtr prober,
+						     uint32_t connector_id);
+extern int drmModeProberQueue(drmModeProberPtr prober,
+			      const uint32_t *connector_ids, uint32_t count);
+extern int drmModeProberGetFd(drmModeProberPtr prober);
+extern int drmModeProberDispatch(drmModeProberPtr prober);
+
+/*
+ * EDID parsing, and a cache of parsed EDID blobs.
+ */
+
+typedef struct _drmModeEdid {
+	char vendor[4];		/* PNP ID */
+	uint16_t product;
+	uint32_t serial;
+	char serial_string[14];	/* from the descriptors, or empty */
+	char name[14];
+	uint8_t week;		/* of manufacture, 0 or 0xff if unknown */
+	uint16_t year;		/* of manufacture, or model year */
+	uint8_t version, revision;
+	uint32_t width_mm, height_mm;	/* 0 if unknown or variable */
+
+	uint32_t count_modes;	/* detailed timings, base block first */
+	drmModeModeInfoPtr modes;
+	drmModeModeInfoPtr preferred;	/* NULL if there is none */
+
+	uint32_t min_vrefresh;	/* range limits, 0 if absent */
+	uint32_t max_vrefresh;
+
+	/* CTA-861 HDR static metadata, luminances as coded in the block */
+	int has_hdr;
+	uint8_t hdr_eotfs;
+	uint8_t hdr_metadata_types;
+	uint8_t hdr_max_luminance;	/* 50 * 2^(v / 32) cd/m^2 */
+	uint8_t hdr_max_frame_avg;	/* 50 * 2^(v / 32) cd/m^2 */
+	uint8_t hdr_min_luminance;	/* max * (v / 255)^2 / 100 cd/m^2 */
+} drmModeEdid, *drmModeEdidPtr;
+
+extern drmModeEdidPtr drmModeEdidParse(const void *data, size_t size);
+extern void drmModeFreeEdid(drmModeEdidPtr edid);
+
+typedef struct _drmModeEdidCache drmModeEdidCache, *drmModeEdidCachePtr;
+
+extern drmModeEdidCachePtr drmModeEdidCacheCreate(int fd);
+extern void drmModeEdidCacheDestroy(drmModeEdidCachePtr cache);
+extern void drmModeEdidCacheInvalidate(drmModeEdidCachePtr cache);
+extern const drmModeEdid *drmModeEdidCacheLookup(drmModeEdidCachePtr cache,
+						 uint32_t blob_id);
+
+/*
+ * CRTC degamma, CTM and gamma through atomic commits.
+ */
+
+typedef struct _drmModeColorPipeline drmModeColorPipeline, *drmModeColorPipelinePtr;
+
+/* Maps @x in [0, 1] to [0, 1] for @channel 0, 1 or 2: red, green or blue. */
+typedef double (*drmModeColorCurve)(unsigned int channel, double x,
+				    void *user_data);
+
+extern drmModeColorPipelinePtr
+drmModeColorPipelineCreate(int fd, uint32_t crtc_id, drmModeBlobCachePtr blobs);
+extern void drmModeColorPipelineDestroy(drmModeColorPipelinePtr pipe);
+extern void drmModeColorPipelineGetSizes(drmModeColorPipelinePtr pipe,
+					 uint32_t *degamma_size,
+					 uint32_t *gamma_size);
+extern int drmModeColorPipelineSetDegamma(drmModeColorPipelinePtr pipe,
+					  drmModeColorCurve curve,
+					  void *user_data);
+extern int drmModeColorPipelineSetCtm(drmModeColorPipelinePtr pipe,
+				      const double *matrix);
+extern int drmModeColorPipelineSetGamma(drmModeColorPipelinePtr pipe,
+					drmModeColorCurve curve,
+					void *user_data);
+extern int drmModeColorPipelineSetGammaRamp(drmModeColorPipelinePtr pipe,
+					    double exponent, double red,
+					    double green, double blue);
+extern int drmModeColorPipelineApply(drmModeColorPipelinePtr pipe,
+				     drmModeAtomicReqPtr req);
+extern void drmModeColorPipelineCommitted(drmModeColorPipelinePtr pipe,
+					  int ret);
+
 #if defined(__cplusplus)
 }
 #endif
@@ -0,0 +1,300 @@
+/* xf86drmModeCapture.c -- Zero-copy scanout capture
+ *
+ * Copyright © 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * DESCRIPTION
+ *
+ * Hands out the framebuffer a CRTC scans out as dma-bufs, for an encoder or
+ * another device to import, instead of mapping and copying it.
+ *
+ * Every frame asks the kernel for the current framebuffer with GETFB2 and
+ * exports its planes.  A compositor cycles through a few buffers, so the
+ * capture keeps the dma-bufs of the last ones: when the export turns out to
+ * be a dma-buf it already holds, in the same layout, the new fds are closed
+ * again and the frame reports the old fds and buffer_id.  Importers can key
+ * their own caches (EGLImages, encoder surfaces) on buffer_id.
+ *
+ * The fds of a frame stay open until the buffer drops out of the capture,
+ * after CAPTURE_SLOTS other buffers, or until drmModeCaptureDestroy();
+ * callers that need them longer dup() them.  GETFB2 only hands out GEM
+ * handles to the DRM master or CAP_SYS_ADMIN, drmModeCaptureGetFrame()
+ * fails with -EACCES for anybody else.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "libdrm_macros.h"
+#include "xf86drm.h"
+#include "xf86drmMode.h"
+#include "drm_fourcc.h"
+
+#define memclear(s) memset(&s, 0, sizeof(s))
+
+/* Buffers whose dma-bufs are kept across frames. */
+#define CAPTURE_SLOTS 8
+
+struct drm_capture_slot {
+	uint32_t buffer_id;		/* 0 if the slot is free */
+	uint64_t last_used;
+	struct drm_mode_fb_cmd2 fb;	/* layout, the handles are unused */
+	uint32_t num_planes;
+	int fds[4];
+	dev_t dev[4];
+	ino_t ino[4];
+};
+
+struct _drmModeCapture {
+	int fd;
+	uint32_t crtc_id;
+	uint32_t next_buffer_id;
+	uint64_t frame;
+	struct drm_capture_slot slots[CAPTURE_SLOTS];
+};
+
+/* Planes of one buffer may share a GEM handle, and so a dma-buf fd. */
+static int drm_capture_plane_shared(const int *fds, uint32_t plane)
+{
+	uint32_t i;
+
+	for (i = 0; i < plane; i++)
+		if (fds[i] == fds[plane])
+			return 1;
+	return 0;
+}
+
+static void drm_capture_close_fds(int *fds, uint32_t num_planes)
+{
+	uint32_t i;
+
+	for (i = num_planes; i-- > 0;)
+		if (fds[i] >= 0 && !drm_capture_plane_shared(fds, i))
+			close(fds[i]);
+}
+
+static void drm_capture_release(struct drm_capture_slot *slot)
+{
+	if (slot->buffer_id)
+		drm_capture_close_fds(slot->fds, slot->num_planes);
+	slot->buffer_id = 0;
+}
+
+static int drm_capture_same_layout(const struct drm_mode_fb_cmd2 *a,
+				   const struct drm_mode_fb_cmd2 *b,
+				   uint32_t num_planes)
+{
+	uint32_t i;
+
+	if (a->width != b->width || a->height != b->height ||
+	    a->pixel_format != b->pixel_format || a->flags != b->flags ||
+	    a->modifier[0] != b->modifier[0])
+		return 0;
+
+	for (i = 0; i < num_planes; i++)
+		if (a->pitches[i] != b->pitches[i] ||
+		    a->offsets[i] != b->offsets[i])
+			return 0;
+	return 1;
+}
+
+/*
+ * Export every plane of fb, closing the GEM handles GETFB2 created on the
+ * way: the dma-bufs keep the buffer alive from here on.
+ */
+static int drm_capture_export(int fd, struct drm_mode_fb_cmd2 *fb,
+			      uint32_t num_planes, int *fds,
+			      dev_t *dev, ino_t *ino)
+{
+	struct drm_gem_close close_bo;
+	struct stat st;
+	uint32_t i, j;
+	int ret = 0;
+
+	for (i = 0; i < num_planes; i++) {
+		fds[i] = -1;
+		for (j = 0; j < i; j++)
+			if (fb->handles[j] == fb->handles[i])
+				break;
+
+		if (j < i) {
+			fds[i] = fds[j];
+			dev[i] = dev[j];
+			ino[i] = ino[j];
+			continue;
+		}
+
+		/* after a failure, only close the remaining handles */
+		if (!ret && (drmPrimeHandleToFD(fd, fb->handles[i], DRM_CLOEXEC,
+						&fds[i]) ||
+			     fstat(fds[i], &st)))
+			ret = -errno;
+		else if (!ret) {
+			dev[i] = st.st_dev;
+			ino[i] = st.st_ino;
+		}
+
+		memclear(close_bo);
+		close_bo.handle = fb->handles[i];
+		drmIoctl(fd, DRM_IOCTL_GEM_CLOSE, &close_bo);
+	}
+
+	if (ret)
+		drm_capture_close_fds(fds, num_planes);
+	return ret;
+}
+
+drm_public drmModeCapturePtr drmModeCaptureCreate(int fd, uint32_t crtc_id)
+{
+	drmModeCapturePtr capture;
+
+	capture = drmMalloc(sizeof(*capture));
+	if (!capture) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	capture->fd = fd;
+	capture->crtc_id = crtc_id;
+	capture->next_buffer_id = 1;
+
+	return capture;
+}
+
+drm_public void drmModeCaptureDestroy(drmModeCapturePtr capture)
+{
+	uint32_t i;
+
+	if (!capture)
+		return;
+
+	for (i = 0; i < CAPTURE_SLOTS; i++)
+		drm_capture_release(&capture->slots[i]);
+	drmFree(capture);
+}
+
+/*
+ * Fill in frame with the buffer the CRTC currently scans out.  Returns 0,
+ * -ENOENT if the CRTC is off, or a negative error code.
+ */
+drm_public int drmModeCaptureGetFrame(drmModeCapturePtr capture,
+				      drmModeCaptureFramePtr frame)
+{
+	struct drm_capture_slot *slot, *victim = NULL;
+	struct drm_mode_crtc crtc;
+	struct drm_mode_fb_cmd2 fb;
+	uint32_t i, num_planes;
+	int fds[4];
+	dev_t dev[4];
+	ino_t ino[4];
+	int ret;
+
+	if (!capture || !frame)
+		return -EINVAL;
+
+	memclear(crtc);
+	crtc.crtc_id = capture->crtc_id;
+	if (drmIoctl(capture->fd, DRM_IOCTL_MODE_GETCRTC, &crtc))
+		return -errno;
+	if (!crtc.fb_id)
+		return -ENOENT;
+
+	memclear(fb);
+	fb.fb_id = crtc.fb_id;
+	if (drmIoctl(capture->fd, DRM_IOCTL_MODE_GETFB2, &fb))
+		return -errno;
+	if (!fb.handles[0])
+		return -EACCES;
+
+	for (num_planes = 1; num_planes < 4; num_planes++)
+		if (!fb.handles[num_planes])
+			break;
+
+	ret = drm_capture_export(capture->fd, &fb, num_planes, fds, dev, ino);
+	if (ret)
+		return ret;
+
+	capture->frame++;
+
+	for (i = 0; i < CAPTURE_SLOTS; i++) {
+		slot = &capture->slots[i];
+
+		if (!slot->buffer_id) {
+			if (!victim || victim->buffer_id)
+				victim = slot;
+			continue;
+		}
+		if (!victim || (victim->buffer_id &&
+				slot->last_used < victim->last_used))
+			victim = slot;
+
+		if (slot->num_planes != num_planes ||
+		    !drm_capture_same_layout(&slot->fb, &fb, num_planes) ||
+		    memcmp(slot->dev, dev, num_planes * sizeof(*dev)) ||
+		    memcmp(slot->ino, ino, num_planes * sizeof(*ino)))
+			continue;
+
+		/* A buffer we already hold, keep handing out the same fds. */
+		drm_capture_close_fds(fds, num_planes);
+		slot->fb.fb_id = fb.fb_id;
+		break;
+	}
+
+	if (i == CAPTURE_SLOTS) {
+		slot = victim;
+		drm_capture_release(slot);
+
+		slot->buffer_id = capture->next_buffer_id++;
+		if (!capture->next_buffer_id)
+			capture->next_buffer_id = 1;
+		slot->fb = fb;
+		memset(slot->fb.handles, 0, sizeof(slot->fb.handles));
+		slot->num_planes = num_planes;
+		memcpy(slot->fds, fds, sizeof(fds));
+		memcpy(slot->dev, dev, sizeof(dev));
+		memcpy(slot->ino, ino, sizeof(ino));
+	}
+
+	slot->last_used = capture->frame;
+
+	memclear(*frame);
+	frame->buffer_id = slot->buffer_id;
+	frame->fb_id = slot->fb.fb_id;
+	frame->width = slot->fb.width;
+	frame->height = slot->fb.height;
+	frame->pixel_format = slot->fb.pixel_format;
+	frame->modifier = slot->fb.flags & DRM_MODE_FB_MODIFIERS ?
+			  slot->fb.modifier[0] : DRM_FORMAT_MOD_INVALID;
+	frame->num_planes = num_planes;
+	for (i = 0; i < 4; i++) {
+		frame->fds[i] = i < num_planes ? slot->fds[i] : -1;
+		frame->pitches[i] = slot->fb.pitches[i];
+		frame->offsets[i] = slot->fb.offsets[i];
+	}
+
+	return 0;
+}
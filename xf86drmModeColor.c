@@ -0,0 +1,422 @@
+/* xf86drmModeColor.c -- Atomic CRTC color management
+ *
+ * Copyright © 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * DESCRIPTION
+ *
+ * Drives the DEGAMMA_LUT, CTM and GAMMA_LUT properties of a CRTC, the
+ * atomic replacement of drmModeCrtcSetGamma().
+ *
+ * Curves are sampled into struct drm_color_lut arrays of the size the CRTC
+ * reports, and matrices converted to struct drm_color_ctm.  The blobs come
+ * from a drmModeBlobCache, so content that didn't change, or that another
+ * CRTC uses already, isn't uploaded again.  drmModeColorPipelineApply() adds
+ * only the properties that differ from what was last committed to the
+ * caller's atomic request, normally the one carrying the frame, so a
+ * night-light ramp changing every few seconds costs neither a separate
+ * commit nor a modeset.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libdrm_macros.h"
+#include "xf86drm.h"
+#include "xf86drmMode.h"
+
+enum drm_color_stage {
+	DRM_COLOR_DEGAMMA,
+	DRM_COLOR_CTM,
+	DRM_COLOR_GAMMA,
+	DRM_COLOR_STAGES
+};
+
+struct drm_color_prop {
+	uint32_t prop_id;		/* 0 if the CRTC lacks the stage */
+	uint32_t blob_id;		/* wanted */
+	int cached;			/* blob_id referenced in the cache */
+	uint32_t queued;		/* in the request not committed yet */
+	uint32_t committed;
+	int has_queued;
+};
+
+struct _drmModeColorPipeline {
+	int fd;
+	uint32_t crtc_id;
+	drmModeBlobCachePtr blobs;
+	int own_blobs;
+	uint32_t degamma_size;
+	uint32_t gamma_size;
+	struct drm_color_prop stages[DRM_COLOR_STAGES];
+};
+
+struct drm_color_ramp {
+	double exponent;
+	double gain[3];
+};
+
+static int drm_color_read_props(drmModeColorPipelinePtr pipe)
+{
+	drmModeObjectPropertiesPtr props;
+	drmModePropertyPtr prop;
+	uint32_t i;
+
+	props = drmModeObjectGetProperties(pipe->fd, pipe->crtc_id,
+					   DRM_MODE_OBJECT_CRTC);
+	if (!props)
+		return -errno;
+
+	for (i = 0; i < props->count_props; i++) {
+		prop = drmModeGetProperty(pipe->fd, props->props[i]);
+		if (!prop)
+			continue;
+
+		if (!strcmp(prop->name, "DEGAMMA_LUT")) {
+			pipe->stages[DRM_COLOR_DEGAMMA].prop_id = prop->prop_id;
+			pipe->stages[DRM_COLOR_DEGAMMA].committed =
+				props->prop_values[i];
+		} else if (!strcmp(prop->name, "CTM")) {
+			pipe->stages[DRM_COLOR_CTM].prop_id = prop->prop_id;
+			pipe->stages[DRM_COLOR_CTM].committed =
+				props->prop_values[i];
+		} else if (!strcmp(prop->name, "GAMMA_LUT")) {
+			pipe->stages[DRM_COLOR_GAMMA].prop_id = prop->prop_id;
+			pipe->stages[DRM_COLOR_GAMMA].committed =
+				props->prop_values[i];
+		} else if (!strcmp(prop->name, "DEGAMMA_LUT_SIZE")) {
+			pipe->degamma_size = props->prop_values[i];
+		} else if (!strcmp(prop->name, "GAMMA_LUT_SIZE")) {
+			pipe->gamma_size = props->prop_values[i];
+		}
+		drmModeFreeProperty(prop);
+	}
+	drmModeFreeObjectProperties(props);
+
+	return 0;
+}
+
+/*
+ * Set up color management of @crtc_id.  Blobs come from @blobs, which may
+ * be shared with other pipelines and must outlive this one, or from a cache
+ * of the pipeline's own if it's NULL.  Each stage starts out wanting the
+ * blob the CRTC has now; stages the CRTC doesn't have are ignored.  Returns
+ * NULL with errno set on failure, ENOENT if the CRTC has none of them.
+ */
+drm_public drmModeColorPipelinePtr
+drmModeColorPipelineCreate(int fd, uint32_t crtc_id, drmModeBlobCachePtr blobs)
+{
+	drmModeColorPipelinePtr pipe;
+	int i, ret;
+
+	pipe = drmMalloc(sizeof(*pipe));
+	if (!pipe) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	pipe->fd = fd;
+	pipe->crtc_id = crtc_id;
+
+	ret = drm_color_read_props(pipe);
+	if (ret)
+		goto out;
+
+	ret = -ENOENT;
+	for (i = 0; i < DRM_COLOR_STAGES; i++) {
+		pipe->stages[i].blob_id = pipe->stages[i].committed;
+		if (pipe->stages[i].prop_id)
+			ret = 0;
+	}
+	if (ret)
+		goto out;
+
+	pipe->blobs = blobs;
+	if (!blobs) {
+		pipe->blobs = drmModeBlobCacheCreate(fd, DRM_COLOR_STAGES);
+		if (!pipe->blobs) {
+			ret = -errno;
+			goto out;
+		}
+		pipe->own_blobs = 1;
+	}
+
+	return pipe;
+
+out:
+	drmFree(pipe);
+	errno = -ret;
+	return NULL;
+}
+
+static void drm_color_release(drmModeColorPipelinePtr pipe,
+			      struct drm_color_prop *stage)
+{
+	/* blobs inherited from the CRTC aren't ours to drop */
+	if (stage->cached)
+		drmModeBlobCachePut(pipe->blobs, stage->blob_id);
+	stage->blob_id = 0;
+	stage->cached = 0;
+}
+
+/*
+ * The CRTC keeps the blobs committed last; with a cache of its own, they're
+ * destroyed and stay alive only as long as the CRTC uses them.
+ */
+drm_public void drmModeColorPipelineDestroy(drmModeColorPipelinePtr pipe)
+{
+	int i;
+
+	if (!pipe)
+		return;
+
+	for (i = 0; i < DRM_COLOR_STAGES; i++)
+		drm_color_release(pipe, &pipe->stages[i]);
+	if (pipe->own_blobs)
+		drmModeBlobCacheDestroy(pipe->blobs);
+	drmFree(pipe);
+}
+
+/* The number of DEGAMMA_LUT and GAMMA_LUT entries, 0 without the stage. */
+drm_public void drmModeColorPipelineGetSizes(drmModeColorPipelinePtr pipe,
+					     uint32_t *degamma_size,
+					     uint32_t *gamma_size)
+{
+	if (!pipe)
+		return;
+
+	if (degamma_size)
+		*degamma_size =
+			pipe->stages[DRM_COLOR_DEGAMMA].prop_id ?
+			pipe->degamma_size : 0;
+	if (gamma_size)
+		*gamma_size =
+			pipe->stages[DRM_COLOR_GAMMA].prop_id ?
+			pipe->gamma_size : 0;
+}
+
+static int drm_color_set_blob(drmModeColorPipelinePtr pipe,
+			      struct drm_color_prop *stage,
+			      const void *data, size_t size)
+{
+	uint32_t id = 0;
+	int ret;
+
+	if (data) {
+		ret = drmModeBlobCacheGet(pipe->blobs, data, size, &id);
+		if (ret)
+			return ret;
+	}
+
+	drm_color_release(pipe, stage);
+	stage->blob_id = id;
+	stage->cached = id != 0;
+	return 0;
+}
+
+static uint16_t drm_color_unorm16(double v)
+{
+	if (!(v > 0.0))		/* NaN too */
+		return 0;
+	if (v >= 1.0)
+		return 0xffff;
+	return (uint16_t)(v * 0xffff + 0.5);
+}
+
+static int drm_color_set_lut(drmModeColorPipelinePtr pipe,
+			     enum drm_color_stage which, uint32_t size,
+			     drmModeColorCurve curve, void *user_data)
+{
+	struct drm_color_prop *stage;
+	struct drm_color_lut *lut;
+	double x;
+	uint32_t i;
+	int ret;
+
+	if (!pipe)
+		return -EINVAL;
+
+	stage = &pipe->stages[which];
+	if (!stage->prop_id || (curve && size < 2))
+		return -ENOTSUP;
+
+	if (!curve)
+		return drm_color_set_blob(pipe, stage, NULL, 0);
+
+	lut = malloc(size * sizeof(*lut));
+	if (!lut)
+		return -ENOMEM;
+
+	for (i = 0; i < size; i++) {
+		x = (double)i / (size - 1);
+		lut[i].red = drm_color_unorm16(curve(0, x, user_data));
+		lut[i].green = drm_color_unorm16(curve(1, x, user_data));
+		lut[i].blue = drm_color_unorm16(curve(2, x, user_data));
+		lut[i].reserved = 0;
+	}
+
+	ret = drm_color_set_blob(pipe, stage, lut, size * sizeof(*lut));
+	free(lut);
+	return ret;
+}
+
+/*
+ * Sample @curve, mapping channel 0-2 (red, green, blue) and an input in
+ * [0, 1] to an output in [0, 1], into the GAMMA_LUT or DEGAMMA_LUT.  A NULL
+ * curve bypasses the stage.  Takes effect with the next
+ * drmModeColorPipelineApply().  Returns 0, -ENOTSUP if the CRTC lacks the
+ * stage or a blob error.
+ */
+drm_public int drmModeColorPipelineSetGamma(drmModeColorPipelinePtr pipe,
+					    drmModeColorCurve curve,
+					    void *user_data)
+{
+	return drm_color_set_lut(pipe, DRM_COLOR_GAMMA,
+				 pipe ? pipe->gamma_size : 0, curve, user_data);
+}
+
+drm_public int drmModeColorPipelineSetDegamma(drmModeColorPipelinePtr pipe,
+					      drmModeColorCurve curve,
+					      void *user_data)
+{
+	return drm_color_set_lut(pipe, DRM_COLOR_DEGAMMA,
+				 pipe ? pipe->degamma_size : 0,
+				 curve, user_data);
+}
+
+static double drm_color_ramp_curve(unsigned int channel, double x,
+				   void *user_data)
+{
+	struct drm_color_ramp *ramp = user_data;
+
+	return ramp->gain[channel] * pow(x, 1.0 / ramp->exponent);
+}
+
+/*
+ * A GAMMA_LUT of gain * x^(1 / exponent) per channel, the ramp night-light
+ * and color temperature tools use: an exponent of 1.0 and a gain of 1.0 for
+ * each channel is the identity.
+ */
+drm_public int drmModeColorPipelineSetGammaRamp(drmModeColorPipelinePtr pipe,
+						double exponent, double red,
+						double green, double blue)
+{
+	struct drm_color_ramp ramp = {
+		.exponent = exponent,
+		.gain = { red, green, blue },
+	};
+
+	if (!(exponent > 0.0))
+		return -EINVAL;
+
+	return drmModeColorPipelineSetGamma(pipe, drm_color_ramp_curve, &ramp);
+}
+
+/*
+ * Set the CTM to the row-major 3x3 @matrix applied to linear RGB, or bypass
+ * it if @matrix is NULL.  Coefficients are converted to the S31.32
+ * sign-magnitude format of struct drm_color_ctm.
+ */
+drm_public int drmModeColorPipelineSetCtm(drmModeColorPipelinePtr pipe,
+					  const double *matrix)
+{
+	struct drm_color_ctm ctm;
+	struct drm_color_prop *stage;
+	double v;
+	int i;
+
+	if (!pipe)
+		return -EINVAL;
+
+	stage = &pipe->stages[DRM_COLOR_CTM];
+	if (!stage->prop_id)
+		return -ENOTSUP;
+
+	if (!matrix)
+		return drm_color_set_blob(pipe, stage, NULL, 0);
+
+	for (i = 0; i < 9; i++) {
+		v = fabs(matrix[i]);
+		if (!(v < 2147483648.0))
+			return -EINVAL;
+		ctm.matrix[i] = (uint64_t)llround(v * 4294967296.0);
+		if (matrix[i] < 0.0)
+			ctm.matrix[i] |= 1ull << 63;
+	}
+
+	return drm_color_set_blob(pipe, stage, &ctm, sizeof(ctm));
+}
+
+/*
+ * Add the stages whose blob differs from the one committed last to @req.
+ * Pass the result of committing @req to drmModeColorPipelineCommitted().
+ * Returns the number of properties added or a negative error.
+ */
+drm_public int drmModeColorPipelineApply(drmModeColorPipelinePtr pipe,
+					 drmModeAtomicReqPtr req)
+{
+	struct drm_color_prop *stage;
+	int i, ret, count = 0;
+
+	if (!pipe || !req)
+		return -EINVAL;
+
+	for (i = 0; i < DRM_COLOR_STAGES; i++) {
+		stage = &pipe->stages[i];
+		stage->has_queued = 0;
+		if (!stage->prop_id || stage->blob_id == stage->committed)
+			continue;
+
+		ret = drmModeAtomicAddProperty(req, pipe->crtc_id,
+					       stage->prop_id, stage->blob_id);
+		if (ret < 0)
+			return ret;
+		stage->queued = stage->blob_id;
+		stage->has_queued = 1;
+		count++;
+	}
+
+	return count;
+}
+
+/*
+ * Record the outcome of committing the request drmModeColorPipelineApply()
+ * last added to: on failure, the same stages are added again next time.
+ * TEST_ONLY commits shouldn't be reported.
+ */
+drm_public void drmModeColorPipelineCommitted(drmModeColorPipelinePtr pipe,
+					      int ret)
+{
+	int i;
+
+	if (!pipe)
+		return;
+
+	for (i = 0; i < DRM_COLOR_STAGES; i++) {
+		if (pipe->stages[i].has_queued && ret == 0)
+			pipe->stages[i].committed = pipe->stages[i].queued;
+		pipe->stages[i].has_queued = 0;
+	}
+}
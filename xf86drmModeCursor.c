@@ -0,0 +1,356 @@
+/* xf86drmModeCursor.c -- Vblank-coalesced cursor updates
+ *
+ * Copyright © 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * DESCRIPTION
+ *
+ * Pointer input usually arrives much faster than the display refreshes.
+ * Cursor moves and image changes are recorded and applied at most once per
+ * vblank, from a CRTC sequence event, so only the latest state reaches the
+ * kernel.
+ *
+ * If the CRTC has a cursor plane usable through atomic properties, updates
+ * are nonblocking atomic commits of that plane alone; otherwise they fall
+ * back to the legacy cursor ioctls.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libdrm_macros.h"
+#include "xf86drm.h"
+#include "xf86drmMode.h"
+
+#define VOID2U64(x) ((uint64_t)(unsigned long)(x))
+
+#define DRM_CURSOR_DIRTY_MOVE	(1 << 0)
+#define DRM_CURSOR_DIRTY_IMAGE	(1 << 1)
+
+struct _drmModeCursor {
+	int fd;
+	uint32_t crtc_id;
+
+	uint32_t dirty;
+	int vblank_pending;
+
+	int32_t x, y;			/* hotspot position */
+	uint32_t bo_handle;
+	uint32_t fb_id;
+	uint32_t width, height;
+	int32_t hot_x, hot_y;
+
+	/* Atomic path, used when plane_id is non-zero. */
+	uint32_t plane_id;
+	uint32_t prop_fb_id, prop_crtc_id;
+	uint32_t prop_src_x, prop_src_y, prop_src_w, prop_src_h;
+	uint32_t prop_crtc_x, prop_crtc_y, prop_crtc_w, prop_crtc_h;
+	drmModeAtomicReqPtr req;
+};
+
+static uint32_t drm_cursor_prop(drmModePropertyCachePtr props,
+				uint32_t plane_id, const char *name)
+{
+	const drmModePropertyInfo *info;
+
+	info = drmModePropertyCacheLookup(props, plane_id,
+					  DRM_MODE_OBJECT_PLANE, name);
+	return info ? info->prop_id : 0;
+}
+
+/*
+ * Look for a cursor plane on the CRTC and its properties.  Planes are only
+ * described this way with DRM_CLIENT_CAP_ATOMIC, so without it nothing is
+ * found and the legacy path is used.
+ */
+static void drm_cursor_find_plane(drmModeCursorPtr cursor)
+{
+	drmModePropertyCachePtr props;
+	drmModePlaneResPtr plane_res;
+	drmModeObjectPropertiesPtr values;
+	drmModeResPtr res;
+	drmModePlanePtr p;
+	uint32_t crtc_mask = 0, prop_type, id, i, j;
+	int is_cursor;
+
+	res = drmModeGetResources(cursor->fd);
+	if (!res)
+		return;
+	for (i = 0; i < (uint32_t)res->count_crtcs; i++)
+		if (res->crtcs[i] == cursor->crtc_id)
+			crtc_mask = 1u << i;
+	drmModeFreeResources(res);
+
+	props = drmModePropertyCacheCreate(cursor->fd);
+	plane_res = drmModeGetPlaneResources(cursor->fd);
+	if (!props || !plane_res || !crtc_mask)
+		goto out;
+
+	for (i = 0; i < plane_res->count_planes && !cursor->plane_id; i++) {
+		id = plane_res->planes[i];
+		p = drmModeGetPlane(cursor->fd, id);
+		if (!p)
+			continue;
+		if (!(p->possible_crtcs & crtc_mask)) {
+			drmModeFreePlane(p);
+			continue;
+		}
+		drmModeFreePlane(p);
+
+		prop_type = drm_cursor_prop(props, id, "type");
+		values = drmModeObjectGetProperties(cursor->fd, id,
+						    DRM_MODE_OBJECT_PLANE);
+		if (!prop_type || !values)
+			continue;
+		is_cursor = 0;
+		for (j = 0; j < values->count_props; j++)
+			if (values->props[j] == prop_type)
+				is_cursor = values->prop_values[j] ==
+					    DRM_PLANE_TYPE_CURSOR;
+		drmModeFreeObjectProperties(values);
+		if (!is_cursor)
+			continue;
+
+		cursor->prop_fb_id = drm_cursor_prop(props, id, "FB_ID");
+		cursor->prop_crtc_id = drm_cursor_prop(props, id, "CRTC_ID");
+		cursor->prop_src_x = drm_cursor_prop(props, id, "SRC_X");
+		cursor->prop_src_y = drm_cursor_prop(props, id, "SRC_Y");
+		cursor->prop_src_w = drm_cursor_prop(props, id, "SRC_W");
+		cursor->prop_src_h = drm_cursor_prop(props, id, "SRC_H");
+		cursor->prop_crtc_x = drm_cursor_prop(props, id, "CRTC_X");
+		cursor->prop_crtc_y = drm_cursor_prop(props, id, "CRTC_Y");
+		cursor->prop_crtc_w = drm_cursor_prop(props, id, "CRTC_W");
+		cursor->prop_crtc_h = drm_cursor_prop(props, id, "CRTC_H");
+		if (cursor->prop_fb_id && cursor->prop_crtc_id &&
+		    cursor->prop_src_x && cursor->prop_src_y &&
+		    cursor->prop_src_w && cursor->prop_src_h &&
+		    cursor->prop_crtc_x && cursor->prop_crtc_y &&
+		    cursor->prop_crtc_w && cursor->prop_crtc_h)
+			cursor->plane_id = id;
+	}
+
+out:
+	drmModeFreePlaneResources(plane_res);
+	drmModePropertyCacheDestroy(props);
+}
+
+/*
+ * Create a cursor helper for one CRTC.  Returns NULL with errno set on
+ * failure.
+ */
+drm_public drmModeCursorPtr drmModeCursorCreate(int fd, uint32_t crtc_id)
+{
+	drmModeCursorPtr cursor;
+
+	cursor = drmMalloc(sizeof(*cursor));
+	if (!cursor) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	cursor->fd = fd;
+	cursor->crtc_id = crtc_id;
+
+	drm_cursor_find_plane(cursor);
+	if (cursor->plane_id) {
+		cursor->req = drmModeAtomicAlloc();
+		if (!cursor->req)
+			cursor->plane_id = 0;
+	}
+
+	return cursor;
+}
+
+/*
+ * A sequence event may still be pending, so the helper must be idle, or the
+ * fd closed, before it is destroyed.
+ */
+drm_public void drmModeCursorDestroy(drmModeCursorPtr cursor)
+{
+	if (!cursor)
+		return;
+
+	drmModeAtomicFree(cursor->req);
+	drmFree(cursor);
+}
+
+static int drm_cursor_commit_atomic(drmModeCursorPtr cursor)
+{
+	drmModeAtomicReqPtr req = cursor->req;
+	uint32_t plane = cursor->plane_id;
+	int visible = cursor->fb_id != 0;
+
+	drmModeAtomicReset(req);
+	drmModeAtomicAddProperty(req, plane, cursor->prop_fb_id, cursor->fb_id);
+	drmModeAtomicAddProperty(req, plane, cursor->prop_crtc_id,
+				 visible ? cursor->crtc_id : 0);
+	if (visible) {
+		drmModeAtomicAddProperty(req, plane, cursor->prop_src_x, 0);
+		drmModeAtomicAddProperty(req, plane, cursor->prop_src_y, 0);
+		drmModeAtomicAddProperty(req, plane, cursor->prop_src_w,
+					 (uint64_t)cursor->width << 16);
+		drmModeAtomicAddProperty(req, plane, cursor->prop_src_h,
+					 (uint64_t)cursor->height << 16);
+		drmModeAtomicAddProperty(req, plane, cursor->prop_crtc_x,
+					 (int64_t)(cursor->x - cursor->hot_x));
+		drmModeAtomicAddProperty(req, plane, cursor->prop_crtc_y,
+					 (int64_t)(cursor->y - cursor->hot_y));
+		drmModeAtomicAddProperty(req, plane, cursor->prop_crtc_w,
+					 cursor->width);
+		drmModeAtomicAddProperty(req, plane, cursor->prop_crtc_h,
+					 cursor->height);
+	}
+
+	return drmModeAtomicCommit(cursor->fd, req,
+				   DRM_MODE_ATOMIC_NONBLOCK, NULL);
+}
+
+static int drm_cursor_commit_legacy(drmModeCursorPtr cursor)
+{
+	int ret;
+
+	if (cursor->dirty & DRM_CURSOR_DIRTY_IMAGE) {
+		ret = drmModeSetCursor2(cursor->fd, cursor->crtc_id,
+					cursor->bo_handle, cursor->width,
+					cursor->height, cursor->hot_x,
+					cursor->hot_y);
+		if (ret == -EINVAL || ret == -ENOSYS)
+			ret = drmModeSetCursor(cursor->fd, cursor->crtc_id,
+					       cursor->bo_handle,
+					       cursor->width, cursor->height);
+		if (ret)
+			return ret;
+		cursor->dirty &= ~DRM_CURSOR_DIRTY_IMAGE;
+	}
+
+	return drmModeMoveCursor(cursor->fd, cursor->crtc_id,
+				 cursor->x - cursor->hot_x,
+				 cursor->y - cursor->hot_y);
+}
+
+/* Send the latest state to the kernel. */
+static int drm_cursor_commit(drmModeCursorPtr cursor)
+{
+	int ret;
+
+	if (!cursor->dirty)
+		return 0;
+
+	if (cursor->plane_id)
+		ret = drm_cursor_commit_atomic(cursor);
+	else
+		ret = drm_cursor_commit_legacy(cursor);
+
+	if (ret == 0)
+		cursor->dirty = 0;
+	return ret;
+}
+
+/*
+ * Ask for a sequence event on the next vblank, or commit right away if the
+ * CRTC can't deliver one (e.g. because it is off).
+ */
+static int drm_cursor_schedule(drmModeCursorPtr cursor)
+{
+	if (cursor->vblank_pending)
+		return 0;
+
+	if (drmCrtcQueueSequence(cursor->fd, cursor->crtc_id,
+				 DRM_CRTC_SEQUENCE_RELATIVE, 1, NULL,
+				 VOID2U64(cursor)) == 0) {
+		cursor->vblank_pending = 1;
+		return 0;
+	}
+
+	return drm_cursor_commit(cursor);
+}
+
+/*
+ * Set the cursor image.  @fb_id is used with the cursor plane and
+ * @bo_handle with the legacy ioctls; pass both if the path isn't known.
+ * Zero for both hides the cursor.
+ */
+drm_public int drmModeCursorSetImage(drmModeCursorPtr cursor,
+				     uint32_t bo_handle, uint32_t fb_id,
+				     uint32_t width, uint32_t height,
+				     int32_t hot_x, int32_t hot_y)
+{
+	if (!cursor)
+		return -EINVAL;
+
+	cursor->bo_handle = bo_handle;
+	cursor->fb_id = fb_id;
+	cursor->width = width;
+	cursor->height = height;
+	cursor->hot_x = hot_x;
+	cursor->hot_y = hot_y;
+	cursor->dirty |= DRM_CURSOR_DIRTY_IMAGE;
+
+	return drm_cursor_schedule(cursor);
+}
+
+/*
+ * Move the cursor hotspot to @x, @y in CRTC coordinates.  Moves between two
+ * vblanks collapse into one update.
+ */
+drm_public int drmModeCursorMove(drmModeCursorPtr cursor, int32_t x, int32_t y)
+{
+	if (!cursor)
+		return -EINVAL;
+
+	if (cursor->x == x && cursor->y == y &&
+	    !(cursor->dirty & DRM_CURSOR_DIRTY_IMAGE))
+		return 0;
+
+	cursor->x = x;
+	cursor->y = y;
+	cursor->dirty |= DRM_CURSOR_DIRTY_MOVE;
+
+	return drm_cursor_schedule(cursor);
+}
+
+/*
+ * Feed a CRTC sequence event to the helper; call this from the
+ * sequence_handler of the event context.  Returns 0 if the event belongs to
+ * the caller, 1 if the cursor was updated, or -errno if the update failed.
+ * An atomic update that collides with a pending commit (-EBUSY) is retried
+ * on the next vblank.
+ */
+drm_public int drmModeCursorSequenceEvent(drmModeCursorPtr cursor,
+					  uint64_t sequence, uint64_t ns,
+					  uint64_t user_data)
+{
+	int ret;
+
+	if (!cursor || !cursor->vblank_pending ||
+	    user_data != VOID2U64(cursor))
+		return 0;
+
+	cursor->vblank_pending = 0;
+	ret = drm_cursor_commit(cursor);
+	if (ret == -EBUSY)
+		ret = drm_cursor_schedule(cursor);
+
+	return ret ? ret : 1;
+}
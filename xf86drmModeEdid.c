@@ -0,0 +1,410 @@
+/* xf86drmModeEdid.c -- EDID parsing and a parse cache keyed by blob ID
+ *
+ * Copyright © 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * DESCRIPTION
+ *
+ * Parses the EDID blob of a connector into the things compositors look at:
+ * identification, detailed timings (as drmModeModeInfo, preferred one
+ * marked), the vertical refresh range from the range limits descriptor, and
+ * the CTA-861 HDR static metadata block.
+ *
+ * drmModeEdidCache parses every EDID blob once.  Blob contents never change,
+ * but the kernel replaces the EDID blob of a connector on hotplug and may
+ * hand the freed ID out again, so the cache must be invalidated on hotplug
+ * events, like drmModePropertyCache.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libdrm_macros.h"
+#include "util_math.h"
+#include "xf86drm.h"
+#include "xf86drmMode.h"
+
+#define EDID_BLOCK_SIZE		128
+#define EDID_DESCRIPTOR_SIZE	18
+/* detailed timing descriptors that fit in one CTA-861 extension */
+#define EDID_CTA_MAX_DTDS	((EDID_BLOCK_SIZE - 5) / EDID_DESCRIPTOR_SIZE)
+
+#define EDID_CTA_TAG		0x02
+#define EDID_CTA_EXTENDED	7
+#define EDID_CTA_HDR_STATIC	6
+
+static const uint8_t edid_header[8] = {
+	0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00
+};
+
+static int edid_block_valid(const uint8_t *block)
+{
+	uint8_t sum = 0;
+	int i;
+
+	for (i = 0; i < EDID_BLOCK_SIZE; i++)
+		sum += block[i];
+	return sum == 0;
+}
+
+/* Descriptor text is terminated by a newline and padded with spaces. */
+static void edid_string(char *dst, const uint8_t *src)
+{
+	int i;
+
+	for (i = 0; i < 13 && src[i] != '\n'; i++)
+		dst[i] = src[i] >= 0x20 && src[i] < 0x7f ? src[i] : '?';
+	while (i > 0 && dst[i - 1] == ' ')
+		i--;
+	dst[i] = 0;
+}
+
+static void edid_range_limits(drmModeEdidPtr edid, const uint8_t *d)
+{
+	uint32_t min_v = d[5], max_v = d[6];
+
+	/* EDID 1.4 offsets for rates above 255 Hz */
+	if (edid->revision >= 4) {
+		if ((d[4] & 0x03) == 0x03)
+			min_v += 255;
+		if (d[4] & 0x02)
+			max_v += 255;
+	}
+
+	if (min_v && max_v >= min_v) {
+		edid->min_vrefresh = min_v;
+		edid->max_vrefresh = max_v;
+	}
+}
+
+/* Returns 1 if the descriptor was a detailed timing added to modes. */
+static int edid_detailed_timing(drmModeEdidPtr edid, const uint8_t *d)
+{
+	drmModeModeInfoPtr mode = &edid->modes[edid->count_modes];
+	uint32_t clock = (d[0] | d[1] << 8) * 10;
+	uint32_t hactive, hblank, hso, hsw, vactive, vblank, vso, vsw;
+	uint64_t num, den;
+
+	if (!clock)
+		return 0;
+
+	hactive = d[2] | (d[4] & 0xf0) << 4;
+	hblank = d[3] | (d[4] & 0x0f) << 8;
+	vactive = d[5] | (d[7] & 0xf0) << 4;
+	vblank = d[6] | (d[7] & 0x0f) << 8;
+	hso = d[8] | (d[11] & 0xc0) << 2;
+	hsw = d[9] | (d[11] & 0x30) << 4;
+	vso = d[10] >> 4 | (d[11] & 0x0c) << 2;
+	vsw = (d[10] & 0x0f) | (d[11] & 0x03) << 4;
+
+	if (!hactive || !vactive || hactive + hblank > UINT16_MAX ||
+	    2 * (vactive + vblank) + 1 > UINT16_MAX)
+		return 0;
+
+	memset(mode, 0, sizeof(*mode));
+	mode->clock = clock;
+	mode->hdisplay = hactive;
+	mode->hsync_start = hactive + hso;
+	mode->hsync_end = hactive + hso + hsw;
+	mode->htotal = hactive + hblank;
+	mode->vdisplay = vactive;
+	mode->vsync_start = vactive + vso;
+	mode->vsync_end = vactive + vso + vsw;
+	mode->vtotal = vactive + vblank;
+	mode->type = DRM_MODE_TYPE_DRIVER;
+
+	/* digital separate sync carries the polarities */
+	if ((d[17] & 0x18) == 0x18) {
+		mode->flags |= d[17] & 0x04 ? DRM_MODE_FLAG_PVSYNC :
+					       DRM_MODE_FLAG_NVSYNC;
+		mode->flags |= d[17] & 0x02 ? DRM_MODE_FLAG_PHSYNC :
+					       DRM_MODE_FLAG_NHSYNC;
+	}
+
+	/* interlaced timings describe a field, as the kernel does */
+	if (d[17] & 0x80) {
+		mode->flags |= DRM_MODE_FLAG_INTERLACE;
+		mode->vdisplay *= 2;
+		mode->vsync_start *= 2;
+		mode->vsync_end *= 2;
+		mode->vtotal = mode->vtotal * 2 + 1;
+	}
+
+	num = (uint64_t)clock * 1000;
+	den = (uint64_t)mode->htotal * mode->vtotal;
+	if (mode->flags & DRM_MODE_FLAG_INTERLACE)
+		num *= 2;
+	mode->vrefresh = (num + den / 2) / den;
+
+	snprintf(mode->name, sizeof(mode->name), "%ux%u%s", mode->hdisplay,
+		 mode->vdisplay,
+		 mode->flags & DRM_MODE_FLAG_INTERLACE ? "i" : "");
+
+	edid->count_modes++;
+	return 1;
+}
+
+static void edid_descriptor(drmModeEdidPtr edid, const uint8_t *d)
+{
+	if (edid_detailed_timing(edid, d))
+		return;
+
+	/* display descriptors have a zero pixel clock */
+	if (d[0] || d[1] || d[2])
+		return;
+
+	switch (d[3]) {
+	case 0xff:
+		edid_string(edid->serial_string, d + 5);
+		break;
+	case 0xfc:
+		edid_string(edid->name, d + 5);
+		break;
+	case 0xfd:
+		edid_range_limits(edid, d);
+		break;
+	default:
+		break;
+	}
+}
+
+static void edid_cta_hdr(drmModeEdidPtr edid, const uint8_t *b, uint32_t len)
+{
+	/* b[0] is the extended tag, the EOTFs and metadata types follow */
+	if (len < 3)
+		return;
+
+	edid->has_hdr = 1;
+	edid->hdr_eotfs = b[1];
+	edid->hdr_metadata_types = b[2];
+	if (len > 3)
+		edid->hdr_max_luminance = b[3];
+	if (len > 4)
+		edid->hdr_max_frame_avg = b[4];
+	if (len > 5)
+		edid->hdr_min_luminance = b[5];
+}
+
+static void edid_cta(drmModeEdidPtr edid, const uint8_t *ext)
+{
+	uint32_t dtd = ext[2], i, len;
+
+	/* 0 if there are neither data blocks nor DTDs */
+	if (dtd < 4 || dtd > EDID_BLOCK_SIZE - 1)
+		return;
+
+	/* data blocks are between the header and the first DTD */
+	for (i = 4; i < dtd; i += len + 1) {
+		len = ext[i] & 0x1f;
+		if (i + 1 + len > dtd)
+			break;
+		if (ext[i] >> 5 == EDID_CTA_EXTENDED && len &&
+		    ext[i + 1] == EDID_CTA_HDR_STATIC)
+			edid_cta_hdr(edid, ext + i + 1, len);
+	}
+
+	for (i = dtd; i + EDID_DESCRIPTOR_SIZE <= EDID_BLOCK_SIZE - 1;
+	     i += EDID_DESCRIPTOR_SIZE)
+		if (!edid_detailed_timing(edid, ext + i))
+			break;
+}
+
+/*
+ * Parse an EDID, as read from a connector's EDID property blob.  Damaged
+ * extension blocks are skipped.  Returns NULL with errno set if the base
+ * block is invalid.  Free the result with drmModeFreeEdid().
+ */
+drm_public drmModeEdidPtr drmModeEdidParse(const void *data, size_t size)
+{
+	const uint8_t *base = data;
+	drmModeEdidPtr edid;
+	uint32_t count_ext, max_modes, i;
+
+	if (!data || size < EDID_BLOCK_SIZE ||
+	    memcmp(base, edid_header, sizeof(edid_header)) ||
+	    !edid_block_valid(base)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	count_ext = MIN2(base[126], size / EDID_BLOCK_SIZE - 1);
+	max_modes = 4 + count_ext * EDID_CTA_MAX_DTDS;
+
+	edid = drmMalloc(sizeof(*edid) + max_modes * sizeof(*edid->modes));
+	if (!edid) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	edid->modes = (drmModeModeInfoPtr)(edid + 1);
+
+	edid->vendor[0] = '@' + ((base[8] >> 2) & 0x1f);
+	edid->vendor[1] = '@' + ((base[8] & 0x03) << 3 | base[9] >> 5);
+	edid->vendor[2] = '@' + (base[9] & 0x1f);
+	edid->product = base[10] | base[11] << 8;
+	edid->serial = base[12] | base[13] << 8 | base[14] << 16 |
+		       (uint32_t)base[15] << 24;
+	edid->week = base[16];
+	edid->year = base[17] + 1990;
+	edid->version = base[18];
+	edid->revision = base[19];
+	edid->width_mm = base[21] * 10;
+	edid->height_mm = base[22] * 10;
+
+	/* The first descriptor, if it is a detailed timing, is the preferred
+	 * mode: always since EDID 1.4, before that if the feature bit says
+	 * so. */
+	edid_descriptor(edid, base + 54);
+	if (edid->count_modes &&
+	    (edid->revision >= 4 || (base[24] & 0x02))) {
+		edid->preferred = &edid->modes[0];
+		edid->preferred->type |= DRM_MODE_TYPE_PREFERRED;
+	}
+
+	for (i = 1; i < 4; i++)
+		edid_descriptor(edid, base + 54 + i * EDID_DESCRIPTOR_SIZE);
+
+	for (i = 1; i <= count_ext; i++) {
+		const uint8_t *ext = base + i * EDID_BLOCK_SIZE;
+
+		if (ext[0] == EDID_CTA_TAG && edid_block_valid(ext))
+			edid_cta(edid, ext);
+	}
+
+	return edid;
+}
+
+drm_public void drmModeFreeEdid(drmModeEdidPtr edid)
+{
+	drmFree(edid);
+}
+
+struct drm_edid_cache_entry {
+	uint32_t blob_id;
+	drmModeEdidPtr edid;
+	struct drm_edid_cache_entry *next;
+};
+
+struct _drmModeEdidCache {
+	int fd;
+	void *blobs;		/* blob_id -> struct drm_edid_cache_entry */
+	struct drm_edid_cache_entry *list;
+};
+
+drm_public drmModeEdidCachePtr drmModeEdidCacheCreate(int fd)
+{
+	drmModeEdidCachePtr cache;
+
+	cache = drmMalloc(sizeof(*cache));
+	if (!cache)
+		return NULL;
+
+	cache->fd = fd;
+	cache->blobs = drmIntMapCreate();
+	if (!cache->blobs) {
+		drmFree(cache);
+		return NULL;
+	}
+
+	return cache;
+}
+
+/*
+ * Forget every parsed EDID, needed after hotplug events.  Pointers returned
+ * by drmModeEdidCacheLookup() become invalid.
+ */
+drm_public void drmModeEdidCacheInvalidate(drmModeEdidCachePtr cache)
+{
+	struct drm_edid_cache_entry *entry;
+
+	if (!cache)
+		return;
+
+	while ((entry = cache->list)) {
+		cache->list = entry->next;
+		drmIntMapDelete(cache->blobs, entry->blob_id);
+		drmModeFreeEdid(entry->edid);
+		drmFree(entry);
+	}
+}
+
+drm_public void drmModeEdidCacheDestroy(drmModeEdidCachePtr cache)
+{
+	if (!cache)
+		return;
+
+	drmModeEdidCacheInvalidate(cache);
+	drmIntMapDestroy(cache->blobs);
+	drmFree(cache);
+}
+
+/*
+ * The parsed EDID of the blob @blob_id, the value of a connector's EDID
+ * property.  Only the first lookup of a blob fetches and parses it.
+ * Returns NULL with errno set on failure.
+ */
+drm_public const drmModeEdid *
+drmModeEdidCacheLookup(drmModeEdidCachePtr cache, uint32_t blob_id)
+{
+	struct drm_edid_cache_entry *entry;
+	drmModePropertyBlobPtr blob;
+	void *value;
+
+	if (!cache || !blob_id) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if (!drmIntMapLookup(cache->blobs, blob_id, &value))
+		return ((struct drm_edid_cache_entry *)value)->edid;
+
+	blob = drmModeGetPropertyBlob(cache->fd, blob_id);
+	if (!blob)
+		return NULL;
+
+	entry = drmMalloc(sizeof(*entry));
+	if (!entry) {
+		drmModeFreePropertyBlob(blob);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	entry->blob_id = blob_id;
+	entry->edid = drmModeEdidParse(blob->data, blob->length);
+	drmModeFreePropertyBlob(blob);
+	if (!entry->edid) {
+		drmFree(entry);
+		return NULL;
+	}
+	if (drmIntMapInsert(cache->blobs, blob_id, entry)) {
+		drmModeFreeEdid(entry->edid);
+		drmFree(entry);
+		errno = ENOMEM;
+		return NULL;
+	}
+	entry->next = cache->list;
+	cache->list = entry;
+
+	return entry->edid;
+}
@@ -0,0 +1,313 @@
+/* xf86drmModeFence.c -- Explicit fencing for atomic commits
+ *
+ * Copyright © 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * DESCRIPTION
+ *
+ * Hands sync_file fences to the display and gets them back from it, so the
+ * handoff between the GPU and the display never waits on the CPU.
+ *
+ * drmModeFencesAddInFence() has a plane wait for a fence, typically the
+ * out-fence of the GPU job that rendered its framebuffer, by setting
+ * IN_FENCE_FD.  drmModeFencesAddOutFence() asks for the fence signaled when
+ * a CRTC's new frame is on screen, through OUT_FENCE_PTR.  Both only add
+ * properties to the caller's request; once it was committed,
+ * drmModeFencesCommitted() closes the in-fences and keeps the out-fences
+ * that came back, replacing each CRTC's previous one.
+ * drmModeFencesCommit() does both in one go.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libdrm_macros.h"
+#include "xf86drm.h"
+#include "xf86drmMode.h"
+
+#define VOID2U64(x) ((uint64_t)(unsigned long)(x))
+
+struct drm_fences_crtc {
+	uint32_t crtc_id;
+	uint32_t prop_out_fence;	/* 0 until first used */
+	int queued;			/* in a request not committed yet */
+	int32_t fence;			/* written by the atomic ioctl */
+	int out_fence;			/* from the last commit, or -1 */
+};
+
+struct _drmModeFences {
+	int fd;
+	drmModePropertyCachePtr props;
+
+	uint32_t count_crtcs;
+	struct drm_fences_crtc *crtcs;
+
+	/* in-fences of the request not committed yet, ours to close */
+	uint32_t count_in_fences;
+	uint32_t size_in_fences;
+	int *in_fences;
+};
+
+static uint32_t drm_fences_prop(drmModeFencesPtr fences, uint32_t id,
+				uint32_t type, const char *name)
+{
+	const drmModePropertyInfo *info;
+
+	info = drmModePropertyCacheLookup(fences->props, id, type, name);
+	return info ? info->prop_id : 0;
+}
+
+static struct drm_fences_crtc *drm_fences_crtc(drmModeFencesPtr fences,
+					       uint32_t crtc_id)
+{
+	uint32_t i;
+
+	for (i = 0; i < fences->count_crtcs; i++)
+		if (fences->crtcs[i].crtc_id == crtc_id)
+			return &fences->crtcs[i];
+	return NULL;
+}
+
+/*
+ * Set up fencing for the CRTCs and planes of @fd.  Enables
+ * DRM_CLIENT_CAP_UNIVERSAL_PLANES and DRM_CLIENT_CAP_ATOMIC.  Returns NULL
+ * with errno set on failure.
+ */
+drm_public drmModeFencesPtr drmModeFencesCreate(int fd)
+{
+	drmModeFencesPtr fences;
+	drmModeResPtr res;
+	int i, ret;
+
+	if (drmSetClientCap(fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1) ||
+	    drmSetClientCap(fd, DRM_CLIENT_CAP_ATOMIC, 1))
+		return NULL;
+
+	fences = drmMalloc(sizeof(*fences));
+	if (!fences) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	fences->fd = fd;
+
+	res = drmModeGetResources(fd);
+	if (!res) {
+		ret = -errno;
+		goto out;
+	}
+	fences->crtcs = calloc(res->count_crtcs ? res->count_crtcs : 1,
+			       sizeof(*fences->crtcs));
+	if (!fences->crtcs) {
+		drmModeFreeResources(res);
+		ret = -ENOMEM;
+		goto out;
+	}
+	for (i = 0; i < res->count_crtcs; i++) {
+		fences->crtcs[i].crtc_id = res->crtcs[i];
+		fences->crtcs[i].fence = -1;
+		fences->crtcs[i].out_fence = -1;
+	}
+	fences->count_crtcs = res->count_crtcs;
+	drmModeFreeResources(res);
+
+	fences->props = drmModePropertyCacheCreate(fd);
+	if (!fences->props) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	return fences;
+
+out:
+	free(fences->crtcs);
+	drmFree(fences);
+	errno = -ret;
+	return NULL;
+}
+
+/* Closes the out-fences, and in-fences of a request never committed. */
+drm_public void drmModeFencesDestroy(drmModeFencesPtr fences)
+{
+	uint32_t i;
+
+	if (!fences)
+		return;
+
+	drmModeFencesCommitted(fences, -ECANCELED);
+	for (i = 0; i < fences->count_crtcs; i++)
+		if (fences->crtcs[i].out_fence >= 0)
+			close(fences->crtcs[i].out_fence);
+	free(fences->crtcs);
+	free(fences->in_fences);
+	drmModePropertyCacheDestroy(fences->props);
+	drmFree(fences);
+}
+
+/*
+ * Have @plane_id wait for @fence_fd before scanning out the framebuffer the
+ * request gives it.  The fd is owned by @fences from now on, also on
+ * failure, and closed once the request was committed.  Returns 0, -ENOENT
+ * if the plane has no IN_FENCE_FD property, or -ENOMEM.
+ */
+drm_public int drmModeFencesAddInFence(drmModeFencesPtr fences,
+				       drmModeAtomicReqPtr req,
+				       uint32_t plane_id, int fence_fd)
+{
+	uint32_t prop, size;
+	int *in_fences;
+
+	if (!fences || !req || fence_fd < 0) {
+		if (fence_fd >= 0)
+			close(fence_fd);
+		return -EINVAL;
+	}
+
+	prop = drm_fences_prop(fences, plane_id, DRM_MODE_OBJECT_PLANE,
+			       "IN_FENCE_FD");
+	if (!prop) {
+		close(fence_fd);
+		return -ENOENT;
+	}
+
+	if (fences->count_in_fences == fences->size_in_fences) {
+		size = fences->size_in_fences ? 2 * fences->size_in_fences : 8;
+		in_fences = realloc(fences->in_fences,
+				    size * sizeof(*in_fences));
+		if (!in_fences) {
+			close(fence_fd);
+			return -ENOMEM;
+		}
+		fences->in_fences = in_fences;
+		fences->size_in_fences = size;
+	}
+	fences->in_fences[fences->count_in_fences++] = fence_fd;
+
+	if (drmModeAtomicAddProperty(req, plane_id, prop, fence_fd) < 0)
+		return -ENOMEM;
+	return 0;
+}
+
+/*
+ * Ask for an out-fence of @crtc_id, signaled once the frame the request
+ * commits is on screen, or replaced by a later one.  Returns 0, -ENOENT if
+ * the CRTC is unknown or has no OUT_FENCE_PTR property, or -ENOMEM.
+ */
+drm_public int drmModeFencesAddOutFence(drmModeFencesPtr fences,
+					drmModeAtomicReqPtr req,
+					uint32_t crtc_id)
+{
+	struct drm_fences_crtc *crtc;
+
+	if (!fences || !req)
+		return -EINVAL;
+
+	crtc = drm_fences_crtc(fences, crtc_id);
+	if (!crtc)
+		return -ENOENT;
+	if (!crtc->prop_out_fence)
+		crtc->prop_out_fence = drm_fences_prop(fences, crtc_id,
+						       DRM_MODE_OBJECT_CRTC,
+						       "OUT_FENCE_PTR");
+	if (!crtc->prop_out_fence)
+		return -ENOENT;
+
+	crtc->fence = -1;
+	if (drmModeAtomicAddProperty(req, crtc_id, crtc->prop_out_fence,
+				     VOID2U64(&crtc->fence)) < 0)
+		return -ENOMEM;
+	crtc->queued = 1;
+	return 0;
+}
+
+/*
+ * Tell @fences about the result of the commit of the request the fences
+ * were added to, also when it failed.  The in-fences are closed; the
+ * out-fences the kernel returned replace the previous ones of their CRTCs,
+ * which are closed.  A TEST_ONLY commit returns none.
+ */
+drm_public void drmModeFencesCommitted(drmModeFencesPtr fences, int ret)
+{
+	struct drm_fences_crtc *crtc;
+	uint32_t i;
+
+	if (!fences)
+		return;
+
+	for (i = 0; i < fences->count_in_fences; i++)
+		close(fences->in_fences[i]);
+	fences->count_in_fences = 0;
+
+	for (i = 0; i < fences->count_crtcs; i++) {
+		crtc = &fences->crtcs[i];
+		if (!crtc->queued)
+			continue;
+		crtc->queued = 0;
+
+		if (crtc->fence < 0)
+			continue;
+		if (ret == 0) {
+			if (crtc->out_fence >= 0)
+				close(crtc->out_fence);
+			crtc->out_fence = crtc->fence;
+		} else {
+			close(crtc->fence);
+		}
+		crtc->fence = -1;
+	}
+}
+
+/*
+ * drmModeAtomicCommit() followed by drmModeFencesCommitted().
+ */
+drm_public int drmModeFencesCommit(drmModeFencesPtr fences,
+				   drmModeAtomicReqPtr req, uint32_t flags,
+				   void *user_data)
+{
+	int ret;
+
+	if (!fences || !req)
+		return -EINVAL;
+
+	ret = drmModeAtomicCommit(fences->fd, req, flags, user_data);
+	drmModeFencesCommitted(fences, ret);
+	return ret;
+}
+
+/*
+ * The out-fence of the last commit asking for one on @crtc_id, or -1.  The
+ * fd stays owned by @fences and valid until the next out-fence of the CRTC
+ * comes back; dup() it to keep it longer.
+ */
+drm_public int drmModeFencesGetOutFence(drmModeFencesPtr fences,
+					uint32_t crtc_id)
+{
+	struct drm_fences_crtc *crtc;
+
+	if (!fences)
+		return -1;
+
+	crtc = drm_fences_crtc(fences, crtc_id);
+	return crtc ? crtc->out_fence : -1;
+}
@@ -0,0 +1,479 @@
+/* xf86drmModeHotplug.c -- Connector-scoped hotplug handling
+ *
+ * Copyright © 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * DESCRIPTION
+ *
+ * Keeps the connectors of a device up to date across hotplug uevents while
+ * probing as few of them as possible.  A forced probe (drmModeGetConnector())
+ * reads the EDID over DDC and takes tens of milliseconds per connector;
+ * drmModeGetConnectorCurrent() only reports what the kernel already knows.
+ *
+ * The uevents are fed in by the caller, from libudev or a netlink socket,
+ * with drmModeHotplugUevent().  Bursts are debounced: nothing is probed
+ * until no event arrived for the debounce interval, the caller polls with
+ * drmModeHotplugGetTimeout() and then calls drmModeHotplugDispatch().
+ *
+ *  - CONNECTOR=<id> and no PROPERTY=: only that connector is probed.
+ *  - CONNECTOR=<id> PROPERTY=<id>: a property changed, the connector is
+ *    re-read without a probe.
+ *  - neither: the kernel's hotplug handling already updated the connection
+ *    status, so every connector is re-read without a probe and only those
+ *    whose status changed, or which are new, are probed.
+ *
+ * The handler is called for every connector that changed, with NULL for
+ * connectors that went away.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#ifdef MAJOR_IN_MKDEV
+#include <sys/mkdev.h>
+#endif
+#ifdef MAJOR_IN_SYSMACROS
+#include <sys/sysmacros.h>
+#endif
+
+#include "libdrm_macros.h"
+#include "xf86drm.h"
+#include "xf86drmMode.h"
+
+/* Connectors whose events are tracked one by one, before falling back to
+ * re-reading all of them. */
+#define HOTPLUG_MAX_PENDING 16
+
+struct drm_hotplug_pending {
+	uint32_t connector_id;
+	uint32_t property_id;	/* 0 for a probe */
+};
+
+struct drm_hotplug_connector {
+	uint32_t connector_id;
+	drmModeConnectorPtr connector;
+	int seen;		/* still listed by GETRESOURCES */
+};
+
+struct _drmModeHotplug {
+	int fd;
+	dev_t rdev;
+	int64_t debounce_ns;
+	drmModeHotplugHandler handler;
+	void *user_data;
+
+	int64_t deadline_ns;	/* 0 if nothing is pending */
+	int full;		/* re-read every connector */
+	uint32_t count_pending;
+	struct drm_hotplug_pending pending[HOTPLUG_MAX_PENDING];
+
+	uint32_t count_connectors;
+	struct drm_hotplug_connector *connectors;
+};
+
+static int64_t drm_hotplug_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static struct drm_hotplug_connector *
+drm_hotplug_find(drmModeHotplugPtr hp, uint32_t connector_id)
+{
+	uint32_t i;
+
+	for (i = 0; i < hp->count_connectors; i++)
+		if (hp->connectors[i].connector_id == connector_id)
+			return &hp->connectors[i];
+	return NULL;
+}
+
+/*
+ * Sync the connector list with GETRESOURCES, which doesn't probe anything.
+ * New connectors have no drmModeConnector yet afterwards.
+ */
+static int drm_hotplug_update_list(drmModeHotplugPtr hp)
+{
+	struct drm_hotplug_connector *connectors, *c;
+	drmModeResPtr res;
+	uint32_t i, n = 0;
+
+	res = drmModeGetResources(hp->fd);
+	if (!res)
+		return -errno;
+
+	connectors = drmMalloc((res->count_connectors + hp->count_connectors + 1) *
+			       sizeof(*connectors));
+	if (!connectors) {
+		drmModeFreeResources(res);
+		return -ENOMEM;
+	}
+
+	for (i = 0; i < hp->count_connectors; i++)
+		hp->connectors[i].seen = 0;
+
+	for (i = 0; i < (uint32_t)res->count_connectors; i++) {
+		c = drm_hotplug_find(hp, res->connectors[i]);
+		if (c) {
+			c->seen = 1;
+			connectors[n] = *c;
+		} else {
+			connectors[n].connector_id = res->connectors[i];
+			connectors[n].connector = NULL;
+		}
+		connectors[n++].seen = 1;
+	}
+
+	/* gone ones go last, still to be reported */
+	for (i = 0; i < hp->count_connectors; i++)
+		if (!hp->connectors[i].seen)
+			connectors[n++] = hp->connectors[i];
+
+	drmFree(hp->connectors);
+	hp->connectors = connectors;
+	hp->count_connectors = n;
+	drmModeFreeResources(res);
+	return 0;
+}
+
+static void drm_hotplug_report(drmModeHotplugPtr hp,
+			       struct drm_hotplug_connector *c,
+			       uint32_t property_id)
+{
+	if (hp->handler)
+		hp->handler(hp->fd, c->connector_id, c->connector, property_id,
+			    hp->user_data);
+}
+
+/* Re-read one connector, probing it if asked to. */
+static int drm_hotplug_reread(drmModeHotplugPtr hp,
+			      struct drm_hotplug_connector *c, int probe)
+{
+	drmModeConnectorPtr connector;
+
+	if (probe)
+		connector = drmModeGetConnector(hp->fd, c->connector_id);
+	else
+		connector = drmModeGetConnectorCurrent(hp->fd, c->connector_id);
+	if (!connector)
+		return -errno;
+
+	drmModeFreeConnector(c->connector);
+	c->connector = connector;
+	return 0;
+}
+
+/*
+ * Track hotplug events of the device on @fd.  The connectors are read
+ * without probing; @debounce_ms is how long the events must be quiet
+ * before anything is probed.  Returns NULL with errno set on failure.
+ */
+drm_public drmModeHotplugPtr drmModeHotplugCreate(int fd, uint32_t debounce_ms,
+						  drmModeHotplugHandler handler,
+						  void *user_data)
+{
+	drmModeHotplugPtr hp;
+	struct stat st;
+	uint32_t i;
+	int ret;
+
+	if (fstat(fd, &st))
+		return NULL;
+
+	hp = drmMalloc(sizeof(*hp));
+	if (!hp) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	hp->fd = fd;
+	hp->rdev = st.st_rdev;
+	hp->debounce_ns = (int64_t)debounce_ms * 1000000;
+	hp->handler = handler;
+	hp->user_data = user_data;
+
+	ret = drm_hotplug_update_list(hp);
+	for (i = 0; !ret && i < hp->count_connectors; i++)
+		ret = drm_hotplug_reread(hp, &hp->connectors[i], 0);
+	if (ret) {
+		drmModeHotplugDestroy(hp);
+		errno = -ret;
+		return NULL;
+	}
+
+	return hp;
+}
+
+drm_public void drmModeHotplugDestroy(drmModeHotplugPtr hp)
+{
+	uint32_t i;
+
+	if (!hp)
+		return;
+
+	for (i = 0; i < hp->count_connectors; i++)
+		drmModeFreeConnector(hp->connectors[i].connector);
+	drmFree(hp->connectors);
+	drmFree(hp);
+}
+
+/*
+ * The current state of a connector, owned by @hp and valid until the next
+ * drmModeHotplugDispatch(), or NULL.
+ */
+drm_public drmModeConnectorPtr
+drmModeHotplugGetConnector(drmModeHotplugPtr hp, uint32_t connector_id)
+{
+	struct drm_hotplug_connector *c;
+
+	if (!hp)
+		return NULL;
+
+	c = drm_hotplug_find(hp, connector_id);
+	return c ? c->connector : NULL;
+}
+
+/*
+ * Note a hotplug event.  @connector_id is 0 if the event names no
+ * connector, @property_id is 0 unless the event is about a property.
+ */
+drm_public int drmModeHotplugEvent(drmModeHotplugPtr hp, uint32_t connector_id,
+				   uint32_t property_id)
+{
+	uint32_t i;
+
+	if (!hp)
+		return -EINVAL;
+
+	hp->deadline_ns = drm_hotplug_now() + hp->debounce_ns;
+
+	if (!connector_id || hp->full) {
+		hp->full = 1;
+		return 0;
+	}
+
+	for (i = 0; i < hp->count_pending; i++) {
+		struct drm_hotplug_pending *p = &hp->pending[i];
+
+		if (p->connector_id != connector_id)
+			continue;
+		/* a probe covers property changes too */
+		if (p->property_id == property_id || !p->property_id)
+			return 0;
+		if (!property_id) {
+			p->property_id = 0;
+			return 0;
+		}
+	}
+
+	if (hp->count_pending == HOTPLUG_MAX_PENDING) {
+		hp->full = 1;
+		return 0;
+	}
+
+	hp->pending[hp->count_pending].connector_id = connector_id;
+	hp->pending[hp->count_pending].property_id = property_id;
+	hp->count_pending++;
+	return 0;
+}
+
+/*
+ * The decimal value of a "KEY=value" entry of length @n for @key, or -1.
+ * The last entry of a uevent needn't be NUL terminated.
+ */
+static int64_t drm_hotplug_value(const char *entry, size_t n, const char *key)
+{
+	size_t i, len = strlen(key);
+	int64_t value = 0;
+
+	if (n <= len || memcmp(entry, key, len))
+		return -1;
+
+	for (i = len; i < n; i++) {
+		if (entry[i] < '0' || entry[i] > '9' || value > UINT32_MAX)
+			return -1;
+		value = value * 10 + entry[i] - '0';
+	}
+	return value;
+}
+
+/*
+ * Parse a kernel uevent, NUL separated KEY=value pairs as read from a
+ * NETLINK_KOBJECT_UEVENT socket, and note it if it is a hotplug event of
+ * this device.  Returns 1 if it was, 0 if not.
+ */
+drm_public int drmModeHotplugUevent(drmModeHotplugPtr hp, const char *buf,
+				    size_t len)
+{
+	int64_t connector_id = -1, property_id = -1, value;
+	int64_t dev_major = -1, dev_minor = -1;
+	const char *p, *end = buf + len;
+	int hotplug = 0;
+	size_t n;
+
+	if (!hp || !buf)
+		return -EINVAL;
+
+	for (p = buf; p < end; p += n + 1) {
+		n = strnlen(p, end - p);
+
+		if ((value = drm_hotplug_value(p, n, "HOTPLUG=")) >= 0)
+			hotplug = value == 1;
+		else if ((value = drm_hotplug_value(p, n, "MAJOR=")) >= 0)
+			dev_major = value;
+		else if ((value = drm_hotplug_value(p, n, "MINOR=")) >= 0)
+			dev_minor = value;
+		else if ((value = drm_hotplug_value(p, n, "CONNECTOR=")) >= 0)
+			connector_id = value;
+		else if ((value = drm_hotplug_value(p, n, "PROPERTY=")) >= 0)
+			property_id = value;
+	}
+
+	if (!hotplug)
+		return 0;
+	if ((dev_major >= 0 && dev_major != major(hp->rdev)) ||
+	    (dev_minor >= 0 && dev_minor != minor(hp->rdev)))
+		return 0;
+
+	if (connector_id < 0)
+		drmModeHotplugEvent(hp, 0, 0);
+	else
+		drmModeHotplugEvent(hp, connector_id,
+				    property_id < 0 ? 0 : property_id);
+	return 1;
+}
+
+/*
+ * Milliseconds until drmModeHotplugDispatch() has work to do, for poll(),
+ * or -1 if no event is pending.
+ */
+drm_public int drmModeHotplugGetTimeout(drmModeHotplugPtr hp)
+{
+	int64_t left;
+
+	if (!hp || !hp->deadline_ns)
+		return -1;
+
+	left = hp->deadline_ns - drm_hotplug_now();
+	if (left <= 0)
+		return 0;
+	return (int)((left + 999999) / 1000000);
+}
+
+static int drm_hotplug_full(drmModeHotplugPtr hp)
+{
+	struct drm_hotplug_connector *c;
+	drmModeConnection status;
+	uint32_t i;
+	int ret, count = 0;
+
+	ret = drm_hotplug_update_list(hp);
+	if (ret)
+		return ret;
+
+	for (i = 0; i < hp->count_connectors; i++) {
+		c = &hp->connectors[i];
+
+		if (!c->seen) {
+			drmModeFreeConnector(c->connector);
+			c->connector = NULL;
+			drm_hotplug_report(hp, c, 0);
+			count++;
+			continue;
+		}
+
+		if (!c->connector) {
+			ret = drm_hotplug_reread(hp, c, 1);
+		} else {
+			status = c->connector->connection;
+			ret = drm_hotplug_reread(hp, c, 0);
+			if (ret || c->connector->connection == status)
+				continue;
+			ret = drm_hotplug_reread(hp, c, 1);
+		}
+		if (ret)
+			continue;
+
+		drm_hotplug_report(hp, c, 0);
+		count++;
+	}
+
+	/* drop the ones that went away */
+	for (i = 0; i < hp->count_connectors && hp->connectors[i].seen; i++)
+		;
+	hp->count_connectors = i;
+
+	return count;
+}
+
+/*
+ * Once the events have been quiet for the debounce interval, re-read and
+ * probe the connectors they were about and call the handler for every
+ * connector that changed.  Returns the number of those, 0 if nothing was
+ * due yet, or a negative error code.
+ */
+drm_public int drmModeHotplugDispatch(drmModeHotplugPtr hp)
+{
+	struct drm_hotplug_pending pending[HOTPLUG_MAX_PENDING];
+	struct drm_hotplug_connector *c;
+	uint32_t i, count_pending;
+	int full, ret, count = 0;
+
+	if (!hp)
+		return -EINVAL;
+	if (!hp->deadline_ns || drmModeHotplugGetTimeout(hp) > 0)
+		return 0;
+
+	/* the handler may note new events */
+	full = hp->full;
+	count_pending = hp->count_pending;
+	memcpy(pending, hp->pending, sizeof(pending));
+	hp->deadline_ns = 0;
+	hp->full = 0;
+	hp->count_pending = 0;
+
+	if (full)
+		return drm_hotplug_full(hp);
+
+	for (i = 0; i < count_pending; i++) {
+		c = drm_hotplug_find(hp, pending[i].connector_id);
+		if (!c) {
+			/* a connector we don't know yet: MST */
+			ret = drm_hotplug_full(hp);
+			return ret < 0 ? ret : count + ret;
+		}
+
+		ret = drm_hotplug_reread(hp, c, !pending[i].property_id);
+		if (ret)
+			continue;
+
+		drm_hotplug_report(hp, c, pending[i].property_id);
+		count++;
+	}
+
+	return count;
+}
@@ -0,0 +1,622 @@
+/* xf86drmModeLease.c -- Partitioning of KMS objects among DRM lessees
+ *
+ * Copyright © 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * DESCRIPTION
+ *
+ * Hands out the connectors, CRTCs and planes of a DRM master to many
+ * lessees without two leases sharing an object.
+ *
+ * The manager reads the topology once, with drmModeGetSnapshot(), into an
+ * array sorted by object ID that records which lessee owns each object, so
+ * checking a set costs a binary search per object instead of another round
+ * of resource ioctls.  Before a lease is created, the connectors of the set
+ * are routed to its CRTCs in an atomic TEST_ONLY commit, so a set the
+ * hardware can't drive is refused up front rather than failing in the
+ * lessee.
+ *
+ * The kernel ends a lease when the lessee closes its fd;
+ * drmModeLeaseManagerReclaim() notices that through drmModeListLessees()
+ * and returns the objects to the pool.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libdrm_macros.h"
+#include "xf86drm.h"
+#include "xf86drmMode.h"
+
+struct drm_lease_object {
+	uint32_t id;
+	uint32_t type;			/* DRM_MODE_OBJECT_* */
+	uint32_t crtcs;			/* CRTC index mask it can be used on */
+	uint32_t plane_type;
+	const drmModeConnector *connector;
+	uint32_t lessee;		/* 0 while free */
+};
+
+struct drm_lease {
+	uint32_t lessee_id;
+	uint32_t count;
+	uint32_t *objects;
+};
+
+struct _drmModeLeaseManager {
+	int fd;
+	drmModeSnapshotPtr snapshot;
+	drmModePropertyCachePtr props;
+
+	uint32_t count_objects;
+	struct drm_lease_object *objects;	/* sorted by id */
+
+	uint32_t count_leases;
+	uint32_t size_leases;
+	struct drm_lease *leases;
+};
+
+static int drm_lease_cmp_object(const void *a, const void *b)
+{
+	const struct drm_lease_object *oa = a, *ob = b;
+
+	return oa->id < ob->id ? -1 : oa->id > ob->id;
+}
+
+static int drm_lease_cmp_id(const void *a, const void *b)
+{
+	uint32_t ia = *(const uint32_t *)a, ib = *(const uint32_t *)b;
+
+	return ia < ib ? -1 : ia > ib;
+}
+
+static struct drm_lease_object *
+drm_lease_find(drmModeLeaseManagerPtr mgr, uint32_t id)
+{
+	struct drm_lease_object key = { .id = id };
+
+	return bsearch(&key, mgr->objects, mgr->count_objects,
+		       sizeof(key), drm_lease_cmp_object);
+}
+
+static uint32_t drm_lease_prop(drmModeLeaseManagerPtr mgr, uint32_t id,
+			       uint32_t type, const char *name)
+{
+	const drmModePropertyInfo *info;
+
+	info = drmModePropertyCacheLookup(mgr->props, id, type, name);
+	return info ? info->prop_id : 0;
+}
+
+static uint32_t drm_lease_connector_crtcs(drmModeSnapshotPtr snap,
+					  const drmModeConnector *connector)
+{
+	uint32_t crtcs = 0;
+	int i, j;
+
+	for (i = 0; i < connector->count_encoders; i++)
+		for (j = 0; j < snap->count_encoders; j++)
+			if (snap->encoders[j].encoder_id ==
+			    connector->encoders[i])
+				crtcs |= snap->encoders[j].possible_crtcs;
+	return crtcs;
+}
+
+static uint32_t drm_lease_plane_type(drmModeLeaseManagerPtr mgr, uint32_t i)
+{
+	drmModeObjectPropertiesPtr props = &mgr->snapshot->plane_props[i];
+	uint32_t prop_type, j;
+
+	prop_type = drm_lease_prop(mgr, mgr->snapshot->planes[i].plane_id,
+				   DRM_MODE_OBJECT_PLANE, "type");
+	for (j = 0; prop_type && j < props->count_props; j++)
+		if (props->props[j] == prop_type)
+			return props->prop_values[j];
+	return DRM_PLANE_TYPE_OVERLAY;
+}
+
+static int drm_lease_build(drmModeLeaseManagerPtr mgr)
+{
+	drmModeSnapshotPtr snap = mgr->snapshot;
+	struct drm_lease_object *o;
+	uint32_t count, i;
+
+	count = snap->count_connectors + snap->count_crtcs + snap->count_planes;
+	mgr->objects = calloc(count ? count : 1, sizeof(*mgr->objects));
+	if (!mgr->objects)
+		return -ENOMEM;
+
+	o = mgr->objects;
+	for (i = 0; i < (uint32_t)snap->count_connectors; i++, o++) {
+		o->id = snap->connectors[i].connector_id;
+		o->type = DRM_MODE_OBJECT_CONNECTOR;
+		o->connector = &snap->connectors[i];
+		o->crtcs = drm_lease_connector_crtcs(snap, o->connector);
+	}
+	for (i = 0; i < (uint32_t)snap->count_crtcs && i < 32; i++, o++) {
+		o->id = snap->crtcs[i].crtc_id;
+		o->type = DRM_MODE_OBJECT_CRTC;
+		o->crtcs = 1u << i;
+	}
+	for (i = 0; i < snap->count_planes; i++, o++) {
+		o->id = snap->planes[i].plane_id;
+		o->type = DRM_MODE_OBJECT_PLANE;
+		o->crtcs = snap->planes[i].possible_crtcs;
+		o->plane_type = drm_lease_plane_type(mgr, i);
+	}
+
+	mgr->count_objects = o - mgr->objects;
+	qsort(mgr->objects, mgr->count_objects, sizeof(*mgr->objects),
+	      drm_lease_cmp_object);
+	return 0;
+}
+
+/*
+ * Create a manager for the objects of @fd, which must be the DRM master.
+ * Enables DRM_CLIENT_CAP_UNIVERSAL_PLANES, so leases can include primary
+ * and cursor planes, and DRM_CLIENT_CAP_ATOMIC for validation.  Objects
+ * already leased out before are considered free.  Returns NULL with errno
+ * set on failure.
+ */
+drm_public drmModeLeaseManagerPtr drmModeLeaseManagerCreate(int fd)
+{
+	drmModeLeaseManagerPtr mgr;
+	int ret;
+
+	if (drmSetClientCap(fd, DRM_CLIENT_CAP_UNIVERSAL_PLANES, 1) ||
+	    drmSetClientCap(fd, DRM_CLIENT_CAP_ATOMIC, 1))
+		return NULL;
+
+	mgr = drmMalloc(sizeof(*mgr));
+	if (!mgr) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	mgr->fd = fd;
+
+	mgr->snapshot = drmModeGetSnapshot(fd, 0);
+	if (!mgr->snapshot) {
+		ret = -errno;
+		goto out;
+	}
+
+	mgr->props = drmModePropertyCacheCreate(fd);
+	if (!mgr->props) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	ret = drm_lease_build(mgr);
+	if (ret)
+		goto out;
+
+	return mgr;
+
+out:
+	drmModePropertyCacheDestroy(mgr->props);
+	drmModeFreeSnapshot(mgr->snapshot);
+	drmFree(mgr);
+	errno = -ret;
+	return NULL;
+}
+
+/* Leases stay in place; revoke them first to take the objects back. */
+drm_public void drmModeLeaseManagerDestroy(drmModeLeaseManagerPtr mgr)
+{
+	uint32_t i;
+
+	if (!mgr)
+		return;
+
+	for (i = 0; i < mgr->count_leases; i++)
+		free(mgr->leases[i].objects);
+	free(mgr->leases);
+	free(mgr->objects);
+	drmModePropertyCacheDestroy(mgr->props);
+	drmModeFreeSnapshot(mgr->snapshot);
+	drmFree(mgr);
+}
+
+static const drmModeModeInfo *
+drm_lease_connector_mode(const drmModeConnector *connector)
+{
+	int i;
+
+	for (i = 0; i < connector->count_modes; i++)
+		if (connector->modes[i].type & DRM_MODE_TYPE_PREFERRED)
+			return &connector->modes[i];
+	return connector->count_modes ? &connector->modes[0] : NULL;
+}
+
+/*
+ * Route each connector of @set to its own CRTC of @set, in a TEST_ONLY
+ * commit using the connector's preferred mode.  Connectors without modes,
+ * e.g. disconnected ones, can't be tested and are only checked for a CRTC.
+ */
+static int drm_lease_test(drmModeLeaseManagerPtr mgr,
+			  struct drm_lease_object **set, uint32_t count)
+{
+	struct drm_lease_object *crtcs[32];
+	const drmModeModeInfo *mode;
+	drmModeAtomicReqPtr req;
+	uint32_t blobs[32];
+	uint32_t count_crtcs = 0, count_blobs = 0, used = 0, i, j;
+	uint32_t prop_crtc_id, prop_mode_id, prop_active;
+	int ret = 0;
+
+	for (i = 0; i < count; i++)
+		if (set[i]->type == DRM_MODE_OBJECT_CRTC)
+			crtcs[count_crtcs++] = set[i];
+
+	req = drmModeAtomicAlloc();
+	if (!req)
+		return -ENOMEM;
+
+	for (i = 0; i < count && !ret; i++) {
+		if (set[i]->type != DRM_MODE_OBJECT_CONNECTOR)
+			continue;
+
+		for (j = 0; j < count_crtcs; j++)
+			if (!(used & (1u << j)) &&
+			    (crtcs[j]->crtcs & set[i]->crtcs))
+				break;
+		if (j == count_crtcs) {
+			ret = -EINVAL;
+			break;
+		}
+		used |= 1u << j;
+
+		mode = drm_lease_connector_mode(set[i]->connector);
+		if (!mode)
+			continue;
+
+		prop_crtc_id = drm_lease_prop(mgr, set[i]->id,
+					      DRM_MODE_OBJECT_CONNECTOR,
+					      "CRTC_ID");
+		prop_mode_id = drm_lease_prop(mgr, crtcs[j]->id,
+					      DRM_MODE_OBJECT_CRTC, "MODE_ID");
+		prop_active = drm_lease_prop(mgr, crtcs[j]->id,
+					     DRM_MODE_OBJECT_CRTC, "ACTIVE");
+		if (!prop_crtc_id || !prop_mode_id || !prop_active) {
+			ret = -ENOTSUP;
+			break;
+		}
+
+		ret = drmModeCreatePropertyBlob(mgr->fd, mode, sizeof(*mode),
+						&blobs[count_blobs]);
+		if (ret)
+			break;
+
+		if (drmModeAtomicAddProperty(req, set[i]->id, prop_crtc_id,
+					     crtcs[j]->id) < 0 ||
+		    drmModeAtomicAddProperty(req, crtcs[j]->id, prop_mode_id,
+					     blobs[count_blobs]) < 0 ||
+		    drmModeAtomicAddProperty(req, crtcs[j]->id, prop_active,
+					     1) < 0)
+			ret = -ENOMEM;
+		count_blobs++;
+	}
+
+	if (!ret && count_blobs)
+		ret = drmModeAtomicCommit(mgr->fd, req,
+					  DRM_MODE_ATOMIC_TEST_ONLY |
+					  DRM_MODE_ATOMIC_ALLOW_MODESET, NULL);
+
+	for (i = 0; i < count_blobs; i++)
+		drmModeDestroyPropertyBlob(mgr->fd, blobs[i]);
+	drmModeAtomicFree(req);
+	return ret;
+}
+
+/*
+ * Check @count objects in @ids, sorted and free of duplicates: all known,
+ * none leased, at least one connector and one CRTC, and a plane for each
+ * CRTC.
+ */
+static int drm_lease_check(drmModeLeaseManagerPtr mgr, const uint32_t *ids,
+			   uint32_t count, struct drm_lease_object **set)
+{
+	uint32_t connectors = 0, crtcs = 0, planes = 0, i;
+
+	for (i = 0; i < count; i++) {
+		if (i && ids[i] == ids[i - 1])
+			return -EINVAL;
+
+		set[i] = drm_lease_find(mgr, ids[i]);
+		if (!set[i])
+			return -ENOENT;
+		if (set[i]->lessee)
+			return -EBUSY;
+
+		if (set[i]->type == DRM_MODE_OBJECT_CONNECTOR)
+			connectors++;
+		else if (set[i]->type == DRM_MODE_OBJECT_CRTC)
+			crtcs |= set[i]->crtcs;
+		else
+			planes |= set[i]->crtcs;
+	}
+
+	if (!connectors || !crtcs || (crtcs & planes) != crtcs)
+		return -EINVAL;
+
+	return 0;
+}
+
+static struct drm_lease *drm_lease_add(drmModeLeaseManagerPtr mgr)
+{
+	struct drm_lease *leases;
+	uint32_t size;
+
+	if (mgr->count_leases == mgr->size_leases) {
+		size = mgr->size_leases ? mgr->size_leases * 2 : 8;
+		leases = realloc(mgr->leases, size * sizeof(*leases));
+		if (!leases)
+			return NULL;
+		mgr->leases = leases;
+		mgr->size_leases = size;
+	}
+	return &mgr->leases[mgr->count_leases++];
+}
+
+/*
+ * Lease @count objects to a new lessee, after validating the set.  @flags
+ * are the open flags of the lease fd, O_CLOEXEC and O_NONBLOCK.  Returns
+ * the lease fd, to be passed to the lessee, or -ENOENT for an unknown
+ * object, -EBUSY for one already leased, -EINVAL for a set no lessee could
+ * drive, or the error of the TEST_ONLY commit or of the lease ioctl.
+ */
+drm_public int drmModeLeaseManagerCreateLease(drmModeLeaseManagerPtr mgr,
+					      const uint32_t *objects,
+					      uint32_t count, int flags,
+					      uint32_t *lessee_id)
+{
+	struct drm_lease_object **set;
+	struct drm_lease *lease;
+	uint32_t *ids, id, i;
+	int ret, lease_fd;
+
+	if (!mgr || !objects || !count || !lessee_id)
+		return -EINVAL;
+
+	ids = malloc(count * sizeof(*ids));
+	set = malloc(count * sizeof(*set));
+	if (!ids || !set) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	memcpy(ids, objects, count * sizeof(*ids));
+	qsort(ids, count, sizeof(*ids), drm_lease_cmp_id);
+
+	ret = drm_lease_check(mgr, ids, count, set);
+	if (ret)
+		goto out;
+
+	ret = drm_lease_test(mgr, set, count);
+	if (ret)
+		goto out;
+
+	lease = drm_lease_add(mgr);
+	if (!lease) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	lease_fd = drmModeCreateLease(mgr->fd, ids, count, flags, &id);
+	if (lease_fd < 0) {
+		mgr->count_leases--;
+		ret = lease_fd;
+		goto out;
+	}
+
+	lease->lessee_id = id;
+	lease->count = count;
+	lease->objects = ids;
+	for (i = 0; i < count; i++)
+		set[i]->lessee = id;
+	free(set);
+
+	*lessee_id = id;
+	return lease_fd;
+
+out:
+	free(set);
+	free(ids);
+	return ret;
+}
+
+static struct drm_lease_object *
+drm_lease_pick_plane(drmModeLeaseManagerPtr mgr, uint32_t crtc,
+		     uint32_t plane_type)
+{
+	struct drm_lease_object *o, *best = NULL;
+	uint32_t i;
+
+	/* prefer planes no other CRTC could use */
+	for (i = 0; i < mgr->count_objects; i++) {
+		o = &mgr->objects[i];
+		if (o->type != DRM_MODE_OBJECT_PLANE || o->lessee ||
+		    o->plane_type != plane_type || !(o->crtcs & crtc))
+			continue;
+		if (o->crtcs == crtc)
+			return o;
+		if (!best)
+			best = o;
+	}
+	return best;
+}
+
+/*
+ * Lease @connector_id with a free CRTC it can be routed to, and that CRTC's
+ * primary plane and cursor plane, if it has one.  Otherwise like
+ * drmModeLeaseManagerCreateLease(); -EBUSY if no CRTC or primary plane is
+ * left for the connector.
+ */
+drm_public int drmModeLeaseManagerLeaseConnector(drmModeLeaseManagerPtr mgr,
+						 uint32_t connector_id,
+						 int flags,
+						 uint32_t *lessee_id)
+{
+	struct drm_lease_object *connector, *o, *primary, *cursor;
+	uint32_t objects[4];
+	uint32_t count, i;
+	int ret = -EBUSY;
+
+	if (!mgr)
+		return -EINVAL;
+
+	connector = drm_lease_find(mgr, connector_id);
+	if (!connector || connector->type != DRM_MODE_OBJECT_CONNECTOR)
+		return -ENOENT;
+	if (connector->lessee)
+		return -EBUSY;
+
+	for (i = 0; i < mgr->count_objects; i++) {
+		o = &mgr->objects[i];
+		if (o->type != DRM_MODE_OBJECT_CRTC || o->lessee ||
+		    !(o->crtcs & connector->crtcs))
+			continue;
+
+		primary = drm_lease_pick_plane(mgr, o->crtcs,
+					       DRM_PLANE_TYPE_PRIMARY);
+		if (!primary)
+			continue;
+		cursor = drm_lease_pick_plane(mgr, o->crtcs,
+					      DRM_PLANE_TYPE_CURSOR);
+
+		count = 0;
+		objects[count++] = connector_id;
+		objects[count++] = o->id;
+		objects[count++] = primary->id;
+		if (cursor)
+			objects[count++] = cursor->id;
+
+		/* the next CRTC may still work if this one failed the test */
+		ret = drmModeLeaseManagerCreateLease(mgr, objects, count,
+						     flags, lessee_id);
+		if (ret >= 0 || (ret != -EINVAL && ret != -ERANGE))
+			return ret;
+	}
+
+	return ret;
+}
+
+static void drm_lease_release(drmModeLeaseManagerPtr mgr, uint32_t index)
+{
+	struct drm_lease *lease = &mgr->leases[index];
+	struct drm_lease_object *o;
+	uint32_t i;
+
+	for (i = 0; i < lease->count; i++) {
+		o = drm_lease_find(mgr, lease->objects[i]);
+		if (o)
+			o->lessee = 0;
+	}
+	free(lease->objects);
+	*lease = mgr->leases[--mgr->count_leases];
+}
+
+static int drm_lease_index(drmModeLeaseManagerPtr mgr, uint32_t lessee_id)
+{
+	uint32_t i;
+
+	for (i = 0; i < mgr->count_leases; i++)
+		if (mgr->leases[i].lessee_id == lessee_id)
+			return i;
+	return -1;
+}
+
+/*
+ * Revoke a lease made by the manager and return its objects to the pool.
+ * Returns 0, -ENOENT for a lessee the manager doesn't know, or the error of
+ * the revoke ioctl.
+ */
+drm_public int drmModeLeaseManagerRevoke(drmModeLeaseManagerPtr mgr,
+					 uint32_t lessee_id)
+{
+	int index, ret;
+
+	if (!mgr)
+		return -EINVAL;
+
+	index = drm_lease_index(mgr, lessee_id);
+	if (index < 0)
+		return -ENOENT;
+
+	/* already gone if the lessee closed its fd */
+	ret = drmModeRevokeLease(mgr->fd, lessee_id);
+	if (ret && ret != -ENOENT)
+		return ret;
+
+	drm_lease_release(mgr, index);
+	return 0;
+}
+
+/*
+ * Take back the objects of leases the kernel no longer has, because their
+ * lessees closed the lease fd.  Returns the number of leases reclaimed or
+ * -errno.
+ */
+drm_public int drmModeLeaseManagerReclaim(drmModeLeaseManagerPtr mgr)
+{
+	drmModeLesseeListPtr list;
+	uint32_t i, j;
+	int count = 0;
+
+	if (!mgr)
+		return -EINVAL;
+	if (!mgr->count_leases)
+		return 0;
+
+	list = drmModeListLessees(mgr->fd);
+	if (!list)
+		return -errno;
+
+	for (i = 0; i < mgr->count_leases; ) {
+		for (j = 0; j < list->count; j++)
+			if (list->lessees[j] == mgr->leases[i].lessee_id)
+				break;
+		if (j < list->count) {
+			i++;
+			continue;
+		}
+		drm_lease_release(mgr, i);
+		count++;
+	}
+	drmFree(list);
+
+	return count;
+}
+
+/* The lessee an object is leased to, 0 if it's free or unknown. */
+drm_public uint32_t drmModeLeaseManagerGetLessee(drmModeLeaseManagerPtr mgr,
+						 uint32_t object_id)
+{
+	struct drm_lease_object *o;
+
+	if (!mgr)
+		return 0;
+
+	o = drm_lease_find(mgr, object_id);
+	return o ? o->lessee : 0;
+}
@@ -0,0 +1,503 @@
+/* xf86drmModePlaneAlloc.c -- Hardware plane assignment for KMS layers
+ *
+ * Copyright © 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * DESCRIPTION
+ *
+ * Maps a stack of layers onto the hardware planes of one CRTC, using atomic
+ * TEST_ONLY commits as the oracle for what the hardware can do.
+ *
+ * 1) Everything that can be known without asking the kernel is checked up
+ * front: the plane must be usable on the CRTC and free, it must support the
+ * layer's format and modifier (from the plane's format list and IN_FORMATS
+ * blob), and it must be able to sit above the plane chosen for the layer
+ * below (from its zpos property, or primary < overlay < cursor without one).
+ *
+ * 2) Layers are placed bottom to top by depth-first search.  Each placement
+ * is tested together with the layers below it, so a prefix the hardware
+ * rejects prunes every assignment that extends it.  Backtracking only
+ * rewinds the request cursor, the prefix is never rebuilt.
+ *
+ * 3) Test results are memoized in a drmModeAtomicTestCache, so retesting a
+ * prefix while backtracking, or the same stack on the next frame, costs no
+ * ioctl.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libdrm_macros.h"
+#include "util_math.h"
+#include "xf86drm.h"
+#include "xf86drmMode.h"
+#include "drm_fourcc.h"
+
+/* Upper bound on test commits for one drmModePlaneAllocatorAssign(). */
+#define PLANE_ALLOC_MAX_TESTS 256
+
+/* zpos range assumed for planes without a zpos property. */
+#define PLANE_ALLOC_ZPOS_OVERLAY_MAX 0xffff
+
+struct drm_alloc_plane {
+	uint32_t plane_id;
+	uint32_t crtc_id;	/* CRTC the plane was last seen on */
+	int used;
+
+	drmModePlaneFormatsPtr formats;
+
+	uint64_t zpos_min, zpos_max;
+	int zpos_mutable;
+
+	uint32_t prop_fb_id, prop_crtc_id;
+	uint32_t prop_src_x, prop_src_y, prop_src_w, prop_src_h;
+	uint32_t prop_crtc_x, prop_crtc_y, prop_crtc_w, prop_crtc_h;
+	uint32_t prop_zpos;
+};
+
+struct _drmModePlaneAllocator {
+	int fd;
+	uint32_t crtc_id;
+	uint32_t crtc_mask;
+	drmModePropertyCachePtr props;
+	drmModeAtomicTestCachePtr tests;
+	uint32_t count_planes;
+	struct drm_alloc_plane *planes;	/* sorted by zpos_min */
+};
+
+struct drm_alloc_search {
+	drmModePlaneAllocatorPtr alloc;
+	drmModeAtomicReqPtr req;
+	drmModeLayerPtr layers;
+	uint32_t *order;
+	uint32_t count;
+	uint32_t flags;
+	uint32_t tests;
+};
+
+static uint32_t drm_alloc_prop(drmModePlaneAllocatorPtr alloc,
+			       uint32_t plane_id, const char *name)
+{
+	const drmModePropertyInfo *info;
+
+	info = drmModePropertyCacheLookup(alloc->props, plane_id,
+					  DRM_MODE_OBJECT_PLANE, name);
+	return info ? info->prop_id : 0;
+}
+
+static uint64_t drm_alloc_prop_value(drmModeObjectPropertiesPtr props,
+				     uint32_t prop_id, uint64_t def)
+{
+	uint32_t i;
+
+	for (i = 0; prop_id && i < props->count_props; i++)
+		if (props->props[i] == prop_id)
+			return props->prop_values[i];
+	return def;
+}
+
+static int drm_alloc_init_plane(drmModePlaneAllocatorPtr alloc,
+				struct drm_alloc_plane *plane,
+				drmModePlanePtr p)
+{
+	const drmModePropertyInfo *zpos;
+	drmModeObjectPropertiesPtr props;
+	uint32_t prop_type;
+	uint64_t type;
+
+	plane->plane_id = p->plane_id;
+	plane->crtc_id = p->crtc_id;
+	plane->formats = drmModeGetPlaneFormats(alloc->fd, p->plane_id);
+	if (!plane->formats)
+		return -errno;
+
+	plane->prop_fb_id = drm_alloc_prop(alloc, p->plane_id, "FB_ID");
+	plane->prop_crtc_id = drm_alloc_prop(alloc, p->plane_id, "CRTC_ID");
+	plane->prop_src_x = drm_alloc_prop(alloc, p->plane_id, "SRC_X");
+	plane->prop_src_y = drm_alloc_prop(alloc, p->plane_id, "SRC_Y");
+	plane->prop_src_w = drm_alloc_prop(alloc, p->plane_id, "SRC_W");
+	plane->prop_src_h = drm_alloc_prop(alloc, p->plane_id, "SRC_H");
+	plane->prop_crtc_x = drm_alloc_prop(alloc, p->plane_id, "CRTC_X");
+	plane->prop_crtc_y = drm_alloc_prop(alloc, p->plane_id, "CRTC_Y");
+	plane->prop_crtc_w = drm_alloc_prop(alloc, p->plane_id, "CRTC_W");
+	plane->prop_crtc_h = drm_alloc_prop(alloc, p->plane_id, "CRTC_H");
+	if (!plane->prop_fb_id || !plane->prop_crtc_id ||
+	    !plane->prop_src_x || !plane->prop_src_y ||
+	    !plane->prop_src_w || !plane->prop_src_h ||
+	    !plane->prop_crtc_x || !plane->prop_crtc_y ||
+	    !plane->prop_crtc_w || !plane->prop_crtc_h)
+		return -EINVAL;
+
+	props = drmModeObjectGetProperties(alloc->fd, p->plane_id,
+					   DRM_MODE_OBJECT_PLANE);
+	if (!props)
+		return -errno;
+
+	prop_type = drm_alloc_prop(alloc, p->plane_id, "type");
+	type = drm_alloc_prop_value(props, prop_type, DRM_PLANE_TYPE_OVERLAY);
+
+	zpos = drmModePropertyCacheLookup(alloc->props, p->plane_id,
+					  DRM_MODE_OBJECT_PLANE, "zpos");
+	if (zpos && (zpos->flags & DRM_MODE_PROP_RANGE)) {
+		plane->zpos_mutable = !(zpos->flags & DRM_MODE_PROP_IMMUTABLE);
+		if (plane->zpos_mutable) {
+			plane->prop_zpos = zpos->prop_id;
+			plane->zpos_min = zpos->min;
+			plane->zpos_max = zpos->max;
+		} else {
+			plane->zpos_min = plane->zpos_max =
+				drm_alloc_prop_value(props, zpos->prop_id, 0);
+		}
+	} else if (type == DRM_PLANE_TYPE_PRIMARY) {
+		plane->zpos_min = plane->zpos_max = 0;
+	} else if (type == DRM_PLANE_TYPE_CURSOR) {
+		plane->zpos_min = plane->zpos_max =
+			PLANE_ALLOC_ZPOS_OVERLAY_MAX + 1;
+	} else {
+		plane->zpos_min = 1;
+		plane->zpos_max = PLANE_ALLOC_ZPOS_OVERLAY_MAX;
+	}
+
+	drmModeFreeObjectProperties(props);
+	return 0;
+}
+
+static int drm_alloc_plane_cmp(const void *a, const void *b)
+{
+	const struct drm_alloc_plane *pa = a, *pb = b;
+
+	if (pa->zpos_min != pb->zpos_min)
+		return pa->zpos_min < pb->zpos_min ? -1 : 1;
+	return pa->plane_id < pb->plane_id ? -1 : pa->plane_id > pb->plane_id;
+}
+
+drm_public void drmModePlaneAllocatorDestroy(drmModePlaneAllocatorPtr alloc)
+{
+	uint32_t i;
+
+	if (!alloc)
+		return;
+
+	for (i = 0; i < alloc->count_planes; i++)
+		drmModeFreePlaneFormats(alloc->planes[i].formats);
+	drmFree(alloc->planes);
+	drmModeAtomicTestCacheDestroy(alloc->tests);
+	drmModePropertyCacheDestroy(alloc->props);
+	drmFree(alloc);
+}
+
+/*
+ * Create a plane allocator for one CRTC.  The caller must have enabled
+ * DRM_CLIENT_CAP_ATOMIC (which implies universal planes).  Returns NULL with
+ * errno set on failure.
+ */
+drm_public drmModePlaneAllocatorPtr
+drmModePlaneAllocatorCreate(int fd, uint32_t crtc_id)
+{
+	drmModePlaneAllocatorPtr alloc;
+	drmModePlaneResPtr plane_res = NULL;
+	drmModeResPtr res;
+	drmModePlanePtr p;
+	uint32_t i;
+	int ret = -ENOMEM;
+
+	res = drmModeGetResources(fd);
+	if (!res)
+		return NULL;
+
+	alloc = drmMalloc(sizeof(*alloc));
+	if (!alloc)
+		goto out;
+
+	alloc->fd = fd;
+	alloc->crtc_id = crtc_id;
+	for (i = 0; i < (uint32_t)res->count_crtcs; i++)
+		if (res->crtcs[i] == crtc_id)
+			alloc->crtc_mask = 1u << i;
+	if (!alloc->crtc_mask) {
+		ret = -ENOENT;
+		goto out;
+	}
+
+	alloc->props = drmModePropertyCacheCreate(fd);
+	alloc->tests = drmModeAtomicTestCacheCreate(fd, 0);
+	if (!alloc->props || !alloc->tests)
+		goto out;
+
+	plane_res = drmModeGetPlaneResources(fd);
+	if (!plane_res) {
+		ret = -errno;
+		goto out;
+	}
+
+	alloc->planes = drmMalloc(MAX2(plane_res->count_planes, 1) *
+				  sizeof(*alloc->planes));
+	if (!alloc->planes)
+		goto out;
+
+	for (i = 0; i < plane_res->count_planes; i++) {
+		p = drmModeGetPlane(fd, plane_res->planes[i]);
+		if (!p) {
+			ret = -errno;
+			goto out;
+		}
+		if (!(p->possible_crtcs & alloc->crtc_mask)) {
+			drmModeFreePlane(p);
+			continue;
+		}
+
+		ret = drm_alloc_init_plane(alloc,
+					   &alloc->planes[alloc->count_planes],
+					   p);
+		alloc->count_planes++;
+		drmModeFreePlane(p);
+		if (ret)
+			goto out;
+	}
+
+	qsort(alloc->planes, alloc->count_planes, sizeof(*alloc->planes),
+	      drm_alloc_plane_cmp);
+
+	drmModeFreePlaneResources(plane_res);
+	drmModeFreeResources(res);
+	return alloc;
+
+out:
+	drmModeFreePlaneResources(plane_res);
+	drmModeFreeResources(res);
+	drmModePlaneAllocatorDestroy(alloc);
+	errno = -ret;
+	return NULL;
+}
+
+/*
+ * Forget remembered test results and re-read which CRTC each plane is on.
+ * Needed after modesets and hotplug, and when framebuffers used in earlier
+ * assignments are destroyed.
+ */
+drm_public void drmModePlaneAllocatorInvalidate(drmModePlaneAllocatorPtr alloc)
+{
+	drmModePlanePtr p;
+	uint32_t i;
+
+	if (!alloc)
+		return;
+
+	drmModeAtomicTestCacheInvalidate(alloc->tests);
+
+	for (i = 0; i < alloc->count_planes; i++) {
+		p = drmModeGetPlane(alloc->fd, alloc->planes[i].plane_id);
+		if (p) {
+			alloc->planes[i].crtc_id = p->crtc_id;
+			drmModeFreePlane(p);
+		}
+	}
+}
+
+static int drm_alloc_add_layer(drmModeAtomicReqPtr req,
+			       const struct drm_alloc_plane *plane,
+			       uint32_t crtc_id, const drmModeLayer *layer,
+			       uint64_t zpos)
+{
+	uint32_t id = plane->plane_id;
+
+	if (drmModeAtomicAddProperty(req, id, plane->prop_fb_id,
+				     layer->fb_id) < 0 ||
+	    drmModeAtomicAddProperty(req, id, plane->prop_crtc_id,
+				     crtc_id) < 0 ||
+	    drmModeAtomicAddProperty(req, id, plane->prop_src_x,
+				     layer->src_x) < 0 ||
+	    drmModeAtomicAddProperty(req, id, plane->prop_src_y,
+				     layer->src_y) < 0 ||
+	    drmModeAtomicAddProperty(req, id, plane->prop_src_w,
+				     layer->src_w) < 0 ||
+	    drmModeAtomicAddProperty(req, id, plane->prop_src_h,
+				     layer->src_h) < 0 ||
+	    drmModeAtomicAddProperty(req, id, plane->prop_crtc_x,
+				     (uint64_t)(int64_t)layer->crtc_x) < 0 ||
+	    drmModeAtomicAddProperty(req, id, plane->prop_crtc_y,
+				     (uint64_t)(int64_t)layer->crtc_y) < 0 ||
+	    drmModeAtomicAddProperty(req, id, plane->prop_crtc_w,
+				     layer->crtc_w) < 0 ||
+	    drmModeAtomicAddProperty(req, id, plane->prop_crtc_h,
+				     layer->crtc_h) < 0)
+		return -ENOMEM;
+
+	if (plane->zpos_mutable &&
+	    drmModeAtomicAddProperty(req, id, plane->prop_zpos, zpos) < 0)
+		return -ENOMEM;
+
+	return 0;
+}
+
+static int drm_alloc_place(struct drm_alloc_search *s, uint32_t depth,
+			   uint64_t below)
+{
+	drmModePlaneAllocatorPtr alloc = s->alloc;
+	struct drm_alloc_plane *plane;
+	drmModeLayerPtr layer;
+	uint64_t zpos;
+	uint32_t i;
+	int cursor, ret;
+
+	if (depth == s->count)
+		return 0;
+
+	layer = &s->layers[s->order[depth]];
+
+	for (i = 0; i < alloc->count_planes; i++) {
+		plane = &alloc->planes[i];
+
+		if (plane->used ||
+		    (plane->crtc_id && plane->crtc_id != alloc->crtc_id) ||
+		    !drmModePlaneSupports(plane->formats, layer->format,
+					  layer->modifier))
+			continue;
+
+		zpos = depth ? MAX2(plane->zpos_min, below + 1) :
+			       plane->zpos_min;
+		if (zpos > plane->zpos_max)
+			continue;
+
+		if (s->tests++ >= PLANE_ALLOC_MAX_TESTS)
+			return -ENOSPC;
+
+		cursor = drmModeAtomicGetCursor(s->req);
+		ret = drm_alloc_add_layer(s->req, plane, alloc->crtc_id,
+					  layer, zpos);
+		if (ret == 0)
+			ret = drmModeAtomicCommitCached(alloc->tests, s->req,
+					s->flags | DRM_MODE_ATOMIC_TEST_ONLY,
+					NULL);
+		if (ret == 0) {
+			plane->used = 1;
+			layer->plane_id = plane->plane_id;
+			ret = drm_alloc_place(s, depth + 1, zpos);
+			if (ret == 0)
+				return 0;
+			plane->used = 0;
+			layer->plane_id = 0;
+		}
+
+		drmModeAtomicSetCursor(s->req, cursor);
+
+		/* Rejected configurations are expected, anything else is
+		 * a real error. */
+		if (ret != -EINVAL && ret != -ERANGE && ret != -ENOSPC)
+			return ret;
+		if (ret == -ENOSPC && s->tests >= PLANE_ALLOC_MAX_TESTS)
+			return ret;
+	}
+
+	return -ENOSPC;
+}
+
+/*
+ * Assign a plane to every layer and add the resulting plane state to req.
+ *
+ * Layers are stacked by ascending zpos (ties keep array order).  Planes of
+ * the CRTC that don't get a layer are disabled in req.  flags are extra
+ * atomic commit flags to test with, e.g. DRM_MODE_ATOMIC_ALLOW_MODESET, and
+ * req should already hold the rest of the state for the commit.
+ *
+ * On success each layer's plane_id is set and req is ready to commit.
+ * Returns -ENOSPC if no assignment was found (req is then unchanged), or
+ * another negative error code on failure.
+ */
+drm_public int drmModePlaneAllocatorAssign(drmModePlaneAllocatorPtr alloc,
+					   drmModeAtomicReqPtr req,
+					   drmModeLayerPtr layers,
+					   uint32_t count, uint32_t flags)
+{
+	struct drm_alloc_search s;
+	struct drm_alloc_plane *plane;
+	uint32_t i, j;
+	int cursor, ret;
+
+	if (!alloc || !req || (count && !layers))
+		return -EINVAL;
+
+	if (count > alloc->count_planes)
+		return -ENOSPC;
+
+	s.order = drmMalloc(MAX2(count, 1) * sizeof(*s.order));
+	if (!s.order)
+		return -ENOMEM;
+
+	/* Insertion sort, stable and fine for a handful of layers. */
+	for (i = 0; i < count; i++) {
+		layers[i].plane_id = 0;
+		for (j = i; j > 0 &&
+		     layers[s.order[j - 1]].zpos > layers[i].zpos; j--)
+			s.order[j] = s.order[j - 1];
+		s.order[j] = i;
+	}
+
+	cursor = drmModeAtomicGetCursor(req);
+
+	/* Start from all of our planes off; placed layers override this as
+	 * the last set of a property wins. */
+	for (i = 0; i < alloc->count_planes; i++) {
+		plane = &alloc->planes[i];
+		plane->used = 0;
+		if (plane->crtc_id != alloc->crtc_id)
+			continue;
+		if (drmModeAtomicAddProperty(req, plane->plane_id,
+					     plane->prop_fb_id, 0) < 0 ||
+		    drmModeAtomicAddProperty(req, plane->plane_id,
+					     plane->prop_crtc_id, 0) < 0) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	s.alloc = alloc;
+	s.req = req;
+	s.layers = layers;
+	s.count = count;
+	s.flags = flags & ~DRM_MODE_PAGE_FLIP_EVENT;
+	s.tests = 0;
+
+	ret = drm_alloc_place(&s, 0, 0);
+	if (ret == 0 && count == 0)
+		ret = drmModeAtomicCommitCached(alloc->tests, req,
+				s.flags | DRM_MODE_ATOMIC_TEST_ONLY, NULL);
+
+out:
+	if (ret) {
+		drmModeAtomicSetCursor(req, cursor);
+		for (i = 0; i < count; i++)
+			layers[i].plane_id = 0;
+	} else {
+		/* Assume the caller commits what we found. */
+		for (i = 0; i < alloc->count_planes; i++) {
+			plane = &alloc->planes[i];
+			if (plane->used)
+				plane->crtc_id = alloc->crtc_id;
+			else if (plane->crtc_id == alloc->crtc_id)
+				plane->crtc_id = 0;
+		}
+	}
+	drmFree(s.order);
+	return ret;
+}
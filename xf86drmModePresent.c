@@ -0,0 +1,676 @@
+/* xf86drmModePresent.c -- Vblank-paced page flip scheduling
+ *
+ * Copyright © 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * DESCRIPTION
+ *
+ * Presents framebuffers on a target vblank sequence instead of "as soon as
+ * possible".
+ *
+ * The vblank period and phase are estimated from the timestamps the kernel
+ * reports with CRTC sequence and page flip events, seeded from the CRTC's
+ * mode timings, so a client can map a presentation time to a sequence with
+ * drmModePresentQueueSequenceForTime().
+ *
+ * A flip for sequence N is issued from the sequence event for N - 1, so it
+ * latches on the following vblank.  When the flip completes, the sequence it
+ * actually landed on is reported back, together with how many vblanks late
+ * it was.
+ *
+ * On a connector with adaptive sync, drmModePresentQueueEnableVrr() sets
+ * the CRTC's VRR_ENABLED property and takes the refresh range from the
+ * EDID.  Presents made with drmModePresentQueuePresent() are then flipped
+ * as soon as their content is ready, and the vblank ends with the flip.
+ * When content runs slower than the lowest refresh rate, the panel would
+ * refresh on its own and delay the next flip by up to a frame; low framerate
+ * compensation instead flips the last framebuffer again at an integer
+ * fraction of the content's frame time, so real frames land on an idle
+ * scanout.  Those repeats are driven by drmModePresentQueueGetTimeout() and
+ * drmModePresentQueueDispatch().
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libdrm_macros.h"
+#include "xf86drm.h"
+#include "xf86drmMode.h"
+
+#define memclear(s) memset(&s, 0, sizeof(s))
+
+/* Presents that can be outstanding on one queue. */
+#define PRESENT_QUEUE_DEPTH 8
+
+/* Vblank timestamps kept for the period estimate. */
+#define PRESENT_QUEUE_SAMPLES 16
+
+/* A gap between presents longer than this isn't a frame time. */
+#define PRESENT_VRR_IDLE_NS 1000000000ll
+
+enum drm_present_state {
+	DRM_PRESENT_FREE,
+	DRM_PRESENT_WAIT_VBLANK,	/* sequence event for target - 1 queued */
+	DRM_PRESENT_READY,		/* waiting for the previous flip */
+	DRM_PRESENT_FLIPPING,		/* page flip submitted */
+};
+
+struct drm_present_entry {
+	enum drm_present_state state;
+	uint32_t fb_id;
+	uint64_t target;
+	void *user_data;
+};
+
+struct drm_present_sample {
+	uint64_t seq;
+	int64_t ns;
+};
+
+struct _drmModePresentQueue {
+	int fd;
+	uint32_t crtc_id;
+	drmModePresentHandler handler;
+
+	struct drm_present_sample samples[PRESENT_QUEUE_SAMPLES];
+	uint32_t count_samples;
+	uint32_t head;			/* index of the newest sample */
+	int64_t mode_period_ns;
+
+	struct drm_present_entry entries[PRESENT_QUEUE_DEPTH];
+	struct drm_present_entry *flipping;
+
+	/* adaptive sync */
+	uint32_t prop_vrr_enabled;
+	int vrr;
+	int64_t vrr_min_frame_ns;	/* at the highest refresh rate */
+	int64_t vrr_max_frame_ns;	/* at the lowest refresh rate */
+	int64_t content_ns;		/* frame time estimate, 0 if unknown */
+	int64_t last_present_ns;
+	uint32_t shown_fb_id;		/* last framebuffer flipped, or 0 */
+	int64_t shown_ns;
+	struct drm_present_entry repeat;	/* low framerate compensation */
+};
+
+static int64_t drm_present_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void drm_present_add_sample(drmModePresentQueuePtr queue,
+				   uint64_t seq, int64_t ns)
+{
+	struct drm_present_sample *newest = &queue->samples[queue->head];
+
+	/* An event can report a vblank we already know about. */
+	if (queue->count_samples && seq <= newest->seq)
+		return;
+
+	queue->head = (queue->head + 1) % PRESENT_QUEUE_SAMPLES;
+	queue->samples[queue->head].seq = seq;
+	queue->samples[queue->head].ns = ns;
+	if (queue->count_samples < PRESENT_QUEUE_SAMPLES)
+		queue->count_samples++;
+}
+
+/*
+ * Average period over the sample window.  Using the oldest and newest
+ * sample rather than consecutive ones keeps timestamp jitter from
+ * dominating, and tracks refresh-rate drift once the window turns over.
+ */
+static int64_t drm_present_period(drmModePresentQueuePtr queue)
+{
+	const struct drm_present_sample *newest, *oldest;
+	uint32_t tail;
+
+	if (queue->count_samples < 2)
+		return queue->mode_period_ns;
+
+	tail = (queue->head + PRESENT_QUEUE_SAMPLES + 1 -
+		queue->count_samples) % PRESENT_QUEUE_SAMPLES;
+	newest = &queue->samples[queue->head];
+	oldest = &queue->samples[tail];
+
+	return (newest->ns - oldest->ns) / (int64_t)(newest->seq - oldest->seq);
+}
+
+/* Widen a 32-bit page flip sequence using a nearby 64-bit one. */
+static uint64_t drm_present_widen(uint32_t seq, uint64_t near)
+{
+	uint64_t wide = (near & ~(uint64_t)0xffffffff) | seq;
+
+	if (wide > near && wide - near > 0x80000000ull && wide >= 0x100000000ull)
+		wide -= 0x100000000ull;
+	else if (wide < near && near - wide > 0x80000000ull)
+		wide += 0x100000000ull;
+	return wide;
+}
+
+static int drm_present_flip(drmModePresentQueuePtr queue,
+			    struct drm_present_entry *entry)
+{
+	drmModePresentFeedback feedback;
+	int ret;
+
+	ret = drmModePageFlip(queue->fd, queue->crtc_id, entry->fb_id,
+			      DRM_MODE_PAGE_FLIP_EVENT, entry);
+	if (ret == 0) {
+		entry->state = DRM_PRESENT_FLIPPING;
+		queue->flipping = entry;
+		return 0;
+	}
+
+	memclear(feedback);
+	feedback.target_seq = entry->target;
+	feedback.status = ret;
+	entry->state = DRM_PRESENT_FREE;
+	if (queue->handler && entry != &queue->repeat)
+		queue->handler(queue->fd, &feedback, entry->user_data);
+	return ret;
+}
+
+/* Flip the earliest present that became due while a flip was pending. */
+static void drm_present_flip_ready(drmModePresentQueuePtr queue)
+{
+	struct drm_present_entry *next;
+	uint32_t i;
+
+	while (!queue->flipping) {
+		next = NULL;
+		for (i = 0; i < PRESENT_QUEUE_DEPTH; i++) {
+			if (queue->entries[i].state == DRM_PRESENT_READY &&
+			    (!next || queue->entries[i].target < next->target))
+				next = &queue->entries[i];
+		}
+		if (!next)
+			return;
+		drm_present_flip(queue, next);
+	}
+}
+
+static struct drm_present_entry *
+drm_present_entry(drmModePresentQueuePtr queue, uintptr_t cookie)
+{
+	uintptr_t first = (uintptr_t)&queue->entries[0];
+	uintptr_t last = (uintptr_t)&queue->entries[PRESENT_QUEUE_DEPTH - 1];
+
+	if (cookie == (uintptr_t)&queue->repeat)
+		return &queue->repeat;
+	if (cookie < first || cookie > last ||
+	    (cookie - first) % sizeof(queue->entries[0]))
+		return NULL;
+	return (struct drm_present_entry *)cookie;
+}
+
+/*
+ * Create a present queue for one CRTC.  The CRTC should be active; the
+ * period estimate is seeded from its current mode.  Returns NULL with errno
+ * set on failure.
+ */
+drm_public drmModePresentQueuePtr
+drmModePresentQueueCreate(int fd, uint32_t crtc_id,
+			  drmModePresentHandler handler)
+{
+	drmModePresentQueuePtr queue;
+	drmModeCrtcPtr crtc;
+	uint64_t seq, ns;
+	int ret;
+
+	crtc = drmModeGetCrtc(fd, crtc_id);
+	if (!crtc)
+		return NULL;
+
+	queue = drmMalloc(sizeof(*queue));
+	if (!queue) {
+		drmModeFreeCrtc(crtc);
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	queue->fd = fd;
+	queue->crtc_id = crtc_id;
+	queue->handler = handler;
+	if (crtc->mode_valid && crtc->mode.clock)
+		queue->mode_period_ns = (int64_t)crtc->mode.htotal *
+					crtc->mode.vtotal * 1000000 /
+					crtc->mode.clock;
+	drmModeFreeCrtc(crtc);
+
+	ret = drmCrtcGetSequence(fd, crtc_id, &seq, &ns);
+	if (ret) {
+		ret = errno;
+		drmFree(queue);
+		errno = ret;
+		return NULL;
+	}
+	drm_present_add_sample(queue, seq, (int64_t)ns);
+
+	return queue;
+}
+
+/*
+ * Pending sequence and flip events still reference the queue, so it must be
+ * idle, or the fd closed, before it is destroyed.
+ */
+drm_public void drmModePresentQueueDestroy(drmModePresentQueuePtr queue)
+{
+	drmFree(queue);
+}
+
+/*
+ * Predict when vblank @seq starts, in CLOCK_MONOTONIC nanoseconds.  Returns
+ * 0, or -EAGAIN while there is no period estimate yet.
+ */
+drm_public int drmModePresentQueuePredict(drmModePresentQueuePtr queue,
+					  uint64_t seq, int64_t *ns)
+{
+	const struct drm_present_sample *newest = &queue->samples[queue->head];
+	int64_t period = drm_present_period(queue);
+
+	if (period <= 0)
+		return -EAGAIN;
+
+	*ns = newest->ns + ((int64_t)seq - (int64_t)newest->seq) * period;
+	return 0;
+}
+
+/*
+ * Find the first vblank that starts at or after @ns.  Returns 0, or -EAGAIN
+ * while there is no period estimate yet.
+ */
+drm_public int drmModePresentQueueSequenceForTime(drmModePresentQueuePtr queue,
+						  int64_t ns, uint64_t *seq)
+{
+	const struct drm_present_sample *newest = &queue->samples[queue->head];
+	int64_t period = drm_present_period(queue);
+	int64_t delta;
+
+	if (period <= 0)
+		return -EAGAIN;
+
+	delta = ns - newest->ns;
+	if (delta > 0)
+		*seq = newest->seq + (uint64_t)((delta + period - 1) / period);
+	else
+		*seq = newest->seq - (uint64_t)(-delta / period);
+	return 0;
+}
+
+/*
+ * Schedule @fb_id to be shown from vblank @target_seq on.  A target that
+ * has already passed is flipped as soon as possible and reported as missed.
+ * Returns 0, -EBUSY when the queue is full, or -errno from queueing the
+ * vblank event.
+ */
+drm_public int drmModePresentQueueSchedule(drmModePresentQueuePtr queue,
+					   uint32_t fb_id, uint64_t target_seq,
+					   void *user_data)
+{
+	struct drm_present_entry *entry = NULL;
+	uint32_t i;
+	int ret;
+
+	for (i = 0; i < PRESENT_QUEUE_DEPTH; i++) {
+		if (queue->entries[i].state == DRM_PRESENT_FREE) {
+			entry = &queue->entries[i];
+			break;
+		}
+	}
+	if (!entry)
+		return -EBUSY;
+
+	entry->fb_id = fb_id;
+	entry->target = target_seq;
+	entry->user_data = user_data;
+
+	/* The event fires right away if target - 1 has already passed. */
+	ret = drmCrtcQueueSequence(queue->fd, queue->crtc_id, 0,
+				   target_seq ? target_seq - 1 : 0, NULL,
+				   (uint64_t)(uintptr_t)entry);
+	if (ret)
+		return -errno;
+
+	entry->state = DRM_PRESENT_WAIT_VBLANK;
+	return 0;
+}
+
+/*
+ * Feed a CRTC sequence event to the queue; call this from the
+ * sequence_handler of the event context.  Returns 1 if the event belonged to
+ * the queue, 0 if it is the caller's own.
+ */
+drm_public int drmModePresentQueueSequenceEvent(drmModePresentQueuePtr queue,
+						uint64_t sequence, uint64_t ns,
+						uint64_t user_data)
+{
+	struct drm_present_entry *entry;
+
+	entry = drm_present_entry(queue, (uintptr_t)user_data);
+	if (!entry || entry->state != DRM_PRESENT_WAIT_VBLANK)
+		return 0;
+
+	drm_present_add_sample(queue, sequence, (int64_t)ns);
+
+	entry->state = DRM_PRESENT_READY;
+	drm_present_flip_ready(queue);
+	return 1;
+}
+
+/*
+ * Feed a page flip event to the queue; call this from the page_flip_handler
+ * of the event context.  Returns 1 if the event belonged to the queue, 0 if
+ * it is the caller's own.
+ */
+drm_public int drmModePresentQueueFlipEvent(drmModePresentQueuePtr queue,
+					    unsigned int sequence,
+					    unsigned int tv_sec,
+					    unsigned int tv_usec,
+					    void *user_data)
+{
+	struct drm_present_entry *entry;
+	drmModePresentFeedback feedback;
+
+	entry = drm_present_entry(queue, (uintptr_t)user_data);
+	if (!entry || entry != queue->flipping)
+		return 0;
+
+	memclear(feedback);
+	feedback.target_seq = entry->target;
+	feedback.seq = drm_present_widen(sequence, entry->target);
+	feedback.ns = (uint64_t)tv_sec * 1000000000 + (uint64_t)tv_usec * 1000;
+	if (feedback.seq > entry->target)
+		feedback.missed = feedback.seq - entry->target;
+
+	drm_present_add_sample(queue, feedback.seq, (int64_t)feedback.ns);
+
+	entry->state = DRM_PRESENT_FREE;
+	queue->flipping = NULL;
+	queue->shown_fb_id = entry->fb_id;
+	queue->shown_ns = (int64_t)feedback.ns;
+	if (queue->handler && entry != &queue->repeat)
+		queue->handler(queue->fd, &feedback, entry->user_data);
+
+	drm_present_flip_ready(queue);
+	return 1;
+}
+
+static int drm_present_get_prop(int fd, uint32_t object_id,
+				uint32_t object_type, const char *name,
+				uint32_t *prop_id, uint64_t *value)
+{
+	drmModeObjectPropertiesPtr props;
+	drmModePropertyPtr prop;
+	uint32_t i;
+	int ret = -ENOENT;
+
+	props = drmModeObjectGetProperties(fd, object_id, object_type);
+	if (!props)
+		return -errno;
+
+	for (i = 0; i < props->count_props && ret; i++) {
+		prop = drmModeGetProperty(fd, props->props[i]);
+		if (!prop)
+			continue;
+		if (!strcmp(prop->name, name)) {
+			if (prop_id)
+				*prop_id = prop->prop_id;
+			if (value)
+				*value = props->prop_values[i];
+			ret = 0;
+		}
+		drmModeFreeProperty(prop);
+	}
+	drmModeFreeObjectProperties(props);
+
+	return ret;
+}
+
+static int drm_present_vrr_range(drmModePresentQueuePtr queue,
+				 uint32_t connector_id)
+{
+	drmModePropertyBlobPtr blob;
+	drmModeEdidPtr edid;
+	uint64_t value;
+	int ret;
+
+	ret = drm_present_get_prop(queue->fd, connector_id,
+				   DRM_MODE_OBJECT_CONNECTOR, "vrr_capable",
+				   NULL, &value);
+	if (ret == -ENOENT || (ret == 0 && !value))
+		return -ENOTSUP;
+	if (ret)
+		return ret;
+
+	ret = drm_present_get_prop(queue->fd, connector_id,
+				   DRM_MODE_OBJECT_CONNECTOR, "EDID",
+				   NULL, &value);
+	if (ret)
+		return ret == -ENOENT ? -ENOTSUP : ret;
+
+	blob = drmModeGetPropertyBlob(queue->fd, value);
+	if (!blob)
+		return -errno;
+	edid = drmModeEdidParse(blob->data, blob->length);
+	drmModeFreePropertyBlob(blob);
+	if (!edid)
+		return -ENOTSUP;
+
+	if (edid->min_vrefresh && edid->max_vrefresh > edid->min_vrefresh) {
+		queue->vrr_min_frame_ns = 1000000000ll / edid->max_vrefresh;
+		queue->vrr_max_frame_ns = 1000000000ll / edid->min_vrefresh;
+		ret = 0;
+	} else {
+		ret = -ENOTSUP;
+	}
+	drmModeFreeEdid(edid);
+
+	/* the current mode's refresh rate is the highest VRR can reach */
+	if (queue->vrr_min_frame_ns < queue->mode_period_ns)
+		queue->vrr_min_frame_ns = queue->mode_period_ns;
+
+	return ret;
+}
+
+/*
+ * Turn on adaptive sync for the queue's CRTC, driving @connector_id.  Needs
+ * the connector's vrr_capable property set and a refresh range in its
+ * EDID.  Returns 0, -ENOTSUP if VRR can't be used, or -errno from setting
+ * VRR_ENABLED.
+ */
+drm_public int drmModePresentQueueEnableVrr(drmModePresentQueuePtr queue,
+					    uint32_t connector_id)
+{
+	int ret;
+
+	if (!queue)
+		return -EINVAL;
+
+	ret = drm_present_get_prop(queue->fd, queue->crtc_id,
+				   DRM_MODE_OBJECT_CRTC, "VRR_ENABLED",
+				   &queue->prop_vrr_enabled, NULL);
+	if (ret)
+		return ret == -ENOENT ? -ENOTSUP : ret;
+
+	ret = drm_present_vrr_range(queue, connector_id);
+	if (ret)
+		return ret;
+
+	if (drmModeObjectSetProperty(queue->fd, queue->crtc_id,
+				     DRM_MODE_OBJECT_CRTC,
+				     queue->prop_vrr_enabled, 1))
+		return -errno;
+
+	queue->vrr = 1;
+	queue->content_ns = 0;
+	queue->last_present_ns = 0;
+	return 0;
+}
+
+/* Go back to a fixed refresh rate.  Returns 0 or -errno. */
+drm_public int drmModePresentQueueDisableVrr(drmModePresentQueuePtr queue)
+{
+	if (!queue)
+		return -EINVAL;
+	if (!queue->vrr)
+		return 0;
+
+	if (drmModeObjectSetProperty(queue->fd, queue->crtc_id,
+				     DRM_MODE_OBJECT_CRTC,
+				     queue->prop_vrr_enabled, 0))
+		return -errno;
+
+	queue->vrr = 0;
+	return 0;
+}
+
+/*
+ * Flip @fb_id as soon as the flip before it completed, without waiting for
+ * a vblank sequence.  With VRR on, this is the low-latency path: the flip
+ * ends the current refresh.  Returns 0, or -EBUSY when the queue is full.
+ */
+drm_public int drmModePresentQueuePresent(drmModePresentQueuePtr queue,
+					  uint32_t fb_id, void *user_data)
+{
+	struct drm_present_entry *entry = NULL;
+	int64_t now, interval;
+	uint32_t i;
+
+	if (!queue)
+		return -EINVAL;
+
+	for (i = 0; i < PRESENT_QUEUE_DEPTH; i++) {
+		if (queue->entries[i].state == DRM_PRESENT_FREE) {
+			entry = &queue->entries[i];
+			break;
+		}
+	}
+	if (!entry)
+		return -EBUSY;
+
+	/* the frame time low framerate compensation works with */
+	now = drm_present_now();
+	interval = now - queue->last_present_ns;
+	if (!queue->last_present_ns || interval > PRESENT_VRR_IDLE_NS)
+		queue->content_ns = 0;
+	else if (!queue->content_ns)
+		queue->content_ns = interval;
+	else
+		queue->content_ns = (3 * queue->content_ns + interval) / 4;
+	queue->last_present_ns = now;
+
+	entry->fb_id = fb_id;
+	entry->target = queue->samples[queue->head].seq + 1;
+	entry->user_data = user_data;
+	entry->state = DRM_PRESENT_READY;
+
+	drm_present_flip_ready(queue);
+	return 0;
+}
+
+/*
+ * When the last framebuffer is due to be shown again, 0 if no repeat is
+ * needed: content slower than the VRR range is split into the fewest whole
+ * refreshes within it.
+ */
+static int64_t drm_present_repeat_deadline(drmModePresentQueuePtr queue)
+{
+	int64_t content = queue->content_ns;
+	int64_t count;
+
+	if (!queue->vrr || !queue->shown_fb_id || queue->flipping ||
+	    content <= queue->vrr_max_frame_ns ||
+	    queue->shown_ns - queue->last_present_ns > PRESENT_VRR_IDLE_NS)
+		return 0;
+
+	count = (content + queue->vrr_max_frame_ns - 1) /
+		queue->vrr_max_frame_ns;
+	if (content / count < queue->vrr_min_frame_ns)
+		count = content / queue->vrr_min_frame_ns;
+	if (count < 2)
+		return 0;
+
+	return queue->shown_ns + content / count;
+}
+
+/*
+ * Milliseconds until drmModePresentQueueDispatch() has a repeat flip to
+ * make, for poll(), or -1 if none is due.
+ */
+drm_public int drmModePresentQueueGetTimeout(drmModePresentQueuePtr queue)
+{
+	int64_t deadline, left;
+
+	if (!queue)
+		return -1;
+
+	deadline = drm_present_repeat_deadline(queue);
+	if (!deadline)
+		return -1;
+
+	left = deadline - drm_present_now();
+	if (left <= 0)
+		return 0;
+	return (int)((left + 999999) / 1000000);
+}
+
+/*
+ * Flip the last framebuffer again if low framerate compensation calls for
+ * it.  Repeats aren't reported to the handler.  Returns 1 if a repeat was
+ * submitted, 0 if nothing was due, or -errno.
+ */
+drm_public int drmModePresentQueueDispatch(drmModePresentQueuePtr queue)
+{
+	struct drm_present_entry *repeat;
+	int64_t deadline;
+	uint32_t i;
+	int ret;
+
+	if (!queue)
+		return -EINVAL;
+
+	deadline = drm_present_repeat_deadline(queue);
+	if (!deadline || deadline > drm_present_now())
+		return 0;
+
+	/* a real frame is on its way */
+	for (i = 0; i < PRESENT_QUEUE_DEPTH; i++)
+		if (queue->entries[i].state == DRM_PRESENT_READY)
+			return 0;
+
+	repeat = &queue->repeat;
+	repeat->fb_id = queue->shown_fb_id;
+	repeat->target = queue->samples[queue->head].seq + 1;
+	repeat->user_data = NULL;
+
+	ret = drm_present_flip(queue, repeat);
+	if (ret) {
+		queue->shown_fb_id = 0;
+		return ret;
+	}
+	return 1;
+}
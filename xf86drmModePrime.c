@@ -0,0 +1,335 @@
+/* xf86drmModePrime.c -- Scanout of buffers rendered on another device
+ *
+ * Copyright © 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * DESCRIPTION
+ *
+ * PRIME offload: buffers are rendered on one device and scanned out by the
+ * plane of another.  Getting a render buffer on screen takes an export on
+ * the render device, an import on the display device and an AddFB2 there.
+ * drmModePrimeScanout does all three once per buffer and keeps the dma-buf
+ * fd, the imported handle and the fb id, keyed by the render handle, so a
+ * swapchain that cycles through the same buffers only pays for its atomic
+ * commits.
+ *
+ * drmModePrimeScanoutNegotiate() picks the modifier to render with from the
+ * ones the render device can produce and the plane's IN_FORMATS.  When they
+ * share none the frame has to be copied into a linear buffer, which every
+ * display that can import at all takes.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libdrm_macros.h"
+#include "xf86drm.h"
+#include "xf86drmMode.h"
+#include "drm_fourcc.h"
+
+#define memclear(s) memset(&s, 0, sizeof(s))
+
+struct drm_prime_buffer {
+	uint32_t handle;		/* on the render device */
+	int prime_fd;
+	uint32_t display_handle;
+	uint32_t fb_id;
+
+	/* layout the fb was created with */
+	uint32_t width, height;
+	uint32_t format;
+	uint64_t modifier;
+	uint32_t pitches[4];
+	uint32_t offsets[4];
+};
+
+struct _drmModePrimeScanout {
+	int render_fd;
+	int display_fd;
+	uint32_t plane_id;
+
+	drmModePlaneFormatsPtr formats;
+
+	void *buffers;			/* render handle -> drm_prime_buffer */
+};
+
+static void drm_prime_release_fb(drmModePrimeScanoutPtr scanout,
+				 struct drm_prime_buffer *buf)
+{
+	if (buf->fb_id)
+		drmModeRmFB(scanout->display_fd, buf->fb_id);
+	buf->fb_id = 0;
+}
+
+static void drm_prime_free_buffer(drmModePrimeScanoutPtr scanout,
+				  struct drm_prime_buffer *buf)
+{
+	struct drm_gem_close req;
+
+	drm_prime_release_fb(scanout, buf);
+	if (buf->display_handle) {
+		memclear(req);
+		req.handle = buf->display_handle;
+		drmIoctl(scanout->display_fd, DRM_IOCTL_GEM_CLOSE, &req);
+	}
+	if (buf->prime_fd >= 0)
+		close(buf->prime_fd);
+	drmFree(buf);
+}
+
+/*
+ * Pair @render_fd, where buffers are rendered, with @plane_id of
+ * @display_fd, where they are scanned out.  The render device has to
+ * export dma-bufs and the display device import them.  Returns NULL with
+ * errno set on failure.
+ */
+drm_public drmModePrimeScanoutPtr
+drmModePrimeScanoutCreate(int render_fd, int display_fd, uint32_t plane_id)
+{
+	drmModePrimeScanoutPtr scanout;
+	uint64_t cap;
+	int ret;
+
+	if (drmGetCap(render_fd, DRM_CAP_PRIME, &cap) ||
+	    !(cap & DRM_PRIME_CAP_EXPORT) ||
+	    drmGetCap(display_fd, DRM_CAP_PRIME, &cap) ||
+	    !(cap & DRM_PRIME_CAP_IMPORT)) {
+		errno = EOPNOTSUPP;
+		return NULL;
+	}
+
+	scanout = drmMalloc(sizeof(*scanout));
+	if (!scanout) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	scanout->render_fd = render_fd;
+	scanout->display_fd = display_fd;
+	scanout->plane_id = plane_id;
+
+	scanout->formats = drmModeGetPlaneFormats(display_fd, plane_id);
+	if (!scanout->formats) {
+		ret = -errno;
+		goto out;
+	}
+
+	scanout->buffers = drmHashCreate();
+	if (!scanout->buffers) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	return scanout;
+
+out:
+	drmModeFreePlaneFormats(scanout->formats);
+	drmFree(scanout);
+	errno = -ret;
+	return NULL;
+}
+
+/* Removes the fbs, closes the imports and the dma-bufs of all buffers. */
+drm_public void drmModePrimeScanoutDestroy(drmModePrimeScanoutPtr scanout)
+{
+	unsigned long key;
+	void *value;
+
+	if (!scanout)
+		return;
+
+	while (drmHashFirst(scanout->buffers, &key, &value) == 1) {
+		drmHashDelete(scanout->buffers, key);
+		drm_prime_free_buffer(scanout, value);
+	}
+	drmHashDestroy(scanout->buffers);
+	drmModeFreePlaneFormats(scanout->formats);
+	drmFree(scanout);
+}
+
+/*
+ * Pick the modifier to render @format with.  @modifiers are the ones the
+ * render device can produce, in order of preference.  Returns
+ * DRM_MODE_PRIME_SCANOUT_DIRECT with the first of them the plane takes, or
+ * DRM_MODE_PRIME_SCANOUT_COPY with DRM_FORMAT_MOD_LINEAR if the plane takes
+ * none of them and frames have to be copied into a linear buffer before
+ * they are handed to drmModePrimeScanoutGetFB().  Returns -EINVAL if the
+ * plane cannot show @format from another device at all.
+ */
+drm_public int drmModePrimeScanoutNegotiate(drmModePrimeScanoutPtr scanout,
+					    uint32_t format,
+					    const uint64_t *modifiers,
+					    uint32_t count, uint64_t *modifier)
+{
+	uint32_t i;
+
+	if (!scanout || (count && !modifiers) || !modifier)
+		return -EINVAL;
+
+	for (i = 0; i < count; i++) {
+		if (modifiers[i] != DRM_FORMAT_MOD_INVALID &&
+		    drmModePlaneSupports(scanout->formats, format,
+					 modifiers[i])) {
+			*modifier = modifiers[i];
+			return DRM_MODE_PRIME_SCANOUT_DIRECT;
+		}
+	}
+
+	if (drmModePlaneSupports(scanout->formats, format,
+				 DRM_FORMAT_MOD_LINEAR)) {
+		*modifier = DRM_FORMAT_MOD_LINEAR;
+		return DRM_MODE_PRIME_SCANOUT_COPY;
+	}
+	return -EINVAL;
+}
+
+/*
+ * Return in @fb_id a framebuffer of the display device showing render
+ * buffer @handle, all of whose planes live in that one buffer.  The first
+ * call for a buffer exports and imports it, later ones with the same
+ * layout return the same fb; a changed layout replaces the fb but keeps the
+ * import.  The fb stays valid until drmModePrimeScanoutForget() of @handle.
+ */
+drm_public int drmModePrimeScanoutGetFB(drmModePrimeScanoutPtr scanout,
+					uint32_t handle, uint32_t width,
+					uint32_t height, uint32_t format,
+					uint64_t modifier,
+					const uint32_t pitches[4],
+					const uint32_t offsets[4],
+					uint32_t *fb_id)
+{
+	struct drm_prime_buffer *buf;
+	uint32_t handles[4] = { 0 };
+	uint64_t modifiers[4] = { 0 };
+	uint32_t i, flags = 0;
+	void *value;
+	int ret;
+
+	if (!scanout || !handle || !pitches || !offsets || !fb_id)
+		return -EINVAL;
+
+	if (drmHashLookup(scanout->buffers, handle, &value) == 0) {
+		buf = value;
+		if (buf->fb_id && buf->width == width &&
+		    buf->height == height && buf->format == format &&
+		    buf->modifier == modifier &&
+		    !memcmp(buf->pitches, pitches, sizeof(buf->pitches)) &&
+		    !memcmp(buf->offsets, offsets, sizeof(buf->offsets))) {
+			*fb_id = buf->fb_id;
+			return 0;
+		}
+		drm_prime_release_fb(scanout, buf);
+	} else {
+		buf = drmMalloc(sizeof(*buf));
+		if (!buf)
+			return -ENOMEM;
+		buf->handle = handle;
+		buf->prime_fd = -1;
+
+		ret = drmPrimeHandleToFD(scanout->render_fd, handle,
+					 DRM_CLOEXEC, &buf->prime_fd);
+		if (ret) {
+			ret = -errno;
+			buf->prime_fd = -1;
+			drm_prime_free_buffer(scanout, buf);
+			return ret;
+		}
+		ret = drmPrimeFDToHandle(scanout->display_fd, buf->prime_fd,
+					 &buf->display_handle);
+		if (ret) {
+			ret = -errno;
+			buf->display_handle = 0;
+			drm_prime_free_buffer(scanout, buf);
+			return ret;
+		}
+		if (drmHashInsert(scanout->buffers, handle, buf)) {
+			drm_prime_free_buffer(scanout, buf);
+			return -ENOMEM;
+		}
+	}
+
+	for (i = 0; i < 4; i++) {
+		if (!pitches[i])
+			continue;
+		handles[i] = buf->display_handle;
+		modifiers[i] = modifier;
+	}
+	if (modifier != DRM_FORMAT_MOD_INVALID)
+		flags = DRM_MODE_FB_MODIFIERS;
+
+	ret = drmModeAddFB2WithModifiers(scanout->display_fd, width, height,
+					 format, handles, pitches, offsets,
+					 flags ? modifiers : NULL,
+					 &buf->fb_id, flags);
+	if (ret) {
+		ret = -errno;
+		buf->fb_id = 0;
+		return ret;
+	}
+
+	buf->width = width;
+	buf->height = height;
+	buf->format = format;
+	buf->modifier = modifier;
+	memcpy(buf->pitches, pitches, sizeof(buf->pitches));
+	memcpy(buf->offsets, offsets, sizeof(buf->offsets));
+	*fb_id = buf->fb_id;
+	return 0;
+}
+
+/*
+ * The dma-buf render buffer @handle was exported as, or -1 before its
+ * first drmModePrimeScanoutGetFB().  Owned by @scanout; dup() it to keep it
+ * past drmModePrimeScanoutForget().
+ */
+drm_public int drmModePrimeScanoutGetFd(drmModePrimeScanoutPtr scanout,
+					uint32_t handle)
+{
+	void *value;
+
+	if (!scanout || drmHashLookup(scanout->buffers, handle, &value))
+		return -1;
+	return ((struct drm_prime_buffer *)value)->prime_fd;
+}
+
+/*
+ * Drop everything cached for render buffer @handle, before it is freed.
+ * Its fb must no longer be on screen, removing it would disable the plane.
+ * Returns 0, or -ENOENT if nothing was cached for @handle.
+ */
+drm_public int drmModePrimeScanoutForget(drmModePrimeScanoutPtr scanout,
+					 uint32_t handle)
+{
+	void *value;
+
+	if (!scanout)
+		return -EINVAL;
+	if (drmHashLookup(scanout->buffers, handle, &value))
+		return -ENOENT;
+
+	drmHashDelete(scanout->buffers, handle);
+	drm_prime_free_buffer(scanout, value);
+	return 0;
+}
@@ -0,0 +1,373 @@
+/* xf86drmModeProbe.c -- Connector probing on a worker thread
+ *
+ * Copyright © 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * DESCRIPTION
+ *
+ * Runs the forced probes of drmModeGetConnector(), which read the EDID over
+ * DDC, on a worker thread so the thread driving the display never waits
+ * for them.
+ *
+ * The kernel holds the same lock for a probe and for reading a connector
+ * without one, so drmModeGetConnectorCurrent() would wait for a probe in
+ * flight too.  The prober therefore keeps a copy of every connector, read
+ * once at creation, which drmModeProberGetConnector() returns without an
+ * ioctl.  Probe results are handed back on the caller's thread: the fd from
+ * drmModeProberGetFd() becomes readable, to be polled next to the fd of the
+ * drmEventLoop, and drmModeProberDispatch() replaces the copies and calls
+ * the handler.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libdrm_macros.h"
+#include "xf86drm.h"
+#include "xf86drmMode.h"
+
+struct drm_probe_connector {
+	uint32_t connector_id;
+	drmModeConnectorPtr current;	/* caller's thread only */
+
+	/* under the prober's lock: */
+	int queued;
+	int probing;
+	int has_result;
+	drmModeConnectorPtr result;
+	int status;
+};
+
+struct _drmModeProber {
+	int fd;
+	drmModeProbeHandler handler;
+	void *user_data;
+	int notify[2];			/* pipe, read end for the caller */
+	pthread_t thread;
+
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int quit;
+	uint32_t count_connectors;
+	uint32_t size_connectors;
+	struct drm_probe_connector *connectors;
+};
+
+static struct drm_probe_connector *
+drm_probe_find(drmModeProberPtr prober, uint32_t connector_id)
+{
+	uint32_t i;
+
+	for (i = 0; i < prober->count_connectors; i++)
+		if (prober->connectors[i].connector_id == connector_id)
+			return &prober->connectors[i];
+	return NULL;
+}
+
+/* Called with the lock held. */
+static struct drm_probe_connector *
+drm_probe_add(drmModeProberPtr prober, uint32_t connector_id)
+{
+	struct drm_probe_connector *connectors;
+	uint32_t size;
+
+	if (prober->count_connectors == prober->size_connectors) {
+		size = prober->size_connectors ? prober->size_connectors * 2 : 8;
+		connectors = realloc(prober->connectors,
+				     size * sizeof(*connectors));
+		if (!connectors)
+			return NULL;
+		prober->connectors = connectors;
+		prober->size_connectors = size;
+	}
+
+	connectors = &prober->connectors[prober->count_connectors++];
+	memset(connectors, 0, sizeof(*connectors));
+	connectors->connector_id = connector_id;
+	return connectors;
+}
+
+static void *drm_probe_thread(void *data)
+{
+	drmModeProberPtr prober = data;
+	struct drm_probe_connector *c;
+	drmModeConnectorPtr connector;
+	uint32_t i, connector_id;
+	char byte = 0;
+	int status;
+
+	pthread_mutex_lock(&prober->lock);
+	while (!prober->quit) {
+		for (i = 0; i < prober->count_connectors; i++)
+			if (prober->connectors[i].queued &&
+			    !prober->connectors[i].probing)
+				break;
+		if (i == prober->count_connectors) {
+			pthread_cond_wait(&prober->cond, &prober->lock);
+			continue;
+		}
+
+		c = &prober->connectors[i];
+		c->queued = 0;
+		c->probing = 1;
+		connector_id = c->connector_id;
+		pthread_mutex_unlock(&prober->lock);
+
+		connector = drmModeGetConnector(prober->fd, connector_id);
+		status = connector ? 0 : -errno;
+
+		/* the array may have been reallocated meanwhile */
+		pthread_mutex_lock(&prober->lock);
+		c = drm_probe_find(prober, connector_id);
+		c->probing = 0;
+		if (c->has_result)
+			drmModeFreeConnector(c->result);
+		c->result = connector;
+		c->status = status;
+		c->has_result = 1;
+
+		/* a full pipe wakes up the caller just as well */
+		if (write(prober->notify[1], &byte, 1) < 0)
+			continue;
+	}
+	pthread_mutex_unlock(&prober->lock);
+
+	return NULL;
+}
+
+static int drm_probe_pipe(int notify[2])
+{
+	int i;
+
+	if (pipe(notify))
+		return -errno;
+
+	for (i = 0; i < 2; i++) {
+		if (fcntl(notify[i], F_SETFD, FD_CLOEXEC) ||
+		    fcntl(notify[i], F_SETFL, O_NONBLOCK)) {
+			close(notify[0]);
+			close(notify[1]);
+			return -errno;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Create a prober for the connectors of @fd, reading each of them once
+ * without a probe.  Returns NULL with errno set on failure.
+ */
+drm_public drmModeProberPtr drmModeProberCreate(int fd,
+						drmModeProbeHandler handler,
+						void *user_data)
+{
+	drmModeProberPtr prober;
+	struct drm_probe_connector *c;
+	drmModeResPtr res;
+	int i, ret = -ENOMEM;
+
+	res = drmModeGetResources(fd);
+	if (!res)
+		return NULL;
+
+	prober = drmMalloc(sizeof(*prober));
+	if (!prober)
+		goto out_res;
+
+	prober->fd = fd;
+	prober->handler = handler;
+	prober->user_data = user_data;
+
+	for (i = 0; i < res->count_connectors; i++) {
+		c = drm_probe_add(prober, res->connectors[i]);
+		if (!c)
+			goto out;
+		c->current = drmModeGetConnectorCurrent(fd, c->connector_id);
+	}
+
+	ret = drm_probe_pipe(prober->notify);
+	if (ret)
+		goto out;
+
+	pthread_mutex_init(&prober->lock, NULL);
+	pthread_cond_init(&prober->cond, NULL);
+	ret = -pthread_create(&prober->thread, NULL, drm_probe_thread, prober);
+	if (ret) {
+		pthread_cond_destroy(&prober->cond);
+		pthread_mutex_destroy(&prober->lock);
+		close(prober->notify[0]);
+		close(prober->notify[1]);
+		goto out;
+	}
+
+	drmModeFreeResources(res);
+	return prober;
+
+out:
+	for (i = 0; i < (int)prober->count_connectors; i++)
+		drmModeFreeConnector(prober->connectors[i].current);
+	free(prober->connectors);
+	drmFree(prober);
+out_res:
+	drmModeFreeResources(res);
+	errno = -ret;
+	return NULL;
+}
+
+/* Waits for a probe in flight; results not dispatched yet are dropped. */
+drm_public void drmModeProberDestroy(drmModeProberPtr prober)
+{
+	uint32_t i;
+
+	if (!prober)
+		return;
+
+	pthread_mutex_lock(&prober->lock);
+	prober->quit = 1;
+	pthread_cond_signal(&prober->cond);
+	pthread_mutex_unlock(&prober->lock);
+	pthread_join(prober->thread, NULL);
+
+	for (i = 0; i < prober->count_connectors; i++) {
+		drmModeFreeConnector(prober->connectors[i].current);
+		if (prober->connectors[i].has_result)
+			drmModeFreeConnector(prober->connectors[i].result);
+	}
+	free(prober->connectors);
+	pthread_cond_destroy(&prober->cond);
+	pthread_mutex_destroy(&prober->lock);
+	close(prober->notify[0]);
+	close(prober->notify[1]);
+	drmFree(prober);
+}
+
+/*
+ * The last known state of a connector, owned by the prober and valid until
+ * the next drmModeProberDispatch(), or NULL.  Costs no ioctl.
+ */
+drm_public drmModeConnectorPtr
+drmModeProberGetConnector(drmModeProberPtr prober, uint32_t connector_id)
+{
+	struct drm_probe_connector *c;
+	drmModeConnectorPtr current;
+
+	if (!prober)
+		return NULL;
+
+	pthread_mutex_lock(&prober->lock);
+	c = drm_probe_find(prober, connector_id);
+	current = c ? c->current : NULL;
+	pthread_mutex_unlock(&prober->lock);
+	return current;
+}
+
+/*
+ * Queue forced probes of @count connectors, which may include ones the
+ * prober doesn't know yet, e.g. new MST connectors.  A connector already
+ * queued is probed once.  Returns 0 or -ENOMEM.
+ */
+drm_public int drmModeProberQueue(drmModeProberPtr prober,
+				  const uint32_t *connector_ids,
+				  uint32_t count)
+{
+	struct drm_probe_connector *c;
+	uint32_t i;
+	int ret = 0;
+
+	if (!prober || (count && !connector_ids))
+		return -EINVAL;
+
+	pthread_mutex_lock(&prober->lock);
+	for (i = 0; i < count; i++) {
+		c = drm_probe_find(prober, connector_ids[i]);
+		if (!c)
+			c = drm_probe_add(prober, connector_ids[i]);
+		if (!c) {
+			ret = -ENOMEM;
+			break;
+		}
+		c->queued = 1;
+	}
+	pthread_cond_signal(&prober->cond);
+	pthread_mutex_unlock(&prober->lock);
+
+	return ret;
+}
+
+/* Becomes readable when probe results are ready for dispatch. */
+drm_public int drmModeProberGetFd(drmModeProberPtr prober)
+{
+	return prober ? prober->notify[0] : -1;
+}
+
+/*
+ * Hand finished probes to the handler, without blocking.  A successful
+ * probe replaces the prober's copy of the connector first; the handler
+ * may queue more probes.  Returns the number of results dispatched.
+ */
+drm_public int drmModeProberDispatch(drmModeProberPtr prober)
+{
+	struct drm_probe_connector *c;
+	drmModeConnectorPtr connector;
+	uint32_t i, connector_id;
+	char buf[64];
+	int status, count = 0;
+
+	if (!prober)
+		return -EINVAL;
+
+	while (read(prober->notify[0], buf, sizeof(buf)) > 0)
+		;
+
+	pthread_mutex_lock(&prober->lock);
+	for (i = 0; i < prober->count_connectors; i++) {
+		c = &prober->connectors[i];
+		if (!c->has_result)
+			continue;
+
+		connector_id = c->connector_id;
+		connector = c->result;
+		status = c->status;
+		c->has_result = 0;
+		c->result = NULL;
+		if (connector) {
+			drmModeFreeConnector(c->current);
+			c->current = connector;
+		}
+		pthread_mutex_unlock(&prober->lock);
+
+		if (prober->handler)
+			prober->handler(prober->fd, connector_id, connector,
+					status, prober->user_data);
+		count++;
+
+		pthread_mutex_lock(&prober->lock);
+	}
+	pthread_mutex_unlock(&prober->lock);
+
+	return count;
+}
@@ -0,0 +1,427 @@
+/* xf86drmModeWriteback.c -- Capture through KMS writeback connectors
+ *
+ * Copyright © 2026 The libdrm authors
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice (including the next
+ * paragraph) shall be included in all copies or substantial portions of the
+ * Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL
+ * THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ *
+ * DESCRIPTION
+ *
+ * Has the display hardware write the composited output of a CRTC into a
+ * ring of framebuffers, without reading anything back on the GPU or CPU.
+ *
+ * drmModeWritebackQueue() adds the next free framebuffer of the ring to the
+ * caller's atomic request, usually the one that commits the frame anyway,
+ * together with a pointer for the out-fence.  Once the commit went through
+ * (drmModeWritebackCommitted()), the capture is in flight until its fence
+ * signals.  Writeback jobs complete in order, so the fence of the oldest one
+ * is all there is to poll: drmModeWritebackGetFd() returns it, next to the
+ * fd of the drmEventLoop, and drmModeWritebackDispatch() hands every
+ * completed capture to the handler.
+ *
+ * The first commit routing the writeback connector to the CRTC is a
+ * modeset and needs DRM_MODE_ATOMIC_ALLOW_MODESET.  The framebuffers must
+ * have a format from the connector's WRITEBACK_PIXEL_FORMATS.
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "libdrm_macros.h"
+#include "xf86drm.h"
+#include "xf86drmMode.h"
+
+#define VOID2U64(x) ((uint64_t)(unsigned long)(x))
+
+/* Framebuffers in the capture ring. */
+#define WRITEBACK_RING_SIZE 8
+
+enum drm_writeback_state {
+	DRM_WRITEBACK_FREE,
+	DRM_WRITEBACK_QUEUED,		/* in a request not committed yet */
+	DRM_WRITEBACK_BUSY,		/* committed, fence not signaled */
+};
+
+struct drm_writeback_slot {
+	uint32_t fb_id;			/* 0 if there is no framebuffer */
+	void *user_data;
+	enum drm_writeback_state state;
+	int32_t fence;			/* written by the atomic ioctl */
+	uint64_t seq;			/* commit order of busy slots */
+};
+
+struct _drmModeWriteback {
+	int fd;
+	uint32_t crtc_id;
+	uint32_t connector_id;
+	uint32_t prop_crtc_id;
+	uint32_t prop_fb_id;
+	uint32_t prop_out_fence;
+	drmModeWritebackHandler handler;
+	uint32_t next;			/* round robin over the ring */
+	uint64_t seq;
+	struct drm_writeback_slot slots[WRITEBACK_RING_SIZE];
+};
+
+static int drm_writeback_find_connector(drmModeWritebackPtr wb)
+{
+	drmModeConnectorPtr connector;
+	drmModeEncoderPtr encoder;
+	drmModeResPtr res;
+	uint32_t crtc_mask = 0;
+	int i, j, ret = -ENOENT;
+
+	res = drmModeGetResources(wb->fd);
+	if (!res)
+		return -errno;
+
+	for (i = 0; i < res->count_crtcs; i++)
+		if (res->crtcs[i] == wb->crtc_id)
+			crtc_mask = 1u << i;
+
+	for (i = 0; crtc_mask && i < res->count_connectors && ret; i++) {
+		connector = drmModeGetConnectorCurrent(wb->fd,
+						       res->connectors[i]);
+		if (!connector)
+			continue;
+
+		for (j = 0; connector->connector_type ==
+			    DRM_MODE_CONNECTOR_WRITEBACK &&
+			    j < connector->count_encoders && ret; j++) {
+			encoder = drmModeGetEncoder(wb->fd,
+						    connector->encoders[j]);
+			if (!encoder)
+				continue;
+			if (encoder->possible_crtcs & crtc_mask) {
+				wb->connector_id = connector->connector_id;
+				ret = 0;
+			}
+			drmModeFreeEncoder(encoder);
+		}
+		drmModeFreeConnector(connector);
+	}
+
+	drmModeFreeResources(res);
+	return ret;
+}
+
+static uint32_t drm_writeback_prop(drmModePropertyCachePtr props,
+				   uint32_t connector_id, const char *name)
+{
+	const drmModePropertyInfo *info;
+
+	info = drmModePropertyCacheLookup(props, connector_id,
+					  DRM_MODE_OBJECT_CONNECTOR, name);
+	return info ? info->prop_id : 0;
+}
+
+/*
+ * Set up capture of @crtc_id through the first writeback connector that can
+ * be routed to it.  Enables DRM_CLIENT_CAP_WRITEBACK_CONNECTORS, which needs
+ * DRM_CLIENT_CAP_ATOMIC to be enabled already.  Returns NULL with errno set
+ * on failure, ENOENT if no writeback connector can be used with the CRTC.
+ */
+drm_public drmModeWritebackPtr
+drmModeWritebackCreate(int fd, uint32_t crtc_id,
+		       drmModeWritebackHandler handler)
+{
+	drmModePropertyCachePtr props;
+	drmModeWritebackPtr wb;
+	int ret;
+
+	if (drmSetClientCap(fd, DRM_CLIENT_CAP_WRITEBACK_CONNECTORS, 1))
+		return NULL;
+
+	wb = drmMalloc(sizeof(*wb));
+	if (!wb) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	wb->fd = fd;
+	wb->crtc_id = crtc_id;
+	wb->handler = handler;
+
+	ret = drm_writeback_find_connector(wb);
+	if (ret)
+		goto out;
+
+	props = drmModePropertyCacheCreate(fd);
+	if (!props) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	wb->prop_crtc_id = drm_writeback_prop(props, wb->connector_id,
+					      "CRTC_ID");
+	wb->prop_fb_id = drm_writeback_prop(props, wb->connector_id,
+					    "WRITEBACK_FB_ID");
+	wb->prop_out_fence = drm_writeback_prop(props, wb->connector_id,
+						"WRITEBACK_OUT_FENCE_PTR");
+	drmModePropertyCacheDestroy(props);
+
+	if (!wb->prop_crtc_id || !wb->prop_fb_id || !wb->prop_out_fence) {
+		ret = -ENOENT;
+		goto out;
+	}
+
+	return wb;
+
+out:
+	drmFree(wb);
+	errno = -ret;
+	return NULL;
+}
+
+/*
+ * Captures still in flight are dropped, their framebuffers must stay alive
+ * until the hardware is done with them.
+ */
+drm_public void drmModeWritebackDestroy(drmModeWritebackPtr wb)
+{
+	uint32_t i;
+
+	if (!wb)
+		return;
+
+	for (i = 0; i < WRITEBACK_RING_SIZE; i++)
+		if (wb->slots[i].fence >= 0 &&
+		    wb->slots[i].state != DRM_WRITEBACK_FREE)
+			close(wb->slots[i].fence);
+	drmFree(wb);
+}
+
+drm_public uint32_t drmModeWritebackGetConnector(drmModeWritebackPtr wb)
+{
+	return wb ? wb->connector_id : 0;
+}
+
+/*
+ * Add a framebuffer to the ring; @user_data is passed to the handler for
+ * every capture into it.  Returns 0, -EEXIST or -ENOSPC.
+ */
+drm_public int drmModeWritebackAddFB(drmModeWritebackPtr wb, uint32_t fb_id,
+				     void *user_data)
+{
+	struct drm_writeback_slot *free_slot = NULL;
+	uint32_t i;
+
+	if (!wb || !fb_id)
+		return -EINVAL;
+
+	for (i = 0; i < WRITEBACK_RING_SIZE; i++) {
+		if (wb->slots[i].fb_id == fb_id)
+			return -EEXIST;
+		if (!wb->slots[i].fb_id && !free_slot)
+			free_slot = &wb->slots[i];
+	}
+	if (!free_slot)
+		return -ENOSPC;
+
+	free_slot->fb_id = fb_id;
+	free_slot->user_data = user_data;
+	free_slot->state = DRM_WRITEBACK_FREE;
+	return 0;
+}
+
+/*
+ * Take a framebuffer out of the ring, before destroying it.  Returns 0,
+ * -ENOENT, or -EBUSY while a capture into it is queued or in flight.
+ */
+drm_public int drmModeWritebackRemoveFB(drmModeWritebackPtr wb,
+					uint32_t fb_id)
+{
+	uint32_t i;
+
+	if (!wb || !fb_id)
+		return -EINVAL;
+
+	for (i = 0; i < WRITEBACK_RING_SIZE; i++) {
+		if (wb->slots[i].fb_id != fb_id)
+			continue;
+		if (wb->slots[i].state != DRM_WRITEBACK_FREE)
+			return -EBUSY;
+		wb->slots[i].fb_id = 0;
+		return 0;
+	}
+	return -ENOENT;
+}
+
+/*
+ * Add a capture into the next free framebuffer to @req.  Returns the
+ * framebuffer ID, -EBUSY if a capture is already queued or the whole ring
+ * is in flight, or -ENOMEM.  Call drmModeWritebackCommitted() with the
+ * result of the commit afterwards, also when it failed.
+ */
+drm_public int drmModeWritebackQueue(drmModeWritebackPtr wb,
+				     drmModeAtomicReqPtr req)
+{
+	struct drm_writeback_slot *slot = NULL;
+	uint32_t i, idx;
+	int cursor;
+
+	if (!wb || !req)
+		return -EINVAL;
+
+	for (i = 0; i < WRITEBACK_RING_SIZE; i++) {
+		idx = (wb->next + i) % WRITEBACK_RING_SIZE;
+		if (wb->slots[idx].state == DRM_WRITEBACK_QUEUED)
+			return -EBUSY;
+		if (!slot && wb->slots[idx].fb_id &&
+		    wb->slots[idx].state == DRM_WRITEBACK_FREE) {
+			slot = &wb->slots[idx];
+			wb->next = idx + 1;
+		}
+	}
+	if (!slot)
+		return -EBUSY;
+
+	cursor = drmModeAtomicGetCursor(req);
+	slot->fence = -1;
+	if (drmModeAtomicAddProperty(req, wb->connector_id, wb->prop_crtc_id,
+				     wb->crtc_id) < 0 ||
+	    drmModeAtomicAddProperty(req, wb->connector_id, wb->prop_fb_id,
+				     slot->fb_id) < 0 ||
+	    drmModeAtomicAddProperty(req, wb->connector_id,
+				     wb->prop_out_fence,
+				     VOID2U64(&slot->fence)) < 0) {
+		drmModeAtomicSetCursor(req, cursor);
+		return -ENOMEM;
+	}
+
+	slot->state = DRM_WRITEBACK_QUEUED;
+	return slot->fb_id;
+}
+
+/*
+ * Tell the writeback about the result of the commit of the request last
+ * passed to drmModeWritebackQueue().  A failed commit, or one the kernel
+ * returned no fence for, such as a TEST_ONLY commit, captured nothing and
+ * the framebuffer becomes free again.
+ */
+drm_public void drmModeWritebackCommitted(drmModeWritebackPtr wb, int ret)
+{
+	struct drm_writeback_slot *slot;
+	uint32_t i;
+
+	if (!wb)
+		return;
+
+	for (i = 0; i < WRITEBACK_RING_SIZE; i++) {
+		slot = &wb->slots[i];
+		if (slot->state != DRM_WRITEBACK_QUEUED)
+			continue;
+
+		if (ret == 0 && slot->fence >= 0) {
+			slot->state = DRM_WRITEBACK_BUSY;
+			slot->seq = ++wb->seq;
+		} else {
+			if (slot->fence >= 0)
+				close(slot->fence);
+			slot->fence = -1;
+			slot->state = DRM_WRITEBACK_FREE;
+		}
+	}
+}
+
+static struct drm_writeback_slot *
+drm_writeback_oldest(drmModeWritebackPtr wb, uint64_t after)
+{
+	struct drm_writeback_slot *oldest = NULL;
+	uint32_t i;
+
+	for (i = 0; i < WRITEBACK_RING_SIZE; i++) {
+		struct drm_writeback_slot *slot = &wb->slots[i];
+
+		if (slot->state == DRM_WRITEBACK_BUSY && slot->seq > after &&
+		    (!oldest || slot->seq < oldest->seq))
+			oldest = slot;
+	}
+	return oldest;
+}
+
+/*
+ * The out-fence of the oldest capture in flight, to poll for POLLIN, or -1
+ * if there is none.  It changes with every completed capture.
+ */
+drm_public int drmModeWritebackGetFd(drmModeWritebackPtr wb)
+{
+	struct drm_writeback_slot *slot;
+
+	if (!wb)
+		return -1;
+
+	slot = drm_writeback_oldest(wb, 0);
+	return slot ? slot->fence : -1;
+}
+
+/*
+ * Hand every completed capture to the handler, oldest first, without
+ * blocking.  The handler may queue the next capture, but must not destroy
+ * the writeback.  Returns the number of completed captures, or -errno.
+ */
+drm_public int drmModeWritebackDispatch(drmModeWritebackPtr wb)
+{
+	struct drm_writeback_slot *busy[WRITEBACK_RING_SIZE], *slot;
+	struct pollfd pfd[WRITEBACK_RING_SIZE];
+	uint32_t i, count = 0;
+	uint64_t seq = 0;
+	int done = 0;
+
+	if (!wb)
+		return -EINVAL;
+
+	while ((slot = drm_writeback_oldest(wb, seq))) {
+		busy[count] = slot;
+		pfd[count].fd = slot->fence;
+		pfd[count].events = POLLIN;
+		pfd[count].revents = 0;
+		seq = slot->seq;
+		count++;
+	}
+	if (!count)
+		return 0;
+
+	if (poll(pfd, count, 0) < 0)
+		return errno == EINTR ? 0 : -errno;
+
+	for (i = 0; i < count; i++) {
+		int status;
+
+		if (!pfd[i].revents)
+			continue;
+
+		slot = busy[i];
+		status = pfd[i].revents & POLLIN ? 0 : -EIO;
+		close(slot->fence);
+		slot->fence = -1;
+		slot->state = DRM_WRITEBACK_FREE;
+		done++;
+
+		if (wb->handler)
+			wb->handler(wb->fd, slot->fb_id, status,
+				    slot->user_data);
+	}
+
+	return done;
+}
@@ -27,7 +27,21 @@
  *
  * DESCRIPTION
  *
- * This file contains a straightforward skip list implementation.n
+ * This file contains a straightforward skip list implementation.
+ *
+ * Entries are carved out of per-list memory blocks and recycled through
+ * free lists sorted by entry size, so building and tearing down a list
+ * does not go through malloc for every entry, and entries allocated in
+ * sequence stay close together in memory.
+ *
+ * Levels are generated from a PRNG owned by the list and seeded with a
+ * constant, so the shape of a list only depends on the sequence of
+ * operations performed on it.
+ *
+ * The result of the last search is kept as a search finger [Pugh90], so
+ * searching for a key greater than or equal to the previous one, as done
+ * when walking a range with drmSLLookupNeighbors, starts from the finger
+ * instead of from the head of the list.
  *
  * FUTURE ENHANCEMENTS
  *
@@ -50,9 +64,7 @@
 #define SL_MAX_LEVEL   16
 #define SL_RANDOM_SEED 0xc01055a1LU
 
-#define SL_RANDOM_DECL        static void *state = NULL
-#define SL_RANDOM_INIT(seed)  if (!state) state = drmRandomCreate(seed)
-#define SL_RANDOM             drmRandom(state)
+#define SL_BLOCK_SIZE  (64 * 1024)
 
 typedef struct SLEntry {
     unsigned long     magic;	   /* SL_ENTRY_MAGIC */
@@ -62,39 +74,86 @@ typedef struct SLEntry {
     struct SLEntry    *forward[1]; /* variable sized array */
 } SLEntry, *SLEntryPtr;
 
+typedef struct SLBlock {
+    struct SLBlock    *next;
+} SLBlock, *SLBlockPtr;
+
 typedef struct SkipList {
     unsigned long    magic;	/* SL_LIST_MAGIC */
     int              level;
     int              count;
     SLEntryPtr       head;
     SLEntryPtr       p0;	/* Position for iteration */
+    void             *random;	/* Level generator */
+    SLBlockPtr       blocks;	/* Entry storage */
+    char             *bump;	/* Unused part of the newest block */
+    char             *bump_end;
+    SLEntryPtr       free[SL_MAX_LEVEL + 2]; /* Freed entries, by levels */
+    int              finger_valid;
+    unsigned long    finger_key;
+    SLEntryPtr       finger[SL_MAX_LEVEL + 1]; /* update[] of the last search */
 } SkipList, *SkipListPtr;
 
-static SLEntryPtr SLCreateEntry(int max_level, unsigned long key, void *value)
+static size_t SLEntrySize(int levels)
+{
+    size_t size = sizeof(SLEntry) + (levels - 1) * sizeof(SLEntryPtr);
+
+    return (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+}
+
+static SLEntryPtr SLCreateEntry(SkipListPtr list, int max_level,
+				unsigned long key, void *value)
 {
     SLEntryPtr entry;
+    size_t     size;
+    int        levels;
     
     if (max_level < 0 || max_level > SL_MAX_LEVEL) max_level = SL_MAX_LEVEL;
+    levels = max_level + 1;
+    size   = SLEntrySize(levels);
+
+    if (list->free[levels]) {
+	entry              = list->free[levels];
+	list->free[levels] = entry->forward[0];
+    } else {
+	if (list->bump + size > list->bump_end) {
+	    SLBlockPtr block = drmMalloc(SL_BLOCK_SIZE);
+
+	    if (!block) return NULL;
+	    block->next    = list->blocks;
+	    list->blocks   = block;
+	    list->bump     = (char *)(block + 1);
+	    list->bump_end = (char *)block + SL_BLOCK_SIZE;
+	}
+	entry       = (SLEntryPtr)list->bump;
+	list->bump += size;
+    }
 
-    entry         = drmMalloc(sizeof(*entry)
-			     + (max_level + 1) * sizeof(entry->forward[0]));
-    if (!entry) return NULL;
     entry->magic  = SL_ENTRY_MAGIC;
     entry->key    = key;
     entry->value  = value;
-    entry->levels = max_level + 1;
+    entry->levels = levels;
 
     return entry;
 }
 
-static int SLRandomLevel(void)
+static void SLFreeEntry(SkipListPtr list, SLEntryPtr entry)
 {
-    int level = 1;
-    SL_RANDOM_DECL;
+    entry->magic             = SL_FREED_MAGIC;
+    entry->forward[0]        = list->free[entry->levels];
+    list->free[entry->levels] = entry;
+}
 
-    SL_RANDOM_INIT(SL_RANDOM_SEED);
-    
-    while ((SL_RANDOM & 0x01) && level < SL_MAX_LEVEL) ++level;
+static int SLRandomLevel(SkipListPtr list)
+{
+    unsigned long bits  = drmRandom(list->random);
+    int           level = 1;
+
+    /* Each set low bit promotes the entry one more level, p = 1/2 */
+    while ((bits & 0x01) && level < SL_MAX_LEVEL) {
+	++level;
+	bits >>= 1;
+    }
     return level;
 }
 
@@ -105,10 +164,20 @@ drm_public void *drmSLCreate(void)
 
     list           = drmMalloc(sizeof(*list));
     if (!list) return NULL;
+    list->random   = drmRandomCreate(SL_RANDOM_SEED);
+    if (!list->random) {
+	drmFree(list);
+	return NULL;
+    }
     list->magic    = SL_LIST_MAGIC;
     list->level    = 0;
-    list->head     = SLCreateEntry(SL_MAX_LEVEL, 0, NULL);
+    list->head     = SLCreateEntry(list, SL_MAX_LEVEL, 0, NULL);
     list->count    = 0;
+    if (!list->head) {
+	drmRandomDestroy(list->random);
+	drmFree(list);
+	return NULL;
+    }
 
     for (i = 0; i <= SL_MAX_LEVEL; i++) list->head->forward[i] = NULL;
     
@@ -120,6 +189,7 @@ drm_public int drmSLDestroy(void *l)
     SkipListPtr   list  = (SkipListPtr)l;
     SLEntryPtr    entry;
     SLEntryPtr    next;
+    SLBlockPtr    block;
 
     if (list->magic != SL_LIST_MAGIC) return -1; /* Bad magic */
 
@@ -127,9 +197,14 @@ drm_public int drmSLDestroy(void *l)
 	if (entry->magic != SL_ENTRY_MAGIC) return -1; /* Bad magic */
 	next         = entry->forward[0];
 	entry->magic = SL_FREED_MAGIC;
-	drmFree(entry);
     }
 
+    while ((block = list->blocks)) {
+	list->blocks = block->next;
+	drmFree(block);
+    }
+
+    drmRandomDestroy(list->random);
     list->magic = SL_FREED_MAGIC;
     drmFree(list);
     return 0;
@@ -139,16 +214,46 @@ static SLEntryPtr SLLocate(void *l, unsigned long key, SLEntryPtr *update)
 {
     SkipListPtr   list  = (SkipListPtr)l;
     SLEntryPtr    entry;
-    int           i;
+    int           i, top;
 
     if (list->magic != SL_LIST_MAGIC) return NULL;
 
-    for (i = list->level, entry = list->head; i >= 0; i--) {
+    top   = list->level;
+    entry = list->head;
+
+    if (list->finger_valid && key >= list->finger_key) {
+	/*
+	 * Every finger[i] precedes the previous key and therefore the new
+	 * one.  Climb until the next entry is not before the key, the
+	 * fingers above that level are then still the right predecessors.
+	 */
+	for (top = 0; top < list->level; top++) {
+	    SLEntryPtr next = list->finger[top]->forward[top];
+
+	    if (!next || next->key >= key) break;
+	}
+	for (i = list->level; i > top; i--) update[i] = list->finger[i];
+	entry = list->finger[top];
+    }
+
+    for (i = top; i >= 0; i--) {
+	SLEntryPtr finger = list->finger_valid ? list->finger[i] : NULL;
+
+	/* A lower finger may already be further along than entry */
+	if (i < top && finger && key >= list->finger_key &&
+	    finger != list->head &&
+	    (entry == list->head || finger->key > entry->key))
+	    entry = finger;
+
 	while (entry->forward[i] && entry->forward[i]->key < key)
 	    entry = entry->forward[i];
 	update[i] = entry;
     }
 
+    for (i = 0; i <= list->level; i++) list->finger[i] = update[i];
+    list->finger_key   = key;
+    list->finger_valid = 1;
+
     return entry->forward[0];
 }
 
@@ -167,13 +272,14 @@ drm_public int drmSLInsert(void *l, unsigned long key, void *value)
     if (entry && entry->key == key) return 1; /* Already in list */
 
 
-    level = SLRandomLevel();
+    level = SLRandomLevel(list);
     if (level > list->level) {
 	level = ++list->level;
 	update[level] = list->head;
     }
 
-    entry = SLCreateEntry(level, key, value);
+    entry = SLCreateEntry(list, level, key, value);
+    if (!entry) return -1;
 
 				/* Fix up forward pointers */
     for (i = 0; i <= level; i++) {
@@ -181,6 +287,7 @@ drm_public int drmSLInsert(void *l, unsigned long key, void *value)
 	update[i]->forward[i] = entry;
     }
 
+    list->finger_valid = 0;
     ++list->count;
     return 0;			/* Added to table */
 }
@@ -204,10 +311,10 @@ drm_public int drmSLDelete(void *l, unsigned long key)
 	    update[i]->forward[i] = entry->forward[i];
     }
 
-    entry->magic = SL_FREED_MAGIC;
-    drmFree(entry);
+    SLFreeEntry(list, entry);
 
     while (list->level && !list->head->forward[list->level]) --list->level;
+    list->finger_valid = 0;
     --list->count;
     return 0;
 }